@@ -0,0 +1,49 @@
+// bench_biquad.c  (biquad cascade cycles/sample vs sections and channels)
+//
+// usage: bench_biquad [frames_per_block] [blocks]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "biquad.h"
+#include "dsp_bench.h"
+
+#define FS  48000
+
+int main(int argc, char **argv)
+{
+    const size_t frames = argc > 1 ? (size_t)atoi(argv[1]) : 768;
+    const int blocks = argc > 2 ? atoi(argv[2]) : 2000;
+    int16_t *x = malloc(frames * BIQUAD_MAX_CHANNELS * sizeof(int16_t));
+    uint32_t seed = 5;
+    for (size_t i = 0; i < frames * BIQUAD_MAX_CHANNELS; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        x[i] = (int16_t)(seed >> 16) / 2;
+    }
+
+    printf("frames/block=%zu (x86 cycles are TSC ticks)\n", frames);
+    printf("%8s %8s %12s %12s\n", "sections", "channels", "ref cyc/smp", "opt cyc/smp");
+    for (size_t sections = 1; sections <= 8; sections *= 2) {
+        for (size_t ch = 1; ch <= BIQUAD_MAX_CHANNELS; ch *= 2) {
+            biquad_config_t cfg = { .num_sections = sections, .channels = ch, .max_frames = frames };
+            for (size_t s = 0; s < sections; s++) {
+                biquad_design_highpass(20.0f + 10.0f * (float)s, 0.7071f, FS, &cfg.sections[s]);
+            }
+            biquad_t *bq;
+            if (biquad_create(&cfg, &bq) != ESP_OK) {
+                return 1;
+            }
+            const uint64_t t0 = dsp_bench_cycles();
+            for (int b = 0; b < blocks; b++) {
+                biquad_process_ref(bq, x, frames);
+            }
+            const double ref = (double)(dsp_bench_cycles() - t0) / ((double)blocks * frames * ch);
+            for (int b = 0; b < blocks; b++) {
+                biquad_process(bq, x, frames);
+            }
+            printf("%8zu %8zu %12.2f %12.2f\n", sections, ch, ref, biquad_cycles_per_sample(bq));
+            biquad_delete(bq);
+        }
+    }
+    free(x);
+    return 0;
+}
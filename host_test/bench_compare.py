@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+# bench_compare.py  (flag regressions between two bench_pipeline --json results)
+#
+# usage: bench_compare.py baseline.json current.json [--threshold PCT] [--noise-ns NS]
+#
+# A stage regresses when its ns/frame grows by more than the threshold
+# (default 10%) and by more than the noise floor (default 0.5 ns/frame, so
+# the stages that cost next to nothing don't trip on jitter). The realtime
+# factor regresses when it drops by more than the threshold, the heap when
+# streaming allocates more than before or the high-water mark grows by more
+# than the threshold. Exits 1 on any regression, 2 if the runs aren't
+# comparable (different source, rate or channels). Keep the baseline from
+# the same machine and build, and use long runs (--seconds 60 or more).
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        return json.load(f)
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Compare two bench_pipeline results")
+    ap.add_argument("baseline")
+    ap.add_argument("current")
+    ap.add_argument("--threshold", type=float, default=10.0, help="allowed slowdown, percent")
+    ap.add_argument("--noise-ns", type=float, default=0.5, help="ignore ns/frame changes below this")
+    args = ap.parse_args()
+    base = load(args.baseline)
+    cur = load(args.current)
+    limit = 1.0 + args.threshold / 100.0
+
+    for key in ("source", "sample_rate_hz", "channels"):
+        if base.get(key) != cur.get(key):
+            print(f"not comparable: {key} {base.get(key)} vs {cur.get(key)}")
+            return 2
+
+    regressions = []
+    print(f"{'stage':<12} {'base':>10} {'current':>10} {'change':>8}")
+    for name, b in base["stages"].items():
+        c = cur["stages"].get(name)
+        if c is None:
+            print(f"{name:<12} {b['ns_per_frame']:>10.2f} {'-':>10}")
+            continue
+        bn, cn = b["ns_per_frame"], c["ns_per_frame"]
+        change = (cn / bn - 1.0) * 100.0 if bn > 0 else 0.0
+        bad = cn > bn * limit and cn - bn > args.noise_ns
+        print(f"{name:<12} {bn:>10.2f} {cn:>10.2f} {change:>+7.1f}%{'  REGRESSION' if bad else ''}")
+        if bad:
+            regressions.append(f"{name} {bn:.2f} -> {cn:.2f} ns/frame")
+
+    brt, crt = base["realtime_factor"], cur["realtime_factor"]
+    print(f"realtime factor {brt:.1f}x -> {crt:.1f}x")
+    if crt * limit < brt:
+        regressions.append(f"realtime factor {brt:.1f}x -> {crt:.1f}x")
+
+    bh, ch = base["heap"], cur["heap"]
+    print(f"heap: streaming allocs {bh['stream_allocs']} -> {ch['stream_allocs']}, "
+          f"high-water {bh['high_water_bytes']} -> {ch['high_water_bytes']} bytes")
+    if ch["stream_allocs"] > bh["stream_allocs"]:
+        regressions.append(f"streaming allocs {bh['stream_allocs']} -> {ch['stream_allocs']}")
+    if ch["high_water_bytes"] > bh["high_water_bytes"] * limit:
+        regressions.append(f"heap high-water {bh['high_water_bytes']} -> {ch['high_water_bytes']} bytes")
+
+    for r in regressions:
+        print(f"REGRESSION: {r}")
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,28 @@
+// bench_dsp_kernels.c  (host wrapper around dsp_bench_run)
+//
+// usage: bench_dsp_kernels [block_len] [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "dsp_bench.h"
+
+int main(int argc, char **argv)
+{
+    const size_t block_len = argc > 1 ? (size_t)strtoul(argv[1], NULL, 0) : 768;
+    const int iterations = argc > 2 ? atoi(argv[2]) : 2000;
+
+    dsp_bench_result_t res[DSP_BENCH_MAX_RESULTS];
+    const int n = dsp_bench_run(block_len, iterations, res);
+    if (n < 0) {
+        fprintf(stderr, "allocation failed\n");
+        return 1;
+    }
+    printf("block_len=%zu iterations=%d (x86 cycles are TSC ticks)\n", block_len, iterations);
+    dsp_bench_print(res, n);
+    for (int i = 0; i < n; i++) {
+        if (!res[i].bit_exact) {
+            return 1;
+        }
+    }
+    return 0;
+}
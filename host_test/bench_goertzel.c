@@ -0,0 +1,86 @@
+// bench_goertzel.c  (Goertzel bank vs STFT for M = 1..32 bands)
+//
+// usage: bench_goertzel [seconds_of_audio] [block_len]
+//
+// Both run over the same audio with the same resolution: a Goertzel block
+// of N samples against a rectangular N-point STFT with hop N. The STFT cost
+// is independent of M, so the crossover shows how many bands the bank can
+// afford before a full spectrum is cheaper.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "goertzel.h"
+#include "stft.h"
+
+#define SAMPLE_RATE     48000
+#define CHUNK           768
+
+static double thread_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void goertzel_sink(const goertzel_result_t *r, void *ctx)
+{
+    *(float *)ctx += r->level_dbfs[0];
+}
+
+static void stft_sink(const stft_frame_t *f, void *ctx)
+{
+    *(float *)ctx += f->power[1];
+}
+
+int main(int argc, char **argv)
+{
+    const double audio_s = argc > 1 ? atof(argv[1]) : 30.0;
+    const size_t block = argc > 2 ? (size_t)atoi(argv[2]) : 512;
+    const size_t total = (size_t)(audio_s * SAMPLE_RATE) / CHUNK * CHUNK;
+    int16_t *x = malloc(total * sizeof(int16_t));
+    uint32_t seed = 3;
+    for (size_t i = 0; i < total; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        x[i] = (int16_t)(seed >> 16) / 4;
+    }
+    float sink = 0.0f;
+
+    const stft_config_t scfg = { .fft_size = block, .hop = block, .window = STFT_WINDOW_RECT };
+    stft_t *stft;
+    if (stft_create(&scfg, &stft) != ESP_OK) {
+        fprintf(stderr, "block_len must be a power of two for the STFT comparison\n");
+        return 1;
+    }
+    stft_subscribe(stft, stft_sink, &sink);
+    double t = thread_seconds();
+    for (size_t i = 0; i < total; i += CHUNK) {
+        stft_process(stft, x + i, CHUNK, i);
+    }
+    const double stft_ns = (thread_seconds() - t) * 1e9 / (double)total;
+    stft_delete(stft);
+
+    printf("block_len=%zu, STFT: %.2f ns/sample\n", block, stft_ns);
+    printf("%6s %14s %10s\n", "bands", "goertzel ns/smp", "vs STFT");
+    for (size_t m = 1; m <= GOERTZEL_MAX_BANDS; m++) {
+        goertzel_config_t cfg = { .sample_rate_hz = SAMPLE_RATE, .block_len = block, .num_bands = m };
+        for (size_t b = 0; b < m; b++) {
+            cfg.bands[b].freq_hz = 1000.0f + 700.0f * (float)b;
+            cfg.bands[b].threshold_dbfs = -30.0f;
+        }
+        goertzel_t *g;
+        if (goertzel_create(&cfg, &g) != ESP_OK) {
+            return 1;
+        }
+        goertzel_subscribe(g, goertzel_sink, &sink);
+        t = thread_seconds();
+        for (size_t i = 0; i < total; i += CHUNK) {
+            goertzel_process(g, x + i, CHUNK, i);
+        }
+        const double ns = (thread_seconds() - t) * 1e9 / (double)total;
+        printf("%6zu %14.2f %9.2fx\n", m, ns, stft_ns / ns);
+        goertzel_delete(g);
+    }
+    free(x);
+    return sink == 12345.0f;
+}
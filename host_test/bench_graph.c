@@ -0,0 +1,157 @@
+// bench_graph.c  (a dsp_graph spec at full speed: the settled plan, per-node cost, realtime factor)
+//
+// usage: bench_graph [--seconds S] [--rate HZ] [--channels N] [--block FRAMES] [spec]
+//
+// Defaults: 60 s of 48 kHz stereo in 768-frame blocks (16 ms URBs) through
+// "mono hpf stft goertzel", the firmware's default graph. The input is
+// Q31, a tone and some noise per channel, as audio_stream's frame subscribers
+// get it. The same sources build the firmware's graph, so a spec can be
+// tried and timed here before it goes into sdkconfig. Node times are per
+// source frame and include one clock read per call.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "dsp_graph_stages.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* Results go nowhere, but are read so the work can't be optimized away */
+static volatile float s_sink;
+
+static void stft_sink(const stft_frame_t *f, void *ctx)
+{
+    (void)ctx;
+    s_sink += f->power[f->nbins / 3];
+}
+
+static void goertzel_sink(const goertzel_result_t *r, void *ctx)
+{
+    (void)ctx;
+    s_sink += r->level_dbfs[0];
+}
+
+static void level_sink(level_meter_period_t period, const level_summary_t *s, void *ctx)
+{
+    (void)period;
+    (void)ctx;
+    s_sink += s->rms_dbfs;
+}
+
+static const char *format(dsp_graph_format_t f, char *buf, size_t len)
+{
+    if (f.type == DSP_GRAPH_NONE) {
+        return "-";
+    }
+    const char *type = f.type == DSP_GRAPH_Q31 ? "Q31" : "int16";
+    if (f.channels == DSP_GRAPH_ANY_CHANNELS) {
+        snprintf(buf, len, "%s x any", type);
+    } else {
+        snprintf(buf, len, "%s x %u", type, (unsigned)f.channels);
+    }
+    return buf;
+}
+
+static int usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [--seconds S] [--rate HZ] [--channels N] [--block FRAMES] [spec]\n", argv0);
+    return 2;
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 60.0;
+    uint32_t hz = 48000;
+    unsigned channels = 2;
+    size_t block = 768;
+    const char *spec = "mono hpf stft goertzel";
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-') {
+            spec = argv[i];
+            continue;
+        }
+        if (i + 1 == argc) {
+            return usage(argv[0]);
+        }
+        if (strcmp(argv[i], "--seconds") == 0) {
+            seconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--rate") == 0) {
+            hz = (uint32_t)atol(argv[++i]);
+        } else if (strcmp(argv[i], "--channels") == 0) {
+            channels = (unsigned)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--block") == 0) {
+            block = (size_t)atol(argv[++i]);
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    if (hz == 0 || hz > 384000 || channels == 0 || channels > 8 || block == 0 || seconds <= 0.0) {
+        return usage(argv[0]);
+    }
+
+    const dsp_graph_stages_config_t cfg = {
+        .sample_rate_hz = hz,
+        .max_channels = channels,
+        .max_frames = block,
+        .level_cb = level_sink,
+        .stft_cb = stft_sink,
+        .goertzel_cb = goertzel_sink,
+        .clock = now_ns,
+    };
+    dsp_graph_t *g;
+    if (dsp_graph_stages_build(spec, &cfg, &g) != ESP_OK || dsp_graph_set_sample_rate(g, hz) != ESP_OK) {
+        fprintf(stderr, "%s: can't build it\n", spec);
+        return 1;
+    }
+
+    // One second of input, replayed on a running timeline
+    int32_t *x = malloc((size_t)hz * channels * sizeof(int32_t));
+    if (x == NULL) {
+        return 1;
+    }
+    uint32_t lcg = 1;
+    for (size_t i = 0; i < hz; i++) {
+        for (size_t c = 0; c < channels; c++) {
+            lcg = lcg * 1664525u + 1013904223u;
+            const double tone = 0.25 * sin(2.0 * M_PI * (1000.0 * (double)(c + 1)) * (double)i / hz);
+            x[i * channels + c] = (int32_t)((tone + 0.01 * ((double)(lcg >> 8) / 16777216.0 - 0.5)) * 2147483647.0);
+        }
+    }
+
+    const uint64_t total = (uint64_t)(seconds * hz);
+    const uint64_t t_start = now_ns();
+    for (uint64_t t = 0; t < total;) {
+        const size_t off = (size_t)(t % hz);
+        const size_t n = block < hz - off ? block : hz - off;
+        dsp_graph_push(g, x + off * channels, n, channels, t);
+        t += n;
+    }
+    const double wall_s = (double)(now_ns() - t_start) * 1e-9;
+
+    printf("\"%s\", %u Hz x %u ch in %zu-frame blocks: %.1f s of audio in %.3f s, %.1fx realtime\n", spec,
+           (unsigned)hz, channels, block, seconds, wall_s, seconds / wall_s);
+    printf("%-10s %-12s %-12s %7s %-7s %12s %10s\n", "node", "in", "out", "frames", "feed", "calls", "ns/frame");
+    for (size_t k = 0; k < dsp_graph_num_nodes(g); k++) {
+        dsp_graph_node_info_t info;
+        dsp_graph_node_info(g, k, &info);
+        char in[16], out[16];
+        const char *feed = info.fifo ? "fifo" : info.split ? "split" : "direct";
+        printf("%-10s %-12s %-12s %7zu %-7s %12u %10.2f%s\n", info.name, format(info.in, in, sizeof(in)),
+               format(info.out, out, sizeof(out)), info.max_frames, feed, (unsigned)info.calls,
+               (double)info.time / (double)total, info.in_place ? "  in place" : "");
+    }
+    dsp_graph_delete(g);
+    free(x);
+    return 0;
+}
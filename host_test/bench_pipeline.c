@@ -0,0 +1,535 @@
+// bench_pipeline.c  (the whole receive path at full speed: per-stage cost, realtime factor, heap use)
+//
+// usage: bench_pipeline [--seconds S] [--rate HZ] [--channels N] [--replay capture.bin]
+//                       [--store capture.bin] [--json out.json]
+//
+// Defaults: 60 s of 48 kHz stereo, stored to /dev/null. A replay runs to
+// the end of the capture; a stored run can be replayed.
+//
+// Streams from a simulated high-speed UAC 2.0 microphone (a ramp per
+// channel, 24-bit), or plays back a URB capture (urb_capture.h), through
+// the firmware's own sources as the firmware wires them:
+//
+//   ingest      mock bus and device, uac_driver's URB callback
+//   compaction  packets -> Q31 frames -> the int16 stream channel
+//   hpf         DC blocker + 50 Hz Butterworth (audio_stream filter)
+//   level       level meter
+//   stft        512-point Hann STFT, hop 256
+//   goertzel    2, 4 and 8 kHz bands, 480-sample blocks
+//   encode      URB capture records written into the ring
+//   storage     the ring drained to a file, as the SD card task does
+//
+// Stage times are wall clock less the cost of reading the clock; ingest is
+// what's left of the event loop once the stages inside it are taken out.
+// malloc and friends (aligned_alloc and posix_memalign included) are
+// wrapped (-Wl,--wrap) to count allocations and
+// the heap high-water mark, up to the first sample and from then on. Prints a
+// table, and with --json the same figures for bench_compare.py.
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "audio_stream.h"
+#include "biquad.h"
+#include "class_driver.h"
+#include "dsp_kernels.h"
+#include "esp_check.h"
+#include "goertzel.h"
+#include "level_meter.h"
+#include "mock_replay.h"
+#include "mock_uac.h"
+#include "stft.h"
+#include "trace.h"
+#include "uac_driver.h"
+#include "urb_capture.h"
+
+static const char *TAG = "bench";
+
+#define CAPTURE_RING    (1u << 20)
+#define DRAIN_PASSES    5       // event passes between storage drains (100 ms in the firmware)
+#define DRAIN_MS        64      // after a replay runs out: the URBs in flight come back
+
+typedef enum {
+    STAGE_INGEST,
+    STAGE_COMPACTION,
+    STAGE_HPF,
+    STAGE_LEVEL,
+    STAGE_STFT,
+    STAGE_GOERTZEL,
+    STAGE_ENCODE,
+    STAGE_STORAGE,
+    NUM_STAGES,
+} stage_id_t;
+
+static const char *const s_stage_names[NUM_STAGES] = {
+    "ingest", "compaction", "hpf", "level", "stft", "goertzel", "encode", "storage",
+};
+
+static struct {
+    uint64_t ns;
+    uint64_t calls;
+} s_stages[NUM_STAGES];
+
+static uint64_t s_clock_ns;     // one now_ns() pair, taken off every timed call
+static uint64_t s_frames;
+static size_t s_channels;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void stage_add(stage_id_t id, uint64_t t0)
+{
+    const uint64_t dt = now_ns() - t0;
+    s_stages[id].ns += dt > s_clock_ns ? dt - s_clock_ns : 0;
+    s_stages[id].calls++;
+}
+
+static void calibrate_clock(void)
+{
+    const int n = 100000;
+    const uint64_t t0 = now_ns();
+    for (int i = 0; i < n; i++) {
+        (void)now_ns();
+    }
+    s_clock_ns = (now_ns() - t0) / n;
+}
+
+/* ---------- Allocation accounting ---------- */
+
+/* Every block carries its size and the offset back to the real block just
+ * in front of it: 16 bytes to keep malloc's alignment, more for a larger one */
+#define ALLOC_HEADER    16
+
+typedef struct {
+    size_t size;
+    size_t offset;
+} alloc_header_t;
+
+_Static_assert(sizeof(alloc_header_t) <= ALLOC_HEADER, "allocation header too large");
+
+typedef struct {
+    uint64_t allocs;
+    uint64_t frees;
+    size_t live;
+    size_t peak;
+} heap_stats_t;
+
+static heap_stats_t s_heap;
+static heap_stats_t s_heap_setup;   // at the first frame
+
+void *__real_malloc(size_t n);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t n);
+void __real_free(void *p);
+void *__real_aligned_alloc(size_t align, size_t n);
+int __real_posix_memalign(void **p, size_t align, size_t n);
+
+static alloc_header_t header_of(void *p)
+{
+    alloc_header_t h;
+    memcpy(&h, (uint8_t *)p - sizeof(h), sizeof(h));
+    return h;
+}
+
+/* `offset` bytes into block p, a multiple of the block's alignment */
+static void *heap_track_at(uint8_t *p, size_t offset, size_t n)
+{
+    if (p == NULL) {
+        return NULL;
+    }
+    const alloc_header_t h = { .size = n, .offset = offset };
+    memcpy(p + offset - sizeof(h), &h, sizeof(h));
+    s_heap.allocs++;
+    s_heap.live += n;
+    s_heap.peak = s_heap.live > s_heap.peak ? s_heap.live : s_heap.peak;
+    return p + offset;
+}
+
+static void *heap_track(uint8_t *p, size_t n)
+{
+    return heap_track_at(p, ALLOC_HEADER, n);
+}
+
+/* Header room that keeps the caller's alignment (a power of two) */
+static size_t aligned_header(size_t align)
+{
+    return align > ALLOC_HEADER ? align : ALLOC_HEADER;
+}
+
+void *__wrap_malloc(size_t n)
+{
+    return heap_track(__real_malloc(n + ALLOC_HEADER), n);
+}
+
+void *__wrap_aligned_alloc(size_t align, size_t n)
+{
+    const size_t off = aligned_header(align);
+    if (n > SIZE_MAX - off) {
+        return NULL;
+    }
+    return heap_track_at(__real_aligned_alloc(align, off + n), off, n);
+}
+
+int __wrap_posix_memalign(void **p, size_t align, size_t n)
+{
+    const size_t off = aligned_header(align);
+    if (n > SIZE_MAX - off) {
+        return ENOMEM;
+    }
+    void *block;
+    const int err = __real_posix_memalign(&block, align, off + n);
+    if (err == 0) {
+        *p = heap_track_at(block, off, n);
+    }
+    return err;
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    if (size && n > (SIZE_MAX - ALLOC_HEADER) / size) {
+        return NULL;
+    }
+    return heap_track(__real_calloc(1, n * size + ALLOC_HEADER), n * size);
+}
+
+void __wrap_free(void *p)
+{
+    if (p == NULL) {
+        return;
+    }
+    const alloc_header_t h = header_of(p);
+    s_heap.frees++;
+    s_heap.live -= h.size;
+    __real_free((uint8_t *)p - h.offset);
+}
+
+void *__wrap_realloc(void *p, size_t n)
+{
+    if (p == NULL) {
+        return __wrap_malloc(n);
+    }
+    const alloc_header_t old = header_of(p);
+    if (old.offset != ALLOC_HEADER) {
+        // From aligned_alloc: realloc only promises malloc's alignment anyway
+        void *q = __wrap_malloc(n);
+        if (q != NULL) {
+            memcpy(q, p, old.size < n ? old.size : n);
+            __wrap_free(p);
+        }
+        return q;
+    }
+    uint8_t *h = __real_realloc((uint8_t *)p - ALLOC_HEADER, n + ALLOC_HEADER);
+    if (h == NULL) {
+        return NULL;
+    }
+    s_heap.live -= old.size;
+    s_heap.frees++;
+    return heap_track(h, n);
+}
+
+/* ---------- Stages inside uac_driver ---------- */
+
+void __real_dsp_pcm_to_q31(int32_t *dst, const uint8_t *src, size_t subframe_bytes, size_t n);
+void __real_dsp_q31_to_s16(int16_t *dst, const int32_t *src, size_t stride, size_t n);
+void __real_urb_capture_urb(const usb_transfer_t *t, uint64_t t_us);
+
+void __wrap_dsp_pcm_to_q31(int32_t *dst, const uint8_t *src, size_t subframe_bytes, size_t n)
+{
+    const uint64_t t0 = now_ns();
+    __real_dsp_pcm_to_q31(dst, src, subframe_bytes, n);
+    stage_add(STAGE_COMPACTION, t0);
+}
+
+void __wrap_dsp_q31_to_s16(int16_t *dst, const int32_t *src, size_t stride, size_t n)
+{
+    const uint64_t t0 = now_ns();
+    __real_dsp_q31_to_s16(dst, src, stride, n);
+    stage_add(STAGE_COMPACTION, t0);
+}
+
+void __wrap_urb_capture_urb(const usb_transfer_t *t, uint64_t t_us)
+{
+    const uint64_t t0 = now_ns();
+    __real_urb_capture_urb(t, t_us);
+    stage_add(STAGE_ENCODE, t0);
+}
+
+/* ---------- Stages on audio_stream ---------- */
+
+typedef struct {
+    stage_id_t id;
+    audio_stream_cb_t cb;
+    void *ctx;
+} timed_sub_t;
+
+typedef struct {
+    audio_stream_filter_t fn;
+    void *ctx;
+} timed_filter_t;
+
+static void timed_sub_cb(const int16_t *samples, size_t n, uint64_t t0, void *ctx)
+{
+    const timed_sub_t *s = ctx;
+    const uint64_t t = now_ns();
+    s->cb(samples, n, t0, s->ctx);
+    stage_add(s->id, t);
+}
+
+static void timed_filter(int16_t *samples, size_t n, uint64_t t0, void *ctx)
+{
+    const timed_filter_t *f = ctx;
+    const uint64_t t = now_ns();
+    f->fn(samples, n, t0, f->ctx);
+    stage_add(STAGE_HPF, t);
+}
+
+static void frames_cb(const int32_t *frames, size_t nframes, size_t channels, uint64_t t0, void *ctx)
+{
+    if (s_frames == 0) {
+        s_heap_setup = s_heap;
+    }
+    s_frames += nframes;
+    s_channels = channels;
+}
+
+/* Results go nowhere, but are read so the work can't be optimized away */
+static volatile float s_sink;
+
+static void stft_sink(const stft_frame_t *f, void *ctx)
+{
+    s_sink += f->power[f->nbins / 3];
+}
+
+static void goertzel_sink(const goertzel_result_t *r, void *ctx)
+{
+    s_sink += r->level_dbfs[0];
+}
+
+static void level_sink(level_meter_period_t period, const level_summary_t *s, void *ctx)
+{
+    s_sink += s->rms_dbfs;
+}
+
+static biquad_t *s_hpf;
+static level_meter_t *s_meter;
+static goertzel_t *s_bank;
+
+static esp_err_t hpf_design(uint32_t hz, biquad_config_t *cfg)
+{
+    cfg->num_sections = 2;
+    ESP_RETURN_ON_ERROR(biquad_design_dc_block(2.0f, hz, &cfg->sections[0]), TAG, "dc block");
+    return biquad_design_highpass(50.0f, 0.7071f, hz, &cfg->sections[1]);
+}
+
+static void rate_cb(uint32_t hz, void *ctx)
+{
+    biquad_config_t cfg;
+    if (hpf_design(hz, &cfg) == ESP_OK) {
+        biquad_set_sections(s_hpf, cfg.sections, cfg.num_sections);
+    }
+    level_meter_set_sample_rate(s_meter, hz);
+    goertzel_set_sample_rate(s_bank, hz);
+}
+
+/* The firmware's audio_stream wiring, every stage timed */
+static esp_err_t pipeline_start(uint32_t hz)
+{
+    static timed_filter_t hpf_filter;
+    static timed_sub_t subs[3];
+    biquad_config_t bq_cfg = { .channels = 1, .max_frames = uac_driver_max_block_samples() };
+    const level_meter_config_t meter_cfg = { .sample_rate_hz = hz };
+    const stft_config_t stft_cfg = { .fft_size = 512, .hop = 256, .window = STFT_WINDOW_HANN };
+    goertzel_config_t g_cfg = { .sample_rate_hz = hz, .block_len = 480, .hann = true };
+    stft_t *stft;
+    ESP_RETURN_ON_ERROR(hpf_design(hz, &bq_cfg), TAG, "hpf");
+    ESP_RETURN_ON_ERROR(biquad_create(&bq_cfg, &s_hpf), TAG, "biquad");
+    ESP_RETURN_ON_ERROR(level_meter_create(&meter_cfg, &s_meter), TAG, "level");
+    ESP_RETURN_ON_ERROR(level_meter_subscribe(s_meter, level_sink, NULL), TAG, "level");
+    ESP_RETURN_ON_ERROR(stft_create(&stft_cfg, &stft), TAG, "stft");
+    ESP_RETURN_ON_ERROR(stft_subscribe(stft, stft_sink, NULL), TAG, "stft");
+    ESP_RETURN_ON_ERROR(goertzel_config_add_bands(&g_cfg, "2000,4000,8000", -40.0f), TAG, "goertzel");
+    ESP_RETURN_ON_ERROR(goertzel_create(&g_cfg, &s_bank), TAG, "goertzel");
+    ESP_RETURN_ON_ERROR(goertzel_subscribe(s_bank, goertzel_sink, NULL), TAG, "goertzel");
+
+    hpf_filter = (timed_filter_t) { biquad_stream_filter, s_hpf };
+    subs[0] = (timed_sub_t) { STAGE_LEVEL, level_meter_stream_cb, s_meter };
+    subs[1] = (timed_sub_t) { STAGE_STFT, stft_stream_cb, stft };
+    subs[2] = (timed_sub_t) { STAGE_GOERTZEL, goertzel_stream_cb, s_bank };
+    ESP_RETURN_ON_ERROR(audio_stream_on_rate_change(rate_cb, NULL), TAG, "rate");
+    ESP_RETURN_ON_ERROR(audio_stream_add_filter(timed_filter, &hpf_filter), TAG, "hpf");
+    for (size_t i = 0; i < 3; i++) {
+        ESP_RETURN_ON_ERROR(audio_stream_subscribe(timed_sub_cb, &subs[i]), TAG, "subscribe");
+    }
+    return audio_stream_subscribe_frames(frames_cb, NULL);
+}
+
+/* A high-speed microphone that fits `hz` x `channels` of 24-bit in one microframe */
+static void mic_init(mock_uac_t *m, uint32_t hz, unsigned channels)
+{
+    mock_uac_init(m);
+    m->uac_version = 2;
+    m->speed = USB_SPEED_HIGH;
+    m->channels = (uint8_t)channels;
+    m->subframe_size = 3;
+    m->bit_resolution = 24;
+    const size_t bytes = (hz + 7999) / 8000 * channels * 3;
+    m->ep_mult = (uint8_t)((bytes + 1023) / 1024);
+    m->ep_mps = (uint16_t)((bytes + m->ep_mult - 1) / m->ep_mult);
+    m->rates[0] = hz;
+    m->rate_hz = hz;
+}
+
+static FILE *s_storage;
+
+static void storage_drain(void)
+{
+    const uint64_t t0 = now_ns();
+    urb_capture_drain(trace_write_file, s_storage, NULL);
+    stage_add(STAGE_STORAGE, t0);
+}
+
+static void print_results(FILE *f, bool json, const char *source, uint32_t hz, unsigned channels,
+                          double audio_s, double wall_s, const heap_stats_t *setup, const heap_stats_t *run)
+{
+    uint64_t total_ns = 0;
+    for (int i = 0; i < NUM_STAGES; i++) {
+        total_ns += s_stages[i].ns;
+    }
+    const double frames = s_frames ? (double)s_frames : 1.0;
+    if (!json) {
+        fprintf(f, "%s, %u Hz x %u ch: %.1f s of audio (%llu frames) in %.3f s, %.1fx realtime\n", source,
+                (unsigned)hz, channels, audio_s, (unsigned long long)s_frames, wall_s, audio_s / wall_s);
+        fprintf(f, "%-12s %12s %10s %10s\n", "stage", "calls", "ns/frame", "share");
+        for (int i = 0; i < NUM_STAGES; i++) {
+            fprintf(f, "%-12s %12llu %10.2f %9.1f%%\n", s_stage_names[i], (unsigned long long)s_stages[i].calls,
+                    (double)s_stages[i].ns / frames, total_ns ? 100.0 * (double)s_stages[i].ns / (double)total_ns : 0.0);
+        }
+        fprintf(f, "heap: setup %llu allocs, %zu bytes live; streaming %llu allocs, %llu frees; high-water %zu bytes\n",
+                (unsigned long long)setup->allocs, setup->live, (unsigned long long)(run->allocs - setup->allocs),
+                (unsigned long long)(run->frees - setup->frees), run->peak);
+        return;
+    }
+    fprintf(f, "{\n  \"source\": \"%s\",\n  \"sample_rate_hz\": %u,\n  \"channels\": %u,\n", source, (unsigned)hz, channels);
+    fprintf(f, "  \"audio_seconds\": %.3f,\n  \"wall_seconds\": %.6f,\n  \"realtime_factor\": %.2f,\n",
+            audio_s, wall_s, audio_s / wall_s);
+    fprintf(f, "  \"frames\": %llu,\n  \"stages\": {\n", (unsigned long long)s_frames);
+    for (int i = 0; i < NUM_STAGES; i++) {
+        fprintf(f, "    \"%s\": { \"calls\": %llu, \"ns_per_frame\": %.3f }%s\n", s_stage_names[i],
+                (unsigned long long)s_stages[i].calls, (double)s_stages[i].ns / frames, i + 1 < NUM_STAGES ? "," : "");
+    }
+    fprintf(f, "  },\n  \"heap\": { \"setup_allocs\": %llu, \"setup_bytes\": %zu, \"stream_allocs\": %llu,"
+            " \"stream_frees\": %llu, \"high_water_bytes\": %zu }\n}\n",
+            (unsigned long long)setup->allocs, setup->live, (unsigned long long)(run->allocs - setup->allocs),
+            (unsigned long long)(run->frees - setup->frees), run->peak);
+}
+
+static int usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [--seconds S] [--rate HZ] [--channels N] [--replay capture.bin]\n"
+            "       [--store capture.bin] [--json out.json]\n", argv0);
+    return 2;
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 60.0;
+    uint32_t hz = 48000;
+    unsigned channels = 2;
+    const char *replay_path = NULL;
+    const char *store_path = "/dev/null";
+    const char *json_path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 == argc) {
+            return usage(argv[0]);
+        }
+        if (strcmp(argv[i], "--seconds") == 0) {
+            seconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--rate") == 0) {
+            hz = (uint32_t)atol(argv[++i]);
+        } else if (strcmp(argv[i], "--channels") == 0) {
+            channels = (unsigned)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--replay") == 0) {
+            replay_path = argv[++i];
+        } else if (strcmp(argv[i], "--store") == 0) {
+            store_path = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0) {
+            json_path = argv[++i];
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    if (hz == 0 || hz > 384000 || channels == 0 || channels > 8 || seconds <= 0.0) {
+        return usage(argv[0]);
+    }
+    calibrate_clock();
+
+    static mock_replay_t r;
+    static mock_uac_t m;
+    if (replay_path) {
+        const esp_err_t err = mock_replay_open(&r, replay_path);
+        if (err != ESP_OK) {
+            fprintf(stderr, "%s: %s\n", replay_path, err == ESP_ERR_NOT_FOUND ? "can't open it" : "not a URB capture");
+            return 1;
+        }
+        hz = r.rate_hz;
+    } else {
+        mic_init(&m, hz, channels);
+    }
+    s_storage = fopen(store_path, "wb");
+    const uac_driver_config_t cfg = { .sample_rate_hz = hz };
+    if (s_storage == NULL || uac_driver_register(&cfg) != ESP_OK || pipeline_start(hz) != ESP_OK ||
+            urb_capture_start(CAPTURE_RING) != ESP_OK || class_driver_install() != ESP_OK ||
+            (replay_path ? mock_replay_connect(&r) : mock_uac_connect(&m, NULL)) == 0) {
+        fprintf(stderr, "pipeline setup failed\n");
+        return 1;
+    }
+
+    // A replay runs to the end of the capture
+    uint64_t stop_ms = replay_path ? UINT64_MAX : (uint64_t)(seconds * 1000.0);
+    const uint64_t t_start = now_ns();
+    for (int pass = 1; mock_usb_now_ms() < stop_ms; pass++) {
+        const uint64_t t0 = now_ns();
+        class_driver_handle_events(CLASS_DRIVER_POLL_MS);
+        stage_add(STAGE_INGEST, t0);
+        if (pass % DRAIN_PASSES == 0) {
+            storage_drain();
+        }
+        if (replay_path && r.done && stop_ms == UINT64_MAX) {
+            stop_ms = mock_usb_now_ms() + DRAIN_MS;
+        }
+    }
+    storage_drain();
+    const double wall_s = (double)(now_ns() - t_start) * 1e-9;
+    const heap_stats_t run = s_heap;
+
+    // The event loop's time includes the stages the URB callback runs,
+    // each with the clock reads around it
+    for (int i = STAGE_COMPACTION; i < NUM_STAGES; i++) {
+        if (i != STAGE_STORAGE) {
+            const uint64_t inner = s_stages[i].ns + s_stages[i].calls * s_clock_ns;
+            s_stages[STAGE_INGEST].ns -= inner < s_stages[STAGE_INGEST].ns ? inner : s_stages[STAGE_INGEST].ns;
+        }
+    }
+    const double audio_s = (double)s_frames / hz;
+    const char *source = replay_path ? "replay" : "synthetic";
+    print_results(stdout, false, source, hz, (unsigned)s_channels, audio_s, wall_s, &s_heap_setup, &run);
+    if (json_path) {
+        FILE *f = fopen(json_path, "w");
+        if (f == NULL) {
+            fprintf(stderr, "%s: can't write it\n", json_path);
+            return 1;
+        }
+        print_results(f, true, source, hz, (unsigned)s_channels, audio_s, wall_s, &s_heap_setup, &run);
+        fclose(f);
+    }
+    if (replay_path) {
+        mock_replay_close(&r);
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+// bench_stft.c  (STFT frames/sec on one core)
+//
+// usage: bench_stft [seconds_of_audio]
+//
+// Feeds synthetic 48 kHz audio in 768-sample blocks (one 16-packet URB)
+// and reports frames/sec and realtime factor per FFT size and hop, using
+// thread CPU time so the figure is per core.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "stft.h"
+
+#define SAMPLE_RATE     48000
+#define BLOCK           768
+
+static double thread_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void count_cb(const stft_frame_t *f, void *ctx)
+{
+    // Touch the output so the work can't be optimized away
+    *(float *)ctx += f->power[f->nbins / 3];
+}
+
+int main(int argc, char **argv)
+{
+    const double audio_s = argc > 1 ? atof(argv[1]) : 60.0;
+    const size_t total = (size_t)(audio_s * SAMPLE_RATE) / BLOCK * BLOCK;
+    int16_t *x = malloc(total * sizeof(int16_t));
+    uint32_t seed = 1;
+    for (size_t i = 0; i < total; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        x[i] = (int16_t)(8000.0 * sin(0.05 * (double)i) + (int16_t)(seed >> 16) / 8);
+    }
+
+    printf("%8s %6s %12s %10s\n", "fft_size", "hop", "frames/s", "x realtime");
+    static const size_t sizes[] = { 256, 512, 1024, 2048, 4096 };
+    for (size_t si = 0; si < sizeof(sizes) / sizeof(sizes[0]); si++) {
+        for (size_t div = 2; div <= 4; div += 2) {
+            const stft_config_t cfg = { .fft_size = sizes[si], .hop = sizes[si] / div, .window = STFT_WINDOW_HANN };
+            stft_t *s;
+            if (stft_create(&cfg, &s) != ESP_OK) {
+                return 1;
+            }
+            float sink = 0.0f;
+            stft_subscribe(s, count_cb, &sink);
+            const double t0 = thread_seconds();
+            for (size_t i = 0; i < total; i += BLOCK) {
+                stft_process(s, x + i, BLOCK, i);
+            }
+            const double dt = thread_seconds() - t0;
+            const double frames = (double)((total - cfg.fft_size) / cfg.hop + 1);
+            printf("%8zu %6zu %12.0f %10.1f\n", cfg.fft_size, cfg.hop, frames / dt, audio_s / dt);
+            stft_delete(s);
+        }
+    }
+    free(x);
+    return 0;
+}
@@ -0,0 +1,56 @@
+// dlog_cat.c  (print the deferred log records in a UART capture)
+//
+// usage: dlog_cat firmware.elf [capture|-]
+//
+//   stty -F /dev/ttyUSB1 921600 raw && dlog_cat build/usb_host_lib_example.elf /dev/ttyUSB1
+//
+// The ELF must be the exact build that produced the capture: records only
+// carry the addresses of their format strings.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "dlog_decode.h"
+
+static void print_line(const char *line, void *ctx)
+{
+    (void)ctx;
+    printf("%s\n", line);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s firmware.elf [capture|-]\n", argv[0]);
+        return 2;
+    }
+    static dlog_elf_t elf;
+    const esp_err_t err = dlog_elf_load(argv[1], &elf);
+    if (err != ESP_OK) {
+        fprintf(stderr, "%s: %s\n", argv[1],
+                err == ESP_ERR_NOT_FOUND ? "can't read it" : "not a little-endian ELF with dlog.c linked in");
+        return 1;
+    }
+    int fd = STDIN_FILENO;
+    if (argc > 2 && strcmp(argv[2], "-") != 0) {
+        fd = open(argv[2], O_RDONLY);
+        if (fd < 0) {
+            perror(argv[2]);
+            return 1;
+        }
+    }
+    static dlog_decoder_t dec;
+    dlog_decoder_init(&dec, &elf);
+    uint8_t buf[4096];
+    ssize_t n;
+    // read(), not fread(): a serial port returns whatever has arrived
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        dlog_decoder_feed(&dec, buf, (size_t)n, print_line, NULL);
+        fflush(stdout);
+    }
+    fprintf(stderr, "%u records, %u before an anchor, %u bad frames, %llu bytes skipped\n", (unsigned)dec.records,
+            (unsigned)dec.unplaced, (unsigned)dec.bad_frames, (unsigned long long)dec.skipped_bytes);
+    dlog_elf_free(&elf);
+    return 0;
+}
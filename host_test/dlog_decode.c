@@ -0,0 +1,212 @@
+// dlog_decode.c  (host side of dlog.h: find record frames in a byte stream, format them with the firmware ELF)
+
+#include <elf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dlog_decode.h"
+#include "metrics.h"
+
+static uint64_t get_le(const uint8_t *p, size_t n)
+{
+    uint64_t v = 0;
+    for (size_t i = 0; i < n; i++) {
+        v |= (uint64_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+/* ---------- ELF ---------- */
+static esp_err_t elf_sections(dlog_elf_t *elf)
+{
+    const uint8_t *e = elf->image;
+    if (elf->size < EI_NIDENT || memcmp(e, ELFMAG, SELFMAG) != 0 || e[EI_DATA] != ELFDATA2LSB) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    const bool is64 = e[EI_CLASS] == ELFCLASS64;
+    if (!is64 && e[EI_CLASS] != ELFCLASS32) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    // Field offsets of the two header layouts
+    const size_t ehdr = is64 ? sizeof(Elf64_Ehdr) : sizeof(Elf32_Ehdr);
+    if (elf->size < ehdr) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    const uint16_t type = (uint16_t)get_le(e + 16, 2);
+    const uint64_t shoff = is64 ? get_le(e + 40, 8) : get_le(e + 32, 4);
+    const size_t shentsize = (size_t)get_le(e + (is64 ? 58 : 46), 2);
+    const size_t shnum = (size_t)get_le(e + (is64 ? 60 : 48), 2);
+    if (shoff > elf->size || shnum > (elf->size - shoff) / (shentsize ? shentsize : 1)) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    elf->pie = type == ET_DYN;
+    elf->abi.ptr_size = is64 ? 8 : 4;
+    elf->abi.long_size = is64 ? 8 : 4;
+    elf->num_sections = 0;
+    for (size_t i = 0; i < shnum && elf->num_sections < DLOG_ELF_MAX_SECTIONS; i++) {
+        const uint8_t *sh = e + shoff + i * shentsize;
+        const uint32_t sh_type = (uint32_t)get_le(sh + 4, 4);
+        const uint64_t flags = is64 ? get_le(sh + 8, 8) : get_le(sh + 8, 4);
+        const uint64_t addr = is64 ? get_le(sh + 16, 8) : get_le(sh + 12, 4);
+        const uint64_t offset = is64 ? get_le(sh + 24, 8) : get_le(sh + 16, 4);
+        const uint64_t size = is64 ? get_le(sh + 32, 8) : get_le(sh + 20, 4);
+        if (sh_type != SHT_PROGBITS || !(flags & SHF_ALLOC) || offset > elf->size || size > elf->size - offset) {
+            continue;
+        }
+        elf->section[elf->num_sections].addr = addr;
+        elf->section[elf->num_sections].size = size;
+        elf->section[elf->num_sections].offset = offset;
+        elf->num_sections++;
+    }
+    // dlog_anchor's text, where the image says it is
+    const size_t alen = strlen(dlog_anchor) + 1;
+    for (size_t i = 0; i < elf->num_sections; i++) {
+        const uint8_t *base = e + elf->section[i].offset;
+        for (uint64_t off = 0; off + alen <= elf->section[i].size; off++) {
+            if (base[off] == (uint8_t)dlog_anchor[0] && memcmp(base + off, dlog_anchor, alen) == 0) {
+                elf->anchor_addr = elf->section[i].addr + off;
+                return ESP_OK;
+            }
+        }
+    }
+    return ESP_ERR_INVALID_VERSION;
+}
+
+esp_err_t dlog_elf_load(const char *path, dlog_elf_t *elf)
+{
+    memset(elf, 0, sizeof(*elf));
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    fseek(f, 0, SEEK_END);
+    const long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    elf->image = size > 0 ? malloc((size_t)size) : NULL;
+    const bool ok = elf->image && fread(elf->image, 1, (size_t)size, f) == (size_t)size;
+    fclose(f);
+    if (!ok) {
+        dlog_elf_free(elf);
+        return ESP_ERR_NOT_FOUND;
+    }
+    elf->size = (size_t)size;
+    const esp_err_t err = elf_sections(elf);
+    if (err != ESP_OK) {
+        dlog_elf_free(elf);
+    }
+    return err;
+}
+
+void dlog_elf_free(dlog_elf_t *elf)
+{
+    free(elf->image);
+    elf->image = NULL;
+    elf->size = 0;
+}
+
+const char *dlog_elf_string(const dlog_elf_t *elf, uint64_t addr)
+{
+    for (size_t i = 0; i < elf->num_sections; i++) {
+        if (addr < elf->section[i].addr || addr - elf->section[i].addr >= elf->section[i].size) {
+            continue;
+        }
+        const uint64_t off = addr - elf->section[i].addr;
+        const char *s = (const char *)elf->image + elf->section[i].offset + off;
+        // Only if it ends inside the section
+        return memchr(s, '\0', (size_t)(elf->section[i].size - off)) ? s : NULL;
+    }
+    return NULL;
+}
+
+/* ---------- Stream ---------- */
+void dlog_decoder_init(dlog_decoder_t *d, const dlog_elf_t *elf)
+{
+    memset(d, 0, sizeof(*d));
+    d->elf = elf;
+    // A fixed-address image needs no anchor
+    d->have_bias = !elf->pie;
+}
+
+static const char *resolve(uint64_t addr, void *ctx)
+{
+    const dlog_decoder_t *d = ctx;
+    return dlog_elf_string(d->elf, addr - (uint64_t)d->bias);
+}
+
+static void decode_frame(dlog_decoder_t *d, const uint8_t *payload, size_t len, dlog_line_cb_t cb, void *ctx)
+{
+    if (d->buf[2] == DLOG_FRAME_ANCHOR && len == 8) {
+        d->bias = (int64_t)(get_le(payload, 8) - d->elf->anchor_addr);
+        d->have_bias = true;
+        return;
+    }
+    if (d->buf[2] != DLOG_FRAME_RECORD || len < 25) {
+        d->bad_frames++;
+        return;
+    }
+    d->records++;
+    if (!d->have_bias) {
+        d->unplaced++;
+        return;
+    }
+    static const char letter[] = "?EWI";
+    const unsigned level = payload[0] <= DLOG_INFO ? payload[0] : 0;
+    const char *tag = resolve(get_le(payload + 9, 8), d);
+    const char *fmt = resolve(get_le(payload + 17, 8), d);
+    char line[512];
+    int n = snprintf(line, sizeof(line), "%c (%llu) %s: ", letter[level],
+                     (unsigned long long)(get_le(payload + 1, 8) / 1000), tag ? tag : "?");
+    if (fmt) {
+        dlog_format_args(fmt, payload + 25, len - 25, &d->elf->abi, resolve, d, line + n, sizeof(line) - (size_t)n);
+    } else {
+        snprintf(line + n, sizeof(line) - (size_t)n, "<format 0x%llx not in the ELF>",
+                 (unsigned long long)get_le(payload + 17, 8));
+    }
+    cb(line, ctx);
+}
+
+static void drop(dlog_decoder_t *d, size_t n)
+{
+    memmove(d->buf, d->buf + n, d->len - n);
+    d->len -= n;
+}
+
+void dlog_decoder_feed(dlog_decoder_t *d, const uint8_t *data, size_t len, dlog_line_cb_t cb, void *ctx)
+{
+    while (len) {
+        const size_t n = len < sizeof(d->buf) - d->len ? len : sizeof(d->buf) - d->len;
+        memcpy(d->buf + d->len, data, n);
+        d->len += n;
+        data += n;
+        len -= n;
+
+        while (d->len >= 2) {
+            if (d->buf[0] != DLOG_SYNC0 || d->buf[1] != DLOG_SYNC1) {
+                const uint8_t *s = memchr(d->buf + 1, DLOG_SYNC0, d->len - 1);
+                const size_t skip = s ? (size_t)(s - d->buf) : d->len;
+                d->skipped_bytes += skip;
+                drop(d, skip);
+                continue;
+            }
+            if (d->len < 4) {
+                break;
+            }
+            const size_t total = 4u + d->buf[3] + 2u;
+            if (total > DLOG_FRAME_MAX) {
+                d->skipped_bytes++;
+                drop(d, 1);
+                continue;
+            }
+            if (d->len < total) {
+                break;
+            }
+            if (metrics_crc16(d->buf + 2, total - 4) != get_le(d->buf + total - 2, 2)) {
+                d->skipped_bytes++;
+                drop(d, 1);
+                continue;
+            }
+            decode_frame(d, d->buf + 4, d->buf[3], cb, ctx);
+            drop(d, total);
+        }
+    }
+}
@@ -0,0 +1,65 @@
+// dlog_decode.h  (host side of dlog.h: find record frames in a byte stream, format them with the firmware ELF)
+//
+// Format strings, tags and %s arguments are looked up by address in the
+// ELF's loaded sections; an anchor frame gives the load address of a
+// position-independent image. Bytes that aren't a dlog frame with a valid
+// CRC (console text, metrics frames on the same UART) are skipped.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "dlog.h"
+
+#define DLOG_ELF_MAX_SECTIONS   64
+
+typedef struct {
+    uint8_t *image;                     /**< The whole file */
+    size_t size;
+    bool pie;                           /**< ET_DYN: addresses need the anchor */
+    dlog_abi_t abi;
+    size_t num_sections;
+    struct {
+        uint64_t addr;
+        uint64_t size;
+        uint64_t offset;
+    } section[DLOG_ELF_MAX_SECTIONS];   /**< Allocated sections with contents */
+    uint64_t anchor_addr;               /**< Where dlog_anchor is in the file's address space */
+} dlog_elf_t;
+
+typedef void (*dlog_line_cb_t)(const char *line, void *ctx);
+
+typedef struct {
+    const dlog_elf_t *elf;
+    bool have_bias;
+    int64_t bias;                       /**< Load address - ELF address */
+    uint8_t buf[DLOG_FRAME_MAX];
+    size_t len;
+    uint32_t records;
+    uint32_t unplaced;                  /**< Records of a PIE before any anchor */
+    uint32_t bad_frames;
+    uint64_t skipped_bytes;
+} dlog_decoder_t;
+
+/**
+ * @brief Load a little-endian ELF32 or ELF64 file
+ *
+ * @return ESP_ERR_NOT_FOUND if it can't be read, ESP_ERR_INVALID_VERSION if
+ *         it isn't such an ELF or has no dlog_anchor
+ */
+esp_err_t dlog_elf_load(const char *path, dlog_elf_t *elf);
+
+void dlog_elf_free(dlog_elf_t *elf);
+
+/**
+ * @brief NUL-terminated string at an ELF address, NULL if there is none
+ */
+const char *dlog_elf_string(const dlog_elf_t *elf, uint64_t addr);
+
+void dlog_decoder_init(dlog_decoder_t *d, const dlog_elf_t *elf);
+
+/**
+ * @brief Consume `len` bytes; `cb` gets the text of every record completed by them
+ */
+void dlog_decoder_feed(dlog_decoder_t *d, const uint8_t *data, size_t len, dlog_line_cb_t cb, void *ctx);
@@ -0,0 +1,104 @@
+// metrics_cat.c  (print the metrics frames in a UART capture)
+//
+// usage: metrics_cat [capture|-]
+//
+//   stty -F /dev/ttyUSB1 921600 raw && metrics_cat /dev/ttyUSB1
+//
+// One line per values frame: counters as total and rate since the previous
+// frame, gauges as is, histograms as the count since the previous frame
+// with the bucket bounds of its median and 99th percentile. Console text
+// on the same UART is skipped.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "metrics_decode.h"
+
+typedef struct {
+    bool have_prev;
+    metrics_frame_t prev;
+} cat_state_t;
+
+/* Upper bound of the bucket holding the q-quantile of `n` counts */
+static uint32_t quantile_bound(const uint32_t *n, uint32_t total, double q)
+{
+    uint32_t seen = 0;
+    for (unsigned b = 0; b < METRICS_HIST_BUCKETS; b++) {
+        seen += n[b];
+        if (seen > 0 && seen >= q * total) {
+            return b == 0 ? 0 : b == METRICS_HIST_BUCKETS - 1 ? UINT32_MAX : (1u << b) - 1;
+        }
+    }
+    return UINT32_MAX;
+}
+
+static void frame_cb(const metrics_frame_t *f, void *ctx)
+{
+    cat_state_t *st = ctx;
+    // A different schema or a reset device: start over
+    const bool prev = st->have_prev && st->prev.count == f->count && st->prev.t_us < f->t_us;
+    const double dt = prev ? (double)(f->t_us - st->prev.t_us) * 1e-6 : 0.0;
+    printf("[%10.3f s] #%u", (double)f->t_us * 1e-6, (unsigned)f->seq);
+    for (size_t i = 0; i < f->count; i++) {
+        const metrics_value_t *v = &f->values[i];
+        const metrics_value_t *p = prev ? &st->prev.values[i] : NULL;
+        switch (v->kind) {
+        case METRICS_COUNTER:
+            printf(" %s=%u", v->name, (unsigned)v->count);
+            if (p) {
+                printf(" (%.1f/s)", (double)(uint32_t)(v->count - p->count) / dt);
+            }
+            break;
+        case METRICS_GAUGE:
+            printf(" %s=%d", v->name, (int)v->value);
+            break;
+        case METRICS_HISTOGRAM: {
+            uint32_t n[METRICS_HIST_BUCKETS];
+            uint32_t total = 0;
+            for (unsigned b = 0; b < METRICS_HIST_BUCKETS; b++) {
+                n[b] = v->buckets[b] - (p ? p->buckets[b] : 0);
+                total += n[b];
+            }
+            printf(" %s:n=%u", v->name, (unsigned)total);
+            if (total) {
+                const uint32_t p50 = quantile_bound(n, total, 0.5), p99 = quantile_bound(n, total, 0.99);
+                if (p99 == UINT32_MAX) {
+                    printf(",p50<=%u,p99>=%u", (unsigned)p50, 1u << (METRICS_HIST_BUCKETS - 2));
+                } else {
+                    printf(",p50<=%u,p99<=%u", (unsigned)p50, (unsigned)p99);
+                }
+            }
+            break;
+        }
+        }
+    }
+    printf("\n");
+    st->prev = *f;
+    st->have_prev = true;
+}
+
+int main(int argc, char **argv)
+{
+    int fd = STDIN_FILENO;
+    if (argc > 1 && strcmp(argv[1], "-") != 0) {
+        fd = open(argv[1], O_RDONLY);
+        if (fd < 0) {
+            perror(argv[1]);
+            return 1;
+        }
+    }
+    static metrics_decoder_t dec;
+    static cat_state_t st;
+    metrics_decoder_init(&dec);
+    uint8_t buf[4096];
+    ssize_t n;
+    // read(), not fread(): a serial port returns whatever has arrived
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        metrics_decoder_feed(&dec, buf, (size_t)n, frame_cb, &st);
+        fflush(stdout);
+    }
+    fprintf(stderr, "%u frames, %u bad, %u without schema, %llu bytes skipped\n", (unsigned)dec.frames,
+            (unsigned)dec.bad_frames, (unsigned)dec.unknown_frames, (unsigned long long)dec.skipped_bytes);
+    return 0;
+}
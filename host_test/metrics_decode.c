@@ -0,0 +1,162 @@
+// metrics_decode.c  (host side of metrics.h: find, check and decode export frames in a byte stream)
+
+#include <string.h>
+#include "metrics_decode.h"
+
+void metrics_decoder_init(metrics_decoder_t *d)
+{
+    memset(d, 0, sizeof(*d));
+}
+
+static uint64_t get_le(const uint8_t *p, size_t n)
+{
+    uint64_t v = 0;
+    for (size_t i = 0; i < n; i++) {
+        v |= (uint64_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+static bool get_varint(const uint8_t **p, const uint8_t *end, uint32_t *v)
+{
+    *v = 0;
+    for (unsigned shift = 0; shift < 35 && *p < end; shift += 7) {
+        const uint8_t b = *(*p)++;
+        *v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_schema(metrics_decoder_t *d, size_t count, const uint8_t *p, const uint8_t *end)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (end - p < 2 || p[0] > METRICS_HISTOGRAM || p[1] > METRICS_NAME_LEN || end - p < 2 + p[1]) {
+            d->schema_count = 0;
+            return false;
+        }
+        d->kind[i] = (metrics_kind_t)p[0];
+        memcpy(d->name[i], p + 2, p[1]);
+        d->name[i][p[1]] = '\0';
+        p += 2 + p[1];
+    }
+    d->schema_count = count;
+    return p == end;
+}
+
+static bool parse_values(const metrics_decoder_t *d, metrics_frame_t *f, const uint8_t *p, const uint8_t *end)
+{
+    for (size_t i = 0; i < f->count; i++) {
+        metrics_value_t *v = &f->values[i];
+        v->kind = d->kind[i];
+        v->name = d->name[i];
+        uint32_t x;
+        switch (v->kind) {
+        case METRICS_COUNTER:
+            if (!get_varint(&p, end, &v->count)) {
+                return false;
+            }
+            break;
+        case METRICS_GAUGE:
+            if (!get_varint(&p, end, &x)) {
+                return false;
+            }
+            v->value = (int32_t)((x >> 1) ^ (0u - (x & 1)));
+            break;
+        case METRICS_HISTOGRAM:
+            for (size_t b = 0; b < METRICS_HIST_BUCKETS; b++) {
+                if (!get_varint(&p, end, &v->buckets[b])) {
+                    return false;
+                }
+            }
+            break;
+        }
+    }
+    return p == end;
+}
+
+/* Decode the complete, CRC-checked frame at the start of buf */
+static void decode_frame(metrics_decoder_t *d, size_t payload, metrics_frame_cb_t cb, void *ctx)
+{
+    const uint8_t *h = d->buf;
+    const uint8_t *p = h + METRICS_HEADER_LEN;
+    const size_t count = h[3];
+    if (h[2] == METRICS_FRAME_SCHEMA) {
+        d->frames++;
+        if (!parse_schema(d, count, p, p + payload)) {
+            d->bad_frames++;
+        }
+        return;
+    }
+    if (h[2] != METRICS_FRAME_VALUES) {
+        d->bad_frames++;
+        return;
+    }
+    d->frames++;
+    if (d->schema_count != count || count == 0) {
+        d->unknown_frames++;
+        return;
+    }
+    metrics_frame_t *f = &d->frame;
+    f->seq = (uint32_t)get_le(h + 6, 4);
+    f->t_us = get_le(h + 10, 8);
+    f->count = count;
+    if (!parse_values(d, f, p, p + payload)) {
+        d->bad_frames++;
+        return;
+    }
+    cb(f, ctx);
+}
+
+static void drop(metrics_decoder_t *d, size_t n)
+{
+    memmove(d->buf, d->buf + n, d->len - n);
+    d->len -= n;
+}
+
+void metrics_decoder_feed(metrics_decoder_t *d, const uint8_t *data, size_t len, metrics_frame_cb_t cb, void *ctx)
+{
+    while (len) {
+        const size_t n = len < sizeof(d->buf) - d->len ? len : sizeof(d->buf) - d->len;
+        memcpy(d->buf + d->len, data, n);
+        d->len += n;
+        data += n;
+        len -= n;
+
+        while (d->len >= 2) {
+            if (d->buf[0] != METRICS_SYNC0 || d->buf[1] != METRICS_SYNC1) {
+                // Console text or a torn frame: resync on the next sync byte
+                const uint8_t *s = memchr(d->buf + 1, METRICS_SYNC0, d->len - 1);
+                const size_t skip = s ? (size_t)(s - d->buf) : d->len;
+                d->skipped_bytes += skip;
+                drop(d, skip);
+                continue;
+            }
+            if (d->len < METRICS_HEADER_LEN) {
+                break;
+            }
+            const size_t payload = (size_t)get_le(d->buf + 4, 2);
+            const size_t total = METRICS_HEADER_LEN + payload + 2;
+            if (total > METRICS_FRAME_MAX || d->buf[3] > METRICS_MAX) {
+                d->bad_frames++;
+                d->skipped_bytes++;
+                drop(d, 1);
+                continue;
+            }
+            if (d->len < total) {
+                break;
+            }
+            if (metrics_crc16(d->buf + 2, total - 4) != get_le(d->buf + total - 2, 2)) {
+                // Sync bytes that happened to appear in text, or a damaged frame
+                d->bad_frames++;
+                d->skipped_bytes++;
+                drop(d, 1);
+                continue;
+            }
+            decode_frame(d, payload, cb, ctx);
+            drop(d, total);
+        }
+    }
+}
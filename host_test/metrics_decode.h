@@ -0,0 +1,41 @@
+// metrics_decode.h  (host side of metrics.h: find, check and decode export frames in a byte stream)
+//
+// The stream may be a UART capture with console text mixed in: bytes
+// outside a frame with a valid CRC are skipped. Values frames are decoded
+// against the last schema frame with the same metric count.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "metrics.h"
+
+typedef struct {
+    uint32_t seq;
+    uint64_t t_us;
+    size_t count;
+    metrics_value_t values[METRICS_MAX];    /**< Names point into the decoder's schema */
+} metrics_frame_t;
+
+typedef void (*metrics_frame_cb_t)(const metrics_frame_t *frame, void *ctx);
+
+typedef struct {
+    uint8_t buf[METRICS_FRAME_MAX];
+    size_t len;
+    size_t schema_count;                    /**< 0 until a schema frame arrives */
+    metrics_kind_t kind[METRICS_MAX];
+    char name[METRICS_MAX][METRICS_NAME_LEN + 1];
+    uint32_t frames;
+    uint32_t bad_frames;                    /**< CRC or layout errors */
+    uint32_t unknown_frames;                /**< Values without a matching schema */
+    uint64_t skipped_bytes;
+    metrics_frame_t frame;                  /**< Handed to the callback */
+} metrics_decoder_t;
+
+void metrics_decoder_init(metrics_decoder_t *d);
+
+/**
+ * @brief Consume `len` bytes; `cb` gets every values frame completed by them
+ */
+void metrics_decoder_feed(metrics_decoder_t *d, const uint8_t *data, size_t len, metrics_frame_cb_t cb, void *ctx);
@@ -0,0 +1,127 @@
+// mock_audiomoth.c  (simulated AudioMoth USB Microphone on top of mock_usb_host)
+
+#include <string.h>
+#include "mock_audiomoth.h"
+
+#define AUDIOMOTH_VID   0x16D0
+#define AUDIOMOTH_PID   0x06F3
+
+void mock_audiomoth_init(mock_audiomoth_t *am)
+{
+    memset(am, 0, sizeof(*am));
+    am->time = 1700000000;
+    am->settings = (audiomoth_settings_t) {
+        .sample_rate_hz = 48000,
+        .gain = 2,
+        .led = true,
+    };
+    am->version[0] = 1;
+    am->version[1] = 2;
+    const uint8_t uid[8] = { 0x24, 0x3B, 0x1A, 0x05, 0x5F, 0x6E, 0x2C, 0x41 };
+    memcpy(am->uid, uid, sizeof(uid));
+    am->battery = 42;
+    am->latency_ms = 1;
+}
+
+/* AC 0, AS 1 (alt 0 idle, alt 1 on EP 0x82) and HID 2, as the real descriptor dump */
+static size_t build_config(uint8_t *d, uint32_t rate_hz)
+{
+    size_t n = 0;
+    const uint16_t mps = (uint16_t)((rate_hz + 999) / 1000 * 2);
+#define PUT(...) do { const uint8_t b_[] = { __VA_ARGS__ }; memcpy(d + n, b_, sizeof(b_)); n += sizeof(b_); } while (0)
+    PUT(9, 0x02, 0, 0, 3, 1, 0, 0x80, 50);
+    PUT(9, 0x04, 0, 0, 0, 0x01, 0x01, 0, 0);
+    PUT(9, 0x24, 0x01, 0x00, 0x01, 30, 0, 1, 1);
+    PUT(12, 0x24, 0x02, 1, 0x01, 0x02, 0, 1, 0, 0, 0, 0);
+    PUT(9, 0x24, 0x03, 2, 0x01, 0x01, 0, 1, 0);
+    PUT(9, 0x04, 1, 0, 0, 0x01, 0x02, 0, 0);
+    PUT(9, 0x04, 1, 1, 1, 0x01, 0x02, 0, 0);
+    PUT(7, 0x24, 0x01, 2, 1, 0x01, 0x00);
+    PUT(11, 0x24, 0x02, 0x01, 1, 2, 16, 1, rate_hz & 0xFF, (rate_hz >> 8) & 0xFF, (rate_hz >> 16) & 0xFF);
+    PUT(9, 0x05, 0x82, 0x0D, mps & 0xFF, mps >> 8, 1, 0, 0);
+    PUT(7, 0x25, 0x01, 0x00, 0, 0, 0);
+    PUT(9, 0x04, 2, 0, 2, 0x03, 0x00, 0x00, 0);
+    PUT(9, 0x21, 0x11, 0x01, 0, 1, 0x22, 34, 0);
+    PUT(7, 0x05, 0x81, 0x03, 64, 0, 1);
+    PUT(7, 0x05, 0x01, 0x03, 64, 0, 1);
+#undef PUT
+    d[2] = n & 0xFF;
+    d[3] = (uint8_t)(n >> 8);
+    return n;
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = v >> 24;
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void hid_out(uint8_t addr, uint8_t ep, const uint8_t *data, size_t len, void *ctx)
+{
+    mock_audiomoth_t *am = ctx;
+    if (ep != 0x01 || len < 1) {
+        return;
+    }
+    am->requests++;
+    if (am->mute) {
+        return;
+    }
+    uint8_t rep[AUDIOMOTH_HID_REPORT_LEN] = { data[0] };
+    const uint64_t now_ms = mock_usb_now_ms();
+    switch (data[0]) {
+    case AUDIOMOTH_HID_SET_TIME:
+        am->time = get_le32(data + 1);
+        am->time_set_ms = now_ms;
+        put_le32(rep + 1, am->time);
+        break;
+    case AUDIOMOTH_HID_GET_TIME:
+        put_le32(rep + 1, am->time + (uint32_t)((now_ms - am->time_set_ms) / 1000));
+        break;
+    case AUDIOMOTH_HID_GET_UID:
+        memcpy(rep + 1, am->uid, sizeof(am->uid));
+        break;
+    case AUDIOMOTH_HID_GET_BATTERY:
+        rep[1] = am->battery;
+        break;
+    case AUDIOMOTH_HID_SET_APP_PACKET:
+        audiomoth_settings_decode(data + 1, &am->settings);
+        audiomoth_settings_encode(&am->settings, rep + 1);
+        break;
+    case AUDIOMOTH_HID_GET_APP_PACKET:
+        audiomoth_settings_encode(&am->settings, rep + 1);
+        break;
+    case AUDIOMOTH_HID_GET_FIRMWARE_VERSION:
+        memcpy(rep + 1, am->version, sizeof(am->version));
+        break;
+    default:
+        // Unknown commands come back as a zeroed report, like the firmware's default case
+        rep[0] = 0;
+        break;
+    }
+    mock_usb_device_send(addr, 0x81, rep, sizeof(rep));
+}
+
+uint8_t mock_audiomoth_connect(mock_audiomoth_t *am, const char *serial)
+{
+    build_config(am->config_desc, am->settings.sample_rate_hz);
+    const mock_usb_device_config_t dev = {
+        .speed = USB_SPEED_FULL,
+        .vid = AUDIOMOTH_VID,
+        .pid = AUDIOMOTH_PID,
+        .serial = serial,
+        .config_desc = am->config_desc,
+        .ctx = am,
+        .ctrl_latency_ms = am->latency_ms,
+        .data_out = hid_out,
+        .data_latency_ms = am->latency_ms,
+    };
+    am->addr = mock_usb_connect(&dev);
+    return am->addr;
+}
@@ -0,0 +1,53 @@
+// mock_audiomoth.h  (simulated AudioMoth USB Microphone on top of mock_usb_host)
+//
+// Presents the same interfaces as the real device: Audio Control (0),
+// Audio Streaming (1, alt 1 on ISO EP 0x82) and the HID configuration
+// channel (2, interrupt EP 0x01 OUT / 0x81 IN), and answers the HID
+// configuration protocol from the state below, which tests can inspect
+// and tweak between requests.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "audiomoth_hid.h"
+#include "mock_usb_host.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    /* Device state */
+    uint32_t time;                  /**< Clock at time_set_ms, seconds since the epoch */
+    uint64_t time_set_ms;           /**< mock_usb_now_ms() when `time` was set */
+    audiomoth_settings_t settings;
+    uint8_t version[3];
+    uint8_t uid[8];
+    uint8_t battery;
+
+    /* Behaviour */
+    uint32_t latency_ms;            /**< Control and interrupt transfer latency */
+    bool mute;                      /**< Swallow HID requests without answering */
+    int requests;                   /**< HID requests received */
+
+    /* Filled by mock_audiomoth_connect() */
+    uint8_t addr;
+    uint8_t config_desc[160];
+} mock_audiomoth_t;
+
+/**
+ * @brief Defaults: 48 kHz, medium gain, no filter, firmware 1.2.0, a fixed UID
+ */
+void mock_audiomoth_init(mock_audiomoth_t *am);
+
+/**
+ * @brief Attach the device; `am` must outlive it
+ *
+ * @return Bus address, 0 if the bus is full
+ */
+uint8_t mock_audiomoth_connect(mock_audiomoth_t *am, const char *serial);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,209 @@
+// mock_replay.c  (a device on mock_usb_host that plays back a urb_capture.h file)
+
+#include <stdlib.h>
+#include <string.h>
+#include "mock_replay.h"
+#include "urb_capture.h"
+
+static uint64_t get_le(const uint8_t *p, size_t n)
+{
+    uint64_t v = 0;
+    for (size_t i = 0; i < n; i++) {
+        v |= (uint64_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+static void put_le(uint8_t *p, uint32_t v, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+/* Next record's payload into r->rec; false at the end or on a truncated record */
+static bool next_record(mock_replay_t *r, uint8_t *type)
+{
+    uint8_t h[URB_CAPTURE_RECORD_HEADER_LEN];
+    if (r->eof || fread(h, 1, sizeof(h), r->f) != sizeof(h)) {
+        r->eof = true;
+        return false;
+    }
+    const size_t len = (size_t)get_le(h + 1, 4);
+    if (len > r->rec_cap) {
+        uint8_t *rec = realloc(r->rec, len);
+        if (rec == NULL) {
+            r->eof = true;
+            return false;
+        }
+        r->rec = rec;
+        r->rec_cap = len;
+    }
+    if (fread(r->rec, 1, len, r->f) != len) {
+        r->eof = true;
+        return false;
+    }
+    r->rec_len = len;
+    *type = h[0];
+    return true;
+}
+
+/* On to the next URB or gap; false once the capture ends. A second device
+ * record is a rate switch the replayed driver won't make, so it ends too. */
+static bool advance(mock_replay_t *r)
+{
+    uint8_t type;
+    while (next_record(r, &type)) {
+        if (type == URB_CAPTURE_URB && r->rec_len >= 10) {
+            const uint16_t n = (uint16_t)get_le(r->rec + 8, 2);
+            if (10u + (size_t)n * URB_CAPTURE_PACKET_LEN > r->rec_len) {
+                break;
+            }
+            r->urb_t_us = get_le(r->rec, 8);
+            if (r->urbs++ == 0) {
+                r->first_t_us = r->urb_t_us;
+            }
+            r->num_packets = n;
+            r->packet = 0;
+            r->data_off = 10u + (size_t)n * URB_CAPTURE_PACKET_LEN;
+            return true;
+        }
+        if (type == URB_CAPTURE_GAP && r->rec_len == 8) {
+            r->gaps++;
+            r->gap_packets = (uint32_t)get_le(r->rec + 4, 4);
+            r->num_packets = 0;
+            r->packet = 0;
+            return true;
+        }
+        if (type == URB_CAPTURE_DEVICE) {
+            break;
+        }
+        // Unknown record types are skipped
+    }
+    r->eof = true;
+    return false;
+}
+
+esp_err_t mock_replay_open(mock_replay_t *r, const char *path)
+{
+    memset(r, 0, sizeof(*r));
+    r->f = fopen(path, "rb");
+    if (r->f == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    char magic[URB_CAPTURE_MAGIC_LEN];
+    uint8_t type;
+    if (fread(magic, 1, sizeof(magic), r->f) != sizeof(magic) ||
+            memcmp(magic, URB_CAPTURE_MAGIC, sizeof(magic)) != 0 ||
+            !next_record(r, &type) || type != URB_CAPTURE_DEVICE || r->rec_len < URB_CAPTURE_DEVICE_LEN + 4 ||
+            r->rec_len - URB_CAPTURE_DEVICE_LEN > sizeof(r->config_desc)) {
+        mock_replay_close(r);
+        return ESP_ERR_INVALID_VERSION;
+    }
+    r->speed = (usb_speed_t)r->rec[0];
+    r->vid = (uint16_t)get_le(r->rec + 1, 2);
+    r->pid = (uint16_t)get_le(r->rec + 3, 2);
+    r->ep = r->rec[5];
+    r->rate_hz = (uint32_t)get_le(r->rec + 6, 4);
+    memcpy(r->config_desc, r->rec + URB_CAPTURE_DEVICE_LEN, r->rec_len - URB_CAPTURE_DEVICE_LEN);
+    r->done = !advance(r);
+    return ESP_OK;
+}
+
+void mock_replay_close(mock_replay_t *r)
+{
+    if (r->f) {
+        fclose(r->f);
+    }
+    free(r->rec);
+    r->f = NULL;
+    r->rec = NULL;
+    r->rec_cap = 0;
+}
+
+uint64_t mock_replay_due_us(const mock_replay_t *r)
+{
+    return r->urb_t_us - r->first_t_us;
+}
+
+/* Sampling frequency control: whatever is set, the capture's rate is read back */
+static esp_err_t replay_ctrl(const usb_setup_packet_t *setup, uint8_t *data, size_t *len, void *ctx)
+{
+    const mock_replay_t *r = ctx;
+    const bool in = setup->bmRequestType & USB_BM_REQUEST_TYPE_DIR_IN;
+    if ((setup->bmRequestType & 0x60) != USB_BM_REQUEST_TYPE_TYPE_CLASS || setup->wValue != 0x0100) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (!in) {
+        return ESP_OK;
+    }
+    if (setup->bRequest == 0x02 && *len >= 2) {
+        // UAC 2.0 RANGE: the one rate
+        uint8_t reply[14] = { 0 };
+        put_le(reply, 1, 2);
+        put_le(reply + 2, r->rate_hz, 4);
+        put_le(reply + 6, r->rate_hz, 4);
+        *len = *len < sizeof(reply) ? *len : sizeof(reply);
+        memcpy(data, reply, *len);
+        return ESP_OK;
+    }
+    if ((setup->bRequest == 0x01 || setup->bRequest == 0x81) && *len >= 3) {
+        // UAC 2.0 CUR is 4 bytes, UAC 1.0 GET_CUR 3
+        *len = *len >= 4 ? 4 : 3;
+        put_le(data, r->rate_hz, *len);
+        return ESP_OK;
+    }
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+static int replay_isoc_in(uint8_t addr, uint8_t ep, uint64_t t_us, uint8_t *data, size_t max_len, void *ctx)
+{
+    (void)addr;
+    (void)t_us;
+    mock_replay_t *r = ctx;
+    if (ep != r->ep || r->done) {
+        return 0;
+    }
+    while (r->gap_packets == 0 && r->packet == r->num_packets) {
+        if (!advance(r)) {
+            r->done = true;
+            return 0;
+        }
+    }
+    r->packets++;
+    if (r->gap_packets) {
+        r->gap_packets--;
+        r->errors++;
+        return -1;
+    }
+    const uint8_t *p = r->rec + 10 + (size_t)URB_CAPTURE_PACKET_LEN * r->packet++;
+    const size_t len = (size_t)get_le(p + 1, 2);
+    if (p[0] != USB_TRANSFER_STATUS_COMPLETED) {
+        r->errors++;
+        return -1;
+    }
+    if (r->data_off + len > r->rec_len) {
+        r->done = true;     // truncated record
+        return 0;
+    }
+    const size_t n = len < max_len ? len : max_len;
+    memcpy(data, r->rec + r->data_off, n);
+    r->data_off += len;
+    return (int)n;
+}
+
+uint8_t mock_replay_connect(mock_replay_t *r)
+{
+    const mock_usb_device_config_t dev = {
+        .speed = r->speed,
+        .vid = r->vid,
+        .pid = r->pid,
+        .config_desc = r->config_desc,
+        .ctrl = replay_ctrl,
+        .ctx = r,
+        .ctrl_latency_ms = 1,
+        .isoc_in = replay_isoc_in,
+    };
+    r->addr = mock_usb_connect(&dev);
+    return r->addr;
+}
@@ -0,0 +1,83 @@
+// mock_replay.h  (a device on mock_usb_host that plays back a urb_capture.h file)
+//
+// The device record's configuration descriptor is what the device
+// enumerates with; every rate request is answered with the captured rate,
+// so uac_driver streams from it exactly as it did from the real device.
+// Each isochronous IN packet the host polls takes the next captured packet
+// in order: its bytes, or a bus error for a packet that failed, and one
+// error per packet of a gap record. Once the capture runs out packets come
+// back empty and mock_replay_t.done is set.
+//
+// The mock bus schedule is the captured one (same descriptor, same
+// intervals); mock_replay_due_us() gives the capture time of the URB being
+// replayed, for a harness that wants to run at the original pace.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "mock_usb_host.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    FILE *f;
+    uint8_t *rec;                   /**< Current record's payload */
+    size_t rec_len;
+    size_t rec_cap;
+    bool eof;
+
+    /* Stream the capture starts with, from its first device record */
+    usb_speed_t speed;
+    uint16_t vid;
+    uint16_t pid;
+    uint8_t ep;
+    uint32_t rate_hz;
+    uint8_t config_desc[1024];
+
+    /* Position */
+    uint64_t first_t_us;            /**< Capture time of the first URB */
+    uint64_t urb_t_us;              /**< Capture time of the URB being replayed */
+    uint16_t num_packets;           /**< Of the URB being replayed */
+    uint16_t packet;                /**< Next packet in it */
+    size_t data_off;                /**< Its data in rec */
+    uint32_t gap_packets;           /**< Errors still to send for a gap record */
+
+    /* Observed */
+    uint64_t urbs;
+    uint64_t packets;               /**< Packets replayed, errors included */
+    uint64_t errors;                /**< Packets replayed as bus errors */
+    uint32_t gaps;                  /**< Gap records met */
+    bool done;
+
+    uint8_t addr;
+} mock_replay_t;
+
+/**
+ * @brief Open a capture and read up to its first URB
+ *
+ * @return ESP_ERR_NOT_FOUND if it can't be opened, ESP_ERR_INVALID_VERSION
+ *         if it isn't a capture or has no device record before its URBs
+ */
+esp_err_t mock_replay_open(mock_replay_t *r, const char *path);
+
+void mock_replay_close(mock_replay_t *r);
+
+/**
+ * @brief Attach the captured device; `r` must outlive it
+ *
+ * @return Bus address, 0 if the bus is full
+ */
+uint8_t mock_replay_connect(mock_replay_t *r);
+
+/**
+ * @brief Capture time of the URB being replayed, from the first one
+ */
+uint64_t mock_replay_due_us(const mock_replay_t *r);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,263 @@
+// mock_uac.c  (simulated UAC 1.0 / 2.0 microphone on top of mock_usb_host)
+
+#include <string.h>
+#include "mock_uac.h"
+
+#define MOCK_UAC_VID        0x1234
+#define MOCK_UAC_PID        0x5678
+#define MOCK_UAC_EP         0x81
+#define MOCK_UAC_CLOCK_ID   0x10
+#define MOCK_UAC_SELECTOR   0x11
+
+/* Frame clock: frames sampled by bus time t at the current rate */
+typedef struct {
+    uint64_t base_us;
+    uint64_t base_frames;
+} frame_clock_t;
+
+static frame_clock_t s_clock[8];    // by bus address - 1
+
+void mock_uac_init(mock_uac_t *m)
+{
+    memset(m, 0, sizeof(*m));
+    m->uac_version = 1;
+    m->speed = USB_SPEED_FULL;
+    m->channels = 1;
+    m->subframe_size = 2;
+    m->bit_resolution = 16;
+    m->ep_mps = 96;
+    m->ep_mult = 1;
+    m->ep_interval = 1;
+    m->num_rates = 1;
+    m->rates[0] = 48000;
+    m->rate_hz = 48000;
+}
+
+static uint8_t alt_channels(const mock_uac_t *m, uint8_t alt)
+{
+    return alt == 2 ? m->alt2_channels : m->channels;
+}
+
+static uint16_t alt_mps(const mock_uac_t *m, uint8_t alt)
+{
+    return alt == 2 ? m->alt2_ep_mps : m->ep_mps;
+}
+
+size_t mock_uac_build_config(mock_uac_t *m)
+{
+    uint8_t *d = m->config_desc;
+    size_t n = 0;
+    const uint8_t ch = m->channels;
+#define PUT(...) do { const uint8_t b_[] = { __VA_ARGS__ }; memcpy(d + n, b_, sizeof(b_)); n += sizeof(b_); } while (0)
+    PUT(9, 0x02, 0, 0, 2, 1, 0, 0x80, 50);
+    if (m->uac_version == 2) {
+        PUT(9, 0x04, 0, 0, 0, 0x01, 0x01, 0x20, 0);
+        PUT(9, 0x24, 0x01, 0x00, 0x02, 0x03, 54, 0, 0);
+        // Clock source: internal, programmable or fixed; frequency read/write or read-only
+        PUT(8, 0x24, 0x0A, MOCK_UAC_CLOCK_ID, m->freq_control ? 0x03 : 0x01, m->freq_control ? 0x07 : 0x05, 0, 0);
+        PUT(8, 0x24, 0x0B, MOCK_UAC_SELECTOR, 1, MOCK_UAC_CLOCK_ID, 0x03, 0);
+        PUT(17, 0x24, 0x02, 1, 0x01, 0x02, 0, MOCK_UAC_SELECTOR, ch, 0, 0, 0, 0, 0, 0, 0, 0);
+        PUT(12, 0x24, 0x03, 2, 0x01, 0x01, 0, 1, MOCK_UAC_SELECTOR, 0, 0, 0);
+        PUT(9, 0x04, 1, 0, 0, 0x01, 0x02, 0x20, 0);
+        for (uint8_t alt = 1; alt <= (m->alt2_channels ? 2 : 1); alt++) {
+            const uint16_t wmps = (uint16_t)(alt_mps(m, alt) | ((m->ep_mult - 1) << 11));
+            PUT(9, 0x04, 1, alt, 1, 0x01, 0x02, 0x20, 0);
+            PUT(16, 0x24, 0x01, 2, 0, 0x01, 0x01, 0, 0, 0, alt_channels(m, alt), 0, 0, 0, 0, 0);
+            PUT(6, 0x24, 0x02, 0x01, m->subframe_size, m->bit_resolution);
+            PUT(7, 0x05, MOCK_UAC_EP, 0x05, wmps & 0xFF, wmps >> 8, m->ep_interval);
+            PUT(8, 0x25, 0x01, 0, 0, 0, 0, 0);
+        }
+    } else {
+        PUT(9, 0x04, 0, 0, 0, 0x01, 0x01, 0, 0);
+        PUT(9, 0x24, 0x01, 0x00, 0x01, 30, 0, 1, 1);
+        PUT(12, 0x24, 0x02, 1, 0x01, 0x02, 0, ch, 0, 0, 0, 0);
+        PUT(9, 0x24, 0x03, 2, 0x01, 0x01, 0, 1, 0);
+        PUT(9, 0x04, 1, 0, 0, 0x01, 0x02, 0, 0);
+        for (uint8_t alt = 1; alt <= (m->alt2_channels ? 2 : 1); alt++) {
+            const uint16_t wmps = (uint16_t)(alt_mps(m, alt) | ((m->ep_mult - 1) << 11));
+            PUT(9, 0x04, 1, alt, 1, 0x01, 0x02, 0, 0);
+            PUT(7, 0x24, 0x01, 2, 1, 0x01, 0x00);
+            PUT((uint8_t)(8 + 3 * m->num_rates), 0x24, 0x02, 0x01, alt_channels(m, alt), m->subframe_size,
+                m->bit_resolution, (uint8_t)m->num_rates);
+            for (size_t i = 0; i < m->num_rates; i++) {
+                PUT(m->rates[i] & 0xFF, (m->rates[i] >> 8) & 0xFF, (m->rates[i] >> 16) & 0xFF);
+            }
+            PUT(9, 0x05, MOCK_UAC_EP, 0x0D, wmps & 0xFF, wmps >> 8, m->ep_interval, 0, 0);
+            PUT(7, 0x25, 0x01, m->freq_control ? 0x01 : 0x00, 0, 0, 0);
+        }
+    }
+#undef PUT
+    d[2] = n & 0xFF;
+    d[3] = (uint8_t)(n >> 8);
+    return n;
+}
+
+static uint64_t frames_by(const mock_uac_t *m, uint64_t t_us)
+{
+    const frame_clock_t *fc = &s_clock[m->addr - 1];
+    if (t_us < fc->base_us) {
+        return fc->base_frames;
+    }
+    // An asynchronous endpoint runs on the device's own clock
+    const uint64_t hz_ppm = (uint64_t)m->rate_hz * (uint64_t)(1000000 + m->clock_ppm);
+    return fc->base_frames + (t_us - fc->base_us) * hz_ppm / 1000000000000ULL;
+}
+
+static void set_rate(mock_uac_t *m, uint32_t want)
+{
+    uint32_t best = m->rates[0];
+    for (size_t i = 0; i < m->num_rates; i++) {
+        const uint32_t d = m->rates[i] > want ? m->rates[i] - want : want - m->rates[i];
+        const uint32_t bd = best > want ? best - want : want - best;
+        best = d < bd ? m->rates[i] : best;
+    }
+    const uint64_t now = mock_usb_now_us();
+    s_clock[m->addr - 1] = (frame_clock_t) {
+        .base_us = now, .base_frames = frames_by(m, now),
+    };
+    m->rate_hz = best;
+    m->rate_sets++;
+    if (m->wedge == MOCK_UAC_WEDGE_UNTIL_RATE) {
+        m->wedge = MOCK_UAC_WEDGE_NONE;
+    }
+}
+
+static void put_le(uint8_t *p, uint32_t v, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+static esp_err_t uac_ctrl(const usb_setup_packet_t *setup, uint8_t *data, size_t *len, void *ctx)
+{
+    mock_uac_t *m = ctx;
+    const bool in = setup->bmRequestType & USB_BM_REQUEST_TYPE_DIR_IN;
+    const uint8_t recip = setup->bmRequestType & 0x1F;
+    if ((setup->bmRequestType & 0x60) == USB_BM_REQUEST_TYPE_TYPE_STANDARD &&
+            setup->bRequest == USB_B_REQUEST_SET_INTERFACE && setup->wIndex == 1) {
+        m->alt = (uint8_t)setup->wValue;
+        if (m->alt == 0 && m->wedge == MOCK_UAC_WEDGE_UNTIL_ALT0) {
+            m->wedge = MOCK_UAC_WEDGE_NONE;
+        }
+    }
+    if ((setup->bmRequestType & 0x60) != USB_BM_REQUEST_TYPE_TYPE_CLASS || setup->wValue != 0x0100) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (m->uac_version == 2) {
+        if (recip != USB_BM_REQUEST_TYPE_RECIP_INTERFACE || setup->wIndex != (MOCK_UAC_CLOCK_ID << 8)) {
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        if (!in && setup->bRequest == 0x01 && setup->wLength == 4 && m->freq_control) {
+            set_rate(m, data[0] | (data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
+            return ESP_OK;
+        }
+        if (in && setup->bRequest == 0x01 && *len >= 4) {
+            put_le(data, m->rate_hz, 4);
+            *len = 4;
+            return ESP_OK;
+        }
+        if (in && setup->bRequest == 0x02 && *len >= 2) {
+            // One discrete subrange per rate, cut short to wLength
+            uint8_t reply[2 + 12 * MOCK_UAC_MAX_RATES] = { 0 };
+            put_le(reply, (uint32_t)m->num_rates, 2);
+            for (size_t i = 0; i < m->num_rates; i++) {
+                put_le(reply + 2 + 12 * i, m->rates[i], 4);
+                put_le(reply + 6 + 12 * i, m->rates[i], 4);
+            }
+            const size_t n = 2 + 12 * m->num_rates;
+            *len = n < *len ? n : *len;
+            memcpy(data, reply, *len);
+            return ESP_OK;
+        }
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (recip != USB_BM_REQUEST_TYPE_RECIP_ENDPOINT || setup->wIndex != MOCK_UAC_EP) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (!in && setup->bRequest == 0x01 && setup->wLength == 3 && m->freq_control) {
+        set_rate(m, data[0] | (data[1] << 8) | ((uint32_t)data[2] << 16));
+        return ESP_OK;
+    }
+    if (in && setup->bRequest == 0x81 && *len >= 3) {
+        put_le(data, m->rate_hz, 3);
+        *len = 3;
+        return ESP_OK;
+    }
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+static int uac_isoc_in(uint8_t addr, uint8_t ep, uint64_t t_us, uint8_t *data, size_t max_len, void *ctx)
+{
+    (void)addr;
+    mock_uac_t *m = ctx;
+    if (ep != MOCK_UAC_EP) {
+        return 0;
+    }
+    const uint32_t unit = m->speed == USB_SPEED_HIGH ? 125 : 1000;
+    const uint64_t end = t_us + ((uint64_t)unit << (m->ep_interval - 1));
+    // Whatever was sampled during intervals the host didn't poll is gone
+    const uint64_t start = frames_by(m, t_us);
+    if (m->frames_sent < start) {
+        m->frames_sent = start;
+    }
+    const uint8_t alt = m->alt == 2 ? 2 : 1;
+    const uint8_t channels = alt_channels(m, alt);
+    const size_t frame_bytes = (size_t)channels * m->subframe_size;
+    const size_t cap = (size_t)alt_mps(m, alt) * m->ep_mult / frame_bytes;
+    size_t n = (size_t)(frames_by(m, end) - m->frames_sent);
+    n = n < cap ? n : cap;
+    n = n * frame_bytes <= max_len ? n : max_len / frame_bytes;
+    const uint64_t f0 = m->frames_sent;
+    m->frames_sent += n;
+    m->packets++;
+    if (m->wedge != MOCK_UAC_WEDGE_NONE) {
+        return 0;
+    }
+    if (m->lose_every && m->packets % m->lose_every == 0) {
+        return -1;
+    }
+    for (size_t f = 0; f < n; f++) {
+        for (unsigned c = 0; c < channels; c++) {
+            const uint32_t raw = (uint32_t)(f0 + f) * MOCK_UAC_FRAME_STEP + c * MOCK_UAC_CHANNEL_STEP;
+            // Low bit_resolution bits, MSB-justified; put_le keeps the subframe's bytes
+            const uint32_t v = raw << (32 - m->bit_resolution) >> (32 - 8 * m->subframe_size);
+            put_le(data + f * frame_bytes + c * m->subframe_size, v, m->subframe_size);
+        }
+    }
+    return (int)(n * frame_bytes);
+}
+
+static void uac_reset(uint8_t addr, bool power_lost, void *ctx)
+{
+    (void)addr;
+    mock_uac_t *m = ctx;
+    if (m->wedge == MOCK_UAC_WEDGE_UNTIL_RESET || (power_lost && m->wedge == MOCK_UAC_WEDGE_UNTIL_POWER)) {
+        m->wedge = MOCK_UAC_WEDGE_NONE;
+    }
+}
+
+uint8_t mock_uac_connect(mock_uac_t *m, const char *serial)
+{
+    mock_uac_build_config(m);
+    const mock_usb_device_config_t dev = {
+        .speed = m->speed,
+        .vid = MOCK_UAC_VID,
+        .pid = MOCK_UAC_PID,
+        .serial = serial,
+        .config_desc = m->config_desc,
+        .ctrl = uac_ctrl,
+        .ctx = m,
+        .ctrl_latency_ms = 1,
+        .isoc_in = uac_isoc_in,
+        .reset = uac_reset,
+    };
+    m->addr = mock_usb_connect(&dev);
+    if (m->addr) {
+        s_clock[m->addr - 1] = (frame_clock_t) {
+            .base_us = mock_usb_now_us(), .base_frames = 0,
+        };
+        m->frames_sent = 0;
+    }
+    return m->addr;
+}
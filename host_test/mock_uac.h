@@ -0,0 +1,95 @@
+// mock_uac.h  (simulated UAC 1.0 / 2.0 microphone on top of mock_usb_host)
+//
+// Audio Control (0) and Audio Streaming (1, alt 1 on ISO EP 0x81, and
+// optionally an alt 2 with another channel count). UAC 1.0
+// devices list their rates in the format descriptor and take the rate on
+// the endpoint; UAC 2.0 devices route the streaming terminal through a
+// clock selector to a clock source (ID 0x10) that answers CUR and RANGE.
+//
+// Isochronous data follows the bus clock: every service interval carries
+// the frames the device has sampled by its end, so 44.1 kHz alternates 44
+// and 45 frames per 1 ms packet. Channel c of frame f carries
+// f * MOCK_UAC_FRAME_STEP + c * MOCK_UAC_CHANNEL_STEP, truncated to
+// bit_resolution and MSB-justified in its subframe, so a receiver can check
+// every sample's position on the timeline from the first one it saw.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "mock_usb_host.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MOCK_UAC_MAX_RATES      8
+#define MOCK_UAC_FRAME_STEP     2654435761u
+#define MOCK_UAC_CHANNEL_STEP   0x01010101u
+
+/* A streaming engine that locked up: ISO packets come back empty (the
+ * frames are still sampled, and lost) until the host does what clears it */
+typedef enum {
+    MOCK_UAC_WEDGE_NONE = 0,
+    MOCK_UAC_WEDGE_UNTIL_RATE,      /**< Cleared by a sampling frequency SET */
+    MOCK_UAC_WEDGE_UNTIL_ALT0,      /**< Cleared by SET_INTERFACE to alt 0 */
+    MOCK_UAC_WEDGE_UNTIL_RESET,     /**< Cleared by a bus reset: enumerated again or power cycled */
+    MOCK_UAC_WEDGE_UNTIL_POWER,     /**< Cleared only by losing power */
+    MOCK_UAC_WEDGE_FOREVER,
+} mock_uac_wedge_t;
+
+typedef struct {
+    /* Device description, set before mock_uac_connect() */
+    uint8_t uac_version;
+    usb_speed_t speed;
+    uint8_t channels;
+    uint8_t subframe_size;          /**< Bytes */
+    uint8_t bit_resolution;
+    uint16_t ep_mps;                /**< Per transaction */
+    uint8_t ep_mult;                /**< Transactions per microframe, 1..3 */
+    uint8_t ep_interval;            /**< bInterval */
+    uint8_t alt2_channels;          /**< Also describe alt 2 with this many channels, 0 for alt 1 only */
+    uint16_t alt2_ep_mps;           /**< Alt 2's per-transaction size; its format is otherwise alt 1's */
+    bool freq_control;
+    size_t num_rates;
+    uint32_t rates[MOCK_UAC_MAX_RATES];
+
+    /* Behaviour */
+    uint32_t rate_hz;               /**< Current rate; SET snaps to the nearest of `rates` */
+    int32_t clock_ppm;              /**< Device clock's offset from the host's, parts per million */
+    uint32_t lose_every;            /**< Drop every n-th ISO packet on the bus, 0 for none */
+    mock_uac_wedge_t wedge;         /**< Set any time; back to NONE once cleared */
+
+    /* Observed */
+    uint64_t frames_sent;           /**< Frames sampled so far (lost packets included) */
+    uint32_t packets;
+    int rate_sets;
+    uint8_t alt;                    /**< Streaming interface's alt setting, as last set */
+
+    /* Filled by mock_uac_connect() */
+    uint8_t addr;
+    uint8_t config_desc[256];
+} mock_uac_t;
+
+/**
+ * @brief Defaults: UAC 1.0 full-speed mono 16-bit, 48 kHz only, no rate control
+ */
+void mock_uac_init(mock_uac_t *m);
+
+/**
+ * @brief Build the configuration descriptor into m->config_desc
+ *
+ * @return wTotalLength
+ */
+size_t mock_uac_build_config(mock_uac_t *m);
+
+/**
+ * @brief Attach the device; `m` must outlive it
+ *
+ * @return Bus address, 0 if the bus is full
+ */
+uint8_t mock_uac_connect(mock_uac_t *m, const char *serial);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,935 @@
+// mock_usb_host.c  (in-process stand-in for the ESP-IDF USB Host Library)
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mock_usb_host.h"
+
+#define MOCK_MAX_CLIENTS    4
+#define MOCK_MAX_DEVICES    8
+#define MOCK_MAX_EVENTS     16
+#define MOCK_MAX_PENDING    64
+#define MOCK_MAX_IN_QUEUE   8
+#define MOCK_MAX_PACKET     1024
+#define MOCK_MAX_ISOC_PACKET (3 * 1024) /**< High-bandwidth: three transactions per microframe */
+#define MOCK_PARKED         UINT64_MAX  /**< due_us of an IN transfer with nothing to return yet */
+
+typedef struct {
+    uint8_t ep;
+    uint16_t len;
+    uint8_t data[MOCK_MAX_PACKET];
+} in_packet_t;
+
+struct usb_host_client_handle_s {
+    bool used;
+    usb_host_client_config_t cfg;
+    usb_host_client_event_msg_t events[MOCK_MAX_EVENTS];
+    int ev_head;
+    int ev_count;
+    bool unblocked;
+};
+
+struct usb_device_handle_s {
+    bool connected;
+    uint8_t addr;
+    mock_usb_device_config_t cfg;
+    usb_device_desc_t dev_desc;
+    usb_str_desc_t *serial;
+    uint32_t opened_by;         /**< Bit per client */
+    int ctrl_inflight;
+    int ctrl_max_inflight;
+    int ctrl_count;
+    uint32_t halted;            /**< Bit per endpoint number */
+    in_packet_t in_queue[MOCK_MAX_IN_QUEUE];
+    int in_count;
+    uint64_t isoc_next_us[16];  /**< Per endpoint number: first free service interval, 0 when idle */
+    uint64_t isoc_done_us[16];  /**< Per endpoint number: completion of the last URB queued */
+    bool unpowered;             /**< Off the bus with the root port; back when it is powered */
+    bool reenumerate;           /**< Back on the bus once no client has it open */
+    int reenumerations;
+};
+
+typedef struct {
+    usb_transfer_t *xfer;
+    usb_host_client_handle_t client;
+    uint64_t due_us;
+    uint64_t start_us;          /**< Isochronous: bus time of the first packet */
+    uint32_t interval_us;       /**< Isochronous: time between packets */
+    bool is_ctrl;
+    bool canceled;              /**< Flushed: completes as CANCELED */
+} pending_t;
+
+static struct {
+    struct usb_host_client_handle_s clients[MOCK_MAX_CLIENTS];
+    struct usb_device_handle_s devices[MOCK_MAX_DEVICES];
+    pending_t pending[MOCK_MAX_PENDING];
+    int num_pending;
+    uint64_t now_us;
+    bool port_off;
+} s_bus;
+
+/* Fault injection; `left` is what remains of the running burst per kind */
+typedef enum {
+    FAULT_PACKET_ERROR,
+    FAULT_SHORT_PACKET,
+    FAULT_LATE,
+    FAULT_SUBMIT_FAIL,
+    FAULT_KINDS,
+} fault_kind_t;
+
+static struct {
+    bool on;
+    mock_usb_faults_t cfg;
+    uint32_t rng;
+    uint32_t left[FAULT_KINDS];
+    uint32_t count[FAULT_KINDS];
+    uint32_t iso_allocs;
+} s_faults;
+
+/* Not reset with the bus: a transfer outlives the test that leaked it */
+static int s_transfers_allocated;
+
+/* ---------- Test control ---------- */
+
+void mock_usb_host_reset(void)
+{
+    for (int i = 0; i < MOCK_MAX_DEVICES; i++) {
+        free(s_bus.devices[i].serial);
+    }
+    memset(&s_bus, 0, sizeof(s_bus));
+    memset(&s_faults, 0, sizeof(s_faults));
+}
+
+void mock_usb_set_faults(const mock_usb_faults_t *faults)
+{
+    memset(&s_faults, 0, sizeof(s_faults));
+    if (faults) {
+        s_faults.on = true;
+        s_faults.cfg = *faults;
+        s_faults.rng = faults->seed ? faults->seed : 1;
+    }
+}
+
+void mock_usb_fault_counts(mock_usb_fault_counts_t *counts)
+{
+    *counts = (mock_usb_fault_counts_t) {
+        .packet_error = s_faults.count[FAULT_PACKET_ERROR],
+        .short_packet = s_faults.count[FAULT_SHORT_PACKET],
+        .late = s_faults.count[FAULT_LATE],
+        .submit_fail = s_faults.count[FAULT_SUBMIT_FAIL],
+    };
+}
+
+int mock_usb_transfers_allocated(void)
+{
+    return s_transfers_allocated;
+}
+
+/* xorshift32: reproducible from the seed */
+static uint32_t fault_rand(void)
+{
+    s_faults.rng ^= s_faults.rng << 13;
+    s_faults.rng ^= s_faults.rng >> 17;
+    s_faults.rng ^= s_faults.rng << 5;
+    return s_faults.rng;
+}
+
+/* Whether this opportunity for a `kind` fault gets one */
+static bool fault_hit(fault_kind_t kind)
+{
+    if (!s_faults.on) {
+        return false;
+    }
+    const mock_usb_fault_t *f = kind == FAULT_PACKET_ERROR ? &s_faults.cfg.packet_error :
+                                kind == FAULT_SHORT_PACKET ? &s_faults.cfg.short_packet :
+                                kind == FAULT_LATE ? &s_faults.cfg.late : &s_faults.cfg.submit_fail;
+    if (s_faults.left[kind] == 0) {
+        if (f->probability <= 0.0f || (float)(fault_rand() >> 8) >= f->probability * (float)(1u << 24)) {
+            return false;
+        }
+        s_faults.left[kind] = f->burst ? f->burst : 1;
+    }
+    s_faults.left[kind]--;
+    s_faults.count[kind]++;
+    return true;
+}
+
+uint64_t mock_usb_now_ms(void)
+{
+    return s_bus.now_us / 1000;
+}
+
+uint64_t mock_usb_now_us(void)
+{
+    return s_bus.now_us;
+}
+
+void mock_usb_advance_ms(uint32_t ms)
+{
+    s_bus.now_us += (uint64_t)ms * 1000;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return (int64_t)s_bus.now_us;
+}
+
+static void post_event(usb_host_client_handle_t client, const usb_host_client_event_msg_t *msg)
+{
+    if (client->ev_count < MOCK_MAX_EVENTS) {
+        client->events[(client->ev_head + client->ev_count) % MOCK_MAX_EVENTS] = *msg;
+        client->ev_count++;
+    }
+}
+
+static struct usb_device_handle_s *dev_by_addr(uint8_t addr)
+{
+    if (addr == 0 || addr > MOCK_MAX_DEVICES || !s_bus.devices[addr - 1].connected) {
+        return NULL;
+    }
+    return &s_bus.devices[addr - 1];
+}
+
+/* NEW_DEV to every client */
+static void announce(const struct usb_device_handle_s *dev)
+{
+    const usb_host_client_event_msg_t msg = {
+        .event = USB_HOST_CLIENT_EVENT_NEW_DEV,
+        .new_dev.address = dev->addr,
+    };
+    for (int c = 0; c < MOCK_MAX_CLIENTS; c++) {
+        if (s_bus.clients[c].used) {
+            post_event(&s_bus.clients[c], &msg);
+        }
+    }
+}
+
+/* Freed and enumerated again: a fresh device at the same address */
+static void reenumerate(struct usb_device_handle_s *dev)
+{
+    dev->connected = true;
+    dev->reenumerate = false;
+    dev->reenumerations++;
+    dev->halted = 0;
+    dev->in_count = 0;
+    memset(dev->isoc_next_us, 0, sizeof(dev->isoc_next_us));
+    memset(dev->isoc_done_us, 0, sizeof(dev->isoc_done_us));
+    announce(dev);
+}
+
+uint8_t mock_usb_connect(const mock_usb_device_config_t *config)
+{
+    for (int i = 0; i < MOCK_MAX_DEVICES; i++) {
+        struct usb_device_handle_s *dev = &s_bus.devices[i];
+        if (dev->connected || dev->unpowered || dev->reenumerate) {
+            continue;
+        }
+        free(dev->serial);
+        memset(dev, 0, sizeof(*dev));
+        dev->connected = true;
+        dev->addr = (uint8_t)(i + 1);
+        dev->cfg = *config;
+        dev->dev_desc.bLength = sizeof(usb_device_desc_t);
+        dev->dev_desc.bDescriptorType = USB_B_DESCRIPTOR_TYPE_DEVICE;
+        dev->dev_desc.bcdUSB = config->speed == USB_SPEED_HIGH ? 0x0200 : 0x0110;
+        dev->dev_desc.bMaxPacketSize0 = 64;
+        dev->dev_desc.idVendor = config->vid;
+        dev->dev_desc.idProduct = config->pid;
+        dev->dev_desc.bNumConfigurations = 1;
+        if (config->serial) {
+            const size_t n = strlen(config->serial);
+            dev->serial = calloc(1, sizeof(usb_str_desc_t) + 2 * n);
+            dev->serial->bLength = (uint8_t)(2 + 2 * n);
+            dev->serial->bDescriptorType = USB_B_DESCRIPTOR_TYPE_STRING;
+            for (size_t c = 0; c < n; c++) {
+                dev->serial->wData[c] = (uint8_t)config->serial[c];
+            }
+            dev->dev_desc.iSerialNumber = 3;
+        }
+        announce(dev);
+        return dev->addr;
+    }
+    return 0;
+}
+
+/* Packets queued on `ep` that no scheduled IN transfer will take yet */
+static int in_backlog(const struct usb_device_handle_s *dev, uint8_t ep)
+{
+    int n = 0;
+    for (int i = 0; i < dev->in_count; i++) {
+        n += dev->in_queue[i].ep == ep;
+    }
+    for (int i = 0; i < s_bus.num_pending; i++) {
+        const pending_t *p = &s_bus.pending[i];
+        n -= p->due_us != MOCK_PARKED && !p->canceled && p->xfer->device_handle == dev && p->xfer->bEndpointAddress == ep;
+    }
+    return n;
+}
+
+/* Wake the oldest parked IN transfer on `ep` if a packet is waiting for it */
+static void unpark_in(struct usb_device_handle_s *dev, uint8_t ep)
+{
+    if (in_backlog(dev, ep) <= 0) {
+        return;
+    }
+    for (int i = 0; i < s_bus.num_pending; i++) {
+        pending_t *p = &s_bus.pending[i];
+        if (p->due_us == MOCK_PARKED && p->xfer->device_handle == dev && p->xfer->bEndpointAddress == ep) {
+            p->due_us = s_bus.now_us + dev->cfg.data_latency_ms * 1000ull;
+            return;
+        }
+    }
+}
+
+esp_err_t mock_usb_device_send(uint8_t addr, uint8_t ep, const void *data, size_t len)
+{
+    struct usb_device_handle_s *dev = dev_by_addr(addr);
+    if (dev == NULL || !(ep & USB_B_ENDPOINT_ADDRESS_EP_DIR_MASK) || len > MOCK_MAX_PACKET) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (dev->in_count == MOCK_MAX_IN_QUEUE) {
+        return ESP_ERR_NO_MEM;
+    }
+    in_packet_t *pkt = &dev->in_queue[dev->in_count++];
+    pkt->ep = ep;
+    pkt->len = (uint16_t)len;
+    memcpy(pkt->data, data, len);
+    unpark_in(dev, ep);
+    return ESP_OK;
+}
+
+void mock_usb_disconnect(uint8_t addr)
+{
+    struct usb_device_handle_s *dev = dev_by_addr(addr);
+    if (dev == NULL) {
+        return;
+    }
+    dev->connected = false;
+    // In-flight transfers end as soon as the clients next handle events
+    for (int i = 0; i < s_bus.num_pending; i++) {
+        if (s_bus.pending[i].xfer->device_handle == dev) {
+            s_bus.pending[i].due_us = s_bus.now_us;
+        }
+    }
+    const usb_host_client_event_msg_t msg = {
+        .event = USB_HOST_CLIENT_EVENT_DEV_GONE,
+        .dev_gone.dev_hdl = dev,
+    };
+    for (int c = 0; c < MOCK_MAX_CLIENTS; c++) {
+        if (dev->opened_by & (1u << c)) {
+            post_event(&s_bus.clients[c], &msg);
+        }
+    }
+}
+
+int mock_usb_reenumerations(uint8_t addr)
+{
+    return addr && addr <= MOCK_MAX_DEVICES ? s_bus.devices[addr - 1].reenumerations : 0;
+}
+
+int mock_usb_ctrl_max_inflight(uint8_t addr)
+{
+    return addr && addr <= MOCK_MAX_DEVICES ? s_bus.devices[addr - 1].ctrl_max_inflight : 0;
+}
+
+int mock_usb_ctrl_count(uint8_t addr)
+{
+    return addr && addr <= MOCK_MAX_DEVICES ? s_bus.devices[addr - 1].ctrl_count : 0;
+}
+
+/* ---------- Library API ---------- */
+
+esp_err_t usb_host_device_free_all(void)
+{
+    bool freed = false;
+    for (int i = 0; i < MOCK_MAX_DEVICES; i++) {
+        struct usb_device_handle_s *dev = &s_bus.devices[i];
+        if (dev->connected && dev->opened_by == 0) {
+            if (dev->cfg.reset) {
+                dev->cfg.reset(dev->addr, false, dev->cfg.ctx);
+            }
+            reenumerate(dev);
+            freed = true;
+        }
+    }
+    // The host library frees them from its own task: done later
+    return freed ? ESP_ERR_NOT_FINISHED : ESP_OK;
+}
+
+esp_err_t usb_host_lib_set_root_port_power(bool enable)
+{
+    if (enable == !s_bus.port_off) {
+        return ESP_OK;
+    }
+    s_bus.port_off = !enable;
+    for (int i = 0; i < MOCK_MAX_DEVICES; i++) {
+        struct usb_device_handle_s *dev = &s_bus.devices[i];
+        if (!enable && dev->connected) {
+            mock_usb_disconnect(dev->addr);
+            dev->unpowered = true;
+            if (dev->cfg.reset) {
+                dev->cfg.reset(dev->addr, true, dev->cfg.ctx);
+            }
+        } else if (enable && dev->unpowered) {
+            dev->unpowered = false;
+            if (dev->opened_by == 0) {
+                reenumerate(dev);
+            } else {
+                dev->reenumerate = true;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+/* ---------- Client API ---------- */
+
+esp_err_t usb_host_client_register(const usb_host_client_config_t *client_config, usb_host_client_handle_t *client_hdl_ret)
+{
+    if (client_config == NULL || client_hdl_ret == NULL || client_config->is_synchronous) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int c = 0; c < MOCK_MAX_CLIENTS; c++) {
+        if (!s_bus.clients[c].used) {
+            memset(&s_bus.clients[c], 0, sizeof(s_bus.clients[c]));
+            s_bus.clients[c].used = true;
+            s_bus.clients[c].cfg = *client_config;
+            // Devices already on the bus are announced to late clients too
+            for (int i = 0; i < MOCK_MAX_DEVICES; i++) {
+                if (s_bus.devices[i].connected) {
+                    const usb_host_client_event_msg_t msg = {
+                        .event = USB_HOST_CLIENT_EVENT_NEW_DEV,
+                        .new_dev.address = s_bus.devices[i].addr,
+                    };
+                    post_event(&s_bus.clients[c], &msg);
+                }
+            }
+            *client_hdl_ret = &s_bus.clients[c];
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t usb_host_client_deregister(usb_host_client_handle_t client_hdl)
+{
+    for (int i = 0; i < s_bus.num_pending; i++) {
+        if (s_bus.pending[i].client == client_hdl) {
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+    client_hdl->used = false;
+    return ESP_OK;
+}
+
+esp_err_t usb_host_client_unblock(usb_host_client_handle_t client_hdl)
+{
+    client_hdl->unblocked = true;
+    return ESP_OK;
+}
+
+static int client_index(usb_host_client_handle_t client_hdl)
+{
+    return (int)(client_hdl - s_bus.clients);
+}
+
+static void run_ctrl(pending_t *p)
+{
+    usb_transfer_t *xfer = p->xfer;
+    struct usb_device_handle_s *dev = xfer->device_handle;
+    usb_setup_packet_t *setup = (usb_setup_packet_t *)xfer->data_buffer;
+    uint8_t *data = xfer->data_buffer + sizeof(usb_setup_packet_t);
+    const bool in = setup->bmRequestType & USB_BM_REQUEST_TYPE_DIR_IN;
+    size_t len = setup->wLength;
+
+    dev->ctrl_inflight--;
+    dev->ctrl_count++;
+    if (!dev->connected) {
+        xfer->status = USB_TRANSFER_STATUS_NO_DEVICE;
+        xfer->actual_num_bytes = 0;
+        return;
+    }
+
+    esp_err_t err = dev->cfg.ctrl ? dev->cfg.ctrl(setup, data, &len, dev->cfg.ctx) : ESP_ERR_NOT_FOUND;
+    if (err == ESP_ERR_NOT_FOUND) {
+        // Built-in standard requests
+        err = ESP_ERR_NOT_SUPPORTED;
+        if (setup->bRequest == USB_B_REQUEST_SET_INTERFACE && !in) {
+            len = 0;
+            err = ESP_OK;
+        } else if (setup->bRequest == USB_B_REQUEST_GET_DESCRIPTOR && in) {
+            const void *desc = NULL;
+            size_t desc_len = 0;
+            switch (setup->wValue >> 8) {
+            case USB_B_DESCRIPTOR_TYPE_DEVICE:
+                desc = &dev->dev_desc;
+                desc_len = sizeof(dev->dev_desc);
+                break;
+            case USB_B_DESCRIPTOR_TYPE_CONFIGURATION:
+                desc = dev->cfg.config_desc;
+                desc_len = desc ? ((const usb_config_desc_t *)desc)->wTotalLength : 0;
+                break;
+            default:
+                break;
+            }
+            if (desc) {
+                len = desc_len < len ? desc_len : len;
+                memcpy(data, desc, len);
+                err = ESP_OK;
+            }
+        }
+    }
+    if (err != ESP_OK) {
+        xfer->status = USB_TRANSFER_STATUS_STALL;
+        xfer->actual_num_bytes = 0;
+        return;
+    }
+    xfer->status = USB_TRANSFER_STATUS_COMPLETED;
+    xfer->actual_num_bytes = (int)(sizeof(usb_setup_packet_t) + (in ? len : setup->wLength));
+}
+
+static void run_data(pending_t *p)
+{
+    usb_transfer_t *xfer = p->xfer;
+    struct usb_device_handle_s *dev = xfer->device_handle;
+    xfer->actual_num_bytes = 0;
+    if (!dev->connected) {
+        xfer->status = USB_TRANSFER_STATUS_NO_DEVICE;
+        return;
+    }
+    if (p->canceled) {
+        xfer->status = USB_TRANSFER_STATUS_CANCELED;
+        return;
+    }
+    xfer->status = USB_TRANSFER_STATUS_COMPLETED;
+    if (!(xfer->bEndpointAddress & USB_B_ENDPOINT_ADDRESS_EP_DIR_MASK)) {
+        xfer->actual_num_bytes = xfer->num_bytes;
+        if (dev->cfg.data_out) {
+            dev->cfg.data_out(dev->addr, xfer->bEndpointAddress, xfer->data_buffer, (size_t)xfer->num_bytes, dev->cfg.ctx);
+        }
+        return;
+    }
+    for (int i = 0; i < dev->in_count; i++) {
+        in_packet_t *pkt = &dev->in_queue[i];
+        if (pkt->ep != xfer->bEndpointAddress) {
+            continue;
+        }
+        const int n = pkt->len < xfer->num_bytes ? pkt->len : xfer->num_bytes;
+        memcpy(xfer->data_buffer, pkt->data, (size_t)n);
+        xfer->actual_num_bytes = n;
+        if (pkt->len > xfer->num_bytes) {
+            xfer->status = USB_TRANSFER_STATUS_OVERFLOW;
+        }
+        memmove(pkt, pkt + 1, (size_t)(dev->in_count - i - 1) * sizeof(*pkt));
+        dev->in_count--;
+        // Anything else queued for this endpoint can go to the next parked transfer
+        unpark_in(dev, xfer->bEndpointAddress);
+        return;
+    }
+}
+
+/* Every packet of an isochronous URB, one service interval apart from
+ * start_us; the device fills each at its own bus time */
+static void run_isoc(pending_t *p)
+{
+    usb_transfer_t *xfer = p->xfer;
+    struct usb_device_handle_s *dev = xfer->device_handle;
+    const bool in = xfer->bEndpointAddress & USB_B_ENDPOINT_ADDRESS_EP_DIR_MASK;
+    static uint8_t pkt[MOCK_MAX_ISOC_PACKET];
+    xfer->status = !dev->connected ? USB_TRANSFER_STATUS_NO_DEVICE :
+                   p->canceled ? USB_TRANSFER_STATUS_CANCELED : USB_TRANSFER_STATUS_COMPLETED;
+    xfer->actual_num_bytes = 0;
+    size_t off = 0;
+    for (int i = 0; i < xfer->num_isoc_packets; i++) {
+        usb_isoc_packet_desc_t *d = &xfer->isoc_packet_desc[i];
+        d->actual_num_bytes = 0;
+        d->status = xfer->status;
+        if (xfer->status == USB_TRANSFER_STATUS_COMPLETED && in) {
+            const int n = dev->cfg.isoc_in ? dev->cfg.isoc_in(dev->addr, xfer->bEndpointAddress,
+                                                              p->start_us + (uint64_t)i * p->interval_us,
+                                                              pkt, sizeof(pkt), dev->cfg.ctx) : 0;
+            // The device sent it either way: a bus fault loses what it sampled
+            if (n < 0 || fault_hit(FAULT_PACKET_ERROR)) {
+                d->status = USB_TRANSFER_STATUS_ERROR;
+            } else {
+                d->actual_num_bytes = n < d->num_bytes ? n : d->num_bytes;
+                d->status = n > d->num_bytes ? USB_TRANSFER_STATUS_OVERFLOW : USB_TRANSFER_STATUS_COMPLETED;
+                if (d->actual_num_bytes > 0 && d->status == USB_TRANSFER_STATUS_COMPLETED &&
+                        fault_hit(FAULT_SHORT_PACKET)) {
+                    d->actual_num_bytes = (int)(fault_rand() % ((uint32_t)d->actual_num_bytes / 2 + 1));
+                }
+                memcpy(xfer->data_buffer + off, pkt, (size_t)d->actual_num_bytes);
+            }
+        } else if (xfer->status == USB_TRANSFER_STATUS_COMPLETED) {
+            d->actual_num_bytes = d->num_bytes;
+        }
+        xfer->actual_num_bytes += d->actual_num_bytes;
+        off += (size_t)d->num_bytes;
+    }
+}
+
+/* Complete the earliest due transfer owned by `client`; false if none is due */
+static bool complete_one(usb_host_client_handle_t client)
+{
+    int best = -1;
+    for (int i = 0; i < s_bus.num_pending; i++) {
+        const pending_t *p = &s_bus.pending[i];
+        if (p->client == client && p->due_us <= s_bus.now_us &&
+                (best < 0 || p->due_us < s_bus.pending[best].due_us)) {
+            best = i;
+        }
+    }
+    if (best < 0) {
+        return false;
+    }
+    pending_t p = s_bus.pending[best];
+    memmove(&s_bus.pending[best], &s_bus.pending[best + 1], (size_t)(s_bus.num_pending - best - 1) * sizeof(pending_t));
+    s_bus.num_pending--;
+    if (p.is_ctrl) {
+        run_ctrl(&p);
+    } else if (p.xfer->num_isoc_packets) {
+        run_isoc(&p);
+    } else {
+        run_data(&p);
+    }
+    p.xfer->callback(p.xfer);
+    return true;
+}
+
+esp_err_t usb_host_client_handle_events(usb_host_client_handle_t client_hdl, uint32_t timeout_ticks)
+{
+    bool handled = false;
+    while (client_hdl->ev_count) {
+        const usb_host_client_event_msg_t msg = client_hdl->events[client_hdl->ev_head];
+        client_hdl->ev_head = (client_hdl->ev_head + 1) % MOCK_MAX_EVENTS;
+        client_hdl->ev_count--;
+        client_hdl->cfg.async.client_event_callback(&msg, client_hdl->cfg.async.callback_arg);
+        handled = true;
+    }
+    while (complete_one(client_hdl)) {
+        handled = true;
+    }
+    if (handled || client_hdl->unblocked) {
+        client_hdl->unblocked = false;
+        return ESP_OK;
+    }
+    if (timeout_ticks == 0) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    // Nothing ready: sleep until the next completion this client is waiting for
+    uint64_t next = UINT64_MAX;
+    for (int i = 0; i < s_bus.num_pending; i++) {
+        if (s_bus.pending[i].client == client_hdl && s_bus.pending[i].due_us < next) {
+            next = s_bus.pending[i].due_us;
+        }
+    }
+    // One tick is one millisecond
+    const uint64_t timeout_us = (uint64_t)timeout_ticks * 1000;
+    if (next == UINT64_MAX || (timeout_ticks != UINT32_MAX && next - s_bus.now_us > timeout_us)) {
+        s_bus.now_us += timeout_ticks == UINT32_MAX ? 0 : timeout_us;
+        return ESP_ERR_TIMEOUT;
+    }
+    s_bus.now_us = next;
+    while (complete_one(client_hdl)) {
+    }
+    return ESP_OK;
+}
+
+/* ---------- Devices ---------- */
+
+esp_err_t usb_host_device_open(usb_host_client_handle_t client_hdl, uint8_t dev_addr, usb_device_handle_t *dev_hdl_ret)
+{
+    struct usb_device_handle_s *dev = dev_by_addr(dev_addr);
+    if (dev == NULL || dev_hdl_ret == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    dev->opened_by |= 1u << client_index(client_hdl);
+    *dev_hdl_ret = dev;
+    return ESP_OK;
+}
+
+esp_err_t usb_host_device_close(usb_host_client_handle_t client_hdl, usb_device_handle_t dev_hdl)
+{
+    if (dev_hdl == NULL || !(dev_hdl->opened_by & (1u << client_index(client_hdl)))) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    dev_hdl->opened_by &= ~(1u << client_index(client_hdl));
+    if (dev_hdl->reenumerate && dev_hdl->opened_by == 0) {
+        reenumerate(dev_hdl);
+    }
+    return ESP_OK;
+}
+
+esp_err_t usb_host_device_info(usb_device_handle_t dev_hdl, usb_device_info_t *dev_info)
+{
+    if (dev_hdl == NULL || dev_info == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(dev_info, 0, sizeof(*dev_info));
+    dev_info->speed = dev_hdl->cfg.speed;
+    dev_info->dev_addr = dev_hdl->addr;
+    dev_info->bMaxPacketSize0 = dev_hdl->dev_desc.bMaxPacketSize0;
+    dev_info->bConfigurationValue = 1;
+    dev_info->str_desc_serial_num = dev_hdl->serial;
+    return ESP_OK;
+}
+
+esp_err_t usb_host_get_device_descriptor(usb_device_handle_t dev_hdl, const usb_device_desc_t **device_desc)
+{
+    if (dev_hdl == NULL || device_desc == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *device_desc = &dev_hdl->dev_desc;
+    return ESP_OK;
+}
+
+esp_err_t usb_host_get_active_config_descriptor(usb_device_handle_t dev_hdl, const usb_config_desc_t **config_desc)
+{
+    if (dev_hdl == NULL || config_desc == NULL || dev_hdl->cfg.config_desc == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *config_desc = (const usb_config_desc_t *)dev_hdl->cfg.config_desc;
+    return ESP_OK;
+}
+
+esp_err_t usb_host_interface_claim(usb_host_client_handle_t client_hdl, usb_device_handle_t dev_hdl,
+                                   uint8_t bInterfaceNumber, uint8_t bAlternateSetting)
+{
+    (void)bInterfaceNumber;
+    (void)bAlternateSetting;
+    if (dev_hdl == NULL || !(dev_hdl->opened_by & (1u << client_index(client_hdl)))) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return ESP_OK;
+}
+
+esp_err_t usb_host_interface_release(usb_host_client_handle_t client_hdl, usb_device_handle_t dev_hdl,
+                                     uint8_t bInterfaceNumber)
+{
+    return usb_host_interface_claim(client_hdl, dev_hdl, bInterfaceNumber, 0);
+}
+
+/* ---------- Endpoints ---------- */
+
+static esp_err_t ep_check(usb_device_handle_t dev_hdl, uint8_t ep)
+{
+    return dev_hdl == NULL || (ep & 0x0F) == 0 ? ESP_ERR_INVALID_ARG : ESP_OK;
+}
+
+esp_err_t usb_host_endpoint_halt(usb_device_handle_t dev_hdl, uint8_t bEndpointAddress)
+{
+    esp_err_t err = ep_check(dev_hdl, bEndpointAddress);
+    if (err == ESP_OK) {
+        dev_hdl->halted |= 1u << (bEndpointAddress & 0x0F);
+    }
+    return err;
+}
+
+esp_err_t usb_host_endpoint_flush(usb_device_handle_t dev_hdl, uint8_t bEndpointAddress)
+{
+    esp_err_t err = ep_check(dev_hdl, bEndpointAddress);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (s_faults.on && s_faults.cfg.flush_fail) {
+        return ESP_FAIL;
+    }
+    if (!(dev_hdl->halted & (1u << (bEndpointAddress & 0x0F)))) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // Everything queued on the endpoint comes back as canceled on the next event pass
+    for (int i = 0; i < s_bus.num_pending; i++) {
+        usb_transfer_t *xfer = s_bus.pending[i].xfer;
+        if (xfer->device_handle == dev_hdl && xfer->bEndpointAddress == bEndpointAddress) {
+            s_bus.pending[i].canceled = true;
+            s_bus.pending[i].due_us = s_bus.now_us;
+        }
+    }
+    dev_hdl->isoc_next_us[bEndpointAddress & 0x0F] = 0;
+    return ESP_OK;
+}
+
+esp_err_t usb_host_endpoint_clear(usb_device_handle_t dev_hdl, uint8_t bEndpointAddress)
+{
+    esp_err_t err = ep_check(dev_hdl, bEndpointAddress);
+    if (err == ESP_OK) {
+        dev_hdl->halted &= ~(1u << (bEndpointAddress & 0x0F));
+    }
+    return err;
+}
+
+/* ---------- Transfers ---------- */
+
+esp_err_t usb_host_transfer_alloc(size_t data_buffer_size, int num_isoc_packets, usb_transfer_t **transfer)
+{
+    if (transfer == NULL || num_isoc_packets < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (num_isoc_packets > 0 && s_faults.on && s_faults.cfg.iso_alloc_limit &&
+            s_faults.iso_allocs++ >= s_faults.cfg.iso_alloc_limit) {
+        return ESP_ERR_NO_MEM;
+    }
+    usb_transfer_t *xfer = calloc(1, sizeof(usb_transfer_t) + (size_t)num_isoc_packets * sizeof(usb_isoc_packet_desc_t));
+    uint8_t *buf = calloc(1, data_buffer_size ? data_buffer_size : 1);
+    if (xfer == NULL || buf == NULL) {
+        free(xfer);
+        free(buf);
+        return ESP_ERR_NO_MEM;
+    }
+    // The const members are only ever set here, as in the real allocator
+    *(uint8_t **)&xfer->data_buffer = buf;
+    *(size_t *)&xfer->data_buffer_size = data_buffer_size;
+    *(int *)&xfer->num_isoc_packets = num_isoc_packets;
+    *transfer = xfer;
+    s_transfers_allocated++;
+    return ESP_OK;
+}
+
+esp_err_t usb_host_transfer_free(usb_transfer_t *transfer)
+{
+    if (transfer == NULL) {
+        return ESP_OK;
+    }
+    for (int i = 0; i < s_bus.num_pending; i++) {
+        if (s_bus.pending[i].xfer == transfer) {
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+    free(transfer->data_buffer);
+    free(transfer);
+    s_transfers_allocated--;
+    return ESP_OK;
+}
+
+static esp_err_t schedule(usb_transfer_t *xfer, usb_host_client_handle_t client, uint64_t due_us, bool is_ctrl)
+{
+    if (s_bus.num_pending >= MOCK_MAX_PENDING) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < s_bus.num_pending; i++) {
+        if (s_bus.pending[i].xfer == xfer) {
+            return ESP_ERR_INVALID_STATE;   // already in flight
+        }
+    }
+    s_bus.pending[s_bus.num_pending++] = (pending_t) {
+        .xfer = xfer, .client = client, .due_us = due_us, .is_ctrl = is_ctrl,
+    };
+    return ESP_OK;
+}
+
+static const usb_ep_desc_t *find_ep(const struct usb_device_handle_s *dev, uint8_t addr)
+{
+    const usb_config_desc_t *cfg = (const usb_config_desc_t *)dev->cfg.config_desc;
+    if (cfg == NULL) {
+        return NULL;
+    }
+    const uint8_t *p = dev->cfg.config_desc;
+    const uint8_t *end = p + cfg->wTotalLength;
+    for (; p + 2 <= end && p[0] >= 2 && p + p[0] <= end; p += p[0]) {
+        if (p[1] == USB_B_DESCRIPTOR_TYPE_ENDPOINT && p[0] >= 7 && p[2] == addr) {
+            return (const usb_ep_desc_t *)p;
+        }
+    }
+    return NULL;
+}
+
+/* Queue an isochronous URB behind the ones already on its endpoint: one
+ * packet per service interval, 2^(bInterval-1) frames at full speed or
+ * microframes at high speed, starting at the next free one */
+static esp_err_t schedule_isoc(usb_transfer_t *xfer, usb_host_client_handle_t client)
+{
+    struct usb_device_handle_s *dev = xfer->device_handle;
+    const usb_ep_desc_t *ep = find_ep(dev, xfer->bEndpointAddress);
+    if (ep == NULL || (ep->bmAttributes & USB_BM_ATTRIBUTES_XFERTYPE_MASK) != USB_BM_ATTRIBUTES_XFER_ISOC) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const size_t capacity = USB_EP_DESC_GET_MPS(ep) * (USB_EP_DESC_GET_MULT(ep) + 1u);
+    int total = 0;
+    for (int i = 0; i < xfer->num_isoc_packets; i++) {
+        if (xfer->isoc_packet_desc[i].num_bytes < 0 || (size_t)xfer->isoc_packet_desc[i].num_bytes > capacity) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        total += xfer->isoc_packet_desc[i].num_bytes;
+    }
+    if (total > xfer->num_bytes) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    const uint32_t unit = dev->cfg.speed == USB_SPEED_HIGH ? 125 : 1000;
+    const uint32_t interval = unit << (ep->bInterval >= 1 && ep->bInterval <= 16 ? ep->bInterval - 1 : 0);
+    uint64_t *next = &dev->isoc_next_us[xfer->bEndpointAddress & 0x0F];
+    // A late submit (or the first) starts at the next interval boundary;
+    // intervals that went by with nothing queued are lost, as on the bus
+    const uint64_t earliest = (s_bus.now_us + interval - 1) / interval * interval;
+    const uint64_t start = *next > earliest ? *next : earliest;
+    const uint64_t due = start + (uint64_t)xfer->num_isoc_packets * interval;
+    // A late completion holds back the ones queued behind it on the endpoint
+    uint64_t done = due;
+    if (s_faults.cfg.late_max_us && fault_hit(FAULT_LATE)) {
+        done += 1 + fault_rand() % s_faults.cfg.late_max_us;
+    }
+    uint64_t *last_done = &dev->isoc_done_us[xfer->bEndpointAddress & 0x0F];
+    done = done > *last_done ? done : *last_done;
+    esp_err_t err = schedule(xfer, client, done, false);
+    if (err == ESP_OK) {
+        s_bus.pending[s_bus.num_pending - 1].start_us = start;
+        s_bus.pending[s_bus.num_pending - 1].interval_us = interval;
+        *next = due;
+        *last_done = done;
+    }
+    return err;
+}
+
+esp_err_t usb_host_transfer_submit_control(usb_host_client_handle_t client_hdl, usb_transfer_t *transfer)
+{
+    if (transfer == NULL || transfer->device_handle == NULL || transfer->callback == NULL ||
+            transfer->num_bytes < (int)sizeof(usb_setup_packet_t) || (size_t)transfer->num_bytes > transfer->data_buffer_size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct usb_device_handle_s *dev = transfer->device_handle;
+    const usb_setup_packet_t *setup = (const usb_setup_packet_t *)transfer->data_buffer;
+    if (transfer->num_bytes < (int)(sizeof(usb_setup_packet_t) + setup->wLength)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (!dev->connected) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t err = schedule(transfer, client_hdl, s_bus.now_us + dev->cfg.ctrl_latency_ms * 1000ull, true);
+    if (err == ESP_OK) {
+        dev->ctrl_inflight++;
+        if (dev->ctrl_inflight > dev->ctrl_max_inflight) {
+            dev->ctrl_max_inflight = dev->ctrl_inflight;
+        }
+    }
+    return err;
+}
+
+esp_err_t usb_host_transfer_submit(usb_transfer_t *transfer)
+{
+    if (transfer == NULL || transfer->device_handle == NULL || transfer->callback == NULL ||
+            (transfer->bEndpointAddress & 0x0F) == 0 || transfer->num_bytes < 0 ||
+            (size_t)transfer->num_bytes > transfer->data_buffer_size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct usb_device_handle_s *dev = transfer->device_handle;
+    if (!dev->connected || (dev->halted & (1u << (transfer->bEndpointAddress & 0x0F)))) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // The client that opened the device gets the completion
+    usb_host_client_handle_t client = NULL;
+    for (int c = 0; c < MOCK_MAX_CLIENTS && client == NULL; c++) {
+        if (dev->opened_by & (1u << c)) {
+            client = &s_bus.clients[c];
+        }
+    }
+    if (client == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (transfer->num_isoc_packets) {
+        return fault_hit(FAULT_SUBMIT_FAIL) ? ESP_FAIL : schedule_isoc(transfer, client);
+    }
+    // IN transfers NAK (stay parked) until the device has a packet for them
+    const bool in = transfer->bEndpointAddress & USB_B_ENDPOINT_ADDRESS_EP_DIR_MASK;
+    const bool ready = !in || in_backlog(dev, transfer->bEndpointAddress) > 0;
+    return schedule(transfer, client, ready ? s_bus.now_us + dev->cfg.data_latency_ms * 1000ull : MOCK_PARKED, false);
+}
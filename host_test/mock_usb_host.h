@@ -0,0 +1,177 @@
+// mock_usb_host.h  (in-process stand-in for the ESP-IDF USB Host Library)
+//
+// mock_usb_host.c implements the usb/usb_host.h client API from shim/ on
+// top of simulated devices, so firmware sources that talk to the host
+// library can be exercised on Linux. Time is virtual: transfers complete at
+// a scheduled microsecond, and usb_host_client_handle_events() jumps the
+// clock forward to the next due completion instead of sleeping. Callbacks
+// run inside usb_host_client_handle_events(), as on the target.
+//
+// Isochronous URBs follow the bus schedule: one packet per service
+// interval (2^(bInterval-1) frames at full speed, 125 us microframes at
+// high speed), queued back to back per endpoint, completing when their
+// last interval ends. esp_timer_get_time() reads the same clock.
+//
+// mock_usb_set_faults() makes the bus misbehave on isochronous transfers:
+// packets that fail or arrive cut short, completions that come late (in
+// order, as the controller would deliver them) and submits that fail.
+//
+// usb_host_device_free_all() resets and enumerates again every device no
+// client has open; usb_host_lib_set_root_port_power() takes every device
+// off the bus and back. A device still open when it comes back is
+// enumerated again once its last client closes it, as the host library
+// only then frees it.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "usb/usb_host.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Device-side control request handler
+ *
+ * @param setup  The request
+ * @param data   Data stage: host payload for OUT requests, to be filled for IN requests
+ * @param len    In: wLength. Out: bytes returned for IN requests.
+ * @return ESP_OK to complete, ESP_ERR_NOT_FOUND to fall back to the built-in
+ *         standard requests, anything else to STALL
+ */
+typedef esp_err_t (*mock_usb_ctrl_handler_t)(const usb_setup_packet_t *setup, uint8_t *data, size_t *len, void *ctx);
+
+/**
+ * @brief Device-side handler for a completed OUT transfer on a non-control endpoint
+ *
+ * Replies go back with mock_usb_device_send(), typically from inside the handler.
+ */
+typedef void (*mock_usb_out_handler_t)(uint8_t addr, uint8_t ep, const uint8_t *data, size_t len, void *ctx);
+
+/**
+ * @brief Device-side source of isochronous IN data
+ *
+ * @param t_us     Bus time of the packet's service interval
+ * @param data     Room for the packet (max_len bytes)
+ * @return Bytes sent, -1 for a packet lost on the bus (the host sees an error)
+ */
+typedef int (*mock_usb_isoc_in_handler_t)(uint8_t addr, uint8_t ep, uint64_t t_us, uint8_t *data, size_t max_len, void *ctx);
+
+/**
+ * @brief Device-side bus reset, before the device is enumerated again
+ *
+ * @param power_lost  The root port's power was cut (and the device with it)
+ */
+typedef void (*mock_usb_reset_handler_t)(uint8_t addr, bool power_lost, void *ctx);
+
+typedef struct {
+    usb_speed_t speed;
+    uint16_t vid;
+    uint16_t pid;
+    const char *serial;             /**< Optional serial number string */
+    const uint8_t *config_desc;     /**< Full configuration descriptor, wTotalLength bytes */
+    mock_usb_ctrl_handler_t ctrl;   /**< Optional; standard requests are built in */
+    void *ctx;
+    uint32_t ctrl_latency_ms;       /**< Time from submit to completion of a control transfer */
+    mock_usb_out_handler_t data_out;    /**< Optional; OUT data is dropped without one */
+    uint32_t data_latency_ms;       /**< Time for an interrupt/bulk packet once both sides are ready */
+    mock_usb_isoc_in_handler_t isoc_in; /**< Optional; isochronous IN packets are empty without one */
+    mock_usb_reset_handler_t reset;     /**< Optional */
+} mock_usb_device_config_t;
+
+/**
+ * @brief Drop every device, client and pending transfer, and rewind the clock
+ */
+void mock_usb_host_reset(void);
+
+/**
+ * @brief Attach a device and post NEW_DEV to every client
+ *
+ * @return Bus address, 0 if the bus is full
+ */
+uint8_t mock_usb_connect(const mock_usb_device_config_t *config);
+
+/**
+ * @brief Detach a device: DEV_GONE to clients that opened it, in-flight transfers end NO_DEVICE
+ */
+void mock_usb_disconnect(uint8_t addr);
+
+/**
+ * @brief Queue a packet for the device to return on IN endpoint `ep`
+ *
+ * An IN transfer submitted to `ep` stays pending (NAKed) until a packet is
+ * queued, then completes data_latency_ms later with it.
+ *
+ * @return ESP_ERR_NO_MEM if the device's IN queue is full
+ */
+esp_err_t mock_usb_device_send(uint8_t addr, uint8_t ep, const void *data, size_t len);
+
+/**
+ * @brief One kind of fault: how often a burst starts and how long it lasts
+ */
+typedef struct {
+    float probability;              /**< Per opportunity (packet, URB, submit), when no burst is running */
+    uint32_t burst;                 /**< Opportunities hit in a row once one is; 0 counts as 1 */
+} mock_usb_fault_t;
+
+typedef struct {
+    uint32_t seed;                  /**< Same seed, same faults */
+    mock_usb_fault_t packet_error;  /**< An ISO IN packet comes back with an error and no data */
+    mock_usb_fault_t short_packet;  /**< An ISO IN packet with data arrives cut to at most half its length */
+    mock_usb_fault_t late;          /**< An ISO URB completes up to late_max_us after its last interval */
+    uint32_t late_max_us;
+    mock_usb_fault_t submit_fail;   /**< usb_host_transfer_submit() of an ISO URB returns ESP_FAIL */
+    bool flush_fail;                /**< usb_host_endpoint_flush() returns ESP_FAIL, leaving the URBs in flight */
+    uint32_t iso_alloc_limit;       /**< ISO URBs usb_host_transfer_alloc() hands out before it returns ESP_ERR_NO_MEM, 0 for no limit */
+} mock_usb_faults_t;
+
+/**
+ * @brief Faults injected so far, by kind
+ */
+typedef struct {
+    uint32_t packet_error;
+    uint32_t short_packet;
+    uint32_t late;
+    uint32_t submit_fail;
+} mock_usb_fault_counts_t;
+
+/**
+ * @brief Start injecting faults into isochronous transfers (NULL: stop); counts restart
+ *
+ * mock_usb_host_reset() stops them too.
+ */
+void mock_usb_set_faults(const mock_usb_faults_t *faults);
+
+void mock_usb_fault_counts(mock_usb_fault_counts_t *counts);
+
+/**
+ * @brief Transfers allocated and not freed yet, over every test so far
+ */
+int mock_usb_transfers_allocated(void);
+
+uint64_t mock_usb_now_ms(void);
+uint64_t mock_usb_now_us(void);
+void mock_usb_advance_ms(uint32_t ms);
+
+/**
+ * @brief Times a device was enumerated again (freed, or after a power cycle)
+ */
+int mock_usb_reenumerations(uint8_t addr);
+
+/**
+ * @brief Largest number of control transfers a device ever had in flight at once
+ */
+int mock_usb_ctrl_max_inflight(uint8_t addr);
+
+/**
+ * @brief Control transfers a device has completed (any status)
+ */
+int mock_usb_ctrl_count(uint8_t addr);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,14 @@
+// esp_log.h  (host shim: log lines go to stdout, as on the target console)
+
+#pragma once
+
+#include <stdio.h>
+#include "esp_err.h"
+
+#define ESP_HOST_LOG(letter, tag, fmt, ...)     printf(letter " (%s) " fmt "\n", tag, ##__VA_ARGS__)
+
+#define ESP_LOGE(tag, fmt, ...)     ESP_HOST_LOG("E", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)     ESP_HOST_LOG("W", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...)     ESP_HOST_LOG("I", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...)     do { (void)(tag); } while (0)
+#define ESP_LOGV(tag, fmt, ...)     do { (void)(tag); } while (0)
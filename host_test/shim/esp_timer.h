@@ -0,0 +1,7 @@
+// esp_timer.h  (host shim: the clock only, read from mock_usb_host's virtual bus time)
+
+#pragma once
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
@@ -0,0 +1,15 @@
+// FreeRTOS.h  (host shim: the tick and mutex types main/ sources use)
+
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+
+#define pdTRUE                  1
+#define pdFALSE                 0
+#define portMAX_DELAY           UINT32_MAX
+#define portTICK_PERIOD_MS      1
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(ms))
@@ -0,0 +1,12 @@
+// task.h  (host shim: tasks are not simulated, tests drive the loops directly)
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+
+static inline void vTaskSuspend(TaskHandle_t task)
+{
+    (void)task;
+}
@@ -0,0 +1,133 @@
+// usb_types_ch9.h  (host shim: the chapter 9 types and macros main/ uses, laid out as in ESP-IDF)
+
+#pragma once
+
+#include <stdint.h>
+
+#define USB_SETUP_PACKET_SIZE                   8
+
+#define USB_BM_REQUEST_TYPE_DIR_OUT             (0x00 << 7)
+#define USB_BM_REQUEST_TYPE_DIR_IN              (0x01 << 7)
+#define USB_BM_REQUEST_TYPE_TYPE_STANDARD       (0x00 << 5)
+#define USB_BM_REQUEST_TYPE_TYPE_CLASS          (0x01 << 5)
+#define USB_BM_REQUEST_TYPE_TYPE_VENDOR         (0x02 << 5)
+#define USB_BM_REQUEST_TYPE_RECIP_DEVICE        (0x00)
+#define USB_BM_REQUEST_TYPE_RECIP_INTERFACE     (0x01)
+#define USB_BM_REQUEST_TYPE_RECIP_ENDPOINT      (0x02)
+
+#define USB_B_REQUEST_GET_DESCRIPTOR            0x06
+#define USB_B_REQUEST_SET_INTERFACE             0x0B
+
+#define USB_B_DESCRIPTOR_TYPE_DEVICE            0x01
+#define USB_B_DESCRIPTOR_TYPE_CONFIGURATION     0x02
+#define USB_B_DESCRIPTOR_TYPE_STRING            0x03
+#define USB_B_DESCRIPTOR_TYPE_INTERFACE         0x04
+#define USB_B_DESCRIPTOR_TYPE_ENDPOINT          0x05
+
+#define USB_CLASS_AUDIO                         0x01
+#define USB_CLASS_HID                           0x03
+
+#define USB_BM_ATTRIBUTES_XFERTYPE_MASK         0x03
+#define USB_BM_ATTRIBUTES_XFER_ISOC             (1 << 0)
+#define USB_BM_ATTRIBUTES_XFER_BULK             (2 << 0)
+#define USB_BM_ATTRIBUTES_XFER_INT              (3 << 0)
+#define USB_B_ENDPOINT_ADDRESS_EP_DIR_MASK      (1 << 7)
+#define USB_EP_DESC_GET_MPS(desc_ptr)           ((desc_ptr)->wMaxPacketSize & 0x7FF)
+#define USB_EP_DESC_GET_MULT(desc_ptr)          (((desc_ptr)->wMaxPacketSize & 0x1800) >> 11)
+
+typedef union {
+    struct {
+        uint8_t bmRequestType;
+        uint8_t bRequest;
+        uint16_t wValue;
+        uint16_t wIndex;
+        uint16_t wLength;
+    } __attribute__((packed));
+    uint8_t val[USB_SETUP_PACKET_SIZE];
+} usb_setup_packet_t;
+
+#define USB_SETUP_PACKET_INIT_SET_INTERFACE(setup_pkt_ptr, intf_num, alt_setting_num) ({  \
+    (setup_pkt_ptr)->bmRequestType = USB_BM_REQUEST_TYPE_DIR_OUT | USB_BM_REQUEST_TYPE_TYPE_STANDARD | USB_BM_REQUEST_TYPE_RECIP_INTERFACE; \
+    (setup_pkt_ptr)->bRequest = USB_B_REQUEST_SET_INTERFACE; \
+    (setup_pkt_ptr)->wValue = (alt_setting_num); \
+    (setup_pkt_ptr)->wIndex = (intf_num); \
+    (setup_pkt_ptr)->wLength = 0; \
+})
+
+typedef union {
+    struct {
+        uint8_t bLength;
+        uint8_t bDescriptorType;
+    } __attribute__((packed));
+    uint8_t val[2];
+} usb_standard_desc_t;
+
+typedef union {
+    struct {
+        uint8_t bLength;
+        uint8_t bDescriptorType;
+        uint16_t bcdUSB;
+        uint8_t bDeviceClass;
+        uint8_t bDeviceSubClass;
+        uint8_t bDeviceProtocol;
+        uint8_t bMaxPacketSize0;
+        uint16_t idVendor;
+        uint16_t idProduct;
+        uint16_t bcdDevice;
+        uint8_t iManufacturer;
+        uint8_t iProduct;
+        uint8_t iSerialNumber;
+        uint8_t bNumConfigurations;
+    } __attribute__((packed));
+    uint8_t val[18];
+} usb_device_desc_t;
+
+typedef union {
+    struct {
+        uint8_t bLength;
+        uint8_t bDescriptorType;
+        uint16_t wTotalLength;
+        uint8_t bNumInterfaces;
+        uint8_t bConfigurationValue;
+        uint8_t iConfiguration;
+        uint8_t bmAttributes;
+        uint8_t bMaxPower;
+    } __attribute__((packed));
+    uint8_t val[9];
+} usb_config_desc_t;
+
+typedef union {
+    struct {
+        uint8_t bLength;
+        uint8_t bDescriptorType;
+        uint8_t bInterfaceNumber;
+        uint8_t bAlternateSetting;
+        uint8_t bNumEndpoints;
+        uint8_t bInterfaceClass;
+        uint8_t bInterfaceSubClass;
+        uint8_t bInterfaceProtocol;
+        uint8_t iInterface;
+    } __attribute__((packed));
+    uint8_t val[9];
+} usb_intf_desc_t;
+
+typedef union {
+    struct {
+        uint8_t bLength;
+        uint8_t bDescriptorType;
+        uint8_t bEndpointAddress;
+        uint8_t bmAttributes;
+        uint16_t wMaxPacketSize;
+        uint8_t bInterval;
+    } __attribute__((packed));
+    uint8_t val[7];
+} usb_ep_desc_t;
+
+typedef union {
+    struct {
+        uint8_t bLength;
+        uint8_t bDescriptorType;
+        uint16_t wData[];
+    } __attribute__((packed));
+    uint8_t val[2];
+} usb_str_desc_t;
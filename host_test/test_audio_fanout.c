@@ -0,0 +1,204 @@
+// test_audio_fanout.c  (shared blocks, refcounts, overflow policies, a threaded consumer)
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "audio_fanout.h"
+#include "audio_stream.h"
+#include "test_util.h"
+
+#define CH  2
+
+static int s_notified;
+
+static void count_notify(void *ctx)
+{
+    (void)ctx;
+    s_notified++;
+}
+
+static void fill(int32_t *x, size_t nframes, uint64_t t0)
+{
+    for (size_t i = 0; i < nframes; i++) {
+        x[i * CH] = (int32_t)(t0 + i);
+        x[i * CH + 1] = -(int32_t)(t0 + i);
+    }
+}
+
+static void test_shared_blocks(void)
+{
+    audio_fanout_t *fo;
+    CHECK(audio_fanout_create(&(audio_fanout_config_t) { .num_blocks = 8, .block_samples = 64 * CH }, &fo) == ESP_OK);
+    audio_fanout_sub_t *a, *b;
+    CHECK(audio_fanout_subscribe(fo, &(audio_fanout_sub_config_t) {
+        .name = "a", .depth = 2, .notify = count_notify
+    }, &a) == ESP_OK);
+    CHECK(audio_fanout_subscribe(fo, &(audio_fanout_sub_config_t) { .name = "b", .depth = 2 }, &b) == ESP_OK);
+    CHECK(audio_fanout_free_blocks(fo) == 8);
+
+    // Through audio_stream, as the firmware wires it
+    CHECK(audio_stream_subscribe_frames(audio_fanout_publish, fo) == ESP_OK);
+    audio_stream_set_sample_rate(48000);
+    static int32_t x[100 * CH];
+    fill(x, 100, 1000);
+    audio_stream_publish_frames(x, 100, CH, 1000);
+    CHECK(s_notified == 2);
+    CHECK(audio_fanout_free_blocks(fo) == 6);
+
+    // Both see the same two blocks, 64 frames then 36
+    const audio_block_t *ba = audio_fanout_next(a);
+    const audio_block_t *bb = audio_fanout_next(b);
+    CHECK(ba != NULL && ba == bb);
+    CHECK(ba->t0 == 1000 && ba->nframes == 64 && ba->channels == CH && ba->sample_rate_hz == 48000);
+    CHECK(((uintptr_t)ba->frames & 15) == 0);
+    CHECK(ba->frames[0] == 1000 && ba->frames[63 * CH + 1] == -1063);
+    ba = audio_fanout_next(a);
+    CHECK(ba->t0 == 1064 && ba->nframes == 36 && ba->frames[35 * CH] == 1099);
+    // The first block is still b's
+    CHECK(audio_fanout_free_blocks(fo) == 6);
+    audio_fanout_done(a);
+    CHECK(audio_fanout_free_blocks(fo) == 6);
+    CHECK(audio_fanout_next(b) == ba);
+    CHECK(audio_fanout_free_blocks(fo) == 7);
+    CHECK(audio_fanout_next(b) == NULL);
+    CHECK(audio_fanout_next(a) == NULL);
+    CHECK(audio_fanout_free_blocks(fo) == 8);
+    CHECK(audio_fanout_dropped(a) == 0 && audio_fanout_dropped(b) == 0);
+    // Left subscribed: audio_stream has no unsubscribe, and later tests publish directly
+}
+
+static void test_reservation(void)
+{
+    audio_fanout_t *fo;
+    CHECK(audio_fanout_create(&(audio_fanout_config_t) { .num_blocks = 1, .block_samples = 64 }, &fo) ==
+          ESP_ERR_INVALID_ARG);
+    CHECK(audio_fanout_create(&(audio_fanout_config_t) { .num_blocks = 8, .block_samples = 64 }, &fo) == ESP_OK);
+    audio_fanout_sub_t *s;
+    CHECK(audio_fanout_subscribe(fo, &(audio_fanout_sub_config_t) { .name = "r1", .depth = 0 }, &s) ==
+          ESP_ERR_INVALID_ARG);
+    CHECK(audio_fanout_subscribe(fo, &(audio_fanout_sub_config_t) { .name = "much_too_long_a_name", .depth = 1 },
+                                 &s) == ESP_ERR_INVALID_ARG);
+    // One for the producer, 2 + 1 and 3 + 1 for these: all 8
+    CHECK(audio_fanout_subscribe(fo, &(audio_fanout_sub_config_t) { .name = "r1", .depth = 2 }, &s) == ESP_OK);
+    CHECK(audio_fanout_subscribe(fo, &(audio_fanout_sub_config_t) { .name = "r2", .depth = 3 }, &s) == ESP_OK);
+    CHECK(audio_fanout_subscribe(fo, &(audio_fanout_sub_config_t) { .name = "r3", .depth = 1 }, &s) ==
+          ESP_ERR_NO_MEM);
+    audio_fanout_delete(fo);
+}
+
+static void test_policies(void)
+{
+    audio_fanout_t *fo;
+    CHECK(audio_fanout_create(&(audio_fanout_config_t) { .num_blocks = 12, .block_samples = 16 * CH }, &fo) ==
+          ESP_OK);
+    audio_fanout_sub_t *fast, *newest, *oldest;
+    CHECK(audio_fanout_subscribe(fo, &(audio_fanout_sub_config_t) { .name = "fast", .depth = 2 }, &fast) == ESP_OK);
+    CHECK(audio_fanout_subscribe(fo, &(audio_fanout_sub_config_t) {
+        .name = "newest", .depth = 3, .policy = AUDIO_FANOUT_DROP_NEWEST
+    }, &newest) == ESP_OK);
+    CHECK(audio_fanout_subscribe(fo, &(audio_fanout_sub_config_t) {
+        .name = "oldest", .depth = 3, .policy = AUDIO_FANOUT_DROP_OLDEST
+    }, &oldest) == ESP_OK);
+
+    // 10 blocks; the fast consumer keeps up, the other two never read
+    static int32_t x[16 * CH];
+    for (uint64_t t = 0; t < 160; t += 16) {
+        fill(x, 16, t);
+        audio_fanout_publish(x, 16, CH, t, fo);
+        const audio_block_t *blk = audio_fanout_next(fast);
+        CHECK(blk != NULL && blk->t0 == t && blk->frames[0] == (int32_t)t);
+    }
+    audio_fanout_done(fast);
+    CHECK(audio_fanout_dropped(fast) == 0);
+    CHECK(audio_fanout_dropped(newest) == 7 && audio_fanout_dropped(oldest) == 7);
+    // Only the six queued blocks are out of the pool
+    CHECK(audio_fanout_free_blocks(fo) == 6);
+
+    // DROP_NEWEST kept the first three, DROP_OLDEST the last three
+    for (uint64_t t = 0; t < 48; t += 16) {
+        const audio_block_t *blk = audio_fanout_next(newest);
+        CHECK(blk != NULL && blk->t0 == t);
+        blk = audio_fanout_next(oldest);
+        CHECK(blk != NULL && blk->t0 == 112 + t && blk->frames[1] == -(int32_t)(112 + t));
+    }
+    CHECK(audio_fanout_next(newest) == NULL && audio_fanout_next(oldest) == NULL);
+    CHECK(audio_fanout_free_blocks(fo) == 12);
+    audio_fanout_delete(fo);
+}
+
+/* A consumer thread against a producer that doesn't wait: every block it
+ * gets must be intact and in order, and no block may leak */
+static audio_fanout_sub_t *s_slow;
+static atomic_bool s_done;
+
+static void *consumer(void *arg)
+{
+    int *bad = arg;
+    uint64_t next_t0 = 0;
+    unsigned got = 0;
+    while (true) {
+        const bool done = atomic_load(&s_done);
+        const audio_block_t *blk;
+        while ((blk = audio_fanout_next(s_slow)) != NULL) {
+            if (blk->t0 < next_t0) {
+                (*bad)++;
+            }
+            next_t0 = blk->t0 + blk->nframes;
+            for (size_t i = 0; i < blk->nframes; i++) {
+                if (blk->frames[i * CH] != (int32_t)(blk->t0 + i) ||
+                        blk->frames[i * CH + 1] != -(int32_t)(blk->t0 + i)) {
+                    (*bad)++;
+                }
+            }
+            got++;
+        }
+        if (done) {
+            break;
+        }
+    }
+    audio_fanout_done(s_slow);
+    return (void *)(uintptr_t)got;
+}
+
+static void test_threaded(void)
+{
+    audio_fanout_t *fo;
+    CHECK(audio_fanout_create(&(audio_fanout_config_t) { .num_blocks = 16, .block_samples = 32 * CH }, &fo) ==
+          ESP_OK);
+    audio_fanout_sub_t *inline_sub;
+    CHECK(audio_fanout_subscribe(fo, &(audio_fanout_sub_config_t) { .name = "inline", .depth = 4 }, &inline_sub) ==
+          ESP_OK);
+    CHECK(audio_fanout_subscribe(fo, &(audio_fanout_sub_config_t) {
+        .name = "slow", .depth = 4, .policy = AUDIO_FANOUT_DROP_OLDEST
+    }, &s_slow) == ESP_OK);
+
+    int bad = 0;
+    pthread_t th;
+    CHECK(pthread_create(&th, NULL, consumer, &bad) == 0);
+    static int32_t x[96 * CH];
+    const unsigned blocks = 3 * 60000;     // 96 frames a publish, 32 a block
+    for (uint64_t t = 0; t < blocks * 32ull; t += 96) {
+        fill(x, 96, t);
+        audio_fanout_publish(x, 96, CH, t, fo);
+        while (audio_fanout_next(inline_sub) != NULL) {
+        }
+    }
+    atomic_store(&s_done, true);
+    void *got;
+    pthread_join(th, &got);
+    CHECK(bad == 0);
+    CHECK((uintptr_t)got + audio_fanout_dropped(s_slow) == blocks);
+    CHECK(audio_fanout_dropped(inline_sub) == 0);
+    CHECK(audio_fanout_free_blocks(fo) == 16);
+    audio_fanout_delete(fo);
+}
+
+int main(void)
+{
+    test_shared_blocks();
+    test_reservation();
+    test_policies();
+    test_threaded();
+    return test_report("audio_fanout");
+}
@@ -0,0 +1,225 @@
+// test_audiomoth_hid.c  (HID configuration channel against the simulated AudioMoth)
+
+#include <string.h>
+#include "audiomoth_hid.h"
+#include "mock_audiomoth.h"
+#include "test_util.h"
+
+static usb_host_client_handle_t s_client;
+static usb_device_handle_t s_dev;
+
+static void client_cb(const usb_host_client_event_msg_t *msg, void *arg)
+{
+    (void)arg;
+    if (msg->event == USB_HOST_CLIENT_EVENT_NEW_DEV) {
+        CHECK(usb_host_device_open(s_client, msg->new_dev.address, &s_dev) == ESP_OK);
+    }
+}
+
+#define MAX_DONE 8
+
+static struct {
+    int n;
+    esp_err_t err[MAX_DONE];
+    audiomoth_hid_reply_t reply[MAX_DONE];
+    uint64_t at_ms[MAX_DONE];
+} s_done;
+
+static void done_cb(esp_err_t err, const audiomoth_hid_reply_t *reply, void *ctx)
+{
+    (void)ctx;
+    if (s_done.n < MAX_DONE) {
+        s_done.err[s_done.n] = err;
+        if (reply) {
+            s_done.reply[s_done.n] = *reply;
+        }
+        s_done.at_ms[s_done.n] = mock_usb_now_ms();
+    }
+    s_done.n++;
+}
+
+static void drain(audiomoth_hid_t *hid)
+{
+    while (usb_host_client_handle_events(s_client, 10) == ESP_OK || audiomoth_hid_pending(hid)) {
+        audiomoth_hid_poll(hid);
+        if (mock_usb_now_ms() > 10000) {
+            break;
+        }
+    }
+}
+
+static audiomoth_hid_t *setup(mock_audiomoth_t *am)
+{
+    mock_usb_host_reset();
+    memset(&s_done, 0, sizeof(s_done));
+    const usb_host_client_config_t cfg = {
+        .async = { .client_event_callback = client_cb },
+    };
+    CHECK(usb_host_client_register(&cfg, &s_client) == ESP_OK);
+    mock_audiomoth_init(am);
+    CHECK(mock_audiomoth_connect(am, "243B1A055F6E2C41") != 0);
+    usb_host_client_handle_events(s_client, 0);
+
+    const usb_config_desc_t *config_desc;
+    CHECK(usb_host_get_active_config_descriptor(s_dev, &config_desc) == ESP_OK);
+    audiomoth_hid_config_t hcfg = {
+        .dev = s_dev,
+        .timeout_ms = 50,
+        .now_ms = mock_usb_now_ms,
+    };
+    CHECK(audiomoth_hid_find(config_desc, &hcfg) == ESP_OK);
+    CHECK(hcfg.intf == 2 && hcfg.ep_out == 0x01 && hcfg.ep_in == 0x81);
+    CHECK(usb_host_interface_claim(s_client, s_dev, hcfg.intf, 0) == ESP_OK);
+
+    audiomoth_hid_t *hid = NULL;
+    CHECK(audiomoth_hid_create(&hcfg, &hid) == ESP_OK);
+    return hid;
+}
+
+/* Field by field: the struct has padding */
+static bool settings_equal(const audiomoth_settings_t *a, const audiomoth_settings_t *b)
+{
+    return a->sample_rate_hz == b->sample_rate_hz && a->gain == b->gain && a->filter == b->filter &&
+           a->lower_filter_hz == b->lower_filter_hz && a->higher_filter_hz == b->higher_filter_hz &&
+           a->led == b->led && a->low_gain_range == b->low_gain_range && a->energy_saver == b->energy_saver;
+}
+
+static void test_settings_roundtrip(void)
+{
+    const audiomoth_settings_t s = {
+        .sample_rate_hz = 384000, .gain = 4, .filter = AUDIOMOTH_FILTER_BAND_PASS,
+        .lower_filter_hz = 15000, .higher_filter_hz = 120000, .energy_saver = true,
+    };
+    uint8_t buf[AUDIOMOTH_SETTINGS_LEN];
+    audiomoth_settings_encode(&s, buf);
+    audiomoth_settings_t back;
+    audiomoth_settings_decode(buf, &back);
+    CHECK(settings_equal(&s, &back));
+}
+
+/* The boot sequence: everything queued at once, answered in order within milliseconds */
+static void test_configure(void)
+{
+    mock_audiomoth_t am;
+    audiomoth_hid_t *hid = setup(&am);
+    const uint64_t t0 = mock_usb_now_ms();
+
+    const audiomoth_settings_t want = {
+        .sample_rate_hz = 192000, .gain = 3, .filter = AUDIOMOTH_FILTER_HIGH_PASS, .lower_filter_hz = 8000,
+    };
+    CHECK(audiomoth_hid_get_firmware_version(hid, done_cb, NULL) == ESP_OK);
+    CHECK(audiomoth_hid_set_time(hid, 1767225600, done_cb, NULL) == ESP_OK);
+    CHECK(audiomoth_hid_set_settings(hid, &want, done_cb, NULL) == ESP_OK);
+    CHECK(audiomoth_hid_get_settings(hid, done_cb, NULL) == ESP_OK);
+    CHECK(audiomoth_hid_pending(hid) == 4);
+    drain(hid);
+
+    CHECK(s_done.n == 4);
+    for (int i = 0; i < 4; i++) {
+        CHECK(s_done.err[i] == ESP_OK);
+    }
+    CHECK(s_done.reply[0].cmd == AUDIOMOTH_HID_GET_FIRMWARE_VERSION && s_done.reply[0].version[0] == 1 &&
+          s_done.reply[0].version[1] == 2);
+    CHECK(s_done.reply[1].time == 1767225600 && am.time == 1767225600);
+    CHECK(settings_equal(&s_done.reply[2].settings, &want));
+    CHECK(settings_equal(&s_done.reply[3].settings, &want));
+    CHECK(settings_equal(&am.settings, &want));
+    // One OUT and one IN latency per request
+    CHECK(s_done.at_ms[3] - t0 <= 4 * 2 * am.latency_ms);
+    CHECK(am.requests == 4);
+
+    // The device clock runs on
+    mock_usb_advance_ms(5000);
+    CHECK(audiomoth_hid_get_time(hid, done_cb, NULL) == ESP_OK);
+    drain(hid);
+    CHECK(s_done.n == 5 && s_done.err[4] == ESP_OK && s_done.reply[4].time == 1767225605);
+
+    CHECK(audiomoth_hid_set_settings(hid, &(audiomoth_settings_t) { .gain = 5 }, done_cb, NULL) == ESP_ERR_INVALID_ARG);
+    audiomoth_hid_delete(hid);
+}
+
+static void test_timeout_and_bad_reply(void)
+{
+    mock_audiomoth_t am;
+    audiomoth_hid_t *hid = setup(&am);
+
+    // No answer: the request times out and the channel recovers
+    am.mute = true;
+    const uint64_t t0 = mock_usb_now_ms();
+    CHECK(audiomoth_hid_get_time(hid, done_cb, NULL) == ESP_OK);
+    CHECK(audiomoth_hid_get_time(hid, done_cb, NULL) == ESP_OK);
+    drain(hid);
+    CHECK(s_done.n == 2 && s_done.err[0] == ESP_ERR_TIMEOUT && s_done.err[1] == ESP_ERR_TIMEOUT);
+    CHECK(s_done.at_ms[0] - t0 >= 50 && s_done.at_ms[0] - t0 < 70);
+
+    am.mute = false;
+    CHECK(audiomoth_hid_get_firmware_version(hid, done_cb, NULL) == ESP_OK);
+    drain(hid);
+    CHECK(s_done.n == 3 && s_done.err[2] == ESP_OK && s_done.reply[2].version[1] == 2);
+
+    // Unknown command: the device answers with a report for no command
+    CHECK(audiomoth_hid_request(hid, 0x55, NULL, 0, done_cb, NULL) == ESP_OK);
+    drain(hid);
+    CHECK(s_done.n == 4 && s_done.err[3] == ESP_ERR_INVALID_RESPONSE);
+
+    // Queue limit
+    am.mute = true;
+    for (int i = 0; i < AUDIOMOTH_HID_QUEUE_LEN; i++) {
+        CHECK(audiomoth_hid_get_time(hid, NULL, NULL) == ESP_OK);
+    }
+    CHECK(audiomoth_hid_get_time(hid, NULL, NULL) == ESP_ERR_NO_MEM);
+
+    // Deleting with a request on the bus frees once its transfers are back
+    audiomoth_hid_delete(hid);
+    while (usb_host_client_handle_events(s_client, 10) == ESP_OK) {
+    }
+}
+
+static void test_unplug(void)
+{
+    mock_audiomoth_t am;
+    audiomoth_hid_t *hid = setup(&am);
+    am.mute = true;
+    CHECK(audiomoth_hid_get_time(hid, done_cb, NULL) == ESP_OK);
+    CHECK(audiomoth_hid_get_settings(hid, done_cb, NULL) == ESP_OK);
+    mock_usb_disconnect(am.addr);
+    drain(hid);
+    CHECK(s_done.n == 2 && s_done.err[0] == ESP_ERR_INVALID_STATE && s_done.err[1] == ESP_ERR_INVALID_STATE);
+    CHECK(audiomoth_hid_pending(hid) == 0);
+    audiomoth_hid_delete(hid);
+}
+
+static audiomoth_hid_t *s_del_hid;
+
+static void delete_cb(esp_err_t err, const audiomoth_hid_reply_t *reply, void *ctx)
+{
+    done_cb(err, reply, ctx);
+    audiomoth_hid_delete(s_del_hid);
+    s_del_hid = NULL;
+}
+
+/* A callback that deletes the handle: queued requests fail, nothing touches it afterwards (ASan) */
+static void test_delete_from_callback(void)
+{
+    mock_audiomoth_t am;
+    s_del_hid = setup(&am);
+    CHECK(audiomoth_hid_get_time(s_del_hid, delete_cb, NULL) == ESP_OK);
+    CHECK(audiomoth_hid_get_settings(s_del_hid, done_cb, NULL) == ESP_OK);
+    CHECK(audiomoth_hid_get_firmware_version(s_del_hid, done_cb, NULL) == ESP_OK);
+    while (usb_host_client_handle_events(s_client, 10) == ESP_OK) {
+    }
+    CHECK(s_del_hid == NULL);
+    CHECK(s_done.n == 3 && s_done.err[0] == ESP_OK);
+    CHECK(s_done.err[1] == ESP_ERR_INVALID_STATE && s_done.err[2] == ESP_ERR_INVALID_STATE);
+    CHECK(mock_usb_transfers_allocated() == 0);
+}
+
+int main(void)
+{
+    test_settings_roundtrip();
+    test_configure();
+    test_timeout_and_bad_reply();
+    test_unplug();
+    test_delete_from_callback();
+    return test_report("audiomoth_hid");
+}
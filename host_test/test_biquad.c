@@ -0,0 +1,119 @@
+// test_biquad.c  (block path vs sample-at-a-time reference, filter response)
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "biquad.h"
+#include "test_util.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define FS  48000
+
+static uint32_t s_seed = 11;
+
+static int16_t rnd16(void)
+{
+    s_seed = s_seed * 1664525u + 1013904223u;
+    return (int16_t)(s_seed >> 16);
+}
+
+static biquad_config_t make_config(size_t sections, size_t channels, size_t max_frames)
+{
+    biquad_config_t cfg = { .num_sections = sections, .channels = channels, .max_frames = max_frames };
+    CHECK(biquad_design_dc_block(5.0f, FS, &cfg.sections[0]) == ESP_OK);
+    for (size_t s = 1; s < sections; s++) {
+        CHECK(biquad_design_highpass(20.0f * (float)s, 0.7071f, FS, &cfg.sections[s]) == ESP_OK);
+    }
+    return cfg;
+}
+
+static void test_bit_exact(void)
+{
+    static const size_t channels[] = { 1, 2, 3, 8 };
+    static const size_t blocks[] = { 1, 48, 333, 768 };
+    for (size_t c = 0; c < sizeof(channels) / sizeof(channels[0]); c++) {
+        for (size_t sections = 1; sections <= 4; sections++) {
+            const biquad_config_t cfg = make_config(sections, channels[c], 256);
+            biquad_t *a, *b;
+            CHECK(biquad_create(&cfg, &a) == ESP_OK);
+            CHECK(biquad_create(&cfg, &b) == ESP_OK);
+            for (size_t bl = 0; bl < sizeof(blocks) / sizeof(blocks[0]); bl++) {
+                const size_t ns = blocks[bl] * channels[c];
+                int16_t *x = malloc(ns * sizeof(int16_t)), *y = malloc(ns * sizeof(int16_t));
+                for (size_t i = 0; i < ns; i++) {
+                    // Full-scale noise with a large offset to exercise saturation
+                    x[i] = (i % 5 == 0) ? INT16_MAX : rnd16();
+                }
+                memcpy(y, x, ns * sizeof(int16_t));
+                biquad_process(a, x, blocks[bl]);
+                biquad_process_ref(b, y, blocks[bl]);
+                CHECK(memcmp(x, y, ns * sizeof(int16_t)) == 0);
+                free(x);
+                free(y);
+            }
+            biquad_delete(a);
+            biquad_delete(b);
+        }
+    }
+}
+
+static double tone_gain(biquad_t *bq, double freq)
+{
+    // Settle for 1 s, then measure peak over the next 0.5 s
+    static int16_t x[FS / 2];
+    double peak = 0.0;
+    biquad_reset(bq);
+    for (int pass = 0; pass < 3; pass++) {
+        for (size_t i = 0; i < FS / 2; i++) {
+            x[i] = (int16_t)(10000.0 * sin(2.0 * M_PI * freq * (double)(pass * FS / 2 + i) / FS));
+        }
+        biquad_process(bq, x, FS / 2);
+    }
+    for (size_t i = 0; i < FS / 2; i++) {
+        peak = fabs((double)x[i]) > peak ? fabs((double)x[i]) : peak;
+    }
+    return peak / 10000.0;
+}
+
+static void test_response(void)
+{
+    const biquad_config_t cfg = make_config(3, 1, 768);
+    biquad_t *bq;
+    CHECK(biquad_create(&cfg, &bq) == ESP_OK);
+
+    // DC offset is removed
+    static int16_t x[FS];
+    for (size_t i = 0; i < FS; i++) {
+        x[i] = 3000 + rnd16() / 64;
+    }
+    biquad_process(bq, x, FS);
+    double mean = 0.0;
+    for (size_t i = FS / 2; i < FS; i++) {
+        mean += x[i];
+    }
+    mean /= FS / 2;
+    CHECK(fabs(mean) < 2.0);
+
+    // Wind rumble band attenuated, passband untouched
+    CHECK(tone_gain(bq, 5.0) < 0.05);
+    CHECK(fabs(tone_gain(bq, 1000.0) - 1.0) < 0.01);
+    CHECK(fabs(tone_gain(bq, 20000.0) - 1.0) < 0.01);
+    CHECK(biquad_cycles_per_sample(bq) > 0.0);
+    biquad_delete(bq);
+
+    biquad_coeffs_t c;
+    CHECK(biquad_design_highpass(30000.0f, 0.7f, FS, &c) == ESP_ERR_INVALID_ARG);
+    biquad_config_t bad = cfg;
+    bad.channels = BIQUAD_MAX_CHANNELS + 1;
+    CHECK(biquad_create(&bad, &bq) == ESP_ERR_INVALID_ARG);
+}
+
+int main(void)
+{
+    test_bit_exact();
+    test_response();
+    return test_report("biquad");
+}
@@ -0,0 +1,224 @@
+// test_class_driver.c  (one client, class drivers matched per interface)
+
+#include <string.h>
+#include "class_driver.h"
+#include "mock_audiomoth.h"
+#include "test_util.h"
+
+#define UAC_SUBCLASS_AUDIOSTREAMING     0x02
+
+typedef struct {
+    int parses;
+    int offers;
+    int attaches;
+    int detaches;
+    int attach_intf;
+    bool cache_hit;
+    int defer_detach;           /**< Detach calls to answer ESP_ERR_NOT_FINISHED */
+    int decline_intf;           /**< Interface to pass on, -1 for none */
+    bool poll_soon;
+    int polls;
+} fake_t;
+
+static fake_t s_stream, s_hid, s_any;
+
+static void reset_fakes(void)
+{
+    memset(&s_stream, 0, sizeof(s_stream));
+    memset(&s_hid, 0, sizeof(s_hid));
+    memset(&s_any, 0, sizeof(s_any));
+    s_stream.decline_intf = s_hid.decline_intf = s_any.decline_intf = -1;
+    s_stream.attach_intf = s_hid.attach_intf = s_any.attach_intf = -1;
+}
+
+static void fake_parse(const usb_config_desc_t *config_desc, const usb_intf_desc_t *intf,
+                       desc_cache_entry_t *entry, void *arg)
+{
+    fake_t *f = arg;
+    f->parses++;
+    if (f == &s_stream) {
+        entry->has_stream = uac_parse_stream(config_desc, intf->bInterfaceNumber, 1, &entry->stream) == ESP_OK;
+    }
+}
+
+static esp_err_t fake_attach(const class_driver_dev_t *dev, const usb_intf_desc_t *intf, void *arg, void **ret_ctx)
+{
+    fake_t *f = arg;
+    f->offers++;
+    CHECK(dev->dev_hdl != NULL && dev->ctrl != NULL && dev->config_desc != NULL && dev->desc != NULL);
+    if (intf->bInterfaceNumber == f->decline_intf) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (f == &s_stream) {
+        CHECK(dev->desc->has_stream && dev->desc->stream.ep_addr == 0x82);
+    }
+    f->attaches++;
+    f->attach_intf = intf->bInterfaceNumber;
+    f->cache_hit = dev->cache_hit;
+    *ret_ctx = f;
+    return ESP_OK;
+}
+
+static esp_err_t fake_detach(const class_driver_dev_t *dev, void *ctx)
+{
+    (void)dev;
+    fake_t *f = ctx;
+    f->detaches++;
+    if (f->defer_detach > 0) {
+        f->defer_detach--;
+        return ESP_ERR_NOT_FINISHED;
+    }
+    return ESP_OK;
+}
+
+static bool fake_poll(const class_driver_dev_t *dev, void *ctx)
+{
+    (void)dev;
+    fake_t *f = ctx;
+    f->polls++;
+    return f->poll_soon;
+}
+
+static const class_driver_ops_t s_stream_ops = {
+    .name = "stream",
+    .intf_class = USB_CLASS_AUDIO,
+    .intf_subclass = UAC_SUBCLASS_AUDIOSTREAMING,
+    .parse = fake_parse,
+    .attach = fake_attach,
+    .detach = fake_detach,
+};
+
+static const class_driver_ops_t s_hid_ops = {
+    .name = "hid",
+    .intf_class = USB_CLASS_HID,
+    .intf_subclass = CLASS_DRIVER_MATCH_ANY,
+    .parse = fake_parse,
+    .attach = fake_attach,
+    .detach = fake_detach,
+    .poll = fake_poll,
+};
+
+static const class_driver_ops_t s_any_ops = {
+    .name = "any",
+    .intf_class = CLASS_DRIVER_MATCH_ANY,
+    .intf_subclass = CLASS_DRIVER_MATCH_ANY,
+    .attach = fake_attach,
+    .detach = fake_detach,
+};
+
+static void run(int passes)
+{
+    for (int i = 0; i < passes; i++) {
+        class_driver_handle_events(0);
+    }
+}
+
+static void shutdown(void)
+{
+    class_driver_client_deregister();
+    int passes = 0;
+    while (class_driver_handle_events(0) && passes < 10) {
+        passes++;
+    }
+    CHECK(passes < 10);
+    CHECK(class_driver_uninstall() == ESP_OK);
+}
+
+static void test_match_and_reattach(void)
+{
+    mock_usb_host_reset();
+    reset_fakes();
+    CHECK(class_driver_install() == ESP_OK);
+    CHECK(class_driver_register(&s_any_ops, &s_any) == ESP_ERR_INVALID_STATE);
+
+    mock_audiomoth_t am;
+    mock_audiomoth_init(&am);
+    s_any.decline_intf = 0;
+    CHECK(mock_audiomoth_connect(&am, "243B1A055F6E2C41") != 0);
+    run(2);
+    // Each driver on its own interface; the one that passed on AC got the next one
+    CHECK(s_stream.attaches == 1 && s_stream.attach_intf == 1 && !s_stream.cache_hit);
+    CHECK(s_hid.attaches == 1 && s_hid.attach_intf == 2);
+    CHECK(s_any.offers == 2 && s_any.attaches == 1 && s_any.attach_intf == 1);
+    CHECK(s_stream.parses == 1 && s_hid.parses == 1);
+
+    // Unplug: every driver detaches; one needs another event pass to let go
+    s_stream.defer_detach = 1;
+    mock_usb_disconnect(am.addr);
+    run(1);
+    CHECK(s_stream.detaches == 1 && s_hid.detaches == 1 && s_any.detaches == 1);
+    run(1);
+    CHECK(s_stream.detaches == 2 && s_hid.detaches == 1);
+
+    // Same unit again: served from the descriptor cache, nothing parsed
+    CHECK(mock_audiomoth_connect(&am, "243B1A055F6E2C41") != 0);
+    run(2);
+    CHECK(s_stream.attaches == 2 && s_stream.cache_hit);
+    CHECK(s_stream.parses == 1 && s_hid.parses == 1);
+    shutdown();
+    CHECK(s_stream.detaches == 3 && s_hid.detaches == 2 && s_any.detaches == 2);
+}
+
+static void test_poll(void)
+{
+    mock_usb_host_reset();
+    reset_fakes();
+    CHECK(class_driver_install() == ESP_OK);
+    mock_audiomoth_t am;
+    mock_audiomoth_init(&am);
+    CHECK(mock_audiomoth_connect(&am, "243B1A055F6E2C42") != 0);
+    run(2);
+    CHECK(s_hid.attaches == 1 && s_hid.polls > 0);
+
+    // A driver waiting on a timeout caps the event wait
+    s_hid.poll_soon = true;
+    run(1);
+    uint64_t t0 = mock_usb_now_ms();
+    class_driver_handle_events(UINT32_MAX);
+    CHECK(mock_usb_now_ms() - t0 == CLASS_DRIVER_POLL_MS);
+
+    s_hid.poll_soon = false;
+    run(1);
+    t0 = mock_usb_now_ms();
+    class_driver_handle_events(UINT32_MAX);
+    CHECK(mock_usb_now_ms() == t0);
+
+    // Not polled once detaching
+    mock_usb_disconnect(am.addr);
+    const int polls = s_hid.polls;
+    run(2);
+    CHECK(s_hid.polls == polls && s_hid.detaches == 1);
+    shutdown();
+}
+
+static void test_shutdown_waits_for_detach(void)
+{
+    mock_usb_host_reset();
+    reset_fakes();
+    CHECK(class_driver_install() == ESP_OK);
+    mock_audiomoth_t am;
+    mock_audiomoth_init(&am);
+    CHECK(mock_audiomoth_connect(&am, "243B1A055F6E2C43") != 0);
+    run(2);
+    s_stream.defer_detach = 3;
+    class_driver_client_deregister();
+    int passes = 0;
+    while (class_driver_handle_events(0)) {
+        passes++;
+    }
+    CHECK(passes == 3 && s_stream.detaches == 4);
+    CHECK(class_driver_uninstall() == ESP_OK);
+    CHECK(class_driver_uninstall() == ESP_ERR_INVALID_STATE);
+}
+
+int main(void)
+{
+    CHECK(class_driver_register(&s_stream_ops, &s_stream) == ESP_OK);
+    CHECK(class_driver_register(&s_hid_ops, &s_hid) == ESP_OK);
+    CHECK(class_driver_register(&s_any_ops, &s_any) == ESP_OK);
+    CHECK(class_driver_register(NULL, NULL) == ESP_ERR_INVALID_ARG);
+    test_match_and_reattach();
+    test_poll();
+    test_shutdown_waits_for_detach();
+    return test_report("class_driver");
+}
@@ -0,0 +1,207 @@
+// test_ctrl_xfer.c  (control-transfer engine against the mock USB host)
+
+#include <string.h>
+#include "ctrl_xfer.h"
+#include "mock_usb_host.h"
+#include "test_util.h"
+
+#define LATENCY_MS  3
+
+static usb_host_client_handle_t s_client;
+static usb_device_handle_t s_dev[8];
+static int s_num_dev;
+
+static void client_cb(const usb_host_client_event_msg_t *msg, void *arg)
+{
+    (void)arg;
+    if (msg->event == USB_HOST_CLIENT_EVENT_NEW_DEV) {
+        CHECK(usb_host_device_open(s_client, msg->new_dev.address, &s_dev[s_num_dev++]) == ESP_OK);
+    }
+}
+
+static esp_err_t vendor_ctrl(const usb_setup_packet_t *setup, uint8_t *data, size_t *len, void *ctx)
+{
+    (void)ctx;
+    if (setup->bRequest == 0x42) {
+        return ESP_ERR_INVALID_ARG;     // STALL
+    }
+    if (setup->bRequest == 0x01 && (setup->bmRequestType & USB_BM_REQUEST_TYPE_DIR_IN)) {
+        for (size_t i = 0; i < *len; i++) {
+            data[i] = (uint8_t)(setup->wValue + i);
+        }
+        return ESP_OK;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+static ctrl_xfer_t *setup_bus(int devices, size_t pool)
+{
+    mock_usb_host_reset();
+    s_num_dev = 0;
+    const usb_host_client_config_t cfg = {
+        .is_synchronous = false,
+        .max_num_event_msg = 5,
+        .async = { .client_event_callback = client_cb },
+    };
+    CHECK(usb_host_client_register(&cfg, &s_client) == ESP_OK);
+    const mock_usb_device_config_t dev = {
+        .speed = USB_SPEED_FULL, .vid = 0x16d0, .pid = 0x06f3,
+        .ctrl = vendor_ctrl, .ctrl_latency_ms = LATENCY_MS,
+    };
+    for (int d = 0; d < devices; d++) {
+        CHECK(mock_usb_connect(&dev) != 0);
+    }
+    usb_host_client_handle_events(s_client, 0);
+    CHECK(s_num_dev == devices);
+
+    const ctrl_xfer_config_t ecfg = { .client = s_client, .pool_size = pool, .max_data_len = 64 };
+    ctrl_xfer_t *eng = NULL;
+    CHECK(ctrl_xfer_create(&ecfg, &eng) == ESP_OK);
+    return eng;
+}
+
+static void drain(void)
+{
+    while (usb_host_client_handle_events(s_client, 100) == ESP_OK) {
+    }
+}
+
+static int s_order[16], s_num_done;
+static esp_err_t s_errs[16];
+static uint64_t s_last_done_ms;
+
+static void record_cb(esp_err_t err, const uint8_t *data, size_t len, void *ctx)
+{
+    (void)data;
+    (void)len;
+    s_last_done_ms = mock_usb_now_ms();
+    s_errs[s_num_done] = err;
+    s_order[s_num_done++] = (int)(intptr_t)ctx;
+}
+
+static void test_pipelined_and_concurrent(void)
+{
+    ctrl_xfer_t *eng = setup_bus(2, 8);
+    s_num_done = 0;
+    const uint64_t t0 = mock_usb_now_ms();
+    for (int i = 0; i < 4; i++) {
+        CHECK(ctrl_xfer_set_interface(eng, s_dev[0], 1, (uint8_t)i, record_cb, (void *)(intptr_t)i) == ESP_OK);
+    }
+    for (int i = 0; i < 4; i++) {
+        CHECK(ctrl_xfer_set_interface(eng, s_dev[1], 1, 1, record_cb, (void *)(intptr_t)(10 + i)) == ESP_OK);
+    }
+    CHECK(ctrl_xfer_pending(eng, s_dev[0]) == 4);
+    drain();
+    CHECK(s_num_done == 8);
+
+    // FIFO per device, one on EP0 at a time, both devices in parallel
+    int last0 = -1, last1 = 9;
+    for (int i = 0; i < s_num_done; i++) {
+        CHECK(s_errs[i] == ESP_OK);
+        if (s_order[i] < 10) {
+            CHECK(s_order[i] == last0 + 1);
+            last0 = s_order[i];
+        } else {
+            CHECK(s_order[i] == last1 + 1);
+            last1 = s_order[i];
+        }
+    }
+    CHECK(mock_usb_ctrl_max_inflight(1) == 1 && mock_usb_ctrl_max_inflight(2) == 1);
+    CHECK(s_last_done_ms - t0 == 4 * LATENCY_MS);
+    CHECK(ctrl_xfer_pending(eng, s_dev[0]) == 0);
+    CHECK(ctrl_xfer_delete(eng) == ESP_OK);
+}
+
+static void test_in_stall_and_pool(void)
+{
+    ctrl_xfer_t *eng = setup_bus(1, 2);
+
+    uint8_t buf[16];
+    ctrl_xfer_future_t f;
+    ctrl_xfer_future_init(&f, buf, sizeof(buf));
+    const usb_setup_packet_t get = {
+        .bmRequestType = USB_BM_REQUEST_TYPE_DIR_IN | USB_BM_REQUEST_TYPE_TYPE_VENDOR,
+        .bRequest = 0x01, .wValue = 7, .wLength = 5,
+    };
+    CHECK(ctrl_xfer_submit(eng, s_dev[0], &get, NULL, ctrl_xfer_future_cb, &f) == ESP_OK);
+
+    ctrl_xfer_future_t stall;
+    ctrl_xfer_future_init(&stall, NULL, 0);
+    const usb_setup_packet_t bad = { .bmRequestType = USB_BM_REQUEST_TYPE_TYPE_VENDOR, .bRequest = 0x42 };
+    CHECK(ctrl_xfer_submit(eng, s_dev[0], &bad, NULL, ctrl_xfer_future_cb, &stall) == ESP_OK);
+    CHECK(ctrl_xfer_submit(eng, s_dev[0], &bad, NULL, NULL, NULL) == ESP_ERR_NO_MEM);
+
+    const usb_setup_packet_t big = { .bmRequestType = USB_BM_REQUEST_TYPE_DIR_IN, .wLength = 65 };
+    CHECK(ctrl_xfer_submit(eng, s_dev[0], &big, NULL, NULL, NULL) == ESP_ERR_INVALID_SIZE);
+
+    drain();
+    CHECK(f.done && f.err == ESP_OK && f.len == 5);
+    CHECK(buf[0] == 7 && buf[4] == 11);
+    CHECK(stall.done && stall.err == ESP_ERR_NOT_SUPPORTED);
+    CHECK(ctrl_xfer_delete(eng) == ESP_OK);
+}
+
+/* A completion callback queues the next step itself, as stream setup does */
+static ctrl_xfer_t *s_chain_eng;
+static int s_chain_steps;
+
+static void chain_cb(esp_err_t err, const uint8_t *data, size_t len, void *ctx)
+{
+    (void)data;
+    (void)len;
+    (void)ctx;
+    CHECK(err == ESP_OK);
+    if (++s_chain_steps < 3) {
+        CHECK(ctrl_xfer_set_interface(s_chain_eng, s_dev[0], 1, 1, chain_cb, NULL) == ESP_OK);
+    }
+}
+
+static void test_chain_and_unplug(void)
+{
+    s_chain_eng = setup_bus(1, 4);
+    s_chain_steps = 0;
+    CHECK(ctrl_xfer_set_interface(s_chain_eng, s_dev[0], 1, 1, chain_cb, NULL) == ESP_OK);
+    drain();
+    CHECK(s_chain_steps == 3);
+
+    // Unplug with one request on the bus and two queued
+    s_num_done = 0;
+    for (int i = 0; i < 3; i++) {
+        CHECK(ctrl_xfer_set_interface(s_chain_eng, s_dev[0], 1, 0, record_cb, (void *)(intptr_t)i) == ESP_OK);
+    }
+    mock_usb_disconnect(1);
+    ctrl_xfer_cancel_device(s_chain_eng, s_dev[0]);
+    CHECK(s_num_done == 2 && s_order[0] == 1 && s_errs[0] == ESP_ERR_INVALID_STATE);
+    drain();
+    CHECK(s_num_done == 3 && s_order[2] == 0 && s_errs[2] == ESP_ERR_INVALID_STATE);
+    CHECK(ctrl_xfer_pending(s_chain_eng, s_dev[0]) == 0);
+    CHECK(ctrl_xfer_set_interface(s_chain_eng, s_dev[0], 1, 0, record_cb, NULL) == ESP_OK);
+    CHECK(s_num_done == 4 && s_errs[3] == ESP_ERR_INVALID_STATE);
+    CHECK(ctrl_xfer_delete(s_chain_eng) == ESP_OK);
+}
+
+/* As many devices as the bus holds, each with a request queued */
+static void test_many_devices(void)
+{
+    const int n = sizeof(s_dev) / sizeof(s_dev[0]);
+    ctrl_xfer_t *eng = setup_bus(n, n);
+    s_num_done = 0;
+    for (int d = 0; d < n; d++) {
+        CHECK(ctrl_xfer_set_interface(eng, s_dev[d], 1, 1, record_cb, (void *)(intptr_t)d) == ESP_OK);
+    }
+    drain();
+    CHECK(s_num_done == n);
+    for (int i = 0; i < s_num_done; i++) {
+        CHECK(s_errs[i] == ESP_OK);
+    }
+    CHECK(ctrl_xfer_delete(eng) == ESP_OK);
+}
+
+int main(void)
+{
+    test_pipelined_and_concurrent();
+    test_in_stall_and_pool();
+    test_chain_and_unplug();
+    test_many_devices();
+    return test_report("ctrl_xfer");
+}
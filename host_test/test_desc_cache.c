@@ -0,0 +1,116 @@
+// test_desc_cache.c  (descriptor cache keyed by device identity)
+
+#include <string.h>
+#include "desc_cache.h"
+#include "mock_audiomoth.h"
+#include "test_util.h"
+
+static usb_host_client_handle_t s_client;
+static usb_device_handle_t s_dev;
+
+static void client_cb(const usb_host_client_event_msg_t *msg, void *arg)
+{
+    (void)arg;
+    if (msg->event == USB_HOST_CLIENT_EVENT_NEW_DEV) {
+        CHECK(usb_host_device_open(s_client, msg->new_dev.address, &s_dev) == ESP_OK);
+    }
+}
+
+/* Attach `am`, return its identity and configuration descriptor */
+static const usb_config_desc_t *attach(mock_audiomoth_t *am, const char *serial, desc_cache_key_t *key)
+{
+    CHECK(mock_audiomoth_connect(am, serial) != 0);
+    usb_host_client_handle_events(s_client, 0);
+    CHECK(desc_cache_key_from_device(s_dev, key) == ESP_OK);
+    const usb_config_desc_t *config_desc = NULL;
+    CHECK(usb_host_get_active_config_descriptor(s_dev, &config_desc) == ESP_OK);
+    return config_desc;
+}
+
+static void detach(mock_audiomoth_t *am)
+{
+    mock_usb_disconnect(am->addr);
+    usb_host_device_close(s_client, s_dev);
+    usb_host_client_handle_events(s_client, 0);
+}
+
+static void store_parsed(desc_cache_t *cache, const desc_cache_key_t *key, const usb_config_desc_t *config_desc)
+{
+    desc_cache_entry_t e = { .key = *key };
+    e.has_stream = uac_parse_stream(config_desc, 1, 1, &e.stream) == ESP_OK;
+    CHECK(desc_cache_store(cache, &e, config_desc) == ESP_OK);
+}
+
+static void test_reattach(void)
+{
+    mock_usb_host_reset();
+    const usb_host_client_config_t cfg = {
+        .async = { .client_event_callback = client_cb },
+    };
+    CHECK(usb_host_client_register(&cfg, &s_client) == ESP_OK);
+    desc_cache_t *cache;
+    CHECK(desc_cache_create(4, &cache) == ESP_OK);
+
+    mock_audiomoth_t am;
+    mock_audiomoth_init(&am);
+    desc_cache_key_t key;
+    const usb_config_desc_t *config_desc = attach(&am, "243B1A055F6E2C41", &key);
+    CHECK(key.vid == 0x16D0 && key.pid == 0x06F3 && strcmp(key.serial, "243B1A055F6E2C41") == 0);
+    CHECK(desc_cache_lookup(cache, &key, config_desc) == NULL);
+    store_parsed(cache, &key, config_desc);
+    detach(&am);
+
+    // Same device again: served from the cache
+    config_desc = attach(&am, "243B1A055F6E2C41", &key);
+    const desc_cache_entry_t *e = desc_cache_lookup(cache, &key, config_desc);
+    CHECK(e != NULL && e->has_stream && e->stream.ep_addr == 0x82 && e->stream.ep_mps == 96 &&
+          e->stream.freqs[0] == 48000);
+    detach(&am);
+
+    // Same identity, reconfigured to another rate: the descriptors changed, so it misses
+    am.settings.sample_rate_hz = 192000;
+    config_desc = attach(&am, "243B1A055F6E2C41", &key);
+    CHECK(desc_cache_lookup(cache, &key, config_desc) == NULL);
+    store_parsed(cache, &key, config_desc);
+    e = desc_cache_lookup(cache, &key, config_desc);
+    CHECK(e != NULL && e->stream.freqs[0] == 192000 && e->stream.ep_mps == 384);
+    detach(&am);
+
+    // Another unit of the same model
+    am.settings.sample_rate_hz = 48000;
+    config_desc = attach(&am, "243B1A055F6E2C42", &key);
+    CHECK(desc_cache_lookup(cache, &key, config_desc) == NULL);
+    detach(&am);
+
+    uint32_t hits, misses;
+    desc_cache_stats(cache, &hits, &misses);
+    CHECK(hits == 2 && misses == 3);
+    desc_cache_delete(cache);
+}
+
+static void test_lru(void)
+{
+    desc_cache_t *cache;
+    CHECK(desc_cache_create(2, &cache) == ESP_OK);
+    uint8_t desc[32] = { 9, 0x02, 9, 0 };
+    const usb_config_desc_t *config_desc = (const usb_config_desc_t *)desc;
+    desc_cache_entry_t a = { .key = { .vid = 1, .serial = "A" } };
+    desc_cache_entry_t b = { .key = { .vid = 1, .serial = "B" } };
+    desc_cache_entry_t c = { .key = { .vid = 1, .serial = "C" } };
+    CHECK(desc_cache_store(cache, &a, config_desc) == ESP_OK);
+    CHECK(desc_cache_store(cache, &b, config_desc) == ESP_OK);
+    CHECK(desc_cache_lookup(cache, &a.key, config_desc) != NULL);
+    CHECK(desc_cache_store(cache, &c, config_desc) == ESP_OK);
+    CHECK(desc_cache_lookup(cache, &a.key, config_desc) != NULL);
+    CHECK(desc_cache_lookup(cache, &b.key, config_desc) == NULL);
+    CHECK(desc_cache_lookup(cache, &c.key, config_desc) != NULL);
+    CHECK(desc_cache_create(0, &cache) == ESP_ERR_INVALID_ARG);
+    desc_cache_delete(cache);
+}
+
+int main(void)
+{
+    test_reattach();
+    test_lru();
+    return test_report("desc_cache");
+}
@@ -0,0 +1,200 @@
+// test_dlog.c  (deferred log: argument capture vs printf, full ring, concurrent writers, frames decoded with this ELF)
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <string.h>
+#include "dlog.h"
+#include "dlog_decode.h"
+#include "test_util.h"
+
+#define THREADS     4
+#define WRITES      50000
+
+static const char *TAG = "dlog_test";
+
+/* Text of the oldest record after its "I (ms) tag: " */
+static const char *pop_text(void)
+{
+    static char line[256];
+    dlog_record_t r;
+    if (!dlog_pop(&r)) {
+        return "<empty>";
+    }
+    dlog_format(&r, line, sizeof(line));
+    const char *text = strstr(line, ": ");
+    return text ? text + 2 : line;
+}
+
+static bool same(const char *got, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static bool same(const char *got, const char *fmt, ...)
+{
+    char want[256];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(want, sizeof(want), fmt, ap);
+    va_end(ap);
+    if (strcmp(got, want) != 0) {
+        printf("got  \"%s\"\nwant \"%s\"\n", got, want);
+        return false;
+    }
+    return true;
+}
+
+static void test_format(void)
+{
+    dlog_record_t r;
+    CHECK(!dlog_pop(&r));
+    DLOGI(TAG, "a %d b %u c %x d %lld %%", -5, 7u, 0xBEEFu, -1234567890123LL);
+    DLOGW(TAG, "e %llu f %.1f g %s p %p", 9876543210ULL, 3.25, "str", (void *)0x1234);
+    DLOGE(TAG, "h %c i %zu j %ld k %5.2f|%-4d|", 'Z', (size_t)42, -77L, 2.5, 9);
+    DLOGI(TAG, "%*d|%-*.*f|", 6, 42, 8, 3, 2.5);
+    DLOGI(TAG, "%.*s|%hhd|%hu|%.*d", 3, "abcdef", (signed char)-3, (unsigned short)65535, -1, 12);
+    DLOGI(TAG, "no arguments");
+    CHECK(same(pop_text(), "a %d b %u c %x d %lld %%", -5, 7u, 0xBEEFu, -1234567890123LL));
+    CHECK(same(pop_text(), "e %llu f %.1f g %s p %p", 9876543210ULL, 3.25, "str", (void *)0x1234));
+    CHECK(same(pop_text(), "h %c i %zu j %ld k %5.2f|%-4d|", 'Z', (size_t)42, -77L, 2.5, 9));
+    CHECK(same(pop_text(), "%*d|%-*.*f|", 6, 42, 8, 3, 2.5));
+    CHECK(same(pop_text(), "%.*s|%hhd|%hu|%.*d", 3, "abcdef", (signed char)-3, (unsigned short)65535, -1, 12));
+    CHECK(same(pop_text(), "no arguments"));
+
+    // Four doubles fill a record: the fifth conversion stays as written
+    DLOGI(TAG, "%.0f %.0f %.0f %.0f %.0f!", 1.0, 2.0, 3.0, 4.0, 5.0);
+    CHECK(strcmp(pop_text(), "1 2 3 4 %.0f!") == 0);
+
+    // The line looks like ESP_LOGx's
+    DLOGW(TAG, "x=%d", 1);
+    CHECK(dlog_pop(&r));
+    char line[64];
+    CHECK(dlog_format(&r, line, sizeof(line)) == strlen(line) && strncmp(line, "W (", 3) == 0);
+    CHECK(strstr(line, ") dlog_test: x=1") != NULL);
+    CHECK(dlog_format(&r, line, 8) == 7 && strlen(line) == 7);
+}
+
+static void test_full(void)
+{
+    CHECK(dlog_take_dropped() == 0);
+    for (int i = 0; i < DLOG_RECORDS + 5; i++) {
+        DLOGI(TAG, "n=%d", i);
+    }
+    CHECK(dlog_take_dropped() == 5 && dlog_take_dropped() == 0);
+    bool in_order = true;
+    for (int i = 0; i < DLOG_RECORDS; i++) {
+        char want[16];
+        snprintf(want, sizeof(want), "n=%d", i);
+        in_order &= strcmp(pop_text(), want) == 0;
+    }
+    CHECK(in_order);
+    CHECK(strcmp(pop_text(), "<empty>") == 0);
+}
+
+static void *writer(void *arg)
+{
+    const int t = (int)(intptr_t)arg;
+    for (int i = 0; i < WRITES; i++) {
+        DLOGI(TAG, "%d %d", t, i);
+    }
+    return NULL;
+}
+
+static void test_concurrent(void)
+{
+    pthread_t th[THREADS];
+    for (intptr_t i = 0; i < THREADS; i++) {
+        CHECK(pthread_create(&th[i], NULL, writer, (void *)i) == 0);
+    }
+    // Consume while they write; after the joins, drain what's left
+    int last[THREADS] = { -1, -1, -1, -1 };
+    uint32_t popped = 0;
+    bool in_order = true;
+    for (int pass = 0; pass < 2; pass++) {
+        for (int spins = 0; spins < 200000; spins++) {
+            dlog_record_t r;
+            if (!dlog_pop(&r)) {
+                continue;
+            }
+            char text[64];
+            int t, i;
+            dlog_format_args(r.fmt, r.args, r.args_len, &(dlog_abi_t){ sizeof(void *), sizeof(long) },
+                             NULL, NULL, text, sizeof(text));
+            in_order &= sscanf(text, "%d %d", &t, &i) == 2 && t >= 0 && t < THREADS && i > last[t];
+            if (t >= 0 && t < THREADS) {
+                last[t] = i;
+            }
+            popped++;
+        }
+        if (pass == 0) {
+            for (int i = 0; i < THREADS; i++) {
+                pthread_join(th[i], NULL);
+            }
+        }
+    }
+    CHECK(in_order);
+    CHECK(popped + dlog_take_dropped() == THREADS * WRITES);
+}
+
+typedef struct {
+    int lines;
+    char last[256];
+} seen_t;
+
+static void on_line(const char *line, void *ctx)
+{
+    seen_t *s = ctx;
+    s->lines++;
+    snprintf(s->last, sizeof(s->last), "%s", line);
+}
+
+static void test_frames(void)
+{
+    // This test binary is the "firmware": its own ELF resolves the strings
+    static dlog_elf_t elf;
+    CHECK(dlog_elf_load("/proc/self/exe", &elf) == ESP_OK);
+    CHECK(elf.abi.ptr_size == sizeof(void *) && elf.abi.long_size == sizeof(long));
+    CHECK(strcmp(dlog_elf_string(&elf, elf.anchor_addr), dlog_anchor) == 0);
+
+    DLOGE(TAG, "resubmit failed: %s (%d urbs live, %.1f ms)", esp_err_to_name(ESP_ERR_INVALID_STATE), 2, 1.5);
+    dlog_record_t r;
+    CHECK(dlog_pop(&r));
+    char want[256];
+    dlog_format(&r, want, sizeof(want));
+
+    uint8_t anchor[DLOG_FRAME_MAX], rec[DLOG_FRAME_MAX];
+    size_t anchor_len, rec_len;
+    CHECK(dlog_encode(NULL, anchor, sizeof(anchor), &anchor_len) == ESP_OK && anchor_len == 14);
+    CHECK(dlog_encode(&r, rec, sizeof(rec), &rec_len) == ESP_OK && rec_len <= DLOG_FRAME_MAX);
+    CHECK(dlog_encode(&r, rec, rec_len - 1, &rec_len) == ESP_ERR_INVALID_SIZE);
+
+    static dlog_decoder_t dec;
+    dlog_decoder_init(&dec, &elf);
+    seen_t seen = {0};
+    const char *text = "I (10) boot: console text \xA5\x4C\x02 with a stray sync\n";
+    dlog_decoder_feed(&dec, (const uint8_t *)text, strlen(text), on_line, &seen);
+    // Before any anchor a PIE's addresses mean nothing yet
+    dlog_decoder_feed(&dec, rec, rec_len, on_line, &seen);
+    CHECK(seen.lines == (elf.pie ? 0 : 1) && dec.unplaced == (elf.pie ? 1u : 0u));
+    // A damaged copy is skipped, then anchor and record a byte at a time
+    uint8_t bad[DLOG_FRAME_MAX];
+    memcpy(bad, rec, rec_len);
+    bad[10] ^= 0x40;
+    dlog_decoder_feed(&dec, bad, rec_len, on_line, &seen);
+    const int before = seen.lines;
+    for (size_t i = 0; i < anchor_len; i++) {
+        dlog_decoder_feed(&dec, anchor + i, 1, on_line, &seen);
+    }
+    for (size_t i = 0; i < rec_len; i++) {
+        dlog_decoder_feed(&dec, rec + i, 1, on_line, &seen);
+    }
+    CHECK(seen.lines == before + 1 && strcmp(seen.last, want) == 0);
+    CHECK(strstr(seen.last, "E (") == seen.last && strstr(seen.last, "ESP_ERR_INVALID_STATE (2 urbs live, 1.5 ms)"));
+    dlog_elf_free(&elf);
+}
+
+int main(void)
+{
+    test_format();
+    test_full();
+    test_concurrent();
+    test_frames();
+    return test_report("dlog");
+}
@@ -0,0 +1,367 @@
+// test_dsp_graph.c  (edges, block negotiation, in place, FIFOs across gaps, specs)
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "biquad.h"
+#include "dsp_graph.h"
+#include "dsp_graph_stages.h"
+#include "dsp_kernels.h"
+#include "level_meter.h"
+#include "test_util.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* A stage that adds `add` to every int16 sample, and records what it got */
+#define MAX_CALLS   64
+
+typedef struct {
+    int16_t add;
+    size_t calls;
+    size_t n[MAX_CALLS];
+    uint64_t t0[MAX_CALLS];
+    int16_t first[MAX_CALLS];
+    bool ok;                    // every sample was t + `expect` (the adds upstream)
+    int16_t expect;
+} probe_t;
+
+static int s_destroyed;
+
+static size_t probe_process(void *state, const void *in, void *out, size_t nframes, size_t channels, uint64_t *t0)
+{
+    (void)channels;
+    probe_t *p = state;
+    const int16_t *x = in;
+    if (p->calls < MAX_CALLS) {
+        p->n[p->calls] = nframes;
+        p->t0[p->calls] = *t0;
+        p->first[p->calls] = x[0];
+    }
+    p->calls++;
+    for (size_t i = 0; i < nframes; i++) {
+        p->ok &= x[i] == (int16_t)(*t0 + i + (uint64_t)p->expect);
+    }
+    if (out) {
+        int16_t *y = out;
+        for (size_t i = 0; i < nframes; i++) {
+            y[i] = (int16_t)(x[i] + p->add);
+        }
+    }
+    return nframes;
+}
+
+static void probe_destroy(void *state)
+{
+    (void)state;
+    s_destroyed++;
+}
+
+#define MONO    { DSP_GRAPH_S16, 1 }
+#define NONE    { DSP_GRAPH_NONE, 0 }
+
+static const dsp_graph_stage_t ADD_IN_PLACE = {
+    .name = "add", .in = MONO, .out = MONO, .flags = DSP_GRAPH_IN_PLACE,
+    .process = probe_process, .destroy = probe_destroy,
+};
+static const dsp_graph_stage_t ADD_50 = {
+    .name = "add50", .in = MONO, .out = MONO, .block = 50,
+    .flags = DSP_GRAPH_IN_PLACE | DSP_GRAPH_BLOCK_EXACT, .process = probe_process, .destroy = probe_destroy,
+};
+static const dsp_graph_stage_t SINK_32 = {
+    .name = "sink32", .in = MONO, .out = NONE, .block = 32, .flags = DSP_GRAPH_BLOCK_EXACT,
+    .process = probe_process, .destroy = probe_destroy,
+};
+static const dsp_graph_stage_t SINK_PREF_25 = {
+    .name = "pref25", .in = MONO, .out = NONE, .block = 25, .process = probe_process, .destroy = probe_destroy,
+};
+static const dsp_graph_stage_t SINK_PREF_10 = {
+    .name = "pref10", .in = MONO, .out = NONE, .block = 10, .process = probe_process, .destroy = probe_destroy,
+};
+static const dsp_graph_stage_t SINK_ANY = {
+    .name = "sink", .in = MONO, .out = NONE, .process = probe_process, .destroy = probe_destroy,
+};
+
+static void ramp(int16_t *x, size_t n, uint64_t t0)
+{
+    for (size_t i = 0; i < n; i++) {
+        x[i] = (int16_t)(t0 + i);
+    }
+}
+
+static void test_negotiation(void)
+{
+    static probe_t add = { .add = 1, .ok = true }, sink32 = { .ok = true, .expect = 1 },
+                   pref25 = { .ok = true, .expect = 1 }, add50 = { .add = 2, .ok = true, .expect = 1 },
+                   pref10 = { .ok = true, .expect = 3 };
+    const dsp_graph_config_t cfg = {
+        .source = MONO,
+        .max_frames = 100,
+        .num_nodes = 5,
+        .nodes = {
+            { &ADD_IN_PLACE, &add, DSP_GRAPH_SOURCE },
+            { &SINK_32, &sink32, 0 },
+            { &SINK_PREF_25, &pref25, 0 },
+            { &ADD_50, &add50, 0 },
+            { &SINK_PREF_10, &pref10, 3 },
+        },
+    };
+    dsp_graph_t *g;
+    CHECK(dsp_graph_create(&cfg, &g) == ESP_OK);
+    CHECK(dsp_graph_num_nodes(g) == 5);
+
+    dsp_graph_node_info_t info[5];
+    for (size_t k = 0; k < 5; k++) {
+        CHECK(dsp_graph_node_info(g, k, &info[k]) == ESP_OK);
+    }
+    // The source is never written; a FIFO is its owner's to write
+    CHECK(!info[0].in_place && !info[0].fifo && !info[0].split && info[0].max_frames == 100);
+    CHECK(info[1].fifo && info[1].max_frames == 32);
+    // Preferred, but the input's blocks vary: as they come
+    CHECK(!info[2].fifo && !info[2].split && info[2].max_frames == 100);
+    CHECK(info[3].fifo && info[3].in_place);
+    // Always 50 frames in: cut into fives, no copy
+    CHECK(info[4].split && !info[4].fifo && info[4].max_frames == 10);
+    CHECK(info[3].out.type == DSP_GRAPH_S16 && info[3].out.channels == 1);
+
+    // 70 frames at a time, 280 in all, then a gap of 5
+    static int16_t x[100];
+    for (uint64_t t = 0; t < 280; t += 70) {
+        ramp(x, 70, t);
+        dsp_graph_push(g, x, 70, 1, t);
+    }
+    CHECK(sink32.calls == 8);
+    for (size_t i = 0; i < 8; i++) {
+        CHECK(sink32.n[i] == 32 && sink32.t0[i] == 32 * i);
+    }
+    CHECK(pref25.calls == 4 && pref25.n[0] == 70);
+    CHECK(add50.calls == 5 && pref10.calls == 25);
+    CHECK(pref10.n[24] == 10 && pref10.t0[24] == 240 && pref10.first[24] == 243);
+
+    // 280..287 are in sink32's FIFO and 250..279 in add50's: both dropped at the gap
+    ramp(x, 100, 285);
+    dsp_graph_push(g, x, 100, 1, 285);
+    CHECK(sink32.calls == 11 && sink32.t0[8] == 285 && sink32.t0[10] == 349);
+    CHECK(add50.calls == 7 && add50.t0[5] == 285 && add50.t0[6] == 335);
+    CHECK(add.ok && sink32.ok && pref25.ok && add50.ok && pref10.ok);
+
+    // A push larger than max_frames is cut
+    static int16_t big[250];
+    ramp(big, 250, 385);
+    dsp_graph_push(g, big, 250, 1, 385);
+    CHECK(add.calls == 8 && add.n[5] == 100 && add.n[7] == 50 && add.t0[7] == 585);
+    CHECK(add.ok && sink32.ok && add50.ok && pref10.ok);
+
+    CHECK(dsp_graph_node_info(g, 4, &info[4]) == ESP_OK);
+    CHECK(info[4].calls == pref10.calls && info[4].frames == 10u * pref10.calls);
+    s_destroyed = 0;
+    dsp_graph_delete(g);
+    CHECK(s_destroyed == 5);
+}
+
+/* Siblings: only the last reader of a buffer may write over it */
+static void test_in_place_siblings(void)
+{
+    static probe_t head = { .add = 1, .ok = true }, a = { .add = 10, .ok = true, .expect = 1 },
+                   b = { .add = 100, .ok = true, .expect = 1 }, after_a = { .ok = true, .expect = 11 },
+                   after_b = { .ok = true, .expect = 101 };
+    const dsp_graph_config_t cfg = {
+        .source = MONO,
+        .max_frames = 64,
+        .num_nodes = 5,
+        .nodes = {
+            { &ADD_IN_PLACE, &head, DSP_GRAPH_SOURCE },
+            { &ADD_IN_PLACE, &a, 0 },
+            { &SINK_ANY, &after_a, 1 },
+            { &ADD_IN_PLACE, &b, 0 },
+            { &SINK_ANY, &after_b, 3 },
+        },
+    };
+    dsp_graph_t *g;
+    CHECK(dsp_graph_create(&cfg, &g) == ESP_OK);
+    dsp_graph_node_info_t ia, ib;
+    dsp_graph_node_info(g, 1, &ia);
+    dsp_graph_node_info(g, 3, &ib);
+    CHECK(!ia.in_place && ib.in_place);
+    static int16_t x[64];
+    for (uint64_t t = 0; t < 640; t += 64) {
+        ramp(x, 64, t);
+        dsp_graph_push(g, x, 64, 1, t);
+        CHECK(x[0] == (int16_t)t);     // the source untouched
+    }
+    CHECK(b.ok && after_a.ok && after_b.ok && after_b.calls == 10);
+    dsp_graph_delete(g);
+}
+
+static void test_bad_edges(void)
+{
+    static const dsp_graph_stage_t Q31_IN = {
+        .name = "q31", .in = { DSP_GRAPH_Q31, 2 }, .out = NONE, .process = probe_process, .destroy = probe_destroy,
+    };
+    static probe_t p[3];
+    dsp_graph_t *g;
+    const struct {
+        dsp_graph_format_t source;
+        dsp_graph_node_t nodes[2];
+    } bad[] = {
+        { MONO, { { &Q31_IN, &p[0], DSP_GRAPH_SOURCE }, { &SINK_ANY, &p[1], DSP_GRAPH_SOURCE } } },      // type
+        { { DSP_GRAPH_Q31, 1 }, { { &Q31_IN, &p[0], DSP_GRAPH_SOURCE }, { &SINK_ANY, &p[1], 0 } } },     // channels
+        { { DSP_GRAPH_S16, DSP_GRAPH_ANY_CHANNELS }, { { &SINK_ANY, &p[0], DSP_GRAPH_SOURCE },
+              { &SINK_ANY, &p[1], 0 } } },                                                                // 1 of any
+        { MONO, { { &SINK_ANY, &p[0], DSP_GRAPH_SOURCE }, { &SINK_ANY, &p[1], 0 } } },                   // from a sink
+        { MONO, { { &SINK_ANY, &p[0], 1 }, { &ADD_IN_PLACE, &p[1], DSP_GRAPH_SOURCE } } },              // forward
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        dsp_graph_config_t cfg = { .source = bad[i].source, .max_channels = 2, .max_frames = 16, .num_nodes = 2 };
+        memcpy(cfg.nodes, bad[i].nodes, sizeof(bad[i].nodes));
+        s_destroyed = 0;
+        CHECK(dsp_graph_create(&cfg, &g) == ESP_ERR_INVALID_ARG);
+        CHECK(s_destroyed == 2);
+    }
+}
+
+/* ---------- The stage library ---------- */
+
+#define FS      48000
+#define BLOCK   960     // 20 ms: whole seconds end on a block
+
+typedef struct {
+    size_t seconds;
+    level_summary_t last;
+} level_log_t;
+
+static void level_cb(level_meter_period_t period, const level_summary_t *s, void *ctx)
+{
+    level_log_t *log = ctx;
+    if (period == LEVEL_METER_SECOND) {
+        log->seconds++;
+        log->last = *s;
+    }
+}
+
+static void stereo(int32_t *x, size_t n, uint64_t t0)
+{
+    for (size_t i = 0; i < n; i++) {
+        const double t = (double)(t0 + i) / FS;
+        x[2 * i] = (int32_t)(0.25 * 2147483647.0 * sin(2.0 * M_PI * 440.0 * t));
+        x[2 * i + 1] = (int32_t)(0.5 * 2147483647.0 * sin(2.0 * M_PI * 1000.0 * t)) + (1 << 26);
+    }
+}
+
+/* "mono:1 hpf level" against the same modules wired by hand */
+static void test_stages_match_direct(void)
+{
+    static level_log_t via_graph, direct;
+    const dsp_graph_stages_config_t cfg = {
+        .sample_rate_hz = FS, .max_channels = 2, .max_frames = BLOCK,
+        .level_cb = level_cb, .level_ctx = &via_graph,
+    };
+    dsp_graph_t *g;
+    CHECK(dsp_graph_stages_build("mono:1 hpf:50:2 level", &cfg, &g) == ESP_OK);
+    dsp_graph_node_info_t info;
+    CHECK(dsp_graph_node_info(g, 1, &info) == ESP_OK && info.in_place);
+
+    biquad_config_t bq_cfg = { .num_sections = 3, .channels = 1, .max_frames = BLOCK };
+    CHECK(biquad_design_dc_block(2.0f, FS, &bq_cfg.sections[0]) == ESP_OK);
+    CHECK(biquad_design_highpass(50.0f, 0.7071f, FS, &bq_cfg.sections[1]) == ESP_OK);
+    bq_cfg.sections[2] = bq_cfg.sections[1];
+    biquad_t *bq;
+    level_meter_t *meter;
+    CHECK(biquad_create(&bq_cfg, &bq) == ESP_OK);
+    CHECK(level_meter_create(&(level_meter_config_t) { .sample_rate_hz = FS }, &meter) == ESP_OK);
+    CHECK(level_meter_subscribe(meter, level_cb, &direct) == ESP_OK);
+
+    static int32_t x[BLOCK * 2];
+    static int16_t mono[BLOCK];
+    for (uint64_t t = 0; t < 5 * FS; t += BLOCK) {
+        stereo(x, BLOCK, t);
+        dsp_graph_stream_cb(x, BLOCK, 2, t, g);
+        dsp_q31_to_s16(mono, x + 1, 2, BLOCK);
+        biquad_process(bq, mono, BLOCK);
+        level_meter_process(meter, mono, BLOCK, t);
+    }
+    CHECK(via_graph.seconds == 4 && direct.seconds == 4);
+    CHECK(memcmp(&via_graph.last, &direct.last, sizeof(level_summary_t)) == 0);
+    // The offset on channel 1 is gone; channel 1's 1 kHz at half scale is what's left
+    CHECK(fabs(via_graph.last.dc) < 1.0);
+    CHECK(fabs(via_graph.last.rms_dbfs - 20.0 * log10(0.5 / sqrt(2.0))) < 0.1);
+    biquad_delete(bq);
+    level_meter_delete(meter);
+    dsp_graph_delete(g);
+}
+
+/* decim divides the rate and the timeline; level@mono still runs at the full rate */
+static void test_decim(void)
+{
+    static level_log_t slow;
+    const dsp_graph_stages_config_t cfg = {
+        .sample_rate_hz = FS, .max_channels = 2, .max_frames = BLOCK,
+        .level_cb = level_cb, .level_ctx = &slow,
+    };
+    dsp_graph_t *g;
+    CHECK(dsp_graph_stages_build("mono decim:4 level", &cfg, &g) == ESP_OK);
+    CHECK(dsp_graph_set_sample_rate(g, FS) == ESP_OK);
+    dsp_graph_node_info_t info;
+    CHECK(dsp_graph_node_info(g, 1, &info) == ESP_OK && !info.in_place);
+
+    static int32_t x[BLOCK * 2];
+    for (uint64_t t = 0; t < 3 * FS; t += BLOCK) {
+        stereo(x, BLOCK, t);
+        dsp_graph_push(g, x, BLOCK, 2, t);
+    }
+    // Seconds of 12000 output samples, on the divided timeline
+    CHECK(slow.seconds == 2);
+    CHECK(slow.last.samples == FS / 4 && slow.last.t0 == FS / 4);
+    CHECK(fabs(slow.last.rms_dbfs - 20.0 * log10(0.25 / sqrt(2.0))) < 0.5);
+
+    // A gap that cuts a group: the group is lost, the next one starts on a multiple of 4
+    stereo(x, BLOCK, 3 * FS + 6);
+    dsp_graph_push(g, x, BLOCK, 2, 3 * FS + 6);
+    dsp_graph_node_info(g, 2, &info);
+    CHECK(info.frames == 3u * FS / 4 + (BLOCK - 2) / 4);
+    dsp_graph_delete(g);
+
+    // A sink doesn't become the next stage's input
+    CHECK(dsp_graph_stages_build("mono level@mono decim:2 level", &cfg, &g) == ESP_OK);
+    CHECK(dsp_graph_set_sample_rate(g, FS) == ESP_OK);
+    slow.seconds = 0;
+    for (uint64_t t = 0; t < 3 * FS; t += BLOCK) {
+        stereo(x, BLOCK, t);
+        dsp_graph_push(g, x, BLOCK, 2, t);
+    }
+    // Two full-rate seconds from the first meter, two half-rate ones from the second
+    CHECK(slow.seconds == 4);
+    dsp_graph_node_info(g, 2, &info);
+    CHECK(strcmp(info.name, "decim") == 0);
+    dsp_graph_node_info(g, 3, &info);
+    CHECK(info.frames == 3u * FS / 2);
+    dsp_graph_delete(g);
+}
+
+static void test_bad_specs(void)
+{
+    const dsp_graph_stages_config_t cfg = { .sample_rate_hz = FS, .max_channels = 2, .max_frames = BLOCK };
+    dsp_graph_t *g;
+    CHECK(dsp_graph_stages_build("mono bogus", &cfg, &g) == ESP_ERR_INVALID_ARG);
+    CHECK(dsp_graph_stages_build("mono level@hpf", &cfg, &g) == ESP_ERR_INVALID_ARG);
+    CHECK(dsp_graph_stages_build("mono decim:1", &cfg, &g) == ESP_ERR_INVALID_ARG);
+    CHECK(dsp_graph_stages_build("mono hpf:50:1:2:3", &cfg, &g) == ESP_ERR_INVALID_ARG);
+    // int16 stages can't take the Q31 source
+    CHECK(dsp_graph_stages_build("hpf", &cfg, &g) == ESP_ERR_INVALID_ARG);
+    CHECK(dsp_graph_stages_build("mono hpf stft:500", &cfg, &g) != ESP_OK);
+    CHECK(dsp_graph_stages_build("mono hpf stft:512:128 goertzel:480:-30:1000/3000 level", &cfg, &g) == ESP_OK);
+    dsp_graph_delete(g);
+}
+
+int main(void)
+{
+    test_negotiation();
+    test_in_place_siblings();
+    test_bad_edges();
+    test_stages_match_direct();
+    test_decim();
+    test_bad_specs();
+    return test_report("dsp_graph");
+}
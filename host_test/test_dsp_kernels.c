@@ -0,0 +1,234 @@
+// test_dsp_kernels.c  (SIMD backends must match the scalar reference bit for bit)
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "dsp_kernels.h"
+#include "test_util.h"
+
+#define MAX_N   1100
+#define TAPS    31
+
+static int16_t s_x[MAX_N + TAPS + 8];
+static int16_t s_y[MAX_N + 8];
+static float   s_f[MAX_N + 8];
+static int16_t s_ref[MAX_N + 8], s_opt[MAX_N + 8];
+static float   s_fref[MAX_N + 8], s_fopt[MAX_N + 8];
+static uint8_t s_pcm[4 * MAX_N + 8];
+static int32_t s_q31[2 * MAX_N + 8];
+static int32_t s_qref[MAX_N + 8], s_qopt[MAX_N + 8];
+
+static uint32_t s_seed = 1;
+
+static uint32_t rnd(void)
+{
+    s_seed = s_seed * 1664525u + 1013904223u;
+    return s_seed;
+}
+
+typedef enum { FILL_RANDOM, FILL_MIN, FILL_MAX, FILL_ALTERNATE, FILL_SMALL } fill_t;
+
+static void fill(fill_t mode)
+{
+    for (size_t i = 0; i < sizeof(s_x) / sizeof(s_x[0]); i++) {
+        switch (mode) {
+        case FILL_RANDOM:    s_x[i] = (int16_t)(rnd() >> 16); break;
+        case FILL_MIN:       s_x[i] = INT16_MIN; break;
+        case FILL_MAX:       s_x[i] = INT16_MAX; break;
+        case FILL_ALTERNATE: s_x[i] = (i & 1) ? INT16_MAX : INT16_MIN; break;
+        case FILL_SMALL:     s_x[i] = (int16_t)((int32_t)(rnd() >> 16) % 64 - 32); break;
+        }
+    }
+    for (size_t i = 0; i < sizeof(s_y) / sizeof(s_y[0]); i++) {
+        s_y[i] = mode == FILL_RANDOM ? (int16_t)(rnd() >> 16) : s_x[i];
+    }
+    for (size_t i = 0; i < sizeof(s_f) / sizeof(s_f[0]); i++) {
+        // Include out-of-range values and exact .5 ties
+        s_f[i] = (i % 7 == 0) ? (float)((int32_t)(rnd() % 65536) - 32768) / 32768.0f + 0.5f / 32768.0f
+                              : (float)(int32_t)rnd() / 2147483648.0f * 1.2f;
+    }
+    // PCM bytes and Q31 words follow the int16 pattern, low bits random
+    for (size_t i = 0; i < sizeof(s_pcm); i++) {
+        s_pcm[i] = (i & 1) ? (uint8_t)((uint16_t)s_x[(i / 2) % MAX_N] >> 8) : (uint8_t)rnd();
+    }
+    for (size_t i = 0; i < sizeof(s_q31) / sizeof(s_q31[0]); i++) {
+        s_q31[i] = (int32_t)(((uint32_t)(uint16_t)s_x[i % MAX_N] << 16) | (rnd() >> 16));
+    }
+}
+
+static void check_all(size_t n, size_t off)
+{
+    const int16_t *x = s_x + off;
+    const int16_t *y = s_y + off;
+    static const int16_t gains[] = { 0, 1, -1, 16384, 23170, 32767, -32768, -12345 };
+
+    for (size_t g = 0; g < sizeof(gains) / sizeof(gains[0]); g++) {
+        for (unsigned shift = 0; shift <= 15; shift += 5) {
+            dsp_s16_gain_ref(s_ref, x, gains[g], shift, n);
+            dsp_s16_gain(s_opt, x, gains[g], shift, n);
+            CHECK(memcmp(s_ref, s_opt, n * sizeof(int16_t)) == 0);
+        }
+    }
+
+    static const int16_t offsets[] = { 0, 1, -1, 32767, -32768, 777 };
+    for (size_t o = 0; o < sizeof(offsets) / sizeof(offsets[0]); o++) {
+        dsp_s16_offset_ref(s_ref, x, offsets[o], n);
+        dsp_s16_offset(s_opt, x, offsets[o], n);
+        CHECK(memcmp(s_ref, s_opt, n * sizeof(int16_t)) == 0);
+    }
+
+    CHECK(dsp_s16_dot_ref(x, y, n) == dsp_s16_dot(x, y, n));
+    CHECK(dsp_s16_dot_ref(x, x, n) == dsp_s16_dot(x, x, n));
+
+    dsp_s16_fir_ref(s_ref, x, y, TAPS, n);
+    dsp_s16_fir(s_opt, x, y, TAPS, n);
+    CHECK(memcmp(s_ref, s_opt, n * sizeof(int16_t)) == 0);
+
+    static const int16_t clips[] = { 1, 100, 30000, 32767 };
+    for (size_t c = 0; c < sizeof(clips) / sizeof(clips[0]); c++) {
+        dsp_s16_stats_t a, b;
+        dsp_s16_stats_ref(x, n, clips[c], &a);
+        dsp_s16_stats(x, n, clips[c], &b);
+        CHECK(a.sum == b.sum && a.sum_sq == b.sum_sq && a.min == b.min &&
+              a.max == b.max && a.clip_count == b.clip_count);
+    }
+
+    dsp_s16_to_f32_ref(s_fref, x, n);
+    dsp_s16_to_f32(s_fopt, x, n);
+    CHECK(memcmp(s_fref, s_fopt, n * sizeof(float)) == 0);
+
+    dsp_f32_to_s16_ref(s_ref, s_f + off, n);
+    dsp_f32_to_s16(s_opt, s_f + off, n);
+    CHECK(memcmp(s_ref, s_opt, n * sizeof(int16_t)) == 0);
+
+    for (size_t bytes = 2; bytes <= 4; bytes++) {
+        dsp_pcm_to_q31_ref(s_qref, s_pcm + off, bytes, n);
+        dsp_pcm_to_q31(s_qopt, s_pcm + off, bytes, n);
+        CHECK(memcmp(s_qref, s_qopt, n * sizeof(int32_t)) == 0);
+    }
+    for (size_t stride = 1; stride <= 2; stride++) {
+        dsp_q31_to_s16_ref(s_ref, s_q31 + off, stride, n);
+        dsp_q31_to_s16(s_opt, s_q31 + off, stride, n);
+        CHECK(memcmp(s_ref, s_opt, n * sizeof(int16_t)) == 0);
+    }
+}
+
+static void test_reference_semantics(void)
+{
+    // Pin down the reference itself so a backend can't "match" a broken one
+    int16_t x[4] = { INT16_MIN, INT16_MAX, -3, 3 };
+    int16_t y[4];
+    dsp_s16_gain_ref(y, x, INT16_MIN, 0, 4);
+    CHECK(y[0] == INT16_MAX && y[1] == -32767 && y[2] == 3 && y[3] == -3);
+    dsp_s16_gain_ref(y, x, 16384, 1, 4);   // x1.0
+    CHECK(memcmp(x, y, sizeof(x)) == 0);
+    dsp_s16_offset_ref(y, x, 10, 4);
+    CHECK(y[0] == -32758 && y[1] == INT16_MAX && y[2] == 7 && y[3] == 13);
+
+    int16_t mins[8] = { INT16_MIN, INT16_MIN, INT16_MIN, INT16_MIN, INT16_MIN, INT16_MIN, INT16_MIN, INT16_MIN };
+    CHECK(dsp_s16_dot(mins, mins, 8) == 8LL * 32768 * 32768);
+
+    float f[4] = { 1.0f, -1.5f, 0.5f / 32768.0f, 1.5f / 32768.0f };
+    dsp_f32_to_s16_ref(y, f, 4);
+    CHECK(y[0] == INT16_MAX && y[1] == INT16_MIN && y[2] == 0 && y[3] == 2);
+
+    dsp_s16_stats_t st;
+    dsp_s16_stats_ref(x, 4, INT16_MAX, &st);
+    CHECK(st.sum == -1 && st.min == INT16_MIN && st.max == INT16_MAX && st.clip_count == 2);
+    CHECK(st.sum_sq == 32768ull * 32768 + 32767ull * 32767 + 18);
+
+    // Full scale stays full scale at every subframe width
+    const uint8_t pcm16[] = { 0x00, 0x80, 0xFF, 0x7F };
+    const uint8_t pcm24[] = { 0x00, 0x00, 0x80, 0xFF, 0xFF, 0x7F, 0x56, 0x34, 0x12 };
+    const uint8_t pcm32[] = { 0x00, 0x00, 0x00, 0x80, 0x78, 0x56, 0x34, 0x12 };
+    int32_t q[3];
+    dsp_pcm_to_q31_ref(q, pcm16, 2, 2);
+    CHECK(q[0] == INT32_MIN && q[1] == 0x7FFF0000);
+    dsp_pcm_to_q31_ref(q, pcm24, 3, 3);
+    CHECK(q[0] == INT32_MIN && q[1] == 0x7FFFFF00 && q[2] == 0x12345600);
+    dsp_pcm_to_q31_ref(q, pcm32, 4, 2);
+    CHECK(q[0] == INT32_MIN && q[1] == 0x12345678);
+
+    // Rounds to nearest, ties up, saturating; stride picks one channel
+    const int32_t frames[] = { INT32_MIN, 0, INT32_MAX, 0, 0x00008000, 0, -0x00008000, 0, 0x00007FFF, 0 };
+    int16_t s16[5];
+    dsp_q31_to_s16_ref(s16, frames, 2, 5);
+    CHECK(s16[0] == INT16_MIN && s16[1] == INT16_MAX && s16[2] == 1 && s16[3] == 0 && s16[4] == 0);
+}
+
+/* Full-scale -32768 squared, 2^30 a product: long dot products and FIRs
+ * must not wrap a SIMD accumulator, at any alignment of the input */
+static void test_full_scale_accumulation(void)
+{
+    static int16_t mins[2048 + 8];
+    for (size_t i = 0; i < sizeof(mins) / sizeof(mins[0]); i++) {
+        mins[i] = INT16_MIN;
+    }
+    for (size_t off = 0; off < 8; off++) {
+        CHECK(dsp_s16_dot(mins + off, mins, 2048) == 2048LL << 30);
+        CHECK(dsp_s16_dot(mins + off, mins, 513) == 513LL << 30);
+    }
+    static const size_t taps[] = { 1, 8, 31, 128, 129 };
+    for (size_t t = 0; t < sizeof(taps) / sizeof(taps[0]); t++) {
+        for (size_t off = 0; off < 8; off++) {
+            dsp_s16_fir(s_opt, mins + off, mins, taps[t], 64);
+            size_t ok = 0;
+            for (size_t i = 0; i < 64; i++) {
+                ok += s_opt[i] == INT16_MAX;
+            }
+            CHECK(ok == 64);
+        }
+    }
+}
+
+/* Each channel of frames that end right before an unreadable page: a
+ * kernel that loads past its last sample faults */
+static void test_end_of_buffer(void)
+{
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t bytes = (2 * MAX_N * sizeof(int32_t) + page - 1) / page * page;
+    uint8_t *map = mmap(NULL, bytes + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    CHECK(map != MAP_FAILED);
+    if (map == MAP_FAILED) {
+        return;
+    }
+    CHECK(mprotect(map + bytes, page, PROT_NONE) == 0);
+    int32_t *end = (int32_t *)(map + bytes);
+    for (size_t i = 0; i < bytes / sizeof(int32_t); i++) {
+        ((int32_t *)map)[i] = (int32_t)rnd();
+    }
+    static const size_t lens[] = { 1, 7, 8, 9, 16, 17, 33, 768, MAX_N };
+    for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+        const size_t n = lens[l];
+        for (size_t stride = 1; stride <= 2; stride++) {
+            for (size_t ch = 0; ch < stride; ch++) {
+                const int32_t *src = end - stride * n + ch;
+                dsp_q31_to_s16_ref(s_ref, src, stride, n);
+                dsp_q31_to_s16(s_opt, src, stride, n);
+                CHECK(memcmp(s_ref, s_opt, n * sizeof(int16_t)) == 0);
+            }
+        }
+    }
+    munmap(map, bytes + page);
+}
+
+int main(void)
+{
+    printf("dsp_kernels backend: %s\n", dsp_kernels_backend());
+    test_reference_semantics();
+    test_end_of_buffer();
+    test_full_scale_accumulation();
+
+    static const size_t lens[] = { 0, 1, 7, 8, 9, 15, 16, 17, 31, 33, 96, 255, 768, MAX_N };
+    static const fill_t modes[] = { FILL_RANDOM, FILL_MIN, FILL_MAX, FILL_ALTERNATE, FILL_SMALL };
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        fill(modes[m]);
+        for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+            for (size_t off = 0; off < 3; off++) {
+                check_all(lens[l], off);
+            }
+        }
+    }
+    return test_report("dsp_kernels");
+}
@@ -0,0 +1,256 @@
+// test_faults.c  (uac_driver on a misbehaving bus: packet errors, short packets, late callbacks, failed submits and allocations)
+
+#include <string.h>
+#include "audio_stream.h"
+#include "class_driver.h"
+#include "metrics.h"
+#include "mock_uac.h"
+#include "test_util.h"
+#include "uac_driver.h"
+
+#define CLEAN_MS    50      // streaming before the faults start
+#define RUN_MS      2000
+#define PKT_FRAMES  6       // 48 kHz every 125 us microframe
+#define NUM_URBS    3       // uac_driver keeps this many queued
+
+/* What the frames subscriber saw */
+static struct {
+    unsigned bits;
+    bool have_first;
+    uint64_t p0;
+    uint32_t q0;
+    uint64_t next_t0;
+    uint64_t frames;
+    uint64_t gap_frames;
+    int mismatches;
+} s_seen;
+
+static void frames_cb(const int32_t *frames, size_t nframes, size_t channels, uint64_t t0, void *ctx)
+{
+    (void)ctx;
+    if (!s_seen.have_first) {
+        s_seen.have_first = true;
+        s_seen.p0 = t0;
+        s_seen.q0 = (uint32_t)frames[0];
+        s_seen.next_t0 = t0;
+    }
+    const unsigned shift = 32 - s_seen.bits;
+    for (size_t i = 0; i < nframes; i++) {
+        for (size_t c = 0; c < channels; c++) {
+            const uint32_t want = s_seen.q0 + (((uint32_t)(t0 + i - s_seen.p0) * MOCK_UAC_FRAME_STEP +
+                                                (uint32_t)c * MOCK_UAC_CHANNEL_STEP) << shift);
+            s_seen.mismatches += (uint32_t)frames[i * channels + c] != want;
+        }
+    }
+    CHECK(t0 >= s_seen.next_t0);
+    s_seen.gap_frames += t0 - s_seen.next_t0;
+    s_seen.next_t0 = t0 + nframes;
+    s_seen.frames += nframes;
+}
+
+static uint32_t resubmit_fails(void)
+{
+    metrics_id_t id;
+    metrics_value_t v;
+    CHECK(metrics_register(METRICS_COUNTER, "uac.resubmit_fail", &id) == ESP_OK);
+    CHECK(metrics_read(id, &v) == ESP_OK);
+    return v.count;
+}
+
+static void run_until_ms(uint64_t ms)
+{
+    while (mock_usb_now_ms() < ms) {
+        class_driver_handle_events(CLASS_DRIVER_POLL_MS);
+    }
+}
+
+static void shutdown(void)
+{
+    class_driver_client_deregister();
+    int passes = 0;
+    while (class_driver_handle_events(0) && passes < 10) {
+        passes++;
+    }
+    CHECK(passes < 10);
+    CHECK(class_driver_uninstall() == ESP_OK);
+}
+
+/* Stream from a high-speed stereo microphone, with `faults` on after
+ * CLEAN_MS; the driver's counters and the faults injected come back */
+static void stream(mock_uac_t *m, const mock_usb_faults_t *faults, uac_driver_stats_t *st,
+                   mock_usb_fault_counts_t *injected)
+{
+    mock_uac_init(m);
+    m->uac_version = 2;
+    m->speed = USB_SPEED_HIGH;
+    m->channels = 2;
+    m->subframe_size = 3;
+    m->bit_resolution = 24;
+    m->ep_mps = 64;
+    m->rates[0] = 48000;
+    m->rate_hz = 48000;
+
+    memset(&s_seen, 0, sizeof(s_seen));
+    s_seen.bits = m->bit_resolution;
+    mock_usb_host_reset();
+    CHECK(class_driver_install() == ESP_OK);
+    CHECK(mock_uac_connect(m, NULL) != 0);
+    run_until_ms(CLEAN_MS);
+    uac_driver_take_stats(st);
+    mock_usb_set_faults(faults);
+    run_until_ms(RUN_MS);
+    uac_driver_take_stats(st);
+    mock_usb_fault_counts(injected);
+    shutdown();
+}
+
+static void test_packet_errors(void)
+{
+    const mock_usb_faults_t faults = {
+        .seed = 1,
+        .packet_error = { .probability = 0.002f, .burst = 3 },
+    };
+    mock_uac_t m;
+    uac_driver_stats_t st;
+    mock_usb_fault_counts_t n;
+    stream(&m, &faults, &st, &n);
+
+    // Every failed packet is a packet of timeline left out, the rest in place
+    CHECK(n.packet_error > 10 && n.packet_error % 3 == 0 && n.short_packet == 0);
+    CHECK(s_seen.mismatches == 0 && st.lost == n.packet_error);
+    CHECK(s_seen.gap_frames == (uint64_t)n.packet_error * PKT_FRAMES);
+}
+
+static void test_short_packets(void)
+{
+    const mock_usb_faults_t faults = {
+        .seed = 2,
+        .short_packet = { .probability = 0.005f },
+    };
+    mock_uac_t m;
+    uac_driver_stats_t st;
+    mock_usb_fault_counts_t n;
+    stream(&m, &faults, &st, &n);
+
+    // The frames that made it stay where they were sampled; the cut ones
+    // are a gap. A packet cut to nothing counts as lost.
+    CHECK(n.short_packet > 10 && st.short_packets > 0 && st.short_packets + st.lost == n.short_packet);
+    CHECK(s_seen.mismatches == 0 && s_seen.gap_frames > 0);
+    CHECK(s_seen.gap_frames <= (uint64_t)n.short_packet * PKT_FRAMES);
+    CHECK(s_seen.gap_frames >= (uint64_t)n.short_packet * PKT_FRAMES / 2);
+}
+
+static void test_late_callbacks(void)
+{
+    // Later than a URB takes, but within the two queued behind it
+    const mock_usb_faults_t faults = {
+        .seed = 3,
+        .late = { .probability = 0.3f, .burst = 2 },
+        .late_max_us = 12000,
+    };
+    mock_uac_t m;
+    uac_driver_stats_t st;
+    mock_usb_fault_counts_t n;
+    stream(&m, &faults, &st, &n);
+
+    // The bus kept sampling: nothing lost, nothing out of place
+    CHECK(n.late > 10);
+    CHECK(s_seen.mismatches == 0 && s_seen.gap_frames == 0 && st.lost == 0 && st.short_packets == 0);
+    CHECK(m.frames_sent - s_seen.frames <= 3 * 16 * 48);
+}
+
+static void test_submit_failures(void)
+{
+    const mock_usb_faults_t faults = {
+        .seed = 4,
+        .submit_fail = { .probability = 0.05f },
+    };
+    const uint32_t fails_before = resubmit_fails();
+    mock_uac_t m;
+    uac_driver_stats_t st;
+    mock_usb_fault_counts_t n;
+    stream(&m, &faults, &st, &n);
+
+    // Each failed submit is counted and retried after the event pass; the
+    // other URBs in flight cover the retry, so nothing is lost
+    CHECK(n.submit_fail > NUM_URBS && resubmit_fails() - fails_before == n.submit_fail);
+    CHECK(st.recoveries > 0 && st.recoveries <= n.submit_fail);
+    CHECK(s_seen.mismatches == 0 && s_seen.gap_frames == 0 && st.lost == 0);
+    CHECK(m.frames_sent - s_seen.frames <= NUM_URBS * 16 * 48);
+}
+
+static void test_pool_runs_dry(void)
+{
+    // Long bursts: every URB comes back unsubmitted and the retries fail too
+    const mock_usb_faults_t faults = {
+        .seed = 6,
+        .submit_fail = { .probability = 0.02f, .burst = 12 },
+    };
+    mock_uac_t m;
+    uac_driver_stats_t st;
+    mock_usb_fault_counts_t n;
+    stream(&m, &faults, &st, &n);
+
+    // Re-armed and streaming again each time; the intervals nobody polled
+    // are a gap of whole packets, the samples after it where they belong
+    CHECK(n.submit_fail >= 12 && st.recoveries > 0);
+    CHECK(s_seen.mismatches == 0 && s_seen.gap_frames > 0 && s_seen.gap_frames % PKT_FRAMES == 0);
+    CHECK(m.frames_sent - s_seen.frames - s_seen.gap_frames <= NUM_URBS * 16 * 48);
+}
+
+static void test_urb_alloc_fails(void)
+{
+    mock_uac_t m;
+    mock_uac_init(&m);
+    memset(&s_seen, 0, sizeof(s_seen));
+    s_seen.bits = m.bit_resolution;
+    const int allocated = mock_usb_transfers_allocated();
+    mock_usb_host_reset();
+    const mock_usb_faults_t faults = { .iso_alloc_limit = NUM_URBS - 1 };
+    mock_usb_set_faults(&faults);
+    CHECK(class_driver_install() == ESP_OK);
+    CHECK(mock_uac_connect(&m, NULL) != 0);
+    run_until_ms(CLEAN_MS);
+
+    // The last URB wouldn't allocate: the stream doesn't start, and the
+    // ones before it are freed rather than left behind
+    CHECK(m.packets == 0 && s_seen.frames == 0);
+    shutdown();
+    CHECK(mock_usb_transfers_allocated() == allocated);
+}
+
+static void test_same_seed_same_faults(void)
+{
+    const mock_usb_faults_t faults = {
+        .seed = 5,
+        .packet_error = { .probability = 0.01f },
+        .short_packet = { .probability = 0.01f },
+    };
+    mock_uac_t m;
+    uac_driver_stats_t st;
+    mock_usb_fault_counts_t a, b;
+    stream(&m, &faults, &st, &a);
+    const uint64_t gap = s_seen.gap_frames;
+    stream(&m, &faults, &st, &b);
+    CHECK(memcmp(&a, &b, sizeof(a)) == 0 && s_seen.gap_frames == gap && s_seen.mismatches == 0);
+
+    // Cleared by a bus reset
+    stream(&m, NULL, &st, &a);
+    CHECK(a.packet_error == 0 && a.short_packet == 0 && s_seen.gap_frames == 0);
+}
+
+int main(void)
+{
+    const uac_driver_config_t cfg = { .sample_rate_hz = 48000 };
+    CHECK(uac_driver_register(&cfg) == ESP_OK);
+    CHECK(audio_stream_subscribe_frames(frames_cb, NULL) == ESP_OK);
+
+    test_packet_errors();
+    test_short_packets();
+    test_late_callbacks();
+    test_submit_failures();
+    test_pool_runs_dry();
+    test_urb_alloc_fails();
+    test_same_seed_same_faults();
+    return test_report("faults");
+}
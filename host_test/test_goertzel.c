@@ -0,0 +1,135 @@
+// test_goertzel.c  (band levels, threshold crossings and their timestamps)
+
+#include <math.h>
+#include <string.h>
+#include "goertzel.h"
+#include "test_util.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define FS      48000
+#define BLOCK   480
+
+typedef struct {
+    int blocks;
+    float level[64][4];
+    uint64_t t0[64];
+    uint32_t rising[64], falling[64];
+} capture_t;
+
+static void capture_cb(const goertzel_result_t *r, void *ctx)
+{
+    capture_t *c = ctx;
+    if (c->blocks >= 64) {
+        return;
+    }
+    for (size_t b = 0; b < r->num_bands && b < 4; b++) {
+        c->level[c->blocks][b] = r->level_dbfs[b];
+    }
+    c->t0[c->blocks] = r->t0;
+    c->rising[c->blocks] = r->rising_mask;
+    c->falling[c->blocks] = r->falling_mask;
+    c->blocks++;
+}
+
+static goertzel_t *make_bank(capture_t *cap, bool hann)
+{
+    goertzel_config_t cfg = { .sample_rate_hz = FS, .block_len = BLOCK, .hann = hann };
+    CHECK(goertzel_config_add_bands(&cfg, "1000, 5000,12000", -20.0f) == ESP_OK);
+    CHECK(cfg.num_bands == 3);
+    goertzel_t *g = NULL;
+    CHECK(goertzel_create(&cfg, &g) == ESP_OK);
+    memset(cap, 0, sizeof(*cap));
+    CHECK(goertzel_subscribe(g, capture_cb, cap) == ESP_OK);
+    return g;
+}
+
+static void test_levels(void)
+{
+    // Full-scale 5 kHz tone: ~0 dBFS in band 1, far down elsewhere
+    static int16_t x[BLOCK * 4];
+    for (size_t i = 0; i < sizeof(x) / sizeof(x[0]); i++) {
+        x[i] = (int16_t)(32767.0 * sin(2.0 * M_PI * 5000.0 * (double)i / FS));
+    }
+    for (int hann = 0; hann <= 1; hann++) {
+        capture_t cap;
+        goertzel_t *g = make_bank(&cap, hann);
+        goertzel_process(g, x, sizeof(x) / sizeof(x[0]), 0);
+        CHECK(cap.blocks == 4);
+        for (int b = 0; b < cap.blocks; b++) {
+            CHECK(fabsf(cap.level[b][1]) < 0.1f);
+            CHECK(cap.level[b][0] < -40.0f);
+            CHECK(cap.level[b][2] < -40.0f);
+        }
+        goertzel_delete(g);
+    }
+}
+
+static void test_crossings(void)
+{
+    // Silence, 1 kHz tone from sample 3 * BLOCK to 6 * BLOCK, silence again
+    static int16_t x[BLOCK * 10];
+    memset(x, 0, sizeof(x));
+    for (size_t i = 3 * BLOCK; i < 6 * BLOCK; i++) {
+        x[i] = (int16_t)(8000.0 * sin(2.0 * M_PI * 1000.0 * (double)i / FS));
+    }
+    capture_t cap;
+    goertzel_t *g = make_bank(&cap, true);
+    // Odd block sizes so blocks straddle calls
+    const uint64_t base = 123456;
+    for (size_t i = 0; i < sizeof(x) / sizeof(x[0]); i += 97) {
+        const size_t n = sizeof(x) / sizeof(x[0]) - i < 97 ? sizeof(x) / sizeof(x[0]) - i : 97;
+        goertzel_process(g, x + i, n, base + i);
+    }
+    CHECK(cap.blocks == 10);
+    for (int b = 0; b < cap.blocks; b++) {
+        CHECK(cap.t0[b] == base + (uint64_t)b * BLOCK);
+        CHECK(cap.rising[b] == (b == 3 ? 1u : 0u));
+        CHECK(cap.falling[b] == (b == 6 ? 1u : 0u));
+    }
+    goertzel_delete(g);
+}
+
+static void test_gap_and_config(void)
+{
+    capture_t cap;
+    goertzel_t *g = make_bank(&cap, false);
+    static int16_t x[BLOCK];
+    goertzel_process(g, x, BLOCK / 2, 0);
+    goertzel_process(g, x, BLOCK, 1000);    // gap: partial block dropped
+    CHECK(cap.blocks == 1 && cap.t0[0] == 1000);
+    goertzel_delete(g);
+
+    goertzel_config_t cfg = { .sample_rate_hz = FS, .block_len = BLOCK };
+    CHECK(goertzel_create(&cfg, &g) == ESP_ERR_INVALID_ARG);            // no bands
+    CHECK(goertzel_config_add_bands(&cfg, "30000", -10.0f) == ESP_OK);
+    CHECK(goertzel_create(&cfg, &g) == ESP_ERR_INVALID_ARG);            // above Nyquist
+    CHECK(goertzel_config_add_bands(&cfg, "abc", -10.0f) == ESP_ERR_INVALID_ARG);
+}
+
+/* A rate switch mid-block: blocks are timed from the first sample at the new rate */
+static void test_rate_switch(void)
+{
+    capture_t cap;
+    goertzel_t *g = make_bank(&cap, false);
+    static int16_t x[BLOCK * 2];
+    goertzel_process(g, x, BLOCK + 100, 5000);
+    CHECK(goertzel_set_sample_rate(g, 32000) == ESP_OK);
+    goertzel_process(g, x, BLOCK * 2, 5000 + BLOCK + 100);
+    CHECK(cap.blocks == 3);
+    CHECK(cap.t0[0] == 5000);
+    CHECK(cap.t0[1] == 5000 + BLOCK + 100 && cap.t0[2] == 5000 + 2 * BLOCK + 100);
+    CHECK(goertzel_set_sample_rate(g, 16000) == ESP_ERR_INVALID_ARG);   // 12 kHz band at Nyquist
+    goertzel_delete(g);
+}
+
+int main(void)
+{
+    test_levels();
+    test_crossings();
+    test_gap_and_config();
+    test_rate_switch();
+    return test_report("goertzel");
+}
@@ -0,0 +1,192 @@
+// test_level_meter.c  (block/second/minute summaries, gaps, concurrent readers)
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "dsp_kernels.h"
+#include "level_meter.h"
+#include "test_util.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define FS      48000
+#define CHUNK   768
+
+static int s_seconds_seen, s_minutes_seen;
+
+static void count_cb(level_meter_period_t period, const level_summary_t *s, void *ctx)
+{
+    (void)s;
+    (void)ctx;
+    if (period == LEVEL_METER_SECOND) {
+        s_seconds_seen++;
+    } else if (period == LEVEL_METER_MINUTE) {
+        s_minutes_seen++;
+    }
+}
+
+static void test_summaries(void)
+{
+    const level_meter_config_t cfg = { .sample_rate_hz = FS, .clip_level = 16000 };
+    level_meter_t *m;
+    CHECK(level_meter_create(&cfg, &m) == ESP_OK);
+    CHECK(level_meter_subscribe(m, count_cb, NULL) == ESP_OK);
+
+    level_summary_t s;
+    CHECK(level_meter_get(m, LEVEL_METER_SECOND, 0, &s) == ESP_ERR_NOT_FOUND);
+
+    // 1 kHz at half scale plus a DC offset of 100, for 150 s
+    static int16_t x[CHUNK];
+    for (uint64_t t = 0; t < 150ull * FS; t += CHUNK) {
+        for (size_t i = 0; i < CHUNK; i++) {
+            x[i] = (int16_t)(100.0 + 16384.0 * sin(2.0 * M_PI * 1000.0 * (double)(t + i) / FS));
+        }
+        level_meter_process(m, x, CHUNK, t);
+    }
+    CHECK(s_seconds_seen == 149);
+    CHECK(s_minutes_seen == 2);
+
+    CHECK(level_meter_get(m, LEVEL_METER_BLOCK, 0, &s) == ESP_OK);
+    CHECK(s.samples == CHUNK && s.t0 == 150ull * FS - CHUNK);
+
+    CHECK(level_meter_get(m, LEVEL_METER_SECOND, 0, &s) == ESP_OK);
+    CHECK(s.t0 == 148ull * FS && s.samples == FS);
+    CHECK(fabs(s.rms_dbfs - (20.0 * log10(0.5 / sqrt(2.0)))) < 0.05);
+    CHECK(fabs(s.peak_dbfs - (20.0 * log10(16484.0 / 32768.0))) < 0.05);
+    CHECK(fabs(s.dc - 100.0) < 0.5);
+    CHECK(s.clip_count > 0 && s.max == 16484);
+
+    CHECK(level_meter_get(m, LEVEL_METER_MINUTE, 1, &s) == ESP_OK);
+    CHECK(s.t0 == 0 && s.samples == 60u * FS);
+    CHECK(level_meter_get(m, LEVEL_METER_MINUTE, 0, &s) == ESP_OK);
+    CHECK(s.t0 == 60ull * FS);
+    CHECK(level_meter_get(m, LEVEL_METER_MINUTE, 2, &s) == ESP_ERR_NOT_FOUND);
+    CHECK(level_meter_get(m, LEVEL_METER_BLOCK, 1, &s) == ESP_ERR_INVALID_ARG);
+    level_meter_delete(m);
+}
+
+static void test_exact_merge_and_gaps(void)
+{
+    const level_meter_config_t cfg = { .sample_rate_hz = FS };
+    level_meter_t *m;
+    CHECK(level_meter_create(&cfg, &m) == ESP_OK);
+
+    // Blocks of odd length straddle second boundaries; totals must equal a
+    // single pass over the whole second
+    static int16_t x[2 * FS];
+    uint32_t seed = 9;
+    for (size_t i = 0; i < 2 * FS; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        x[i] = (int16_t)(seed >> 16);
+    }
+    for (size_t t = 0; t < 2 * FS; t += 1000) {
+        const size_t n = 2 * FS - t < 1000 ? 2 * FS - t : 1000;
+        level_meter_process(m, x + t, n, t);
+    }
+    // Lost packets: 48 samples missing, then three silent seconds skipped
+    level_meter_process(m, x, 100, 2 * FS + 48);
+    level_meter_process(m, x, 100, 6 * FS);
+
+    level_summary_t s;
+    dsp_s16_stats_t st;
+    dsp_s16_stats_ref(x + FS, FS, DSP_S16_CLIP_LEVEL_DEFAULT, &st);
+    CHECK(level_meter_get(m, LEVEL_METER_SECOND, 4, &s) == ESP_OK);
+    CHECK(s.t0 == FS && s.samples == FS);
+    CHECK(s.min == st.min && s.max == st.max && s.clip_count == st.clip_count);
+    CHECK(s.dc == (float)((double)st.sum / FS));
+    CHECK(fabs(s.rms_dbfs - 20.0 * log10(sqrt((double)st.sum_sq / FS) / 32768.0)) < 1e-3);
+
+    CHECK(level_meter_get(m, LEVEL_METER_SECOND, 3, &s) == ESP_OK);
+    CHECK(s.t0 == 2ull * FS && s.samples == 100);
+    for (size_t ago = 0; ago < 3; ago++) {
+        CHECK(level_meter_get(m, LEVEL_METER_SECOND, ago, &s) == ESP_OK);
+        CHECK(s.samples == 0 && s.t0 == (5 - ago) * (uint64_t)FS);
+    }
+    level_meter_delete(m);
+}
+
+static void test_rate_change(void)
+{
+    const level_meter_config_t cfg = { .sample_rate_hz = FS };
+    level_meter_t *m;
+    CHECK(level_meter_create(&cfg, &m) == ESP_OK);
+    static int16_t x[FS];
+    for (size_t i = 0; i < FS; i++) {
+        x[i] = 1000;
+    }
+    // 1.5 s at 48 kHz, then 2 s at 8 kHz with a one-sample gap at the switch
+    level_meter_process(m, x, FS, 0);
+    level_meter_process(m, x, FS / 2, FS);
+    CHECK(level_meter_set_sample_rate(m, 8000) == ESP_OK);
+    level_meter_process(m, x, 16000, FS + FS / 2 + 1);
+    level_meter_process(m, x, 1, FS + FS / 2 + 1 + 16000);
+
+    level_summary_t s;
+    CHECK(level_meter_get(m, LEVEL_METER_SECOND, 2, &s) == ESP_OK);
+    CHECK(s.t0 == FS && s.samples == FS / 2);
+    CHECK(level_meter_get(m, LEVEL_METER_SECOND, 1, &s) == ESP_OK);
+    CHECK(s.t0 == FS + FS / 2 + 1 && s.samples == 8000);
+    CHECK(level_meter_get(m, LEVEL_METER_SECOND, 0, &s) == ESP_OK);
+    CHECK(s.t0 == FS + FS / 2 + 1 + 8000 && s.samples == 8000);
+    CHECK(level_meter_get(m, LEVEL_METER_BLOCK, 0, &s) == ESP_OK && s.samples == 1);
+    level_meter_delete(m);
+}
+
+/* Every second holds a constant equal to its index, so a torn read shows up
+ * as a summary whose fields disagree with each other. */
+static level_meter_t *s_shared;
+static atomic_bool s_done;
+
+static void *reader(void *arg)
+{
+    int *torn = arg;
+    while (!atomic_load(&s_done)) {
+        level_summary_t s;
+        const esp_err_t err = level_meter_get(s_shared, LEVEL_METER_SECOND, 0, &s);
+        if (err == ESP_OK) {
+            const int16_t v = (int16_t)(s.t0 / FS);
+            *torn += s.min != v || s.max != v || s.dc != (float)v || s.samples != FS;
+        } else {
+            // Not there yet, or the writer kept it busy: never anything else
+            *torn += err != ESP_ERR_NOT_FOUND && err != ESP_ERR_TIMEOUT;
+        }
+    }
+    return NULL;
+}
+
+static void test_concurrent_reader(void)
+{
+    const level_meter_config_t cfg = { .sample_rate_hz = FS };
+    CHECK(level_meter_create(&cfg, &s_shared) == ESP_OK);
+    int torn = 0;
+    pthread_t th;
+    atomic_store(&s_done, false);
+    CHECK(pthread_create(&th, NULL, reader, &torn) == 0);
+
+    static int16_t x[FS / 100];
+    for (uint64_t sec = 0; sec < 2000; sec++) {
+        for (size_t i = 0; i < FS / 100; i++) {
+            x[i] = (int16_t)sec;
+        }
+        for (uint64_t t = 0; t < FS; t += FS / 100) {
+            level_meter_process(s_shared, x, FS / 100, sec * FS + t);
+        }
+    }
+    atomic_store(&s_done, true);
+    pthread_join(th, NULL);
+    CHECK(torn == 0);
+    level_meter_delete(s_shared);
+}
+
+int main(void)
+{
+    test_summaries();
+    test_exact_merge_and_gaps();
+    test_rate_change();
+    test_concurrent_reader();
+    return test_report("level_meter");
+}
@@ -0,0 +1,139 @@
+// test_metrics.c  (per-core metrics: concurrent updates, aggregation, export frames through the decoder)
+
+#include <pthread.h>
+#include <string.h>
+#include "metrics.h"
+#include "metrics_decode.h"
+#include "test_util.h"
+
+#define THREADS     4
+#define ADDS        200000
+
+static metrics_id_t s_count, s_level, s_lat;
+
+static void *hammer(void *arg)
+{
+    const uint32_t k = (uint32_t)(uintptr_t)arg;
+    for (uint32_t i = 0; i < ADDS; i++) {
+        metrics_add(s_count, 1);
+        metrics_observe(s_lat, i & 0xFF);
+    }
+    metrics_set(s_level, (int32_t)-k);
+    return NULL;
+}
+
+static void test_register(void)
+{
+    CHECK(metrics_register(METRICS_COUNTER, "test.count", &s_count) == ESP_OK);
+    CHECK(metrics_register(METRICS_GAUGE, "test.level", &s_level) == ESP_OK);
+    CHECK(metrics_register(METRICS_HISTOGRAM, "test.latency_us", &s_lat) == ESP_OK);
+    CHECK(s_count == 0 && s_level == 1 && s_lat == 2 && metrics_count() == 3);
+
+    // Same name: same id, unless the kind differs
+    metrics_id_t id;
+    CHECK(metrics_register(METRICS_COUNTER, "test.count", &id) == ESP_OK && id == s_count);
+    CHECK(metrics_register(METRICS_GAUGE, "test.count", &id) == ESP_ERR_INVALID_STATE);
+    CHECK(metrics_register(METRICS_COUNTER, "a.name.longer.than.the.limit", &id) == ESP_ERR_INVALID_ARG);
+    CHECK(metrics_count() == 3);
+
+    CHECK(metrics_hist_bucket(0) == 0 && metrics_hist_bucket(1) == 1 && metrics_hist_bucket(2) == 2 &&
+          metrics_hist_bucket(3) == 2 && metrics_hist_bucket(255) == 8 && metrics_hist_bucket(256) == 9);
+    CHECK(metrics_hist_bucket(UINT32_MAX) == METRICS_HIST_BUCKETS - 1);
+}
+
+static void test_concurrent(void)
+{
+    pthread_t t[THREADS];
+    for (uintptr_t i = 0; i < THREADS; i++) {
+        CHECK(pthread_create(&t[i], NULL, hammer, (void *)(i + 1)) == 0);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(t[i], NULL);
+    }
+    // Nothing lost whichever cores the threads ran on
+    metrics_value_t v;
+    CHECK(metrics_read(s_count, &v) == ESP_OK && v.kind == METRICS_COUNTER && v.count == THREADS * ADDS);
+    CHECK(metrics_read(s_lat, &v) == ESP_OK && strcmp(v.name, "test.latency_us") == 0);
+    uint32_t total = 0;
+    for (int b = 0; b < METRICS_HIST_BUCKETS; b++) {
+        total += v.buckets[b];
+    }
+    CHECK(total == THREADS * ADDS);
+    // i & 0xFF: one zero and 128 values of 128..255 in every 256
+    CHECK(v.buckets[0] == THREADS * ((ADDS + 255) / 256));
+    CHECK(v.buckets[8] >= THREADS * (ADDS / 256) * 128);
+    CHECK(metrics_read(s_level, &v) == ESP_OK && v.value < 0 && v.value >= -THREADS);
+    CHECK(metrics_read(200, &v) == ESP_ERR_INVALID_ARG);
+}
+
+typedef struct {
+    int frames;
+    metrics_frame_t last;
+} seen_t;
+
+static void frame_cb(const metrics_frame_t *f, void *ctx)
+{
+    seen_t *s = ctx;
+    s->frames++;
+    s->last = *f;
+}
+
+static void test_export(void)
+{
+    metrics_set(s_level, -123456);
+    uint8_t schema[METRICS_FRAME_MAX], values[METRICS_FRAME_MAX];
+    size_t schema_len, values_len;
+    CHECK(metrics_encode(METRICS_FRAME_SCHEMA, 7, 1000, schema, sizeof(schema), &schema_len) == ESP_OK);
+    CHECK(metrics_encode(METRICS_FRAME_VALUES, 7, 1000, values, sizeof(values), &values_len) == ESP_OK);
+    CHECK(schema[0] == METRICS_SYNC0 && schema[1] == METRICS_SYNC1 && schema[3] == 3);
+    // Varints: a 3-byte counter, a 3-byte gauge and 16 buckets
+    CHECK(values_len < METRICS_HEADER_LEN + 2 + 3 + 3 + 16 * 5);
+    uint8_t small[METRICS_HEADER_LEN + 2];
+    size_t len;
+    CHECK(metrics_encode(METRICS_FRAME_VALUES, 7, 1000, small, sizeof(small), &len) == ESP_ERR_INVALID_SIZE);
+
+    // Console text around the frames, values before any schema, a damaged copy
+    static metrics_decoder_t dec;
+    metrics_decoder_init(&dec);
+    seen_t seen = {0};
+    const char *text = "I (1234) UAC: stream at 48000 Hz\n\xA5 stray sync\n";
+    metrics_decoder_feed(&dec, values, values_len, frame_cb, &seen);
+    metrics_decoder_feed(&dec, (const uint8_t *)text, strlen(text), frame_cb, &seen);
+    metrics_decoder_feed(&dec, schema, schema_len, frame_cb, &seen);
+    uint8_t bad[METRICS_FRAME_MAX];
+    memcpy(bad, values, values_len);
+    bad[METRICS_HEADER_LEN] ^= 0x01;
+    metrics_decoder_feed(&dec, bad, values_len, frame_cb, &seen);
+    CHECK(seen.frames == 0 && dec.unknown_frames == 1 && dec.bad_frames >= 1);
+
+    // A byte at a time decodes the same as in one piece
+    for (size_t i = 0; i < values_len; i++) {
+        metrics_decoder_feed(&dec, values + i, 1, frame_cb, &seen);
+    }
+    CHECK(seen.frames == 1 && seen.last.seq == 7 && seen.last.t_us == 1000 && seen.last.count == 3);
+    const metrics_value_t *v = seen.last.values;
+    CHECK(strcmp(v[0].name, "test.count") == 0 && v[0].kind == METRICS_COUNTER && v[0].count == THREADS * ADDS);
+    CHECK(strcmp(v[1].name, "test.level") == 0 && v[1].value == -123456);
+    metrics_value_t lat;
+    metrics_read(s_lat, &lat);
+    CHECK(v[2].kind == METRICS_HISTOGRAM && memcmp(v[2].buckets, lat.buckets, sizeof(lat.buckets)) == 0);
+
+    // A new metric changes the count: old schema no longer applies
+    metrics_id_t extra;
+    CHECK(metrics_register(METRICS_COUNTER, "test.extra", &extra) == ESP_OK);
+    CHECK(metrics_encode(METRICS_FRAME_VALUES, 8, 2000, values, sizeof(values), &values_len) == ESP_OK);
+    metrics_decoder_feed(&dec, values, values_len, frame_cb, &seen);
+    CHECK(seen.frames == 1 && dec.unknown_frames == 2);
+    CHECK(metrics_encode(METRICS_FRAME_SCHEMA, 9, 3000, schema, sizeof(schema), &schema_len) == ESP_OK);
+    metrics_decoder_feed(&dec, schema, schema_len, frame_cb, &seen);
+    metrics_decoder_feed(&dec, values, values_len, frame_cb, &seen);
+    CHECK(seen.frames == 2 && seen.last.count == 4 && strcmp(seen.last.values[3].name, "test.extra") == 0);
+}
+
+int main(void)
+{
+    test_register();
+    test_concurrent();
+    test_export();
+    return test_report("metrics");
+}
@@ -0,0 +1,178 @@
+// test_stft.c  (radix-4 FFT against a naive DFT, STFT framing and timestamps)
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fft.h"
+#include "stft.h"
+#include "test_util.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static uint32_t s_seed = 7;
+
+static float frand(void)
+{
+    s_seed = s_seed * 1664525u + 1013904223u;
+    return (float)(int32_t)s_seed / 2147483648.0f;
+}
+
+static double max_err_vs_dft(const fft_cf32_t *got, const double *re, const double *im, size_t nbins, size_t n)
+{
+    double err = 0.0;
+    for (size_t k = 0; k < nbins; k++) {
+        double dr = 0.0, di = 0.0;
+        for (size_t t = 0; t < n; t++) {
+            const double ang = -2.0 * M_PI * (double)((k * t) % n) / (double)n;
+            dr += re[t] * cos(ang) - im[t] * sin(ang);
+            di += re[t] * sin(ang) + im[t] * cos(ang);
+        }
+        const double e = hypot(got[k].re - dr, got[k].im - di);
+        err = e > err ? e : err;
+    }
+    return err;
+}
+
+static void test_fft_complex(void)
+{
+    for (size_t n = 2; n <= 1024; n *= 2) {
+        fft_plan_t *plan;
+        CHECK(fft_plan_create(n, &plan) == ESP_OK);
+        fft_cf32_t *d = malloc(n * sizeof(*d));
+        double *re = malloc(n * sizeof(double)), *im = malloc(n * sizeof(double));
+        for (size_t i = 0; i < n; i++) {
+            d[i].re = frand();
+            d[i].im = frand();
+            re[i] = d[i].re;
+            im[i] = d[i].im;
+        }
+        fft_cf32(plan, d);
+        // Unit-variance input: error should scale ~ sqrt(n) * eps * log(n)
+        CHECK(max_err_vs_dft(d, re, im, n, n) < 1e-5 * n);
+        free(d);
+        free(re);
+        free(im);
+        fft_plan_delete(plan);
+    }
+    fft_plan_t *plan;
+    CHECK(fft_plan_create(12, &plan) == ESP_ERR_INVALID_ARG);
+    CHECK(fft_plan_create(1, &plan) == ESP_ERR_INVALID_ARG);
+}
+
+static void test_fft_real(void)
+{
+    for (size_t n = 4; n <= 2048; n *= 2) {
+        fft_real_plan_t *plan;
+        CHECK(fft_real_plan_create(n, &plan) == ESP_OK);
+        float *work = malloc(n * sizeof(float));
+        fft_cf32_t *out = malloc((n / 2 + 1) * sizeof(*out));
+        double *re = malloc(n * sizeof(double)), *im = calloc(n, sizeof(double));
+        for (size_t i = 0; i < n; i++) {
+            work[i] = frand();
+            re[i] = work[i];
+        }
+        fft_real_f32(plan, work, out);
+        CHECK(max_err_vs_dft(out, re, im, n / 2 + 1, n) < 1e-5 * n);
+        free(work);
+        free(out);
+        free(re);
+        free(im);
+        fft_real_plan_delete(plan);
+    }
+}
+
+typedef struct {
+    int frames;
+    uint64_t t0[64];
+    uint32_t peak_bin[64];
+    float power_sum[64];
+} capture_t;
+
+static void capture_cb(const stft_frame_t *f, void *ctx)
+{
+    capture_t *c = ctx;
+    if (c->frames >= 64) {
+        return;
+    }
+    uint32_t pk = 0;
+    float sum = 0.0f;
+    for (size_t k = 0; k < f->nbins; k++) {
+        sum += f->power[k];
+        if (f->power[k] > f->power[pk]) {
+            pk = (uint32_t)k;
+        }
+    }
+    c->t0[c->frames] = f->t0;
+    c->peak_bin[c->frames] = pk;
+    c->power_sum[c->frames] = sum;
+    c->frames++;
+}
+
+static void run_stft(const int16_t *x, size_t total, size_t block, capture_t *cap)
+{
+    const stft_config_t cfg = { .fft_size = 256, .hop = 64, .window = STFT_WINDOW_HANN };
+    stft_t *s;
+    memset(cap, 0, sizeof(*cap));
+    CHECK(stft_create(&cfg, &s) == ESP_OK);
+    CHECK(stft_subscribe(s, capture_cb, cap) == ESP_OK);
+    for (size_t i = 0; i < total; i += block) {
+        const size_t n = total - i < block ? total - i : block;
+        stft_process(s, x + i, n, 1000 + i);
+    }
+    stft_delete(s);
+}
+
+static void test_stft_framing(void)
+{
+    // Bin-centred sine at bin 20 of a 256-point FFT
+    static int16_t x[1000];
+    for (size_t i = 0; i < 1000; i++) {
+        x[i] = (int16_t)(16000.0 * sin(2.0 * M_PI * 20.0 * (double)i / 256.0));
+    }
+
+    capture_t a, b, c;
+    run_stft(x, 1000, 1000, &a);
+    run_stft(x, 1000, 1, &b);
+    run_stft(x, 1000, 77, &c);
+
+    // Frames end at 256, 320, ..., 960: 12 frames
+    CHECK(a.frames == 12);
+    for (int f = 0; f < a.frames; f++) {
+        CHECK(a.t0[f] == 1000 + 64 * (uint64_t)f);
+        CHECK(a.peak_bin[f] == 20);
+    }
+    // Block size must not change anything
+    CHECK(b.frames == a.frames && c.frames == a.frames);
+    CHECK(memcmp(a.t0, b.t0, sizeof(a.t0)) == 0 && memcmp(a.t0, c.t0, sizeof(a.t0)) == 0);
+    CHECK(memcmp(a.power_sum, b.power_sum, sizeof(a.power_sum)) == 0);
+    CHECK(memcmp(a.power_sum, c.power_sum, sizeof(a.power_sum)) == 0);
+}
+
+static void test_stft_gap_restarts_window(void)
+{
+    const stft_config_t cfg = { .fft_size = 64, .hop = 32, .window = STFT_WINDOW_RECT };
+    static int16_t x[200];
+    capture_t cap = {0};
+    stft_t *s;
+    CHECK(stft_create(&cfg, &s) == ESP_OK);
+    CHECK(stft_subscribe(s, capture_cb, &cap) == ESP_OK);
+    stft_process(s, x, 100, 0);         // frames at t0 = 0, 32
+    stft_process(s, x, 100, 150);       // gap of 50: next frame covers [150, 214) -> t0 = 150, 182
+    CHECK(cap.frames == 4);
+    CHECK(cap.t0[0] == 0 && cap.t0[1] == 32 && cap.t0[2] == 150 && cap.t0[3] == 182);
+    stft_delete(s);
+
+    const stft_config_t bad = { .fft_size = 100, .hop = 10, .window = STFT_WINDOW_HANN };
+    CHECK(stft_create(&bad, &s) == ESP_ERR_INVALID_ARG);
+}
+
+int main(void)
+{
+    test_fft_complex();
+    test_fft_real();
+    test_stft_framing();
+    test_stft_gap_restarts_window();
+    return test_report("stft");
+}
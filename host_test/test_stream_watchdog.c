@@ -0,0 +1,363 @@
+// test_stream_watchdog.c  (stall detection, the recovery ladder, and uac_driver recovering a wedged device)
+
+#include <string.h>
+#include "audio_stream.h"
+#include "class_driver.h"
+#include "metrics.h"
+#include "mock_uac.h"
+#include "stream_watchdog.h"
+#include "test_util.h"
+#include "uac_driver.h"
+
+#define STALL_MS    200
+#define STAGE_MS    300
+#define CHECK_MS    50
+
+static const stream_watchdog_stage_t NO_STAGE = STREAM_WATCHDOG_STAGES;
+
+/* What the recover callback was asked, in order */
+static struct {
+    stream_watchdog_stage_t stages[16];
+    int64_t at_us[16];
+    int n;
+} s_calls;
+
+static int64_t s_now_us;
+
+static uint32_t metric(const char *name)
+{
+    metrics_id_t id;
+    metrics_value_t v;
+    CHECK(metrics_register(METRICS_COUNTER, name, &id) == ESP_OK);
+    CHECK(metrics_read(id, &v) == ESP_OK);
+    return v.count;
+}
+
+static uint32_t recover_ms_observed(void)
+{
+    metrics_id_t id;
+    metrics_value_t v;
+    CHECK(metrics_register(METRICS_HISTOGRAM, "wd.recover_ms", &id) == ESP_OK);
+    CHECK(metrics_read(id, &v) == ESP_OK);
+    uint32_t n = 0;
+    for (int b = 0; b < METRICS_HIST_BUCKETS; b++) {
+        n += v.buckets[b];
+    }
+    return n;
+}
+
+static void record(stream_watchdog_stage_t stage, void *ctx)
+{
+    (void)ctx;
+    if (s_calls.n < 16) {
+        s_calls.stages[s_calls.n] = stage;
+        s_calls.at_us[s_calls.n] = s_now_us;
+    }
+    s_calls.n++;
+}
+
+static stream_watchdog_t *create(stream_watchdog_recover_t recover)
+{
+    const stream_watchdog_config_t cfg = {
+        .stall_ms = STALL_MS,
+        .stage_ms = { STAGE_MS, STAGE_MS, 2 * STAGE_MS, 4 * STAGE_MS },
+        .recover = recover,
+    };
+    stream_watchdog_t *wd = NULL;
+    CHECK(stream_watchdog_create(&cfg, &wd) == ESP_OK && wd != NULL);
+    return wd;
+}
+
+/* Check every CHECK_MS for `ms`; frames grow by `step` per check */
+static void run(stream_watchdog_t *wd, stream_watchdog_sample_t *s, uint32_t step, int ms)
+{
+    for (int t = 0; t < ms; t += CHECK_MS) {
+        s_now_us += CHECK_MS * 1000;
+        s->frames += step;
+        stream_watchdog_check(wd, s, s_now_us);
+    }
+}
+
+static void test_create_args(void)
+{
+    stream_watchdog_config_t cfg = {
+        .stall_ms = STALL_MS,
+        .stage_ms = { 1, 1, 1, 1 },
+        .recover = record,
+    };
+    stream_watchdog_t *wd;
+    CHECK(stream_watchdog_create(NULL, &wd) == ESP_ERR_INVALID_ARG);
+    CHECK(stream_watchdog_create(&cfg, NULL) == ESP_ERR_INVALID_ARG);
+    cfg.stage_ms[2] = 0;
+    CHECK(stream_watchdog_create(&cfg, &wd) == ESP_ERR_INVALID_ARG);
+    cfg.stage_ms[2] = 1;
+    cfg.recover = NULL;
+    CHECK(stream_watchdog_create(&cfg, &wd) == ESP_ERR_INVALID_ARG);
+    CHECK(strcmp(stream_watchdog_stage_name(STREAM_WATCHDOG_ALT_RESET), "alt reset") == 0);
+    CHECK(strcmp(stream_watchdog_stage_name(NO_STAGE), "none") == 0);
+}
+
+static void test_ladder_and_give_up(void)
+{
+    memset(&s_calls, 0, sizeof(s_calls));
+    const uint32_t gave_up = metric("wd.gave_up"), stalls = metric("wd.stall");
+    stream_watchdog_t *wd = create(record);
+    stream_watchdog_sample_t s = { .active = true };
+
+    // Active but nothing ever arrived: not armed
+    run(wd, &s, 0, 2000);
+    CHECK(s_calls.n == 0);
+
+    run(wd, &s, 480, 500);
+    const int64_t stalled_us = s_now_us;
+    run(wd, &s, 0, 5000);
+
+    // Every stage in turn, each after the one before had its time
+    CHECK(s_calls.n == STREAM_WATCHDOG_STAGES);
+    for (int i = 0; i < s_calls.n && i < STREAM_WATCHDOG_STAGES; i++) {
+        CHECK(s_calls.stages[i] == (stream_watchdog_stage_t)i);
+    }
+    CHECK(s_calls.at_us[0] - stalled_us == STALL_MS * 1000);
+    CHECK(s_calls.at_us[1] - s_calls.at_us[0] == STAGE_MS * 1000);
+    CHECK(s_calls.at_us[2] - s_calls.at_us[1] == STAGE_MS * 1000);
+    CHECK(s_calls.at_us[3] - s_calls.at_us[2] == 2 * STAGE_MS * 1000);
+    CHECK(metric("wd.stall") - stalls == 1 && metric("wd.gave_up") - gave_up == 1);
+    CHECK(stream_watchdog_stage(wd) == NO_STAGE);
+
+    // Flowing again re-arms it; the next stall starts from the first stage
+    run(wd, &s, 480, 500);
+    run(wd, &s, 0, STALL_MS + CHECK_MS);
+    CHECK(s_calls.n == STREAM_WATCHDOG_STAGES + 1 && s_calls.stages[STREAM_WATCHDOG_STAGES] == STREAM_WATCHDOG_RESUBMIT);
+    stream_watchdog_delete(wd);
+}
+
+static void test_recovery(void)
+{
+    memset(&s_calls, 0, sizeof(s_calls));
+    const uint32_t recovered = metric("wd.recovered"), observed = recover_ms_observed();
+    stream_watchdog_t *wd = create(record);
+    stream_watchdog_sample_t s = { .active = true };
+
+    run(wd, &s, 480, 500);
+    run(wd, &s, 0, STALL_MS + STAGE_MS + CHECK_MS);
+    CHECK(s_calls.n == 2 && stream_watchdog_stage(wd) == STREAM_WATCHDOG_ALT_RESET);
+    run(wd, &s, 480, CHECK_MS);
+    CHECK(stream_watchdog_stage(wd) == NO_STAGE);
+    CHECK(metric("wd.recovered") - recovered == 1 && recover_ms_observed() - observed == 1);
+
+    // Nothing more while samples flow
+    run(wd, &s, 480, 2000);
+    CHECK(s_calls.n == 2);
+    stream_watchdog_delete(wd);
+}
+
+static void test_stopped_is_not_stalled(void)
+{
+    memset(&s_calls, 0, sizeof(s_calls));
+    stream_watchdog_t *wd = create(record);
+    stream_watchdog_sample_t s = { .active = true };
+
+    run(wd, &s, 480, 500);
+    s.active = false;       // detached
+    run(wd, &s, 0, 5000);
+    CHECK(s_calls.n == 0);
+
+    // A device attached again but never streaming isn't watched either
+    s.active = true;
+    run(wd, &s, 0, 5000);
+    CHECK(s_calls.n == 0);
+
+    // Detached mid-recovery: the ladder carries on, re-enumeration detaches
+    run(wd, &s, 480, 500);
+    run(wd, &s, 0, STALL_MS + STAGE_MS + CHECK_MS);
+    s.active = false;
+    run(wd, &s, 0, 2 * STAGE_MS + CHECK_MS);
+    CHECK(s_calls.n == 3 && s_calls.stages[2] == STREAM_WATCHDOG_REENUMERATE);
+    stream_watchdog_delete(wd);
+}
+
+static void test_stuck_stage(void)
+{
+    memset(&s_calls, 0, sizeof(s_calls));
+    const uint32_t stuck = metric("wd.stage_stuck");
+    stream_watchdog_t *wd = create(record);
+    stream_watchdog_sample_t s = { .active = true };
+
+    run(wd, &s, 480, 500);
+    s.stream.published = 7;
+    s.stream.busy = AUDIO_STREAM_STAGE_SUBSCRIBER;
+    s.stream.busy_index = 2;
+    run(wd, &s, 0, 5000);
+
+    // Logged once; no USB stage could get the client task going again
+    CHECK(s_calls.n == 0 && metric("wd.stage_stuck") - stuck == 1);
+
+    // Back from the stage but still no samples: now it's the bus
+    s.stream.busy = AUDIO_STREAM_STAGE_NONE;
+    s.stream.published++;
+    run(wd, &s, 0, STALL_MS);
+    CHECK(s_calls.n == 1 && s_calls.stages[0] == STREAM_WATCHDOG_RESUBMIT);
+
+    // Moving between stages is progress, not a stuck stage
+    run(wd, &s, 480, 500);
+    for (int i = 0; i < 100; i++) {
+        s.stream.busy = i % 2 ? AUDIO_STREAM_STAGE_FILTER : AUDIO_STREAM_STAGE_SUBSCRIBER;
+        s.stream.published += i % 2;
+        run(wd, &s, 480, CHECK_MS);
+    }
+    CHECK(metric("wd.stage_stuck") - stuck == 1);
+    stream_watchdog_delete(wd);
+}
+
+/* ---------- End to end: uac_driver on a device that wedges ---------- */
+
+static struct {
+    unsigned bits;
+    bool have_first;
+    uint64_t p0;
+    uint32_t q0;
+    uint64_t frames;
+    int mismatches;
+} s_seen;
+
+static void frames_cb(const int32_t *frames, size_t nframes, size_t channels, uint64_t t0, void *ctx)
+{
+    (void)ctx;
+    if (!s_seen.have_first) {
+        s_seen.have_first = true;
+        s_seen.p0 = t0;
+        s_seen.q0 = (uint32_t)frames[0];
+    }
+    const unsigned shift = 32 - s_seen.bits;
+    for (size_t i = 0; i < nframes; i++) {
+        for (size_t c = 0; c < channels; c++) {
+            const uint32_t want = s_seen.q0 + (((uint32_t)(t0 + i - s_seen.p0) * MOCK_UAC_FRAME_STEP +
+                                                (uint32_t)c * MOCK_UAC_CHANNEL_STEP) << shift);
+            s_seen.mismatches += (uint32_t)frames[i * channels + c] != want;
+        }
+    }
+    s_seen.frames += nframes;
+}
+
+/* What the firmware does for each stage; the power stays off for no bus time */
+static void recover_uac(stream_watchdog_stage_t stage, void *ctx)
+{
+    record(stage, ctx);
+    switch (stage) {
+    case STREAM_WATCHDOG_RESUBMIT:
+    case STREAM_WATCHDOG_ALT_RESET:
+        uac_driver_request_recovery(stage == STREAM_WATCHDOG_RESUBMIT ? UAC_RECOVER_RESTART : UAC_RECOVER_ALT_RESET);
+        break;
+    case STREAM_WATCHDOG_REENUMERATE:
+        class_driver_request_reenumerate();
+        break;
+    case STREAM_WATCHDOG_POWER_CYCLE:
+        CHECK(usb_host_lib_set_root_port_power(false) == ESP_OK);
+        CHECK(usb_host_lib_set_root_port_power(true) == ESP_OK);
+        break;
+    default:
+        break;
+    }
+}
+
+static void stream_until_ms(stream_watchdog_t *wd, uint64_t ms)
+{
+    uint64_t next_check = mock_usb_now_ms();
+    while (mock_usb_now_ms() < ms) {
+        class_driver_handle_events(CLASS_DRIVER_POLL_MS);
+        if (mock_usb_now_ms() >= next_check) {
+            stream_watchdog_sample_t s = { .frames = uac_driver_frames_received(), .active = uac_driver_active() };
+            audio_stream_progress(&s.stream);
+            s_now_us = (int64_t)mock_usb_now_us();
+            stream_watchdog_check(wd, &s, s_now_us);
+            next_check += CHECK_MS;
+        }
+    }
+}
+
+static void test_wedged_device(void)
+{
+    mock_uac_t m;
+    mock_uac_init(&m);
+    m.uac_version = 2;
+    m.speed = USB_SPEED_HIGH;
+    m.channels = 2;
+    m.subframe_size = 3;
+    m.bit_resolution = 24;
+    m.ep_mps = 64;
+    m.freq_control = true;
+    m.num_rates = 1;
+    m.rates[0] = 48000;
+    m.rate_hz = 48000;
+    memset(&s_seen, 0, sizeof(s_seen));
+    s_seen.bits = m.bit_resolution;
+    memset(&s_calls, 0, sizeof(s_calls));
+    const uint32_t recovered = metric("wd.recovered");
+
+    stream_watchdog_t *wd = create(recover_uac);
+    mock_usb_host_reset();
+    CHECK(class_driver_install() == ESP_OK);
+    CHECK(mock_uac_connect(&m, NULL) != 0);
+    stream_until_ms(wd, 500);
+    CHECK(uac_driver_active() && s_seen.frames > 0);
+
+    // A rate request unwedges it: the first stage is enough
+    m.wedge = MOCK_UAC_WEDGE_UNTIL_RATE;
+    const uint64_t before = s_seen.frames;
+    stream_until_ms(wd, 1500);
+    CHECK(m.wedge == MOCK_UAC_WEDGE_NONE && s_calls.n == 1 && s_calls.stages[0] == STREAM_WATCHDOG_RESUBMIT);
+    CHECK(metric("wd.recovered") - recovered == 1 && s_seen.frames - before > 500 * 48);
+
+    // Only alt setting 0 does: the second stage
+    m.wedge = MOCK_UAC_WEDGE_UNTIL_ALT0;
+    stream_until_ms(wd, 2500);
+    CHECK(m.wedge == MOCK_UAC_WEDGE_NONE && s_calls.n == 3 && s_calls.stages[2] == STREAM_WATCHDOG_ALT_RESET);
+    CHECK(metric("wd.recovered") - recovered == 2 && stream_watchdog_stage(wd) == NO_STAGE);
+
+    // Restarted on the same timeline: the time lost is a gap, every sample
+    // after it where it was sampled
+    CHECK(s_seen.mismatches == 0);
+
+    // Only a bus reset does: the client closes the device so it can be freed
+    // and enumerated again. A new attach starts a new timeline
+    m.wedge = MOCK_UAC_WEDGE_UNTIL_RESET;
+    s_seen.have_first = false;
+    stream_until_ms(wd, 4500);
+    CHECK(m.wedge == MOCK_UAC_WEDGE_NONE && s_calls.n == 6 && s_calls.stages[5] == STREAM_WATCHDOG_REENUMERATE);
+    CHECK(mock_usb_reenumerations(m.addr) == 1 && uac_driver_active());
+    CHECK(metric("wd.recovered") - recovered == 3 && stream_watchdog_stage(wd) == NO_STAGE);
+
+    // Only losing power does: the last stage, after re-enumerating once more
+    m.wedge = MOCK_UAC_WEDGE_UNTIL_POWER;
+    s_seen.have_first = false;
+    const uint64_t before_power = s_seen.frames;
+    stream_until_ms(wd, 7500);
+    CHECK(m.wedge == MOCK_UAC_WEDGE_NONE && s_calls.n == 10 && s_calls.stages[9] == STREAM_WATCHDOG_POWER_CYCLE);
+    CHECK(mock_usb_reenumerations(m.addr) == 3 && uac_driver_active() && s_seen.frames - before_power > 500 * 48);
+    CHECK(metric("wd.recovered") - recovered == 4 && stream_watchdog_stage(wd) == NO_STAGE);
+    CHECK(s_seen.mismatches == 0);
+
+    class_driver_client_deregister();
+    int passes = 0;
+    while (class_driver_handle_events(0) && passes < 10) {
+        passes++;
+    }
+    CHECK(passes < 10 && !uac_driver_active());
+    CHECK(class_driver_uninstall() == ESP_OK);
+    stream_watchdog_delete(wd);
+}
+
+int main(void)
+{
+    test_create_args();
+    test_ladder_and_give_up();
+    test_recovery();
+    test_stopped_is_not_stalled();
+    test_stuck_stage();
+
+    const uac_driver_config_t cfg = { .sample_rate_hz = 48000 };
+    CHECK(uac_driver_register(&cfg) == ESP_OK);
+    CHECK(audio_stream_subscribe_frames(frames_cb, NULL) == ESP_OK);
+    test_wedged_device();
+    return test_report("stream_watchdog");
+}
@@ -0,0 +1,102 @@
+// test_task_profile.c  (per-task load between snapshots: matching, ordering, idle, wrap-around)
+
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+#include "task_profile.h"
+#include "test_util.h"
+
+static void add(task_profile_snapshot_t *s, const char *name, uint32_t id, int core, uint32_t run_time)
+{
+    task_profile_task_t *t = &s->tasks[s->num_tasks++];
+    memset(t, 0, sizeof(*t));
+    strncpy(t->name, name, sizeof(t->name) - 1);
+    t->id = id;
+    t->core = core;
+    t->run_time = run_time;
+    t->stack_free = 1000 + id;
+}
+
+static const task_profile_row_t *row(const task_profile_report_t *r, const char *name)
+{
+    for (size_t i = 0; i < r->num_rows; i++) {
+        if (strcmp(r->rows[i].task->name, name) == 0) {
+            return &r->rows[i];
+        }
+    }
+    return NULL;
+}
+
+static bool near(float a, float b)
+{
+    return fabsf(a - b) < 0.01f;
+}
+
+static void test_load(void)
+{
+    task_profile_snapshot_t a = { .total = 1000000 }, b = { .total = 2000000 };
+    add(&a, "IDLE0", 1, 0, 500000);
+    add(&a, "IDLE1", 2, 1, 500000);
+    add(&a, "usb_client", 7, 1, 100000);
+    add(&a, "urb_capture", 9, 0, 0);
+    add(&a, "gone", 11, TASK_PROFILE_ANY_CORE, 5000);
+
+    // A million ticks later; "late" was created during the period
+    add(&b, "usb_client", 7, 1, 350000);
+    add(&b, "IDLE0", 1, 0, 1400000);
+    add(&b, "IDLE1", 2, 1, 1250000);
+    add(&b, "urb_capture", 9, 0, 60000);
+    add(&b, "late", 12, TASK_PROFILE_ANY_CORE, 40000);
+
+    task_profile_report_t r;
+    task_profile_diff(&a, &b, &r);
+    CHECK(r.num_rows == 5 && row(&r, "gone") == NULL);
+    CHECK(near(row(&r, "usb_client")->cpu_pct, 25.0f));
+    CHECK(near(row(&r, "urb_capture")->cpu_pct, 6.0f));
+    CHECK(near(row(&r, "late")->cpu_pct, 4.0f));
+    CHECK(near(r.core_load_pct[0], 10.0f) && near(r.core_load_pct[1], 25.0f));
+    CHECK(row(&r, "late")->task->stack_free == 1012);
+
+    // Busiest first
+    CHECK(strcmp(r.rows[0].task->name, "IDLE0") == 0 && strcmp(r.rows[2].task->name, "usb_client") == 0);
+    for (size_t i = 1; i < r.num_rows; i++) {
+        CHECK(r.rows[i - 1].cpu_pct >= r.rows[i].cpu_pct);
+    }
+}
+
+static void test_wrap(void)
+{
+    // Both the total and a task's counter wrap during the period
+    task_profile_snapshot_t a = { .total = 0xFFFF0000u }, b = { .total = 0x00010000u };
+    add(&a, "IDLE0", 1, 0, 0xFFFFF000u);
+    add(&a, "usb_daemon", 3, 0, 0xFFFFFF00u);
+    add(&b, "IDLE0", 1, 0, 0x0000F000u);
+    add(&b, "usb_daemon", 3, 0, 0x00001900u);
+
+    task_profile_report_t r;
+    task_profile_diff(&a, &b, &r);
+    CHECK(near(row(&r, "IDLE0")->cpu_pct, 100.0f * 0x10000 / 0x20000));
+    CHECK(near(row(&r, "usb_daemon")->cpu_pct, 100.0f * 0x1A00 / 0x20000));
+    CHECK(near(r.core_load_pct[0], 50.0f));
+}
+
+static void test_no_idle_no_time(void)
+{
+    // No idle task for core 1, and no time went by: nothing to divide by
+    task_profile_snapshot_t a = { .total = 500 }, b = { .total = 500 };
+    add(&a, "IDLE0", 1, 0, 100);
+    add(&b, "IDLE0", 1, 0, 100);
+    add(&b, "main", 4, 0, 0);
+    task_profile_report_t r;
+    task_profile_diff(&a, &b, &r);
+    CHECK(r.num_rows == 2 && r.rows[0].cpu_pct == 0.0f && r.rows[1].cpu_pct == 0.0f);
+    CHECK(r.core_load_pct[1] < 0.0f);
+}
+
+int main(void)
+{
+    test_load();
+    test_wrap();
+    test_no_idle_no_time();
+    return test_report("task_profile");
+}
@@ -0,0 +1,252 @@
+// test_trace.c  (trace ring: order, wrap, concurrent writers vs snapshots, dump, timeline, Chrome JSON)
+
+#define _GNU_SOURCE     // sched_setaffinity()
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include "trace.h"
+#include "trace_decode.h"
+#include "test_util.h"
+
+#define THREADS     4
+#define RECORDS     200000
+
+static trace_snapshot_t s_snap, s_back;
+static cpu_set_t s_cpus;    // the process's CPUs, before pinning
+static unsigned s_core;     // ring the pinned main thread writes to
+
+/* Pin the calling thread to the nth (mod their count) CPU it may run on, so
+ * its events land in one ring; returns that ring */
+static unsigned pin_self(unsigned nth)
+{
+    const int count = CPU_COUNT(&s_cpus);
+    int skip = (int)(nth % (unsigned)count);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &s_cpus) && skip-- == 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            CHECK(pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0);
+            return cpu > 0 ? (unsigned)cpu % TRACE_CORES : 0;
+        }
+    }
+    return 0;
+}
+
+static void test_order_and_wrap(void)
+{
+    trace_snapshot(&s_snap);
+    CHECK(s_snap.core[0].count == 0 && s_snap.core[1].count == 0);
+
+    trace_record(TRACE_URB_DONE, TRACE_PHASE_BEGIN, 16);
+    trace_record(TRACE_URB_SUBMIT, TRACE_PHASE_INSTANT, 0);
+    trace_record(TRACE_URB_DONE, TRACE_PHASE_END, 16);
+    trace_snapshot(&s_snap);
+    const trace_event_t *e = s_snap.core[s_core].events;
+    CHECK(s_snap.core[s_core].count == 3 && s_snap.core[!s_core].count == 0);
+    CHECK(e[0].event == TRACE_URB_DONE && e[0].phase == TRACE_PHASE_BEGIN && e[0].arg == 16);
+    CHECK(e[1].event == TRACE_URB_SUBMIT && e[1].phase == TRACE_PHASE_INSTANT);
+    CHECK(e[2].event == TRACE_URB_DONE && e[2].phase == TRACE_PHASE_END);
+    CHECK((int32_t)(e[2].cycles - e[0].cycles) >= 0 && (int32_t)(s_snap.core[s_core].anchor_cycles - e[2].cycles) >= 0);
+
+    // Past a full ring only the newest TRACE_RING_EVENTS remain, oldest first
+    for (uint32_t i = 0; i < 3 * TRACE_RING_EVENTS; i++) {
+        trace_record(TRACE_MARK, TRACE_PHASE_INSTANT, (uint16_t)i);
+    }
+    trace_snapshot(&s_snap);
+    CHECK(s_snap.core[s_core].count == TRACE_RING_EVENTS);
+    bool in_order = true;
+    for (size_t i = 0; i < TRACE_RING_EVENTS; i++) {
+        in_order &= e[i].event == TRACE_MARK && e[i].arg == (uint16_t)(2 * TRACE_RING_EVENTS + i);
+    }
+    CHECK(in_order);
+}
+
+/* Each writer stays on one CPU, so a thread's events all land in one ring
+ * and a snapshot's window can't skip 4096 of them; rings still have
+ * several writers, interleaved or at the same time */
+static void *writer(void *arg)
+{
+    const uint16_t t = (uint16_t)(uintptr_t)arg;
+    pin_self(t);
+    for (uint32_t i = 0; i < RECORDS; i++) {
+        trace_record(TRACE_MARK, TRACE_PHASE_INSTANT, (uint16_t)(t << 12 | (i & 0xFFF)));
+    }
+    return NULL;
+}
+
+/* Every event a snapshot keeps is whole: per writer thread, args and
+ * timestamps only move forward */
+static bool snapshot_consistent(const trace_snapshot_t *snap)
+{
+    for (unsigned c = 0; c < TRACE_CORES; c++) {
+        bool seen[THREADS] = {0};
+        uint16_t arg[THREADS] = {0};
+        uint32_t cycles[THREADS] = {0};
+        for (size_t i = 0; i < snap->core[c].count; i++) {
+            const trace_event_t *e = &snap->core[c].events[i];
+            const unsigned t = e->arg >> 12;
+            if (e->event != TRACE_MARK || e->phase != TRACE_PHASE_INSTANT || t >= THREADS) {
+                return false;
+            }
+            if (seen[t] && (((e->arg - arg[t]) & 0xFFF) == 0 || (int32_t)(e->cycles - cycles[t]) < 0)) {
+                return false;
+            }
+            seen[t] = true;
+            arg[t] = e->arg;
+            cycles[t] = e->cycles;
+        }
+    }
+    return true;
+}
+
+static void test_concurrent(void)
+{
+    pthread_t th[THREADS];
+    for (uintptr_t i = 0; i < THREADS; i++) {
+        CHECK(pthread_create(&th[i], NULL, writer, (void *)i) == 0);
+    }
+    int snapshots = 0;
+    bool consistent = true;
+    for (; snapshots < 200; snapshots++) {
+        trace_snapshot(&s_snap);
+        consistent &= snapshot_consistent(&s_snap);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(th[i], NULL);
+    }
+    CHECK(consistent);
+    trace_snapshot(&s_snap);
+    CHECK(snapshot_consistent(&s_snap));
+    CHECK(s_snap.core[0].count + s_snap.core[1].count > 0);
+
+    // A writer preempted inside its slot costs a lapping writer its event;
+    // alone, a lap fills the ring again
+    for (uint32_t i = 0; i < TRACE_RING_EVENTS; i++) {
+        trace_record(TRACE_MARK, TRACE_PHASE_INSTANT, (uint16_t)i);
+    }
+    trace_snapshot(&s_snap);
+    CHECK(s_snap.core[s_core].count == TRACE_RING_EVENTS);
+}
+
+static bool snapshots_equal(const trace_snapshot_t *a, const trace_snapshot_t *b)
+{
+    if (a->cpu_hz != b->cpu_hz) {
+        return false;
+    }
+    for (unsigned c = 0; c < TRACE_CORES; c++) {
+        if (a->core[c].anchor_cycles != b->core[c].anchor_cycles || a->core[c].anchor_us != b->core[c].anchor_us ||
+                a->core[c].count != b->core[c].count) {
+            return false;
+        }
+        for (size_t i = 0; i < a->core[c].count; i++) {
+            const trace_event_t *x = &a->core[c].events[i], *y = &b->core[c].events[i];
+            if (x->cycles != y->cycles || x->event != y->event || x->phase != y->phase || x->arg != y->arg) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+typedef struct {
+    uint8_t buf[TRACE_HEADER_LEN + TRACE_CORES * (TRACE_CORE_HEADER_LEN + TRACE_RING_EVENTS * TRACE_EVENT_LEN)];
+    size_t len;
+} sink_t;
+
+static esp_err_t to_sink(const void *data, size_t len, void *ctx)
+{
+    sink_t *s = ctx;
+    if (s->len + len > sizeof(s->buf)) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(s->buf + s->len, data, len);
+    s->len += len;
+    return ESP_OK;
+}
+
+static void test_dump(void)
+{
+    static sink_t sink;
+    trace_record(TRACE_FILTER, TRACE_PHASE_BEGIN, 0);
+    trace_record(TRACE_FILTER, TRACE_PHASE_END, 0);
+    trace_snapshot(&s_snap);
+    CHECK(trace_dump(&s_snap, to_sink, &sink) == ESP_OK);
+    CHECK(sink.len == TRACE_HEADER_LEN + TRACE_CORES * TRACE_CORE_HEADER_LEN +
+          (s_snap.core[0].count + s_snap.core[1].count) * TRACE_EVENT_LEN);
+    CHECK(memcmp(sink.buf, TRACE_MAGIC, 4) == 0);
+    CHECK(trace_decode(sink.buf, sink.len, &s_back) == ESP_OK);
+    CHECK(snapshots_equal(&s_back, &s_snap));
+    CHECK(trace_decode(sink.buf, sink.len - 1, &s_back) == ESP_ERR_INVALID_SIZE);
+    sink.buf[0] = 'X';
+    CHECK(trace_decode(sink.buf, sink.len, &s_back) == ESP_ERR_INVALID_VERSION);
+    sink.buf[0] = 'T';
+
+    // The same bytes as console hex lines, between log lines, after a dump
+    // that was cut short and with one that never ends after it
+    static char log[4 * sizeof(sink.buf)];
+    size_t n = (size_t)sprintf(log, "I (100) UAC: lost 3\nTRACE: begin\nTRACE: 5452\nI (200) boot\n"
+                                     "I (300) UAC: lost 1\r\nI (300) UAC_PROBE: TRACE: begin\r\n");
+    for (size_t i = 0; i < sink.len; i++) {
+        n += (size_t)sprintf(log + n, "%s%02X%s", i % 32 == 0 ? "TRACE: " : "", sink.buf[i],
+                             i % 32 == 31 || i + 1 == sink.len ? "\r\n" : "");
+    }
+    n += (size_t)sprintf(log + n, "TRACE: end\r\nTRACE: begin\nTRACE: 54\n");
+    static uint8_t back[sizeof(sink.buf)];
+    CHECK(trace_unhex_log(log, n, back, sizeof(back)) == sink.len && memcmp(back, sink.buf, sink.len) == 0);
+    CHECK(trace_unhex_log(log, n, back, sink.len - 1) == 0);
+    CHECK(trace_unhex_log("TRACE: begin\nTRACE: 00\n", 23, back, sizeof(back)) == 0);
+
+    // What the firmware prints decodes to the same dump
+    char *text = NULL;
+    size_t text_len = 0;
+    FILE *f = open_memstream(&text, &text_len);
+    CHECK(trace_dump_hex(&s_snap, f) == ESP_OK);
+    fclose(f);
+    CHECK(trace_unhex_log(text, text_len, back, sizeof(back)) == sink.len && memcmp(back, sink.buf, sink.len) == 0);
+    free(text);
+}
+
+static void test_timeline(void)
+{
+    // 1 MHz: a cycle is a microsecond. The counter wrapped between the
+    // second and third event; the fourth was stamped before the third
+    memset(&s_snap, 0, sizeof(s_snap));
+    s_snap.cpu_hz = 1000000;
+    s_snap.core[1].anchor_cycles = 20;
+    s_snap.core[1].anchor_us = 5000000;
+    const uint32_t cycles[] = { 0xFFFFFF00u, 0xFFFFFFF0u, 4, 2 };
+    const uint8_t phase[] = { TRACE_PHASE_END, TRACE_PHASE_BEGIN, TRACE_PHASE_INSTANT, TRACE_PHASE_END };
+    for (size_t i = 0; i < 4; i++) {
+        s_snap.core[1].events[i] = (trace_event_t){ .cycles = cycles[i], .event = TRACE_URB_DONE, .phase = phase[i],
+                                                    .arg = (uint16_t)i };
+    }
+    s_snap.core[1].count = 4;
+    static double ts[TRACE_RING_EVENTS];
+    trace_event_times(&s_snap, 1, ts);
+    CHECK(ts[3] == 4999982.0 && ts[2] == 4999984.0 && ts[1] == 4999964.0 && ts[0] == 4999724.0);
+
+    // The leading end lost its begin; the rest pair up on core 1's track
+    char *json = NULL;
+    size_t len = 0;
+    FILE *f = open_memstream(&json, &len);
+    trace_write_json(&s_snap, f);
+    fclose(f);
+    CHECK(strstr(json, "\"args\":{\"arg\":0}") == NULL);
+    CHECK(strstr(json, "{\"name\":\"urb_done\",\"ph\":\"B\",\"ts\":4999964.000,\"pid\":1,\"tid\":1,\"args\":{\"arg\":1}}") != NULL);
+    CHECK(strstr(json, "\"ph\":\"i\",\"s\":\"t\",\"ts\":4999984.000") != NULL);
+    CHECK(strstr(json, "\"ph\":\"E\",\"ts\":4999982.000") != NULL);
+    CHECK(strstr(json, "\"args\":{\"name\":\"core 1\"}") != NULL);
+    free(json);
+}
+
+int main(void)
+{
+    CHECK(sched_getaffinity(0, sizeof(s_cpus), &s_cpus) == 0);
+    s_core = pin_self(0);
+    test_order_and_wrap();
+    test_concurrent();
+    test_dump();
+    test_timeline();
+    return test_report("trace");
+}
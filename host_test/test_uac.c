@@ -0,0 +1,297 @@
+// test_uac.c  (AS descriptor parsing, packet sizing, sampling-frequency control, UAC 1.0 and 2.0)
+
+#include <string.h>
+#include "mock_uac.h"
+#include "mock_usb_host.h"
+#include "test_util.h"
+#include "uac.h"
+
+/* Config descriptor shaped like the AudioMoth's: AC interface 0, AS
+ * interface 1 (alt 0 idle, alt 1 streaming on EP 0x82) */
+static size_t build_config(uint8_t *d, uint16_t mps, bool freq_control, bool continuous,
+                           const uint32_t *freqs, uint8_t nfreq)
+{
+    size_t n = 0;
+#define PUT(...) do { const uint8_t b_[] = { __VA_ARGS__ }; memcpy(d + n, b_, sizeof(b_)); n += sizeof(b_); } while (0)
+    PUT(9, 0x02, 0, 0, 2, 1, 0, 0xE0, 50);
+    PUT(9, 0x04, 0, 0, 0, 0x01, 0x01, 0, 0);
+    PUT(9, 0x24, 0x01, 0x00, 0x01, 30, 0, 1, 1);
+    PUT(12, 0x24, 0x02, 1, 0x01, 0x02, 0, 1, 0, 0, 0, 0);
+    PUT(9, 0x24, 0x03, 2, 0x01, 0x01, 0, 1, 0);
+    PUT(9, 0x04, 1, 0, 0, 0x01, 0x02, 0, 0);
+    PUT(9, 0x04, 1, 1, 1, 0x01, 0x02, 0, 0);
+    PUT(7, 0x24, 0x01, 2, 1, 0x01, 0x00);
+    PUT((uint8_t)(8 + 3 * nfreq), 0x24, 0x02, 0x01, 1, 2, 16, continuous ? 0 : nfreq);
+    for (uint8_t i = 0; i < nfreq; i++) {
+        PUT(freqs[i] & 0xFF, (freqs[i] >> 8) & 0xFF, (freqs[i] >> 16) & 0xFF);
+    }
+    PUT(9, 0x05, 0x82, 0x0D, mps & 0xFF, mps >> 8, 1, 0, 0);
+    PUT(7, 0x25, 0x01, freq_control ? 0x01 : 0x00, 0, 0, 0);
+#undef PUT
+    d[2] = n & 0xFF;
+    d[3] = (uint8_t)(n >> 8);
+    return n;
+}
+
+static void test_parse(void)
+{
+    uint8_t desc[256];
+    const uint32_t fixed[] = { 48000 };
+    build_config(desc, 96, false, false, fixed, 1);
+    uac_stream_info_t info;
+    CHECK(uac_parse_stream((const usb_config_desc_t *)desc, 1, 1, &info) == ESP_OK);
+    CHECK(info.ep_addr == 0x82 && info.ep_mps == 96);
+    CHECK(info.channels == 1 && info.subframe_size == 2 && info.bit_resolution == 16);
+    CHECK(!info.freq_control && !info.continuous && info.num_freqs == 1 && info.freqs[0] == 48000);
+    CHECK(uac_rate_supported(&info, 48000) && !uac_rate_supported(&info, 44100));
+    // A frame over nominal when it fits; this endpoint has no room for one
+    CHECK(uac_packet_frames(&info, 48000) == 48 && uac_packet_bytes(&info, 48000) == 96);
+    CHECK(uac_packet_bytes(&info, 96000) == 0);
+    CHECK(uac_parse_stream((const usb_config_desc_t *)desc, 1, 0, &info) == ESP_ERR_NOT_FOUND);
+    CHECK(uac_parse_stream((const usb_config_desc_t *)desc, 1, 2, &info) == ESP_ERR_NOT_FOUND);
+
+    const uint32_t rates[] = { 8000, 44100, 48000, 192000, 384000 };
+    build_config(desc, 768, true, false, rates, 5);
+    CHECK(uac_parse_stream((const usb_config_desc_t *)desc, 1, 1, &info) == ESP_OK);
+    CHECK(info.freq_control && info.num_freqs == 5 && info.freqs[4] == 384000);
+    CHECK(uac_packet_frames(&info, 44100) == 45 && uac_packet_bytes(&info, 44100) == 92);
+    CHECK(uac_packet_bytes(&info, 384000) == 768);
+    CHECK(uac_packet_bytes(&info, 8000) == 18);
+
+    // Continuous range: bSamFreqType 0 followed by lower and upper bounds
+    const uint32_t range[] = { 8000, 96000 };
+    build_config(desc, 192, true, true, range, 2);
+    CHECK(uac_parse_stream((const usb_config_desc_t *)desc, 1, 1, &info) == ESP_OK);
+    CHECK(info.continuous && uac_rate_supported(&info, 22050) && !uac_rate_supported(&info, 192000));
+
+    // Stereo 24-bit in 3-byte subframes: packets round to whole frames
+    build_config(desc, 582, true, false, rates, 5);
+    for (size_t i = 0; i + 7 < sizeof(desc); i++) {
+        if (desc[i + 1] == 0x24 && desc[i + 2] == 0x02 && desc[i + 3] == 0x01 && desc[i + 6] == 16) {
+            desc[i + 4] = 2;
+            desc[i + 5] = 3;
+            desc[i + 6] = 24;
+            break;
+        }
+    }
+    CHECK(uac_parse_stream((const usb_config_desc_t *)desc, 1, 1, &info) == ESP_OK);
+    CHECK(info.channels == 2 && info.subframe_size == 3 && info.bit_resolution == 24);
+    CHECK(uac_packet_bytes(&info, 48000) == 294);
+    CHECK(uac_packet_bytes(&info, 44100) == 276);
+    CHECK(uac_packet_bytes(&info, 96000) == 582);
+    CHECK(uac_packet_bytes(&info, 192000) == 0);
+}
+
+/* ---------- SET_CUR / GET_CUR against a device that snaps to its list ---------- */
+
+static uint32_t s_dev_rate = 48000;
+static const uint32_t s_dev_rates[] = { 8000, 48000, 192000 };
+static int s_set_count;
+
+static esp_err_t uac_device_ctrl(const usb_setup_packet_t *setup, uint8_t *data, size_t *len, void *ctx)
+{
+    (void)ctx;
+    if ((setup->bmRequestType & 0x7F) != (USB_BM_REQUEST_TYPE_TYPE_CLASS | USB_BM_REQUEST_TYPE_RECIP_ENDPOINT) ||
+            setup->wValue != 0x0100 || setup->wIndex != 0x82) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (setup->bRequest == 0x01) {
+        const uint32_t want = data[0] | (data[1] << 8) | ((uint32_t)data[2] << 16);
+        // Snap to the nearest supported rate, like real fixed-list devices
+        uint32_t best = s_dev_rates[0];
+        for (size_t i = 0; i < sizeof(s_dev_rates) / sizeof(s_dev_rates[0]); i++) {
+            const uint32_t d = s_dev_rates[i] > want ? s_dev_rates[i] - want : want - s_dev_rates[i];
+            const uint32_t bd = best > want ? best - want : want - best;
+            best = d < bd ? s_dev_rates[i] : best;
+        }
+        s_dev_rate = best;
+        s_set_count++;
+        return ESP_OK;
+    }
+    if (setup->bRequest == 0x81 && *len >= 3) {
+        data[0] = s_dev_rate & 0xFF;
+        data[1] = (s_dev_rate >> 8) & 0xFF;
+        data[2] = (s_dev_rate >> 16) & 0xFF;
+        *len = 3;
+        return ESP_OK;
+    }
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+static usb_host_client_handle_t s_client;
+static usb_device_handle_t s_dev;
+
+static void client_cb(const usb_host_client_event_msg_t *msg, void *arg)
+{
+    (void)arg;
+    if (msg->event == USB_HOST_CLIENT_EVENT_NEW_DEV) {
+        CHECK(usb_host_device_open(s_client, msg->new_dev.address, &s_dev) == ESP_OK);
+    }
+}
+
+static esp_err_t s_rate_err;
+static uint32_t s_rate_hz;
+static int s_rate_done;
+
+static void rate_cb(esp_err_t err, uint32_t hz, void *ctx)
+{
+    (void)ctx;
+    s_rate_err = err;
+    s_rate_hz = hz;
+    s_rate_done++;
+}
+
+static void drain(void)
+{
+    while (usb_host_client_handle_events(s_client, 100) == ESP_OK) {
+    }
+}
+
+static void test_rate_control(void)
+{
+    mock_usb_host_reset();
+    const usb_host_client_config_t cfg = {
+        .async = { .client_event_callback = client_cb },
+    };
+    CHECK(usb_host_client_register(&cfg, &s_client) == ESP_OK);
+    const mock_usb_device_config_t dev = {
+        .speed = USB_SPEED_FULL, .ctrl = uac_device_ctrl, .ctrl_latency_ms = 1,
+    };
+    mock_usb_connect(&dev);
+    usb_host_client_handle_events(s_client, 0);
+
+    ctrl_xfer_t *ctrl;
+    const ctrl_xfer_config_t ccfg = { .client = s_client, .pool_size = 4, .max_data_len = 16 };
+    CHECK(ctrl_xfer_create(&ccfg, &ctrl) == ESP_OK);
+    const uac_stream_info_t ep82 = { .uac_version = 1, .ep_addr = 0x82 };
+    const uac_stream_info_t ep83 = { .uac_version = 1, .ep_addr = 0x83 };
+
+    CHECK(uac_set_sample_rate(ctrl, s_dev, &ep82, 192000, rate_cb, NULL) == ESP_OK);
+    drain();
+    CHECK(s_rate_done == 1 && s_rate_err == ESP_OK && s_rate_hz == 192000);
+    CHECK(mock_usb_ctrl_count(1) == 2);
+
+    // Device snaps 44.1 kHz to 48 kHz: the read-back catches it
+    CHECK(uac_set_sample_rate(ctrl, s_dev, &ep82, 44100, rate_cb, NULL) == ESP_OK);
+    drain();
+    CHECK(s_rate_done == 2 && s_rate_err == ESP_ERR_INVALID_RESPONSE && s_rate_hz == 48000);
+
+    CHECK(uac_get_sample_rate(ctrl, s_dev, &ep82, rate_cb, NULL) == ESP_OK);
+    drain();
+    CHECK(s_rate_done == 3 && s_rate_err == ESP_OK && s_rate_hz == 48000);
+
+    // Wrong endpoint: the device STALLs and the SET_CUR error is reported
+    CHECK(uac_set_sample_rate(ctrl, s_dev, &ep83, 8000, rate_cb, NULL) == ESP_OK);
+    drain();
+    CHECK(s_rate_done == 4 && s_rate_err == ESP_ERR_NOT_SUPPORTED && s_rate_hz == 0);
+    CHECK(s_set_count == 2);
+    CHECK(uac_set_sample_rate(ctrl, s_dev, &ep82, 0, rate_cb, NULL) == ESP_ERR_INVALID_ARG);
+    CHECK(ctrl_xfer_delete(ctrl) == ESP_OK);
+}
+
+/* ---------- UAC 2.0: clock entities, high-speed packet sizing ---------- */
+
+static mock_uac_t s_uac2;
+
+static void uac2_init(void)
+{
+    mock_uac_init(&s_uac2);
+    s_uac2.uac_version = 2;
+    s_uac2.speed = USB_SPEED_HIGH;
+    s_uac2.channels = 8;
+    s_uac2.subframe_size = 3;
+    s_uac2.bit_resolution = 24;
+    s_uac2.ep_mps = 1024;
+    s_uac2.ep_mult = 2;
+    s_uac2.freq_control = true;
+    const uint32_t rates[] = { 44100, 48000, 96000, 192000 };
+    memcpy(s_uac2.rates, rates, sizeof(rates));
+    s_uac2.num_rates = 4;
+}
+
+static void test_parse_uac2(void)
+{
+    uac2_init();
+    mock_uac_build_config(&s_uac2);
+    const usb_config_desc_t *cfg = (const usb_config_desc_t *)s_uac2.config_desc;
+    uac_stream_info_t info;
+    CHECK(uac_parse_stream(cfg, 1, 1, &info) == ESP_OK);
+    // The terminal's clock is behind a selector: the source is what gets programmed
+    CHECK(info.uac_version == 2 && info.ac_intf == 0 && info.clock_id == 0x10 && info.freq_control);
+    CHECK(info.channels == 8 && info.subframe_size == 3 && info.bit_resolution == 24);
+    CHECK(info.ep_addr == 0x81 && info.ep_mult == 2 && info.ep_mps == 2048 && info.ep_interval == 1);
+    CHECK(info.num_freqs == 0);
+
+    // Microframes once the caller says the device is high speed
+    info.high_speed = true;
+    CHECK(uac_interval_us(&info) == 125);
+    CHECK(uac_packet_bytes(&info, 192000) == 25 * 24);
+    CHECK(uac_packet_bytes(&info, 44100) == 7 * 24);
+    CHECK(uac_packet_bytes(&info, 384000) == 49 * 24);
+    CHECK(uac_packet_bytes(&info, 768000) == 0);        // needs a third transaction
+    info.ep_interval = 4;
+    CHECK(uac_interval_us(&info) == 1000 && uac_packet_bytes(&info, 48000) == 49 * 24);
+    info.high_speed = false;
+    info.ep_interval = 1;
+    CHECK(uac_interval_us(&info) == 1000);
+
+    // A fixed clock can be read but not set
+    s_uac2.freq_control = false;
+    mock_uac_build_config(&s_uac2);
+    CHECK(uac_parse_stream(cfg, 1, 1, &info) == ESP_OK && !info.freq_control);
+
+    // Selector pointing at a clock that isn't there
+    for (size_t i = 0; i + 5 < sizeof(s_uac2.config_desc); i++) {
+        if (s_uac2.config_desc[i + 1] == 0x24 && s_uac2.config_desc[i + 2] == 0x0B) {
+            s_uac2.config_desc[i + 5] = 0x42;
+            break;
+        }
+    }
+    CHECK(uac_parse_stream(cfg, 1, 1, &info) == ESP_ERR_NOT_SUPPORTED);
+}
+
+static void test_rate_control_uac2(void)
+{
+    mock_usb_host_reset();
+    const usb_host_client_config_t cfg = {
+        .async = { .client_event_callback = client_cb },
+    };
+    CHECK(usb_host_client_register(&cfg, &s_client) == ESP_OK);
+    uac2_init();
+    CHECK(mock_uac_connect(&s_uac2, NULL) != 0);
+    usb_host_client_handle_events(s_client, 0);
+
+    ctrl_xfer_t *ctrl;
+    const ctrl_xfer_config_t ccfg = { .client = s_client, .pool_size = 4, .max_data_len = 128 };
+    CHECK(ctrl_xfer_create(&ccfg, &ctrl) == ESP_OK);
+    uac_stream_info_t info;
+    CHECK(uac_parse_stream((const usb_config_desc_t *)s_uac2.config_desc, 1, 1, &info) == ESP_OK);
+
+    // GET RANGE: one discrete subrange per rate
+    CHECK(uac_read_rates(ctrl, s_dev, &info, NULL, NULL) == ESP_OK);
+    drain();
+    CHECK(info.num_freqs == 4 && !info.continuous && info.freqs[3] == 192000);
+    CHECK(uac_rate_supported(&info, 96000) && !uac_rate_supported(&info, 88200));
+
+    // 4-byte CUR on the clock source, read back
+    s_rate_done = 0;
+    CHECK(uac_set_sample_rate(ctrl, s_dev, &info, 192000, rate_cb, NULL) == ESP_OK);
+    drain();
+    CHECK(s_rate_done == 1 && s_rate_err == ESP_OK && s_rate_hz == 192000 && s_uac2.rate_hz == 192000);
+    CHECK(uac_set_sample_rate(ctrl, s_dev, &info, 50000, rate_cb, NULL) == ESP_OK);
+    drain();
+    CHECK(s_rate_done == 2 && s_rate_err == ESP_ERR_INVALID_RESPONSE && s_rate_hz == 48000);
+    CHECK(uac_get_sample_rate(ctrl, s_dev, &info, rate_cb, NULL) == ESP_OK);
+    drain();
+    CHECK(s_rate_done == 3 && s_rate_err == ESP_OK && s_rate_hz == 48000 && s_uac2.rate_sets == 2);
+    CHECK(ctrl_xfer_delete(ctrl) == ESP_OK);
+}
+
+int main(void)
+{
+    test_parse();
+    test_rate_control();
+    test_parse_uac2();
+    test_rate_control_uac2();
+    return test_report("uac");
+}
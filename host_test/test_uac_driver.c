@@ -0,0 +1,287 @@
+// test_uac_driver.c  (UAC streaming end to end: full- and high-speed ISO timing, formats, gaps)
+
+#include <string.h>
+#include "audio_stream.h"
+#include "class_driver.h"
+#include "dsp_kernels.h"
+#include "metrics.h"
+#include "mock_uac.h"
+#include "test_util.h"
+#include "uac_driver.h"
+
+#define RUN_MS      200
+
+/* What the subscribers saw */
+static struct {
+    unsigned bits;              /**< Device bit_resolution, to rebuild expected samples */
+    unsigned stream_channel;
+    bool have_first;
+    uint64_t p0;                /**< Timeline index of the first frame seen */
+    uint32_t q0;                /**< Its channel-0 sample */
+    uint64_t next_t0;           /**< Where the next block should start if nothing was lost */
+    uint64_t frames;
+    uint64_t gap_frames;
+    int blocks;
+    int mismatches;
+    uint64_t last_block_us;
+    uint64_t block_period_us;   /**< Bus time between the last two blocks */
+    size_t last_nframes;
+    uint64_t s16_t0;
+    size_t s16_n;
+    int s16_mismatches;
+} s_seen;
+
+static int32_t s_last_q31[8 * 8192];
+
+static void frames_cb(const int32_t *frames, size_t nframes, size_t channels, uint64_t t0, void *ctx)
+{
+    (void)ctx;
+    if (!s_seen.have_first) {
+        s_seen.have_first = true;
+        s_seen.p0 = t0;
+        s_seen.q0 = (uint32_t)frames[0];
+        s_seen.next_t0 = t0;
+    }
+    const unsigned shift = 32 - s_seen.bits;
+    for (size_t i = 0; i < nframes; i++) {
+        for (size_t c = 0; c < channels; c++) {
+            const uint32_t want = s_seen.q0 + (((uint32_t)(t0 + i - s_seen.p0) * MOCK_UAC_FRAME_STEP +
+                                                (uint32_t)c * MOCK_UAC_CHANNEL_STEP) << shift);
+            s_seen.mismatches += (uint32_t)frames[i * channels + c] != want;
+        }
+    }
+    CHECK(t0 >= s_seen.next_t0);
+    s_seen.gap_frames += t0 - s_seen.next_t0;
+    s_seen.next_t0 = t0 + nframes;
+    s_seen.frames += nframes;
+    s_seen.blocks++;
+    const uint64_t now = mock_usb_now_us();
+    s_seen.block_period_us = now - s_seen.last_block_us;
+    s_seen.last_block_us = now;
+    s_seen.last_nframes = nframes;
+
+    // Keep the stream channel for the int16 subscriber to compare against
+    const size_t ch = s_seen.stream_channel < channels ? s_seen.stream_channel : channels - 1;
+    for (size_t i = 0; i < nframes && i < sizeof(s_last_q31) / sizeof(s_last_q31[0]); i++) {
+        s_last_q31[i] = frames[i * channels + ch];
+    }
+}
+
+static void block_cb(const int16_t *samples, size_t n, uint64_t t0, void *ctx)
+{
+    (void)ctx;
+    int16_t want[8192];
+    CHECK(n <= sizeof(want) / sizeof(want[0]));
+    dsp_q31_to_s16_ref(want, s_last_q31, 1, n);
+    s_seen.s16_mismatches += memcmp(want, samples, n * sizeof(int16_t)) != 0;
+    s_seen.s16_t0 = t0;
+    s_seen.s16_n = n;
+}
+
+static void run_until_ms(uint64_t ms)
+{
+    while (mock_usb_now_ms() < ms) {
+        class_driver_handle_events(CLASS_DRIVER_POLL_MS);
+    }
+}
+
+static void shutdown(void)
+{
+    class_driver_client_deregister();
+    int passes = 0;
+    while (class_driver_handle_events(0) && passes < 10) {
+        passes++;
+    }
+    CHECK(passes < 10);
+    CHECK(class_driver_uninstall() == ESP_OK);
+}
+
+static void stream(mock_uac_t *m)
+{
+    memset(&s_seen, 0, sizeof(s_seen));
+    s_seen.bits = m->bit_resolution;
+    s_seen.stream_channel = CONFIG_APP_STREAM_CHANNEL;
+    mock_usb_host_reset();
+    CHECK(class_driver_install() == ESP_OK);
+    CHECK(mock_uac_connect(m, NULL) != 0);
+    run_until_ms(RUN_MS);
+}
+
+static void test_full_speed_uac1(void)
+{
+    mock_uac_t m;
+    mock_uac_init(&m);
+    m.channels = 2;
+    m.ep_mps = 2 * 2 * 49;
+    m.freq_control = true;
+    m.rates[0] = 32000;
+    m.rates[1] = 44100;
+    m.num_rates = 2;
+    m.rate_hz = 32000;
+    stream(&m);
+
+    // Rate control on the endpoint; 44.1 kHz packets alternate 44 and 45 frames
+    CHECK(m.rate_hz == 44100 && audio_stream_sample_rate() == 44100);
+    CHECK(s_seen.blocks > 5 && s_seen.mismatches == 0 && s_seen.gap_frames == 0);
+    CHECK(s_seen.block_period_us == 16000);
+    CHECK(s_seen.last_nframes == 705 || s_seen.last_nframes == 706);
+    CHECK(s_seen.s16_mismatches == 0 && s_seen.s16_n == s_seen.last_nframes);
+    shutdown();
+}
+
+static void test_high_speed_uac2(void)
+{
+    mock_uac_t m;
+    mock_uac_init(&m);
+    m.uac_version = 2;
+    m.speed = USB_SPEED_HIGH;
+    m.channels = 8;
+    m.subframe_size = 3;
+    m.bit_resolution = 24;
+    m.ep_mps = 1024;
+    m.ep_mult = 2;
+    m.freq_control = true;
+    m.rates[0] = 96000;
+    m.rates[1] = 384000;
+    m.num_rates = 2;
+    m.rate_hz = 96000;
+    stream(&m);
+
+    // Clock source programmed; one packet per microframe, 128 per 16 ms URB
+    CHECK(m.rate_hz == 384000 && m.rate_sets == 1);
+    CHECK(s_seen.blocks > 5 && s_seen.mismatches == 0 && s_seen.gap_frames == 0);
+    CHECK(s_seen.block_period_us == 16000 && s_seen.last_nframes == 384 * 16);
+    CHECK(m.packets % 128 == 0);
+    CHECK(s_seen.s16_mismatches == 0);
+
+    // Nothing fell through the cracks between URBs: every frame sent arrived
+    // or is still in a URB in flight (at most three URBs' worth)
+    CHECK(m.frames_sent - s_seen.frames <= 3 * 384 * 16);
+    shutdown();
+}
+
+static void test_lost_packets_leave_gaps(void)
+{
+    mock_uac_t m;
+    mock_uac_init(&m);
+    m.uac_version = 2;
+    m.speed = USB_SPEED_HIGH;
+    m.channels = 1;
+    m.subframe_size = 4;
+    m.bit_resolution = 32;
+    m.ep_mps = 512;
+    m.ep_interval = 2;          // every other microframe
+    m.rates[0] = 192000;
+    m.rate_hz = 192000;
+    m.lose_every = 100;
+    stream(&m);
+
+    // Fixed clock: read, not set; 250 us packets of 48 frames, 64 per URB
+    CHECK(m.rate_sets == 0 && audio_stream_sample_rate() == 192000);
+    CHECK(s_seen.mismatches == 0);
+    // Each lost packet is exactly one packet's frames of timeline
+    const uint64_t lost = m.packets / 100;
+    CHECK(lost > 0 && s_seen.gap_frames > 0 && s_seen.gap_frames % 48 == 0 && s_seen.gap_frames / 48 <= lost);
+    uac_driver_stats_t st;
+    uac_driver_take_stats(&st);
+    CHECK(st.lost == s_seen.gap_frames / 48 && st.rate_hz == 192000);
+    shutdown();
+}
+
+static void test_fast_device_clock(void)
+{
+    mock_uac_t m;
+    mock_uac_init(&m);
+    m.ep_mps = 2 * 50;
+    m.clock_ppm = 2000;
+    stream(&m);
+
+    // 48.096 frames per ms: about every tenth packet carries 49 frames, which
+    // fit the request, so nothing is truncated or skipped
+    CHECK(m.frames_sent > (uint64_t)m.packets * 48);
+    CHECK(s_seen.blocks > 5 && s_seen.mismatches == 0 && s_seen.gap_frames == 0);
+    CHECK(m.frames_sent - s_seen.frames <= 3 * 49 * 16);
+    uac_driver_stats_t st;
+    uac_driver_take_stats(&st);
+    CHECK(st.lost == 0 && st.short_packets == 0);
+    shutdown();
+}
+
+static void test_unsupported_alts(void)
+{
+    // 16 channels is past CONFIG_APP_MAX_CHANNELS: the wider alt 2 is
+    // skipped and the device streams on alt 1
+    mock_uac_t m;
+    mock_uac_init(&m);
+    m.alt2_channels = 16;
+    m.alt2_ep_mps = 1023;
+    stream(&m);
+    CHECK(m.alt == 1 && audio_stream_sample_rate() == 48000);
+    CHECK(s_seen.blocks > 5 && s_seen.mismatches == 0 && s_seen.gap_frames == 0);
+    shutdown();
+
+    // Alt 1 is more than a full-speed frame holds; the 16-channel fallback
+    // that would fit is never offered, so nothing streams
+    mock_uac_init(&m);
+    m.rates[0] = 8000;
+    m.rate_hz = 8000;
+    m.ep_mps = 1500;
+    m.alt2_channels = 16;
+    m.alt2_ep_mps = 16 * 2 * 9;
+    stream(&m);
+    CHECK(m.alt == 0 && s_seen.blocks == 0 && !uac_driver_active());
+    shutdown();
+}
+
+static uint32_t stop_fails(void)
+{
+    metrics_id_t id;
+    metrics_value_t v;
+    CHECK(metrics_register(METRICS_COUNTER, "uac.stop_fail", &id) == ESP_OK);
+    CHECK(metrics_read(id, &v) == ESP_OK);
+    return v.count;
+}
+
+static void test_rate_switch_flush_refused(void)
+{
+    mock_uac_t m;
+    mock_uac_init(&m);
+    m.ep_mps = 2 * 97;
+    m.freq_control = true;
+    m.rates[0] = 48000;
+    m.rates[1] = 96000;
+    m.num_rates = 2;
+    stream(&m);
+    CHECK(m.rate_hz == 96000);
+
+    // The URBs still in flight come back on their own and the switch goes on
+    const mock_usb_faults_t faults = { .flush_fail = true };
+    mock_usb_set_faults(&faults);
+    const uint32_t fails_before = stop_fails();
+    uac_driver_request_rate(48000);
+    run_until_ms(2 * RUN_MS);
+    CHECK(stop_fails() - fails_before == 1);
+    CHECK(m.rate_hz == 48000 && audio_stream_sample_rate() == 48000);
+    const int blocks = s_seen.blocks;
+    run_until_ms(3 * RUN_MS);
+    CHECK(s_seen.blocks > blocks);
+    mock_usb_set_faults(NULL);
+    shutdown();
+}
+
+int main(void)
+{
+    const uac_driver_config_t cfg = { .sample_rate_hz = 384000 };
+    CHECK(uac_driver_register(&cfg) == ESP_OK);
+    CHECK(audio_stream_subscribe_frames(frames_cb, NULL) == ESP_OK);
+    CHECK(audio_stream_subscribe(block_cb, NULL) == ESP_OK);
+
+    test_high_speed_uac2();
+    test_lost_packets_leave_gaps();
+    test_fast_device_clock();
+    test_rate_switch_flush_refused();
+    test_unsupported_alts();
+    // UAC 1.0 at 44.1 kHz: the closest the device has to the 384 kHz asked for
+    test_full_speed_uac1();
+    return test_report("uac_driver");
+}
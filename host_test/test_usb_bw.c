@@ -0,0 +1,157 @@
+// test_usb_bw.c  (periodic bandwidth admission: costs, phases, domains, array planning)
+
+#include "usb_bw.h"
+#include "test_util.h"
+
+static const usb_bw_ep_t HS_3X1024 = { .speed = USB_SPEED_HIGH, .bytes = 3072, .mult = 3, .interval = 1 };
+static const usb_bw_ep_t HS_2X1024 = { .speed = USB_SPEED_HIGH, .bytes = 2048, .mult = 2, .interval = 1 };
+static const usb_bw_ep_t HS_1024 = { .speed = USB_SPEED_HIGH, .bytes = 1024, .mult = 1, .interval = 1 };
+static const usb_bw_ep_t HS_512 = { .speed = USB_SPEED_HIGH, .bytes = 512, .mult = 1, .interval = 1 };
+
+static void test_cost(void)
+{
+    // Overhead per transaction plus 7/6 of the payload, rounded up
+    CHECK(usb_bw_cost(&HS_2X1024) == 2 * 38 + 2390);
+    CHECK(usb_bw_cost(&HS_3X1024) == 3 * 38 + 3584);
+    const usb_bw_ep_t fs = { .speed = USB_SPEED_FULL, .bytes = 196, .mult = 1, .interval = 1 };
+    CHECK(usb_bw_cost(&fs) == 9 + 229);
+    const usb_bw_ep_t ls = { .speed = USB_SPEED_LOW, .bytes = 8, .mult = 1, .interval = 1 };
+    CHECK(usb_bw_cost(&ls) == 8 * (9 + 10));
+}
+
+static void test_phases(void)
+{
+    usb_bw_t *bw;
+    CHECK(usb_bw_create(&bw) == ESP_OK);
+    // Two 3 x 1024 endpoints can't share a microframe...
+    CHECK(usb_bw_reserve(bw, 1, 0x81, &HS_3X1024) == ESP_OK);
+    CHECK(usb_bw_reserve(bw, 2, 0x81, &HS_3X1024) == ESP_ERR_NO_MEM);
+    CHECK(usb_bw_release(bw, 1, 0x81) == ESP_OK);
+
+    // ...but every other microframe they interleave
+    usb_bw_ep_t every2 = HS_3X1024;
+    every2.interval = 2;
+    CHECK(usb_bw_reserve(bw, 1, 0x81, &every2) == ESP_OK);
+    CHECK(usb_bw_reserve(bw, 2, 0x81, &every2) == ESP_OK);
+    const usb_bw_resv_t *r;
+    CHECK(usb_bw_reservations(bw, &r) == 2);
+    CHECK(r[0].phase == 0 && r[1].phase == 1 && r[1].period == 2);
+    uint32_t budget;
+    CHECK(usb_bw_peak(bw, &every2, &budget) == 3698 && budget == USB_BW_HS_BUDGET);
+    // A third fits nowhere
+    CHECK(usb_bw_reserve(bw, 3, 0x81, &every2) == ESP_ERR_NO_MEM);
+
+    // Intervals beyond the schedule period are charged every 32 microframes
+    usb_bw_ep_t slow = HS_1024;
+    slow.interval = 16;
+    CHECK(usb_bw_reserve(bw, 3, 0x81, &slow) == ESP_OK);
+    CHECK(usb_bw_reservations(bw, &r) == 3 && r[2].period == USB_BW_SLOTS);
+
+    CHECK(usb_bw_reserve(bw, 3, 0x81, &slow) == ESP_ERR_INVALID_STATE);
+    CHECK(usb_bw_release(bw, 9, 0x81) == ESP_ERR_NOT_FOUND);
+    usb_bw_release_device(bw, 2);
+    CHECK(usb_bw_reservations(bw, &r) == 2 && r[0].dev_addr == 1 && r[1].dev_addr == 3);
+    usb_bw_log(bw);
+    usb_bw_delete(bw);
+}
+
+static void test_domains(void)
+{
+    usb_bw_t *bw;
+    CHECK(usb_bw_create(&bw) == ESP_OK);
+    usb_bw_ep_t tt5 = { .speed = USB_SPEED_FULL, .tt_hub = 5, .bytes = 196, .mult = 1, .interval = 1 };
+    usb_bw_ep_t tt6 = tt5;
+    tt6.tt_hub = 6;
+    usb_bw_ep_t root = tt5;
+    root.tt_hub = 0;
+
+    // 238 byte times each: four per TT frame, five on a full-speed root port
+    for (uint8_t a = 1; a <= 4; a++) {
+        CHECK(usb_bw_reserve(bw, a, 0x81, &tt5) == ESP_OK);
+    }
+    CHECK(usb_bw_reserve(bw, 5, 0x81, &tt5) == ESP_ERR_NO_MEM);
+    CHECK(usb_bw_reserve(bw, 5, 0x81, &tt6) == ESP_OK);
+    for (uint8_t a = 10; a < 15; a++) {
+        CHECK(usb_bw_reserve(bw, a, 0x81, &root) == ESP_OK);
+    }
+    CHECK(usb_bw_reserve(bw, 15, 0x81, &root) == ESP_ERR_NO_MEM);
+    uint32_t budget;
+    CHECK(usb_bw_peak(bw, &tt5, &budget) == 4 * 238 && budget == USB_BW_TT_BUDGET);
+    CHECK(usb_bw_peak(bw, &tt6, NULL) == 238);
+    CHECK(usb_bw_peak(bw, &root, &budget) == 5 * 238 && budget == USB_BW_FS_BUDGET);
+    CHECK(usb_bw_peak(bw, &HS_512, NULL) == 0);
+    usb_bw_log(bw);
+
+    // One host channel each: 10 held, 6 left
+    for (uint8_t ep = 1; ep <= 6; ep++) {
+        CHECK(usb_bw_reserve(bw, 20, 0x80 | ep, &HS_512) == ESP_OK);
+    }
+    CHECK(usb_bw_reserve(bw, 20, 0x87, &HS_512) == ESP_ERR_NO_MEM);
+    usb_bw_delete(bw);
+}
+
+static void test_plan_array(void)
+{
+    usb_bw_t *bw;
+    CHECK(usb_bw_create(&bw) == ESP_OK);
+    // Four high-speed 8-channel mics, each with three alt settings
+    const usb_bw_ep_t alts[] = { HS_2X1024, HS_1024, HS_512 };
+    usb_bw_request_t reqs[4];
+    for (uint8_t i = 0; i < 4; i++) {
+        reqs[i] = (usb_bw_request_t) {
+            .dev_addr = (uint8_t)(i + 1), .ep_addr = 0x81, .options = alts, .num_options = 3,
+        };
+    }
+    int choice[4];
+    // Everyone gets in at 636; what's left upgrades the first mics first
+    CHECK(usb_bw_plan(bw, reqs, 4, choice) == ESP_OK);
+    CHECK(choice[0] == 0 && choice[1] == 1 && choice[2] == 1 && choice[3] == 2);
+    CHECK(usb_bw_peak(bw, &HS_512, NULL) == 2466 + 1233 + 1233 + 636);
+    usb_bw_log(bw);
+
+    // The same requests give the same plan
+    for (uint8_t i = 1; i <= 4; i++) {
+        usb_bw_release_device(bw, i);
+    }
+    int again[4];
+    CHECK(usb_bw_plan(bw, reqs, 4, again) == ESP_OK);
+    for (int i = 0; i < 4; i++) {
+        CHECK(again[i] == choice[i]);
+    }
+    usb_bw_delete(bw);
+}
+
+static void test_plan_refuses_in_order(void)
+{
+    usb_bw_t *bw;
+    CHECK(usb_bw_create(&bw) == ESP_OK);
+    usb_bw_request_t reqs[5];
+    for (uint8_t i = 0; i < 5; i++) {
+        reqs[i] = (usb_bw_request_t) {
+            .dev_addr = (uint8_t)(i + 1), .ep_addr = 0x81, .options = &HS_2X1024, .num_options = 1,
+        };
+    }
+    int choice[5];
+    CHECK(usb_bw_plan(bw, reqs, 5, choice) == ESP_ERR_NO_MEM);
+    CHECK(choice[0] == 0 && choice[1] == 0 && choice[2] == -1 && choice[3] == -1 && choice[4] == -1);
+
+    // A device leaves: the next refused one gets in
+    usb_bw_release_device(bw, 2);
+    CHECK(usb_bw_plan(bw, reqs + 2, 3, choice) == ESP_ERR_NO_MEM);
+    CHECK(choice[0] == 0 && choice[1] == -1 && choice[2] == -1);
+
+    // No options at all is a refusal, not an error
+    const usb_bw_request_t none = { .dev_addr = 9, .ep_addr = 0x81 };
+    CHECK(usb_bw_plan(bw, &none, 1, choice) == ESP_ERR_NO_MEM && choice[0] == -1);
+    usb_bw_delete(bw);
+}
+
+int main(void)
+{
+    test_cost();
+    test_phases();
+    test_domains();
+    test_plan_array();
+    test_plan_refuses_in_order();
+    return test_report("usb_bw");
+}
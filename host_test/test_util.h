@@ -0,0 +1,20 @@
+// test_util.h  (minimal CHECK macro shared by the host tests)
+
+#pragma once
+
+#include <stdio.h>
+
+static int s_test_failures;
+
+#define CHECK(cond) do {                                                    \
+        if (!(cond)) {                                                      \
+            printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            s_test_failures++;                                              \
+        }                                                                   \
+    } while (0)
+
+static inline int test_report(const char *suite)
+{
+    printf("%s: %s (%d failures)\n", suite, s_test_failures ? "FAIL" : "PASS", s_test_failures);
+    return s_test_failures ? 1 : 0;
+}
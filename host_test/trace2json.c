@@ -0,0 +1,60 @@
+// trace2json.c  (convert a trace dump to Chrome trace JSON)
+//
+// usage: trace2json [dump|log|-] > trace.json
+//
+// The input is a binary dump (trace.bin from the SD card) or a console log
+// holding "TRACE:" hex lines. Open the output in chrome://tracing or
+// ui.perfetto.dev: one track per core, times on the esp_timer timeline.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace_decode.h"
+
+int main(int argc, char **argv)
+{
+    FILE *in = stdin;
+    if (argc > 1 && strcmp(argv[1], "-") != 0) {
+        in = fopen(argv[1], "rb");
+        if (in == NULL) {
+            perror(argv[1]);
+            return 1;
+        }
+    }
+    size_t len = 0, cap = 1 << 16;
+    char *data = malloc(cap);
+    size_t n;
+    while (data && (n = fread(data + len, 1, cap - len, in)) > 0) {
+        len += n;
+        if (len == cap) {
+            cap *= 2;
+            char *grown = realloc(data, cap);
+            if (grown == NULL) {
+                free(data);
+            }
+            data = grown;
+        }
+    }
+    static trace_snapshot_t snap;
+    static uint8_t dump[TRACE_HEADER_LEN + TRACE_CORES * (TRACE_CORE_HEADER_LEN + TRACE_RING_EVENTS * TRACE_EVENT_LEN)];
+    if (data == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    esp_err_t err;
+    if (len >= 4 && memcmp(data, TRACE_MAGIC, 4) == 0) {
+        err = trace_decode((const uint8_t *)data, len, &snap);
+    } else {
+        const size_t dump_len = trace_unhex_log(data, len, dump, sizeof(dump));
+        err = dump_len ? trace_decode(dump, dump_len, &snap) : ESP_ERR_NOT_FOUND;
+    }
+    free(data);
+    if (err != ESP_OK) {
+        fprintf(stderr, "no usable trace dump in the input (%s)\n",
+                err == ESP_ERR_NOT_FOUND ? "no complete TRACE: begin .. end block" : "bad dump");
+        return 1;
+    }
+    trace_write_json(&snap, stdout);
+    fprintf(stderr, "%u Hz, %zu + %zu events\n", (unsigned)snap.cpu_hz, snap.core[0].count, snap.core[1].count);
+    return 0;
+}
@@ -0,0 +1,163 @@
+// trace_decode.c  (host side of trace.h: read a dump, place events in time, write Chrome trace JSON)
+
+#include <string.h>
+#include "trace_decode.h"
+
+static uint64_t get_le(const uint8_t *p, size_t n)
+{
+    uint64_t v = 0;
+    for (size_t i = 0; i < n; i++) {
+        v |= (uint64_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+esp_err_t trace_decode(const uint8_t *buf, size_t len, trace_snapshot_t *out)
+{
+    if (len < TRACE_HEADER_LEN) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (memcmp(buf, TRACE_MAGIC, 4) != 0 || buf[4] != TRACE_CORES || buf[5] != TRACE_EVENT_LEN) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    memset(out, 0, sizeof(*out));
+    out->cpu_hz = (uint32_t)get_le(buf + 8, 4);
+    const uint8_t *p = buf + TRACE_HEADER_LEN;
+    const uint8_t *end = buf + len;
+    for (unsigned c = 0; c < TRACE_CORES; c++) {
+        if (end - p < TRACE_CORE_HEADER_LEN) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        out->core[c].anchor_cycles = (uint32_t)get_le(p, 4);
+        out->core[c].anchor_us = get_le(p + 4, 8);
+        const size_t count = (size_t)get_le(p + 12, 4);
+        p += TRACE_CORE_HEADER_LEN;
+        if (count > TRACE_RING_EVENTS || (size_t)(end - p) < count * TRACE_EVENT_LEN) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        for (size_t i = 0; i < count; i++, p += TRACE_EVENT_LEN) {
+            trace_event_t *e = &out->core[c].events[i];
+            e->cycles = (uint32_t)get_le(p, 4);
+            e->event = p[4];
+            e->phase = p[5];
+            e->arg = (uint16_t)get_le(p + 6, 2);
+        }
+        out->core[c].count = count;
+    }
+    return ESP_OK;
+}
+
+static int hex_digit(char c)
+{
+    return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+}
+
+/* Text after TRACE_LOG_PREFIX on this line, which may follow a log header
+ * or a serial monitor's own decoration; NULL if it isn't a trace line */
+static const char *trace_line(const char *line, const char *eol)
+{
+    const size_t prefix = strlen(TRACE_LOG_PREFIX);
+    for (const char *s = line; s + prefix <= eol; s++) {
+        if (memcmp(s, TRACE_LOG_PREFIX, prefix) == 0) {
+            return s + prefix;
+        }
+    }
+    return NULL;
+}
+
+static bool is_word(const char *s, const char *eol, const char *word)
+{
+    const size_t n = strlen(word);
+    return (size_t)(eol - s) >= n && memcmp(s, word, n) == 0;
+}
+
+size_t trace_unhex_log(const char *log, size_t log_len, uint8_t *out, size_t out_size)
+{
+    const char *end = log + log_len;
+    // Find the last begin .. end pair first: a dump cut short by a reset
+    // mustn't overwrite a complete one before it
+    const char *open = NULL, *from = NULL, *to = NULL;
+    for (const char *line = log; line < end;) {
+        const char *nl = memchr(line, '\n', (size_t)(end - line));
+        const char *eol = nl ? nl : end;
+        const char *tag = trace_line(line, eol);
+        if (tag && is_word(tag, eol, "begin")) {
+            open = eol;
+        } else if (tag && is_word(tag, eol, "end") && open) {
+            from = open;
+            to = line;
+            open = NULL;
+        }
+        line = eol + 1;
+    }
+    size_t len = 0;
+    for (const char *line = from; line && line < to;) {
+        const char *nl = memchr(line, '\n', (size_t)(to - line));
+        const char *eol = nl ? nl : to;
+        const char *tag = trace_line(line, eol);
+        for (const char *s = tag; s && s + 1 < eol; s += 2) {
+            const int hi = hex_digit(s[0]), lo = hex_digit(s[1]);
+            if (hi < 0 || lo < 0) {
+                break;      // '\r' or anything else ends the line's data
+            }
+            if (len == out_size) {
+                return 0;
+            }
+            out[len++] = (uint8_t)(hi << 4 | lo);
+        }
+        line = eol + 1;
+    }
+    return len;
+}
+
+void trace_event_times(const trace_snapshot_t *snap, unsigned core, double ts_us[TRACE_RING_EVENTS])
+{
+    const size_t n = snap->core[core].count;
+    if (n == 0) {
+        return;
+    }
+    const trace_event_t *e = snap->core[core].events;
+    const double us_per_cycle = 1e6 / snap->cpu_hz;
+    // The anchor was taken after every event; between events allow for an
+    // ISR that claimed its slot first but read the clock second
+    ts_us[n - 1] = (double)snap->core[core].anchor_us -
+                   (double)(uint32_t)(snap->core[core].anchor_cycles - e[n - 1].cycles) * us_per_cycle;
+    for (size_t i = n - 1; i > 0; i--) {
+        ts_us[i - 1] = ts_us[i] - (double)(int32_t)(e[i].cycles - e[i - 1].cycles) * us_per_cycle;
+    }
+}
+
+void trace_write_json(const trace_snapshot_t *snap, FILE *out)
+{
+    static double ts[TRACE_RING_EVENTS];
+    static const char phase[] = { [TRACE_PHASE_BEGIN] = 'B', [TRACE_PHASE_END] = 'E', [TRACE_PHASE_INSTANT] = 'i' };
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (unsigned c = 0; c < TRACE_CORES; c++) {
+        fprintf(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"core %u\"}},\n",
+                c, c);
+    }
+    bool first = true;
+    for (unsigned c = 0; c < TRACE_CORES; c++) {
+        trace_event_times(snap, c, ts);
+        unsigned depth[TRACE_EVENT_COUNT] = {0};
+        for (size_t i = 0; i < snap->core[c].count; i++) {
+            const trace_event_t *e = &snap->core[c].events[i];
+            if (e->event >= TRACE_EVENT_COUNT || e->phase > TRACE_PHASE_INSTANT) {
+                continue;
+            }
+            if (e->phase == TRACE_PHASE_END) {
+                if (depth[e->event] == 0) {
+                    continue;   // began before the oldest event kept
+                }
+                depth[e->event]--;
+            } else if (e->phase == TRACE_PHASE_BEGIN) {
+                depth[e->event]++;
+            }
+            fprintf(out, "%s{\"name\":\"%s\",\"ph\":\"%c\",%s\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"arg\":%u}}",
+                    first ? "" : ",\n", trace_event_name(e->event), phase[e->phase],
+                    e->phase == TRACE_PHASE_INSTANT ? "\"s\":\"t\"," : "", ts[i], c, (unsigned)e->arg);
+            first = false;
+        }
+    }
+    fprintf(out, "\n]}\n");
+}
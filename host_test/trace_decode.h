@@ -0,0 +1,40 @@
+// trace_decode.h  (host side of trace.h: read a dump, place events in time, write Chrome trace JSON)
+//
+// A dump arrives either as the raw bytes (a file from the SD card) or as a
+// console log with the hex lines of trace_dump_hex(). Other lines are
+// ignored; of several dumps in one log the last complete one is used.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "trace.h"
+
+/**
+ * @brief Parse a binary dump back into a snapshot
+ *
+ * @return ESP_ERR_INVALID_VERSION for a different magic or layout,
+ *         ESP_ERR_INVALID_SIZE if it's truncated or a core has too many events
+ */
+esp_err_t trace_decode(const uint8_t *buf, size_t len, trace_snapshot_t *out);
+
+/**
+ * @brief Extract the last hex dump from a console log into `out`
+ *
+ * @return Bytes written, 0 if the log has no complete dump
+ */
+size_t trace_unhex_log(const char *log, size_t log_len, uint8_t *out, size_t out_size);
+
+/**
+ * @brief esp_timer time in us of every event of one core, oldest first
+ */
+void trace_event_times(const trace_snapshot_t *snap, unsigned core, double ts_us[TRACE_RING_EVENTS]);
+
+/**
+ * @brief Write the snapshot as Chrome trace JSON, one thread per core
+ *
+ * Ends whose begin the ring had already overwritten are left out.
+ */
+void trace_write_json(const trace_snapshot_t *snap, FILE *out);
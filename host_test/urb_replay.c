@@ -0,0 +1,113 @@
+// urb_replay.c  (play a URB capture through uac_driver and the level meter on the PC)
+//
+// usage: urb_replay capture.bin [--realtime]
+//
+// The capture (urb_capture.h; /sdcard/urbNNNN.bin with
+// CONFIG_APP_URB_CAPTURE) enumerates as a device on the mock USB host and
+// uac_driver streams from it as it did in the field, publishing to
+// audio_stream with the level meter subscribed. Runs as fast as it goes
+// unless --realtime paces every URB to its capture time. Prints the
+// per-minute levels, the driver's counters and how long it took.
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "audio_stream.h"
+#include "class_driver.h"
+#include "level_meter.h"
+#include "mock_replay.h"
+#include "uac_driver.h"
+
+#define DRAIN_MS    64      // after the capture runs out: the URBs in flight come back
+
+static uint64_t s_frames;
+
+static uint64_t wall_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static void sleep_until_us(uint64_t t)
+{
+    const uint64_t now = wall_us();
+    if (t > now) {
+        const struct timespec ts = { .tv_sec = (time_t)((t - now) / 1000000u),
+                                     .tv_nsec = (long)((t - now) % 1000000u * 1000u) };
+        nanosleep(&ts, NULL);
+    }
+}
+
+static void frames_cb(const int32_t *frames, size_t nframes, size_t channels, uint64_t t0, void *ctx)
+{
+    s_frames += nframes;
+}
+
+static void level_cb(level_meter_period_t period, const level_summary_t *s, void *ctx)
+{
+    if (period == LEVEL_METER_MINUTE) {
+        printf("minute @%llu: rms=%.1f peak=%.1f dBFS clip=%u dc=%.1f samples=%u\n", (unsigned long long)s->t0,
+               s->rms_dbfs, s->peak_dbfs, (unsigned)s->clip_count, s->dc, (unsigned)s->samples);
+    }
+}
+
+static void rate_cb(uint32_t sample_rate_hz, void *ctx)
+{
+    level_meter_set_sample_rate(ctx, sample_rate_hz);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s capture.bin [--realtime]\n", argv[0]);
+        return 2;
+    }
+    const bool realtime = argc > 2 && strcmp(argv[2], "--realtime") == 0;
+    static mock_replay_t r;
+    const esp_err_t err = mock_replay_open(&r, argv[1]);
+    if (err != ESP_OK) {
+        fprintf(stderr, "%s: %s\n", argv[1], err == ESP_ERR_NOT_FOUND ? "can't open it" : "not a URB capture");
+        return 1;
+    }
+    printf("device %04x:%04x, %s speed, EP 0x%02x at %u Hz\n", r.vid, r.pid,
+           r.speed == USB_SPEED_HIGH ? "high" : "full", r.ep, (unsigned)r.rate_hz);
+
+    const uac_driver_config_t cfg = { .sample_rate_hz = r.rate_hz };
+    const level_meter_config_t meter_cfg = { .sample_rate_hz = r.rate_hz };
+    level_meter_t *meter;
+    if (uac_driver_register(&cfg) != ESP_OK || level_meter_create(&meter_cfg, &meter) != ESP_OK ||
+            level_meter_subscribe(meter, level_cb, NULL) != ESP_OK ||
+            audio_stream_on_rate_change(rate_cb, meter) != ESP_OK ||
+            audio_stream_subscribe(level_meter_stream_cb, meter) != ESP_OK ||
+            audio_stream_subscribe_frames(frames_cb, NULL) != ESP_OK ||
+            class_driver_install() != ESP_OK || mock_replay_connect(&r) == 0) {
+        fprintf(stderr, "pipeline setup failed\n");
+        return 1;
+    }
+
+    const uint64_t start = wall_us();
+    while (!r.done) {
+        class_driver_handle_events(CLASS_DRIVER_POLL_MS);
+        if (realtime) {
+            sleep_until_us(start + mock_replay_due_us(&r));
+        }
+    }
+    const uint64_t end_ms = mock_usb_now_ms() + DRAIN_MS;
+    while (mock_usb_now_ms() < end_ms) {
+        class_driver_handle_events(CLASS_DRIVER_POLL_MS);
+    }
+    const double wall_s = (double)(wall_us() - start) / 1e6;
+    const double audio_s = (double)mock_replay_due_us(&r) / 1e6;
+
+    uac_driver_stats_t st;
+    uac_driver_take_stats(&st);
+    printf("%llu URBs, %llu packets (%llu failed, %u gaps), %llu frames at %u Hz\n",
+           (unsigned long long)r.urbs, (unsigned long long)r.packets, (unsigned long long)r.errors,
+           (unsigned)r.gaps, (unsigned long long)s_frames, (unsigned)st.rate_hz);
+    printf("driver: %u packets, %u bytes, %u lost (the trailing URBs' empty packets included)\n",
+           (unsigned)st.packets, (unsigned)st.bytes, (unsigned)st.lost);
+    printf("%.3f s of capture in %.3f s (%.1fx)\n", audio_s, wall_s, wall_s > 0 ? audio_s / wall_s : 0.0);
+    mock_replay_close(&r);
+    return 0;
+}
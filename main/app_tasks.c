@@ -0,0 +1,143 @@
+// app_tasks.c  (task topology and the profiling task)
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "app_tasks.h"
+#include "task_profile.h"
+
+static const char *TAG = "TASKS";
+
+#define STACK_LOW_BYTES     512     // flagged in the profile: too close to an overflow
+#define PROFILE_STACK       (CONFIG_APP_TASK_TELEMETRY_STACK + 1024)   // printf of the task table
+
+typedef struct {
+    const char *name;
+    int core;                   /**< -1: either core */
+    UBaseType_t priority;
+    uint32_t stack;             /**< Bytes */
+    bool ingest;
+} app_task_spec_t;
+
+static const app_task_spec_t s_tasks[APP_TASK_COUNT] = {
+    [APP_TASK_USB_DAEMON] = { "usb_daemon", CONFIG_APP_TASK_USB_DAEMON_CORE, CONFIG_APP_TASK_USB_DAEMON_PRIO,
+                              CONFIG_APP_TASK_USB_DAEMON_STACK, true },
+    [APP_TASK_USB_CLIENT] = { "usb_client", CONFIG_APP_TASK_USB_CLIENT_CORE, CONFIG_APP_TASK_USB_CLIENT_PRIO,
+                              CONFIG_APP_TASK_USB_CLIENT_STACK, true },
+    [APP_TASK_CAPTURE] = { "urb_capture", CONFIG_APP_TASK_STORAGE_CORE, CONFIG_APP_TASK_STORAGE_PRIO,
+                           CONFIG_APP_TASK_STORAGE_STACK, false },
+    [APP_TASK_WATCHDOG] = { "stream_wd", CONFIG_APP_TASK_WATCHDOG_CORE, CONFIG_APP_TASK_WATCHDOG_PRIO,
+                            CONFIG_APP_TASK_WATCHDOG_STACK, false },
+    [APP_TASK_METRICS] = { "metrics", CONFIG_APP_TASK_TELEMETRY_CORE, CONFIG_APP_TASK_TELEMETRY_PRIO,
+                           CONFIG_APP_TASK_TELEMETRY_STACK, false },
+    [APP_TASK_TRACE] = { "trace", CONFIG_APP_TASK_TELEMETRY_CORE, CONFIG_APP_TASK_TELEMETRY_PRIO,
+                         CONFIG_APP_TASK_TELEMETRY_STACK, false },
+    [APP_TASK_DLOG] = { "dlog", CONFIG_APP_TASK_TELEMETRY_CORE, CONFIG_APP_TASK_TELEMETRY_PRIO,
+                        CONFIG_APP_TASK_TELEMETRY_STACK, false },
+    [APP_TASK_PROFILE] = { "task_profile", CONFIG_APP_TASK_TELEMETRY_CORE, CONFIG_APP_TASK_TELEMETRY_PRIO,
+                           PROFILE_STACK, false },
+    [APP_TASK_DETECTOR] = { "detector", CONFIG_APP_TASK_DETECTOR_CORE, CONFIG_APP_TASK_DETECTOR_PRIO,
+                            CONFIG_APP_TASK_DETECTOR_STACK, false },
+};
+
+static BaseType_t affinity(int core)
+{
+    return core < 0 ? tskNO_AFFINITY : (BaseType_t)core;
+}
+
+static const char *core_name(int core, char buf[4])
+{
+    if (core < 0) {
+        return "any";
+    }
+    snprintf(buf, 4, "%d", core);
+    return buf;
+}
+
+esp_err_t app_task_start(app_task_id_t id, TaskFunction_t fn, void *arg, TaskHandle_t *ret_task)
+{
+    if (id >= APP_TASK_COUNT || fn == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const app_task_spec_t *t = &s_tasks[id];
+    return xTaskCreatePinnedToCore(fn, t->name, t->stack, arg, t->priority, ret_task, affinity(t->core)) == pdPASS ?
+           ESP_OK : ESP_ERR_NO_MEM;
+}
+
+void app_tasks_log(void)
+{
+    const app_task_spec_t *client = &s_tasks[APP_TASK_USB_CLIENT];
+    for (int i = 0; i < APP_TASK_COUNT; i++) {
+        const app_task_spec_t *t = &s_tasks[i];
+        char core[4];
+        ESP_LOGI(TAG, "%-12s core %-3s prio %2u stack %5" PRIu32 "%s", t->name, core_name(t->core, core),
+                 (unsigned)t->priority, t->stack, t->ingest ? "  ingest" : "");
+        if (!t->ingest && (t->core < 0 || client->core < 0 || t->core == client->core)) {
+            ESP_LOGW(TAG, "%s can run on usb_client's core: URB handling may be late", t->name);
+        }
+    }
+}
+
+/* ================== Profiling ================== */
+#if CONFIG_APP_TASK_PROFILE
+static TaskStatus_t s_status[TASK_PROFILE_MAX_TASKS];
+static task_profile_snapshot_t s_snap[2];
+static task_profile_report_t s_report;
+
+static bool take_snapshot(task_profile_snapshot_t *s)
+{
+    configRUN_TIME_COUNTER_TYPE total;
+    const UBaseType_t n = uxTaskGetSystemState(s_status, TASK_PROFILE_MAX_TASKS, &total);
+    if (n == 0) {
+        return false;   // more tasks than TASK_PROFILE_MAX_TASKS
+    }
+    s->total = (uint32_t)total;
+    s->num_tasks = n;
+    for (UBaseType_t i = 0; i < n; i++) {
+        const TaskStatus_t *ts = &s_status[i];
+        task_profile_task_t *t = &s->tasks[i];
+        snprintf(t->name, sizeof(t->name), "%s", ts->pcTaskName);
+        t->id = ts->xTaskNumber;
+        t->core = ts->xCoreID == tskNO_AFFINITY ? TASK_PROFILE_ANY_CORE : (int)ts->xCoreID;
+        t->priority = ts->uxCurrentPriority;
+        t->run_time = (uint32_t)ts->ulRunTimeCounter;
+        t->stack_free = ts->usStackHighWaterMark;
+    }
+    return true;
+}
+
+static void profile_task(void *arg)
+{
+    int cur = 0;
+    bool have_prev = take_snapshot(&s_snap[1]);
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_APP_TASK_PROFILE_PERIOD_MS));
+        if (!take_snapshot(&s_snap[cur])) {
+            ESP_LOGW(TAG, "more than %d tasks: not profiled", TASK_PROFILE_MAX_TASKS);
+            have_prev = false;
+            continue;
+        }
+        if (have_prev) {
+            task_profile_diff(&s_snap[!cur], &s_snap[cur], &s_report);
+            ESP_LOGI(TAG, "last %d ms: core 0 %.1f%% busy, core 1 %.1f%% busy", CONFIG_APP_TASK_PROFILE_PERIOD_MS,
+                     s_report.core_load_pct[0], s_report.core_load_pct[1]);
+            for (size_t i = 0; i < s_report.num_rows; i++) {
+                const task_profile_row_t *r = &s_report.rows[i];
+                char core[4];
+                ESP_LOGI(TAG, "  %-16s core %-3s prio %2" PRIu32 " %5.1f%%  stack free %5" PRIu32 "%s",
+                         r->task->name, core_name(r->task->core, core), r->task->priority, r->cpu_pct, r->task->stack_free,
+                         r->task->stack_free < STACK_LOW_BYTES ? "  LOW" : "");
+            }
+        }
+        have_prev = true;
+        cur = !cur;
+    }
+}
+
+esp_err_t app_tasks_profile_start(void)
+{
+    return app_task_start(APP_TASK_PROFILE, profile_task, NULL, NULL);
+}
+#endif
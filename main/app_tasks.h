@@ -0,0 +1,59 @@
+// app_tasks.h  (task topology: every task's core, priority and stack, from Kconfig)
+//
+// One table places the whole pipeline. The ingest path is usb_daemon (host
+// library events) and usb_client (class drivers, the URB callback and the
+// audio_stream stages it runs). Storage, watchdog and telemetry tasks
+// belong on the other core. app_tasks_log() prints the table at boot and
+// warns when any of them can run on usb_client's core, where SD or DSP
+// work would make URB handling late.
+//
+// With CONFIG_APP_TASK_PROFILE a low-priority task logs each task's share
+// of its core and its stack high-water every period (task_profile.h), to
+// rebalance from measurements.
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    APP_TASK_USB_DAEMON = 0,
+    APP_TASK_USB_CLIENT,
+    APP_TASK_CAPTURE,
+    APP_TASK_WATCHDOG,
+    APP_TASK_METRICS,
+    APP_TASK_TRACE,
+    APP_TASK_DLOG,
+    APP_TASK_PROFILE,
+    APP_TASK_DETECTOR,
+    APP_TASK_COUNT,
+} app_task_id_t;
+
+/**
+ * @brief Create task `id` where the topology puts it
+ *
+ * @param ret_task  Optional
+ * @return ESP_ERR_NO_MEM if the task couldn't be created
+ */
+esp_err_t app_task_start(app_task_id_t id, TaskFunction_t fn, void *arg, TaskHandle_t *ret_task);
+
+/**
+ * @brief Print the topology; warn about tasks that share the ingest core
+ */
+void app_tasks_log(void);
+
+#if CONFIG_APP_TASK_PROFILE
+/**
+ * @brief Start logging per-task CPU load and stack high-water
+ */
+esp_err_t app_tasks_profile_start(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,248 @@
+// audio_fanout.c  (refcounted blocks, a lock-free pool and one queue per consumer)
+//
+// The pool is a stack of free blocks: any task pushes (a release), only the
+// producer pops, so a compare-and-swap on the top is enough. Each queue has
+// one writer of `head` (the producer) and two contenders for `tail`: the
+// consumer taking a block and, under DROP_OLDEST, the producer evicting
+// one. Whoever wins the compare-and-swap on `tail` owns the block in that
+// slot.
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "audio_fanout.h"
+#include "audio_stream.h"
+#include "esp_check.h"
+#include "metrics.h"
+
+static const char *TAG = "FANOUT";
+
+typedef struct fan_block {
+    audio_block_t pub;          /**< First: consumers get its address */
+    atomic_uint refs;
+    struct fan_block *next_free;
+    int32_t *data;
+} fan_block_t;
+
+struct audio_fanout_sub {
+    audio_fanout_sub_config_t cfg;
+    _Atomic(fan_block_t *) *slots;
+    atomic_uint head;           /**< Written by the producer only */
+    atomic_uint tail;
+    fan_block_t *held;          /**< Returned by the last next() */
+    atomic_uint dropped;
+    metrics_id_t drop_metric;
+    audio_fanout_t *fanout;
+};
+
+struct audio_fanout {
+    audio_fanout_config_t cfg;
+    fan_block_t *blocks;
+    int32_t *data;
+    _Atomic(fan_block_t *) free_top;
+    atomic_size_t num_free;
+    size_t reserved;            /**< Blocks promised to subscribers and the producer */
+    audio_fanout_sub_t subs[AUDIO_FANOUT_MAX_SUBSCRIBERS];
+    int num_subs;
+};
+
+static void pool_push(audio_fanout_t *fo, fan_block_t *b)
+{
+    fan_block_t *top = atomic_load(&fo->free_top);
+    do {
+        b->next_free = top;
+    } while (!atomic_compare_exchange_weak(&fo->free_top, &top, b));
+    atomic_fetch_add(&fo->num_free, 1);
+}
+
+/* Producer only: with a single popper the top can't be popped and pushed
+ * back between the load and the swap */
+static fan_block_t *pool_pop(audio_fanout_t *fo)
+{
+    fan_block_t *top = atomic_load(&fo->free_top);
+    while (top && !atomic_compare_exchange_weak(&fo->free_top, &top, top->next_free)) {
+    }
+    if (top) {
+        atomic_fetch_sub(&fo->num_free, 1);
+    }
+    return top;
+}
+
+static void release(audio_fanout_t *fo, fan_block_t *b)
+{
+    if (atomic_fetch_sub(&b->refs, 1) == 1) {
+        pool_push(fo, b);
+    }
+}
+
+esp_err_t audio_fanout_create(const audio_fanout_config_t *config, audio_fanout_t **ret_fanout)
+{
+    if (config == NULL || ret_fanout == NULL || config->num_blocks < 2 || config->block_samples == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    audio_fanout_t *fo = calloc(1, sizeof(*fo));
+    if (fo == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    fo->cfg = *config;
+    // Every block starts on a 16-byte boundary
+    const size_t stride = (config->block_samples + 3) & ~(size_t)3;
+    fo->blocks = calloc(config->num_blocks, sizeof(fan_block_t));
+    fo->data = aligned_alloc(16, config->num_blocks * stride * sizeof(int32_t));
+    if (fo->blocks == NULL || fo->data == NULL) {
+        audio_fanout_delete(fo);
+        return ESP_ERR_NO_MEM;
+    }
+    atomic_init(&fo->free_top, NULL);
+    atomic_init(&fo->num_free, 0);
+    for (size_t i = 0; i < config->num_blocks; i++) {
+        fo->blocks[i].data = fo->data + i * stride;
+        atomic_init(&fo->blocks[i].refs, 0);
+        pool_push(fo, &fo->blocks[i]);
+    }
+    fo->reserved = 1;
+    *ret_fanout = fo;
+    return ESP_OK;
+}
+
+void audio_fanout_delete(audio_fanout_t *fanout)
+{
+    if (fanout == NULL) {
+        return;
+    }
+    for (int i = 0; i < fanout->num_subs; i++) {
+        free((void *)fanout->subs[i].slots);
+    }
+    free(fanout->blocks);
+    free(fanout->data);
+    free(fanout);
+}
+
+esp_err_t audio_fanout_subscribe(audio_fanout_t *fanout, const audio_fanout_sub_config_t *config,
+                                 audio_fanout_sub_t **ret_sub)
+{
+    if (fanout == NULL || config == NULL || ret_sub == NULL || config->name == NULL ||
+            strlen(config->name) > AUDIO_FANOUT_NAME_LEN || config->depth == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (fanout->num_subs >= AUDIO_FANOUT_MAX_SUBSCRIBERS ||
+            fanout->reserved + config->depth + 1 > fanout->cfg.num_blocks) {
+        return ESP_ERR_NO_MEM;
+    }
+    audio_fanout_sub_t *s = &fanout->subs[fanout->num_subs];
+    memset(s, 0, sizeof(*s));
+    char metric[32];
+    snprintf(metric, sizeof(metric), "fan.%s.drop", config->name);
+    ESP_RETURN_ON_ERROR(metrics_register(METRICS_COUNTER, metric, &s->drop_metric), TAG, "metrics");
+    s->slots = calloc(config->depth, sizeof(*s->slots));
+    if (s->slots == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    s->cfg = *config;
+    s->fanout = fanout;
+    atomic_init(&s->head, 0);
+    atomic_init(&s->tail, 0);
+    atomic_init(&s->dropped, 0);
+    fanout->reserved += config->depth + 1;
+    fanout->num_subs++;
+    *ret_sub = s;
+    return ESP_OK;
+}
+
+static void drop(audio_fanout_sub_t *s)
+{
+    atomic_fetch_add_explicit(&s->dropped, 1, memory_order_relaxed);
+    metrics_add(s->drop_metric, 1);
+}
+
+static void enqueue(audio_fanout_sub_t *s, fan_block_t *b)
+{
+    const unsigned head = atomic_load_explicit(&s->head, memory_order_relaxed);
+    unsigned tail = atomic_load(&s->tail);
+    if (head - tail >= s->cfg.depth) {
+        if (s->cfg.policy == AUDIO_FANOUT_DROP_NEWEST) {
+            drop(s);
+            return;
+        }
+        // Lost the race to the consumer: it just made room
+        if (atomic_compare_exchange_strong(&s->tail, &tail, tail + 1)) {
+            release(s->fanout, atomic_load(&s->slots[tail % s->cfg.depth]));
+            drop(s);
+        }
+    }
+    atomic_fetch_add(&b->refs, 1);
+    atomic_store(&s->slots[head % s->cfg.depth], b);
+    atomic_store(&s->head, head + 1);
+    if (s->cfg.notify) {
+        s->cfg.notify(s->cfg.ctx);
+    }
+}
+
+void audio_fanout_publish(const int32_t *frames, size_t nframes, size_t channels, uint64_t t0, void *ctx)
+{
+    audio_fanout_t *fo = ctx;
+    const size_t per_block = channels ? fo->cfg.block_samples / channels : 0;
+    if (per_block == 0 || fo->num_subs == 0) {
+        return;
+    }
+    const uint32_t rate = audio_stream_sample_rate();
+    for (size_t off = 0; off < nframes; off += per_block) {
+        const size_t n = nframes - off < per_block ? nframes - off : per_block;
+        fan_block_t *b = pool_pop(fo);
+        if (b == NULL) {
+            // Can't happen while every consumer holds one block at a time
+            for (int i = 0; i < fo->num_subs; i++) {
+                drop(&fo->subs[i]);
+            }
+            continue;
+        }
+        memcpy(b->data, frames + off * channels, n * channels * sizeof(int32_t));
+        b->pub = (audio_block_t) {
+            .t0 = t0 + off,
+            .sample_rate_hz = rate,
+            .channels = channels,
+            .nframes = n,
+            .frames = b->data,
+        };
+        atomic_store(&b->refs, 1);      // the producer's, until every queue has it
+        for (int i = 0; i < fo->num_subs; i++) {
+            enqueue(&fo->subs[i], b);
+        }
+        release(fo, b);
+    }
+}
+
+void audio_fanout_done(audio_fanout_sub_t *sub)
+{
+    if (sub->held) {
+        release(sub->fanout, sub->held);
+        sub->held = NULL;
+    }
+}
+
+const audio_block_t *audio_fanout_next(audio_fanout_sub_t *sub)
+{
+    audio_fanout_done(sub);
+    unsigned tail = atomic_load(&sub->tail);
+    while (tail != atomic_load(&sub->head)) {
+        // Read before the swap: if the producer evicted this slot meanwhile
+        // the swap fails and the value is never used
+        fan_block_t *b = atomic_load(&sub->slots[tail % sub->cfg.depth]);
+        if (atomic_compare_exchange_weak(&sub->tail, &tail, tail + 1)) {
+            sub->held = b;
+            return &b->pub;
+        }
+    }
+    return NULL;
+}
+
+uint32_t audio_fanout_dropped(const audio_fanout_sub_t *sub)
+{
+    return atomic_load_explicit(&((audio_fanout_sub_t *)sub)->dropped, memory_order_relaxed);
+}
+
+size_t audio_fanout_free_blocks(const audio_fanout_t *fanout)
+{
+    return atomic_load(&((audio_fanout_t *)fanout)->num_free);
+}
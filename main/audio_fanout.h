@@ -0,0 +1,109 @@
+// audio_fanout.h  (one stream, many consumer tasks: refcounted blocks from a fixed pool)
+//
+// audio_fanout_publish() is an audio_stream frame subscriber. It copies
+// each published block once, in pieces of up to block_samples, into blocks
+// from a pool allocated at create, and queues the same block for every
+// subscriber, one reference each. Consumers in their own tasks walk their
+// queue with audio_fanout_next(), which returns the next block and releases
+// the one before: no copy per consumer, and a block goes back to the pool
+// when its last consumer is done with it. Blocks are never written once
+// queued.
+//
+// Every subscriber has its own queue depth and overflow policy, and the
+// pool reserves depth + 1 blocks for it at subscribe. A consumer that falls
+// behind loses blocks of its own (DROP_NEWEST: the new block isn't queued
+// for it; DROP_OLDEST: its oldest queued block makes room) and never holds
+// up ingest or the other consumers. A dropped block is a jump in t0, like a
+// lost packet, and counts in the fan.<name>.drop metric.
+//
+// Subscribe before the stream starts. One producer (the client task);
+// each subscriber's next/done calls from one task at a time.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AUDIO_FANOUT_MAX_SUBSCRIBERS    4
+#define AUDIO_FANOUT_NAME_LEN           14      /**< fan.<name>.drop fits METRICS_NAME_LEN */
+
+typedef struct {
+    uint64_t t0;                /**< Absolute index of frames[0], as audio_stream's */
+    uint32_t sample_rate_hz;    /**< Rate the block was sampled at */
+    size_t channels;
+    size_t nframes;
+    const int32_t *frames;      /**< Interleaved Q31, 16-byte aligned */
+} audio_block_t;
+
+typedef enum {
+    AUDIO_FANOUT_DROP_NEWEST = 0,   /**< Queue full: the new block isn't queued */
+    AUDIO_FANOUT_DROP_OLDEST,       /**< Queue full: the oldest queued block is released */
+} audio_fanout_policy_t;
+
+typedef struct {
+    size_t num_blocks;
+    size_t block_samples;       /**< Interleaved samples per block; frames = block_samples / channels */
+} audio_fanout_config_t;
+
+typedef struct {
+    const char *name;           /**< Up to AUDIO_FANOUT_NAME_LEN characters */
+    size_t depth;               /**< Blocks queued at most */
+    audio_fanout_policy_t policy;
+    void (*notify)(void *ctx);  /**< Optional: the producer queued a block (e.g. a task notification) */
+    void *ctx;
+} audio_fanout_sub_config_t;
+
+typedef struct audio_fanout audio_fanout_t;
+typedef struct audio_fanout_sub audio_fanout_sub_t;
+
+esp_err_t audio_fanout_create(const audio_fanout_config_t *config, audio_fanout_t **ret_fanout);
+
+/**
+ * @brief Free the pool; only once nothing publishes or consumes
+ */
+void audio_fanout_delete(audio_fanout_t *fanout);
+
+/**
+ * @brief Add a consumer
+ *
+ * @return ESP_ERR_NO_MEM if the pool can't reserve depth + 1 more blocks
+ *         (it keeps one for the producer) or AUDIO_FANOUT_MAX_SUBSCRIBERS are taken
+ */
+esp_err_t audio_fanout_subscribe(audio_fanout_t *fanout, const audio_fanout_sub_config_t *config,
+                                 audio_fanout_sub_t **ret_sub);
+
+/**
+ * @brief audio_stream_frames_cb_t; `ctx` is the audio_fanout_t
+ */
+void audio_fanout_publish(const int32_t *frames, size_t nframes, size_t channels, uint64_t t0, void *ctx);
+
+/**
+ * @brief Release the block from the previous call and take the next one
+ *
+ * @return NULL if none is queued (the previous one is still released)
+ */
+const audio_block_t *audio_fanout_next(audio_fanout_sub_t *sub);
+
+/**
+ * @brief Release the block from the previous audio_fanout_next() without taking another
+ */
+void audio_fanout_done(audio_fanout_sub_t *sub);
+
+/**
+ * @brief Blocks dropped for this subscriber so far
+ */
+uint32_t audio_fanout_dropped(const audio_fanout_sub_t *sub);
+
+/**
+ * @brief Blocks in the pool now
+ */
+size_t audio_fanout_free_blocks(const audio_fanout_t *fanout);
+
+#ifdef __cplusplus
+}
+#endif
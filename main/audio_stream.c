@@ -0,0 +1,163 @@
+// audio_stream.c  (compacted ISO samples -> subscribed stages)
+
+#include <stdatomic.h>
+#include "audio_stream.h"
+#include "trace.h"
+
+static struct {
+    audio_stream_cb_t cb;
+    void *ctx;
+} s_subs[AUDIO_STREAM_MAX_SUBSCRIBERS];
+static int s_num_subs;
+
+static struct {
+    audio_stream_frames_cb_t cb;
+    void *ctx;
+} s_frame_subs[AUDIO_STREAM_MAX_FRAME_SUBSCRIBERS];
+static int s_num_frame_subs;
+
+static struct {
+    audio_stream_filter_t fn;
+    void *ctx;
+} s_filters[AUDIO_STREAM_MAX_FILTERS];
+static int s_num_filters;
+
+static struct {
+    audio_stream_rate_cb_t cb;
+    void *ctx;
+} s_rate_listeners[AUDIO_STREAM_MAX_RATE_LISTENERS];
+static int s_num_rate_listeners;
+static uint32_t s_sample_rate_hz;
+
+/* For audio_stream_progress(): kind << 8 | index of the stage running */
+static _Atomic uint32_t s_busy;
+static _Atomic uint32_t s_published;
+
+static inline void set_busy(audio_stream_stage_kind_t kind, int i)
+{
+    atomic_store_explicit(&s_busy, (uint32_t)kind << 8 | (uint32_t)i, memory_order_relaxed);
+}
+
+static inline void block_done(void)
+{
+    atomic_store_explicit(&s_busy, AUDIO_STREAM_STAGE_NONE, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s_published, 1, memory_order_relaxed);
+}
+
+esp_err_t audio_stream_subscribe(audio_stream_cb_t cb, void *ctx)
+{
+    if (cb == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_num_subs >= AUDIO_STREAM_MAX_SUBSCRIBERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_subs[s_num_subs].cb = cb;
+    s_subs[s_num_subs].ctx = ctx;
+    s_num_subs++;
+    return ESP_OK;
+}
+
+esp_err_t audio_stream_subscribe_frames(audio_stream_frames_cb_t cb, void *ctx)
+{
+    if (cb == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_num_frame_subs >= AUDIO_STREAM_MAX_FRAME_SUBSCRIBERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_frame_subs[s_num_frame_subs].cb = cb;
+    s_frame_subs[s_num_frame_subs].ctx = ctx;
+    s_num_frame_subs++;
+    return ESP_OK;
+}
+
+esp_err_t audio_stream_add_filter(audio_stream_filter_t fn, void *ctx)
+{
+    if (fn == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_num_filters >= AUDIO_STREAM_MAX_FILTERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_filters[s_num_filters].fn = fn;
+    s_filters[s_num_filters].ctx = ctx;
+    s_num_filters++;
+    return ESP_OK;
+}
+
+esp_err_t audio_stream_on_rate_change(audio_stream_rate_cb_t cb, void *ctx)
+{
+    if (cb == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_num_rate_listeners >= AUDIO_STREAM_MAX_RATE_LISTENERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_rate_listeners[s_num_rate_listeners].cb = cb;
+    s_rate_listeners[s_num_rate_listeners].ctx = ctx;
+    s_num_rate_listeners++;
+    return ESP_OK;
+}
+
+uint32_t audio_stream_sample_rate(void)
+{
+    return s_sample_rate_hz;
+}
+
+void audio_stream_set_sample_rate(uint32_t sample_rate_hz)
+{
+    if (sample_rate_hz == s_sample_rate_hz) {
+        return;
+    }
+    s_sample_rate_hz = sample_rate_hz;
+    for (int i = 0; i < s_num_rate_listeners; i++) {
+        s_rate_listeners[i].cb(sample_rate_hz, s_rate_listeners[i].ctx);
+    }
+}
+
+void audio_stream_progress(audio_stream_progress_t *progress)
+{
+    const uint32_t busy = atomic_load_explicit(&s_busy, memory_order_relaxed);
+    progress->published = atomic_load_explicit(&s_published, memory_order_relaxed);
+    progress->busy = (audio_stream_stage_kind_t)(busy >> 8);
+    progress->busy_index = (uint8_t)busy;
+}
+
+void audio_stream_publish(int16_t *samples, size_t n, uint64_t t0)
+{
+    if (n == 0) {
+        return;
+    }
+    TRACE_BEGIN(TRACE_PUBLISH, n);
+    for (int i = 0; i < s_num_filters; i++) {
+        TRACE_BEGIN(TRACE_FILTER, i);
+        set_busy(AUDIO_STREAM_STAGE_FILTER, i);
+        s_filters[i].fn(samples, n, t0, s_filters[i].ctx);
+        TRACE_END(TRACE_FILTER, i);
+    }
+    for (int i = 0; i < s_num_subs; i++) {
+        TRACE_BEGIN(TRACE_SUBSCRIBER, i);
+        set_busy(AUDIO_STREAM_STAGE_SUBSCRIBER, i);
+        s_subs[i].cb(samples, n, t0, s_subs[i].ctx);
+        TRACE_END(TRACE_SUBSCRIBER, i);
+    }
+    block_done();
+    TRACE_END(TRACE_PUBLISH, n);
+}
+
+void audio_stream_publish_frames(const int32_t *frames, size_t nframes, size_t channels, uint64_t t0)
+{
+    if (nframes == 0) {
+        return;
+    }
+    TRACE_BEGIN(TRACE_PUBLISH_FRAMES, nframes);
+    for (int i = 0; i < s_num_frame_subs; i++) {
+        TRACE_BEGIN(TRACE_FRAME_SUBSCRIBER, i);
+        set_busy(AUDIO_STREAM_STAGE_FRAME_SUBSCRIBER, i);
+        s_frame_subs[i].cb(frames, nframes, channels, t0, s_frame_subs[i].ctx);
+        TRACE_END(TRACE_FRAME_SUBSCRIBER, i);
+    }
+    block_done();
+    TRACE_END(TRACE_PUBLISH_FRAMES, nframes);
+}
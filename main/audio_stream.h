@@ -0,0 +1,129 @@
+// audio_stream.h  (compacted ISO samples -> subscribed stages)
+//
+// isoc_in_cb packs the valid packets of each URB into one contiguous block
+// and publishes it here. Every block carries the absolute index of its
+// first sample, so stages can timestamp results to the sample.
+//
+// Filters (in-place stages such as DC removal) run first, in registration
+// order, on the mutable block; subscribers then see the filtered samples.
+//
+// Frame subscribers see the same block before any of that: every channel
+// at full resolution, as interleaved Q31 whatever the device's format. The
+// int16 stages get one channel of it (CONFIG_APP_STREAM_CHANNEL).
+//
+// The sample rate can change while running. Rate listeners are told before
+// the first block at the new rate, and the timeline gets a one-sample gap
+// so stages that track continuity restart their windows.
+//
+// audio_stream_progress() tells another task which stage is running and
+// how many blocks got through, so a watchdog can tell a stage that never
+// returns from a device that stopped sending.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AUDIO_STREAM_MAX_SUBSCRIBERS    8
+#define AUDIO_STREAM_MAX_FILTERS        4
+#define AUDIO_STREAM_MAX_RATE_LISTENERS 8
+#define AUDIO_STREAM_MAX_FRAME_SUBSCRIBERS 4
+
+/**
+ * @brief Block callback
+ *
+ * @param samples  Mono int16 samples, 16-byte aligned; valid only during the call
+ * @param n        Sample count
+ * @param t0       Absolute index of samples[0] since stream start
+ */
+typedef void (*audio_stream_cb_t)(const int16_t *samples, size_t n, uint64_t t0, void *ctx);
+
+/**
+ * @brief Frame callback
+ *
+ * @param frames   Interleaved Q31 frames, `channels` samples each, left-justified
+ *                 from the device's subframe; valid only during the call
+ * @param nframes  Frame count
+ * @param t0       Absolute index of frames[0]; the same timeline as audio_stream_cb_t
+ */
+typedef void (*audio_stream_frames_cb_t)(const int32_t *frames, size_t nframes, size_t channels,
+                                         uint64_t t0, void *ctx);
+
+/**
+ * @brief In-place filter; same arguments as audio_stream_cb_t but may modify samples
+ */
+typedef void (*audio_stream_filter_t)(int16_t *samples, size_t n, uint64_t t0, void *ctx);
+
+/**
+ * @brief Sample-rate change notification; called from the stream context
+ */
+typedef void (*audio_stream_rate_cb_t)(uint32_t sample_rate_hz, void *ctx);
+
+typedef enum {
+    AUDIO_STREAM_STAGE_NONE = 0,            /**< Between blocks */
+    AUDIO_STREAM_STAGE_FRAME_SUBSCRIBER,
+    AUDIO_STREAM_STAGE_FILTER,
+    AUDIO_STREAM_STAGE_SUBSCRIBER,
+} audio_stream_stage_kind_t;
+
+typedef struct {
+    uint32_t published;                     /**< Blocks (frames and int16) every stage returned from */
+    audio_stream_stage_kind_t busy;         /**< Kind of stage running now */
+    uint8_t busy_index;                     /**< Its index, in registration order */
+} audio_stream_progress_t;
+
+/**
+ * @brief Register a block consumer. Call before the stream starts.
+ */
+esp_err_t audio_stream_subscribe(audio_stream_cb_t cb, void *ctx);
+
+/**
+ * @brief Register a frame consumer. Call before the stream starts.
+ */
+esp_err_t audio_stream_subscribe_frames(audio_stream_frames_cb_t cb, void *ctx);
+
+/**
+ * @brief Register an in-place filter. Call before the stream starts.
+ */
+esp_err_t audio_stream_add_filter(audio_stream_filter_t fn, void *ctx);
+
+/**
+ * @brief Register a sample-rate listener. Call before the stream starts.
+ */
+esp_err_t audio_stream_on_rate_change(audio_stream_rate_cb_t cb, void *ctx);
+
+/**
+ * @brief Current sample rate, 0 before the first audio_stream_set_sample_rate()
+ */
+uint32_t audio_stream_sample_rate(void);
+
+/**
+ * @brief Announce the rate of the blocks that follow; listeners run only if it changed
+ */
+void audio_stream_set_sample_rate(uint32_t sample_rate_hz);
+
+/**
+ * @brief Run the filters over one block, then deliver it to every subscriber
+ */
+void audio_stream_publish(int16_t *samples, size_t n, uint64_t t0);
+
+/**
+ * @brief Where delivery is now; any task
+ */
+void audio_stream_progress(audio_stream_progress_t *progress);
+
+/**
+ * @brief Deliver one block of frames to every frame subscriber
+ *
+ * The producer calls this before audio_stream_publish() with the same t0.
+ */
+void audio_stream_publish_frames(const int32_t *frames, size_t nframes, size_t channels, uint64_t t0);
+
+#ifdef __cplusplus
+}
+#endif
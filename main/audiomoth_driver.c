@@ -0,0 +1,152 @@
+// audiomoth_driver.c  (AudioMoth HID configuration as a class_driver plugin)
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include <time.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "usb/usb_host.h"
+#include "usb/usb_types_ch9.h"
+
+#include "class_driver.h"
+#include "audiomoth_driver.h"
+
+static const char *TAG = "AUDIOMOTH";
+
+typedef struct {
+    audiomoth_hid_t *hid;       /**< NULL once detach started */
+    uint8_t intf;
+    int64_t attach_us;
+} am_device_t;
+
+static audiomoth_settings_t s_settings;
+
+static uint64_t now_ms(void)
+{
+    return (uint64_t)(esp_timer_get_time() / 1000);
+}
+
+static void am_version_cb(esp_err_t err, const audiomoth_hid_reply_t *reply, void *ctx)
+{
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "firmware %u.%u.%u", reply->version[0], reply->version[1], reply->version[2]);
+    }
+}
+
+static void am_time_cb(esp_err_t err, const audiomoth_hid_reply_t *reply, void *ctx)
+{
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "set time failed: %s", esp_err_to_name(err));
+    }
+}
+
+static void am_settings_cb(esp_err_t err, const audiomoth_hid_reply_t *reply, void *ctx)
+{
+    const am_device_t *am = ctx;
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "settings failed: %s", esp_err_to_name(err));
+        return;
+    }
+    ESP_LOGI(TAG, "configured %lld us after attach: gain %u, %" PRIu32 " Hz",
+             (long long)(esp_timer_get_time() - am->attach_us), reply->settings.gain,
+             reply->settings.sample_rate_hz);
+}
+
+/* ================== Class driver hooks ================== */
+static void am_parse(const usb_config_desc_t *config_desc, const usb_intf_desc_t *intf,
+                     desc_cache_entry_t *entry, void *arg)
+{
+    audiomoth_hid_config_t hid = {0};
+    if (entry->has_hid || audiomoth_hid_find(config_desc, &hid) != ESP_OK) {
+        return;
+    }
+    entry->has_hid = true;
+    entry->hid_intf = hid.intf;
+    entry->hid_ep_in = hid.ep_in;
+    entry->hid_ep_out = hid.ep_out;
+}
+
+/* Queue the whole exchange; it runs alongside the stream setup on EP0 */
+static esp_err_t am_attach(const class_driver_dev_t *dev, const usb_intf_desc_t *intf, void *arg, void **ret_ctx)
+{
+    if (!dev->desc->has_hid || dev->desc->hid_intf != intf->bInterfaceNumber) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    am_device_t *am = calloc(1, sizeof(*am));
+    if (am == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    am->intf = dev->desc->hid_intf;
+    am->attach_us = esp_timer_get_time();
+    const audiomoth_hid_config_t cfg = {
+        .dev = dev->dev_hdl,
+        .intf = am->intf,
+        .ep_out = dev->desc->hid_ep_out,
+        .ep_in = dev->desc->hid_ep_in,
+        .timeout_ms = 100,
+        .now_ms = now_ms,
+    };
+    esp_err_t err = usb_host_interface_claim(dev->client, dev->dev_hdl, am->intf, 0);
+    if (err == ESP_OK) {
+        err = audiomoth_hid_create(&cfg, &am->hid);
+        if (err != ESP_OK) {
+            usb_host_interface_release(dev->client, dev->dev_hdl, am->intf);
+        }
+    }
+    if (err != ESP_OK) {
+        free(am);
+        return err;
+    }
+
+    audiomoth_hid_get_firmware_version(am->hid, am_version_cb, am);
+    const time_t now = time(NULL);
+    if (now > 1600000000) {
+        audiomoth_hid_set_time(am->hid, (uint32_t)now, am_time_cb, am);
+    } else {
+        ESP_LOGW(TAG, "system time not set, leaving the AudioMoth clock alone");
+    }
+    audiomoth_hid_set_settings(am->hid, &s_settings, am_settings_cb, am);
+    *ret_ctx = am;
+    return ESP_OK;
+}
+
+static esp_err_t am_detach(const class_driver_dev_t *dev, void *ctx)
+{
+    am_device_t *am = ctx;
+    audiomoth_hid_delete(am->hid);
+    am->hid = NULL;
+    // Refused while the request on the bus is still coming back
+    if (usb_host_interface_release(dev->client, dev->dev_hdl, am->intf) == ESP_ERR_INVALID_STATE) {
+        return ESP_ERR_NOT_FINISHED;
+    }
+    free(am);
+    return ESP_OK;
+}
+
+/* Keep being polled while a request may need timing out */
+static bool am_poll(const class_driver_dev_t *dev, void *ctx)
+{
+    am_device_t *am = ctx;
+    audiomoth_hid_poll(am->hid);
+    return audiomoth_hid_pending(am->hid) != 0;
+}
+
+static const class_driver_ops_t s_ops = {
+    .name = "AudioMoth HID",
+    .intf_class = USB_CLASS_HID,
+    .intf_subclass = CLASS_DRIVER_MATCH_ANY,
+    .parse = am_parse,
+    .attach = am_attach,
+    .detach = am_detach,
+    .poll = am_poll,
+};
+
+esp_err_t audiomoth_driver_register(const audiomoth_settings_t *settings)
+{
+    if (settings == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_settings = *settings;
+    return class_driver_register(&s_ops, NULL);
+}
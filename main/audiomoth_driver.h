@@ -0,0 +1,25 @@
+// audiomoth_driver.h  (AudioMoth HID configuration as a class_driver plugin)
+//
+// On every AudioMoth that attaches: read the firmware version, set its
+// clock from the system time (when that is set) and write the microphone
+// settings, all queued on the HID channel while the stream starts up.
+
+#pragma once
+
+#include "esp_err.h"
+#include "audiomoth_hid.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Register with class_driver; before class_driver_install()
+ *
+ * @param settings  Written to each device at attach; copied
+ */
+esp_err_t audiomoth_driver_register(const audiomoth_settings_t *settings);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,412 @@
+// audiomoth_hid.c  (AudioMoth configuration channel over the HID interface)
+
+#include <stdlib.h>
+#include <string.h>
+#include "audiomoth_hid.h"
+
+typedef struct {
+    uint8_t cmd;
+    uint8_t len;
+    uint8_t payload[AUDIOMOTH_HID_REPORT_LEN - 1];
+    audiomoth_hid_cb_t cb;
+    void *ctx;
+} hid_req_t;
+
+struct audiomoth_hid {
+    audiomoth_hid_config_t cfg;
+    usb_transfer_t *out;
+    usb_transfer_t *in;
+    hid_req_t queue[AUDIOMOTH_HID_QUEUE_LEN];
+    size_t head;
+    size_t count;
+    int live;                   /**< Transfers of the head request still on the bus */
+    esp_err_t err;              /**< First failure of the head request */
+    uint64_t deadline_ms;
+    bool timed_out;
+    bool flushed;               /**< Endpoints halted; cleared once both transfers are back */
+    bool deleting;
+    int in_cb;                  /**< Completion callbacks on the stack */
+    bool free_pending;          /**< Deleted from a callback: freed once it returns */
+};
+
+static void xfer_done(usb_transfer_t *xfer);
+
+static void put_le16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    put_le16(p, v & 0xFFFF);
+    put_le16(p + 2, v >> 16);
+}
+
+static uint32_t get_le16(const uint8_t *p)
+{
+    return p[0] | ((uint32_t)p[1] << 8);
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return get_le16(p) | (get_le16(p + 2) << 16);
+}
+
+void audiomoth_settings_encode(const audiomoth_settings_t *settings, uint8_t out[AUDIOMOTH_SETTINGS_LEN])
+{
+    put_le32(out, settings->sample_rate_hz);
+    out[4] = settings->gain;
+    out[5] = (uint8_t)settings->filter;
+    put_le16(out + 6, (uint16_t)(settings->lower_filter_hz / 100));
+    put_le16(out + 8, (uint16_t)(settings->higher_filter_hz / 100));
+    out[10] = (settings->led ? 0x01 : 0) | (settings->low_gain_range ? 0x02 : 0) | (settings->energy_saver ? 0x04 : 0);
+}
+
+void audiomoth_settings_decode(const uint8_t in[AUDIOMOTH_SETTINGS_LEN], audiomoth_settings_t *settings)
+{
+    settings->sample_rate_hz = get_le32(in);
+    settings->gain = in[4];
+    settings->filter = (audiomoth_filter_t)in[5];
+    settings->lower_filter_hz = get_le16(in + 6) * 100;
+    settings->higher_filter_hz = get_le16(in + 8) * 100;
+    settings->led = in[10] & 0x01;
+    settings->low_gain_range = in[10] & 0x02;
+    settings->energy_saver = in[10] & 0x04;
+}
+
+esp_err_t audiomoth_hid_find(const usb_config_desc_t *config_desc, audiomoth_hid_config_t *out)
+{
+    if (config_desc == NULL || out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const uint8_t *p = (const uint8_t *)config_desc;
+    const uint8_t *end = p + config_desc->wTotalLength;
+    bool in_hid = false;
+    uint8_t intf = 0, ep_in = 0, ep_out = 0;
+    for (; p + 2 <= end && p[0] >= 2 && p + p[0] <= end; p += p[0]) {
+        if (p[1] == USB_B_DESCRIPTOR_TYPE_INTERFACE) {
+            if (in_hid && ep_in && ep_out) {
+                break;
+            }
+            const usb_intf_desc_t *id = (const usb_intf_desc_t *)p;
+            in_hid = id->bInterfaceClass == USB_CLASS_HID;
+            intf = id->bInterfaceNumber;
+            ep_in = ep_out = 0;
+        } else if (in_hid && p[1] == USB_B_DESCRIPTOR_TYPE_ENDPOINT) {
+            const usb_ep_desc_t *ep = (const usb_ep_desc_t *)p;
+            if ((ep->bmAttributes & USB_BM_ATTRIBUTES_XFERTYPE_MASK) != USB_BM_ATTRIBUTES_XFER_INT) {
+                continue;
+            }
+            if (ep->bEndpointAddress & USB_B_ENDPOINT_ADDRESS_EP_DIR_MASK) {
+                ep_in = ep->bEndpointAddress;
+            } else {
+                ep_out = ep->bEndpointAddress;
+            }
+        }
+    }
+    if (!in_hid || ep_in == 0 || ep_out == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    out->intf = intf;
+    out->ep_in = ep_in;
+    out->ep_out = ep_out;
+    return ESP_OK;
+}
+
+esp_err_t audiomoth_hid_create(const audiomoth_hid_config_t *config, audiomoth_hid_t **ret_hid)
+{
+    if (config == NULL || ret_hid == NULL || config->dev == NULL || config->ep_in == 0 || config->ep_out == 0 ||
+            (config->timeout_ms && config->now_ms == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    audiomoth_hid_t *hid = calloc(1, sizeof(*hid));
+    if (hid == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    hid->cfg = *config;
+    esp_err_t err = usb_host_transfer_alloc(AUDIOMOTH_HID_REPORT_LEN, 0, &hid->out);
+    if (err == ESP_OK) {
+        err = usb_host_transfer_alloc(AUDIOMOTH_HID_REPORT_LEN, 0, &hid->in);
+    }
+    if (err != ESP_OK) {
+        if (hid->out) {
+            usb_host_transfer_free(hid->out);
+        }
+        free(hid);
+        return err;
+    }
+    usb_transfer_t *xfers[2] = { hid->out, hid->in };
+    for (int i = 0; i < 2; i++) {
+        xfers[i]->device_handle = config->dev;
+        xfers[i]->bEndpointAddress = i ? config->ep_in : config->ep_out;
+        xfers[i]->num_bytes = AUDIOMOTH_HID_REPORT_LEN;
+        xfers[i]->callback = xfer_done;
+        xfers[i]->context = hid;
+    }
+    *ret_hid = hid;
+    return ESP_OK;
+}
+
+static void hid_free(audiomoth_hid_t *hid)
+{
+    usb_host_transfer_free(hid->out);
+    usb_host_transfer_free(hid->in);
+    free(hid);
+}
+
+/* Get both transfers of the head request back now: they complete as canceled */
+static void abort_bus(audiomoth_hid_t *hid)
+{
+    if (hid->flushed) {
+        return;
+    }
+    hid->flushed = true;
+    usb_host_endpoint_halt(hid->cfg.dev, hid->cfg.ep_in);
+    usb_host_endpoint_flush(hid->cfg.dev, hid->cfg.ep_in);
+    usb_host_endpoint_halt(hid->cfg.dev, hid->cfg.ep_out);
+    usb_host_endpoint_flush(hid->cfg.dev, hid->cfg.ep_out);
+}
+
+void audiomoth_hid_delete(audiomoth_hid_t *hid)
+{
+    if (hid == NULL) {
+        return;
+    }
+    // Everything behind the head never reached the bus
+    const size_t queued = hid->live ? hid->count - 1 : hid->count;
+    for (size_t i = hid->count - queued; i < hid->count; i++) {
+        const hid_req_t *r = &hid->queue[(hid->head + i) % AUDIOMOTH_HID_QUEUE_LEN];
+        if (r->cb) {
+            r->cb(ESP_ERR_INVALID_STATE, NULL, r->ctx);
+        }
+    }
+    if (hid->live == 0) {
+        // From a callback: the caller still holds the handle, run_cb() frees it
+        if (hid->in_cb) {
+            hid->count = 0;
+            hid->free_pending = true;
+            return;
+        }
+        hid_free(hid);
+        return;
+    }
+    hid->count = 1;
+    hid->deleting = true;
+    abort_bus(hid);
+}
+
+static esp_err_t status_to_err(usb_transfer_status_t status)
+{
+    switch (status) {
+    case USB_TRANSFER_STATUS_COMPLETED:
+        return ESP_OK;
+    case USB_TRANSFER_STATUS_STALL:
+        return ESP_ERR_NOT_SUPPORTED;
+    case USB_TRANSFER_STATUS_TIMED_OUT:
+        return ESP_ERR_TIMEOUT;
+    case USB_TRANSFER_STATUS_NO_DEVICE:
+    case USB_TRANSFER_STATUS_CANCELED:
+        return ESP_ERR_INVALID_STATE;
+    default:
+        return ESP_FAIL;
+    }
+}
+
+static void decode_reply(const uint8_t *rep, audiomoth_hid_reply_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->cmd = rep[0];
+    switch (rep[0]) {
+    case AUDIOMOTH_HID_GET_TIME:
+    case AUDIOMOTH_HID_SET_TIME:
+        out->time = get_le32(rep + 1);
+        break;
+    case AUDIOMOTH_HID_GET_UID:
+        memcpy(out->uid, rep + 1, sizeof(out->uid));
+        break;
+    case AUDIOMOTH_HID_GET_BATTERY:
+        out->battery = rep[1];
+        break;
+    case AUDIOMOTH_HID_GET_APP_PACKET:
+    case AUDIOMOTH_HID_SET_APP_PACKET:
+        audiomoth_settings_decode(rep + 1, &out->settings);
+        break;
+    case AUDIOMOTH_HID_GET_FIRMWARE_VERSION:
+        memcpy(out->version, rep + 1, sizeof(out->version));
+        break;
+    default:
+        break;
+    }
+}
+
+static void kick(audiomoth_hid_t *hid);
+
+/* Run a completion; false if the callback deleted the handle, which must not be touched again */
+static bool run_cb(audiomoth_hid_t *hid, const hid_req_t *r, esp_err_t err, const audiomoth_hid_reply_t *reply)
+{
+    hid->in_cb++;
+    r->cb(err, reply, r->ctx);
+    hid->in_cb--;
+    if (hid->free_pending) {
+        if (hid->in_cb == 0) {
+            hid_free(hid);
+        }
+        return false;
+    }
+    return !hid->deleting;
+}
+
+/* Both transfers of the head request are back */
+static void finish(audiomoth_hid_t *hid)
+{
+    if (hid->deleting) {
+        hid_free(hid);
+        return;
+    }
+    if (hid->flushed) {
+        usb_host_endpoint_clear(hid->cfg.dev, hid->cfg.ep_in);
+        usb_host_endpoint_clear(hid->cfg.dev, hid->cfg.ep_out);
+        hid->flushed = false;
+    }
+    const hid_req_t r = hid->queue[hid->head];
+    hid->head = (hid->head + 1) % AUDIOMOTH_HID_QUEUE_LEN;
+    hid->count--;
+
+    esp_err_t err = hid->timed_out ? ESP_ERR_TIMEOUT : hid->err;
+    if (err == ESP_OK && (hid->in->actual_num_bytes != AUDIOMOTH_HID_REPORT_LEN || hid->in->data_buffer[0] != r.cmd)) {
+        err = ESP_ERR_INVALID_RESPONSE;
+    }
+    if (r.cb) {
+        audiomoth_hid_reply_t reply;
+        if (err == ESP_OK) {
+            decode_reply(hid->in->data_buffer, &reply);
+        }
+        if (!run_cb(hid, &r, err, err == ESP_OK ? &reply : NULL)) {
+            return;
+        }
+    }
+    kick(hid);
+}
+
+static void xfer_done(usb_transfer_t *xfer)
+{
+    audiomoth_hid_t *hid = xfer->context;
+    hid->live--;
+    const esp_err_t err = status_to_err(xfer->status);
+    if (err != ESP_OK && hid->err == ESP_OK) {
+        hid->err = err;
+        // The other half may never complete on its own (a reply that won't come)
+        if (hid->live) {
+            abort_bus(hid);
+        }
+    }
+    if (hid->live == 0) {
+        finish(hid);
+    }
+}
+
+/* Put the head request on the bus: IN first, so a fast reply is never missed */
+static void kick(audiomoth_hid_t *hid)
+{
+    while (hid->live == 0 && hid->count) {
+        const hid_req_t *r = &hid->queue[hid->head];
+        memset(hid->out->data_buffer, 0, AUDIOMOTH_HID_REPORT_LEN);
+        hid->out->data_buffer[0] = r->cmd;
+        memcpy(hid->out->data_buffer + 1, r->payload, r->len);
+        hid->err = ESP_OK;
+        hid->timed_out = false;
+        hid->deadline_ms = hid->cfg.timeout_ms ? hid->cfg.now_ms() + hid->cfg.timeout_ms : 0;
+
+        esp_err_t err = usb_host_transfer_submit(hid->in);
+        if (err == ESP_OK) {
+            hid->live = 1;
+            err = usb_host_transfer_submit(hid->out);
+            if (err == ESP_OK) {
+                hid->live = 2;
+                return;
+            }
+            // The IN half comes back canceled and finishes the request
+            hid->err = err;
+            abort_bus(hid);
+            return;
+        }
+        const hid_req_t failed = *r;
+        hid->head = (hid->head + 1) % AUDIOMOTH_HID_QUEUE_LEN;
+        hid->count--;
+        if (failed.cb && !run_cb(hid, &failed, err, NULL)) {
+            return;
+        }
+    }
+}
+
+void audiomoth_hid_poll(audiomoth_hid_t *hid)
+{
+    if (hid == NULL || hid->live == 0 || hid->deadline_ms == 0 || hid->flushed) {
+        return;
+    }
+    if (hid->cfg.now_ms() >= hid->deadline_ms) {
+        hid->timed_out = true;
+        abort_bus(hid);
+    }
+}
+
+esp_err_t audiomoth_hid_request(audiomoth_hid_t *hid, uint8_t cmd, const void *payload, size_t len,
+                                audiomoth_hid_cb_t cb, void *ctx)
+{
+    if (hid == NULL || len > AUDIOMOTH_HID_REPORT_LEN - 1 || (len && payload == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (hid->count == AUDIOMOTH_HID_QUEUE_LEN) {
+        return ESP_ERR_NO_MEM;
+    }
+    hid_req_t *r = &hid->queue[(hid->head + hid->count) % AUDIOMOTH_HID_QUEUE_LEN];
+    r->cmd = cmd;
+    r->len = (uint8_t)len;
+    if (len) {
+        memcpy(r->payload, payload, len);
+    }
+    r->cb = cb;
+    r->ctx = ctx;
+    hid->count++;
+    kick(hid);
+    return ESP_OK;
+}
+
+esp_err_t audiomoth_hid_set_time(audiomoth_hid_t *hid, uint32_t unix_time, audiomoth_hid_cb_t cb, void *ctx)
+{
+    uint8_t payload[4];
+    put_le32(payload, unix_time);
+    return audiomoth_hid_request(hid, AUDIOMOTH_HID_SET_TIME, payload, sizeof(payload), cb, ctx);
+}
+
+esp_err_t audiomoth_hid_get_time(audiomoth_hid_t *hid, audiomoth_hid_cb_t cb, void *ctx)
+{
+    return audiomoth_hid_request(hid, AUDIOMOTH_HID_GET_TIME, NULL, 0, cb, ctx);
+}
+
+esp_err_t audiomoth_hid_set_settings(audiomoth_hid_t *hid, const audiomoth_settings_t *settings,
+                                     audiomoth_hid_cb_t cb, void *ctx)
+{
+    if (settings == NULL || settings->gain > 4 || settings->filter > AUDIOMOTH_FILTER_BAND_PASS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint8_t payload[AUDIOMOTH_SETTINGS_LEN];
+    audiomoth_settings_encode(settings, payload);
+    return audiomoth_hid_request(hid, AUDIOMOTH_HID_SET_APP_PACKET, payload, sizeof(payload), cb, ctx);
+}
+
+esp_err_t audiomoth_hid_get_settings(audiomoth_hid_t *hid, audiomoth_hid_cb_t cb, void *ctx)
+{
+    return audiomoth_hid_request(hid, AUDIOMOTH_HID_GET_APP_PACKET, NULL, 0, cb, ctx);
+}
+
+esp_err_t audiomoth_hid_get_firmware_version(audiomoth_hid_t *hid, audiomoth_hid_cb_t cb, void *ctx)
+{
+    return audiomoth_hid_request(hid, AUDIOMOTH_HID_GET_FIRMWARE_VERSION, NULL, 0, cb, ctx);
+}
+
+size_t audiomoth_hid_pending(const audiomoth_hid_t *hid)
+{
+    return hid ? hid->count : 0;
+}
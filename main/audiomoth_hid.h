@@ -0,0 +1,150 @@
+// audiomoth_hid.h  (AudioMoth configuration channel over the HID interface)
+//
+// The AudioMoth USB Microphone firmware exposes a vendor protocol on its
+// HID interface: the host writes a 64-byte report to the interrupt OUT
+// endpoint, whose first byte is a command, and the device answers with a
+// 64-byte report on the interrupt IN endpoint echoing that byte. This is
+// what the AudioMoth configuration app speaks; doing it from the P4 lets a
+// device be configured in a few milliseconds at attach instead of on a PC.
+//
+// One request is on the bus at a time, through a pair of interrupt
+// transfers allocated up front; further requests wait in a fixed queue.
+// Like ctrl_xfer, it is driven by usb_host_client_handle_events() and must
+// only be used from the client task.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "usb/usb_host.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AUDIOMOTH_HID_REPORT_LEN    64
+#define AUDIOMOTH_HID_QUEUE_LEN     8
+
+/* Command bytes (first byte of both reports) */
+#define AUDIOMOTH_HID_GET_TIME              0x01
+#define AUDIOMOTH_HID_SET_TIME              0x02
+#define AUDIOMOTH_HID_GET_UID               0x03
+#define AUDIOMOTH_HID_GET_BATTERY           0x04
+#define AUDIOMOTH_HID_GET_APP_PACKET        0x05
+#define AUDIOMOTH_HID_SET_APP_PACKET        0x06
+#define AUDIOMOTH_HID_GET_FIRMWARE_VERSION  0x07
+
+typedef enum {
+    AUDIOMOTH_FILTER_NONE,
+    AUDIOMOTH_FILTER_LOW_PASS,
+    AUDIOMOTH_FILTER_HIGH_PASS,
+    AUDIOMOTH_FILTER_BAND_PASS,
+} audiomoth_filter_t;
+
+/**
+ * @brief Microphone settings carried by the app packet
+ *
+ * Encoded by audiomoth_settings_encode(), the only place that knows the
+ * byte layout (AUDIOMOTH_SETTINGS_LEN bytes after the command byte).
+ */
+typedef struct {
+    uint32_t sample_rate_hz;
+    uint8_t gain;               /**< 0 (low) .. 4 (high) */
+    audiomoth_filter_t filter;
+    uint32_t lower_filter_hz;   /**< Carried in 100 Hz steps */
+    uint32_t higher_filter_hz;
+    bool led;
+    bool low_gain_range;
+    bool energy_saver;
+} audiomoth_settings_t;
+
+#define AUDIOMOTH_SETTINGS_LEN      11
+
+typedef struct {
+    uint8_t cmd;
+    uint32_t time;              /**< GET_TIME / SET_TIME: seconds since the Unix epoch */
+    uint8_t uid[8];             /**< GET_UID */
+    uint8_t battery;            /**< GET_BATTERY: device's raw battery state */
+    audiomoth_settings_t settings;  /**< GET_APP_PACKET / SET_APP_PACKET */
+    uint8_t version[3];         /**< GET_FIRMWARE_VERSION: major, minor, patch */
+} audiomoth_hid_reply_t;
+
+/**
+ * @brief Request completion
+ *
+ * @param err    ESP_OK, ESP_ERR_TIMEOUT, ESP_ERR_INVALID_RESPONSE (short
+ *               report or reply to another command), ESP_ERR_NOT_SUPPORTED
+ *               (STALL), ESP_ERR_INVALID_STATE (device gone / cancelled) or
+ *               ESP_FAIL
+ * @param reply  Decoded reply; valid only during the call, NULL on error
+ */
+typedef void (*audiomoth_hid_cb_t)(esp_err_t err, const audiomoth_hid_reply_t *reply, void *ctx);
+
+typedef struct {
+    usb_device_handle_t dev;
+    uint8_t intf;               /**< HID interface, already claimed */
+    uint8_t ep_out;             /**< Interrupt OUT, e.g. 0x01 */
+    uint8_t ep_in;              /**< Interrupt IN, e.g. 0x81 */
+    uint32_t timeout_ms;        /**< Per request, 0 for no timeout */
+    uint64_t (*now_ms)(void);   /**< Clock for timeouts; required when timeout_ms is set */
+} audiomoth_hid_config_t;
+
+typedef struct audiomoth_hid audiomoth_hid_t;
+
+/**
+ * @brief Find a HID interface with an interrupt IN and OUT endpoint
+ *
+ * Fills intf, ep_out and ep_in of `out`; other fields are left alone.
+ *
+ * @return ESP_ERR_NOT_FOUND if there is none
+ */
+esp_err_t audiomoth_hid_find(const usb_config_desc_t *config_desc, audiomoth_hid_config_t *out);
+
+esp_err_t audiomoth_hid_create(const audiomoth_hid_config_t *config, audiomoth_hid_t **ret_hid);
+
+/**
+ * @brief Fail queued requests and free the channel
+ *
+ * If a request is on the bus, freeing waits for its transfers to come back
+ * (normally NO_DEVICE after an unplug); the callback is not run for it.
+ * May be called from a completion callback: the handle is then freed once
+ * that callback has returned.
+ */
+void audiomoth_hid_delete(audiomoth_hid_t *hid);
+
+/**
+ * @brief Time out the request on the bus if it is overdue
+ *
+ * Call periodically from the client task. The endpoints are halted and
+ * flushed; the callback gets ESP_ERR_TIMEOUT once the transfers return.
+ */
+void audiomoth_hid_poll(audiomoth_hid_t *hid);
+
+/**
+ * @brief Queue a raw command; `payload` follows the command byte
+ *
+ * @return ESP_ERR_NO_MEM if the queue is full
+ */
+esp_err_t audiomoth_hid_request(audiomoth_hid_t *hid, uint8_t cmd, const void *payload, size_t len,
+                                audiomoth_hid_cb_t cb, void *ctx);
+
+esp_err_t audiomoth_hid_set_time(audiomoth_hid_t *hid, uint32_t unix_time, audiomoth_hid_cb_t cb, void *ctx);
+esp_err_t audiomoth_hid_get_time(audiomoth_hid_t *hid, audiomoth_hid_cb_t cb, void *ctx);
+esp_err_t audiomoth_hid_set_settings(audiomoth_hid_t *hid, const audiomoth_settings_t *settings,
+                                     audiomoth_hid_cb_t cb, void *ctx);
+esp_err_t audiomoth_hid_get_settings(audiomoth_hid_t *hid, audiomoth_hid_cb_t cb, void *ctx);
+esp_err_t audiomoth_hid_get_firmware_version(audiomoth_hid_t *hid, audiomoth_hid_cb_t cb, void *ctx);
+
+/**
+ * @brief Requests queued or on the bus
+ */
+size_t audiomoth_hid_pending(const audiomoth_hid_t *hid);
+
+void audiomoth_settings_encode(const audiomoth_settings_t *settings, uint8_t out[AUDIOMOTH_SETTINGS_LEN]);
+void audiomoth_settings_decode(const uint8_t in[AUDIOMOTH_SETTINGS_LEN], audiomoth_settings_t *settings);
+
+#ifdef __cplusplus
+}
+#endif
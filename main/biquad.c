@@ -0,0 +1,311 @@
+// biquad.c  (fixed-point biquad cascade: DC removal / high-pass)
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "biquad.h"
+#include "dsp_bench.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define BIQUAD_LANES    4       /**< Channels processed side by side */
+
+#if defined(__AVX2__) && !defined(DSP_KERNELS_FORCE_SCALAR)
+#include <immintrin.h>
+#define BIQUAD_AVX2     1
+#endif
+
+struct biquad {
+    biquad_config_t cfg;
+    // Padded to whole lane groups so cascade_lanes() can copy full groups
+    int32_t s1[BIQUAD_MAX_SECTIONS][BIQUAD_MAX_CHANNELS + BIQUAD_LANES];
+    int32_t s2[BIQUAD_MAX_SECTIONS][BIQUAD_MAX_CHANNELS + BIQUAD_LANES];
+    int32_t *work;          /**< max_frames * BIQUAD_LANES widened samples */
+    uint64_t cycles;
+    uint64_t samples;
+};
+
+static inline int32_t q30_round_sat(int64_t acc)
+{
+    acc = (acc + (1LL << (BIQUAD_COEF_FRAC_BITS - 1))) >> BIQUAD_COEF_FRAC_BITS;
+    return (int32_t)(acc > INT32_MAX ? INT32_MAX : (acc < INT32_MIN ? INT32_MIN : acc));
+}
+
+static inline int16_t narrow(int32_t y)
+{
+    const int32_t r = (int32_t)(((int64_t)y + (1 << (BIQUAD_SIGNAL_SHIFT - 1))) >> BIQUAD_SIGNAL_SHIFT);
+    return (int16_t)(r > INT16_MAX ? INT16_MAX : (r < INT16_MIN ? INT16_MIN : r));
+}
+
+/* One TDF-II step; shared by both paths so the arithmetic is identical */
+static inline int32_t tdf2_step(const biquad_coeffs_t *c, int32_t x, int32_t *s1, int32_t *s2)
+{
+    const int32_t y = q30_round_sat((int64_t)c->b0 * x + (int64_t)*s1 * (1LL << BIQUAD_COEF_FRAC_BITS));
+    *s1 = q30_round_sat((int64_t)c->b1 * x - (int64_t)c->a1 * y + (int64_t)*s2 * (1LL << BIQUAD_COEF_FRAC_BITS));
+    *s2 = q30_round_sat((int64_t)c->b2 * x - (int64_t)c->a2 * y);
+    return y;
+}
+
+static esp_err_t to_q30(double v, int32_t *out)
+{
+    if (!(fabs(v) < 2.0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out = (int32_t)llround(v * (double)(1LL << BIQUAD_COEF_FRAC_BITS));
+    return ESP_OK;
+}
+
+static esp_err_t coeffs_from_double(const double b[3], const double a[3], biquad_coeffs_t *out)
+{
+    biquad_coeffs_t c;
+    if (to_q30(b[0] / a[0], &c.b0) != ESP_OK || to_q30(b[1] / a[0], &c.b1) != ESP_OK ||
+            to_q30(b[2] / a[0], &c.b2) != ESP_OK || to_q30(a[1] / a[0], &c.a1) != ESP_OK ||
+            to_q30(a[2] / a[0], &c.a2) != ESP_OK) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out = c;
+    return ESP_OK;
+}
+
+esp_err_t biquad_design_highpass(float fc_hz, float q, float fs_hz, biquad_coeffs_t *out)
+{
+    if (out == NULL || fc_hz <= 0.0f || fc_hz >= fs_hz / 2.0f || q <= 0.0f) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const double w0 = 2.0 * M_PI * fc_hz / fs_hz;
+    const double cw = cos(w0);
+    const double alpha = sin(w0) / (2.0 * q);
+    const double b[3] = { (1.0 + cw) / 2.0, -(1.0 + cw), (1.0 + cw) / 2.0 };
+    const double a[3] = { 1.0 + alpha, -2.0 * cw, 1.0 - alpha };
+    return coeffs_from_double(b, a, out);
+}
+
+esp_err_t biquad_design_dc_block(float fc_hz, float fs_hz, biquad_coeffs_t *out)
+{
+    if (out == NULL || fc_hz <= 0.0f || fc_hz >= fs_hz / 2.0f) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const double r = exp(-2.0 * M_PI * fc_hz / fs_hz);
+    const double b[3] = { 1.0, -1.0, 0.0 };
+    const double a[3] = { 1.0, -r, 0.0 };
+    return coeffs_from_double(b, a, out);
+}
+
+esp_err_t biquad_create(const biquad_config_t *config, biquad_t **ret_bq)
+{
+    if (config == NULL || ret_bq == NULL || config->num_sections == 0 ||
+            config->num_sections > BIQUAD_MAX_SECTIONS || config->channels == 0 ||
+            config->channels > BIQUAD_MAX_CHANNELS || config->max_frames == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    biquad_t *bq = calloc(1, sizeof(*bq));
+    if (bq == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    bq->cfg = *config;
+    bq->work = malloc(config->max_frames * BIQUAD_LANES * sizeof(int32_t));
+    if (bq->work == NULL) {
+        free(bq);
+        return ESP_ERR_NO_MEM;
+    }
+    *ret_bq = bq;
+    return ESP_OK;
+}
+
+void biquad_delete(biquad_t *bq)
+{
+    if (bq == NULL) {
+        return;
+    }
+    free(bq->work);
+    free(bq);
+}
+
+void biquad_reset(biquad_t *bq)
+{
+    memset(bq->s1, 0, sizeof(bq->s1));
+    memset(bq->s2, 0, sizeof(bq->s2));
+}
+
+esp_err_t biquad_set_sections(biquad_t *bq, const biquad_coeffs_t *sections, size_t num_sections)
+{
+    if (bq == NULL || sections == NULL || num_sections != bq->cfg.num_sections) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(bq->cfg.sections, sections, num_sections * sizeof(biquad_coeffs_t));
+    biquad_reset(bq);
+    return ESP_OK;
+}
+
+static void cascade_mono(biquad_t *bq, int32_t *buf, size_t frames)
+{
+    // Sample-major: the sections of one sample form a dependency chain, but
+    // consecutive samples overlap in the pipeline
+    const size_t ns = bq->cfg.num_sections;
+    int32_t s1[BIQUAD_MAX_SECTIONS], s2[BIQUAD_MAX_SECTIONS];
+    for (size_t s = 0; s < ns; s++) {
+        s1[s] = bq->s1[s][0];
+        s2[s] = bq->s2[s][0];
+    }
+    for (size_t f = 0; f < frames; f++) {
+        int32_t v = buf[f];
+        for (size_t s = 0; s < ns; s++) {
+            v = tdf2_step(&bq->cfg.sections[s], v, &s1[s], &s2[s]);
+        }
+        buf[f] = v;
+    }
+    for (size_t s = 0; s < ns; s++) {
+        bq->s1[s][0] = s1[s];
+        bq->s2[s][0] = s2[s];
+    }
+}
+
+#if BIQUAD_AVX2
+/* AVX2 has no 64-bit arithmetic shift: shift logically and sign-extend from bit 63 - n */
+static inline __m256i q30_round_sat_x4(__m256i acc)
+{
+    const __m256i sign = _mm256_set1_epi64x(1LL << (63 - BIQUAD_COEF_FRAC_BITS));
+    acc = _mm256_add_epi64(acc, _mm256_set1_epi64x(1LL << (BIQUAD_COEF_FRAC_BITS - 1)));
+    acc = _mm256_sub_epi64(_mm256_xor_si256(_mm256_srli_epi64(acc, BIQUAD_COEF_FRAC_BITS), sign), sign);
+    const __m256i hi = _mm256_set1_epi64x(INT32_MAX), lo = _mm256_set1_epi64x(INT32_MIN);
+    acc = _mm256_blendv_epi8(acc, hi, _mm256_cmpgt_epi64(acc, hi));
+    return _mm256_blendv_epi8(acc, lo, _mm256_cmpgt_epi64(lo, acc));
+}
+
+static void cascade_lanes(biquad_t *bq, int32_t *buf, size_t frames, size_t first_ch)
+{
+    // Lanes are int64 holding int32 values; _mm256_mul_epi32 multiplies the
+    // low signed halves, matching the scalar (int64_t)c * x exactly
+    const size_t ns = bq->cfg.num_sections;
+    __m256i s1[BIQUAD_MAX_SECTIONS], s2[BIQUAD_MAX_SECTIONS];
+    __m256i b0[BIQUAD_MAX_SECTIONS], b1[BIQUAD_MAX_SECTIONS], b2[BIQUAD_MAX_SECTIONS];
+    __m256i a1[BIQUAD_MAX_SECTIONS], a2[BIQUAD_MAX_SECTIONS];
+    for (size_t s = 0; s < ns; s++) {
+        s1[s] = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)&bq->s1[s][first_ch]));
+        s2[s] = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)&bq->s2[s][first_ch]));
+        b0[s] = _mm256_set1_epi64x(bq->cfg.sections[s].b0);
+        b1[s] = _mm256_set1_epi64x(bq->cfg.sections[s].b1);
+        b2[s] = _mm256_set1_epi64x(bq->cfg.sections[s].b2);
+        a1[s] = _mm256_set1_epi64x(bq->cfg.sections[s].a1);
+        a2[s] = _mm256_set1_epi64x(bq->cfg.sections[s].a2);
+    }
+    const __m256i pack = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+    for (size_t f = 0; f < frames; f++) {
+        __m256i x = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(buf + f * BIQUAD_LANES)));
+        for (size_t s = 0; s < ns; s++) {
+            const __m256i y = q30_round_sat_x4(_mm256_add_epi64(_mm256_mul_epi32(b0[s], x),
+                                                                _mm256_slli_epi64(s1[s], BIQUAD_COEF_FRAC_BITS)));
+            s1[s] = q30_round_sat_x4(_mm256_add_epi64(_mm256_sub_epi64(_mm256_mul_epi32(b1[s], x),
+                                                                       _mm256_mul_epi32(a1[s], y)),
+                                                      _mm256_slli_epi64(s2[s], BIQUAD_COEF_FRAC_BITS)));
+            s2[s] = q30_round_sat_x4(_mm256_sub_epi64(_mm256_mul_epi32(b2[s], x), _mm256_mul_epi32(a2[s], y)));
+            x = y;
+        }
+        _mm_storeu_si128((__m128i *)(buf + f * BIQUAD_LANES),
+                         _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(x, pack)));
+    }
+    for (size_t s = 0; s < ns; s++) {
+        _mm_storeu_si128((__m128i *)&bq->s1[s][first_ch], _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(s1[s], pack)));
+        _mm_storeu_si128((__m128i *)&bq->s2[s][first_ch], _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(s2[s], pack)));
+    }
+}
+#else
+static void cascade_lanes(biquad_t *bq, int32_t *buf, size_t frames, size_t first_ch)
+{
+    // BIQUAD_LANES independent channel recurrences side by side; on an
+    // in-order core this is where the instruction-level parallelism comes from
+    const size_t ns = bq->cfg.num_sections;
+    int32_t s1[BIQUAD_MAX_SECTIONS][BIQUAD_LANES], s2[BIQUAD_MAX_SECTIONS][BIQUAD_LANES];
+    for (size_t s = 0; s < ns; s++) {
+        memcpy(s1[s], &bq->s1[s][first_ch], sizeof(s1[s]));
+        memcpy(s2[s], &bq->s2[s][first_ch], sizeof(s2[s]));
+    }
+    for (size_t f = 0; f < frames; f++) {
+        int32_t *x = buf + f * BIQUAD_LANES;
+        for (size_t s = 0; s < ns; s++) {
+            const biquad_coeffs_t *c = &bq->cfg.sections[s];
+            for (size_t k = 0; k < BIQUAD_LANES; k++) {
+                x[k] = tdf2_step(c, x[k], &s1[s][k], &s2[s][k]);
+            }
+        }
+    }
+    for (size_t s = 0; s < ns; s++) {
+        memcpy(&bq->s1[s][first_ch], s1[s], sizeof(s1[s]));
+        memcpy(&bq->s2[s][first_ch], s2[s], sizeof(s2[s]));
+    }
+}
+#endif
+
+void biquad_process(biquad_t *bq, int16_t *samples, size_t frames)
+{
+    const uint64_t t_start = dsp_bench_cycles();
+    const size_t ch = bq->cfg.channels;
+    bq->samples += frames;
+
+    if (ch == 2) {
+        // Half-empty lane groups cost more than they save
+        biquad_process_ref(bq, samples, frames);
+        frames = 0;
+    }
+    while (frames) {
+        const size_t nf = frames < bq->cfg.max_frames ? frames : bq->cfg.max_frames;
+        if (ch == 1) {
+            for (size_t f = 0; f < nf; f++) {
+                bq->work[f] = (int32_t)samples[f] * (1 << BIQUAD_SIGNAL_SHIFT);
+            }
+            cascade_mono(bq, bq->work, nf);
+            for (size_t f = 0; f < nf; f++) {
+                samples[f] = narrow(bq->work[f]);
+            }
+        } else {
+            // Deinterleave one group of lanes at a time; padding lanes run on zeros
+            for (size_t g = 0; g < ch; g += BIQUAD_LANES) {
+                const size_t nl = ch - g < BIQUAD_LANES ? ch - g : BIQUAD_LANES;
+                for (size_t f = 0; f < nf; f++) {
+                    for (size_t k = 0; k < BIQUAD_LANES; k++) {
+                        bq->work[f * BIQUAD_LANES + k] = k < nl
+                                                         ? (int32_t)samples[f * ch + g + k] * (1 << BIQUAD_SIGNAL_SHIFT) : 0;
+                    }
+                }
+                cascade_lanes(bq, bq->work, nf, g);
+                for (size_t f = 0; f < nf; f++) {
+                    for (size_t k = 0; k < nl; k++) {
+                        samples[f * ch + g + k] = narrow(bq->work[f * BIQUAD_LANES + k]);
+                    }
+                }
+            }
+        }
+        samples += nf * ch;
+        frames -= nf;
+    }
+    bq->cycles += dsp_bench_cycles() - t_start;
+}
+
+void biquad_process_ref(biquad_t *bq, int16_t *samples, size_t frames)
+{
+    const size_t ch = bq->cfg.channels;
+    for (size_t f = 0; f < frames; f++) {
+        for (size_t k = 0; k < ch; k++) {
+            int32_t v = (int32_t)samples[f * ch + k] * (1 << BIQUAD_SIGNAL_SHIFT);
+            for (size_t s = 0; s < bq->cfg.num_sections; s++) {
+                v = tdf2_step(&bq->cfg.sections[s], v, &bq->s1[s][k], &bq->s2[s][k]);
+            }
+            samples[f * ch + k] = narrow(v);
+        }
+    }
+}
+
+void biquad_stream_filter(int16_t *samples, size_t n, uint64_t t0, void *ctx)
+{
+    (void)t0;
+    // State carries across gaps: a lost packet costs a small transient, a
+    // reset would cost a full settling time
+    biquad_process((biquad_t *)ctx, samples, n);
+}
+
+double biquad_cycles_per_sample(const biquad_t *bq)
+{
+    return bq->samples ? (double)bq->cycles / (double)(bq->samples * bq->cfg.channels) : 0.0;
+}
@@ -0,0 +1,92 @@
+// biquad.h  (fixed-point biquad cascade: DC removal / high-pass)
+//
+// Transposed direct form II, Q30 coefficients, Q31 state words. Samples are
+// widened so int16 full scale sits at 2^27 inside the state, which leaves
+// 24 dB of headroom for the state overshoot of steep high-pass sections.
+// Pure integer arithmetic, so the target and Linux builds are bit-exact.
+//
+// Blocks are interleaved multi-channel (one channel per device). With three
+// or more channels the cascade runs four channels side by side (AVX2 on the
+// host, plain lane loops elsewhere), since an IIR can't be vectorized along
+// time but independent channels can.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BIQUAD_MAX_SECTIONS     8
+#define BIQUAD_MAX_CHANNELS     8
+#define BIQUAD_COEF_FRAC_BITS   30  /**< Coefficients are Q30: |c| < 2 */
+#define BIQUAD_SIGNAL_SHIFT     12  /**< int16 -> state scaling */
+
+typedef struct {
+    int32_t b0, b1, b2;     /**< Feed-forward, Q30 */
+    int32_t a1, a2;         /**< Feedback, Q30 (a0 == 1) */
+} biquad_coeffs_t;
+
+typedef struct {
+    size_t num_sections;
+    biquad_coeffs_t sections[BIQUAD_MAX_SECTIONS];
+    size_t channels;        /**< Interleaved channels per frame, 1..BIQUAD_MAX_CHANNELS */
+    size_t max_frames;      /**< Largest block biquad_process() will be given */
+} biquad_config_t;
+
+typedef struct biquad biquad_t;
+
+/**
+ * @brief 2nd-order high-pass (RBJ cookbook), e.g. q = 0.7071 for Butterworth
+ */
+esp_err_t biquad_design_highpass(float fc_hz, float q, float fs_hz, biquad_coeffs_t *out);
+
+/**
+ * @brief 1st-order DC blocker (1 - z^-1) / (1 - r z^-1) with its -3 dB point at fc_hz
+ */
+esp_err_t biquad_design_dc_block(float fc_hz, float fs_hz, biquad_coeffs_t *out);
+
+esp_err_t biquad_create(const biquad_config_t *config, biquad_t **ret_bq);
+void biquad_delete(biquad_t *bq);
+
+/**
+ * @brief Clear the filter state of every section and channel
+ */
+void biquad_reset(biquad_t *bq);
+
+/**
+ * @brief Replace the coefficients (e.g. redesigned for a new sample rate) and clear the state
+ *
+ * @param num_sections Must match the configured section count
+ */
+esp_err_t biquad_set_sections(biquad_t *bq, const biquad_coeffs_t *sections, size_t num_sections);
+
+/**
+ * @brief Filter an interleaved block in place
+ *
+ * @param frames Frames (samples per channel), at most config->max_frames;
+ *               larger blocks are processed in max_frames pieces
+ */
+void biquad_process(biquad_t *bq, int16_t *samples, size_t frames);
+
+/**
+ * @brief Sample-at-a-time reference of biquad_process(); must match it bit for bit
+ */
+void biquad_process_ref(biquad_t *bq, int16_t *samples, size_t frames);
+
+/**
+ * @brief audio_stream_filter_t adapter for a mono cascade; ctx is the biquad_t
+ */
+void biquad_stream_filter(int16_t *samples, size_t n, uint64_t t0, void *ctx);
+
+/**
+ * @brief Average cycles per sample (per channel) spent in biquad_process() so far
+ */
+double biquad_cycles_per_sample(const biquad_t *bq);
+
+#ifdef __cplusplus
+}
+#endif
@@ -4,80 +4,219 @@
  * SPDX-License-Identifier: Unlicense OR CC0-1.0
  */
 
+#include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
+#include "freertos/task.h"
 #include "esp_log.h"
 #include "usb/usb_host.h"
+#include "class_driver.h"
 
-#define CLIENT_NUM_EVENT_MSG        5
+#define CLIENT_NUM_EVENT_MSG        16
+#define DESC_CACHE_ENTRIES          8
+#define CTRL_POOL_SIZE              8
+#define CTRL_MAX_DATA_LEN           128     // UAC 2.0 GET RANGE with UAC_MAX_FREQS subranges
 
 typedef enum {
     ACTION_OPEN_DEV         = (1 << 0),
-    ACTION_GET_DEV_INFO     = (1 << 1),
-    ACTION_GET_DEV_DESC     = (1 << 2),
-    ACTION_GET_CONFIG_DESC  = (1 << 3),
-    ACTION_GET_STR_DESC     = (1 << 4),
-    ACTION_CLOSE_DEV        = (1 << 5),
+    ACTION_PROBE_DEV        = (1 << 1),
+    ACTION_CLOSE_DEV        = (1 << 2),
 } action_t;
 
-#define DEV_MAX_COUNT           128
+#define DEV_MAX_COUNT           128     /**< USB address space */
+#define DEV_SLOT_COUNT          16      /**< Devices handled at the same time (hubs included) */
+#define DEV_SLOT_NONE           0xFF
+#define DEV_HDL_BUCKETS         (2 * DEV_SLOT_COUNT)
+
+_Static_assert(CTRL_XFER_MAX_DEVICES >= DEV_SLOT_COUNT, "every device slot needs a control-transfer queue");
 
 typedef struct {
-    usb_host_client_handle_t client_hdl;
-    uint8_t dev_addr;
-    usb_device_handle_t dev_hdl;
-    action_t actions;
+    class_driver_dev_t dev;             /**< What the drivers see; dev.dev_hdl is NULL until opened */
+    desc_cache_entry_t desc;            /**< Parse results, copied so another device's store can't move them */
+    action_t actions;                   /**< Next steps of this device's state machine. Only the class driver task touches it */
+    bool closing;                       /**< Detach started; no more polling */
+    uint8_t attached;                   /**< Bit per registered driver holding the device */
+    void *ctx[CLASS_DRIVER_MAX];        /**< Per-driver device context */
 } usb_device_t;
 
 typedef struct {
     struct {
         union {
             struct {
-                uint8_t unhandled_devices: 1;   /**< Device has unhandled devices */
-                uint8_t shutdown: 1;            /**<  */
+                uint8_t shutdown: 1;            /**< Deregister once the pending queue is empty */
+                uint8_t reenumerate: 1;         /**< Close every device, then free them all */
                 uint8_t reserved6: 6;           /**< Reserved */
             };
             uint8_t val;                        /**< Class drivers' flags value */
         } flags;                                /**< Class drivers' flags */
-        usb_device_t device[DEV_MAX_COUNT];     /**< Class drivers' static array of devices */
+        action_t requested[DEV_SLOT_COUNT];     /**< Actions posted for each slot since it was last dequeued */
+        uint8_t pending[DEV_SLOT_COUNT];        /**< FIFO of slots with requested actions, each slot at most once */
+        uint8_t pending_head;
+        uint8_t pending_count;
     } mux_protected;                            /**< Mutex protected members. Must be protected by the Class mux_lock when accessed */
 
+    struct {
+        usb_device_t device[DEV_SLOT_COUNT];    /**< Per-slot device state */
+        uint8_t addr_to_slot[DEV_MAX_COUNT];    /**< Bus address -> slot, DEV_SLOT_NONE if unused */
+        uint8_t hdl_bucket[DEV_HDL_BUCKETS];    /**< Open-addressed device handle -> slot index */
+        uint32_t used_slots;                    /**< Bit per allocated slot */
+        uint32_t close_waiting;                 /**< Bit per slot whose drivers are still detaching */
+        bool closing;                           /**< Shutdown: every device has been told to close */
+        bool reenumerating;                     /**< Every device has been told to close; free them once closed */
+        uint32_t reenumerate_waiting;           /**< Bit per slot told to close for it and not freed yet */
+        bool poll_soon;                         /**< A driver asked to be polled again shortly */
+    } single_thread;                            /**< Only accessed from the USB client context (class driver task and its callbacks) */
+
     struct {
         usb_host_client_handle_t client_hdl;
         SemaphoreHandle_t mux_lock;         /**< Mutex for protected members */
+        ctrl_xfer_t *ctrl;                  /**< EP0 engine shared by the drivers */
+        desc_cache_t *desc_cache;           /**< Parse results per device identity, shared by every slot */
+        usb_bw_t *bw;                       /**< Periodic bandwidth reserved by the drivers */
     } constant;                                 /**< Constant members. Do not change after installation thus do not require a critical section or mutex */
 } class_driver_t;
 
+typedef struct {
+    const class_driver_ops_t *ops;
+    void *arg;
+} registry_entry_t;
+
 static const char *TAG = "CLASS";
 static class_driver_t *s_driver_obj;
+static registry_entry_t s_registry[CLASS_DRIVER_MAX];
+static uint8_t s_num_drivers;
+
+static inline uint32_t hdl_hash(usb_device_handle_t dev_hdl)
+{
+    // Fibonacci hash of the handle pointer
+    return (uint32_t)(((uintptr_t)dev_hdl >> 2) * 2654435761u) % DEV_HDL_BUCKETS;
+}
+
+static uint8_t hdl_lookup(const class_driver_t *driver_obj, usb_device_handle_t dev_hdl)
+{
+    for (uint32_t i = 0, b = hdl_hash(dev_hdl); i < DEV_HDL_BUCKETS; i++, b = (b + 1) % DEV_HDL_BUCKETS) {
+        const uint8_t slot = driver_obj->single_thread.hdl_bucket[b];
+        if (slot == DEV_SLOT_NONE) {
+            break;
+        }
+        if (driver_obj->single_thread.device[slot].dev.dev_hdl == dev_hdl) {
+            return slot;
+        }
+    }
+    return DEV_SLOT_NONE;
+}
+
+static void hdl_insert(class_driver_t *driver_obj, uint8_t slot)
+{
+    uint32_t b = hdl_hash(driver_obj->single_thread.device[slot].dev.dev_hdl);
+    while (driver_obj->single_thread.hdl_bucket[b] != DEV_SLOT_NONE) {
+        b = (b + 1) % DEV_HDL_BUCKETS;
+    }
+    driver_obj->single_thread.hdl_bucket[b] = slot;
+}
+
+static void hdl_remove(class_driver_t *driver_obj, uint8_t slot)
+{
+    uint8_t *buckets = driver_obj->single_thread.hdl_bucket;
+    uint32_t b = 0;
+    while (buckets[b] != slot) {
+        b++;
+    }
+    buckets[b] = DEV_SLOT_NONE;
+    // Re-insert the rest of the probe run so later lookups don't stop early
+    for (uint32_t n = (b + 1) % DEV_HDL_BUCKETS; buckets[n] != DEV_SLOT_NONE; n = (n + 1) % DEV_HDL_BUCKETS) {
+        const uint8_t moved = buckets[n];
+        buckets[n] = DEV_SLOT_NONE;
+        hdl_insert(driver_obj, moved);
+    }
+}
+
+static uint8_t slot_alloc(class_driver_t *driver_obj, uint8_t dev_addr)
+{
+    const uint32_t free_slots = ~driver_obj->single_thread.used_slots & ((1ull << DEV_SLOT_COUNT) - 1);
+    if (free_slots == 0) {
+        return DEV_SLOT_NONE;
+    }
+    const uint8_t slot = (uint8_t)__builtin_ctz(free_slots);
+    usb_device_t *device_obj = &driver_obj->single_thread.device[slot];
+    driver_obj->single_thread.used_slots |= 1u << slot;
+    driver_obj->single_thread.addr_to_slot[dev_addr] = slot;
+    memset(device_obj, 0, sizeof(*device_obj));
+    device_obj->dev.client = driver_obj->constant.client_hdl;
+    device_obj->dev.ctrl = driver_obj->constant.ctrl;
+    device_obj->dev.bw = driver_obj->constant.bw;
+    device_obj->dev.dev_addr = dev_addr;
+    device_obj->dev.desc = &device_obj->desc;
+    return slot;
+}
+
+static void slot_free(class_driver_t *driver_obj, uint8_t slot)
+{
+    usb_device_t *device_obj = &driver_obj->single_thread.device[slot];
+    driver_obj->single_thread.addr_to_slot[device_obj->dev.dev_addr] = DEV_SLOT_NONE;
+    driver_obj->single_thread.used_slots &= ~(1u << slot);
+    driver_obj->single_thread.reenumerate_waiting &= ~(1u << slot);
+    device_obj->dev.dev_addr = 0;
+}
+
+/* Post actions for a slot. The only work done under the mutex. */
+static void slot_enqueue(class_driver_t *driver_obj, uint8_t slot, action_t actions, bool replace)
+{
+    xSemaphoreTake(driver_obj->constant.mux_lock, portMAX_DELAY);
+    if (driver_obj->mux_protected.requested[slot] == 0) {
+        const uint8_t tail = (driver_obj->mux_protected.pending_head + driver_obj->mux_protected.pending_count) % DEV_SLOT_COUNT;
+        driver_obj->mux_protected.pending[tail] = slot;
+        driver_obj->mux_protected.pending_count++;
+    }
+    if (replace) {
+        driver_obj->mux_protected.requested[slot] = actions;
+    } else {
+        driver_obj->mux_protected.requested[slot] |= actions;
+    }
+    xSemaphoreGive(driver_obj->constant.mux_lock);
+}
+
+/* Pop the next slot and its requested actions, DEV_SLOT_NONE if the queue is empty */
+static uint8_t slot_dequeue(class_driver_t *driver_obj, action_t *actions)
+{
+    uint8_t slot = DEV_SLOT_NONE;
+    xSemaphoreTake(driver_obj->constant.mux_lock, portMAX_DELAY);
+    if (driver_obj->mux_protected.pending_count) {
+        slot = driver_obj->mux_protected.pending[driver_obj->mux_protected.pending_head];
+        driver_obj->mux_protected.pending_head = (driver_obj->mux_protected.pending_head + 1) % DEV_SLOT_COUNT;
+        driver_obj->mux_protected.pending_count--;
+        *actions = driver_obj->mux_protected.requested[slot];
+        driver_obj->mux_protected.requested[slot] = 0;
+    }
+    xSemaphoreGive(driver_obj->constant.mux_lock);
+    return slot;
+}
 
 static void client_event_cb(const usb_host_client_event_msg_t *event_msg, void *arg)
 {
     class_driver_t *driver_obj = (class_driver_t *)arg;
+    uint8_t slot;
     switch (event_msg->event) {
     case USB_HOST_CLIENT_EVENT_NEW_DEV:
-        // Save the device address
-        xSemaphoreTake(driver_obj->constant.mux_lock, portMAX_DELAY);
-        driver_obj->mux_protected.device[event_msg->new_dev.address].dev_addr = event_msg->new_dev.address;
-        driver_obj->mux_protected.device[event_msg->new_dev.address].dev_hdl = NULL;
+        slot = driver_obj->single_thread.addr_to_slot[event_msg->new_dev.address];
+        if (slot == DEV_SLOT_NONE) {
+            slot = slot_alloc(driver_obj, event_msg->new_dev.address);
+        }
+        if (slot == DEV_SLOT_NONE) {
+            ESP_LOGW(TAG, "No free slot for device at address %d", event_msg->new_dev.address);
+            break;
+        }
         // Open the device next
-        driver_obj->mux_protected.device[event_msg->new_dev.address].actions |= ACTION_OPEN_DEV;
-        // Set flag
-        driver_obj->mux_protected.flags.unhandled_devices = 1;
-        xSemaphoreGive(driver_obj->constant.mux_lock);
+        slot_enqueue(driver_obj, slot, ACTION_OPEN_DEV, false);
         break;
     case USB_HOST_CLIENT_EVENT_DEV_GONE:
         // Cancel any other actions and close the device next
-        xSemaphoreTake(driver_obj->constant.mux_lock, portMAX_DELAY);
-        for (uint8_t i = 0; i < DEV_MAX_COUNT; i++) {
-            if (driver_obj->mux_protected.device[i].dev_hdl == event_msg->dev_gone.dev_hdl) {
-                driver_obj->mux_protected.device[i].actions = ACTION_CLOSE_DEV;
-                // Set flag
-                driver_obj->mux_protected.flags.unhandled_devices = 1;
-            }
+        slot = hdl_lookup(driver_obj, event_msg->dev_gone.dev_hdl);
+        if (slot != DEV_SLOT_NONE) {
+            slot_enqueue(driver_obj, slot, ACTION_CLOSE_DEV, true);
         }
-        xSemaphoreGive(driver_obj->constant.mux_lock);
         break;
     default:
         // Should never occur
@@ -85,129 +224,219 @@ static void client_event_cb(const usb_host_client_event_msg_t *event_msg, void *
     }
 }
 
-static void action_open_dev(usb_device_t *device_obj)
+static bool driver_matches(const class_driver_ops_t *ops, const usb_intf_desc_t *intf)
 {
-    assert(device_obj->dev_addr != 0);
-    ESP_LOGI(TAG, "Opening device at address %d", device_obj->dev_addr);
-    ESP_ERROR_CHECK(usb_host_device_open(device_obj->client_hdl, device_obj->dev_addr, &device_obj->dev_hdl));
-    // Get the device's information next
-    device_obj->actions |= ACTION_GET_DEV_INFO;
+    return (ops->intf_class == CLASS_DRIVER_MATCH_ANY || ops->intf_class == intf->bInterfaceClass) &&
+           (ops->intf_subclass == CLASS_DRIVER_MATCH_ANY || ops->intf_subclass == intf->bInterfaceSubClass);
 }
 
-static void action_get_info(usb_device_t *device_obj)
+/* Next interface descriptor (alternate setting 0) after `prev`, NULL at the end */
+static const usb_intf_desc_t *next_intf(const usb_config_desc_t *config_desc, const usb_intf_desc_t *prev)
 {
-    assert(device_obj->dev_hdl != NULL);
-    ESP_LOGI(TAG, "Getting device information");
-    usb_device_info_t dev_info;
-    ESP_ERROR_CHECK(usb_host_device_info(device_obj->dev_hdl, &dev_info));
-    ESP_LOGI(TAG, "\t%s speed", (char *[]) {
-        "Low", "Full", "High"
-    }[dev_info.speed]);
-    ESP_LOGI(TAG, "\tParent info:");
-    if (dev_info.parent.dev_hdl) {
-        usb_device_info_t parent_dev_info;
-        ESP_ERROR_CHECK(usb_host_device_info(dev_info.parent.dev_hdl, &parent_dev_info));
-        ESP_LOGI(TAG, "\t\tBus addr: %d", parent_dev_info.dev_addr);
-        ESP_LOGI(TAG, "\t\tPort: %d", dev_info.parent.port_num);
-
-    } else {
-        ESP_LOGI(TAG, "\t\tPort: ROOT");
+    const uint8_t *p = prev ? (const uint8_t *)prev + prev->bLength : (const uint8_t *)config_desc;
+    const uint8_t *end = (const uint8_t *)config_desc + config_desc->wTotalLength;
+    for (; p + 2 <= end && p[0] >= 2 && p + p[0] <= end; p += p[0]) {
+        if (p[1] == USB_B_DESCRIPTOR_TYPE_INTERFACE && p[0] >= sizeof(usb_intf_desc_t) &&
+                ((const usb_intf_desc_t *)p)->bAlternateSetting == 0) {
+            return (const usb_intf_desc_t *)p;
+        }
     }
-    ESP_LOGI(TAG, "\tbConfigurationValue %d", dev_info.bConfigurationValue);
-    // Get the device descriptor next
-    device_obj->actions |= ACTION_GET_DEV_DESC;
+    return NULL;
 }
 
-static void action_get_dev_desc(usb_device_t *device_obj)
-{
-    assert(device_obj->dev_hdl != NULL);
-    ESP_LOGI(TAG, "Getting device descriptor");
-    const usb_device_desc_t *dev_desc;
-    ESP_ERROR_CHECK(usb_host_get_device_descriptor(device_obj->dev_hdl, &dev_desc));
-    usb_print_device_descriptor(dev_desc);
-    // Get the device's config descriptor next
-    device_obj->actions |= ACTION_GET_CONFIG_DESC;
-}
-
-static void action_get_config_desc(usb_device_t *device_obj)
+static void action_open_dev(usb_device_t *device_obj)
 {
-    assert(device_obj->dev_hdl != NULL);
-    ESP_LOGI(TAG, "Getting config descriptor");
-    const usb_config_desc_t *config_desc;
-    ESP_ERROR_CHECK(usb_host_get_active_config_descriptor(device_obj->dev_hdl, &config_desc));
-    usb_print_config_descriptor(config_desc, NULL);
-    // Get the device's string descriptors next
-    device_obj->actions |= ACTION_GET_STR_DESC;
+    assert(device_obj->dev.dev_addr != 0);
+    ESP_LOGI(TAG, "Opening device at address %d", device_obj->dev.dev_addr);
+    esp_err_t err = usb_host_device_open(device_obj->dev.client, device_obj->dev.dev_addr, &device_obj->dev.dev_hdl);
+    if (err != ESP_OK) {
+        // Gone again before we got to it
+        ESP_LOGW(TAG, "Opening address %d failed: %s", device_obj->dev.dev_addr, esp_err_to_name(err));
+        device_obj->dev.dev_hdl = NULL;
+        return;
+    }
+    // Identify it and hand it to the drivers next
+    device_obj->actions |= ACTION_PROBE_DEV;
 }
 
-static void action_get_str_desc(usb_device_t *device_obj)
+static void action_probe_dev(class_driver_t *driver_obj, usb_device_t *device_obj)
 {
-    assert(device_obj->dev_hdl != NULL);
-    usb_device_info_t dev_info;
-    ESP_ERROR_CHECK(usb_host_device_info(device_obj->dev_hdl, &dev_info));
-    if (dev_info.str_desc_manufacturer) {
-        ESP_LOGI(TAG, "Getting Manufacturer string descriptor");
-        usb_print_string_descriptor(dev_info.str_desc_manufacturer);
+    class_driver_dev_t *dev = &device_obj->dev;
+    assert(dev->dev_hdl != NULL);
+    if (usb_host_get_active_config_descriptor(dev->dev_hdl, &dev->config_desc) != ESP_OK) {
+        ESP_LOGW(TAG, "Device at address %d has no active configuration", dev->dev_addr);
+        return;
     }
-    if (dev_info.str_desc_product) {
-        ESP_LOGI(TAG, "Getting Product string descriptor");
-        usb_print_string_descriptor(dev_info.str_desc_product);
+
+    // Seen before with the same descriptors: skip parsing
+    desc_cache_entry_t *entry = &device_obj->desc;
+    memset(entry, 0, sizeof(*entry));
+    desc_cache_key_from_device(dev->dev_hdl, &entry->key);
+    const desc_cache_entry_t *cached = desc_cache_lookup(driver_obj->constant.desc_cache, &entry->key, dev->config_desc);
+    dev->cache_hit = cached != NULL;
+    if (cached) {
+        *entry = *cached;
+    } else {
+        for (const usb_intf_desc_t *intf = next_intf(dev->config_desc, NULL); intf; intf = next_intf(dev->config_desc, intf)) {
+            for (uint8_t i = 0; i < s_num_drivers; i++) {
+                if (s_registry[i].ops->parse && driver_matches(s_registry[i].ops, intf)) {
+                    s_registry[i].ops->parse(dev->config_desc, intf, entry, s_registry[i].arg);
+                }
+            }
+        }
+        desc_cache_store(driver_obj->constant.desc_cache, entry, dev->config_desc);
     }
-    if (dev_info.str_desc_serial_num) {
-        ESP_LOGI(TAG, "Getting Serial Number string descriptor");
-        usb_print_string_descriptor(dev_info.str_desc_serial_num);
+
+    // Each driver takes the device at most once, from its first matching interface
+    for (const usb_intf_desc_t *intf = next_intf(dev->config_desc, NULL); intf; intf = next_intf(dev->config_desc, intf)) {
+        for (uint8_t i = 0; i < s_num_drivers; i++) {
+            const class_driver_ops_t *ops = s_registry[i].ops;
+            if ((device_obj->attached & (1u << i)) || !driver_matches(ops, intf)) {
+                continue;
+            }
+            esp_err_t err = ops->attach(dev, intf, s_registry[i].arg, &device_obj->ctx[i]);
+            if (err == ESP_OK) {
+                ESP_LOGI(TAG, "%s driver attached to interface %d of address %d", ops->name,
+                         intf->bInterfaceNumber, dev->dev_addr);
+                device_obj->attached |= 1u << i;
+            } else if (err != ESP_ERR_NOT_SUPPORTED) {
+                ESP_LOGE(TAG, "%s driver attach failed: %s", ops->name, esp_err_to_name(err));
+            }
+        }
     }
 }
 
-static void action_close_dev(usb_device_t *device_obj)
+/* Detach every driver, then close. False while a driver or EP0 still has transfers out. */
+static bool action_close_dev(class_driver_t *driver_obj, usb_device_t *device_obj)
 {
-    ESP_ERROR_CHECK(usb_host_device_close(device_obj->client_hdl, device_obj->dev_hdl));
-    device_obj->dev_hdl = NULL;
-    device_obj->dev_addr = 0;
+    class_driver_dev_t *dev = &device_obj->dev;
+    device_obj->closing = true;
+    ctrl_xfer_cancel_device(driver_obj->constant.ctrl, dev->dev_hdl);
+    for (uint32_t attached = device_obj->attached; attached; attached &= attached - 1) {
+        const uint8_t i = (uint8_t)__builtin_ctz(attached);
+        esp_err_t err = s_registry[i].ops->detach(dev, device_obj->ctx[i]);
+        if (err == ESP_ERR_NOT_FINISHED) {
+            continue;
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "%s driver detach failed: %s", s_registry[i].ops->name, esp_err_to_name(err));
+        }
+        device_obj->attached &= ~(1u << i);
+        device_obj->ctx[i] = NULL;
+    }
+    if (device_obj->attached || ctrl_xfer_pending(driver_obj->constant.ctrl, dev->dev_hdl)) {
+        return false;
+    }
+    ESP_ERROR_CHECK(usb_host_device_close(dev->client, dev->dev_hdl));
+    dev->dev_hdl = NULL;
+    usb_bw_release_device(driver_obj->constant.bw, dev->dev_addr);
+    return true;
 }
 
-static void class_driver_device_handle(usb_device_t *device_obj)
+static void class_driver_device_handle(class_driver_t *driver_obj, uint8_t slot, action_t requested)
 {
-    uint8_t actions = device_obj->actions;
+    usb_device_t *device_obj = &driver_obj->single_thread.device[slot];
+    uint8_t actions = device_obj->actions | requested;
     device_obj->actions = 0;
+    if (actions & ACTION_CLOSE_DEV) {
+        // Gone or shutting down: drop whatever enumeration step was next
+        actions = device_obj->dev.dev_hdl ? ACTION_CLOSE_DEV : 0;
+    }
 
     while (actions) {
         if (actions & ACTION_OPEN_DEV) {
             action_open_dev(device_obj);
+            if (device_obj->dev.dev_hdl) {
+                hdl_insert(driver_obj, slot);
+            }
         }
-        if (actions & ACTION_GET_DEV_INFO) {
-            action_get_info(device_obj);
-        }
-        if (actions & ACTION_GET_DEV_DESC) {
-            action_get_dev_desc(device_obj);
-        }
-        if (actions & ACTION_GET_CONFIG_DESC) {
-            action_get_config_desc(device_obj);
-        }
-        if (actions & ACTION_GET_STR_DESC) {
-            action_get_str_desc(device_obj);
+        if (actions & ACTION_PROBE_DEV) {
+            action_probe_dev(driver_obj, device_obj);
         }
         if (actions & ACTION_CLOSE_DEV) {
-            action_close_dev(device_obj);
+            if (action_close_dev(driver_obj, device_obj)) {
+                hdl_remove(driver_obj, slot);
+                driver_obj->single_thread.close_waiting &= ~(1u << slot);
+            } else {
+                driver_obj->single_thread.close_waiting |= 1u << slot;
+            }
         }
 
         actions = device_obj->actions;
         device_obj->actions = 0;
     }
+    if (device_obj->dev.dev_hdl == NULL) {
+        slot_free(driver_obj, slot);
+    }
 }
 
-void class_driver_task(void *arg)
+/* Advance every device with posted actions; O(devices with events) */
+static void drain_pending(class_driver_t *driver_obj)
 {
-    class_driver_t driver_obj = {0};
-    usb_host_client_handle_t class_driver_client_hdl = NULL;
+    action_t requested;
+    uint8_t slot;
+    while ((slot = slot_dequeue(driver_obj, &requested)) != DEV_SLOT_NONE) {
+        class_driver_device_handle(driver_obj, slot, requested);
+    }
+}
 
-    ESP_LOGI(TAG, "Registering Client");
+static void poll_drivers(class_driver_t *driver_obj)
+{
+    bool poll_soon = driver_obj->single_thread.close_waiting != 0;
+    for (uint32_t used = driver_obj->single_thread.used_slots; used; used &= used - 1) {
+        usb_device_t *device_obj = &driver_obj->single_thread.device[__builtin_ctz(used)];
+        if (device_obj->closing) {
+            continue;
+        }
+        for (uint32_t attached = device_obj->attached; attached; attached &= attached - 1) {
+            const uint8_t i = (uint8_t)__builtin_ctz(attached);
+            if (s_registry[i].ops->poll && s_registry[i].ops->poll(&device_obj->dev, device_obj->ctx[i])) {
+                poll_soon = true;
+            }
+        }
+    }
+    driver_obj->single_thread.poll_soon = poll_soon;
+}
 
-    SemaphoreHandle_t mux_lock = xSemaphoreCreateMutex();
-    if (mux_lock == NULL) {
-        ESP_LOGE(TAG, "Unable to create class driver mutex");
-        vTaskSuspend(NULL);
-        return;
+esp_err_t class_driver_register(const class_driver_ops_t *ops, void *arg)
+{
+    if (ops == NULL || ops->attach == NULL || ops->detach == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_driver_obj != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (s_num_drivers == CLASS_DRIVER_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_registry[s_num_drivers++] = (registry_entry_t) {
+        .ops = ops,
+        .arg = arg,
+    };
+    return ESP_OK;
+}
+
+esp_err_t class_driver_install(void)
+{
+    if (s_driver_obj != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    class_driver_t *driver_obj = calloc(1, sizeof(class_driver_t));
+    if (driver_obj == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = ESP_ERR_NO_MEM;
+    driver_obj->constant.mux_lock = xSemaphoreCreateMutex();
+    if (driver_obj->constant.mux_lock == NULL) {
+        goto fail;
+    }
+    err = desc_cache_create(DESC_CACHE_ENTRIES, &driver_obj->constant.desc_cache);
+    if (err != ESP_OK) {
+        goto fail;
+    }
+    err = usb_bw_create(&driver_obj->constant.bw);
+    if (err != ESP_OK) {
+        goto fail;
     }
 
     usb_host_client_config_t client_config = {
@@ -215,62 +444,149 @@ void class_driver_task(void *arg)
         .max_num_event_msg = CLIENT_NUM_EVENT_MSG,
         .async = {
             .client_event_callback = client_event_cb,
-            .callback_arg = (void *) &driver_obj,
+            .callback_arg = (void *) driver_obj,
         },
     };
-    ESP_ERROR_CHECK(usb_host_client_register(&client_config, &class_driver_client_hdl));
+    err = usb_host_client_register(&client_config, &driver_obj->constant.client_hdl);
+    if (err != ESP_OK) {
+        goto fail;
+    }
+    const ctrl_xfer_config_t ctrl_cfg = {
+        .client = driver_obj->constant.client_hdl,
+        .pool_size = CTRL_POOL_SIZE,
+        .max_data_len = CTRL_MAX_DATA_LEN,
+    };
+    err = ctrl_xfer_create(&ctrl_cfg, &driver_obj->constant.ctrl);
+    if (err != ESP_OK) {
+        usb_host_client_deregister(driver_obj->constant.client_hdl);
+        goto fail;
+    }
 
-    driver_obj.constant.mux_lock = mux_lock;
-    driver_obj.constant.client_hdl = class_driver_client_hdl;
+    memset(driver_obj->single_thread.addr_to_slot, DEV_SLOT_NONE, sizeof(driver_obj->single_thread.addr_to_slot));
+    memset(driver_obj->single_thread.hdl_bucket, DEV_SLOT_NONE, sizeof(driver_obj->single_thread.hdl_bucket));
+    s_driver_obj = driver_obj;
+    return ESP_OK;
 
-    for (uint8_t i = 0; i < DEV_MAX_COUNT; i++) {
-        driver_obj.mux_protected.device[i].client_hdl = class_driver_client_hdl;
+fail:
+    usb_bw_delete(driver_obj->constant.bw);
+    desc_cache_delete(driver_obj->constant.desc_cache);
+    if (driver_obj->constant.mux_lock != NULL) {
+        vSemaphoreDelete(driver_obj->constant.mux_lock);
     }
+    free(driver_obj);
+    return err;
+}
 
-    s_driver_obj = &driver_obj;
+bool class_driver_handle_events(uint32_t timeout_ticks)
+{
+    class_driver_t *driver_obj = s_driver_obj;
+    drain_pending(driver_obj);
 
-    while (1) {
-        // Driver has unhandled devices, handle all devices first
-        if (driver_obj.mux_protected.flags.unhandled_devices) {
-            xSemaphoreTake(driver_obj.constant.mux_lock, portMAX_DELAY);
-            for (uint8_t i = 0; i < DEV_MAX_COUNT; i++) {
-                if (driver_obj.mux_protected.device[i].actions) {
-                    class_driver_device_handle(&driver_obj.mux_protected.device[i]);
-                }
-            }
-            driver_obj.mux_protected.flags.unhandled_devices = 0;
-            xSemaphoreGive(driver_obj.constant.mux_lock);
-        } else {
-            // Driver is active, handle client events
-            if (driver_obj.mux_protected.flags.shutdown == 0) {
-                usb_host_client_handle_events(class_driver_client_hdl, portMAX_DELAY);
-            } else {
-                // Shutdown the driver
-                break;
-            }
+    xSemaphoreTake(driver_obj->constant.mux_lock, portMAX_DELAY);
+    const bool shutdown = driver_obj->mux_protected.flags.shutdown;
+    const bool reenumerate = driver_obj->mux_protected.flags.reenumerate;
+    driver_obj->mux_protected.flags.reenumerate = 0;
+    xSemaphoreGive(driver_obj->constant.mux_lock);
+    if (reenumerate && !shutdown && !driver_obj->single_thread.reenumerating) {
+        ESP_LOGI(TAG, "Closing every device to enumerate it again");
+        driver_obj->single_thread.reenumerating = true;
+        driver_obj->single_thread.reenumerate_waiting = driver_obj->single_thread.used_slots;
+        for (uint32_t used = driver_obj->single_thread.used_slots; used; used &= used - 1) {
+            slot_enqueue(driver_obj, (uint8_t)__builtin_ctz(used), ACTION_CLOSE_DEV, true);
+        }
+        drain_pending(driver_obj);
+    }
+    if (driver_obj->single_thread.reenumerating && driver_obj->single_thread.reenumerate_waiting == 0) {
+        // Nobody has them open now: freed, each is enumerated again and comes back as NEW_DEV
+        driver_obj->single_thread.reenumerating = false;
+        const esp_err_t err = usb_host_device_free_all();
+        if (err != ESP_OK && err != ESP_ERR_NOT_FINISHED) {
+            ESP_LOGE(TAG, "Freeing the devices failed: %s", esp_err_to_name(err));
+        }
+    }
+    if (shutdown && !driver_obj->single_thread.closing) {
+        // Close every opened device; drivers may need a few more event passes to let go
+        driver_obj->single_thread.closing = true;
+        for (uint32_t used = driver_obj->single_thread.used_slots; used; used &= used - 1) {
+            slot_enqueue(driver_obj, (uint8_t)__builtin_ctz(used), ACTION_CLOSE_DEV, true);
         }
+        drain_pending(driver_obj);
+    }
+    if (shutdown && driver_obj->single_thread.used_slots == 0) {
+        return false;
     }
 
-    ESP_LOGI(TAG, "Deregistering Class Client");
-    ESP_ERROR_CHECK(usb_host_client_deregister(class_driver_client_hdl));
-    if (mux_lock != NULL) {
-        vSemaphoreDelete(mux_lock);
+    if (driver_obj->single_thread.poll_soon && timeout_ticks > pdMS_TO_TICKS(CLASS_DRIVER_POLL_MS)) {
+        timeout_ticks = pdMS_TO_TICKS(CLASS_DRIVER_POLL_MS);
+    }
+    usb_host_client_handle_events(driver_obj->constant.client_hdl, timeout_ticks);
+
+    // Transfers came back: retry the detaches that were waiting for them
+    for (uint32_t waiting = driver_obj->single_thread.close_waiting; waiting; waiting &= waiting - 1) {
+        slot_enqueue(driver_obj, (uint8_t)__builtin_ctz(waiting), ACTION_CLOSE_DEV, true);
+    }
+    drain_pending(driver_obj);
+    poll_drivers(driver_obj);
+    return true;
+}
+
+esp_err_t class_driver_uninstall(void)
+{
+    class_driver_t *driver_obj = s_driver_obj;
+    if (driver_obj == NULL || driver_obj->single_thread.used_slots) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t err = usb_host_client_deregister(driver_obj->constant.client_hdl);
+    if (err != ESP_OK) {
+        return err;
+    }
+    ctrl_xfer_delete(driver_obj->constant.ctrl);
+    desc_cache_delete(driver_obj->constant.desc_cache);
+    usb_bw_delete(driver_obj->constant.bw);
+    vSemaphoreDelete(driver_obj->constant.mux_lock);
+    free(driver_obj);
+    s_driver_obj = NULL;
+    return ESP_OK;
+}
+
+void class_driver_wake(void)
+{
+    if (s_driver_obj != NULL) {
+        usb_host_client_unblock(s_driver_obj->constant.client_hdl);
+    }
+}
+
+void class_driver_task(void *arg)
+{
+    (void)arg;
+    ESP_LOGI(TAG, "Registering Client");
+    esp_err_t err = class_driver_install();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Unable to install class driver client: %s", esp_err_to_name(err));
+        vTaskSuspend(NULL);
+        return;
+    }
+
+    while (class_driver_handle_events(portMAX_DELAY)) {
     }
+
+    ESP_LOGI(TAG, "Deregistering Class Client");
+    ESP_ERROR_CHECK(class_driver_uninstall());
     vTaskSuspend(NULL);
 }
 
+void class_driver_request_reenumerate(void)
+{
+    xSemaphoreTake(s_driver_obj->constant.mux_lock, portMAX_DELAY);
+    s_driver_obj->mux_protected.flags.reenumerate = 1;
+    xSemaphoreGive(s_driver_obj->constant.mux_lock);
+    ESP_ERROR_CHECK(usb_host_client_unblock(s_driver_obj->constant.client_hdl));
+}
+
 void class_driver_client_deregister(void)
 {
-    // Mark all opened devices
+    // Opened devices are closed by the class driver task itself, which owns the device slots
     xSemaphoreTake(s_driver_obj->constant.mux_lock, portMAX_DELAY);
-    for (uint8_t i = 0; i < DEV_MAX_COUNT; i++) {
-        if (s_driver_obj->mux_protected.device[i].dev_hdl != NULL) {
-            // Mark device to close
-            s_driver_obj->mux_protected.device[i].actions |= ACTION_CLOSE_DEV;
-            // Set flag
-            s_driver_obj->mux_protected.flags.unhandled_devices = 1;
-        }
-    }
     s_driver_obj->mux_protected.flags.shutdown = 1;
     xSemaphoreGive(s_driver_obj->constant.mux_lock);
 
@@ -0,0 +1,141 @@
+// class_driver.h  (single USB host client with a registry of class drivers)
+//
+// One client task opens every device on the bus, identifies it (descriptor
+// cache first, parse on a miss) and hands its interfaces to whichever
+// registered class drivers match them by bInterfaceClass/SubClass: the UAC
+// stream, the AudioMoth HID channel, the descriptor logger. Each driver
+// keeps its own per-device context and runs entirely from the client task,
+// so one event loop serves every device and no event is processed twice.
+//
+// The client task owns the ctrl_xfer engine, the descriptor cache and the
+// periodic bandwidth budget and shares them with the drivers through
+// class_driver_dev_t. A closed device's reservations are returned for it.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "usb/usb_host.h"
+#include "ctrl_xfer.h"
+#include "desc_cache.h"
+#include "usb_bw.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CLASS_DRIVER_MAX            8       /**< Registered drivers */
+#define CLASS_DRIVER_MATCH_ANY      0xFFFF  /**< Wildcard for intf_class / intf_subclass */
+#define CLASS_DRIVER_POLL_MS        20      /**< Event wait while a driver asks to be polled */
+
+/**
+ * @brief An opened device, as the drivers see it
+ *
+ * Valid from attach() until detach() returns ESP_OK.
+ */
+typedef struct {
+    usb_host_client_handle_t client;
+    usb_device_handle_t dev_hdl;
+    uint8_t dev_addr;
+    const usb_config_desc_t *config_desc;
+    const desc_cache_entry_t *desc;     /**< Parse results, from the cache or fresh */
+    bool cache_hit;                     /**< `desc` came from the cache: seen before, descriptors unchanged */
+    ctrl_xfer_t *ctrl;                  /**< Shared EP0 engine */
+    usb_bw_t *bw;                       /**< Shared periodic bandwidth budget */
+} class_driver_dev_t;
+
+typedef struct {
+    const char *name;
+    uint16_t intf_class;        /**< bInterfaceClass, or CLASS_DRIVER_MATCH_ANY */
+    uint16_t intf_subclass;     /**< bInterfaceSubClass, or CLASS_DRIVER_MATCH_ANY */
+
+    /**
+     * @brief Optional: fill this driver's fields of a fresh cache entry
+     *
+     * Called for every matching interface (alternate setting 0) of a device
+     * that missed the descriptor cache. The entry is cached afterwards.
+     */
+    void (*parse)(const usb_config_desc_t *config_desc, const usb_intf_desc_t *intf,
+                  desc_cache_entry_t *entry, void *arg);
+
+    /**
+     * @brief Take the device, from its first matching interface
+     *
+     * Called at most once per device. Return ESP_ERR_NOT_SUPPORTED to pass
+     * on it; the driver is then offered the next matching interface.
+     */
+    esp_err_t (*attach)(const class_driver_dev_t *dev, const usb_intf_desc_t *intf, void *arg, void **ret_ctx);
+
+    /**
+     * @brief Release the device: it is gone or the client is shutting down
+     *
+     * Return ESP_ERR_NOT_FINISHED while transfers are still coming back;
+     * detach() is called again after the next event pass. The device stays
+     * open until every driver has returned ESP_OK.
+     */
+    esp_err_t (*detach)(const class_driver_dev_t *dev, void *ctx);
+
+    /**
+     * @brief Optional: called after every event pass while attached
+     *
+     * @return true to be polled again within CLASS_DRIVER_POLL_MS even if
+     *         no event arrives (e.g. a request timeout is running)
+     */
+    bool (*poll)(const class_driver_dev_t *dev, void *ctx);
+} class_driver_ops_t;
+
+/**
+ * @brief Add a driver; before class_driver_install()
+ *
+ * Drivers are offered each interface in registration order. `ops` must
+ * stay valid.
+ */
+esp_err_t class_driver_register(const class_driver_ops_t *ops, void *arg);
+
+/**
+ * @brief Register the USB host client and create the shared resources
+ */
+esp_err_t class_driver_install(void);
+
+/**
+ * @brief One pass of the client loop: wait up to `timeout_ticks` for events,
+ *        advance every device with work to do, poll the drivers
+ *
+ * @return false once a requested shutdown has closed every device
+ */
+bool class_driver_handle_events(uint32_t timeout_ticks);
+
+/**
+ * @brief Deregister the client; every device must be closed
+ */
+esp_err_t class_driver_uninstall(void);
+
+/**
+ * @brief Wake the client task from another task, e.g. after posting it work
+ */
+void class_driver_wake(void);
+
+/**
+ * @brief Client task: install, handle events until shutdown, uninstall
+ */
+void class_driver_task(void *arg);
+
+/**
+ * @brief Ask the client task to enumerate every device again
+ *
+ * The host library only frees a device no client has open, so the client
+ * task detaches every driver and closes every device first, then calls
+ * usb_host_device_free_all(). The devices come back as new ones once the
+ * hub has enumerated them again. From any task.
+ */
+void class_driver_request_reenumerate(void);
+
+/**
+ * @brief Ask the client task to detach every driver, close every device and exit
+ */
+void class_driver_client_deregister(void);
+
+#ifdef __cplusplus
+}
+#endif
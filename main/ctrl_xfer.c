@@ -0,0 +1,308 @@
+// ctrl_xfer.c  (asynchronous control-transfer engine)
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "ctrl_xfer.h"
+
+static const char *TAG = "CTRL_XFER";
+
+#define REQ_NONE    (-1)
+
+typedef struct {
+    ctrl_xfer_t *eng;
+    usb_transfer_t *xfer;
+    ctrl_xfer_cb_t cb;
+    void *ctx;
+    int next;                   /**< Next request in the device FIFO or the free list */
+    int dev_slot;
+} ctrl_req_t;
+
+typedef struct {
+    usb_device_handle_t dev;    /**< NULL when the slot is unused */
+    int head;
+    int tail;
+    size_t count;
+    bool busy;                  /**< head is on the bus */
+} ctrl_devq_t;
+
+struct ctrl_xfer {
+    ctrl_xfer_config_t cfg;
+    ctrl_req_t *reqs;
+    int free_head;
+    ctrl_devq_t devs[CTRL_XFER_MAX_DEVICES];
+};
+
+static void xfer_done(usb_transfer_t *xfer);
+
+esp_err_t ctrl_xfer_create(const ctrl_xfer_config_t *config, ctrl_xfer_t **ret_eng)
+{
+    if (config == NULL || ret_eng == NULL || config->client == NULL || config->pool_size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ctrl_xfer_t *eng = calloc(1, sizeof(*eng));
+    if (eng == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    eng->cfg = *config;
+    eng->reqs = calloc(config->pool_size, sizeof(ctrl_req_t));
+    if (eng->reqs == NULL) {
+        free(eng);
+        return ESP_ERR_NO_MEM;
+    }
+    eng->free_head = REQ_NONE;
+    for (int i = (int)config->pool_size - 1; i >= 0; i--) {
+        ctrl_req_t *r = &eng->reqs[i];
+        esp_err_t err = usb_host_transfer_alloc(sizeof(usb_setup_packet_t) + config->max_data_len, 0, &r->xfer);
+        if (err != ESP_OK) {
+            ctrl_xfer_delete(eng);
+            return err;
+        }
+        r->eng = eng;
+        r->xfer->bEndpointAddress = 0;
+        r->xfer->callback = xfer_done;
+        r->xfer->context = r;
+        r->next = eng->free_head;
+        eng->free_head = i;
+    }
+    *ret_eng = eng;
+    return ESP_OK;
+}
+
+esp_err_t ctrl_xfer_delete(ctrl_xfer_t *eng)
+{
+    if (eng == NULL) {
+        return ESP_OK;
+    }
+    for (int d = 0; d < CTRL_XFER_MAX_DEVICES; d++) {
+        if (eng->devs[d].count) {
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+    for (size_t i = 0; i < eng->cfg.pool_size; i++) {
+        if (eng->reqs[i].xfer) {
+            usb_host_transfer_free(eng->reqs[i].xfer);
+        }
+    }
+    free(eng->reqs);
+    free(eng);
+    return ESP_OK;
+}
+
+static esp_err_t status_to_err(usb_transfer_status_t status)
+{
+    switch (status) {
+    case USB_TRANSFER_STATUS_COMPLETED:
+        return ESP_OK;
+    case USB_TRANSFER_STATUS_STALL:
+        return ESP_ERR_NOT_SUPPORTED;
+    case USB_TRANSFER_STATUS_TIMED_OUT:
+        return ESP_ERR_TIMEOUT;
+    case USB_TRANSFER_STATUS_NO_DEVICE:
+    case USB_TRANSFER_STATUS_CANCELED:
+        return ESP_ERR_INVALID_STATE;
+    default:
+        return ESP_FAIL;
+    }
+}
+
+static int devq_pop(ctrl_xfer_t *eng, ctrl_devq_t *q)
+{
+    const int i = q->head;
+    q->head = eng->reqs[i].next;
+    if (q->head == REQ_NONE) {
+        q->tail = REQ_NONE;
+    }
+    q->count--;
+    return i;
+}
+
+static void req_release(ctrl_xfer_t *eng, int i)
+{
+    eng->reqs[i].cb = NULL;
+    eng->reqs[i].next = eng->free_head;
+    eng->free_head = i;
+}
+
+/* Put the head of the device's FIFO on the bus; requests that fail to
+ * submit are completed with the error and the next one is tried. */
+static void devq_kick(ctrl_xfer_t *eng, ctrl_devq_t *q)
+{
+    while (!q->busy && q->count) {
+        ctrl_req_t *r = &eng->reqs[q->head];
+        const esp_err_t err = usb_host_transfer_submit_control(eng->cfg.client, r->xfer);
+        if (err == ESP_OK) {
+            q->busy = true;
+            return;
+        }
+        const int i = devq_pop(eng, q);
+        const ctrl_xfer_cb_t cb = r->cb;
+        void *ctx = r->ctx;
+        req_release(eng, i);
+        if (cb) {
+            cb(err, NULL, 0, ctx);
+        }
+    }
+    if (q->count == 0) {
+        q->dev = NULL;
+    }
+}
+
+static void xfer_done(usb_transfer_t *xfer)
+{
+    ctrl_req_t *r = xfer->context;
+    ctrl_xfer_t *eng = r->eng;
+    ctrl_devq_t *q = &eng->devs[r->dev_slot];
+
+    const int i = devq_pop(eng, q);
+    q->busy = false;
+    const ctrl_xfer_cb_t cb = r->cb;
+    void *ctx = r->ctx;
+    const esp_err_t err = status_to_err(xfer->status);
+    const usb_setup_packet_t *setup = (const usb_setup_packet_t *)xfer->data_buffer;
+    size_t len = 0;
+    if (err == ESP_OK && (setup->bmRequestType & USB_BM_REQUEST_TYPE_DIR_IN) &&
+            xfer->actual_num_bytes > (int)sizeof(usb_setup_packet_t)) {
+        len = (size_t)xfer->actual_num_bytes - sizeof(usb_setup_packet_t);
+    }
+
+    // Callback before releasing, so the data stage is still ours; it may queue more work
+    if (cb) {
+        cb(err, xfer->data_buffer + sizeof(usb_setup_packet_t), len, ctx);
+    }
+    req_release(eng, i);
+    devq_kick(eng, q);
+}
+
+static ctrl_devq_t *devq_get(ctrl_xfer_t *eng, usb_device_handle_t dev, bool create)
+{
+    ctrl_devq_t *unused = NULL;
+    for (int d = 0; d < CTRL_XFER_MAX_DEVICES; d++) {
+        if (eng->devs[d].dev == dev) {
+            return &eng->devs[d];
+        }
+        if (eng->devs[d].dev == NULL && unused == NULL) {
+            unused = &eng->devs[d];
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+    if (unused == NULL) {
+        ESP_LOGW(TAG, "more than %d devices with control requests queued", CTRL_XFER_MAX_DEVICES);
+        return NULL;
+    }
+    unused->dev = dev;
+    unused->head = unused->tail = REQ_NONE;
+    unused->count = 0;
+    unused->busy = false;
+    return unused;
+}
+
+esp_err_t ctrl_xfer_submit(ctrl_xfer_t *eng, usb_device_handle_t dev, const usb_setup_packet_t *setup,
+                           const void *out_data, ctrl_xfer_cb_t cb, void *ctx)
+{
+    if (eng == NULL || dev == NULL || setup == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const bool in = setup->bmRequestType & USB_BM_REQUEST_TYPE_DIR_IN;
+    if (setup->wLength > eng->cfg.max_data_len) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (!in && setup->wLength && out_data == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (eng->free_head == REQ_NONE) {
+        return ESP_ERR_NO_MEM;
+    }
+    ctrl_devq_t *q = devq_get(eng, dev, true);
+    if (q == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    const int i = eng->free_head;
+    ctrl_req_t *r = &eng->reqs[i];
+    eng->free_head = r->next;
+    r->cb = cb;
+    r->ctx = ctx;
+    r->next = REQ_NONE;
+    r->dev_slot = (int)(q - eng->devs);
+    memcpy(r->xfer->data_buffer, setup, sizeof(*setup));
+    if (!in && setup->wLength) {
+        memcpy(r->xfer->data_buffer + sizeof(*setup), out_data, setup->wLength);
+    }
+    r->xfer->device_handle = dev;
+    r->xfer->num_bytes = (int)(sizeof(*setup) + setup->wLength);
+
+    if (q->tail == REQ_NONE) {
+        q->head = i;
+    } else {
+        eng->reqs[q->tail].next = i;
+    }
+    q->tail = i;
+    q->count++;
+    devq_kick(eng, q);
+    return ESP_OK;
+}
+
+esp_err_t ctrl_xfer_set_interface(ctrl_xfer_t *eng, usb_device_handle_t dev, uint8_t intf, uint8_t alt,
+                                  ctrl_xfer_cb_t cb, void *ctx)
+{
+    usb_setup_packet_t setup;
+    USB_SETUP_PACKET_INIT_SET_INTERFACE(&setup, intf, alt);
+    return ctrl_xfer_submit(eng, dev, &setup, NULL, cb, ctx);
+}
+
+void ctrl_xfer_cancel_device(ctrl_xfer_t *eng, usb_device_handle_t dev)
+{
+    ctrl_devq_t *q = devq_get(eng, dev, false);
+    if (q == NULL || dev == NULL) {
+        return;
+    }
+    // Keep the request on the bus (it completes through xfer_done), drop the rest
+    const int in_flight = q->busy ? devq_pop(eng, q) : REQ_NONE;
+    while (q->count) {
+        const int i = devq_pop(eng, q);
+        const ctrl_xfer_cb_t cb = eng->reqs[i].cb;
+        void *ctx = eng->reqs[i].ctx;
+        req_release(eng, i);
+        if (cb) {
+            cb(ESP_ERR_INVALID_STATE, NULL, 0, ctx);
+        }
+    }
+    if (in_flight != REQ_NONE) {
+        eng->reqs[in_flight].next = REQ_NONE;
+        q->head = q->tail = in_flight;
+        q->count = 1;
+    } else {
+        q->dev = NULL;
+    }
+}
+
+size_t ctrl_xfer_pending(const ctrl_xfer_t *eng, usb_device_handle_t dev)
+{
+    for (int d = 0; d < CTRL_XFER_MAX_DEVICES; d++) {
+        if (dev != NULL && eng->devs[d].dev == dev) {
+            return eng->devs[d].count;
+        }
+    }
+    return 0;
+}
+
+void ctrl_xfer_future_init(ctrl_xfer_future_t *f, void *data, size_t data_cap)
+{
+    memset(f, 0, sizeof(*f));
+    f->data = data;
+    f->data_cap = data_cap;
+}
+
+void ctrl_xfer_future_cb(esp_err_t err, const uint8_t *data, size_t len, void *ctx)
+{
+    ctrl_xfer_future_t *f = ctx;
+    f->err = err;
+    f->len = len < f->data_cap ? len : f->data_cap;
+    if (f->data && f->len) {
+        memcpy(f->data, data, f->len);
+    }
+    f->done = true;
+}
@@ -0,0 +1,98 @@
+// ctrl_xfer.h  (asynchronous control-transfer engine)
+//
+// A pool of control transfers allocated once, and a FIFO of requests per
+// device. Each device has at most one request on EP0 at a time; different
+// devices run concurrently. Submitting never blocks: the completion
+// callback runs from usb_host_client_handle_events() in the client task,
+// and the next queued request for that device is submitted right after.
+//
+// Not thread-safe by design: call it only from the client task (the one
+// handling client events) or from callbacks it runs, which is where
+// enumeration and stream setup already happen.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "usb/usb_host.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Devices with requests queued at once: one per class_driver device slot */
+#define CTRL_XFER_MAX_DEVICES   16
+
+typedef struct {
+    usb_host_client_handle_t client;
+    size_t pool_size;           /**< Requests queued or in flight across all devices */
+    size_t max_data_len;        /**< Largest data stage (wLength) */
+} ctrl_xfer_config_t;
+
+/**
+ * @brief Completion callback
+ *
+ * @param err   ESP_OK, ESP_ERR_NOT_SUPPORTED (STALL), ESP_ERR_TIMEOUT,
+ *              ESP_ERR_INVALID_STATE (device gone / cancelled) or ESP_FAIL
+ * @param data  Data stage of an IN request; valid only during the call
+ * @param len   Bytes received for IN requests, 0 for OUT
+ */
+typedef void (*ctrl_xfer_cb_t)(esp_err_t err, const uint8_t *data, size_t len, void *ctx);
+
+/**
+ * @brief Completion state for callers that poll instead of taking a callback
+ *
+ * Pass ctrl_xfer_future_cb with the future as ctx; `done` is set last.
+ */
+typedef struct {
+    volatile bool done;
+    esp_err_t err;
+    size_t len;
+    uint8_t *data;              /**< Optional destination for IN data */
+    size_t data_cap;
+} ctrl_xfer_future_t;
+
+typedef struct ctrl_xfer ctrl_xfer_t;
+
+esp_err_t ctrl_xfer_create(const ctrl_xfer_config_t *config, ctrl_xfer_t **ret_eng);
+
+/**
+ * @brief Free the pool; every request must have completed
+ */
+esp_err_t ctrl_xfer_delete(ctrl_xfer_t *eng);
+
+/**
+ * @brief Queue a control request
+ *
+ * @param out_data  Data stage for OUT requests (setup->wLength bytes), copied; NULL for IN
+ * @return ESP_ERR_NO_MEM if the pool or the device table is exhausted
+ */
+esp_err_t ctrl_xfer_submit(ctrl_xfer_t *eng, usb_device_handle_t dev, const usb_setup_packet_t *setup,
+                           const void *out_data, ctrl_xfer_cb_t cb, void *ctx);
+
+/**
+ * @brief Standard SET_INTERFACE
+ */
+esp_err_t ctrl_xfer_set_interface(ctrl_xfer_t *eng, usb_device_handle_t dev, uint8_t intf, uint8_t alt,
+                                  ctrl_xfer_cb_t cb, void *ctx);
+
+/**
+ * @brief Fail every request still queued for `dev` with ESP_ERR_INVALID_STATE
+ *
+ * The request on the bus (if any) completes on its own, normally as NO_DEVICE.
+ */
+void ctrl_xfer_cancel_device(ctrl_xfer_t *eng, usb_device_handle_t dev);
+
+/**
+ * @brief Requests queued or in flight for `dev`
+ */
+size_t ctrl_xfer_pending(const ctrl_xfer_t *eng, usb_device_handle_t dev);
+
+void ctrl_xfer_future_init(ctrl_xfer_future_t *f, void *data, size_t data_cap);
+void ctrl_xfer_future_cb(esp_err_t err, const uint8_t *data, size_t len, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
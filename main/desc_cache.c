@@ -0,0 +1,147 @@
+// desc_cache.c  (parsed descriptors cached per device identity)
+
+#include <stdlib.h>
+#include <string.h>
+#include "desc_cache.h"
+
+typedef struct {
+    bool used;
+    uint32_t fingerprint;
+    uint32_t last_use;
+    desc_cache_entry_t entry;
+} cache_slot_t;
+
+struct desc_cache {
+    size_t capacity;
+    uint32_t clock;             /**< Bumped on every lookup/store, for LRU */
+    uint32_t hits;
+    uint32_t misses;
+    cache_slot_t slots[];
+};
+
+esp_err_t desc_cache_create(size_t capacity, desc_cache_t **ret_cache)
+{
+    if (capacity == 0 || ret_cache == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    desc_cache_t *cache = calloc(1, sizeof(*cache) + capacity * sizeof(cache_slot_t));
+    if (cache == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    cache->capacity = capacity;
+    *ret_cache = cache;
+    return ESP_OK;
+}
+
+void desc_cache_delete(desc_cache_t *cache)
+{
+    free(cache);
+}
+
+esp_err_t desc_cache_key_from_device(usb_device_handle_t dev, desc_cache_key_t *key)
+{
+    if (dev == NULL || key == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const usb_device_desc_t *dev_desc;
+    esp_err_t err = usb_host_get_device_descriptor(dev, &dev_desc);
+    if (err != ESP_OK) {
+        return err;
+    }
+    usb_device_info_t info;
+    err = usb_host_device_info(dev, &info);
+    if (err != ESP_OK) {
+        return err;
+    }
+    memset(key, 0, sizeof(*key));
+    key->vid = dev_desc->idVendor;
+    key->pid = dev_desc->idProduct;
+    key->bcd_device = dev_desc->bcdDevice;
+    const usb_str_desc_t *sn = info.str_desc_serial_num;
+    if (sn) {
+        // UTF-16LE; serials are ASCII in practice, anything else becomes '?'
+        const size_t n = sn->bLength > 2 ? (size_t)(sn->bLength - 2) / 2 : 0;
+        for (size_t i = 0; i < n && i < DESC_CACHE_SERIAL_LEN; i++) {
+            key->serial[i] = sn->wData[i] < 0x80 ? (char)sn->wData[i] : '?';
+        }
+    }
+    return ESP_OK;
+}
+
+/* FNV-1a over the whole configuration descriptor */
+static uint32_t fingerprint(const usb_config_desc_t *config_desc)
+{
+    const uint8_t *p = (const uint8_t *)config_desc;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < config_desc->wTotalLength; i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+static bool key_equal(const desc_cache_key_t *a, const desc_cache_key_t *b)
+{
+    return a->vid == b->vid && a->pid == b->pid && a->bcd_device == b->bcd_device && strcmp(a->serial, b->serial) == 0;
+}
+
+static cache_slot_t *find(desc_cache_t *cache, const desc_cache_key_t *key)
+{
+    for (size_t i = 0; i < cache->capacity; i++) {
+        if (cache->slots[i].used && key_equal(&cache->slots[i].entry.key, key)) {
+            return &cache->slots[i];
+        }
+    }
+    return NULL;
+}
+
+const desc_cache_entry_t *desc_cache_lookup(desc_cache_t *cache, const desc_cache_key_t *key,
+                                            const usb_config_desc_t *config_desc)
+{
+    if (cache == NULL || key == NULL || config_desc == NULL) {
+        return NULL;
+    }
+    cache_slot_t *s = find(cache, key);
+    if (s && s->fingerprint != fingerprint(config_desc)) {
+        s->used = false;
+        s = NULL;
+    }
+    if (s == NULL) {
+        cache->misses++;
+        return NULL;
+    }
+    cache->hits++;
+    s->last_use = ++cache->clock;
+    return &s->entry;
+}
+
+esp_err_t desc_cache_store(desc_cache_t *cache, const desc_cache_entry_t *entry, const usb_config_desc_t *config_desc)
+{
+    if (cache == NULL || entry == NULL || config_desc == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    cache_slot_t *s = find(cache, &entry->key);
+    for (size_t i = 0; s == NULL && i < cache->capacity; i++) {
+        if (!cache->slots[i].used) {
+            s = &cache->slots[i];
+        }
+    }
+    if (s == NULL) {
+        s = &cache->slots[0];
+        for (size_t i = 1; i < cache->capacity; i++) {
+            if (cache->slots[i].last_use < s->last_use) {
+                s = &cache->slots[i];
+            }
+        }
+    }
+    s->used = true;
+    s->fingerprint = fingerprint(config_desc);
+    s->last_use = ++cache->clock;
+    s->entry = *entry;
+    return ESP_OK;
+}
+
+void desc_cache_stats(const desc_cache_t *cache, uint32_t *hits, uint32_t *misses)
+{
+    *hits = cache->hits;
+    *misses = cache->misses;
+}
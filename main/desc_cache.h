@@ -0,0 +1,80 @@
+// desc_cache.h  (parsed descriptors cached per device identity)
+//
+// Enumerating a device means walking its configuration descriptor for the
+// streaming alt setting, the HID channel and their endpoints, and, in the
+// descriptor logger, printing all of it over the console. A device that
+// re-attaches (cable glitch, power cycle, brown-out) has the same
+// descriptors, so its parse results are kept here, keyed by VID, PID,
+// bcdDevice and serial number, and reused on the next attach.
+//
+// Entries are fingerprinted with a hash of the configuration descriptor;
+// a device whose descriptors changed under the same identity (e.g. a
+// different sample rate configured on the AudioMoth) misses and is parsed
+// again. Fixed capacity, least recently used entry evicted. Client task
+// only, like ctrl_xfer.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "usb/usb_host.h"
+#include "uac.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DESC_CACHE_SERIAL_LEN   32
+#define DESC_CACHE_STREAM_ALTS  3       /**< Fallback alt settings kept per stream */
+
+typedef struct {
+    uint16_t vid;
+    uint16_t pid;
+    uint16_t bcd_device;
+    char serial[DESC_CACHE_SERIAL_LEN + 1];    /**< ASCII, empty if the device has none */
+} desc_cache_key_t;
+
+typedef struct {
+    desc_cache_key_t key;
+    bool has_stream;
+    uac_stream_info_t stream;           /**< Usable alt setting with the most bandwidth */
+    uint8_t num_stream_alts;
+    uac_stream_info_t stream_alts[DESC_CACHE_STREAM_ALTS];     /**< Further usable ones, decreasing bandwidth */
+    bool has_hid;
+    uint8_t hid_intf;
+    uint8_t hid_ep_in;
+    uint8_t hid_ep_out;
+} desc_cache_entry_t;
+
+typedef struct desc_cache desc_cache_t;
+
+esp_err_t desc_cache_create(size_t capacity, desc_cache_t **ret_cache);
+void desc_cache_delete(desc_cache_t *cache);
+
+/**
+ * @brief Identity of an opened device from its device descriptor and serial string
+ */
+esp_err_t desc_cache_key_from_device(usb_device_handle_t dev, desc_cache_key_t *key);
+
+/**
+ * @brief Entry for `key` if its fingerprint still matches `config_desc`
+ *
+ * A stale entry is dropped. The pointer is valid until the next store.
+ *
+ * @return NULL on a miss
+ */
+const desc_cache_entry_t *desc_cache_lookup(desc_cache_t *cache, const desc_cache_key_t *key,
+                                            const usb_config_desc_t *config_desc);
+
+/**
+ * @brief Insert or replace the entry for entry->key
+ */
+esp_err_t desc_cache_store(desc_cache_t *cache, const desc_cache_entry_t *entry, const usb_config_desc_t *config_desc);
+
+void desc_cache_stats(const desc_cache_t *cache, uint32_t *hits, uint32_t *misses);
+
+#ifdef __cplusplus
+}
+#endif
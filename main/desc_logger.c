@@ -0,0 +1,102 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include "esp_log.h"
+#include "usb/usb_host.h"
+#include "usb/usb_helpers.h"
+#include "class_driver.h"
+#include "desc_logger.h"
+
+static const char *TAG = "CLASS";
+
+static void log_dev_info(usb_device_handle_t dev_hdl)
+{
+    ESP_LOGI(TAG, "Getting device information");
+    usb_device_info_t dev_info;
+    ESP_ERROR_CHECK(usb_host_device_info(dev_hdl, &dev_info));
+    ESP_LOGI(TAG, "\t%s speed", (char *[]) {
+        "Low", "Full", "High"
+    }[dev_info.speed]);
+    ESP_LOGI(TAG, "\tParent info:");
+    if (dev_info.parent.dev_hdl) {
+        usb_device_info_t parent_dev_info;
+        ESP_ERROR_CHECK(usb_host_device_info(dev_info.parent.dev_hdl, &parent_dev_info));
+        ESP_LOGI(TAG, "\t\tBus addr: %d", parent_dev_info.dev_addr);
+        ESP_LOGI(TAG, "\t\tPort: %d", dev_info.parent.port_num);
+
+    } else {
+        ESP_LOGI(TAG, "\t\tPort: ROOT");
+    }
+    ESP_LOGI(TAG, "\tbConfigurationValue %d", dev_info.bConfigurationValue);
+}
+
+static void log_dev_desc(usb_device_handle_t dev_hdl)
+{
+    ESP_LOGI(TAG, "Getting device descriptor");
+    const usb_device_desc_t *dev_desc;
+    ESP_ERROR_CHECK(usb_host_get_device_descriptor(dev_hdl, &dev_desc));
+    usb_print_device_descriptor(dev_desc);
+}
+
+static void log_config_desc(const usb_config_desc_t *config_desc)
+{
+    ESP_LOGI(TAG, "Getting config descriptor");
+    usb_print_config_descriptor(config_desc, NULL);
+}
+
+static void log_str_desc(usb_device_handle_t dev_hdl)
+{
+    usb_device_info_t dev_info;
+    ESP_ERROR_CHECK(usb_host_device_info(dev_hdl, &dev_info));
+    if (dev_info.str_desc_manufacturer) {
+        ESP_LOGI(TAG, "Getting Manufacturer string descriptor");
+        usb_print_string_descriptor(dev_info.str_desc_manufacturer);
+    }
+    if (dev_info.str_desc_product) {
+        ESP_LOGI(TAG, "Getting Product string descriptor");
+        usb_print_string_descriptor(dev_info.str_desc_product);
+    }
+    if (dev_info.str_desc_serial_num) {
+        ESP_LOGI(TAG, "Getting Serial Number string descriptor");
+        usb_print_string_descriptor(dev_info.str_desc_serial_num);
+    }
+}
+
+/* Takes every device from its first interface and holds nothing */
+static esp_err_t logger_attach(const class_driver_dev_t *dev, const usb_intf_desc_t *intf, void *arg, void **ret_ctx)
+{
+    log_dev_info(dev->dev_hdl);
+    if (dev->cache_hit) {
+        // Dumped on an earlier attach with the same descriptors
+        const desc_cache_key_t *key = &dev->desc->key;
+        ESP_LOGI(TAG, "\tKnown device %04x:%04x \"%s\", descriptors unchanged", key->vid, key->pid, key->serial);
+    } else {
+        log_dev_desc(dev->dev_hdl);
+        log_config_desc(dev->config_desc);
+        log_str_desc(dev->dev_hdl);
+    }
+    *ret_ctx = NULL;
+    return ESP_OK;
+}
+
+static esp_err_t logger_detach(const class_driver_dev_t *dev, void *ctx)
+{
+    ESP_LOGI(TAG, "Device at address %d detached", dev->dev_addr);
+    return ESP_OK;
+}
+
+static const class_driver_ops_t s_ops = {
+    .name = "Descriptor logger",
+    .intf_class = CLASS_DRIVER_MATCH_ANY,
+    .intf_subclass = CLASS_DRIVER_MATCH_ANY,
+    .attach = logger_attach,
+    .detach = logger_detach,
+};
+
+esp_err_t desc_logger_register(void)
+{
+    return class_driver_register(&s_ops, NULL);
+}
@@ -0,0 +1,22 @@
+// desc_logger.h  (descriptor dump as a class_driver plugin)
+//
+// Prints the device information, device, configuration and string
+// descriptors of every device that attaches, once per device identity:
+// a device the descriptor cache already knows is only named.
+
+#pragma once
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Register with class_driver; before class_driver_install()
+ */
+esp_err_t desc_logger_register(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,412 @@
+// dlog.c  (deferred logging: the format string's address and raw arguments now, the text later)
+
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include "dlog.h"
+#include "metrics.h"
+
+#if defined(ESP_PLATFORM)
+#include "esp_timer.h"
+#else
+#include <time.h>
+#endif
+
+const char dlog_anchor[] = "dlog anchor v1";
+
+/* A slot holds its record once seq is the index it was claimed under + 1 */
+typedef struct {
+    _Atomic uint32_t seq;
+    dlog_record_t rec;
+} slot_t;
+
+static slot_t s_ring[DLOG_RECORDS];
+static _Atomic uint32_t s_head;     // next index to claim
+static _Atomic uint32_t s_tail;     // next index to pop
+static _Atomic uint32_t s_dropped;
+
+static const dlog_abi_t s_native = { .ptr_size = sizeof(void *), .long_size = sizeof(long) };
+
+static uint64_t now_us(void)
+{
+#if defined(ESP_PLATFORM)
+    return (uint64_t)esp_timer_get_time();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+#endif
+}
+
+/* ---------- Conversion specs ---------- */
+typedef enum {
+    ARG_NONE,       // no argument (unknown conversion)
+    ARG_INT,
+    ARG_DOUBLE,
+    ARG_STR,
+    ARG_PTR,        // %p, and %n which prints nothing
+} arg_kind_t;
+
+typedef struct {
+    const char *start;      // the '%'
+    const char *lenmod;     // length modifier as written (may be empty) ...
+    const char *end;        // ... up to the conversion character, end is past it
+    char conv;
+    bool width_star;
+    bool prec_star;
+    bool is_long_double;
+    arg_kind_t kind;
+    bool is_signed;
+    uint8_t size;           // bytes of the argument in the recording image
+} spec_t;
+
+static bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+/* Parse the conversion starting at p (a '%' that isn't "%%"); NULL if the
+ * string ends inside it */
+static const char *parse_spec(const char *p, const dlog_abi_t *abi, spec_t *s)
+{
+    memset(s, 0, sizeof(*s));
+    s->start = p++;
+    while (*p && strchr("-+ #0", *p)) {
+        p++;
+    }
+    if (*p == '*') {
+        s->width_star = true;
+        p++;
+    }
+    while (is_digit(*p)) {
+        p++;
+    }
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            s->prec_star = true;
+            p++;
+        }
+        while (is_digit(*p)) {
+            p++;
+        }
+    }
+    s->lenmod = p;
+    while (*p && strchr("hlLqjzt", *p)) {
+        p++;
+    }
+    if (*p == '\0') {
+        return NULL;
+    }
+    const size_t lm = (size_t)(p - s->lenmod);
+    s->conv = *p;
+    s->end = ++p;
+    switch (s->conv) {
+    case 'd': case 'i':
+        s->is_signed = true;
+        // fall through
+    case 'u': case 'o': case 'x': case 'X':
+        s->kind = ARG_INT;
+        if ((lm == 2 && s->lenmod[0] == 'l') || (lm == 1 && strchr("qjL", s->lenmod[0]))) {
+            s->size = 8;
+        } else if (lm == 1 && s->lenmod[0] == 'l') {
+            s->size = abi->long_size;
+        } else if (lm == 1 && strchr("zt", s->lenmod[0])) {
+            s->size = abi->ptr_size;
+        } else {
+            s->size = 4;    // int, and the promoted char and short
+        }
+        break;
+    case 'c':
+        s->kind = ARG_INT;
+        s->size = 4;
+        break;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        s->kind = ARG_DOUBLE;
+        s->size = 8;        // long double is kept as a double
+        s->is_long_double = lm == 1 && s->lenmod[0] == 'L';
+        break;
+    case 's':
+        s->kind = ARG_STR;
+        s->size = abi->ptr_size;
+        break;
+    case 'p': case 'n':
+        s->kind = ARG_PTR;
+        s->size = abi->ptr_size;
+        break;
+    default:
+        s->kind = ARG_NONE;
+        break;
+    }
+    return p;
+}
+
+static size_t arg_bytes(const spec_t *s)
+{
+    return (s->width_star + s->prec_star) * 4u + (s->kind == ARG_NONE ? 0 : s->size);
+}
+
+/* ---------- Recording ---------- */
+static void put_le(uint8_t *p, uint64_t v, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+void dlog_write(dlog_level_t level, const char *tag, const char *fmt, ...)
+{
+    uint32_t head = atomic_load_explicit(&s_head, memory_order_relaxed);
+    do {
+        if (head - atomic_load_explicit(&s_tail, memory_order_acquire) >= DLOG_RECORDS) {
+            atomic_fetch_add_explicit(&s_dropped, 1, memory_order_relaxed);
+            return;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&s_head, &head, head + 1,
+                                                    memory_order_relaxed, memory_order_relaxed));
+    slot_t *slot = &s_ring[head % DLOG_RECORDS];
+    dlog_record_t *r = &slot->rec;
+    r->level = level;
+    r->t_us = now_us();
+    r->tag = tag;
+    r->fmt = fmt;
+
+    // Copy each argument as the format string says it was passed
+    va_list ap;
+    va_start(ap, fmt);
+    size_t len = 0;
+    for (const char *p = fmt; *p;) {
+        if (*p != '%') {
+            p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            p += 2;
+            continue;
+        }
+        spec_t s;
+        p = parse_spec(p, &s_native, &s);
+        if (p == NULL || len + arg_bytes(&s) > DLOG_ARG_BYTES) {
+            break;      // the formatter prints the rest as written
+        }
+        for (int i = 0; i < s.width_star + s.prec_star; i++) {
+            put_le(r->args + len, (uint32_t)va_arg(ap, int), 4);
+            len += 4;
+        }
+        uint64_t v = 0;
+        switch (s.kind) {
+        case ARG_INT:
+            v = s.size == 8 ? va_arg(ap, uint64_t) : va_arg(ap, uint32_t);
+            break;
+        case ARG_DOUBLE: {
+            const double d = s.is_long_double ? (double)va_arg(ap, long double) : va_arg(ap, double);
+            memcpy(&v, &d, sizeof(v));
+            break;
+        }
+        case ARG_STR:
+        case ARG_PTR:
+            v = (uintptr_t)va_arg(ap, const void *);
+            break;
+        case ARG_NONE:
+            continue;
+        }
+        put_le(r->args + len, v, s.size);
+        len += s.size;
+    }
+    va_end(ap);
+    r->args_len = (uint8_t)len;
+    atomic_store_explicit(&slot->seq, head + 1, memory_order_release);
+}
+
+bool dlog_pop(dlog_record_t *out)
+{
+    const uint32_t tail = atomic_load_explicit(&s_tail, memory_order_relaxed);
+    const slot_t *slot = &s_ring[tail % DLOG_RECORDS];
+    // Claimed but still being written counts as not there yet
+    if (atomic_load_explicit(&slot->seq, memory_order_acquire) != tail + 1) {
+        return false;
+    }
+    *out = slot->rec;
+    atomic_store_explicit(&s_tail, tail + 1, memory_order_release);
+    return true;
+}
+
+uint32_t dlog_take_dropped(void)
+{
+    return atomic_exchange_explicit(&s_dropped, 0, memory_order_relaxed);
+}
+
+/* ---------- Formatting ---------- */
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;     // as if nothing was truncated
+} out_t;
+
+static void out_printf(out_t *o, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void out_printf(out_t *o, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    const size_t room = o->len < o->size ? o->size - o->len : 0;
+    const int n = vsnprintf(room ? o->buf + o->len : NULL, room, fmt, ap);
+    va_end(ap);
+    o->len += n > 0 ? (size_t)n : 0;
+}
+
+static void out_text(out_t *o, const char *text, size_t n)
+{
+    out_printf(o, "%.*s", (int)n, text);
+}
+
+static uint64_t get_le(const uint8_t *p, size_t n)
+{
+    uint64_t v = 0;
+    for (size_t i = 0; i < n; i++) {
+        v |= (uint64_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+static const char *resolve_native(uint64_t addr, void *ctx)
+{
+    (void)ctx;
+    return (const char *)(uintptr_t)addr;
+}
+
+size_t dlog_format_args(const char *fmt, const uint8_t *args, size_t args_len, const dlog_abi_t *abi,
+                        dlog_resolve_fn_t resolve, void *ctx, char *buf, size_t size)
+{
+    out_t o = { .buf = buf, .size = size };
+    if (size) {
+        buf[0] = '\0';
+    }
+    size_t off = 0;
+    for (const char *p = fmt; *p;) {
+        const char *pct = strchr(p, '%');
+        if (pct == NULL) {
+            out_text(&o, p, strlen(p));
+            break;
+        }
+        out_text(&o, p, (size_t)(pct - p));
+        if (pct[1] == '%') {
+            out_text(&o, "%", 1);
+            p = pct + 2;
+            continue;
+        }
+        spec_t s;
+        const char *next = parse_spec(pct, abi, &s);
+        if (next == NULL) {
+            out_text(&o, pct, strlen(pct));
+            break;
+        }
+        p = next;
+        if (off + arg_bytes(&s) > args_len) {
+            off = args_len;     // not recorded: show the conversion itself
+            out_text(&o, s.start, (size_t)(s.end - s.start));
+            continue;
+        }
+        // Rebuild the conversion for this host's printf: stars become
+        // numbers and integers take a 64-bit value
+        char spec[48];
+        size_t n = 0;
+        for (const char *c = s.start; c < s.lenmod && n < sizeof(spec) - 24; c++) {
+            if (*c != '*') {
+                spec[n++] = *c;
+                continue;
+            }
+            const int32_t star = (int32_t)get_le(args + off, 4);
+            off += 4;
+            if (c[-1] == '.' && star < 0) {
+                n--;    // a negative precision is no precision
+            } else {
+                n += (size_t)snprintf(spec + n, sizeof(spec) - n, "%d", (int)star);
+            }
+        }
+        const uint64_t v = s.kind == ARG_NONE ? 0 : get_le(args + off, s.size);
+        off += s.kind == ARG_NONE ? 0 : s.size;
+        switch (s.kind) {
+        case ARG_INT:
+            if (s.conv == 'c') {
+                snprintf(spec + n, sizeof(spec) - n, "c");
+                out_printf(&o, spec, (int)v);
+            } else {
+                snprintf(spec + n, sizeof(spec) - n, "ll%c", s.conv);
+                const unsigned shift = 64 - 8 * s.size;
+                if (s.is_signed) {
+                    out_printf(&o, spec, (long long)((int64_t)(v << shift) >> shift));
+                } else {
+                    out_printf(&o, spec, (unsigned long long)v);
+                }
+            }
+            break;
+        case ARG_DOUBLE: {
+            double d;
+            memcpy(&d, &v, sizeof(d));
+            snprintf(spec + n, sizeof(spec) - n, "%c", s.conv);
+            out_printf(&o, spec, d);
+            break;
+        }
+        case ARG_STR: {
+            const char *str = v ? resolve(v, ctx) : "(null)";
+            if (str) {
+                snprintf(spec + n, sizeof(spec) - n, "s");
+                out_printf(&o, spec, str);
+            } else {
+                out_printf(&o, "<0x%llx>", (unsigned long long)v);
+            }
+            break;
+        }
+        case ARG_PTR:
+            if (s.conv == 'p') {
+                out_printf(&o, "0x%llx", (unsigned long long)v);
+            }
+            break;
+        case ARG_NONE:
+            out_text(&o, s.start, (size_t)(s.end - s.start));
+            break;
+        }
+    }
+    return o.len < size ? o.len : (size ? size - 1 : 0);
+}
+
+size_t dlog_format(const dlog_record_t *r, char *buf, size_t size)
+{
+    static const char letter[] = { [DLOG_ERROR] = 'E', [DLOG_WARN] = 'W', [DLOG_INFO] = 'I' };
+    const int n = snprintf(buf, size, "%c (%lu) %s: ", r->level <= DLOG_INFO ? letter[r->level] : '?',
+                           (unsigned long)(r->t_us / 1000), r->tag);
+    const size_t head = n < 0 ? 0 : (size_t)n < size ? (size_t)n : (size ? size - 1 : 0);
+    return head + dlog_format_args(r->fmt, r->args, r->args_len, &s_native, resolve_native, NULL,
+                                   buf + head, size - head);
+}
+
+/* ---------- Frames ---------- */
+esp_err_t dlog_encode(const dlog_record_t *r, uint8_t *buf, size_t size, size_t *ret_len)
+{
+    if (buf == NULL || ret_len == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const size_t payload = r ? 25u + r->args_len : 8u;
+    if (size < 4 + payload + 2) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    buf[0] = DLOG_SYNC0;
+    buf[1] = DLOG_SYNC1;
+    buf[2] = r ? DLOG_FRAME_RECORD : DLOG_FRAME_ANCHOR;
+    buf[3] = (uint8_t)payload;
+    uint8_t *p = buf + 4;
+    if (r) {
+        p[0] = (uint8_t)r->level;
+        put_le(p + 1, r->t_us, 8);
+        put_le(p + 9, (uintptr_t)r->tag, 8);
+        put_le(p + 17, (uintptr_t)r->fmt, 8);
+        memcpy(p + 25, r->args, r->args_len);
+    } else {
+        put_le(p, (uintptr_t)dlog_anchor, 8);
+    }
+    put_le(p + payload, metrics_crc16(buf + 2, 2 + payload), 2);
+    *ret_len = 4 + payload + 2;
+    return ESP_OK;
+}
@@ -0,0 +1,132 @@
+// dlog.h  (deferred logging: the format string's address and raw arguments now, the text later)
+//
+// DLOGE/DLOGW/DLOGI take the same arguments as ESP_LOGx but format
+// nothing: the call walks the format string to copy each argument's bytes
+// into a lock-free ring of fixed-size records and returns, a few hundred
+// cycles instead of a vsnprintf() with 64-bit and float conversions. A
+// low-priority task pops the records and either formats them on target
+// (dlog_format) or sends them as binary frames (dlog_encode) to be
+// formatted on a PC with host_test/dlog_cat, which looks the format and
+// tag strings up in the firmware ELF.
+//
+// Restrictions that follow from keeping only addresses: the format and
+// tag must be string literals, and %s arguments must be strings that live
+// forever (literals, esp_err_to_name()). At most DLOG_ARG_BYTES of
+// arguments are kept per record; conversions past that print as written.
+// When the ring is full new records are dropped and counted.
+//
+// Frames (little endian), the CRC as in metrics.h so both can share a UART:
+//
+//   0xA5 0x4C  type:u8  length:u8  payload  crc16:u16
+//   anchor:  address of dlog_anchor:u64 (lets the decoder relocate a PIE)
+//   record:  level:u8  t_us:u64  tag:u64  fmt:u64  arguments, packed
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#if defined(ESP_PLATFORM)
+#include "sdkconfig.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef CONFIG_APP_DLOG_RECORDS
+#define DLOG_RECORDS            CONFIG_APP_DLOG_RECORDS
+#else
+#define DLOG_RECORDS            64
+#endif
+#define DLOG_ARG_BYTES          32      /**< 8 ints or 4 doubles */
+
+#define DLOG_SYNC0              0xA5
+#define DLOG_SYNC1              0x4C
+#define DLOG_FRAME_MAX          (4 + 25 + DLOG_ARG_BYTES + 2)
+
+typedef enum {
+    DLOG_ERROR = 1,             /**< Same numbers as esp_log_level_t */
+    DLOG_WARN,
+    DLOG_INFO,
+} dlog_level_t;
+
+typedef enum {
+    DLOG_FRAME_ANCHOR = 1,
+    DLOG_FRAME_RECORD,
+} dlog_frame_type_t;
+
+typedef struct {
+    dlog_level_t level;
+    uint64_t t_us;
+    const char *tag;
+    const char *fmt;
+    uint8_t args_len;
+    uint8_t args[DLOG_ARG_BYTES];   /**< Argument bytes back to back, native sizes */
+} dlog_record_t;
+
+/**
+ * @brief Sizes of the types in the image that recorded the arguments
+ */
+typedef struct {
+    uint8_t ptr_size;
+    uint8_t long_size;
+} dlog_abi_t;
+
+/**
+ * @brief Text of the string at `addr` in the recording image, NULL if unknown
+ */
+typedef const char *(*dlog_resolve_fn_t)(uint64_t addr, void *ctx);
+
+/** Text the decoder finds in the ELF to relocate addresses */
+extern const char dlog_anchor[];
+
+/**
+ * @brief Queue a message; any task, no formatting, never blocks
+ */
+void dlog_write(dlog_level_t level, const char *tag, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+#define DLOGE(tag, fmt, ...)    dlog_write(DLOG_ERROR, tag, fmt, ##__VA_ARGS__)
+#define DLOGW(tag, fmt, ...)    dlog_write(DLOG_WARN, tag, fmt, ##__VA_ARGS__)
+#define DLOGI(tag, fmt, ...)    dlog_write(DLOG_INFO, tag, fmt, ##__VA_ARGS__)
+
+/**
+ * @brief Oldest queued record; one consumer task only
+ *
+ * @return false if the ring is empty
+ */
+bool dlog_pop(dlog_record_t *out);
+
+/**
+ * @brief Records dropped on a full ring since the last call
+ */
+uint32_t dlog_take_dropped(void);
+
+/**
+ * @brief Render a record as an ESP_LOG line without the newline: "I (1234) TAG: text"
+ *
+ * @return Length written, at most size - 1
+ */
+size_t dlog_format(const dlog_record_t *r, char *buf, size_t size);
+
+/**
+ * @brief Render `fmt` with packed argument bytes recorded by an image with `abi`
+ *
+ * %s arguments go through `resolve`; unresolved ones print as <0x...>.
+ *
+ * @return Length written, at most size - 1
+ */
+size_t dlog_format_args(const char *fmt, const uint8_t *args, size_t args_len, const dlog_abi_t *abi,
+                        dlog_resolve_fn_t resolve, void *ctx, char *buf, size_t size);
+
+/**
+ * @brief Frame of one record, or of the anchor (r == NULL); send an anchor first
+ *
+ * @return ESP_ERR_INVALID_SIZE if it doesn't fit `size` (DLOG_FRAME_MAX always does)
+ */
+esp_err_t dlog_encode(const dlog_record_t *r, uint8_t *buf, size_t size, size_t *ret_len);
+
+#ifdef __cplusplus
+}
+#endif
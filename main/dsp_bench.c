@@ -0,0 +1,205 @@
+// dsp_bench.c  (kernel microbenchmarks, same source on target and host)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dsp_kernels.h"
+#include "dsp_bench.h"
+#include "biquad.h"
+
+#if defined(ESP_PLATFORM)
+#include "esp_cpu.h"
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+#define BENCH_FIR_TAPS  16
+#define BENCH_BQ_CH     4
+
+typedef struct {
+    size_t n;
+    int16_t *x;         /**< Input block (+ FIR history) */
+    int16_t *y;         /**< Second input / FIR coefficients: at least BENCH_FIR_TAPS */
+    float   *f;         /**< Float input */
+    void    *out[2];    /**< [0] = reference output, [1] = optimized output */
+    biquad_t *bq;       /**< 4-section high-pass over BENCH_BQ_CH interleaved channels */
+} bench_bufs_t;
+
+typedef void (*bench_fn_t)(bench_bufs_t *b, int opt);
+
+static void b_gain(bench_bufs_t *b, int opt)
+{
+    (opt ? dsp_s16_gain : dsp_s16_gain_ref)(b->out[opt], b->x, 23170, 0, b->n);
+}
+
+static void b_gain_x4(bench_bufs_t *b, int opt)
+{
+    (opt ? dsp_s16_gain : dsp_s16_gain_ref)(b->out[opt], b->x, 23170, 2, b->n);
+}
+
+static void b_offset(bench_bufs_t *b, int opt)
+{
+    (opt ? dsp_s16_offset : dsp_s16_offset_ref)(b->out[opt], b->x, -1234, b->n);
+}
+
+static void b_dot(bench_bufs_t *b, int opt)
+{
+    *(int64_t *)b->out[opt] = (opt ? dsp_s16_dot : dsp_s16_dot_ref)(b->x, b->y, b->n);
+}
+
+static void b_fir(bench_bufs_t *b, int opt)
+{
+    (opt ? dsp_s16_fir : dsp_s16_fir_ref)(b->out[opt], b->x, b->y, BENCH_FIR_TAPS, b->n);
+}
+
+static void b_stats(bench_bufs_t *b, int opt)
+{
+    (opt ? dsp_s16_stats : dsp_s16_stats_ref)(b->x, b->n, 30000, b->out[opt]);
+}
+
+static void b_s16_to_f32(bench_bufs_t *b, int opt)
+{
+    (opt ? dsp_s16_to_f32 : dsp_s16_to_f32_ref)(b->out[opt], b->x, b->n);
+}
+
+static void b_f32_to_s16(bench_bufs_t *b, int opt)
+{
+    (opt ? dsp_f32_to_s16 : dsp_f32_to_s16_ref)(b->out[opt], b->f, b->n);
+}
+
+static void b_biquad(bench_bufs_t *b, int opt)
+{
+    int16_t *y = b->out[opt];
+    memcpy(y, b->x, b->n * sizeof(int16_t));
+    biquad_reset(b->bq);
+    (opt ? biquad_process : biquad_process_ref)(b->bq, y, b->n / BENCH_BQ_CH);
+}
+
+static const struct {
+    const char *name;
+    bench_fn_t fn;
+    size_t out_bytes_per_sample;    /**< 0 = fixed-size result */
+    size_t out_fixed_bytes;
+} s_kernels[] = {
+    { "gain_q15",   b_gain,       sizeof(int16_t), 0 },
+    { "gain_q15x4", b_gain_x4,    sizeof(int16_t), 0 },
+    { "offset",     b_offset,     sizeof(int16_t), 0 },
+    { "dot",        b_dot,        0, sizeof(int64_t) },
+    { "fir16",      b_fir,        sizeof(int16_t), 0 },
+    { "stats",      b_stats,      0, sizeof(dsp_s16_stats_t) },
+    { "s16_to_f32", b_s16_to_f32, sizeof(float),   0 },
+    { "f32_to_s16", b_f32_to_s16, sizeof(int16_t), 0 },
+    { "biquad4x4",  b_biquad,     sizeof(int16_t), 0 },
+};
+
+uint64_t dsp_bench_cycles(void)
+{
+#if defined(ESP_PLATFORM)
+    return esp_cpu_get_cycle_count();
+#elif defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static void *bench_alloc(size_t bytes)
+{
+    // aligned_alloc wants a multiple of the alignment
+    return aligned_alloc(16, (bytes + 15) & ~(size_t)15);
+}
+
+static double measure(bench_fn_t fn, bench_bufs_t *b, int opt, int iterations)
+{
+    uint64_t best = UINT64_MAX;
+    for (int rep = 0; rep < 3; rep++) {
+        const uint64_t t0 = dsp_bench_cycles();
+        for (int it = 0; it < iterations; it++) {
+            fn(b, opt);
+        }
+        const uint64_t dt = dsp_bench_cycles() - t0;
+        best = dt < best ? dt : best;
+    }
+    return best ? (double)b->n * iterations / (double)best : 0.0;
+}
+
+int dsp_bench_run(size_t block_len, int iterations, dsp_bench_result_t out[DSP_BENCH_MAX_RESULTS])
+{
+    const size_t out_max = block_len * sizeof(float) + sizeof(dsp_s16_stats_t);
+    // The FIR takes its taps from y whatever the block length
+    const size_t y_len = block_len > BENCH_FIR_TAPS ? block_len : BENCH_FIR_TAPS;
+    bench_bufs_t b = {
+        .n = block_len,
+        .x = bench_alloc((block_len + BENCH_FIR_TAPS) * sizeof(int16_t)),
+        .y = bench_alloc(y_len * sizeof(int16_t)),
+        .f = bench_alloc(block_len * sizeof(float)),
+        .out = { bench_alloc(out_max), bench_alloc(out_max) },
+    };
+    int count = -1;
+    biquad_config_t bq_cfg = { .num_sections = 4, .channels = BENCH_BQ_CH, .max_frames = block_len / BENCH_BQ_CH + 1 };
+    for (size_t s = 0; s < bq_cfg.num_sections; s++) {
+        biquad_design_highpass(20.0f * (float)(s + 1), 0.7071f, 48000.0f, &bq_cfg.sections[s]);
+    }
+    if (!b.x || !b.y || !b.f || !b.out[0] || !b.out[1] || biquad_create(&bq_cfg, &b.bq) != ESP_OK) {
+        goto cleanup;
+    }
+
+    // Deterministic LCG so target and host bench the same data
+    uint32_t seed = 0x2545f491;
+    for (size_t i = 0; i < block_len + BENCH_FIR_TAPS; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        b.x[i] = (int16_t)(seed >> 16);
+    }
+    for (size_t i = 0; i < block_len; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        b.y[i] = (int16_t)(seed >> 16);
+        b.f[i] = (float)(int32_t)seed / 2147483648.0f * 1.1f;
+    }
+    for (size_t i = block_len; i < y_len; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        b.y[i] = (int16_t)(seed >> 16);
+    }
+
+    count = 0;
+    for (size_t k = 0; k < sizeof(s_kernels) / sizeof(s_kernels[0]) && count < DSP_BENCH_MAX_RESULTS; k++) {
+        const size_t out_bytes = s_kernels[k].out_bytes_per_sample
+                                 ? s_kernels[k].out_bytes_per_sample * block_len
+                                 : s_kernels[k].out_fixed_bytes;
+        memset(b.out[0], 0, out_max);
+        memset(b.out[1], 0, out_max);
+        s_kernels[k].fn(&b, 0);
+        s_kernels[k].fn(&b, 1);
+
+        dsp_bench_result_t *r = &out[count++];
+        r->name = s_kernels[k].name;
+        r->bit_exact = memcmp(b.out[0], b.out[1], out_bytes) == 0;
+        r->ref_samples_per_cycle = measure(s_kernels[k].fn, &b, 0, iterations);
+        r->opt_samples_per_cycle = measure(s_kernels[k].fn, &b, 1, iterations);
+    }
+
+cleanup:
+    biquad_delete(b.bq);
+    free(b.x);
+    free(b.y);
+    free(b.f);
+    free(b.out[0]);
+    free(b.out[1]);
+    return count;
+}
+
+void dsp_bench_print(const dsp_bench_result_t *res, int n)
+{
+    printf("dsp kernels, backend=%s\n", dsp_kernels_backend());
+    printf("%-12s %12s %12s %8s %s\n", "kernel", "ref smp/cyc", "opt smp/cyc", "speedup", "exact");
+    for (int i = 0; i < n; i++) {
+        const double speedup = res[i].ref_samples_per_cycle > 0
+                               ? res[i].opt_samples_per_cycle / res[i].ref_samples_per_cycle : 0.0;
+        printf("%-12s %12.3f %12.3f %7.2fx %s\n", res[i].name,
+               res[i].ref_samples_per_cycle, res[i].opt_samples_per_cycle,
+               speedup, res[i].bit_exact ? "yes" : "NO");
+    }
+}
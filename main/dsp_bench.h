@@ -0,0 +1,44 @@
+// dsp_bench.h  (kernel microbenchmarks, same source on target and host)
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DSP_BENCH_MAX_RESULTS   16
+
+typedef struct {
+    const char *name;
+    double ref_samples_per_cycle;   /**< Scalar reference throughput */
+    double opt_samples_per_cycle;   /**< Dispatched (SIMD) kernel throughput */
+    bool bit_exact;                 /**< Outputs matched the reference on the bench input */
+} dsp_bench_result_t;
+
+/**
+ * @brief Cycle counter used by all benchmarks (CPU cycles on target, TSC ticks on x86)
+ */
+uint64_t dsp_bench_cycles(void);
+
+/**
+ * @brief Run every kernel on a random block and compare against the scalar reference
+ *
+ * @param block_len  Samples per call
+ * @param iterations Calls per measurement (best-of-3 is reported)
+ * @param out        Results, one per kernel
+ * @return Number of results written, or -1 if buffers could not be allocated
+ */
+int dsp_bench_run(size_t block_len, int iterations, dsp_bench_result_t out[DSP_BENCH_MAX_RESULTS]);
+
+/**
+ * @brief Print results as a table via printf
+ */
+void dsp_bench_print(const dsp_bench_result_t *res, int n);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,347 @@
+// dsp_graph.c  (static DSP graph: stages that declare formats and block sizes)
+
+#include <stdlib.h>
+#include <string.h>
+#include "dsp_graph.h"
+#include "esp_log.h"
+
+static const char *TAG = "DSP_GRAPH";
+
+typedef enum {
+    FEED_DIRECT,        // blocks as they come
+    FEED_SPLIT,         // cut into `block`-frame pieces, no copy
+    FEED_FIFO,          // gathered into `block`-frame pieces
+} feed_t;
+
+typedef struct {
+    dsp_graph_format_t fmt;
+    size_t max_frames;
+    size_t exact;       // every block has this many frames; 0 if they vary
+} edge_t;
+
+typedef struct {
+    dsp_graph_node_t cfg;
+    dsp_graph_format_t in, out;
+    size_t block;
+    feed_t feed;
+    bool in_place;
+    size_t max_in;
+    void *out_buf;
+    void *fifo;
+    size_t fifo_fill;
+    size_t fifo_channels;
+    uint64_t fifo_t0;
+    uint8_t children[DSP_GRAPH_MAX_NODES];
+    uint8_t num_children;
+    uint32_t calls;
+    uint64_t frames;
+    uint64_t time;
+} node_t;
+
+struct dsp_graph {
+    dsp_graph_format_t source;
+    size_t max_channels;
+    size_t max_frames;
+    uint64_t (*clock)(void);
+    size_t num_nodes;
+    node_t nodes[DSP_GRAPH_MAX_NODES];
+    uint8_t children[DSP_GRAPH_MAX_NODES];      // of the source
+    uint8_t num_children;
+};
+
+static size_t sample_bytes(dsp_graph_sample_t type)
+{
+    return type == DSP_GRAPH_Q31 ? sizeof(int32_t) : sizeof(int16_t);
+}
+
+static const char *format_name(dsp_graph_sample_t type)
+{
+    return type == DSP_GRAPH_Q31 ? "Q31" : type == DSP_GRAPH_S16 ? "int16" : "nothing";
+}
+
+static void *alloc_frames(size_t frames, size_t channels, dsp_graph_sample_t type)
+{
+    // 16-byte aligned and a multiple of 16 bytes, for the SIMD kernels
+    const size_t bytes = (frames * channels * sample_bytes(type) + 15) & ~(size_t)15;
+    return aligned_alloc(16, bytes ? bytes : 16);
+}
+
+/* Formats, block plan and in-place decision for node k, fed by `up` */
+static esp_err_t settle(dsp_graph_t *g, size_t k, const edge_t *up, edge_t *down)
+{
+    node_t *n = &g->nodes[k];
+    const dsp_graph_stage_t *s = n->cfg.stage;
+    if (up->fmt.type == DSP_GRAPH_NONE) {
+        ESP_LOGE(TAG, "%s: its input is a sink", s->name);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s->in.type != up->fmt.type) {
+        ESP_LOGE(TAG, "%s: takes %s, gets %s", s->name, format_name(s->in.type), format_name(up->fmt.type));
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s->in.channels != DSP_GRAPH_ANY_CHANNELS && s->in.channels != up->fmt.channels) {
+        ESP_LOGE(TAG, "%s: takes %u channels, gets %s%u", s->name, (unsigned)s->in.channels,
+                 up->fmt.channels ? "" : "up to ", (unsigned)(up->fmt.channels ? up->fmt.channels : g->max_channels));
+        return ESP_ERR_INVALID_ARG;
+    }
+    n->in = (dsp_graph_format_t) { s->in.type, up->fmt.channels };
+    n->out = (dsp_graph_format_t) {
+        s->out.type, s->out.channels == DSP_GRAPH_ANY_CHANNELS ? n->in.channels : s->out.channels
+    };
+
+    size_t exact_in = up->exact;
+    n->block = s->block;
+    n->max_in = up->max_frames;
+    n->feed = FEED_DIRECT;
+    if (s->block && up->exact && up->exact % s->block == 0) {
+        n->feed = FEED_SPLIT;
+    } else if (s->block && (s->flags & DSP_GRAPH_BLOCK_EXACT)) {
+        n->feed = FEED_FIFO;
+    }
+    if (n->feed != FEED_DIRECT) {
+        n->max_in = s->block;
+        exact_in = s->block;
+    }
+
+    const size_t decim = s->decim > 1 ? s->decim : 1;
+    *down = (edge_t) {
+        .fmt = n->out,
+        .max_frames = (n->max_in + decim - 1) / decim,
+        .exact = decim == 1 ? exact_in : 0,
+    };
+    if (n->out.type == DSP_GRAPH_NONE) {
+        return ESP_OK;
+    }
+
+    // In place only as the input buffer's last reader: later siblings read it after this runs
+    const int input = n->cfg.input;
+    const bool last_reader = n->feed == FEED_FIFO ||
+                             (input != DSP_GRAPH_SOURCE && g->nodes[input].children[g->nodes[input].num_children - 1] == k);
+    n->in_place = (s->flags & DSP_GRAPH_IN_PLACE) && decim == 1 && last_reader &&
+                  n->out.type == n->in.type && n->out.channels == n->in.channels;
+    return ESP_OK;
+}
+
+static esp_err_t build(dsp_graph_t *g, const dsp_graph_config_t *config)
+{
+    for (size_t k = 0; k < g->num_nodes; k++) {
+        const dsp_graph_node_t *c = &config->nodes[k];
+        if (c->stage == NULL || c->stage->process == NULL || c->input < DSP_GRAPH_SOURCE || c->input >= (int)k) {
+            ESP_LOGE(TAG, "node %u: no stage, or its input isn't an earlier node", (unsigned)k);
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (c->input == DSP_GRAPH_SOURCE) {
+            g->children[g->num_children++] = (uint8_t)k;
+        } else {
+            node_t *p = &g->nodes[c->input];
+            p->children[p->num_children++] = (uint8_t)k;
+        }
+    }
+
+    edge_t edges[DSP_GRAPH_MAX_NODES];
+    const edge_t source = { .fmt = g->source, .max_frames = g->max_frames };
+    for (size_t k = 0; k < g->num_nodes; k++) {
+        node_t *n = &g->nodes[k];
+        const esp_err_t err = settle(g, k, n->cfg.input == DSP_GRAPH_SOURCE ? &source : &edges[n->cfg.input],
+                                     &edges[k]);
+        if (err != ESP_OK) {
+            return err;
+        }
+        const size_t in_ch = n->in.channels ? n->in.channels : g->max_channels;
+        const size_t out_ch = n->out.channels ? n->out.channels : g->max_channels;
+        if (n->feed == FEED_FIFO && (n->fifo = alloc_frames(n->block, in_ch, n->in.type)) == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        if (n->out.type != DSP_GRAPH_NONE && !n->in_place &&
+                (n->out_buf = alloc_frames(edges[k].max_frames, out_ch, n->out.type)) == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t dsp_graph_create(const dsp_graph_config_t *config, dsp_graph_t **ret_graph)
+{
+    if (config == NULL || ret_graph == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    dsp_graph_t *g = calloc(1, sizeof(*g));
+    if (g == NULL) {
+        for (size_t k = 0; k < config->num_nodes && k < DSP_GRAPH_MAX_NODES; k++) {
+            if (config->nodes[k].stage && config->nodes[k].stage->destroy) {
+                config->nodes[k].stage->destroy(config->nodes[k].state);
+            }
+        }
+        return ESP_ERR_NO_MEM;
+    }
+    g->source = config->source;
+    g->max_channels = config->source.channels ? config->source.channels : config->max_channels;
+    g->max_frames = config->max_frames;
+    g->clock = config->clock;
+    g->num_nodes = config->num_nodes < DSP_GRAPH_MAX_NODES ? config->num_nodes : DSP_GRAPH_MAX_NODES;
+    for (size_t k = 0; k < g->num_nodes; k++) {
+        g->nodes[k].cfg = config->nodes[k];
+    }
+
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if (config->num_nodes > DSP_GRAPH_MAX_NODES || config->max_frames == 0 || g->max_channels == 0 ||
+            config->source.type == DSP_GRAPH_NONE) {
+        ESP_LOGE(TAG, "%u nodes, source of %u frames x %u channels", (unsigned)config->num_nodes,
+                 (unsigned)config->max_frames, (unsigned)g->max_channels);
+    } else {
+        err = build(g, config);
+    }
+    if (err != ESP_OK) {
+        dsp_graph_delete(g);
+        return err;
+    }
+    *ret_graph = g;
+    return ESP_OK;
+}
+
+void dsp_graph_delete(dsp_graph_t *graph)
+{
+    if (graph == NULL) {
+        return;
+    }
+    for (size_t k = 0; k < graph->num_nodes; k++) {
+        node_t *n = &graph->nodes[k];
+        if (n->cfg.stage && n->cfg.stage->destroy) {
+            n->cfg.stage->destroy(n->cfg.state);
+        }
+        free(n->out_buf);
+        free(n->fifo);
+    }
+    free(graph);
+}
+
+static void deliver(dsp_graph_t *g, size_t k, const uint8_t *in, size_t nframes, size_t channels, uint64_t t0);
+
+static void feed_children(dsp_graph_t *g, const uint8_t *children, size_t num_children,
+                          const void *frames, size_t nframes, size_t channels, uint64_t t0)
+{
+    for (size_t i = 0; i < num_children; i++) {
+        deliver(g, children[i], frames, nframes, channels, t0);
+    }
+}
+
+static void run(dsp_graph_t *g, node_t *n, const void *in, size_t nframes, size_t channels, uint64_t t0)
+{
+    const bool sink = n->out.type == DSP_GRAPH_NONE;
+    void *out = sink ? NULL : n->in_place ? (void *)in : n->out_buf;
+    const uint64_t start = g->clock ? g->clock() : 0;
+    const size_t produced = n->cfg.stage->process(n->cfg.state, in, out, nframes, channels, &t0);
+    if (g->clock) {
+        n->time += g->clock() - start;
+    }
+    n->calls++;
+    n->frames += nframes;
+    if (!sink && produced) {
+        const size_t out_ch = n->cfg.stage->out.channels ? n->cfg.stage->out.channels : channels;
+        feed_children(g, n->children, n->num_children, out, produced, out_ch, t0);
+    }
+}
+
+static void deliver(dsp_graph_t *g, size_t k, const uint8_t *in, size_t nframes, size_t channels, uint64_t t0)
+{
+    node_t *n = &g->nodes[k];
+    const size_t frame_bytes = channels * sample_bytes(n->in.type);
+    if (n->feed == FEED_DIRECT) {
+        run(g, n, in, nframes, channels, t0);
+        return;
+    }
+    if (n->feed == FEED_SPLIT) {
+        for (size_t off = 0; off < nframes; off += n->block) {
+            const size_t len = nframes - off < n->block ? nframes - off : n->block;
+            run(g, n, in + off * frame_bytes, len, channels, t0 + off);
+        }
+        return;
+    }
+    // A gap, or another device, leaves a partial block that belongs to nothing
+    if (n->fifo_fill && (t0 != n->fifo_t0 + n->fifo_fill || channels != n->fifo_channels)) {
+        n->fifo_fill = 0;
+    }
+    while (nframes) {
+        if (n->fifo_fill == 0) {
+            n->fifo_t0 = t0;
+            n->fifo_channels = channels;
+        }
+        const size_t room = n->block - n->fifo_fill;
+        const size_t take = nframes < room ? nframes : room;
+        memcpy((uint8_t *)n->fifo + n->fifo_fill * frame_bytes, in, take * frame_bytes);
+        n->fifo_fill += take;
+        in += take * frame_bytes;
+        nframes -= take;
+        t0 += take;
+        if (n->fifo_fill == n->block) {
+            n->fifo_fill = 0;
+            run(g, n, n->fifo, n->block, channels, n->fifo_t0);
+        }
+    }
+}
+
+void dsp_graph_push(dsp_graph_t *graph, const void *frames, size_t nframes, size_t channels, uint64_t t0)
+{
+    if (channels == 0 || channels > graph->max_channels ||
+            (graph->source.channels && channels != graph->source.channels)) {
+        return;
+    }
+    const size_t frame_bytes = channels * sample_bytes(graph->source.type);
+    const uint8_t *p = frames;
+    while (nframes) {
+        const size_t n = nframes < graph->max_frames ? nframes : graph->max_frames;
+        feed_children(graph, graph->children, graph->num_children, p, n, channels, t0);
+        p += n * frame_bytes;
+        nframes -= n;
+        t0 += n;
+    }
+}
+
+esp_err_t dsp_graph_set_sample_rate(dsp_graph_t *graph, uint32_t sample_rate_hz)
+{
+    uint32_t out_rate[DSP_GRAPH_MAX_NODES];
+    esp_err_t ret = ESP_OK;
+    for (size_t k = 0; k < graph->num_nodes; k++) {
+        const node_t *n = &graph->nodes[k];
+        const uint32_t in_rate = n->cfg.input == DSP_GRAPH_SOURCE ? sample_rate_hz : out_rate[n->cfg.input];
+        out_rate[k] = in_rate / (n->cfg.stage->decim > 1 ? n->cfg.stage->decim : 1);
+        if (n->cfg.stage->set_rate) {
+            const esp_err_t err = n->cfg.stage->set_rate(n->cfg.state, in_rate);
+            if (err != ESP_OK && ret == ESP_OK) {
+                ret = err;
+            }
+        }
+    }
+    return ret;
+}
+
+void dsp_graph_stream_cb(const int32_t *frames, size_t nframes, size_t channels, uint64_t t0, void *ctx)
+{
+    dsp_graph_push((dsp_graph_t *)ctx, frames, nframes, channels, t0);
+}
+
+size_t dsp_graph_num_nodes(const dsp_graph_t *graph)
+{
+    return graph->num_nodes;
+}
+
+esp_err_t dsp_graph_node_info(const dsp_graph_t *graph, size_t index, dsp_graph_node_info_t *out)
+{
+    if (graph == NULL || out == NULL || index >= graph->num_nodes) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const node_t *n = &graph->nodes[index];
+    *out = (dsp_graph_node_info_t) {
+        .name = n->cfg.stage->name,
+        .in = n->in,
+        .out = n->out,
+        .max_frames = n->max_in,
+        .split = n->feed == FEED_SPLIT,
+        .fifo = n->feed == FEED_FIFO,
+        .in_place = n->in_place,
+        .calls = n->calls,
+        .frames = n->frames,
+        .time = n->time,
+    };
+    return ESP_OK;
+}
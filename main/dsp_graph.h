@@ -0,0 +1,154 @@
+// dsp_graph.h  (static DSP graph: stages that declare formats and block sizes)
+//
+// A graph is a list of nodes in run order, each fed by the source or by an
+// earlier node. A stage declares the format it takes and the format it
+// gives (Q31 or int16, and a channel count), the block it wants, and how
+// much it decimates. dsp_graph_create() checks every edge, settles how each
+// node gets its blocks and allocates every buffer; dsp_graph_push() never
+// allocates.
+//
+// Block sizes: a stage that takes any size gets its input's blocks as they
+// come. One that prefers N frames gets its input cut into N-frame pieces
+// when the input always comes in multiples of N, and as it comes if not.
+// One that needs exactly N frames gets the same pieces, or else a FIFO of
+// its own. A FIFO that sees a gap in t0 drops what it holds, so a block
+// never straddles lost samples.
+//
+// Buffers: a stage whose output format is its input format, and which can
+// work in place, writes over its input when nothing after it reads that
+// buffer (it is its input's last consumer, or the buffer is its own FIFO).
+// Otherwise it writes to an output buffer sized for its largest block.
+// The source's blocks are never written.
+//
+// A node runs, then everything it feeds, depth first, before the next node
+// fed by the same input; output is only valid during that.
+//
+// No ESP-IDF dependency beyond esp_err.h: the firmware and the host
+// benchmarks run the same graph.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DSP_GRAPH_MAX_NODES     12
+#define DSP_GRAPH_SOURCE        (-1)    /**< dsp_graph_node_t::input: the pushed blocks */
+#define DSP_GRAPH_ANY_CHANNELS  0       /**< Take what the input has; give what was taken */
+
+/* dsp_graph_stage_t::flags */
+#define DSP_GRAPH_IN_PLACE      (1u << 0)   /**< process() works with out == in */
+#define DSP_GRAPH_BLOCK_EXACT   (1u << 1)   /**< `block` is a requirement, not a preference */
+
+typedef enum {
+    DSP_GRAPH_NONE = 0,         /**< Output of a sink */
+    DSP_GRAPH_S16,
+    DSP_GRAPH_Q31,
+} dsp_graph_sample_t;
+
+typedef struct {
+    dsp_graph_sample_t type;
+    size_t channels;            /**< Interleaved; DSP_GRAPH_ANY_CHANNELS */
+} dsp_graph_format_t;
+
+/**
+ * @brief Process one block
+ *
+ * @param in        `nframes` frames of `channels` samples in the stage's input format
+ * @param out       Output buffer (`in` when running in place); NULL for a sink
+ * @param t0        Absolute index of in[0]; a stage that changes the timeline
+ *                  (decimation) sets it to the index of out[0]
+ * @return Frames written to `out`; ignored for a sink
+ */
+typedef size_t (*dsp_graph_process_t)(void *state, const void *in, void *out, size_t nframes,
+                                      size_t channels, uint64_t *t0);
+
+typedef struct {
+    const char *name;
+    dsp_graph_format_t in;
+    dsp_graph_format_t out;     /**< type DSP_GRAPH_NONE: a sink */
+    size_t block;               /**< Frames per call wanted; 0 = any */
+    size_t decim;               /**< Output frames are at most ceil(in / decim); 0 or 1 = none */
+    uint32_t flags;
+    dsp_graph_process_t process;
+    esp_err_t (*set_rate)(void *state, uint32_t sample_rate_hz);   /**< Optional */
+    void (*destroy)(void *state);                                   /**< Optional; at dsp_graph_delete() */
+} dsp_graph_stage_t;
+
+typedef struct {
+    const dsp_graph_stage_t *stage;
+    void *state;
+    int input;                  /**< DSP_GRAPH_SOURCE or an earlier node's index */
+} dsp_graph_node_t;
+
+typedef struct {
+    dsp_graph_format_t source;
+    size_t max_channels;        /**< Largest channel count when source.channels is ANY */
+    size_t max_frames;          /**< Largest push */
+    size_t num_nodes;
+    dsp_graph_node_t nodes[DSP_GRAPH_MAX_NODES];
+    uint64_t (*clock)(void);    /**< Optional: time each process() call with it */
+} dsp_graph_config_t;
+
+typedef struct {
+    const char *name;
+    dsp_graph_format_t in;      /**< As settled: ANY only if the source's count varies */
+    dsp_graph_format_t out;
+    size_t max_frames;          /**< Largest block process() gets */
+    bool split;                 /**< Input cut into `block`-frame pieces */
+    bool fifo;                  /**< Input gathered into `block`-frame pieces */
+    bool in_place;
+    uint32_t calls;
+    uint64_t frames;            /**< Input frames processed */
+    uint64_t time;              /**< In config.clock units */
+} dsp_graph_node_info_t;
+
+typedef struct dsp_graph dsp_graph_t;
+
+/**
+ * @brief Check and settle the graph, allocate its buffers
+ *
+ * The graph owns the node states from here on, even on failure: they go
+ * to their stage's destroy().
+ *
+ * @return ESP_ERR_INVALID_ARG for a bad edge (the log says which), ESP_ERR_NO_MEM
+ */
+esp_err_t dsp_graph_create(const dsp_graph_config_t *config, dsp_graph_t **ret_graph);
+
+void dsp_graph_delete(dsp_graph_t *graph);
+
+/**
+ * @brief Run one block of source frames through the graph
+ *
+ * @param frames    At most config.max_frames; larger pushes are cut
+ * @param channels  The source's, at most config.max_channels
+ */
+void dsp_graph_push(dsp_graph_t *graph, const void *frames, size_t nframes, size_t channels, uint64_t t0);
+
+/**
+ * @brief Tell every stage its rate: the source's divided by the decimation on the way
+ *
+ * @return The first error a stage returned; the others are still told
+ */
+esp_err_t dsp_graph_set_sample_rate(dsp_graph_t *graph, uint32_t sample_rate_hz);
+
+/**
+ * @brief audio_stream_frames_cb_t adapter; ctx is a graph with a Q31 source
+ */
+void dsp_graph_stream_cb(const int32_t *frames, size_t nframes, size_t channels, uint64_t t0, void *ctx);
+
+size_t dsp_graph_num_nodes(const dsp_graph_t *graph);
+
+/**
+ * @brief How node `index` was settled, and what it has done so far
+ */
+esp_err_t dsp_graph_node_info(const dsp_graph_t *graph, size_t index, dsp_graph_node_info_t *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,473 @@
+// dsp_graph_stages.c  (the pipeline's stages as dsp_graph nodes, built from a text spec)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "biquad.h"
+#include "dsp_graph_stages.h"
+#include "dsp_kernels.h"
+#include "esp_check.h"
+#include "esp_log.h"
+
+static const char *TAG = "DSP_GRAPH";
+
+#define MAX_ARGS        3
+#define NAME_LEN        12
+#define DECIM_MAX       64
+
+/* Each instance carries its own descriptor: block sizes depend on its arguments */
+
+/* ---------- mono ---------- */
+
+typedef struct {
+    dsp_graph_stage_t stage;
+    size_t channel;
+} mono_t;
+
+static size_t mono_process(void *state, const void *in, void *out, size_t nframes, size_t channels, uint64_t *t0)
+{
+    (void)t0;
+    const mono_t *m = state;
+    const size_t ch = m->channel < channels ? m->channel : channels - 1u;
+    dsp_q31_to_s16(out, (const int32_t *)in + ch, channels, nframes);
+    return nframes;
+}
+
+/* ---------- hpf ---------- */
+
+typedef struct {
+    dsp_graph_stage_t stage;
+    biquad_t *bq;
+    float cutoff_hz;
+    size_t sections;
+} hpf_t;
+
+static esp_err_t hpf_design(const hpf_t *h, uint32_t hz, biquad_config_t *cfg)
+{
+    // DC blocker first, then Butterworth sections at the cutoff
+    cfg->num_sections = 1 + h->sections;
+    ESP_RETURN_ON_ERROR(biquad_design_dc_block(2.0f, hz, &cfg->sections[0]), TAG, "dc block");
+    for (size_t s = 1; s < cfg->num_sections; s++) {
+        ESP_RETURN_ON_ERROR(biquad_design_highpass(h->cutoff_hz, 0.7071f, hz, &cfg->sections[s]), TAG, "high-pass");
+    }
+    return ESP_OK;
+}
+
+static size_t hpf_process(void *state, const void *in, void *out, size_t nframes, size_t channels, uint64_t *t0)
+{
+    (void)channels;
+    (void)t0;
+    hpf_t *h = state;
+    if (out != in) {
+        memcpy(out, in, nframes * sizeof(int16_t));
+    }
+    biquad_process(h->bq, out, nframes);
+    return nframes;
+}
+
+static esp_err_t hpf_set_rate(void *state, uint32_t hz)
+{
+    hpf_t *h = state;
+    biquad_config_t cfg;
+    ESP_RETURN_ON_ERROR(hpf_design(h, hz, &cfg), TAG, "hpf at %u Hz", (unsigned)hz);
+    return biquad_set_sections(h->bq, cfg.sections, cfg.num_sections);
+}
+
+static void hpf_destroy(void *state)
+{
+    biquad_delete(((hpf_t *)state)->bq);
+    free(state);
+}
+
+/* ---------- decim ---------- */
+
+typedef struct {
+    dsp_graph_stage_t stage;
+    size_t m;
+    int32_t acc;
+    size_t count;
+    bool open;          // inside a group that started on a multiple of m
+    uint64_t next_t;
+} decim_t;
+
+static size_t decim_process(void *state, const void *in, void *out, size_t nframes, size_t channels, uint64_t *t0)
+{
+    (void)channels;
+    decim_t *d = state;
+    const int16_t *x = in;
+    int16_t *y = out;
+    if (*t0 != d->next_t) {
+        d->open = false;    // a gap: the group it cut is lost
+    }
+    d->next_t = *t0 + nframes;
+    // Output j averages input [j * m, (j + 1) * m): the timeline divides exactly
+    size_t n = 0;
+    uint64_t out_t0 = 0;
+    const int32_t half = (int32_t)(d->m / 2);
+    for (size_t i = 0; i < nframes; i++) {
+        const uint64_t t = *t0 + i;
+        if (t % d->m == 0) {
+            d->open = true;
+            d->acc = 0;
+            d->count = 0;
+        }
+        if (!d->open) {
+            continue;
+        }
+        d->acc += x[i];
+        if (++d->count == d->m) {
+            if (n == 0) {
+                out_t0 = t / d->m;
+            }
+            y[n++] = (int16_t)((d->acc >= 0 ? d->acc + half : d->acc - half) / (int32_t)d->m);
+            d->open = false;
+        }
+    }
+    *t0 = out_t0;
+    return n;
+}
+
+/* ---------- level, stft, goertzel: sinks around the existing modules ---------- */
+
+typedef struct {
+    dsp_graph_stage_t stage;
+    void *obj;
+} sink_t;
+
+static size_t level_process(void *state, const void *in, void *out, size_t nframes, size_t channels, uint64_t *t0)
+{
+    (void)out;
+    (void)channels;
+    level_meter_process(((sink_t *)state)->obj, in, nframes, *t0);
+    return 0;
+}
+
+static esp_err_t level_set_rate(void *state, uint32_t hz)
+{
+    return level_meter_set_sample_rate(((sink_t *)state)->obj, hz);
+}
+
+static void level_destroy(void *state)
+{
+    level_meter_delete(((sink_t *)state)->obj);
+    free(state);
+}
+
+static size_t stft_node_process(void *state, const void *in, void *out, size_t nframes, size_t channels,
+                                uint64_t *t0)
+{
+    (void)out;
+    (void)channels;
+    stft_process(((sink_t *)state)->obj, in, nframes, *t0);
+    return 0;
+}
+
+static void stft_destroy(void *state)
+{
+    stft_delete(((sink_t *)state)->obj);
+    free(state);
+}
+
+static size_t goertzel_node_process(void *state, const void *in, void *out, size_t nframes, size_t channels,
+                                    uint64_t *t0)
+{
+    (void)out;
+    (void)channels;
+    goertzel_process(((sink_t *)state)->obj, in, nframes, *t0);
+    return 0;
+}
+
+static esp_err_t goertzel_node_set_rate(void *state, uint32_t hz)
+{
+    return goertzel_set_sample_rate(((sink_t *)state)->obj, hz);
+}
+
+static void goertzel_destroy(void *state)
+{
+    goertzel_delete(((sink_t *)state)->obj);
+    free(state);
+}
+
+/* ---------- Factories ---------- */
+
+static const dsp_graph_format_t S16_MONO = { DSP_GRAPH_S16, 1 };
+static const dsp_graph_format_t SINK = { DSP_GRAPH_NONE, 0 };
+
+typedef esp_err_t (*factory_t)(const char *const *args, size_t nargs, const dsp_graph_stages_config_t *cfg,
+                               dsp_graph_node_t *node);
+
+static long arg_long(const char *const *args, size_t nargs, size_t i, long def)
+{
+    return i < nargs && *args[i] ? strtol(args[i], NULL, 10) : def;
+}
+
+static esp_err_t make_mono(const char *const *args, size_t nargs, const dsp_graph_stages_config_t *cfg,
+                           dsp_graph_node_t *node)
+{
+    (void)cfg;
+    const long ch = arg_long(args, nargs, 0, 0);
+    if (ch < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    mono_t *m = calloc(1, sizeof(*m));
+    if (m == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    m->channel = (size_t)ch;
+    m->stage = (dsp_graph_stage_t) {
+        .name = "mono",
+        .in = { DSP_GRAPH_Q31, DSP_GRAPH_ANY_CHANNELS },
+        .out = S16_MONO,
+        .process = mono_process,
+        .destroy = free,
+    };
+    node->stage = &m->stage;
+    node->state = m;
+    return ESP_OK;
+}
+
+static esp_err_t make_hpf(const char *const *args, size_t nargs, const dsp_graph_stages_config_t *cfg,
+                          dsp_graph_node_t *node)
+{
+    hpf_t *h = calloc(1, sizeof(*h));
+    if (h == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    h->cutoff_hz = (float)arg_long(args, nargs, 0, 50);
+    const long sections = arg_long(args, nargs, 1, 1);
+    biquad_config_t bq_cfg = { .channels = 1, .max_frames = cfg->max_frames };
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if (h->cutoff_hz > 0.0f && sections >= 0 && sections < BIQUAD_MAX_SECTIONS) {
+        h->sections = (size_t)sections;
+        err = hpf_design(h, cfg->sample_rate_hz, &bq_cfg);
+    }
+    if (err == ESP_OK) {
+        err = biquad_create(&bq_cfg, &h->bq);
+    }
+    if (err != ESP_OK) {
+        free(h);
+        return err;
+    }
+    h->stage = (dsp_graph_stage_t) {
+        .name = "hpf",
+        .in = S16_MONO,
+        .out = S16_MONO,
+        .flags = DSP_GRAPH_IN_PLACE,
+        .process = hpf_process,
+        .set_rate = hpf_set_rate,
+        .destroy = hpf_destroy,
+    };
+    node->stage = &h->stage;
+    node->state = h;
+    return ESP_OK;
+}
+
+static esp_err_t make_decim(const char *const *args, size_t nargs, const dsp_graph_stages_config_t *cfg,
+                            dsp_graph_node_t *node)
+{
+    (void)cfg;
+    const long m = arg_long(args, nargs, 0, 0);
+    if (m < 2 || m > DECIM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    decim_t *d = calloc(1, sizeof(*d));
+    if (d == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    d->m = (size_t)m;
+    d->stage = (dsp_graph_stage_t) {
+        .name = "decim",
+        .in = S16_MONO,
+        .out = S16_MONO,
+        .decim = d->m,
+        .process = decim_process,
+        .destroy = free,
+    };
+    node->stage = &d->stage;
+    node->state = d;
+    return ESP_OK;
+}
+
+static sink_t *new_sink(const char *name, dsp_graph_process_t process, void (*destroy)(void *))
+{
+    sink_t *s = calloc(1, sizeof(*s));
+    if (s) {
+        s->stage = (dsp_graph_stage_t) {
+            .name = name,
+            .in = S16_MONO,
+            .out = SINK,
+            .process = process,
+            .destroy = destroy,
+        };
+    }
+    return s;
+}
+
+static esp_err_t make_level(const char *const *args, size_t nargs, const dsp_graph_stages_config_t *cfg,
+                            dsp_graph_node_t *node)
+{
+    (void)args;
+    (void)nargs;
+    const level_meter_config_t meter_cfg = { .sample_rate_hz = cfg->sample_rate_hz };
+    level_meter_t *meter;
+    ESP_RETURN_ON_ERROR(level_meter_create(&meter_cfg, &meter), TAG, "level_meter_create");
+    sink_t *s = new_sink("level", level_process, level_destroy);
+    if (s == NULL || (cfg->level_cb && level_meter_subscribe(meter, cfg->level_cb, cfg->level_ctx) != ESP_OK)) {
+        free(s);
+        level_meter_delete(meter);
+        return ESP_ERR_NO_MEM;
+    }
+    s->obj = meter;
+    s->stage.set_rate = level_set_rate;
+    node->stage = &s->stage;
+    node->state = s;
+    return ESP_OK;
+}
+
+static esp_err_t make_stft(const char *const *args, size_t nargs, const dsp_graph_stages_config_t *cfg,
+                           dsp_graph_node_t *node)
+{
+    const long fft_size = arg_long(args, nargs, 0, 512);
+    const long hop = arg_long(args, nargs, 1, fft_size / 2);
+    if (fft_size <= 0 || hop <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const stft_config_t stft_cfg = { .fft_size = (size_t)fft_size, .hop = (size_t)hop, .window = STFT_WINDOW_HANN };
+    stft_t *stft;
+    ESP_RETURN_ON_ERROR(stft_create(&stft_cfg, &stft), TAG, "stft_create");
+    sink_t *s = new_sink("stft", stft_node_process, stft_destroy);
+    if (s == NULL || (cfg->stft_cb && stft_subscribe(stft, cfg->stft_cb, cfg->stft_ctx) != ESP_OK)) {
+        free(s);
+        stft_delete(stft);
+        return ESP_ERR_NO_MEM;
+    }
+    s->obj = stft;
+    // A frame every hop: whole hops make every call end on a frame
+    s->stage.block = (size_t)hop;
+    node->stage = &s->stage;
+    node->state = s;
+    return ESP_OK;
+}
+
+static esp_err_t make_goertzel(const char *const *args, size_t nargs, const dsp_graph_stages_config_t *cfg,
+                               dsp_graph_node_t *node)
+{
+    const long block = arg_long(args, nargs, 0, 480);
+    const long dbfs = arg_long(args, nargs, 1, -40);
+    char bands[64] = "2000,4000,8000";
+    if (nargs > 2 && *args[2]) {
+        // '/' between frequencies in the spec, ',' for goertzel_config_add_bands()
+        snprintf(bands, sizeof(bands), "%s", args[2]);
+        for (char *p = bands; *p; p++) {
+            *p = *p == '/' ? ',' : *p;
+        }
+    }
+    if (block <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    goertzel_config_t g_cfg = { .sample_rate_hz = cfg->sample_rate_hz, .block_len = (size_t)block, .hann = true };
+    ESP_RETURN_ON_ERROR(goertzel_config_add_bands(&g_cfg, bands, (float)dbfs), TAG, "goertzel bands");
+    goertzel_t *bank;
+    ESP_RETURN_ON_ERROR(goertzel_create(&g_cfg, &bank), TAG, "goertzel_create");
+    sink_t *s = new_sink("goertzel", goertzel_node_process, goertzel_destroy);
+    if (s == NULL || (cfg->goertzel_cb && goertzel_subscribe(bank, cfg->goertzel_cb, cfg->goertzel_ctx) != ESP_OK)) {
+        free(s);
+        goertzel_delete(bank);
+        return ESP_ERR_NO_MEM;
+    }
+    s->obj = bank;
+    s->stage.block = (size_t)block;
+    s->stage.set_rate = goertzel_node_set_rate;
+    node->stage = &s->stage;
+    node->state = s;
+    return ESP_OK;
+}
+
+static const struct {
+    const char *name;
+    factory_t make;
+} s_factories[] = {
+    { "mono", make_mono },
+    { "hpf", make_hpf },
+    { "decim", make_decim },
+    { "level", make_level },
+    { "stft", make_stft },
+    { "goertzel", make_goertzel },
+};
+
+/* ---------- Spec ---------- */
+
+static int find_input(const dsp_graph_config_t *gc, char names[][NAME_LEN], size_t k, const char *want)
+{
+    for (int j = (int)k - 1; j >= 0; j--) {
+        if (want ? strcmp(names[j], want) == 0 : gc->nodes[j].stage->out.type != DSP_GRAPH_NONE) {
+            return j;
+        }
+    }
+    return want ? -2 : DSP_GRAPH_SOURCE;
+}
+
+esp_err_t dsp_graph_stages_build(const char *spec, const dsp_graph_stages_config_t *config,
+                                 dsp_graph_t **ret_graph)
+{
+    if (spec == NULL || config == NULL || ret_graph == NULL || strlen(spec) >= DSP_GRAPH_STAGES_SPEC_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    char buf[DSP_GRAPH_STAGES_SPEC_LEN];
+    strcpy(buf, spec);
+    char names[DSP_GRAPH_MAX_NODES][NAME_LEN];
+    dsp_graph_config_t gc = {
+        .source = { DSP_GRAPH_Q31, DSP_GRAPH_ANY_CHANNELS },
+        .max_channels = config->max_channels,
+        .max_frames = config->max_frames,
+        .clock = config->clock,
+    };
+
+    esp_err_t err = ESP_OK;
+    char *save;
+    for (char *item = strtok_r(buf, " \t", &save); item && err == ESP_OK; item = strtok_r(NULL, " \t", &save)) {
+        char *input = strchr(item, '@');
+        if (input) {
+            *input++ = '\0';
+        }
+        const char *args[MAX_ARGS];
+        size_t nargs = 0;
+        char *colon = strchr(item, ':');
+        while (colon && nargs < MAX_ARGS) {
+            *colon = '\0';
+            args[nargs++] = colon + 1;
+            colon = strchr(colon + 1, ':');
+        }
+
+        factory_t make = NULL;
+        for (size_t f = 0; f < sizeof(s_factories) / sizeof(s_factories[0]); f++) {
+            if (strcmp(item, s_factories[f].name) == 0) {
+                make = s_factories[f].make;
+            }
+        }
+        const size_t k = gc.num_nodes;
+        const int from = find_input(&gc, names, k, input);
+        if (k == DSP_GRAPH_MAX_NODES || make == NULL || colon || from == -2) {
+            ESP_LOGE(TAG, "spec: \"%s\"%s%s: %s", item, input ? " from " : "", input ? input : "",
+                     k == DSP_GRAPH_MAX_NODES ? "too many stages" : make == NULL ? "no such stage" :
+                     colon ? "too many arguments" : "no such stage before it");
+            err = ESP_ERR_INVALID_ARG;
+            break;
+        }
+        err = make(args, nargs, config, &gc.nodes[k]);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "spec: \"%s\": %s", item, esp_err_to_name(err));
+            break;
+        }
+        gc.nodes[k].input = from;
+        snprintf(names[k], NAME_LEN, "%s", item);
+        gc.num_nodes++;
+    }
+    if (err != ESP_OK) {
+        for (size_t k = 0; k < gc.num_nodes; k++) {
+            gc.nodes[k].stage->destroy(gc.nodes[k].state);
+        }
+        return err;
+    }
+    return dsp_graph_create(&gc, ret_graph);
+}
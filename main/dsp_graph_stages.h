@@ -0,0 +1,61 @@
+// dsp_graph_stages.h  (the pipeline's stages as dsp_graph nodes, built from a text spec)
+//
+// A spec lists stages in run order, separated by spaces, each with its
+// arguments after colons:
+//
+//   mono[:channel]                          Q31 frames -> one int16 channel (default 0;
+//                                           a device with fewer gets its last, as uac_driver does)
+//   hpf[:cutoff_hz[:sections]]              DC blocker + Butterworth high-pass, in place (50 Hz, 1)
+//   decim:M                                 average each M samples into one, M in 2..64: a
+//                                           boxcar, first null at fs / M, not a brick wall
+//   level                                   level meter (sink)
+//   stft[:fft_size[:hop]]                   Hann spectrogram (sink; 512, fft_size / 2)
+//   goertzel[:block[:dbfs[:f1/f2/...]]]     band detector (sink; 480, -40, 2000/4000/8000)
+//
+// A stage reads the latest stage before it that has an output, or the
+// source (Q31 frames, any channel count) if there's none; `@name` reads the
+// latest stage so named instead. "mono hpf level stft" filters once and
+// meters and analyses the filtered samples; "mono hpf decim:4 stft level@hpf"
+// runs the spectrogram at a quarter of the rate and meters at the full one.
+// Sinks hand their results to the callbacks in the config.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "dsp_graph.h"
+#include "esp_err.h"
+#include "goertzel.h"
+#include "level_meter.h"
+#include "stft.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DSP_GRAPH_STAGES_SPEC_LEN   256
+
+typedef struct {
+    uint32_t sample_rate_hz;        /**< Until dsp_graph_set_sample_rate() */
+    size_t max_channels;            /**< Of the source */
+    size_t max_frames;              /**< Largest source block */
+    level_meter_cb_t level_cb;      /**< Optional, as the other callbacks */
+    void *level_ctx;
+    stft_frame_cb_t stft_cb;
+    void *stft_ctx;
+    goertzel_cb_t goertzel_cb;
+    void *goertzel_ctx;
+    uint64_t (*clock)(void);        /**< dsp_graph_config_t::clock */
+} dsp_graph_stages_config_t;
+
+/**
+ * @brief Create the stages a spec names and the graph that runs them
+ *
+ * @return ESP_ERR_INVALID_ARG for a bad spec (the log says where), ESP_ERR_NO_MEM
+ */
+esp_err_t dsp_graph_stages_build(const char *spec, const dsp_graph_stages_config_t *config,
+                                 dsp_graph_t **ret_graph);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,632 @@
+// dsp_kernels.c  (int16 / Q15 and Q31 format inner loops, scalar + PIE + SSE4.1/AVX2)
+//
+// Backend is picked at compile time. The SIMD paths only handle whole
+// vectors; tails (and, on PIE, unaligned buffers outside the FIR) go
+// through the scalar reference so every backend stays bit-exact with it.
+
+#include <math.h>
+#include <string.h>
+#include "dsp_kernels.h"
+#if defined(ESP_PLATFORM)
+#include "sdkconfig.h"
+#endif
+
+// Without sdkconfig.h the PIE backend would quietly drop out
+#if defined(ESP_PLATFORM) && !defined(CONFIG_IDF_TARGET)
+#error "dsp_kernels.c needs sdkconfig.h for CONFIG_DSP_KERNELS_PIE"
+#endif
+
+#if defined(CONFIG_DSP_KERNELS_PIE) && !defined(DSP_KERNELS_FORCE_SCALAR)
+#define DSP_BACKEND_PIE     1
+#elif defined(__AVX2__) && !defined(DSP_KERNELS_FORCE_SCALAR)
+#define DSP_BACKEND_AVX2    1
+#define DSP_BACKEND_SSE41   1
+#elif defined(__SSE4_1__) && !defined(DSP_KERNELS_FORCE_SCALAR)
+#define DSP_BACKEND_SSE41   1
+#endif
+
+#if DSP_BACKEND_AVX2 || DSP_BACKEND_SSE41
+#include <immintrin.h>
+#endif
+
+/* ================== Scalar reference ================== */
+
+void dsp_s16_gain_ref(int16_t *dst, const int16_t *src, int16_t gain_q15, unsigned shift, size_t n)
+{
+    const unsigned rs = 15 - shift;
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = dsp_sat16(((int32_t)src[i] * gain_q15) >> rs);
+    }
+}
+
+void dsp_s16_offset_ref(int16_t *dst, const int16_t *src, int16_t offset, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = dsp_sat16((int32_t)src[i] + offset);
+    }
+}
+
+int64_t dsp_s16_dot_ref(const int16_t *a, const int16_t *b, size_t n)
+{
+    int64_t acc = 0;
+    for (size_t i = 0; i < n; i++) {
+        acc += (int32_t)a[i] * b[i];
+    }
+    return acc;
+}
+
+static inline int16_t fir_round(int64_t acc)
+{
+    acc = (acc + (1 << 14)) >> 15;
+    return (int16_t)(acc > INT16_MAX ? INT16_MAX : (acc < INT16_MIN ? INT16_MIN : acc));
+}
+
+void dsp_s16_fir_ref(int16_t *dst, const int16_t *src, const int16_t *coeffs, size_t ntaps, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = fir_round(dsp_s16_dot_ref(coeffs, src + i, ntaps));
+    }
+}
+
+void dsp_s16_stats_ref(const int16_t *src, size_t n, int16_t clip_level, dsp_s16_stats_t *st)
+{
+    memset(st, 0, sizeof(*st));
+    if (n == 0) {
+        return;
+    }
+    int16_t mn = INT16_MAX, mx = INT16_MIN;
+    for (size_t i = 0; i < n; i++) {
+        const int32_t x = src[i];
+        st->sum += x;
+        st->sum_sq += (uint32_t)(x * x);
+        if (x < mn) {
+            mn = (int16_t)x;
+        }
+        if (x > mx) {
+            mx = (int16_t)x;
+        }
+        if (x >= clip_level || x <= -clip_level) {
+            st->clip_count++;
+        }
+    }
+    st->min = mn;
+    st->max = mx;
+}
+
+void dsp_s16_to_f32_ref(float *dst, const int16_t *src, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = (float)src[i] * (1.0f / 32768.0f);
+    }
+}
+
+void dsp_f32_to_s16_ref(int16_t *dst, const float *src, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        float v = src[i] * 32768.0f;
+        v = v > 32767.0f ? 32767.0f : v;
+        v = v < -32768.0f ? -32768.0f : v;
+        dst[i] = (int16_t)lrintf(v);
+    }
+}
+
+void dsp_pcm_to_q31_ref(int32_t *dst, const uint8_t *src, size_t subframe_bytes, size_t n)
+{
+    for (size_t i = 0; i < n; i++, src += subframe_bytes) {
+        uint32_t v = 0;
+        for (size_t b = 0; b < subframe_bytes; b++) {
+            v |= (uint32_t)src[b] << (8 * (4 - subframe_bytes + b));
+        }
+        dst[i] = (int32_t)v;
+    }
+}
+
+void dsp_q31_to_s16_ref(int16_t *dst, const int32_t *src, size_t stride, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = dsp_sat16(((src[i * stride] >> 15) + 1) >> 1);
+    }
+}
+
+/* ================== ESP32-P4 PIE ================== */
+#if DSP_BACKEND_PIE
+
+// PIE loads/stores ignore the low 4 address bits, so only 16-byte aligned
+// buffers take the vector path. Pool-allocated blocks always are.
+#define PIE_ALIGNED(p)  ((((uintptr_t)(p)) & 15) == 0)
+
+// The 40-bit XACC accumulator takes 8 products (<= 2^30 each) per vmulas
+// and holds up to 2^39 - 1: 32 vectors of full-scale -32768 squared make
+// 2^38, 64 would wrap. Flushed every 32.
+#define PIE_XACC_CHUNK  32
+#define PIE_FIR_MAX_TAPS 128    // shifted tap copy on the stack
+
+static int64_t pie_dot_aligned(const int16_t *a, const int16_t *b, size_t nvec)
+{
+    int64_t acc = 0;
+    while (nvec) {
+        size_t chunk = nvec > PIE_XACC_CHUNK ? PIE_XACC_CHUNK : nvec;
+        nvec -= chunk;
+        uint32_t lo, hi;
+        asm volatile("esp.zero.xacc\n");
+        for (size_t v = 0; v < chunk; v++) {
+            asm volatile(
+                "esp.vld.128.ip q0, %0, 16\n"
+                "esp.vld.128.ip q1, %1, 16\n"
+                "esp.vmulas.s16.xacc q0, q1\n"
+                : "+r"(a), "+r"(b) :: "memory");
+        }
+        asm volatile(
+            "esp.movx.r.xacc.l %0\n"
+            "esp.movx.r.xacc.h %1\n"
+            : "=r"(lo), "=r"(hi));
+        // Sign-extend the 40-bit accumulator
+        int64_t v = (int64_t)(((uint64_t)(hi & 0xff) << 32) | lo);
+        acc += (v & (1LL << 39)) ? v - (1LL << 40) : v;
+    }
+    return acc;
+}
+
+void dsp_s16_gain(int16_t *dst, const int16_t *src, int16_t gain_q15, unsigned shift, size_t n)
+{
+    // esp.vmul.s16 shifts by SAR; only use it where no saturation can occur
+    if (shift != 0 || gain_q15 == INT16_MIN || !PIE_ALIGNED(dst) || !PIE_ALIGNED(src)) {
+        dsp_s16_gain_ref(dst, src, gain_q15, shift, n);
+        return;
+    }
+    const size_t nvec = n / 8;
+    int16_t gvec[8] __attribute__((aligned(16)));
+    for (int k = 0; k < 8; k++) {
+        gvec[k] = gain_q15;
+    }
+    const int16_t *gp = gvec;
+    const int16_t *s = src;
+    int16_t *d = dst;
+    asm volatile(
+        "esp.movx.w.sar %1\n"
+        "esp.vld.128.ip q1, %0, 0\n"
+        : "+r"(gp) : "r"(15) : "memory");
+    for (size_t v = 0; v < nvec; v++) {
+        asm volatile(
+            "esp.vld.128.ip q0, %0, 16\n"
+            "esp.vmul.s16 q2, q0, q1\n"
+            "esp.vst.128.ip q2, %1, 16\n"
+            : "+r"(s), "+r"(d) :: "memory");
+    }
+    dsp_s16_gain_ref(dst + nvec * 8, src + nvec * 8, gain_q15, shift, n - nvec * 8);
+}
+
+void dsp_s16_offset(int16_t *dst, const int16_t *src, int16_t offset, size_t n)
+{
+    if (!PIE_ALIGNED(dst) || !PIE_ALIGNED(src)) {
+        dsp_s16_offset_ref(dst, src, offset, n);
+        return;
+    }
+    const size_t nvec = n / 8;
+    int16_t ovec[8] __attribute__((aligned(16)));
+    for (int k = 0; k < 8; k++) {
+        ovec[k] = offset;
+    }
+    const int16_t *op = ovec;
+    const int16_t *s = src;
+    int16_t *d = dst;
+    asm volatile("esp.vld.128.ip q1, %0, 0\n" : "+r"(op) :: "memory");
+    for (size_t v = 0; v < nvec; v++) {
+        asm volatile(
+            "esp.vld.128.ip q0, %0, 16\n"
+            "esp.vadd.s16 q2, q0, q1\n"
+            "esp.vst.128.ip q2, %1, 16\n"
+            : "+r"(s), "+r"(d) :: "memory");
+    }
+    dsp_s16_offset_ref(dst + nvec * 8, src + nvec * 8, offset, n - nvec * 8);
+}
+
+int64_t dsp_s16_dot(const int16_t *a, const int16_t *b, size_t n)
+{
+    if (!PIE_ALIGNED(a) || !PIE_ALIGNED(b)) {
+        return dsp_s16_dot_ref(a, b, n);
+    }
+    const size_t nvec = n / 8;
+    return pie_dot_aligned(a, b, nvec) + dsp_s16_dot_ref(a + nvec * 8, b + nvec * 8, n - nvec * 8);
+}
+
+/* Output i reads src + i, 16-byte aligned for one output in 8. Each of the
+ * others loads from the aligned address p samples below it, against the
+ * taps shifted up by p with zeros in front: one shifted copy per phase
+ * serves every output of that phase. The vectors start and end inside the
+ * aligned 16 bytes holding the first and last sample read, so nothing
+ * outside the buffer's words changes the sum. */
+void dsp_s16_fir(int16_t *dst, const int16_t *src, const int16_t *coeffs, size_t ntaps, size_t n)
+{
+    if (((uintptr_t)src & 1) || ntaps == 0 || ntaps > PIE_FIR_MAX_TAPS) {
+        dsp_s16_fir_ref(dst, src, coeffs, ntaps, n);
+        return;
+    }
+    int16_t shifted[PIE_FIR_MAX_TAPS + 8] __attribute__((aligned(16)));
+    const size_t src_phase = ((uintptr_t)src >> 1) & 7;
+    for (size_t p = 0; p < 8; p++) {
+        const size_t nvec = (p + ntaps + 7) / 8;
+        memset(shifted, 0, nvec * 8 * sizeof(int16_t));
+        memcpy(shifted + p, coeffs, ntaps * sizeof(int16_t));
+        for (size_t i = (p + 8 - src_phase) & 7; i < n; i += 8) {
+            dst[i] = fir_round(pie_dot_aligned(shifted, src + i - p, nvec));
+        }
+    }
+}
+
+void dsp_s16_stats(const int16_t *src, size_t n, int16_t clip_level, dsp_s16_stats_t *st)
+{
+    // No PIE min/max/clip-count path yet
+    dsp_s16_stats_ref(src, n, clip_level, st);
+}
+
+void dsp_s16_to_f32(float *dst, const int16_t *src, size_t n)
+{
+    dsp_s16_to_f32_ref(dst, src, n);
+}
+
+void dsp_f32_to_s16(int16_t *dst, const float *src, size_t n)
+{
+    dsp_f32_to_s16_ref(dst, src, n);
+}
+
+// PIE has no byte shuffle; 24-bit samples still go four at a time from
+// three word loads instead of twelve byte loads
+static void pcm24_to_q31_words(int32_t *dst, const uint8_t *src, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4, src += 12) {
+        uint32_t w[3];
+        memcpy(w, src, sizeof(w));
+        dst[i + 0] = (int32_t)(w[0] << 8);
+        dst[i + 1] = (int32_t)(((w[0] >> 24) << 8) | (w[1] << 16));
+        dst[i + 2] = (int32_t)(((w[1] >> 16) << 8) | (w[2] << 24));
+        dst[i + 3] = (int32_t)(w[2] & 0xFFFFFF00u);
+    }
+    dsp_pcm_to_q31_ref(dst + i, src, 3, n - i);
+}
+
+void dsp_pcm_to_q31(int32_t *dst, const uint8_t *src, size_t subframe_bytes, size_t n)
+{
+    if (subframe_bytes == 3) {
+        pcm24_to_q31_words(dst, src, n);
+    } else {
+        dsp_pcm_to_q31_ref(dst, src, subframe_bytes, n);
+    }
+}
+
+void dsp_q31_to_s16(int16_t *dst, const int32_t *src, size_t stride, size_t n)
+{
+    dsp_q31_to_s16_ref(dst, src, stride, n);
+}
+
+const char *dsp_kernels_backend(void)
+{
+    return "pie";
+}
+
+/* ================== x86 SSE4.1 / AVX2 ================== */
+#elif DSP_BACKEND_SSE41
+
+// madd_epi16 overflows int32 only for (-32768 * -32768) * 2 = 2^31, which
+// wraps to INT32_MIN; no other pair sum can produce that value, so it is
+// fixed up to +2^31 when widening.
+static inline __m128i widen_madd_lo(__m128i m)
+{
+    __m128i w = _mm_cvtepi32_epi64(m);
+    __m128i fix = _mm_cmpeq_epi64(w, _mm_set1_epi64x(INT32_MIN));
+    return _mm_add_epi64(w, _mm_and_si128(fix, _mm_set1_epi64x(1LL << 32)));
+}
+
+static inline int64_t hsum_epi64_128(__m128i v)
+{
+    return _mm_cvtsi128_si64(v) + _mm_extract_epi64(v, 1);
+}
+
+#if DSP_BACKEND_AVX2
+static inline __m256i widen_madd_256(__m128i m)
+{
+    __m256i w = _mm256_cvtepi32_epi64(m);
+    __m256i fix = _mm256_cmpeq_epi64(w, _mm256_set1_epi64x(INT32_MIN));
+    return _mm256_add_epi64(w, _mm256_and_si256(fix, _mm256_set1_epi64x(1LL << 32)));
+}
+
+static inline int64_t hsum_epi64_256(__m256i v)
+{
+    return hsum_epi64_128(_mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+}
+#endif
+
+void dsp_s16_gain(int16_t *dst, const int16_t *src, int16_t gain_q15, unsigned shift, size_t n)
+{
+    const __m128i cnt = _mm_cvtsi32_si128((int)(15 - shift));
+    size_t i = 0;
+#if DSP_BACKEND_AVX2
+    const __m256i g8 = _mm256_set1_epi16(gain_q15);
+    for (; i + 16 <= n; i += 16) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i lo = _mm256_mullo_epi16(x, g8);
+        __m256i hi = _mm256_mulhi_epi16(x, g8);
+        __m256i p0 = _mm256_sra_epi32(_mm256_unpacklo_epi16(lo, hi), cnt);
+        __m256i p1 = _mm256_sra_epi32(_mm256_unpackhi_epi16(lo, hi), cnt);
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_packs_epi32(p0, p1));
+    }
+#endif
+    const __m128i g4 = _mm_set1_epi16(gain_q15);
+    for (; i + 8 <= n; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i lo = _mm_mullo_epi16(x, g4);
+        __m128i hi = _mm_mulhi_epi16(x, g4);
+        __m128i p0 = _mm_sra_epi32(_mm_unpacklo_epi16(lo, hi), cnt);
+        __m128i p1 = _mm_sra_epi32(_mm_unpackhi_epi16(lo, hi), cnt);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(p0, p1));
+    }
+    dsp_s16_gain_ref(dst + i, src + i, gain_q15, shift, n - i);
+}
+
+void dsp_s16_offset(int16_t *dst, const int16_t *src, int16_t offset, size_t n)
+{
+    size_t i = 0;
+#if DSP_BACKEND_AVX2
+    const __m256i o8 = _mm256_set1_epi16(offset);
+    for (; i + 16 <= n; i += 16) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_adds_epi16(x, o8));
+    }
+#endif
+    const __m128i o4 = _mm_set1_epi16(offset);
+    for (; i + 8 <= n; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_adds_epi16(x, o4));
+    }
+    dsp_s16_offset_ref(dst + i, src + i, offset, n - i);
+}
+
+int64_t dsp_s16_dot(const int16_t *a, const int16_t *b, size_t n)
+{
+    size_t i = 0;
+    int64_t acc = 0;
+#if DSP_BACKEND_AVX2
+    __m256i acc8 = _mm256_setzero_si256();
+    for (; i + 16 <= n; i += 16) {
+        __m256i m = _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(a + i)),
+                                      _mm256_loadu_si256((const __m256i *)(b + i)));
+        acc8 = _mm256_add_epi64(acc8, widen_madd_256(_mm256_castsi256_si128(m)));
+        acc8 = _mm256_add_epi64(acc8, widen_madd_256(_mm256_extracti128_si256(m, 1)));
+    }
+    acc += hsum_epi64_256(acc8);
+#endif
+    __m128i acc4 = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8) {
+        __m128i m = _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(a + i)),
+                                   _mm_loadu_si128((const __m128i *)(b + i)));
+        acc4 = _mm_add_epi64(acc4, widen_madd_lo(m));
+        acc4 = _mm_add_epi64(acc4, widen_madd_lo(_mm_srli_si128(m, 8)));
+    }
+    acc += hsum_epi64_128(acc4);
+    return acc + dsp_s16_dot_ref(a + i, b + i, n - i);
+}
+
+void dsp_s16_stats(const int16_t *src, size_t n, int16_t clip_level, dsp_s16_stats_t *st)
+{
+    if (n < 8) {
+        dsp_s16_stats_ref(src, n, clip_level, st);
+        return;
+    }
+    // madd(x, 1) pair sums fit 17 bits, so 32-bit lanes can take 2^14
+    // vectors before widening. madd(x, x) pair sums are in [0, 2^31] and
+    // are widened as unsigned every vector.
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i hi_thr = _mm_set1_epi16((int16_t)(clip_level - 1));
+    const __m128i lo_thr = _mm_set1_epi16((int16_t)(-clip_level + 1));
+    __m128i vmin = _mm_set1_epi16(INT16_MAX);
+    __m128i vmax = _mm_set1_epi16(INT16_MIN);
+    __m128i sum64 = _mm_setzero_si128();
+    __m128i sq64 = _mm_setzero_si128();
+    uint32_t clip2 = 0;   // two movemask bits per clipped sample
+    size_t i = 0;
+    while (i + 8 <= n) {
+        __m128i sum32 = _mm_setzero_si128();
+        const size_t nvec = (n - i) / 8 > 16384 ? 16384 : (n - i) / 8;
+        const size_t end = i + nvec * 8;
+        for (; i < end; i += 8) {
+            __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+            sum32 = _mm_add_epi32(sum32, _mm_madd_epi16(x, ones));
+            __m128i sq = _mm_madd_epi16(x, x);
+            sq64 = _mm_add_epi64(sq64, _mm_cvtepu32_epi64(sq));
+            sq64 = _mm_add_epi64(sq64, _mm_cvtepu32_epi64(_mm_srli_si128(sq, 8)));
+            vmin = _mm_min_epi16(vmin, x);
+            vmax = _mm_max_epi16(vmax, x);
+            __m128i clip = _mm_or_si128(_mm_cmpgt_epi16(x, hi_thr), _mm_cmpgt_epi16(lo_thr, x));
+            clip2 += (uint32_t)__builtin_popcount(_mm_movemask_epi8(clip));
+        }
+        sum64 = _mm_add_epi64(sum64, _mm_cvtepi32_epi64(sum32));
+        sum64 = _mm_add_epi64(sum64, _mm_cvtepi32_epi64(_mm_srli_si128(sum32, 8)));
+    }
+
+    int16_t lanes[8];
+    dsp_s16_stats_t tail;
+    dsp_s16_stats_ref(src + i, n - i, clip_level, &tail);
+
+    st->sum = hsum_epi64_128(sum64) + tail.sum;
+    st->sum_sq = (uint64_t)hsum_epi64_128(sq64) + tail.sum_sq;
+    st->clip_count = clip2 / 2 + tail.clip_count;
+    _mm_storeu_si128((__m128i *)lanes, vmin);
+    st->min = lanes[0];
+    for (int k = 1; k < 8; k++) {
+        st->min = lanes[k] < st->min ? lanes[k] : st->min;
+    }
+    _mm_storeu_si128((__m128i *)lanes, vmax);
+    st->max = lanes[0];
+    for (int k = 1; k < 8; k++) {
+        st->max = lanes[k] > st->max ? lanes[k] : st->max;
+    }
+    if (i < n) {
+        st->min = tail.min < st->min ? tail.min : st->min;
+        st->max = tail.max > st->max ? tail.max : st->max;
+    }
+}
+
+void dsp_s16_to_f32(float *dst, const int16_t *src, size_t n)
+{
+    size_t i = 0;
+#if DSP_BACKEND_AVX2
+    const __m256 k8 = _mm256_set1_ps(1.0f / 32768.0f);
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(src + i)));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x), k8));
+    }
+#else
+    const __m128 k4 = _mm_set1_ps(1.0f / 32768.0f);
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i *)(src + i)));
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(x), k4));
+    }
+#endif
+    dsp_s16_to_f32_ref(dst + i, src + i, n - i);
+}
+
+void dsp_f32_to_s16(int16_t *dst, const float *src, size_t n)
+{
+    // cvtps_epi32 rounds per MXCSR (nearest-even by default), same as lrintf
+    size_t i = 0;
+    const __m128 k4 = _mm_set1_ps(32768.0f);
+    const __m128 hi4 = _mm_set1_ps(32767.0f);
+    const __m128 lo4 = _mm_set1_ps(-32768.0f);
+    for (; i + 8 <= n; i += 8) {
+        __m128 a = _mm_mul_ps(_mm_loadu_ps(src + i), k4);
+        __m128 b = _mm_mul_ps(_mm_loadu_ps(src + i + 4), k4);
+        a = _mm_max_ps(_mm_min_ps(a, hi4), lo4);
+        b = _mm_max_ps(_mm_min_ps(b, hi4), lo4);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+    }
+    dsp_f32_to_s16_ref(dst + i, src + i, n - i);
+}
+
+void dsp_pcm_to_q31(int32_t *dst, const uint8_t *src, size_t subframe_bytes, size_t n)
+{
+    size_t i = 0;
+    if (subframe_bytes == 3) {
+        // Byte k of each 3-byte sample lands in byte k + 1 of its lane; byte 0 is zero
+        const __m128i shuf = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+#if DSP_BACKEND_AVX2
+        // Two 16-byte loads of which 12 bytes are used: stay 4 bytes clear of the end
+        const __m256i shuf2 = _mm256_broadcastsi128_si256(shuf);
+        for (; i + 8 <= n && 3 * i + 28 <= 3 * n; i += 8) {
+            __m256i v = _mm256_inserti128_si256(
+                            _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(src + 3 * i))),
+                            _mm_loadu_si128((const __m128i *)(src + 3 * i + 12)), 1);
+            _mm256_storeu_si256((__m256i *)(dst + i), _mm256_shuffle_epi8(v, shuf2));
+        }
+#endif
+        for (; i + 4 <= n && 3 * i + 16 <= 3 * n; i += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(src + 3 * i));
+            _mm_storeu_si128((__m128i *)(dst + i), _mm_shuffle_epi8(v, shuf));
+        }
+    } else if (subframe_bytes == 2) {
+        for (; i + 8 <= n; i += 8) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+            _mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi16(_mm_setzero_si128(), v));
+            _mm_storeu_si128((__m128i *)(dst + i + 4), _mm_unpackhi_epi16(_mm_setzero_si128(), v));
+        }
+    }
+    dsp_pcm_to_q31_ref(dst + i, src + i * subframe_bytes, subframe_bytes, n - i);
+}
+
+void dsp_q31_to_s16(int16_t *dst, const int32_t *src, size_t stride, size_t n)
+{
+    size_t i = 0;
+    const __m128i one = _mm_set1_epi32(1);
+    if (stride == 1) {
+        for (; i + 8 <= n; i += 8) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 4));
+            a = _mm_srai_epi32(_mm_add_epi32(_mm_srai_epi32(a, 15), one), 1);
+            b = _mm_srai_epi32(_mm_add_epi32(_mm_srai_epi32(b, 15), one), 1);
+            _mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(a, b));
+        }
+    } else if (stride == 2) {
+        // Even lanes of four loads are the channel; packs saturates like sat16.
+        // The last load ends one past frame i + 7's sample, so it needs frame i + 8
+        for (; i + 8 < n; i += 8) {
+            const int32_t *s = src + 2 * i;
+            __m128i a = _mm_unpacklo_epi64(_mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)s), 0x08),
+                                           _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(s + 4)), 0x08));
+            __m128i b = _mm_unpacklo_epi64(_mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(s + 8)), 0x08),
+                                           _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(s + 12)), 0x08));
+            a = _mm_srai_epi32(_mm_add_epi32(_mm_srai_epi32(a, 15), one), 1);
+            b = _mm_srai_epi32(_mm_add_epi32(_mm_srai_epi32(b, 15), one), 1);
+            _mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(a, b));
+        }
+    }
+    dsp_q31_to_s16_ref(dst + i, src + i * stride, stride, n - i);
+}
+
+const char *dsp_kernels_backend(void)
+{
+#if DSP_BACKEND_AVX2
+    return "avx2";
+#else
+    return "sse4.1";
+#endif
+}
+
+/* ================== Scalar only ================== */
+#else
+
+void dsp_s16_gain(int16_t *dst, const int16_t *src, int16_t gain_q15, unsigned shift, size_t n)
+{
+    dsp_s16_gain_ref(dst, src, gain_q15, shift, n);
+}
+
+void dsp_s16_offset(int16_t *dst, const int16_t *src, int16_t offset, size_t n)
+{
+    dsp_s16_offset_ref(dst, src, offset, n);
+}
+
+int64_t dsp_s16_dot(const int16_t *a, const int16_t *b, size_t n)
+{
+    return dsp_s16_dot_ref(a, b, n);
+}
+
+void dsp_s16_stats(const int16_t *src, size_t n, int16_t clip_level, dsp_s16_stats_t *st)
+{
+    dsp_s16_stats_ref(src, n, clip_level, st);
+}
+
+void dsp_s16_to_f32(float *dst, const int16_t *src, size_t n)
+{
+    dsp_s16_to_f32_ref(dst, src, n);
+}
+
+void dsp_f32_to_s16(int16_t *dst, const float *src, size_t n)
+{
+    dsp_f32_to_s16_ref(dst, src, n);
+}
+
+void dsp_pcm_to_q31(int32_t *dst, const uint8_t *src, size_t subframe_bytes, size_t n)
+{
+    dsp_pcm_to_q31_ref(dst, src, subframe_bytes, n);
+}
+
+void dsp_q31_to_s16(int16_t *dst, const int32_t *src, size_t stride, size_t n)
+{
+    dsp_q31_to_s16_ref(dst, src, stride, n);
+}
+
+const char *dsp_kernels_backend(void)
+{
+    return "scalar";
+}
+
+#endif
+
+#if !DSP_BACKEND_PIE
+/* FIR is a dot product per output; the x86 dot takes unaligned loads */
+void dsp_s16_fir(int16_t *dst, const int16_t *src, const int16_t *coeffs, size_t ntaps, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = fir_round(dsp_s16_dot(coeffs, src + i, ntaps));
+    }
+}
+#endif
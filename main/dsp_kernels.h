@@ -0,0 +1,120 @@
+// dsp_kernels.h  (int16 / Q15 and Q31 format inner loops)
+//
+// Every DSP stage in the pipeline (gain, DC removal, FIR, level metering,
+// format conversion) bottoms out in one of these loops. Each kernel has a
+// portable scalar reference (`*_ref`) and a dispatching entry point that
+// uses the best SIMD backend compiled in:
+//
+//   - ESP32-P4 PIE (CONFIG_DSP_KERNELS_PIE)
+//   - x86 AVX2 / SSE4.1 (host builds, see host_test/)
+//   - scalar fallback
+//
+// All backends are bit-exact with the reference; host_test/test_dsp_kernels.c
+// checks that on random and edge-case input.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Clip level used by the level meter: |x| >= this counts as clipped */
+#define DSP_S16_CLIP_LEVEL_DEFAULT  32767
+
+typedef struct {
+    int64_t  sum;           /**< Sum of samples (DC = sum / n) */
+    uint64_t sum_sq;        /**< Sum of squared samples (RMS = sqrt(sum_sq / n)) */
+    int16_t  min;           /**< Smallest sample */
+    int16_t  max;           /**< Largest sample */
+    uint32_t clip_count;    /**< Samples with |x| >= clip_level */
+} dsp_s16_stats_t;
+
+/**
+ * @brief dst[i] = sat16((src[i] * gain_q15) >> (15 - shift))
+ *
+ * The shift is arithmetic (rounds towards -inf). `shift` in [0, 15] gives
+ * gains up to 2^shift. dst may alias src.
+ */
+void dsp_s16_gain(int16_t *dst, const int16_t *src, int16_t gain_q15, unsigned shift, size_t n);
+
+/**
+ * @brief dst[i] = sat16(src[i] + offset). dst may alias src.
+ */
+void dsp_s16_offset(int16_t *dst, const int16_t *src, int16_t offset, size_t n);
+
+/**
+ * @brief Exact 64-bit dot product sum(a[i] * b[i])
+ */
+int64_t dsp_s16_dot(const int16_t *a, const int16_t *b, size_t n);
+
+/**
+ * @brief Q15 FIR: dst[i] = sat16((sum_k coeffs[k] * src[i + k] + 2^14) >> 15)
+ *
+ * `coeffs` is stored time-reversed (oldest tap first) and `src` must hold
+ * n + ntaps - 1 samples, i.e. the ntaps - 1 history samples followed by the
+ * new block. dst must not alias src.
+ */
+void dsp_s16_fir(int16_t *dst, const int16_t *src, const int16_t *coeffs, size_t ntaps, size_t n);
+
+/**
+ * @brief Single-pass block statistics (sum, sum of squares, min/max, clips)
+ *
+ * @param clip_level Threshold in [1, 32767]; |x| >= clip_level counts as a clip
+ */
+void dsp_s16_stats(const int16_t *src, size_t n, int16_t clip_level, dsp_s16_stats_t *st);
+
+/**
+ * @brief dst[i] = src[i] / 32768.0f
+ */
+void dsp_s16_to_f32(float *dst, const int16_t *src, size_t n);
+
+/**
+ * @brief dst[i] = sat16(round_nearest_even(src[i] * 32768.0f)). NaN input is undefined.
+ */
+void dsp_f32_to_s16(int16_t *dst, const float *src, size_t n);
+
+/**
+ * @brief Unpack little-endian PCM subframes to left-justified Q31
+ *
+ * UAC Type I samples are MSB-justified in their subframe, so a sample of
+ * `subframe_bytes` (2, 3 or 4) becomes dst[i] = sample << (32 - 8 * subframe_bytes):
+ * full scale maps to full scale whatever the source width. `n` counts
+ * samples (frames x channels); src holds n * subframe_bytes bytes.
+ */
+void dsp_pcm_to_q31(int32_t *dst, const uint8_t *src, size_t subframe_bytes, size_t n);
+
+/**
+ * @brief One channel of interleaved Q31 frames to int16
+ *
+ * dst[i] = sat16(((src[i * stride] >> 15) + 1) >> 1), i.e. rounded to
+ * nearest with ties up. stride 1 converts a mono block.
+ */
+void dsp_q31_to_s16(int16_t *dst, const int32_t *src, size_t stride, size_t n);
+
+/* Scalar references. Always compiled; the dispatching kernels above must match them bit for bit. */
+void    dsp_s16_gain_ref(int16_t *dst, const int16_t *src, int16_t gain_q15, unsigned shift, size_t n);
+void    dsp_s16_offset_ref(int16_t *dst, const int16_t *src, int16_t offset, size_t n);
+int64_t dsp_s16_dot_ref(const int16_t *a, const int16_t *b, size_t n);
+void    dsp_s16_fir_ref(int16_t *dst, const int16_t *src, const int16_t *coeffs, size_t ntaps, size_t n);
+void    dsp_s16_stats_ref(const int16_t *src, size_t n, int16_t clip_level, dsp_s16_stats_t *st);
+void    dsp_s16_to_f32_ref(float *dst, const int16_t *src, size_t n);
+void    dsp_f32_to_s16_ref(int16_t *dst, const float *src, size_t n);
+void    dsp_pcm_to_q31_ref(int32_t *dst, const uint8_t *src, size_t subframe_bytes, size_t n);
+void    dsp_q31_to_s16_ref(int16_t *dst, const int32_t *src, size_t stride, size_t n);
+
+/**
+ * @brief Name of the backend the dispatching kernels were built with ("pie", "avx2", "sse4.1", "scalar")
+ */
+const char *dsp_kernels_backend(void);
+
+static inline int16_t dsp_sat16(int32_t x)
+{
+    return (int16_t)(x > INT16_MAX ? INT16_MAX : (x < INT16_MIN ? INT16_MIN : x));
+}
+
+#ifdef __cplusplus
+}
+#endif
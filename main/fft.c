@@ -0,0 +1,217 @@
+// fft.c  (float radix-4 FFT with precomputed twiddles)
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "fft.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+struct fft_plan {
+    size_t n;
+    unsigned log2n;
+    size_t num_swaps;
+    uint16_t *swaps;        /**< Bit-reversal swap pairs (i, j), i < j */
+    fft_cf32_t *twiddles;   /**< Per radix-4 stage: W^k, W^2k, W^3k for k in [0, L) */
+};
+
+struct fft_real_plan {
+    size_t n;
+    fft_plan_t *half;       /**< n/2-point complex plan */
+    fft_cf32_t *split;      /**< W_n^k for k in [0, n/2] */
+};
+
+static inline fft_cf32_t cmul(fft_cf32_t a, fft_cf32_t b)
+{
+    return (fft_cf32_t) {
+        a.re * b.re - a.im * b.im, a.re * b.im + a.im * b.re
+    };
+}
+
+static inline fft_cf32_t twiddle(size_t k, size_t n)
+{
+    const double ang = -2.0 * M_PI * (double)k / (double)n;
+    return (fft_cf32_t) {
+        (float)cos(ang), (float)sin(ang)
+    };
+}
+
+static unsigned bit_reverse(unsigned x, unsigned bits)
+{
+    unsigned r = 0;
+    for (unsigned b = 0; b < bits; b++) {
+        r = (r << 1) | ((x >> b) & 1);
+    }
+    return r;
+}
+
+esp_err_t fft_plan_create(size_t n, fft_plan_t **ret_plan)
+{
+    if (n < 2 || n > FFT_MAX_SIZE / 2 || (n & (n - 1)) != 0 || ret_plan == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    fft_plan_t *plan = calloc(1, sizeof(*plan));
+    if (plan == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    plan->n = n;
+    while ((1u << plan->log2n) < n) {
+        plan->log2n++;
+    }
+
+    // Swap list: roughly n/2 pairs, only the i < j half
+    plan->swaps = malloc(n * sizeof(uint16_t));
+    // Twiddles: sum of 3L over radix-4 stages is < n
+    plan->twiddles = malloc(n * sizeof(fft_cf32_t));
+    if (plan->swaps == NULL || plan->twiddles == NULL) {
+        fft_plan_delete(plan);
+        return ESP_ERR_NO_MEM;
+    }
+    for (unsigned i = 0; i < n; i++) {
+        unsigned j = bit_reverse(i, plan->log2n);
+        if (i < j) {
+            plan->swaps[plan->num_swaps * 2] = (uint16_t)i;
+            plan->swaps[plan->num_swaps * 2 + 1] = (uint16_t)j;
+            plan->num_swaps++;
+        }
+    }
+
+    fft_cf32_t *tw = plan->twiddles;
+    for (size_t L = (plan->log2n & 1) ? 2 : 1; L < n; L *= 4) {
+        for (size_t k = 0; k < L; k++) {
+            *tw++ = twiddle(k, 4 * L);
+            *tw++ = twiddle(2 * k, 4 * L);
+            *tw++ = twiddle(3 * k, 4 * L);
+        }
+    }
+
+    *ret_plan = plan;
+    return ESP_OK;
+}
+
+void fft_plan_delete(fft_plan_t *plan)
+{
+    if (plan == NULL) {
+        return;
+    }
+    free(plan->swaps);
+    free(plan->twiddles);
+    free(plan);
+}
+
+void fft_cf32(const fft_plan_t *plan, fft_cf32_t *d)
+{
+    const size_t n = plan->n;
+
+    for (size_t s = 0; s < plan->num_swaps; s++) {
+        const uint16_t i = plan->swaps[s * 2], j = plan->swaps[s * 2 + 1];
+        fft_cf32_t t = d[i];
+        d[i] = d[j];
+        d[j] = t;
+    }
+
+    size_t L = 1;
+    if (plan->log2n & 1) {
+        for (size_t i = 0; i < n; i += 2) {
+            fft_cf32_t a = d[i], b = d[i + 1];
+            d[i] = (fft_cf32_t) {
+                a.re + b.re, a.im + b.im
+            };
+            d[i + 1] = (fft_cf32_t) {
+                a.re - b.re, a.im - b.im
+            };
+        }
+        L = 2;
+    }
+
+    // Radix-4 DIT. With bit-reversed input the four length-L sub-DFTs of a
+    // 4L group sit in the order x[4n], x[4n+2], x[4n+1], x[4n+3].
+    const fft_cf32_t *tw = plan->twiddles;
+    for (; L < n; L *= 4) {
+        for (size_t base = 0; base < n; base += 4 * L) {
+            fft_cf32_t *p0 = d + base, *p1 = p0 + L, *p2 = p1 + L, *p3 = p2 + L;
+            for (size_t k = 0; k < L; k++) {
+                const fft_cf32_t a = p0[k];
+                const fft_cf32_t b = cmul(p2[k], tw[3 * k]);
+                const fft_cf32_t c = cmul(p1[k], tw[3 * k + 1]);
+                const fft_cf32_t e = cmul(p3[k], tw[3 * k + 2]);
+                const fft_cf32_t t0 = { a.re + c.re, a.im + c.im };
+                const fft_cf32_t t1 = { a.re - c.re, a.im - c.im };
+                const fft_cf32_t t2 = { b.re + e.re, b.im + e.im };
+                const fft_cf32_t t3 = { b.re - e.re, b.im - e.im };
+                p0[k] = (fft_cf32_t) {
+                    t0.re + t2.re, t0.im + t2.im
+                };
+                p1[k] = (fft_cf32_t) {
+                    t1.re + t3.im, t1.im - t3.re
+                };
+                p2[k] = (fft_cf32_t) {
+                    t0.re - t2.re, t0.im - t2.im
+                };
+                p3[k] = (fft_cf32_t) {
+                    t1.re - t3.im, t1.im + t3.re
+                };
+            }
+        }
+        tw += 3 * L;
+    }
+}
+
+esp_err_t fft_real_plan_create(size_t n, fft_real_plan_t **ret_plan)
+{
+    if (n < 4 || n > FFT_MAX_SIZE || (n & (n - 1)) != 0 || ret_plan == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    fft_real_plan_t *plan = calloc(1, sizeof(*plan));
+    if (plan == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    plan->n = n;
+    plan->split = malloc((n / 2 + 1) * sizeof(fft_cf32_t));
+    esp_err_t err = plan->split ? fft_plan_create(n / 2, &plan->half) : ESP_ERR_NO_MEM;
+    if (err != ESP_OK) {
+        fft_real_plan_delete(plan);
+        return err;
+    }
+    for (size_t k = 0; k <= n / 2; k++) {
+        plan->split[k] = twiddle(k, n);
+    }
+    *ret_plan = plan;
+    return ESP_OK;
+}
+
+void fft_real_plan_delete(fft_real_plan_t *plan)
+{
+    if (plan == NULL) {
+        return;
+    }
+    fft_plan_delete(plan->half);
+    free(plan->split);
+    free(plan);
+}
+
+void fft_real_f32(const fft_real_plan_t *plan, float *work, fft_cf32_t *out)
+{
+    // Even/odd samples as re/im of an n/2-point complex sequence, then
+    // X[k] = E[k] + W_n^k O[k] with E, O recovered from Z[k] and Z[m-k]*.
+    const size_t m = plan->n / 2;
+    fft_cf32_t *z = (fft_cf32_t *)work;
+    fft_cf32(plan->half, z);
+
+    for (size_t k = 0; k <= m / 2; k++) {
+        const fft_cf32_t zk = z[k];
+        const fft_cf32_t zc = z[k == 0 ? 0 : m - k];
+        const fft_cf32_t e = { 0.5f * (zk.re + zc.re), 0.5f * (zk.im - zc.im) };
+        const fft_cf32_t o = { 0.5f * (zk.im + zc.im), -0.5f * (zk.re - zc.re) };
+        const fft_cf32_t wo = cmul(o, plan->split[k]);
+        out[k] = (fft_cf32_t) {
+            e.re + wo.re, e.im + wo.im
+        };
+        // E[m-k] = E[k]*, O[m-k] = O[k]* and W^(m-k) = -(W^k)*, so X[m-k] = (E[k] - W^k O[k])*
+        out[m - k] = (fft_cf32_t) {
+            e.re - wo.re, -(e.im - wo.im)
+        };
+    }
+}
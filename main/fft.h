@@ -0,0 +1,57 @@
+// fft.h  (float radix-4 FFT with precomputed twiddles)
+//
+// Complex transforms of any power-of-two length: radix-4 stages, plus one
+// radix-2 stage when log2(n) is odd. Twiddles and the bit-reversal swap
+// list are built once per plan; the transform itself never allocates.
+
+#pragma once
+
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FFT_MAX_SIZE    8192    /**< Largest real transform length */
+
+typedef struct {
+    float re;
+    float im;
+} fft_cf32_t;
+
+typedef struct fft_plan fft_plan_t;
+typedef struct fft_real_plan fft_real_plan_t;
+
+/**
+ * @brief Create a complex FFT plan
+ *
+ * @param n Transform length, power of two in [2, FFT_MAX_SIZE / 2]
+ */
+esp_err_t fft_plan_create(size_t n, fft_plan_t **ret_plan);
+void fft_plan_delete(fft_plan_t *plan);
+
+/**
+ * @brief In-place forward complex FFT (unnormalized, e^{-j...} kernel)
+ */
+void fft_cf32(const fft_plan_t *plan, fft_cf32_t *data);
+
+/**
+ * @brief Create a real-input FFT plan (n/2-point complex FFT plus split)
+ *
+ * @param n Transform length, power of two in [4, FFT_MAX_SIZE]
+ */
+esp_err_t fft_real_plan_create(size_t n, fft_real_plan_t **ret_plan);
+void fft_real_plan_delete(fft_real_plan_t *plan);
+
+/**
+ * @brief Forward FFT of n real samples
+ *
+ * @param work n floats of input; used as scratch and clobbered
+ * @param out  n/2 + 1 bins (DC .. Nyquist)
+ */
+void fft_real_f32(const fft_real_plan_t *plan, float *work, fft_cf32_t *out);
+
+#ifdef __cplusplus
+}
+#endif
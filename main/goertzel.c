@@ -0,0 +1,240 @@
+// goertzel.c  (Goertzel filter bank for a few narrow target bands)
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "goertzel.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Bands are processed in groups of this many so the inner loop has a
+// constant trip count and vectorizes even at -O2.
+#define BAND_GROUP  8
+
+struct goertzel {
+    goertzel_config_t cfg;
+    size_t nb_pad;              /**< num_bands rounded up to BAND_GROUP */
+    float *coeff;               /**< 2 cos(w) per band, nb_pad entries */
+    float *s1, *s2;             /**< Filter state per band */
+    float *window;              /**< block_len coefficients, or NULL */
+    float norm;                 /**< Scales |X|^2 so a full-scale sine reads 1.0 */
+    float level[GOERTZEL_MAX_BANDS];
+    uint32_t above;
+    size_t pos;                 /**< Samples into the current block */
+    uint64_t block_t0;
+    uint64_t next_t;
+    bool started;
+    bool rebase;                /**< Rate changed: the next sample starts a new block */
+    struct {
+        goertzel_cb_t cb;
+        void *ctx;
+    } subs[GOERTZEL_MAX_SUBSCRIBERS];
+    int num_subs;
+};
+
+static void set_coeffs(goertzel_t *g)
+{
+    for (size_t b = 0; b < g->cfg.num_bands; b++) {
+        const double w = 2.0 * M_PI * g->cfg.bands[b].freq_hz / g->cfg.sample_rate_hz;
+        g->coeff[b] = (float)(2.0 * cos(w));
+    }
+}
+
+esp_err_t goertzel_create(const goertzel_config_t *config, goertzel_t **ret_bank)
+{
+    if (config == NULL || ret_bank == NULL || config->sample_rate_hz == 0 || config->block_len == 0 ||
+            config->num_bands == 0 || config->num_bands > GOERTZEL_MAX_BANDS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t b = 0; b < config->num_bands; b++) {
+        if (config->bands[b].freq_hz <= 0.0f || config->bands[b].freq_hz >= config->sample_rate_hz / 2.0f) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    goertzel_t *g = calloc(1, sizeof(*g));
+    if (g == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    g->cfg = *config;
+    g->nb_pad = (config->num_bands + BAND_GROUP - 1) / BAND_GROUP * BAND_GROUP;
+    g->coeff = calloc(g->nb_pad, sizeof(float));
+    g->s1 = calloc(g->nb_pad, sizeof(float));
+    g->s2 = calloc(g->nb_pad, sizeof(float));
+    if (config->hann) {
+        g->window = malloc(config->block_len * sizeof(float));
+    }
+    if (!g->coeff || !g->s1 || !g->s2 || (config->hann && !g->window)) {
+        goertzel_delete(g);
+        return ESP_ERR_NO_MEM;
+    }
+
+    set_coeffs(g);
+    double wsum = (double)config->block_len;
+    if (config->hann) {
+        wsum = 0.0;
+        for (size_t i = 0; i < config->block_len; i++) {
+            g->window[i] = (float)(0.5 - 0.5 * cos(2.0 * M_PI * (double)i / (double)config->block_len));
+            wsum += g->window[i];
+        }
+    }
+    const double full_scale = 32768.0 * wsum / 2.0;
+    g->norm = (float)(1.0 / (full_scale * full_scale));
+
+    *ret_bank = g;
+    return ESP_OK;
+}
+
+void goertzel_delete(goertzel_t *bank)
+{
+    if (bank == NULL) {
+        return;
+    }
+    free(bank->coeff);
+    free(bank->s1);
+    free(bank->s2);
+    free(bank->window);
+    free(bank);
+}
+
+esp_err_t goertzel_subscribe(goertzel_t *bank, goertzel_cb_t cb, void *ctx)
+{
+    if (bank == NULL || cb == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (bank->num_subs >= GOERTZEL_MAX_SUBSCRIBERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    bank->subs[bank->num_subs].cb = cb;
+    bank->subs[bank->num_subs].ctx = ctx;
+    bank->num_subs++;
+    return ESP_OK;
+}
+
+static void reset_state(goertzel_t *g)
+{
+    memset(g->s1, 0, g->nb_pad * sizeof(float));
+    memset(g->s2, 0, g->nb_pad * sizeof(float));
+    g->pos = 0;
+}
+
+esp_err_t goertzel_set_sample_rate(goertzel_t *bank, uint32_t sample_rate_hz)
+{
+    if (bank == NULL || sample_rate_hz == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t b = 0; b < bank->cfg.num_bands; b++) {
+        if (bank->cfg.bands[b].freq_hz >= sample_rate_hz / 2.0f) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    bank->cfg.sample_rate_hz = sample_rate_hz;
+    set_coeffs(bank);
+    reset_state(bank);
+    bank->rebase = true;
+    return ESP_OK;
+}
+
+static void run_bands(goertzel_t *g, const int16_t *x, size_t n)
+{
+    const float *win = g->window ? g->window + g->pos : NULL;
+
+    // One group of bands at a time with its state in locals: the recurrence
+    // is latency-bound, and keeping s1/s2 out of memory avoids a
+    // store-to-load round trip per sample.
+    for (size_t b = 0; b < g->nb_pad; b += BAND_GROUP) {
+        float c[BAND_GROUP], s1[BAND_GROUP], s2[BAND_GROUP];
+        memcpy(c, g->coeff + b, sizeof(c));
+        memcpy(s1, g->s1 + b, sizeof(s1));
+        memcpy(s2, g->s2 + b, sizeof(s2));
+        for (size_t i = 0; i < n; i++) {
+            const float v = win ? (float)x[i] * win[i] : (float)x[i];
+            for (size_t k = 0; k < BAND_GROUP; k++) {
+                const float s0 = v + c[k] * s1[k] - s2[k];
+                s2[k] = s1[k];
+                s1[k] = s0;
+            }
+        }
+        memcpy(g->s1 + b, s1, sizeof(s1));
+        memcpy(g->s2 + b, s2, sizeof(s2));
+    }
+    g->pos += n;
+}
+
+static void finish_block(goertzel_t *g)
+{
+    uint32_t above = 0;
+    for (size_t b = 0; b < g->cfg.num_bands; b++) {
+        const float p = g->s1[b] * g->s1[b] + g->s2[b] * g->s2[b] - g->coeff[b] * g->s1[b] * g->s2[b];
+        g->level[b] = 10.0f * log10f(p * g->norm + 1e-20f);
+        if (g->level[b] >= g->cfg.bands[b].threshold_dbfs) {
+            above |= 1u << b;
+        }
+    }
+
+    const goertzel_result_t res = {
+        .t0 = g->block_t0,
+        .num_bands = g->cfg.num_bands,
+        .level_dbfs = g->level,
+        .above_mask = above,
+        .rising_mask = above & ~g->above,
+        .falling_mask = g->above & ~above,
+    };
+    g->above = above;
+    for (int i = 0; i < g->num_subs; i++) {
+        g->subs[i].cb(&res, g->subs[i].ctx);
+    }
+    reset_state(g);
+    g->block_t0 += g->cfg.block_len;
+}
+
+void goertzel_process(goertzel_t *g, const int16_t *samples, size_t n, uint64_t t0)
+{
+    if (!g->started || g->rebase || t0 != g->next_t) {
+        g->started = true;
+        g->rebase = false;
+        reset_state(g);
+        g->block_t0 = t0;
+    }
+    g->next_t = t0 + n;
+
+    while (n) {
+        const size_t room = g->cfg.block_len - g->pos;
+        const size_t chunk = n < room ? n : room;
+        run_bands(g, samples, chunk);
+        samples += chunk;
+        n -= chunk;
+        if (g->pos == g->cfg.block_len) {
+            finish_block(g);
+        }
+    }
+}
+
+void goertzel_stream_cb(const int16_t *samples, size_t n, uint64_t t0, void *ctx)
+{
+    goertzel_process((goertzel_t *)ctx, samples, n, t0);
+}
+
+esp_err_t goertzel_config_add_bands(goertzel_config_t *config, const char *freqs_hz, float threshold_dbfs)
+{
+    const char *p = freqs_hz;
+    while (p && *p) {
+        char *end;
+        const float f = strtof(p, &end);
+        if (end == p) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (config->num_bands >= GOERTZEL_MAX_BANDS) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        config->bands[config->num_bands].freq_hz = f;
+        config->bands[config->num_bands].threshold_dbfs = threshold_dbfs;
+        config->num_bands++;
+        while (*end == ' ' || *end == ',') {
+            end++;
+        }
+        p = end;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,85 @@
+// goertzel.h  (Goertzel filter bank for a few narrow target bands)
+//
+// Evaluates M bands over consecutive blocks of `block_len` samples. Band
+// state is kept as structure-of-arrays and updated eight bands at a time,
+// so the per-sample inner loop vectorizes across bands. Coefficients (and
+// the optional Hann window) are computed once in goertzel_create().
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GOERTZEL_MAX_BANDS          32
+#define GOERTZEL_MAX_SUBSCRIBERS    4
+
+typedef struct {
+    float freq_hz;              /**< Band centre */
+    float threshold_dbfs;       /**< Crossing threshold for this band */
+} goertzel_band_t;
+
+typedef struct {
+    uint32_t sample_rate_hz;
+    size_t block_len;           /**< Samples per evaluation; bandwidth ~ sample_rate / block_len */
+    bool hann;                  /**< Window each block (less leakage, ~1.5x wider bins) */
+    size_t num_bands;
+    goertzel_band_t bands[GOERTZEL_MAX_BANDS];
+} goertzel_config_t;
+
+typedef struct {
+    uint64_t t0;                /**< Absolute index of the block's first sample */
+    size_t num_bands;
+    const float *level_dbfs;    /**< Per band, 0 dBFS = full-scale sine at the band centre */
+    uint32_t above_mask;        /**< Bands at or above threshold in this block */
+    uint32_t rising_mask;       /**< Bands that crossed upwards at t0 */
+    uint32_t falling_mask;      /**< Bands that crossed downwards at t0 */
+} goertzel_result_t;
+
+typedef void (*goertzel_cb_t)(const goertzel_result_t *res, void *ctx);
+
+typedef struct goertzel goertzel_t;
+
+esp_err_t goertzel_create(const goertzel_config_t *config, goertzel_t **ret_bank);
+void goertzel_delete(goertzel_t *bank);
+
+/**
+ * @brief Register a result consumer, called once per completed block
+ */
+esp_err_t goertzel_subscribe(goertzel_t *bank, goertzel_cb_t cb, void *ctx);
+
+/**
+ * @brief Recompute band coefficients for a new sample rate and restart the current block
+ *
+ * The partial block at the old rate is dropped; the next block starts at the
+ * next sample pushed, and block boundaries are counted from there.
+ *
+ * @return ESP_ERR_INVALID_ARG (bank unchanged) if a band would be at or above Nyquist
+ */
+esp_err_t goertzel_set_sample_rate(goertzel_t *bank, uint32_t sample_rate_hz);
+
+/**
+ * @brief Push samples. A gap in t0 discards the partial block (no crossing state is lost).
+ */
+void goertzel_process(goertzel_t *bank, const int16_t *samples, size_t n, uint64_t t0);
+
+/**
+ * @brief audio_stream_cb_t adapter; ctx is the goertzel_t
+ */
+void goertzel_stream_cb(const int16_t *samples, size_t n, uint64_t t0, void *ctx);
+
+/**
+ * @brief Append bands from a comma-separated list of frequencies ("2000,4500,9000")
+ *
+ * Every added band gets `threshold_dbfs`.
+ */
+esp_err_t goertzel_config_add_bands(goertzel_config_t *config, const char *freqs_hz, float threshold_dbfs);
+
+#ifdef __cplusplus
+}
+#endif
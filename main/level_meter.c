@@ -0,0 +1,307 @@
+// level_meter.c  (per-block RMS / peak / clip / DC metering)
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dsp_kernels.h"
+#include "level_meter.h"
+
+#define SECONDS_PER_MINUTE  60
+#define READ_TRIES          64      // a writer preempted mid-update may not finish while we spin
+
+/* Raw sums of one period; merging two is exact */
+typedef struct {
+    uint64_t t0;
+    uint64_t n;
+    dsp_s16_stats_t st;
+} level_acc_t;
+
+struct level_meter {
+    level_meter_config_t cfg;
+    level_acc_t second;         /**< Second being filled */
+    level_acc_t minute;         /**< Minute being filled */
+    uint64_t second_idx;
+    uint64_t base_t;            /**< Seconds are counted from base_t, which is second base_idx */
+    uint64_t base_idx;
+    bool started;
+    bool rebase;                /**< Rate changed: the next sample starts a new second */
+
+    // Published state, written only by the stream under `seq`
+    atomic_uint seq;            /**< Odd while an update is in progress */
+    level_summary_t block;
+    level_summary_t seconds[LEVEL_METER_HISTORY];
+    level_summary_t minutes[LEVEL_METER_HISTORY];
+    uint32_t num_blocks;
+    uint32_t num_seconds;
+    uint32_t num_minutes;
+
+    struct {
+        level_meter_cb_t cb;
+        void *ctx;
+    } subs[LEVEL_METER_MAX_SUBSCRIBERS];
+    int num_subs;
+};
+
+esp_err_t level_meter_create(const level_meter_config_t *config, level_meter_t **ret_meter)
+{
+    if (config == NULL || ret_meter == NULL || config->sample_rate_hz == 0 || config->clip_level < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    level_meter_t *m = calloc(1, sizeof(*m));
+    if (m == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    m->cfg = *config;
+    if (m->cfg.clip_level == 0) {
+        m->cfg.clip_level = DSP_S16_CLIP_LEVEL_DEFAULT;
+    }
+    atomic_init(&m->seq, 0);
+    *ret_meter = m;
+    return ESP_OK;
+}
+
+void level_meter_delete(level_meter_t *meter)
+{
+    free(meter);
+}
+
+esp_err_t level_meter_subscribe(level_meter_t *meter, level_meter_cb_t cb, void *ctx)
+{
+    if (meter == NULL || cb == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (meter->num_subs >= LEVEL_METER_MAX_SUBSCRIBERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    meter->subs[meter->num_subs].cb = cb;
+    meter->subs[meter->num_subs].ctx = ctx;
+    meter->num_subs++;
+    return ESP_OK;
+}
+
+static float to_dbfs(double level)
+{
+    // Floor at the smallest non-zero int16 level instead of -inf
+    return (float)(20.0 * log10((level > 0.5 ? level : 0.5) / 32768.0));
+}
+
+static void acc_merge(level_acc_t *acc, const level_acc_t *add)
+{
+    if (add->n == 0) {
+        return;
+    }
+    if (acc->n == 0) {
+        const uint64_t t0 = acc->t0;
+        *acc = *add;
+        acc->t0 = t0;
+        return;
+    }
+    acc->n += add->n;
+    acc->st.sum += add->st.sum;
+    acc->st.sum_sq += add->st.sum_sq;
+    acc->st.clip_count += add->st.clip_count;
+    acc->st.min = add->st.min < acc->st.min ? add->st.min : acc->st.min;
+    acc->st.max = add->st.max > acc->st.max ? add->st.max : acc->st.max;
+}
+
+static void acc_summary(const level_acc_t *acc, level_summary_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->t0 = acc->t0;
+    out->samples = (uint32_t)acc->n;
+    if (acc->n == 0) {
+        out->rms_dbfs = out->peak_dbfs = to_dbfs(0.0);
+        return;
+    }
+    const int32_t peak = -(int32_t)acc->st.min > acc->st.max ? -(int32_t)acc->st.min : acc->st.max;
+    out->clip_count = acc->st.clip_count;
+    out->min = acc->st.min;
+    out->max = acc->st.max;
+    out->rms_dbfs = to_dbfs(sqrt((double)acc->st.sum_sq / (double)acc->n));
+    out->peak_dbfs = to_dbfs((double)peak);
+    out->dc = (float)((double)acc->st.sum / (double)acc->n);
+}
+
+static void publish_begin(level_meter_t *m)
+{
+    atomic_fetch_add_explicit(&m->seq, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void publish_end(level_meter_t *m)
+{
+    atomic_fetch_add_explicit(&m->seq, 1, memory_order_release);
+}
+
+static void notify(level_meter_t *m, level_meter_period_t period, const level_summary_t *s)
+{
+    for (int i = 0; i < m->num_subs; i++) {
+        m->subs[i].cb(period, s, m->subs[i].ctx);
+    }
+}
+
+static void close_second(level_meter_t *m)
+{
+    level_summary_t sec;
+    acc_summary(&m->second, &sec);
+    acc_merge(&m->minute, &m->second);
+
+    const bool minute_done = (m->second_idx + 1) % SECONDS_PER_MINUTE == 0;
+    level_summary_t min;
+    if (minute_done) {
+        acc_summary(&m->minute, &min);
+    }
+
+    publish_begin(m);
+    m->seconds[m->num_seconds % LEVEL_METER_HISTORY] = sec;
+    m->num_seconds++;
+    if (minute_done) {
+        m->minutes[m->num_minutes % LEVEL_METER_HISTORY] = min;
+        m->num_minutes++;
+    }
+    publish_end(m);
+
+    notify(m, LEVEL_METER_SECOND, &sec);
+    if (minute_done) {
+        notify(m, LEVEL_METER_MINUTE, &min);
+    }
+}
+
+static uint64_t second_start(const level_meter_t *m, uint64_t idx)
+{
+    return m->base_t + (idx - m->base_idx) * m->cfg.sample_rate_hz;
+}
+
+static void next_second(level_meter_t *m, uint64_t t0)
+{
+    m->second_idx++;
+    m->second = (level_acc_t){ .t0 = t0 };
+    if (m->second_idx % SECONDS_PER_MINUTE == 0) {
+        m->minute = (level_acc_t){ .t0 = t0 };
+    }
+}
+
+/* Advance to the second containing sample t, closing every second passed on
+ * the way. Seconds skipped entirely by a gap close empty (samples == 0). */
+static void seek_second(level_meter_t *m, uint64_t t)
+{
+    const uint64_t fs = m->cfg.sample_rate_hz;
+    if (!m->started) {
+        const uint64_t idx = t / fs;
+        m->started = true;
+        m->second_idx = idx;
+        m->second = (level_acc_t){ .t0 = idx * fs };
+        m->minute = (level_acc_t){ .t0 = (idx - idx % SECONDS_PER_MINUTE) * fs };
+        return;
+    }
+    if (m->rebase) {
+        // The partial second at the old rate was closed by set_sample_rate
+        m->rebase = false;
+        next_second(m, t);
+        m->base_t = t;
+        m->base_idx = m->second_idx;
+        return;
+    }
+    const uint64_t idx = m->base_idx + (t - m->base_t) / fs;
+    while (m->second_idx < idx) {
+        close_second(m);
+        next_second(m, second_start(m, m->second_idx + 1));
+        if (idx - m->second_idx > SECONDS_PER_MINUTE * LEVEL_METER_HISTORY) {
+            // Long outage: nothing older than the history is visible anyway
+            const uint64_t skip = idx - idx % SECONDS_PER_MINUTE;
+            m->second_idx = skip;
+            m->second = (level_acc_t){ .t0 = second_start(m, skip) };
+            m->minute = m->second;
+        }
+    }
+}
+
+esp_err_t level_meter_set_sample_rate(level_meter_t *meter, uint32_t sample_rate_hz)
+{
+    if (meter == NULL || sample_rate_hz == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (sample_rate_hz == meter->cfg.sample_rate_hz) {
+        return ESP_OK;
+    }
+    meter->cfg.sample_rate_hz = sample_rate_hz;
+    if (meter->started && !meter->rebase) {
+        close_second(meter);
+        meter->rebase = true;
+    }
+    return ESP_OK;
+}
+
+void level_meter_process(level_meter_t *meter, const int16_t *samples, size_t n, uint64_t t0)
+{
+    if (n == 0) {
+        return;
+    }
+    level_acc_t block = { .t0 = t0 };
+
+    // One stats pass per piece; a block only splits where it straddles a second
+    size_t done = 0;
+    while (done < n) {
+        const uint64_t t = t0 + done;
+        seek_second(meter, t);
+        const uint64_t left_in_second = second_start(meter, meter->second_idx + 1) - t;
+        const size_t len = (size_t)((n - done) < left_in_second ? (n - done) : left_in_second);
+
+        level_acc_t piece = { .t0 = t, .n = len };
+        dsp_s16_stats(samples + done, len, meter->cfg.clip_level, &piece.st);
+        acc_merge(&meter->second, &piece);
+        acc_merge(&block, &piece);
+        done += len;
+    }
+
+    level_summary_t s;
+    acc_summary(&block, &s);
+    publish_begin(meter);
+    meter->block = s;
+    meter->num_blocks++;
+    publish_end(meter);
+}
+
+void level_meter_stream_cb(const int16_t *samples, size_t n, uint64_t t0, void *ctx)
+{
+    level_meter_process((level_meter_t *)ctx, samples, n, t0);
+}
+
+esp_err_t level_meter_get(level_meter_t *meter, level_meter_period_t period, size_t ago, level_summary_t *out)
+{
+    if (meter == NULL || out == NULL || period >= LEVEL_METER_NUM_PERIODS || ago >= LEVEL_METER_HISTORY ||
+        (period == LEVEL_METER_BLOCK && ago != 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int tries = 0; tries < READ_TRIES; tries++) {
+        const unsigned s1 = atomic_load_explicit(&meter->seq, memory_order_acquire);
+        if (s1 & 1) {
+            continue;
+        }
+        // Copied aside: `out` never sees a torn summary, even on a timeout
+        esp_err_t err = ESP_OK;
+        level_summary_t snap;
+        switch (period) {
+        case LEVEL_METER_BLOCK:
+            err = meter->num_blocks ? ESP_OK : ESP_ERR_NOT_FOUND;
+            snap = meter->block;
+            break;
+        case LEVEL_METER_SECOND:
+            err = meter->num_seconds > ago ? ESP_OK : ESP_ERR_NOT_FOUND;
+            snap = meter->seconds[(meter->num_seconds - 1 - ago) % LEVEL_METER_HISTORY];
+            break;
+        default:
+            err = meter->num_minutes > ago ? ESP_OK : ESP_ERR_NOT_FOUND;
+            snap = meter->minutes[(meter->num_minutes - 1 - ago) % LEVEL_METER_HISTORY];
+            break;
+        }
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&meter->seq, memory_order_relaxed) == s1) {
+            *out = snap;
+            return err;
+        }
+    }
+    return ESP_ERR_TIMEOUT;
+}
@@ -0,0 +1,86 @@
+// level_meter.h  (per-block RMS / peak / clip / DC metering)
+//
+// Every block gets one dsp_s16_stats() pass. The raw sums are kept (not the
+// derived dB values) so blocks merge exactly into per-second summaries and
+// seconds into per-minute summaries, aligned to the absolute sample index.
+//
+// The latest block and the last LEVEL_METER_HISTORY completed seconds and
+// minutes are published under a sequence counter: any task can read them
+// with level_meter_get() while the stream keeps running, and the writer
+// never waits for a reader.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LEVEL_METER_HISTORY         60
+#define LEVEL_METER_MAX_SUBSCRIBERS 4
+
+typedef enum {
+    LEVEL_METER_BLOCK = 0,
+    LEVEL_METER_SECOND,
+    LEVEL_METER_MINUTE,
+    LEVEL_METER_NUM_PERIODS,
+} level_meter_period_t;
+
+typedef struct {
+    uint32_t sample_rate_hz;
+    int16_t clip_level;         /**< |x| >= clip_level counts as clipped; 0 = DSP_S16_CLIP_LEVEL_DEFAULT */
+} level_meter_config_t;
+
+typedef struct {
+    uint64_t t0;                /**< Absolute index of the period's first sample */
+    uint32_t samples;           /**< Samples seen; less than the period length if packets were lost */
+    uint32_t clip_count;
+    int16_t min;
+    int16_t max;
+    float rms_dbfs;             /**< Including DC; 0 dBFS = full-scale square wave */
+    float peak_dbfs;
+    float dc;                   /**< Mean, in int16 counts */
+} level_summary_t;
+
+typedef void (*level_meter_cb_t)(level_meter_period_t period, const level_summary_t *summary, void *ctx);
+
+typedef struct level_meter level_meter_t;
+
+esp_err_t level_meter_create(const level_meter_config_t *config, level_meter_t **ret_meter);
+void level_meter_delete(level_meter_t *meter);
+
+/**
+ * @brief Register a consumer, called from the stream context when a second or minute completes
+ */
+esp_err_t level_meter_subscribe(level_meter_t *meter, level_meter_cb_t cb, void *ctx);
+
+/**
+ * @brief Switch rate: the current second closes early and seconds restart at the next sample
+ */
+esp_err_t level_meter_set_sample_rate(level_meter_t *meter, uint32_t sample_rate_hz);
+
+void level_meter_process(level_meter_t *meter, const int16_t *samples, size_t n, uint64_t t0);
+
+/**
+ * @brief audio_stream_cb_t adapter; ctx is the level_meter_t
+ */
+void level_meter_stream_cb(const int16_t *samples, size_t n, uint64_t t0, void *ctx);
+
+/**
+ * @brief Copy a completed summary; safe from any task while the stream runs
+ *
+ * Never blocks: a reader that outranks a stream preempted mid-update would
+ * wait for it forever, so after a bounded number of tries it gives up.
+ *
+ * @param ago  0 = most recent, up to LEVEL_METER_HISTORY - 1 (must be 0 for LEVEL_METER_BLOCK)
+ * @return ESP_ERR_NOT_FOUND if that period hasn't completed yet;
+ *         ESP_ERR_TIMEOUT if an update was in progress on every try: try again later
+ */
+esp_err_t level_meter_get(level_meter_t *meter, level_meter_period_t period, size_t ago, level_summary_t *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,241 @@
+// metrics.c  (lock-free per-core counters, gauges and histograms, binary export)
+
+#if !defined(ESP_PLATFORM)
+#define _GNU_SOURCE     // sched_getcpu()
+#endif
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+#include "metrics.h"
+
+#if defined(ESP_PLATFORM)
+#include "esp_cpu.h"
+#else
+#include <sched.h>
+#endif
+
+typedef struct {
+    char name[METRICS_NAME_LEN + 1];
+    metrics_kind_t kind;
+    uint16_t slot;              /**< First word of the core block, or gauge index */
+} metric_t;
+
+/* One block per core: a core only ever writes its own lines */
+typedef struct {
+    _Atomic uint32_t words[METRICS_CORE_WORDS];
+} __attribute__((aligned(METRICS_CACHE_LINE))) core_block_t;
+
+/* Gauges are set from anywhere: a line each */
+typedef struct {
+    _Atomic int32_t value;
+} __attribute__((aligned(METRICS_CACHE_LINE))) gauge_slot_t;
+
+static core_block_t s_core[METRICS_CORES];
+static gauge_slot_t s_gauge[METRICS_MAX_GAUGES];
+static metric_t s_metric[METRICS_MAX];
+static size_t s_num_metrics;
+static size_t s_words_used;
+static size_t s_gauges_used;
+
+static inline unsigned core_id(void)
+{
+#if defined(ESP_PLATFORM)
+    return (unsigned)esp_cpu_get_core_id();
+#else
+    // Any block is correct (updates are atomic), this just spreads threads out
+    const int cpu = sched_getcpu();
+    return cpu > 0 ? (unsigned)cpu % METRICS_CORES : 0;
+#endif
+}
+
+esp_err_t metrics_register(metrics_kind_t kind, const char *name, metrics_id_t *ret_id)
+{
+    if (name == NULL || ret_id == NULL || strlen(name) > METRICS_NAME_LEN || kind > METRICS_HISTOGRAM) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < s_num_metrics; i++) {
+        if (strcmp(s_metric[i].name, name) == 0) {
+            *ret_id = (metrics_id_t)i;
+            return s_metric[i].kind == kind ? ESP_OK : ESP_ERR_INVALID_STATE;
+        }
+    }
+    const size_t words = kind == METRICS_HISTOGRAM ? METRICS_HIST_BUCKETS : kind == METRICS_COUNTER ? 1 : 0;
+    if (s_num_metrics == METRICS_MAX || s_words_used + words > METRICS_CORE_WORDS ||
+            (kind == METRICS_GAUGE && s_gauges_used == METRICS_MAX_GAUGES)) {
+        return ESP_ERR_NO_MEM;
+    }
+    metric_t *m = &s_metric[s_num_metrics];
+    strcpy(m->name, name);
+    m->kind = kind;
+    m->slot = (uint16_t)(kind == METRICS_GAUGE ? s_gauges_used++ : s_words_used);
+    s_words_used += words;
+    *ret_id = (metrics_id_t)s_num_metrics++;
+    return ESP_OK;
+}
+
+void metrics_add(metrics_id_t id, uint32_t n)
+{
+    atomic_fetch_add_explicit(&s_core[core_id()].words[s_metric[id].slot], n, memory_order_relaxed);
+}
+
+void metrics_set(metrics_id_t id, int32_t v)
+{
+    atomic_store_explicit(&s_gauge[s_metric[id].slot].value, v, memory_order_relaxed);
+}
+
+unsigned metrics_hist_bucket(uint32_t v)
+{
+    if (v == 0) {
+        return 0;
+    }
+    const unsigned b = 32 - (unsigned)__builtin_clz(v);
+    return b < METRICS_HIST_BUCKETS ? b : METRICS_HIST_BUCKETS - 1;
+}
+
+void metrics_observe(metrics_id_t id, uint32_t v)
+{
+    atomic_fetch_add_explicit(&s_core[core_id()].words[s_metric[id].slot + metrics_hist_bucket(v)], 1,
+                              memory_order_relaxed);
+}
+
+size_t metrics_count(void)
+{
+    return s_num_metrics;
+}
+
+static uint32_t sum_cores(size_t word)
+{
+    uint32_t sum = 0;
+    for (size_t c = 0; c < METRICS_CORES; c++) {
+        sum += atomic_load_explicit(&s_core[c].words[word], memory_order_relaxed);
+    }
+    return sum;
+}
+
+esp_err_t metrics_read(metrics_id_t id, metrics_value_t *out)
+{
+    if (id >= s_num_metrics || out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const metric_t *m = &s_metric[id];
+    out->kind = m->kind;
+    out->name = m->name;
+    switch (m->kind) {
+    case METRICS_COUNTER:
+        out->count = sum_cores(m->slot);
+        break;
+    case METRICS_GAUGE:
+        out->value = atomic_load_explicit(&s_gauge[m->slot].value, memory_order_relaxed);
+        break;
+    case METRICS_HISTOGRAM:
+        for (size_t b = 0; b < METRICS_HIST_BUCKETS; b++) {
+            out->buckets[b] = sum_cores(m->slot + b);
+        }
+        break;
+    }
+    return ESP_OK;
+}
+
+/* ---------- Export ---------- */
+typedef struct {
+    uint8_t *p;
+    uint8_t *end;
+    bool overflow;
+} writer_t;
+
+static void put_bytes(writer_t *w, const void *data, size_t n)
+{
+    if ((size_t)(w->end - w->p) < n) {
+        w->overflow = true;
+        return;
+    }
+    memcpy(w->p, data, n);
+    w->p += n;
+}
+
+static void put_le(writer_t *w, uint64_t v, size_t n)
+{
+    uint8_t b[8];
+    for (size_t i = 0; i < n; i++) {
+        b[i] = (uint8_t)(v >> (8 * i));
+    }
+    put_bytes(w, b, n);
+}
+
+static void put_varint(writer_t *w, uint32_t v)
+{
+    uint8_t b[5];
+    size_t n = 0;
+    do {
+        b[n] = (uint8_t)(v & 0x7F);
+        v >>= 7;
+        b[n++] |= v ? 0x80 : 0;
+    } while (v);
+    put_bytes(w, b, n);
+}
+
+uint16_t metrics_crc16(const uint8_t *data, size_t len)
+{
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)(data[i] << 8);
+        for (int k = 0; k < 8; k++) {
+            crc = (uint16_t)(crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1);
+        }
+    }
+    return crc;
+}
+
+esp_err_t metrics_encode(metrics_frame_type_t type, uint32_t seq, uint64_t t_us,
+                         uint8_t *buf, size_t size, size_t *ret_len)
+{
+    if (buf == NULL || ret_len == NULL || (type != METRICS_FRAME_SCHEMA && type != METRICS_FRAME_VALUES)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    writer_t w = { .p = buf, .end = buf + size };
+    const size_t n = s_num_metrics;
+    put_le(&w, METRICS_SYNC0, 1);
+    put_le(&w, METRICS_SYNC1, 1);
+    put_le(&w, type, 1);
+    put_le(&w, n, 1);
+    put_le(&w, 0, 2);           // length, patched below
+    put_le(&w, seq, 4);
+    put_le(&w, t_us, 8);
+    for (size_t i = 0; i < n && !w.overflow; i++) {
+        const metric_t *m = &s_metric[i];
+        if (type == METRICS_FRAME_SCHEMA) {
+            const size_t len = strlen(m->name);
+            put_le(&w, m->kind, 1);
+            put_le(&w, len, 1);
+            put_bytes(&w, m->name, len);
+            continue;
+        }
+        metrics_value_t v;
+        metrics_read((metrics_id_t)i, &v);
+        switch (m->kind) {
+        case METRICS_COUNTER:
+            put_varint(&w, v.count);
+            break;
+        case METRICS_GAUGE:
+            put_varint(&w, ((uint32_t)v.value << 1) ^ (uint32_t)(v.value >> 31));
+            break;
+        case METRICS_HISTOGRAM:
+            for (size_t b = 0; b < METRICS_HIST_BUCKETS; b++) {
+                put_varint(&w, v.buckets[b]);
+            }
+            break;
+        }
+    }
+    const size_t payload = (size_t)(w.p - buf) - METRICS_HEADER_LEN;
+    if (!w.overflow && payload <= UINT16_MAX) {
+        buf[4] = (uint8_t)payload;
+        buf[5] = (uint8_t)(payload >> 8);
+        put_le(&w, metrics_crc16(buf + 2, (size_t)(w.p - buf) - 2), 2);
+    }
+    if (w.overflow || payload > UINT16_MAX) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    *ret_len = (size_t)(w.p - buf);
+    return ESP_OK;
+}
@@ -0,0 +1,119 @@
+// metrics.h  (lock-free per-core counters, gauges and histograms, binary export)
+//
+// Hot paths update metrics with one relaxed atomic on the calling core's
+// own block of slots: each core's block is cache-line aligned, so cores
+// never share a line and nothing waits. A reporter aggregates the cores
+// when it encodes a frame; nothing is ever reset by the writers.
+//
+//   counter    32-bit, wraps; the reader takes differences
+//   gauge      last value set, from any core (one padded slot each)
+//   histogram  METRICS_HIST_BUCKETS log2 buckets: 0, then [2^(b-1), 2^b),
+//              the last one open-ended
+//
+// Register everything before the tasks that update it start; registering
+// an existing name returns its id. Export frames (little endian):
+//
+//   0xA5 0x4D  type  count  length:u16  seq:u32  t_us:u64  payload  crc16:u16
+//
+// crc16 is CRC-16/CCITT-FALSE over type..payload. A schema frame lists
+// kind:u8 name_len:u8 name per metric; a values frame has one LEB128
+// varint per counter, a zigzag varint per gauge and one varint per
+// histogram bucket, in id order. host_test/metrics_cat decodes them.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define METRICS_MAX             64
+#define METRICS_MAX_GAUGES      16
+#define METRICS_CORE_WORDS      256     /**< Per-core slots: 1 per counter, METRICS_HIST_BUCKETS per histogram */
+#define METRICS_HIST_BUCKETS    16
+#define METRICS_NAME_LEN        23
+#define METRICS_CORES           2
+#define METRICS_CACHE_LINE      64
+
+#define METRICS_SYNC0           0xA5
+#define METRICS_SYNC1           0x4D
+#define METRICS_HEADER_LEN      18
+#define METRICS_FRAME_MAX       2048    /**< Enough for either frame of a full registry of counters */
+
+typedef enum {
+    METRICS_COUNTER = 0,
+    METRICS_GAUGE,
+    METRICS_HISTOGRAM,
+} metrics_kind_t;
+
+typedef enum {
+    METRICS_FRAME_SCHEMA = 1,
+    METRICS_FRAME_VALUES,
+} metrics_frame_type_t;
+
+typedef uint8_t metrics_id_t;
+
+typedef struct {
+    metrics_kind_t kind;
+    const char *name;
+    union {
+        uint32_t count;                             /**< Counter, summed over the cores */
+        int32_t value;                              /**< Gauge */
+        uint32_t buckets[METRICS_HIST_BUCKETS];     /**< Histogram, summed over the cores */
+    };
+} metrics_value_t;
+
+/**
+ * @brief Add a metric, or find the one already registered under `name`
+ *
+ * @return ESP_ERR_NO_MEM if the registry is full,
+ *         ESP_ERR_INVALID_STATE if `name` exists with another kind
+ */
+esp_err_t metrics_register(metrics_kind_t kind, const char *name, metrics_id_t *ret_id);
+
+/**
+ * @brief Counter += n; any task or ISR
+ */
+void metrics_add(metrics_id_t id, uint32_t n);
+
+/**
+ * @brief Gauge = v; any task or ISR
+ */
+void metrics_set(metrics_id_t id, int32_t v);
+
+/**
+ * @brief Count `v` in its histogram bucket; any task or ISR
+ */
+void metrics_observe(metrics_id_t id, uint32_t v);
+
+/**
+ * @brief Bucket `v` falls in
+ */
+unsigned metrics_hist_bucket(uint32_t v);
+
+size_t metrics_count(void);
+
+/**
+ * @brief Current value of one metric, aggregated over the cores
+ */
+esp_err_t metrics_read(metrics_id_t id, metrics_value_t *out);
+
+/**
+ * @brief Encode a schema or values frame of every registered metric
+ *
+ * @return ESP_ERR_INVALID_SIZE if it doesn't fit `size`
+ */
+esp_err_t metrics_encode(metrics_frame_type_t type, uint32_t seq, uint64_t t_us,
+                         uint8_t *buf, size_t size, size_t *ret_len);
+
+/**
+ * @brief CRC-16/CCITT-FALSE, as used by the frames
+ */
+uint16_t metrics_crc16(const uint8_t *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,178 @@
+// stft.c  (streaming short-time FFT / spectrogram stage)
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fft.h"
+#include "stft.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+struct stft {
+    stft_config_t cfg;
+    fft_real_plan_t *fft;
+    float *window;          /**< fft_size coefficients, pre-scaled by 1/32768 */
+    float window_sum;
+    int16_t *ring;          /**< 2 * fft_size, ring[i] == ring[i + fft_size] */
+    size_t wr;              /**< Next write position in [0, fft_size) */
+    size_t until_frame;     /**< Samples left before the next frame is due */
+    uint64_t next_t;        /**< Absolute index of the next expected sample */
+    bool started;
+    float *work;            /**< fft_size floats */
+    fft_cf32_t *spec;       /**< nbins */
+    float *power;           /**< nbins */
+    uint32_t frame_index;
+    struct {
+        stft_frame_cb_t cb;
+        void *ctx;
+    } subs[STFT_MAX_SUBSCRIBERS];
+    int num_subs;
+};
+
+esp_err_t stft_create(const stft_config_t *config, stft_t **ret_stft)
+{
+    if (config == NULL || ret_stft == NULL || config->fft_size < 16 || config->hop == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    stft_t *s = calloc(1, sizeof(*s));
+    if (s == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    const size_t n = config->fft_size;
+    const size_t nbins = n / 2 + 1;
+    s->cfg = *config;
+
+    esp_err_t err = fft_real_plan_create(n, &s->fft);
+    if (err != ESP_OK) {
+        stft_delete(s);
+        return err;
+    }
+    s->window = malloc(n * sizeof(float));
+    s->ring = calloc(2 * n, sizeof(int16_t));
+    s->work = malloc(n * sizeof(float));
+    s->spec = malloc(nbins * sizeof(fft_cf32_t));
+    s->power = malloc(nbins * sizeof(float));
+    if (!s->window || !s->ring || !s->work || !s->spec || !s->power) {
+        stft_delete(s);
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        // Periodic windows (divide by n, not n - 1) for overlap-add friendliness
+        const double ph = 2.0 * M_PI * (double)i / (double)n;
+        double w = 1.0;
+        switch (config->window) {
+        case STFT_WINDOW_HANN:    w = 0.5 - 0.5 * cos(ph); break;
+        case STFT_WINDOW_HAMMING: w = 0.54 - 0.46 * cos(ph); break;
+        case STFT_WINDOW_RECT:    w = 1.0; break;
+        }
+        s->window[i] = (float)(w / 32768.0);
+        s->window_sum += (float)w;
+    }
+
+    *ret_stft = s;
+    return ESP_OK;
+}
+
+void stft_delete(stft_t *stft)
+{
+    if (stft == NULL) {
+        return;
+    }
+    fft_real_plan_delete(stft->fft);
+    free(stft->window);
+    free(stft->ring);
+    free(stft->work);
+    free(stft->spec);
+    free(stft->power);
+    free(stft);
+}
+
+esp_err_t stft_subscribe(stft_t *stft, stft_frame_cb_t cb, void *ctx)
+{
+    if (stft == NULL || cb == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (stft->num_subs >= STFT_MAX_SUBSCRIBERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    stft->subs[stft->num_subs].cb = cb;
+    stft->subs[stft->num_subs].ctx = ctx;
+    stft->num_subs++;
+    return ESP_OK;
+}
+
+float stft_window_sum(const stft_t *stft)
+{
+    return stft->window_sum;
+}
+
+static void emit_frame(stft_t *s)
+{
+    const size_t n = s->cfg.fft_size;
+    const size_t nbins = n / 2 + 1;
+    // Oldest sample sits at wr; the mirror makes [wr, wr + n) contiguous
+    const int16_t *frame = s->ring + s->wr;
+    for (size_t i = 0; i < n; i++) {
+        s->work[i] = (float)frame[i] * s->window[i];
+    }
+    fft_real_f32(s->fft, s->work, s->spec);
+    for (size_t k = 0; k < nbins; k++) {
+        s->power[k] = s->spec[k].re * s->spec[k].re + s->spec[k].im * s->spec[k].im;
+    }
+
+    const stft_frame_t f = {
+        .t0 = s->next_t - n,
+        .index = s->frame_index++,
+        .nbins = nbins,
+        .power = s->power,
+    };
+    for (int i = 0; i < s->num_subs; i++) {
+        s->subs[i].cb(&f, s->subs[i].ctx);
+    }
+}
+
+void stft_process(stft_t *s, const int16_t *samples, size_t count, uint64_t t0)
+{
+    const size_t n = s->cfg.fft_size;
+
+    if (!s->started || t0 != s->next_t) {
+        // First block or a gap: start a fresh window
+        s->started = true;
+        s->wr = 0;
+        s->until_frame = n;
+        s->next_t = t0;
+    }
+
+    while (count) {
+        size_t chunk = count < s->until_frame ? count : s->until_frame;
+        s->until_frame -= chunk;
+        s->next_t += chunk;
+        count -= chunk;
+        // Only the last n samples of a chunk can be part of a window
+        if (chunk > n) {
+            samples += chunk - n;
+            chunk = n;
+        }
+        while (chunk) {
+            const size_t seg = (n - s->wr) < chunk ? (n - s->wr) : chunk;
+            memcpy(s->ring + s->wr, samples, seg * sizeof(int16_t));
+            memcpy(s->ring + s->wr + n, samples, seg * sizeof(int16_t));
+            s->wr = (s->wr + seg) % n;
+            samples += seg;
+            chunk -= seg;
+        }
+        if (s->until_frame == 0) {
+            emit_frame(s);
+            s->until_frame = s->cfg.hop;
+        }
+    }
+}
+
+void stft_stream_cb(const int16_t *samples, size_t n, uint64_t t0, void *ctx)
+{
+    stft_process((stft_t *)ctx, samples, n, t0);
+}
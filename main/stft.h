@@ -0,0 +1,71 @@
+// stft.h  (streaming short-time FFT / spectrogram stage)
+//
+// Consumes int16 blocks of any size (e.g. from audio_stream) and emits a
+// power spectrum every `hop` samples once `fft_size` samples have been
+// seen. History lives in a mirrored ring (each sample written twice), so
+// every frame is a contiguous window and nothing is re-copied per frame.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STFT_MAX_SUBSCRIBERS    4
+
+typedef enum {
+    STFT_WINDOW_HANN,
+    STFT_WINDOW_HAMMING,
+    STFT_WINDOW_RECT,
+} stft_window_t;
+
+typedef struct {
+    size_t fft_size;        /**< Power of two in [16, FFT_MAX_SIZE] */
+    size_t hop;             /**< Samples between frames, >= 1 */
+    stft_window_t window;
+} stft_config_t;
+
+typedef struct {
+    uint64_t t0;            /**< Absolute index of the first sample in the window */
+    uint32_t index;         /**< Frame counter since creation / last reset */
+    size_t nbins;           /**< fft_size / 2 + 1 */
+    const float *power;     /**< |X[k]|^2, full scale sine ~ (fft_size * window_gain / 2)^2 */
+} stft_frame_t;
+
+typedef void (*stft_frame_cb_t)(const stft_frame_t *frame, void *ctx);
+
+typedef struct stft stft_t;
+
+esp_err_t stft_create(const stft_config_t *config, stft_t **ret_stft);
+void stft_delete(stft_t *stft);
+
+/**
+ * @brief Register a frame consumer. Frames are valid only during the callback.
+ */
+esp_err_t stft_subscribe(stft_t *stft, stft_frame_cb_t cb, void *ctx);
+
+/**
+ * @brief Push a block of samples; emits zero or more frames synchronously
+ *
+ * @param t0 Absolute index of samples[0]. A gap against the previous block
+ *           (dropped packets) restarts the window so frames never straddle it.
+ */
+void stft_process(stft_t *stft, const int16_t *samples, size_t n, uint64_t t0);
+
+/**
+ * @brief audio_stream_cb_t adapter; ctx is the stft_t
+ */
+void stft_stream_cb(const int16_t *samples, size_t n, uint64_t t0, void *ctx);
+
+/**
+ * @brief Sum of window coefficients (coherent gain * fft_size)
+ */
+float stft_window_sum(const stft_t *stft);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,183 @@
+// stream_watchdog.c  (stall detection and the recovery ladder)
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include "esp_check.h"
+#include "esp_log.h"
+#include "metrics.h"
+#include "stream_watchdog.h"
+
+static const char *TAG = "WDOG";
+
+static const char *const s_stage_names[STREAM_WATCHDOG_STAGES] = {
+    [STREAM_WATCHDOG_RESUBMIT] = "resubmit",
+    [STREAM_WATCHDOG_ALT_RESET] = "alt reset",
+    [STREAM_WATCHDOG_REENUMERATE] = "re-enumerate",
+    [STREAM_WATCHDOG_POWER_CYCLE] = "power cycle",
+};
+
+static const char *const s_stage_metrics[STREAM_WATCHDOG_STAGES] = {
+    [STREAM_WATCHDOG_RESUBMIT] = "wd.resubmit",
+    [STREAM_WATCHDOG_ALT_RESET] = "wd.alt_reset",
+    [STREAM_WATCHDOG_REENUMERATE] = "wd.reenumerate",
+    [STREAM_WATCHDOG_POWER_CYCLE] = "wd.power_cycle",
+};
+
+static const char *const s_kind_names[] = {
+    [AUDIO_STREAM_STAGE_NONE] = "none",
+    [AUDIO_STREAM_STAGE_FRAME_SUBSCRIBER] = "frame subscriber",
+    [AUDIO_STREAM_STAGE_FILTER] = "filter",
+    [AUDIO_STREAM_STAGE_SUBSCRIBER] = "subscriber",
+};
+
+struct stream_watchdog {
+    stream_watchdog_config_t cfg;
+    struct {
+        metrics_id_t stall;
+        metrics_id_t stage[STREAM_WATCHDOG_STAGES];
+        metrics_id_t recovered;
+        metrics_id_t recover_ms;
+        metrics_id_t gave_up;
+        metrics_id_t stage_stuck;
+    } metrics;
+
+    int64_t last_check_us;
+    bool armed;                     /**< Samples have flowed since the last give-up or stop */
+    uint32_t frames;
+    int64_t progress_us;            /**< Last new frame, or the end of a stuck stage */
+    stream_watchdog_stage_t stage;  /**< STREAM_WATCHDOG_STAGES while not recovering */
+    int64_t stage_us;               /**< When `stage` was tried */
+
+    uint32_t published;             /**< audio_stream progress last seen ... */
+    uint16_t busy;                  /**< ... kind << 8 | index */
+    int64_t busy_since_us;          /**< Sample before `busy` was first seen: it started after that */
+    bool stuck_logged;
+};
+
+const char *stream_watchdog_stage_name(stream_watchdog_stage_t stage)
+{
+    return stage < STREAM_WATCHDOG_STAGES ? s_stage_names[stage] : "none";
+}
+
+esp_err_t stream_watchdog_create(const stream_watchdog_config_t *config, stream_watchdog_t **ret_wd)
+{
+    if (config == NULL || ret_wd == NULL || config->recover == NULL || config->stall_ms == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int s = 0; s < STREAM_WATCHDOG_STAGES; s++) {
+        if (config->stage_ms[s] == 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    stream_watchdog_t wd0 = { .cfg = *config, .stage = STREAM_WATCHDOG_STAGES };
+    ESP_RETURN_ON_ERROR(metrics_register(METRICS_COUNTER, "wd.stall", &wd0.metrics.stall), TAG, "metrics");
+    for (int s = 0; s < STREAM_WATCHDOG_STAGES; s++) {
+        ESP_RETURN_ON_ERROR(metrics_register(METRICS_COUNTER, s_stage_metrics[s], &wd0.metrics.stage[s]), TAG, "metrics");
+    }
+    ESP_RETURN_ON_ERROR(metrics_register(METRICS_COUNTER, "wd.recovered", &wd0.metrics.recovered), TAG, "metrics");
+    ESP_RETURN_ON_ERROR(metrics_register(METRICS_HISTOGRAM, "wd.recover_ms", &wd0.metrics.recover_ms), TAG, "metrics");
+    ESP_RETURN_ON_ERROR(metrics_register(METRICS_COUNTER, "wd.gave_up", &wd0.metrics.gave_up), TAG, "metrics");
+    ESP_RETURN_ON_ERROR(metrics_register(METRICS_COUNTER, "wd.stage_stuck", &wd0.metrics.stage_stuck), TAG, "metrics");
+
+    stream_watchdog_t *wd = malloc(sizeof(*wd));
+    if (wd == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    *wd = wd0;
+    *ret_wd = wd;
+    return ESP_OK;
+}
+
+void stream_watchdog_delete(stream_watchdog_t *wd)
+{
+    free(wd);
+}
+
+stream_watchdog_stage_t stream_watchdog_stage(const stream_watchdog_t *wd)
+{
+    return wd->stage;
+}
+
+static void try_stage(stream_watchdog_t *wd, stream_watchdog_stage_t stage, int64_t now_us)
+{
+    ESP_LOGW(TAG, "no samples for %lld ms: trying %s", (long long)((now_us - wd->progress_us) / 1000),
+             s_stage_names[stage]);
+    wd->stage = stage;
+    wd->stage_us = now_us;
+    metrics_add(wd->metrics.stage[stage], 1);
+    wd->cfg.recover(stage, wd->cfg.ctx);
+}
+
+/* A stage of audio_stream that hasn't returned for stall_ms; logged once */
+static bool consumer_stuck(stream_watchdog_t *wd, const audio_stream_progress_t *p, int64_t prev_us,
+                           int64_t now_us)
+{
+    const uint16_t busy = (uint16_t)(p->busy << 8 | p->busy_index);
+    if (p->busy == AUDIO_STREAM_STAGE_NONE || p->published != wd->published || busy != wd->busy) {
+        wd->published = p->published;
+        wd->busy = busy;
+        wd->busy_since_us = prev_us ? prev_us : now_us;
+        wd->stuck_logged = false;
+        return false;
+    }
+    if (now_us - wd->busy_since_us < (int64_t)wd->cfg.stall_ms * 1000) {
+        return false;
+    }
+    if (!wd->stuck_logged) {
+        ESP_LOGE(TAG, "%s %u hasn't returned for %lld ms; USB recovery held off",
+                 s_kind_names[p->busy], p->busy_index,
+                 (long long)((now_us - wd->busy_since_us) / 1000));
+        metrics_add(wd->metrics.stage_stuck, 1);
+        wd->stuck_logged = true;
+    }
+    return true;
+}
+
+void stream_watchdog_check(stream_watchdog_t *wd, const stream_watchdog_sample_t *sample, int64_t now_us)
+{
+    const int64_t prev_us = wd->last_check_us;
+    wd->last_check_us = now_us;
+    if (sample->frames != wd->frames) {
+        if (wd->stage != STREAM_WATCHDOG_STAGES) {
+            const int64_t ms = (now_us - wd->progress_us) / 1000;
+            ESP_LOGW(TAG, "samples back after %lld ms (%s)", (long long)ms, s_stage_names[wd->stage]);
+            metrics_add(wd->metrics.recovered, 1);
+            metrics_observe(wd->metrics.recover_ms, ms > UINT32_MAX ? UINT32_MAX : (uint32_t)ms);
+        }
+        wd->frames = sample->frames;
+        wd->armed = true;
+        wd->progress_us = now_us;
+        wd->stage = STREAM_WATCHDOG_STAGES;
+    }
+    if (consumer_stuck(wd, &sample->stream, prev_us, now_us)) {
+        // The client task is stuck with it: nothing to recover on the bus.
+        // The ladder starts over from its first stage once it returns.
+        wd->progress_us = now_us;
+        wd->stage = STREAM_WATCHDOG_STAGES;
+        return;
+    }
+    if (!wd->armed) {
+        return;
+    }
+    if (wd->stage == STREAM_WATCHDOG_STAGES) {
+        if (!sample->active) {
+            wd->armed = false;      // stopped, not stalled
+        } else if (now_us - wd->progress_us >= (int64_t)wd->cfg.stall_ms * 1000) {
+            metrics_add(wd->metrics.stall, 1);
+            try_stage(wd, STREAM_WATCHDOG_RESUBMIT, now_us);
+        }
+        return;
+    }
+    if (now_us - wd->stage_us < (int64_t)wd->cfg.stage_ms[wd->stage] * 1000) {
+        return;
+    }
+    if (wd->stage + 1 < STREAM_WATCHDOG_STAGES) {
+        try_stage(wd, wd->stage + 1, now_us);
+        return;
+    }
+    ESP_LOGE(TAG, "no samples for %lld ms after every stage; giving up until they flow again",
+             (long long)((now_us - wd->progress_us) / 1000));
+    metrics_add(wd->metrics.gave_up, 1);
+    wd->armed = false;
+    wd->stage = STREAM_WATCHDOG_STAGES;
+}
@@ -0,0 +1,84 @@
+// stream_watchdog.h  (notice when samples stop arriving and escalate until they flow again)
+//
+// Fed a progress sample every check period: frames the UAC driver has
+// received, whether a stream is meant to be running, and audio_stream's
+// delivery progress. Once samples have flowed, stall_ms
+// without a new frame is a stall, and the watchdog works up the recovery
+// ladder, giving each stage its time before trying the next:
+//
+//   resubmit     flush the endpoint, confirm the rate, resubmit the URBs
+//   alt reset    the same through alt setting 0 and back
+//   re-enumerate close and free the device so the hub enumerates it again
+//   power cycle  root port power off and on
+//
+// The first new frame ends the stall and logs how long recovery took and
+// at which stage (wd.recover_ms). A stage of audio_stream that doesn't
+// return blocks the client task, so no USB stage could help: that is
+// logged once per stall instead (wd.stage_stuck) and the ladder waits.
+// A stream that stops on its own (device detached, nothing attached) is
+// not a stall; after the last stage the watchdog gives up until samples
+// flow again.
+//
+// The watchdog only decides; `recover` carries a stage out. One task
+// calls stream_watchdog_check().
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "audio_stream.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    STREAM_WATCHDOG_RESUBMIT = 0,
+    STREAM_WATCHDOG_ALT_RESET,
+    STREAM_WATCHDOG_REENUMERATE,
+    STREAM_WATCHDOG_POWER_CYCLE,
+    STREAM_WATCHDOG_STAGES,
+} stream_watchdog_stage_t;
+
+typedef void (*stream_watchdog_recover_t)(stream_watchdog_stage_t stage, void *ctx);
+
+typedef struct {
+    uint32_t stall_ms;                              /**< No new frame for this long is a stall */
+    uint32_t stage_ms[STREAM_WATCHDOG_STAGES];      /**< Time a stage gets before the next one */
+    stream_watchdog_recover_t recover;
+    void *ctx;
+} stream_watchdog_config_t;
+
+typedef struct {
+    uint32_t frames;                    /**< uac_driver_frames_received() */
+    bool active;                        /**< uac_driver_active() */
+    audio_stream_progress_t stream;     /**< audio_stream_progress() */
+} stream_watchdog_sample_t;
+
+typedef struct stream_watchdog stream_watchdog_t;
+
+/**
+ * @brief Create a watchdog; registers the wd.* metrics
+ *
+ * @return ESP_ERR_INVALID_ARG without `recover` or with a zero time
+ */
+esp_err_t stream_watchdog_create(const stream_watchdog_config_t *config, stream_watchdog_t **ret_wd);
+
+void stream_watchdog_delete(stream_watchdog_t *wd);
+
+/**
+ * @brief Take one progress sample; calls `recover` when a stage is due
+ */
+void stream_watchdog_check(stream_watchdog_t *wd, const stream_watchdog_sample_t *sample, int64_t now_us);
+
+/**
+ * @brief Stage being tried, STREAM_WATCHDOG_STAGES if none
+ */
+stream_watchdog_stage_t stream_watchdog_stage(const stream_watchdog_t *wd);
+
+const char *stream_watchdog_stage_name(stream_watchdog_stage_t stage);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,42 @@
+// task_profile.c  (per-task CPU load and stack high-water between two snapshots)
+
+#include <string.h>
+#include "task_profile.h"
+
+static const task_profile_task_t *find(const task_profile_snapshot_t *s, uint32_t id)
+{
+    for (size_t i = 0; i < s->num_tasks; i++) {
+        if (s->tasks[i].id == id) {
+            return &s->tasks[i];
+        }
+    }
+    return NULL;
+}
+
+void task_profile_diff(const task_profile_snapshot_t *prev, const task_profile_snapshot_t *cur,
+                       task_profile_report_t *out)
+{
+    const uint32_t elapsed = cur->total - prev->total;
+    memset(out, 0, sizeof(*out));
+    for (int c = 0; c < TASK_PROFILE_CORES; c++) {
+        out->core_load_pct[c] = -1.0f;
+    }
+    for (size_t i = 0; i < cur->num_tasks && i < TASK_PROFILE_MAX_TASKS; i++) {
+        const task_profile_task_t *t = &cur->tasks[i];
+        const task_profile_task_t *p = find(prev, t->id);
+        const uint32_t ran = p ? t->run_time - p->run_time : t->run_time;
+        const float pct = elapsed ? 100.0f * (float)ran / (float)elapsed : 0.0f;
+
+        // Insertion sort, busiest first
+        size_t j = out->num_rows++;
+        for (; j > 0 && out->rows[j - 1].cpu_pct < pct; j--) {
+            out->rows[j] = out->rows[j - 1];
+        }
+        out->rows[j] = (task_profile_row_t) { .task = t, .cpu_pct = pct };
+
+        if (t->core >= 0 && t->core < TASK_PROFILE_CORES &&
+                strncmp(t->name, TASK_PROFILE_IDLE_NAME, strlen(TASK_PROFILE_IDLE_NAME)) == 0) {
+            out->core_load_pct[t->core] = pct < 100.0f ? 100.0f - pct : 0.0f;
+        }
+    }
+}
@@ -0,0 +1,64 @@
+// task_profile.h  (per-task CPU load and stack high-water between two snapshots)
+//
+// The profiling task snapshots every task's cumulative run time and stack
+// high-water (uxTaskGetSystemState) once a period; the difference between
+// two snapshots is each task's share of a core over that period. A core's
+// load is what its idle task didn't get. Run-time counters are 32-bit and
+// wrap; differences are taken modulo 2^32, so a period must stay shorter
+// than one wrap (71 minutes at the default 1 MHz counter).
+//
+// Pure logic, no FreeRTOS: the host tests feed it made-up snapshots.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TASK_PROFILE_MAX_TASKS  32
+#define TASK_PROFILE_NAME_LEN   16
+#define TASK_PROFILE_CORES      2
+#define TASK_PROFILE_ANY_CORE   (-1)
+#define TASK_PROFILE_IDLE_NAME  "IDLE"      /**< Prefix of the per-core idle tasks */
+
+typedef struct {
+    char name[TASK_PROFILE_NAME_LEN];
+    uint32_t id;                /**< Task number: matches a task across snapshots */
+    int core;                   /**< TASK_PROFILE_ANY_CORE if not pinned */
+    uint32_t priority;
+    uint32_t run_time;          /**< Cumulative, in run-time counter ticks */
+    uint32_t stack_free;        /**< Least stack ever free, bytes */
+} task_profile_task_t;
+
+typedef struct {
+    uint32_t total;             /**< Run-time counter when taken */
+    size_t num_tasks;
+    task_profile_task_t tasks[TASK_PROFILE_MAX_TASKS];
+} task_profile_snapshot_t;
+
+typedef struct {
+    const task_profile_task_t *task;    /**< In the later snapshot */
+    float cpu_pct;                      /**< Of one core, over the period */
+} task_profile_row_t;
+
+typedef struct {
+    size_t num_rows;
+    task_profile_row_t rows[TASK_PROFILE_MAX_TASKS];    /**< Busiest first, idle tasks included */
+    float core_load_pct[TASK_PROFILE_CORES];            /**< 100 - idle task's share; -1 if no idle task seen */
+} task_profile_report_t;
+
+/**
+ * @brief Load per task and per core between `prev` and `cur`
+ *
+ * A task missing from `prev` was created during the period: all its run
+ * time counts. Rows point into `cur`.
+ */
+void task_profile_diff(const task_profile_snapshot_t *prev, const task_profile_snapshot_t *cur,
+                       task_profile_report_t *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,251 @@
+// trace.c  (per-core lock-free event trace ring, cycle timestamps, binary dump)
+
+#if !defined(ESP_PLATFORM)
+#define _GNU_SOURCE     // sched_getcpu()
+#endif
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include "trace.h"
+
+#if defined(ESP_PLATFORM)
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#if !CONFIG_FREERTOS_UNICORE
+#include "esp_ipc.h"
+#endif
+#define TRACE_CPU_HZ    (CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ * 1000000u)
+#else
+#include <sched.h>
+#include <time.h>
+#define TRACE_CPU_HZ    1000000000u     // the host "cycle" is a nanosecond
+#endif
+
+_Static_assert((TRACE_RING_EVENTS & (TRACE_RING_EVENTS - 1)) == 0, "TRACE_RING_EVENTS must be a power of two");
+
+#define META(event, phase, arg) ((uint32_t)(arg) | (uint32_t)(event) << 16 | (uint32_t)(phase) << 22)
+
+/* A slot holds index i's event once seq is SEQ_DONE(i); SEQ_BUSY(i) while
+ * its writer fills it in. Any writer can reach any ring (host threads, a
+ * task that moved to the other core after core_id()), so a writer takes
+ * its slot from the previous lap before touching it */
+#define SEQ_BUSY(i)     (2u * (i) + 1u)
+#define SEQ_DONE(i)     (2u * (i) + 2u)
+
+typedef struct {
+    _Atomic uint32_t seq;
+    _Atomic uint32_t cycles;
+    _Atomic uint32_t meta;
+} slot_t;
+
+/* Mostly written by one core (its tasks and ISRs); the head on its own line */
+typedef struct {
+    _Atomic uint32_t head;
+    slot_t slot[TRACE_RING_EVENTS] __attribute__((aligned(64)));
+} __attribute__((aligned(64))) ring_t;
+
+static ring_t s_ring[TRACE_CORES];
+
+static const char *const s_names[TRACE_EVENT_COUNT] = {
+    [TRACE_URB_DONE]          = "urb_done",
+    [TRACE_URB_SUBMIT]        = "urb_submit",
+    [TRACE_PUBLISH]           = "publish",
+    [TRACE_PUBLISH_FRAMES]    = "publish_frames",
+    [TRACE_FILTER]            = "filter",
+    [TRACE_SUBSCRIBER]        = "subscriber",
+    [TRACE_FRAME_SUBSCRIBER]  = "frame_subscriber",
+    [TRACE_MARK]              = "mark",
+};
+
+static inline uint32_t trace_cycles(void)
+{
+#if defined(ESP_PLATFORM)
+    return esp_cpu_get_cycle_count();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec);
+#endif
+}
+
+static inline unsigned core_id(void)
+{
+#if defined(ESP_PLATFORM)
+    return (unsigned)esp_cpu_get_core_id();
+#else
+    // Threads stand in for cores, so a ring has several writers at once
+    const int cpu = sched_getcpu();
+    return cpu > 0 ? (unsigned)cpu % TRACE_CORES : 0;
+#endif
+}
+
+static uint64_t now_us(void)
+{
+#if defined(ESP_PLATFORM)
+    return (uint64_t)esp_timer_get_time();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+#endif
+}
+
+void trace_record(trace_event_id_t event, trace_phase_t phase, uint16_t arg)
+{
+    ring_t *r = &s_ring[core_id()];
+    const uint32_t i = atomic_fetch_add_explicit(&r->head, 1, memory_order_relaxed);
+    slot_t *s = &r->slot[i & (TRACE_RING_EVENTS - 1)];
+    // Only a writer a full lap behind or ahead can be at this slot. Neither
+    // is waited for (it may be the task this ISR interrupted): the event
+    // is dropped rather than mixed with theirs
+    uint32_t seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+    do {
+        if ((seq & 1u) || (int32_t)(seq - SEQ_DONE(i)) >= 0) {
+            return;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&s->seq, &seq, SEQ_BUSY(i),
+                                                    memory_order_relaxed, memory_order_relaxed));
+    // Busy is visible before the words change: see trace_snapshot()
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&s->cycles, trace_cycles(), memory_order_relaxed);
+    atomic_store_explicit(&s->meta, META(event, phase, arg), memory_order_relaxed);
+    atomic_store_explicit(&s->seq, SEQ_DONE(i), memory_order_release);
+}
+
+typedef struct {
+    uint32_t cycles;
+    uint64_t us;
+} anchor_t;
+
+static void take_anchor(void *arg)
+{
+    anchor_t *a = arg;
+    a->cycles = trace_cycles();
+    a->us = now_us();
+}
+
+void trace_snapshot(trace_snapshot_t *out)
+{
+    out->cpu_hz = TRACE_CPU_HZ;
+    for (unsigned c = 0; c < TRACE_CORES; c++) {
+        ring_t *r = &s_ring[c];
+        anchor_t a;
+#if defined(ESP_PLATFORM) && !CONFIG_FREERTOS_UNICORE
+        // Cycle counters are per core: read this one on its own core
+        if (c != core_id()) {
+            esp_ipc_call_blocking(c, take_anchor, &a);
+        } else {
+            take_anchor(&a);
+        }
+#else
+        take_anchor(&a);
+#endif
+        out->core[c].anchor_cycles = a.cycles;
+        out->core[c].anchor_us = a.us;
+
+        // Keep each slot of the window that holds its own index's event from
+        // before to after it was copied: not one still being written, from
+        // an older lap, or taken over by a newer one meanwhile. Until a ring
+        // has filled, its window starts at 0: the empty slots' seq of 0 is
+        // SEQ_DONE(-1)
+        const uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+        trace_event_t *ev = out->core[c].events;
+        size_t n = 0;
+        for (uint32_t i = head < TRACE_RING_EVENTS ? 0 : head - TRACE_RING_EVENTS; i != head; i++) {
+            const slot_t *s = &r->slot[i & (TRACE_RING_EVENTS - 1)];
+            if (atomic_load_explicit(&s->seq, memory_order_acquire) != SEQ_DONE(i)) {
+                continue;
+            }
+            const uint32_t cycles = atomic_load_explicit(&s->cycles, memory_order_relaxed);
+            const uint32_t meta = atomic_load_explicit(&s->meta, memory_order_relaxed);
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&s->seq, memory_order_relaxed) != SEQ_DONE(i)) {
+                continue;
+            }
+            ev[n++] = (trace_event_t){ .cycles = cycles, .event = (uint8_t)(meta >> 16 & 0x3F),
+                                       .phase = (uint8_t)(meta >> 22 & 0x03), .arg = (uint16_t)meta };
+        }
+        out->core[c].count = n;
+    }
+}
+
+static void put_le(uint8_t *p, uint64_t v, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+esp_err_t trace_dump(const trace_snapshot_t *snap, trace_write_fn_t write, void *ctx)
+{
+    if (snap == NULL || write == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint8_t hdr[TRACE_HEADER_LEN] = { 'T', 'R', 'C', '1', TRACE_CORES, TRACE_EVENT_LEN };
+    put_le(hdr + 8, snap->cpu_hz, 4);
+    esp_err_t err = write(hdr, sizeof(hdr), ctx);
+    for (unsigned c = 0; c < TRACE_CORES && err == ESP_OK; c++) {
+        uint8_t ch[TRACE_CORE_HEADER_LEN];
+        put_le(ch, snap->core[c].anchor_cycles, 4);
+        put_le(ch + 4, snap->core[c].anchor_us, 8);
+        put_le(ch + 12, snap->core[c].count, 4);
+        err = write(ch, sizeof(ch), ctx);
+        // A few events per write keeps the stack small and the sink busy
+        uint8_t buf[32 * TRACE_EVENT_LEN];
+        size_t len = 0;
+        for (size_t i = 0; i < snap->core[c].count && err == ESP_OK; i++) {
+            const trace_event_t *e = &snap->core[c].events[i];
+            put_le(buf + len, e->cycles, 4);
+            buf[len + 4] = e->event;
+            buf[len + 5] = e->phase;
+            put_le(buf + len + 6, e->arg, 2);
+            len += TRACE_EVENT_LEN;
+            if (len == sizeof(buf) || i + 1 == snap->core[c].count) {
+                err = write(buf, len, ctx);
+                len = 0;
+            }
+        }
+    }
+    return err;
+}
+
+esp_err_t trace_write_file(const void *data, size_t len, void *file)
+{
+    return fwrite(data, 1, len, file) == len ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t write_hex(const void *data, size_t len, void *console)
+{
+    static const char digits[] = "0123456789ABCDEF";
+    const uint8_t *p = data;
+    for (size_t off = 0; off < len; off += TRACE_HEX_BYTES) {
+        char line[2 * TRACE_HEX_BYTES + 1];
+        const size_t n = len - off < TRACE_HEX_BYTES ? len - off : TRACE_HEX_BYTES;
+        for (size_t i = 0; i < n; i++) {
+            line[2 * i] = digits[p[off + i] >> 4];
+            line[2 * i + 1] = digits[p[off + i] & 0x0F];
+        }
+        line[2 * n] = '\0';
+        if (fprintf(console, TRACE_LOG_PREFIX "%s\n", line) < 0) {
+            return ESP_FAIL;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t trace_dump_hex(const trace_snapshot_t *snap, FILE *console)
+{
+    fprintf(console, TRACE_LOG_PREFIX "begin\n");
+    const esp_err_t err = trace_dump(snap, write_hex, console);
+    // A dump without its end line is ignored by the decoder
+    if (err == ESP_OK) {
+        fprintf(console, TRACE_LOG_PREFIX "end\n");
+    }
+    return err;
+}
+
+const char *trace_event_name(unsigned event)
+{
+    return event < TRACE_EVENT_COUNT ? s_names[event] : "?";
+}
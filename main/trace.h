@@ -0,0 +1,144 @@
+// trace.h  (per-core lock-free event trace ring, cycle timestamps, binary dump)
+//
+// Hot paths mark the begin and end of what they do; a ring per core keeps
+// the last TRACE_RING_EVENTS events of that core. Recording claims an
+// index with one atomic add on the core's own head, takes its slot with a
+// compare-and-swap on the slot's sequence number, stores two words and
+// publishes them: no lock, no wait, a few tens of cycles, so it stays on
+// in the field. A writer that would have to wait for another at the same
+// slot (a full lap apart) drops its event instead. When
+// something goes wrong (a dropout), trace_snapshot() copies the rings and
+// trace_dump() writes them out, to a file or as hex lines on the console
+// (trace_dump_hex); host_test/trace2json turns either into Chrome trace
+// JSON (chrome://tracing, ui.perfetto.dev).
+//
+// Timestamps are the low 32 bits of the core's cycle counter. Each core's
+// events are placed on the esp_timer timeline through an anchor taken on
+// that core at snapshot time, walking back from the newest event: events
+// must be less than 2^31 cycles (about 6 s at 360 MHz) apart to come out
+// right. Dump layout (little endian):
+//
+//   "TRC1"  cores:u8  event_size:u8  0:u16  cpu_hz:u32
+//   per core:  anchor_cycles:u32  anchor_us:u64  count:u32
+//              count x { cycles:u32  event:u8  phase:u8  arg:u16 }, oldest first
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "esp_err.h"
+#if defined(ESP_PLATFORM)
+#include "sdkconfig.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef CONFIG_APP_TRACE_EVENTS
+#define TRACE_RING_EVENTS       CONFIG_APP_TRACE_EVENTS
+#else
+#define TRACE_RING_EVENTS       1024    /**< Per core; a power of two */
+#endif
+#define TRACE_CORES             2
+#define TRACE_MAGIC             "TRC1"
+#define TRACE_HEADER_LEN        12
+#define TRACE_CORE_HEADER_LEN   16
+#define TRACE_EVENT_LEN         8
+#define TRACE_LOG_PREFIX        "TRACE: "
+#define TRACE_HEX_BYTES         32      /**< Dump bytes per console line */
+
+typedef enum {
+    TRACE_URB_DONE = 0,     /**< ISO URB completion callback; arg = packets received */
+    TRACE_URB_SUBMIT,       /**< ISO URB (re)submission; arg = 1 if it failed */
+    TRACE_PUBLISH,          /**< audio_stream_publish(); arg = samples */
+    TRACE_PUBLISH_FRAMES,   /**< audio_stream_publish_frames(); arg = frames */
+    TRACE_FILTER,           /**< One in-place filter stage; arg = its index */
+    TRACE_SUBSCRIBER,       /**< One int16 subscriber; arg = its index */
+    TRACE_FRAME_SUBSCRIBER, /**< One Q31 frame subscriber; arg = its index */
+    TRACE_MARK,             /**< Free for debugging; arg = anything */
+    TRACE_EVENT_COUNT,
+} trace_event_id_t;
+
+typedef enum {
+    TRACE_PHASE_BEGIN = 0,
+    TRACE_PHASE_END,
+    TRACE_PHASE_INSTANT,
+} trace_phase_t;
+
+typedef struct {
+    uint32_t cycles;
+    uint8_t event;          /**< trace_event_id_t */
+    uint8_t phase;          /**< trace_phase_t */
+    uint16_t arg;
+} trace_event_t;
+
+typedef struct {
+    uint32_t cpu_hz;
+    struct {
+        uint32_t anchor_cycles;     /**< Cycle counter of this core ... */
+        uint64_t anchor_us;         /**< ... at this esp_timer time */
+        size_t count;
+        trace_event_t events[TRACE_RING_EVENTS];    /**< Oldest first */
+    } core[TRACE_CORES];
+} trace_snapshot_t;
+
+/**
+ * @brief Sink for trace_dump(): a UART, a file on the SD card (trace_write_file)...
+ */
+typedef esp_err_t (*trace_write_fn_t)(const void *data, size_t len, void *ctx);
+
+/**
+ * @brief Append an event to the calling core's ring; any task or ISR
+ *
+ * Use the TRACE_* macros, which compile away without CONFIG_APP_TRACE_ENABLE.
+ */
+void trace_record(trace_event_id_t event, trace_phase_t phase, uint16_t arg);
+
+#if CONFIG_APP_TRACE_ENABLE
+#define TRACE_BEGIN(event, arg)     trace_record((event), TRACE_PHASE_BEGIN, (uint16_t)(arg))
+#define TRACE_END(event, arg)       trace_record((event), TRACE_PHASE_END, (uint16_t)(arg))
+#define TRACE_INSTANT(event, arg)   trace_record((event), TRACE_PHASE_INSTANT, (uint16_t)(arg))
+#else
+#define TRACE_BEGIN(event, arg)     ((void)0)
+#define TRACE_END(event, arg)       ((void)0)
+#define TRACE_INSTANT(event, arg)   ((void)0)
+#endif
+
+/**
+ * @brief Copy every core's ring; from a task, the rings keep recording meanwhile
+ *
+ * Events overwritten or still being written while they're copied are left out.
+ */
+void trace_snapshot(trace_snapshot_t *out);
+
+/**
+ * @brief Write a snapshot in the dump layout above
+ */
+esp_err_t trace_dump(const trace_snapshot_t *snap, trace_write_fn_t write, void *ctx);
+
+/**
+ * @brief trace_write_fn_t for a stdio FILE *, e.g. fopen("/sdcard/trace.bin", "wb")
+ */
+esp_err_t trace_write_file(const void *data, size_t len, void *file);
+
+/**
+ * @brief Print a snapshot to a console as TRACE_LOG_PREFIX lines
+ *
+ *   TRACE: begin
+ *   TRACE: 54524331020800...     (TRACE_HEX_BYTES of the dump per line)
+ *   TRACE: end
+ *
+ * Each line is one fprintf(), so other tasks' log lines only come between them.
+ */
+esp_err_t trace_dump_hex(const trace_snapshot_t *snap, FILE *console);
+
+/**
+ * @brief Name of an event id, "?" if unknown
+ */
+const char *trace_event_name(unsigned event);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,427 @@
+// uac.c  (USB Audio Class 1.0 / 2.0 streaming helpers)
+
+#include <stdlib.h>
+#include <string.h>
+#include "uac.h"
+
+#define UAC_CS_INTERFACE            0x24
+#define UAC_CS_ENDPOINT             0x25
+#define UAC_SUBCLASS_AUDIOCONTROL   0x01
+#define UAC_AS_GENERAL              0x01
+#define UAC_AS_FORMAT_TYPE          0x02
+#define UAC_EP_GENERAL              0x01
+#define UAC_FORMAT_TYPE_I           0x01
+#define UAC_FORMAT_PCM              0x0001
+#define UAC_SET_CUR                 0x01
+#define UAC_GET_CUR                 0x81
+#define UAC_EP_SAMPLING_FREQ_CONTROL 0x01
+
+/* UAC 2.0 */
+#define UAC2_PROTOCOL               0x20
+#define UAC2_AC_HEADER              0x01    // every other AC subtype has its entity ID at byte 3
+#define UAC2_INPUT_TERMINAL         0x02
+#define UAC2_OUTPUT_TERMINAL        0x03
+#define UAC2_CLOCK_SOURCE           0x0A
+#define UAC2_CLOCK_SELECTOR         0x0B
+#define UAC2_CLOCK_MULTIPLIER       0x0C
+#define UAC2_CUR                    0x01
+#define UAC2_RANGE                  0x02
+#define UAC2_CS_SAM_FREQ_CONTROL    0x01
+#define UAC2_CLOCK_CHAIN_MAX        4       // selector/multiplier hops before giving up
+
+static uint32_t get24(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return get24(p) | ((uint32_t)p[3] << 24);
+}
+
+/* Class-specific AudioControl descriptor of entity `id`, with the number of
+ * the interface it belongs to. IDs are unique within the audio function. */
+static const uint8_t *find_entity(const usb_config_desc_t *config_desc, uint8_t id, uint8_t *ac_intf)
+{
+    const uint8_t *p = (const uint8_t *)config_desc;
+    const uint8_t *end = p + config_desc->wTotalLength;
+    bool in_ac = false;
+    for (; p + 2 <= end && p[0] >= 2 && p + p[0] <= end; p += p[0]) {
+        if (p[1] == USB_B_DESCRIPTOR_TYPE_INTERFACE) {
+            const usb_intf_desc_t *id_desc = (const usb_intf_desc_t *)p;
+            in_ac = id_desc->bInterfaceClass == USB_CLASS_AUDIO &&
+                    id_desc->bInterfaceSubClass == UAC_SUBCLASS_AUDIOCONTROL;
+            *ac_intf = id_desc->bInterfaceNumber;
+        } else if (in_ac && p[1] == UAC_CS_INTERFACE && p[0] >= 4 && p[2] != UAC2_AC_HEADER && p[3] == id) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/* Follow the streaming terminal to the clock source that drives it. A
+ * selector is taken at its first input: the power-on default of every
+ * device seen so far. */
+static esp_err_t find_clock(const usb_config_desc_t *config_desc, uint8_t terminal, uac_stream_info_t *out)
+{
+    const uint8_t *t = find_entity(config_desc, terminal, &out->ac_intf);
+    uint8_t id;
+    if (t && t[2] == UAC2_INPUT_TERMINAL && t[0] >= 17) {
+        id = t[7];
+    } else if (t && t[2] == UAC2_OUTPUT_TERMINAL && t[0] >= 12) {
+        id = t[8];
+    } else {
+        return ESP_ERR_NOT_FOUND;
+    }
+    for (int hop = 0; hop < UAC2_CLOCK_CHAIN_MAX; hop++) {
+        const uint8_t *c = find_entity(config_desc, id, &out->ac_intf);
+        if (c == NULL) {
+            return ESP_ERR_NOT_FOUND;
+        }
+        if (c[2] == UAC2_CLOCK_SOURCE && c[0] >= 8) {
+            out->clock_id = id;
+            // bmControls D1..0: sampling frequency, 0b11 host programmable
+            out->freq_control = (c[5] & 0x03) == 0x03;
+            return ESP_OK;
+        } else if (c[2] == UAC2_CLOCK_SELECTOR && c[0] >= 7 && c[4] >= 1) {
+            id = c[5];
+        } else if (c[2] == UAC2_CLOCK_MULTIPLIER && c[0] >= 7) {
+            id = c[4];
+        } else {
+            return ESP_ERR_NOT_FOUND;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t uac_parse_stream(const usb_config_desc_t *config_desc, uint8_t intf, uint8_t alt, uac_stream_info_t *out)
+{
+    if (config_desc == NULL || out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(out, 0, sizeof(*out));
+    out->intf = intf;
+    out->alt = alt;
+
+    const uint8_t *p = (const uint8_t *)config_desc;
+    const uint8_t *end = p + config_desc->wTotalLength;
+    bool in_alt = false, pcm = false, format = false;
+    uint8_t terminal = 0;
+    for (; p + 2 <= end && p[0] >= 2 && p + p[0] <= end; p += p[0]) {
+        const uint8_t len = p[0], type = p[1];
+        if (type == USB_B_DESCRIPTOR_TYPE_INTERFACE) {
+            if (in_alt) {
+                break;
+            }
+            const usb_intf_desc_t *id = (const usb_intf_desc_t *)p;
+            in_alt = id->bInterfaceNumber == intf && id->bAlternateSetting == alt;
+            out->uac_version = id->bInterfaceProtocol == UAC2_PROTOCOL ? 2 : 1;
+            continue;
+        }
+        if (!in_alt) {
+            continue;
+        }
+        // UAC 2.0 moves channels to AS_GENERAL and drops the format descriptor's rate table
+        if (type == UAC_CS_INTERFACE && out->uac_version == 2) {
+            if (len >= 16 && p[2] == UAC_AS_GENERAL) {
+                terminal = p[3];
+                pcm = p[5] == UAC_FORMAT_TYPE_I && (p[6] & 0x01);
+                out->channels = p[10];
+            } else if (len >= 6 && p[2] == UAC_AS_FORMAT_TYPE && p[3] == UAC_FORMAT_TYPE_I) {
+                format = true;
+                out->subframe_size = p[4];
+                out->bit_resolution = p[5];
+            }
+        } else if (type == UAC_CS_INTERFACE && len >= 7 && p[2] == UAC_AS_GENERAL) {
+            pcm = (p[5] | (p[6] << 8)) == UAC_FORMAT_PCM;
+        } else if (type == UAC_CS_INTERFACE && len >= 8 && p[2] == UAC_AS_FORMAT_TYPE && p[3] == UAC_FORMAT_TYPE_I) {
+            format = true;
+            out->channels = p[4];
+            out->subframe_size = p[5];
+            out->bit_resolution = p[6];
+            const uint8_t nfreq = p[7];
+            out->continuous = nfreq == 0;
+            const size_t count = out->continuous ? 2 : nfreq;
+            for (size_t i = 0; i < count && i < UAC_MAX_FREQS && 8 + 3 * (i + 1) <= len; i++) {
+                out->freqs[out->num_freqs++] = get24(p + 8 + 3 * i);
+            }
+        } else if (type == USB_B_DESCRIPTOR_TYPE_ENDPOINT && out->ep_addr == 0) {
+            const usb_ep_desc_t *ep = (const usb_ep_desc_t *)p;
+            if ((ep->bmAttributes & USB_BM_ATTRIBUTES_XFERTYPE_MASK) == USB_BM_ATTRIBUTES_XFER_ISOC) {
+                out->ep_addr = ep->bEndpointAddress;
+                out->ep_mult = (uint8_t)(USB_EP_DESC_GET_MULT(ep) + 1);
+                out->ep_mps = (uint16_t)(USB_EP_DESC_GET_MPS(ep) * out->ep_mult);
+                out->ep_interval = ep->bInterval >= 1 && ep->bInterval <= 16 ? ep->bInterval : 1;
+            }
+        } else if (type == UAC_CS_ENDPOINT && len >= 4 && p[2] == UAC_EP_GENERAL && out->uac_version == 1) {
+            out->freq_control = p[3] & 0x01;
+        }
+    }
+    if (out->ep_addr == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (!pcm || !format || out->channels == 0 || out->subframe_size == 0) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (out->uac_version == 2) {
+        return find_clock(config_desc, terminal, out) == ESP_OK ? ESP_OK : ESP_ERR_NOT_SUPPORTED;
+    }
+    return ESP_OK;
+}
+
+bool uac_rate_supported(const uac_stream_info_t *info, uint32_t hz)
+{
+    if (info->continuous) {
+        return info->num_freqs == 2 && hz >= info->freqs[0] && hz <= info->freqs[1];
+    }
+    for (size_t i = 0; i < info->num_freqs; i++) {
+        if (info->freqs[i] == hz) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t uac_interval_us(const uac_stream_info_t *info)
+{
+    const uint32_t unit = info->high_speed ? 125 : 1000;
+    return unit << (info->ep_interval ? info->ep_interval - 1 : 0);
+}
+
+size_t uac_packet_frames(const uac_stream_info_t *info, uint32_t hz)
+{
+    // 44.1 kHz alternates 44 and 45 frames per 1 ms packet: the larger
+    return (size_t)(((uint64_t)hz * uac_interval_us(info) + 999999) / 1000000);
+}
+
+size_t uac_packet_bytes(const uac_stream_info_t *info, uint32_t hz)
+{
+    const size_t frame_bytes = (size_t)info->channels * info->subframe_size;
+    const size_t nominal = uac_packet_frames(info, hz);
+    if (frame_bytes == 0 || nominal * frame_bytes > info->ep_mps) {
+        return 0;
+    }
+    // An asynchronous device catching up on its own clock sends a frame more
+    const size_t most = info->ep_mps / frame_bytes;
+    return (nominal + 1 < most ? nominal + 1 : most) * frame_bytes;
+}
+
+/* ---------- Sampling frequency control ---------- */
+
+/* UAC 1.0 addresses the endpoint with a 3-byte value, UAC 2.0 the clock
+ * source (in its AudioControl interface) with a 4-byte one */
+typedef struct {
+    uint8_t recipient;
+    uint8_t get_request;
+    uint16_t value;
+    uint16_t index;
+    uint16_t len;
+} freq_target_t;
+
+static freq_target_t freq_target(const uac_stream_info_t *info)
+{
+    if (info->uac_version == 2) {
+        return (freq_target_t) {
+            .recipient = USB_BM_REQUEST_TYPE_RECIP_INTERFACE,
+            .get_request = UAC2_CUR,
+            .value = UAC2_CS_SAM_FREQ_CONTROL << 8,
+            .index = (uint16_t)((info->clock_id << 8) | info->ac_intf),
+            .len = 4,
+        };
+    }
+    return (freq_target_t) {
+        .recipient = USB_BM_REQUEST_TYPE_RECIP_ENDPOINT,
+        .get_request = UAC_GET_CUR,
+        .value = UAC_EP_SAMPLING_FREQ_CONTROL << 8,
+        .index = info->ep_addr,
+        .len = 3,
+    };
+}
+
+typedef struct {
+    ctrl_xfer_t *ctrl;
+    usb_device_handle_t dev;
+    freq_target_t target;
+    uint32_t hz;                /**< Requested rate, 0 for a plain GET CUR */
+    uac_rate_cb_t cb;
+    void *ctx;
+} rate_op_t;
+
+static void rate_op_finish(rate_op_t *op, esp_err_t err, uint32_t hz)
+{
+    if (op->cb) {
+        op->cb(err, hz, op->ctx);
+    }
+    free(op);
+}
+
+static void get_cur_done(esp_err_t err, const uint8_t *data, size_t len, void *ctx)
+{
+    rate_op_t *op = ctx;
+    if (err == ESP_OK && len < op->target.len) {
+        err = ESP_ERR_INVALID_RESPONSE;
+    }
+    const uint32_t hz = err != ESP_OK ? 0 : op->target.len == 4 ? get32(data) : get24(data);
+    if (err == ESP_OK && op->hz && hz != op->hz) {
+        err = ESP_ERR_INVALID_RESPONSE;
+    }
+    rate_op_finish(op, err, hz);
+}
+
+static esp_err_t submit_get_cur(rate_op_t *op)
+{
+    const usb_setup_packet_t setup = {
+        .bmRequestType = USB_BM_REQUEST_TYPE_DIR_IN | USB_BM_REQUEST_TYPE_TYPE_CLASS | op->target.recipient,
+        .bRequest = op->target.get_request,
+        .wValue = op->target.value,
+        .wIndex = op->target.index,
+        .wLength = op->target.len,
+    };
+    return ctrl_xfer_submit(op->ctrl, op->dev, &setup, NULL, get_cur_done, op);
+}
+
+static void set_cur_done(esp_err_t err, const uint8_t *data, size_t len, void *ctx)
+{
+    (void)data;
+    (void)len;
+    rate_op_t *op = ctx;
+    if (err == ESP_OK) {
+        err = submit_get_cur(op);
+        if (err == ESP_OK) {
+            return;
+        }
+    }
+    rate_op_finish(op, err, 0);
+}
+
+static rate_op_t *rate_op_new(ctrl_xfer_t *ctrl, usb_device_handle_t dev, const uac_stream_info_t *info, uint32_t hz,
+                              uac_rate_cb_t cb, void *ctx)
+{
+    rate_op_t *op = calloc(1, sizeof(*op));
+    if (op) {
+        *op = (rate_op_t) {
+            .ctrl = ctrl, .dev = dev, .target = freq_target(info), .hz = hz, .cb = cb, .ctx = ctx,
+        };
+    }
+    return op;
+}
+
+esp_err_t uac_set_sample_rate(ctrl_xfer_t *ctrl, usb_device_handle_t dev, const uac_stream_info_t *info, uint32_t hz,
+                              uac_rate_cb_t cb, void *ctx)
+{
+    if (ctrl == NULL || dev == NULL || info == NULL || hz == 0 || (info->uac_version != 2 && hz > 0xFFFFFF)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    rate_op_t *op = rate_op_new(ctrl, dev, info, hz, cb, ctx);
+    if (op == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    const usb_setup_packet_t setup = {
+        .bmRequestType = USB_BM_REQUEST_TYPE_DIR_OUT | USB_BM_REQUEST_TYPE_TYPE_CLASS | op->target.recipient,
+        .bRequest = UAC_SET_CUR,
+        .wValue = op->target.value,
+        .wIndex = op->target.index,
+        .wLength = op->target.len,
+    };
+    const uint8_t freq[4] = { hz & 0xFF, (hz >> 8) & 0xFF, (hz >> 16) & 0xFF, (hz >> 24) & 0xFF };
+    esp_err_t err = ctrl_xfer_submit(ctrl, dev, &setup, freq, set_cur_done, op);
+    if (err != ESP_OK) {
+        free(op);
+    }
+    return err;
+}
+
+esp_err_t uac_get_sample_rate(ctrl_xfer_t *ctrl, usb_device_handle_t dev, const uac_stream_info_t *info,
+                              uac_rate_cb_t cb, void *ctx)
+{
+    if (ctrl == NULL || dev == NULL || info == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    rate_op_t *op = rate_op_new(ctrl, dev, info, 0, cb, ctx);
+    if (op == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = submit_get_cur(op);
+    if (err != ESP_OK) {
+        free(op);
+    }
+    return err;
+}
+
+/* ---------- UAC 2.0 rate discovery ---------- */
+
+typedef struct {
+    uac_stream_info_t *info;
+    uac_done_cb_t cb;
+    void *ctx;
+} range_op_t;
+
+static void get_range_done(esp_err_t err, const uint8_t *data, size_t len, void *ctx)
+{
+    range_op_t *op = ctx;
+    uac_stream_info_t *info = op->info;
+    // wNumSubRanges, then { dMIN, dMAX, dRES } per subrange; a short reply
+    // (the request is capped at UAC_MAX_FREQS subranges) keeps what fits
+    const size_t n = err == ESP_OK && len >= 2 ? (size_t)(data[0] | (data[1] << 8)) : 0;
+    if (err == ESP_OK && (n == 0 || len < 14)) {
+        err = ESP_ERR_INVALID_RESPONSE;
+    }
+    if (err == ESP_OK) {
+        bool discrete = true;
+        uint32_t lo = UINT32_MAX, hi = 0;
+        info->num_freqs = 0;
+        for (size_t i = 0; i < n && 2 + 12 * (i + 1) <= len; i++) {
+            const uint32_t min = get32(data + 2 + 12 * i), max = get32(data + 6 + 12 * i);
+            discrete = discrete && min == max;
+            lo = min < lo ? min : lo;
+            hi = max > hi ? max : hi;
+            if (info->num_freqs < UAC_MAX_FREQS) {
+                info->freqs[info->num_freqs++] = min;
+            }
+        }
+        info->continuous = !discrete;
+        if (!discrete) {
+            info->freqs[0] = lo;
+            info->freqs[1] = hi;
+            info->num_freqs = 2;
+        }
+    }
+    if (op->cb) {
+        op->cb(err, op->ctx);
+    }
+    free(op);
+}
+
+esp_err_t uac_read_rates(ctrl_xfer_t *ctrl, usb_device_handle_t dev, uac_stream_info_t *info,
+                         uac_done_cb_t cb, void *ctx)
+{
+    if (ctrl == NULL || dev == NULL || info == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (info->uac_version != 2) {
+        if (cb) {
+            cb(ESP_OK, ctx);
+        }
+        return ESP_OK;
+    }
+    range_op_t *op = calloc(1, sizeof(*op));
+    if (op == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    *op = (range_op_t) {
+        .info = info, .cb = cb, .ctx = ctx,
+    };
+    const freq_target_t target = freq_target(info);
+    const usb_setup_packet_t setup = {
+        .bmRequestType = USB_BM_REQUEST_TYPE_DIR_IN | USB_BM_REQUEST_TYPE_TYPE_CLASS | target.recipient,
+        .bRequest = UAC2_RANGE,
+        .wValue = target.value,
+        .wIndex = target.index,
+        .wLength = 2 + 12 * UAC_MAX_FREQS,
+    };
+    esp_err_t err = ctrl_xfer_submit(ctrl, dev, &setup, NULL, get_range_done, op);
+    if (err != ESP_OK) {
+        free(op);
+    }
+    return err;
+}
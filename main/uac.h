@@ -0,0 +1,116 @@
+// uac.h  (USB Audio Class 1.0 / 2.0 streaming helpers)
+//
+// Descriptor parsing for one AudioStreaming alternate setting, and the
+// sampling-frequency control issued through ctrl_xfer: on the endpoint for
+// UAC 1.0, on the clock source entity feeding the streaming terminal for
+// UAC 2.0. A rate change is always read back: devices that only support a
+// fixed list may silently pick a neighbour, and the stream must run at
+// whatever the device actually uses.
+//
+// Packet sizing follows the endpoint's service interval: 2^(bInterval-1)
+// frames at full speed, microframes (125 us) at high speed, with up to
+// three transactions per microframe on high-bandwidth endpoints.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "usb/usb_host.h"
+#include "ctrl_xfer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UAC_MAX_FREQS   8
+
+typedef struct {
+    uint8_t intf;
+    uint8_t alt;
+    uint8_t uac_version;        /**< 1 or 2, from bInterfaceProtocol */
+    uint8_t ac_intf;            /**< UAC 2.0: AudioControl interface holding the clock */
+    uint8_t clock_id;           /**< UAC 2.0: clock source entity of the streaming terminal */
+    uint8_t ep_addr;            /**< ISO data endpoint */
+    uint16_t ep_mps;            /**< Bytes per service interval the endpoint can carry (all transactions) */
+    uint8_t ep_interval;        /**< bInterval: one packet every 2^(bInterval-1) (micro)frames */
+    uint8_t ep_mult;            /**< Transactions per microframe, 1..3 */
+    bool high_speed;            /**< Not in the descriptors: set from the device speed before sizing packets */
+    uint8_t channels;
+    uint8_t subframe_size;      /**< Bytes per sample per channel */
+    uint8_t bit_resolution;
+    bool freq_control;          /**< Endpoint (UAC 1.0) or clock (UAC 2.0) accepts SET CUR sampling frequency */
+    bool continuous;            /**< freqs[0]..freqs[1] is a range rather than a list */
+    size_t num_freqs;           /**< UAC 2.0: 0 until uac_read_rates() */
+    uint32_t freqs[UAC_MAX_FREQS];
+} uac_stream_info_t;
+
+/**
+ * @brief Parse the AudioStreaming interface `intf`, alternate setting `alt`
+ *
+ * @return ESP_ERR_NOT_FOUND if the alt setting or its ISO endpoint is missing,
+ *         ESP_ERR_NOT_SUPPORTED if it isn't a PCM Type I format
+ */
+esp_err_t uac_parse_stream(const usb_config_desc_t *config_desc, uint8_t intf, uint8_t alt, uac_stream_info_t *out);
+
+/**
+ * @brief Whether the format descriptor lists (or its range covers) `hz`
+ */
+bool uac_rate_supported(const uac_stream_info_t *info, uint32_t hz);
+
+/**
+ * @brief Microseconds between the endpoint's packets
+ */
+uint32_t uac_interval_us(const uac_stream_info_t *info);
+
+/**
+ * @brief Nominal frames per packet (service interval) at `hz`, rounded up
+ */
+size_t uac_packet_frames(const uac_stream_info_t *info, uint32_t hz);
+
+/**
+ * @brief Bytes to request per packet at `hz`: one frame more than
+ *        uac_packet_frames(), which an asynchronous device sends now and
+ *        then, as far as the endpoint's wMaxPacketSize x transactions go
+ *
+ * @return 0 if the nominal packet doesn't fit the endpoint
+ */
+size_t uac_packet_bytes(const uac_stream_info_t *info, uint32_t hz);
+
+/**
+ * @brief Completion of a rate request
+ *
+ * @param hz  Rate the device reports after the request (0 if it couldn't be read)
+ */
+typedef void (*uac_rate_cb_t)(esp_err_t err, uint32_t hz, void *ctx);
+
+/**
+ * @brief SET CUR sampling frequency on the stream's endpoint or clock, then GET CUR to verify
+ *
+ * err is ESP_ERR_INVALID_RESPONSE if the read-back differs from `hz`.
+ */
+esp_err_t uac_set_sample_rate(ctrl_xfer_t *ctrl, usb_device_handle_t dev, const uac_stream_info_t *info, uint32_t hz,
+                              uac_rate_cb_t cb, void *ctx);
+
+/**
+ * @brief GET CUR sampling frequency on the stream's endpoint or clock
+ */
+esp_err_t uac_get_sample_rate(ctrl_xfer_t *ctrl, usb_device_handle_t dev, const uac_stream_info_t *info,
+                              uac_rate_cb_t cb, void *ctx);
+
+typedef void (*uac_done_cb_t)(esp_err_t err, void *ctx);
+
+/**
+ * @brief UAC 2.0: fill info->freqs from the clock's GET RANGE
+ *
+ * Discrete subranges become a list, anything else one continuous range.
+ * `info` is written from the completion and must stay valid until it.
+ * UAC 1.0 streams complete immediately: their rates are in the descriptors.
+ */
+esp_err_t uac_read_rates(ctrl_xfer_t *ctrl, usb_device_handle_t dev, uac_stream_info_t *info,
+                         uac_done_cb_t cb, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,838 @@
+// uac_driver.c  (USB Audio Class 1.0 / 2.0 streaming, triple-buffered ISO URBs)
+
+#include <string.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+
+#include "usb/usb_host.h"
+#include "usb/usb_types_ch9.h"
+
+#include "audio_stream.h"
+#include "class_driver.h"
+#include "dlog.h"
+#include "dsp_kernels.h"
+#include "metrics.h"
+#include "trace.h"
+#include "uac.h"
+#include "uac_driver.h"
+#include "urb_capture.h"
+
+static const char *TAG = "UAC";
+
+/* ---------- ISO config ---------- */
+#define URB_MS               16      // audio per URB (tune): 16 packets at full speed, 128 at high speed
+#define NUM_ISO_URBS         3       // triple buffering
+#define MAX_ISO_PKTS         (URB_MS * 8)    // one packet per microframe
+#define MAX_MS_FRAMES        ((CONFIG_APP_MAX_SAMPLE_RATE_HZ + 999) / 1000)
+// Each packet rounds up to whole frames and has room for one frame over
+// that: at most two extra frames per packet
+#define MAX_URB_FRAMES       (URB_MS * MAX_MS_FRAMES + 2 * MAX_ISO_PKTS)
+#define MAX_CHANNELS         CONFIG_APP_MAX_CHANNELS
+#define MAX_ALT_SETTINGS     8
+#define UAC_SUBCLASS_AUDIOSTREAMING  0x02
+
+/* Stream lifecycle. Everything here runs in the client task (its event and
+ * transfer callbacks); other tasks only post s_rate_request and
+ * s_recovery_request. */
+typedef enum {
+    STREAM_IDLE,
+    STREAM_STARTING,    // control requests in flight
+    STREAM_RUNNING,
+    STREAM_STOPPING,    // endpoint flushed, waiting for the URBs to come back
+} stream_state_t;
+
+static struct {
+    const class_driver_dev_t *dev;  // NULL while no device is attached
+    stream_state_t state;
+    uac_stream_info_t info;
+    uint32_t rate_hz;       // rate the device confirmed
+    size_t pkt_bytes;       // requested bytes per ISO packet (service interval)
+    size_t pkt_frames;      // nominal frames per packet, rounded up: a lost packet's gap
+    size_t short_frames;    // a packet with fewer frames than this was cut short
+    int pkts_per_urb;       // URB_MS worth of service intervals
+    size_t frame_bytes;     // channels * subframe_size
+    size_t mono_channel;    // channel the int16 stages get
+    int urbs_live;          // in flight
+    int urbs_idle;          // owned but not in flight: a submit failed, uac_poll retries
+    int64_t dry_us;         // when the last URB in flight came back and stayed out
+    int64_t heal_since_us;  // first failed submit not recovered yet, 0 if none
+    bool rearmed;           // endpoint halted, flushed and cleared since the pool ran dry
+    bool alt_reset;         // restart through alt setting 0 once STOPPING completes
+    int64_t last_done_us;   // last URB completed while RUNNING
+    uint8_t resv_ep;        // endpoint the bandwidth reservation is held under
+    uint32_t next_rate_hz;  // applied once STOPPING completes, 0 = stay stopped
+} s_stream;
+
+static uac_driver_config_t s_config;
+static _Atomic uint32_t s_rate_request;    // 0 = none
+static _Atomic int s_recovery_request;      // uac_recovery_t + 1, 0 = none
+static _Atomic uint32_t s_frames_received;
+static atomic_bool s_active;
+static int64_t s_attach_us;
+
+/* Time-to-first-sample of the current attach, and the last one measured
+ * with and without a descriptor cache hit */
+static bool    s_await_first_sample;
+static bool    s_cache_hit;
+static int64_t s_first_sample_us[2];
+
+/* Keep the URB pointers so they don't get GC'd */
+static usb_transfer_t *s_iso_urbs[NUM_ISO_URBS] = {0};
+static usb_transfer_t *s_idle_urbs[NUM_ISO_URBS];
+
+/* Registered by uac_driver_register(); the callback only ever adds */
+static struct {
+    metrics_id_t packets;
+    metrics_id_t bytes;
+    metrics_id_t lost;
+    metrics_id_t short_pkts;
+    metrics_id_t resubmit_fail;
+    metrics_id_t recovered;     // URB pool back to full strength
+    metrics_id_t stop_fail;     // halt or flush refused when stopping to restart
+    metrics_id_t rate_hz;
+    metrics_id_t cb_us;         // time spent in isoc_in_cb
+} s_metrics;
+
+/* Totals at the previous uac_driver_take_stats(), which reports differences */
+static struct {
+    uint32_t packets;
+    uint32_t bytes;
+    uint32_t lost;
+    uint32_t short_pkts;
+    uint32_t recovered;
+} s_taken;
+
+/* Valid packets of the current URB, packed back to back for audio_stream:
+ * every channel as Q31 frames, and the selected one as int16 */
+static int32_t  s_frames[MAX_URB_FRAMES * MAX_CHANNELS] __attribute__((aligned(16)));
+static int16_t  s_block[MAX_URB_FRAMES] __attribute__((aligned(16)));
+static uint64_t s_stream_pos = 0;   // absolute index of the next frame
+
+/* ================== ISO callback ================== */
+static void stream_stopped(void);
+
+static void publish_block(size_t nframes)
+{
+    if (nframes == 0) {
+        return;
+    }
+    const size_t ch = s_stream.info.channels;
+    audio_stream_publish_frames(s_frames, nframes, ch, s_stream_pos);
+    dsp_q31_to_s16(s_block, s_frames + s_stream.mono_channel, ch, nframes);
+    audio_stream_publish(s_block, nframes, s_stream_pos);
+    s_stream_pos += nframes;
+    atomic_fetch_add_explicit(&s_frames_received, (uint32_t)nframes, memory_order_relaxed);
+}
+
+/* Frames the service intervals since `since_us` carried: the stream picks
+ * up again at the next one, as a first submit does */
+static uint64_t frames_missed_since(int64_t since_us, int64_t now_us)
+{
+    const int64_t interval = uac_interval_us(&s_stream.info);
+    const int64_t missed = (now_us - since_us + interval - 1) / interval;
+    return (uint64_t)missed * s_stream.pkt_frames;
+}
+
+/* A URB whose submit failed; `t_us` is when it came back */
+static void urb_park(usb_transfer_t *t, int64_t t_us)
+{
+    s_idle_urbs[s_stream.urbs_idle++] = t;
+    if (s_stream.heal_since_us == 0) {
+        s_stream.heal_since_us = t_us;
+    }
+    if (--s_stream.urbs_live == 0) {
+        s_stream.dry_us = t_us;
+    }
+}
+
+static void free_idle_urbs(void)
+{
+    while (s_stream.urbs_idle) {
+        usb_host_transfer_free(s_idle_urbs[--s_stream.urbs_idle]);
+    }
+    s_stream.heal_since_us = 0;
+    s_stream.rearmed = false;
+}
+
+static void isoc_in_cb(usb_transfer_t *t)
+{
+    if (s_stream.state != STREAM_RUNNING) {
+        // Flushed for a rate switch or a detach
+        usb_host_transfer_free(t);
+        if (--s_stream.urbs_live == 0) {
+            stream_stopped();
+        }
+        return;
+    }
+
+    TRACE_BEGIN(TRACE_URB_DONE, t->num_isoc_packets);
+    const int64_t t_start = esp_timer_get_time();
+    s_stream.last_done_us = t_start;
+    urb_capture_urb(t, (uint64_t)t_start);
+    const size_t mps = s_stream.pkt_bytes;
+    const size_t ch = s_stream.info.channels;
+    const size_t sub = s_stream.info.subframe_size;
+    size_t off = 0;
+
+    size_t nframes = 0;
+    bool got_samples = false;
+    uint32_t pkts = 0, bytes = 0, lost = 0, short_pkts = 0;
+
+    for (int i = 0; i < t->num_isoc_packets; i++) {
+        const usb_isoc_packet_desc_t *d = &t->isoc_packet_desc[i];
+        if (d->status == USB_TRANSFER_STATUS_COMPLETED && d->actual_num_bytes) {
+            // A trailing partial frame can't be placed on the timeline; drop it
+            const size_t n = d->actual_num_bytes / s_stream.frame_bytes;
+            dsp_pcm_to_q31(s_frames + nframes * ch, t->data_buffer + off, sub, n * ch);
+            nframes += n;
+            pkts++;
+            bytes += d->actual_num_bytes;
+            got_samples = true;
+            if (n < s_stream.short_frames || d->actual_num_bytes % s_stream.frame_bytes) {
+                // Cut short on the bus: the rest of the packet is a gap,
+                // sized like a lost packet's
+                publish_block(nframes);
+                s_stream_pos += n < s_stream.pkt_frames ? s_stream.pkt_frames - n : 0;
+                nframes = 0;
+                short_pkts++;
+            }
+        } else {
+            // Lost packet: flush what we have and leave a one-packet gap in
+            // the timeline so downstream stages see the discontinuity
+            publish_block(nframes);
+            s_stream_pos += s_stream.pkt_frames;
+            nframes = 0;
+            lost++;
+        }
+        off += mps;
+    }
+
+    publish_block(nframes);
+    metrics_add(s_metrics.packets, pkts);
+    metrics_add(s_metrics.bytes, bytes);
+    metrics_add(s_metrics.lost, lost);
+    metrics_add(s_metrics.short_pkts, short_pkts);
+
+    if (s_await_first_sample && got_samples) {
+        s_await_first_sample = false;
+        const int64_t us = esp_timer_get_time() - s_attach_us;
+        s_first_sample_us[s_cache_hit] = us;
+        DLOGI(TAG, "first sample %lld us after attach (descriptor cache %s; last %s: %lld us)",
+                 (long long)us, s_cache_hit ? "hit" : "miss", s_cache_hit ? "miss" : "hit",
+                 (long long)s_first_sample_us[!s_cache_hit]);
+    }
+
+    // Re-submit THIS URB immediately
+    esp_err_t err = usb_host_transfer_submit(t);
+    TRACE_INSTANT(TRACE_URB_SUBMIT, err != ESP_OK);
+    if (err != ESP_OK) {
+        // Kept for uac_poll to retry after this event pass
+        DLOGE(TAG, "ISO resubmit failed: %s", esp_err_to_name(err));
+        urb_park(t, t_start);
+        metrics_add(s_metrics.resubmit_fail, 1);
+    }
+    metrics_observe(s_metrics.cb_us, (uint32_t)(esp_timer_get_time() - t_start));
+    TRACE_END(TRACE_URB_DONE, pkts);
+}
+
+/* ================== Start ISO stream (multi-URB) ================== */
+/* What a replay needs to enumerate and stream like this device */
+static void capture_stream_start(uint32_t rate_hz)
+{
+    const usb_device_desc_t *dev_desc;
+    if (usb_host_get_device_descriptor(s_stream.dev->dev_hdl, &dev_desc) != ESP_OK) {
+        return;
+    }
+    const esp_err_t err = urb_capture_device(s_stream.info.high_speed ? USB_SPEED_HIGH : USB_SPEED_FULL,
+                                             dev_desc->idVendor, dev_desc->idProduct, s_stream.info.ep_addr,
+                                             rate_hz, s_stream.dev->config_desc);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "capture ring full: stream start not recorded");
+    }
+}
+
+static esp_err_t start_isoc_stream(uint32_t rate_hz)
+{
+    const size_t mps = uac_packet_bytes(&s_stream.info, rate_hz);
+    const int pkts = s_stream.pkts_per_urb;
+    if (mps == 0 || mps / s_stream.frame_bytes * pkts > MAX_URB_FRAMES) {
+        ESP_LOGE(TAG, "%" PRIu32 " Hz doesn't fit the endpoint (%u bytes per %" PRIu32 " us) or CONFIG_APP_MAX_SAMPLE_RATE_HZ",
+                 rate_hz, s_stream.info.ep_mps, uac_interval_us(&s_stream.info));
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    const size_t buf_size = mps * pkts;
+
+    // The DSP stages retune before the first block at the new rate; the
+    // one-sample gap makes windowed stages restart cleanly. Restarted at
+    // the same rate, the time the restart took is the gap.
+    const bool restart = s_stream.rate_hz == rate_hz;
+    if (s_stream.rate_hz != 0 && !restart) {
+        s_stream_pos++;
+    }
+    s_stream.rate_hz = rate_hz;
+    s_stream.pkt_bytes = mps;
+    s_stream.pkt_frames = uac_packet_frames(&s_stream.info, rate_hz);
+    if (restart) {
+        s_stream_pos += frames_missed_since(s_stream.last_done_us, esp_timer_get_time());
+    }
+    // Asynchronous devices drift a frame either way of the nominal count
+    const size_t nominal = (size_t)((uint64_t)rate_hz * uac_interval_us(&s_stream.info) / 1000000);
+    s_stream.short_frames = nominal > 1 ? nominal - 1 : 0;
+    audio_stream_set_sample_rate(rate_hz);
+    metrics_set(s_metrics.rate_hz, (int32_t)rate_hz);
+    capture_stream_start(rate_hz);
+
+    esp_err_t err = ESP_OK;
+    int u;
+    for (u = 0; u < NUM_ISO_URBS; u++) {
+        usb_transfer_t *xfer;
+        err = usb_host_transfer_alloc(buf_size, pkts, &xfer);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "alloc iso: %s", esp_err_to_name(err));
+            goto fail;
+        }
+        s_iso_urbs[u] = xfer;
+
+        xfer->device_handle    = s_stream.dev->dev_hdl;
+        xfer->bEndpointAddress = s_stream.info.ep_addr;
+        xfer->callback         = isoc_in_cb;
+        xfer->context          = NULL;
+        xfer->num_bytes        = buf_size;
+
+        for (int i = 0; i < pkts; i++) {
+            xfer->isoc_packet_desc[i].num_bytes = mps;
+        }
+    }
+
+    // Submit ALL of them so the controller always has work; any that
+    // won't go are retried from uac_poll like a failed resubmit
+    s_stream.state = STREAM_RUNNING;
+    s_stream.urbs_live = NUM_ISO_URBS;
+    for (u = 0; u < NUM_ISO_URBS; u++) {
+        err = usb_host_transfer_submit(s_iso_urbs[u]);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "submit iso urb %d failed: %s", u, esp_err_to_name(err));
+            urb_park(s_iso_urbs[u], esp_timer_get_time());
+        }
+    }
+    return ESP_OK;
+
+fail:
+    // None went out yet: free what was allocated
+    while (u--) {
+        usb_host_transfer_free(s_iso_urbs[u]);
+        s_iso_urbs[u] = NULL;
+    }
+    return err;
+}
+
+/* ================== Stream setup ================== */
+static void rate_confirmed(esp_err_t err, uint32_t hz, void *ctx)
+{
+    const uint32_t requested = (uint32_t)(uintptr_t)ctx;
+    if (s_stream.state != STREAM_STARTING) {
+        return;     // detached meanwhile
+    }
+    if (err == ESP_ERR_INVALID_STATE) {
+        s_stream.state = STREAM_IDLE;   // device gone
+        return;
+    }
+    if ((err == ESP_ERR_INVALID_RESPONSE && hz != 0) || (err == ESP_OK && hz != requested)) {
+        ESP_LOGW(TAG, "asked for %" PRIu32 " Hz, device runs at %" PRIu32 " Hz", requested, hz);
+        err = ESP_OK;
+    } else if (err != ESP_OK) {
+        // Keep whatever the device was already doing
+        hz = s_stream.rate_hz ? s_stream.rate_hz : s_stream.info.freqs[0];
+        ESP_LOGE(TAG, "sampling frequency request failed (%s), streaming at %" PRIu32 " Hz",
+                 esp_err_to_name(err), hz);
+    }
+    err = start_isoc_stream(hz);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "start_isoc_stream failed: %s", esp_err_to_name(err));
+        if (s_stream.urbs_live == 0) {
+            s_stream.state = STREAM_IDLE;
+        }
+        return;
+    }
+    ESP_LOGI(TAG, "stream at %" PRIu32 " Hz, %u-byte packets every %" PRIu32 " us, started %lld us after request",
+             hz, (unsigned)s_stream.pkt_bytes, uac_interval_us(&s_stream.info),
+             (long long)(esp_timer_get_time() - s_attach_us));
+}
+
+static void configure_rate(uint32_t hz)
+{
+    s_stream.state = STREAM_STARTING;
+    esp_err_t err;
+    if (!s_stream.info.freq_control && s_stream.info.uac_version == 2) {
+        // Fixed clock: it can still be read
+        err = uac_get_sample_rate(s_stream.dev->ctrl, s_stream.dev->dev_hdl, &s_stream.info,
+                                  rate_confirmed, (void *)(uintptr_t)hz);
+        if (err != ESP_OK) {
+            rate_confirmed(err, 0, (void *)(uintptr_t)hz);
+        }
+        return;
+    }
+    if (!s_stream.info.freq_control) {
+        // Fixed-rate endpoint: nothing to ask, the format descriptor says it all
+        const uint32_t fixed = s_stream.info.freqs[0];
+        if (hz != fixed) {
+            ESP_LOGW(TAG, "endpoint has no sampling frequency control, staying at %" PRIu32 " Hz", fixed);
+        }
+        rate_confirmed(ESP_OK, fixed, (void *)(uintptr_t)fixed);
+        return;
+    }
+    if (!uac_rate_supported(&s_stream.info, hz)) {
+        ESP_LOGW(TAG, "%" PRIu32 " Hz isn't in the format descriptor; asking anyway", hz);
+    }
+    err = uac_set_sample_rate(s_stream.dev->ctrl, s_stream.dev->dev_hdl, &s_stream.info, hz,
+                              rate_confirmed, (void *)(uintptr_t)hz);
+    if (err != ESP_OK) {
+        rate_confirmed(err, 0, (void *)(uintptr_t)hz);
+    }
+}
+
+/* UAC 2.0 clocks report their rates only on request */
+static void rates_read(esp_err_t err, void *ctx)
+{
+    if (s_stream.state != STREAM_STARTING) {
+        return;
+    }
+    if (err == ESP_ERR_INVALID_STATE) {
+        s_stream.state = STREAM_IDLE;   // device gone
+        return;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "clock %d rate range unreadable (%s)", s_stream.info.clock_id, esp_err_to_name(err));
+    } else if (s_stream.info.uac_version == 2 && s_stream.info.num_freqs) {
+        ESP_LOGI(TAG, "clock %d: %u %s, %" PRIu32 "..%" PRIu32 " Hz", s_stream.info.clock_id,
+                 (unsigned)s_stream.info.num_freqs, s_stream.info.continuous ? "range bounds" : "rates",
+                 s_stream.info.freqs[0], s_stream.info.freqs[s_stream.info.num_freqs - 1]);
+    }
+    configure_rate(s_config.sample_rate_hz);
+}
+
+/* `ctx` is the rate to restart at, NULL at attach */
+static void set_interface_done(esp_err_t err, const uint8_t *data, size_t len, void *ctx)
+{
+    if (s_stream.state != STREAM_STARTING) {
+        return;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "SET_INTERFACE failed: %s", esp_err_to_name(err));
+        s_stream.state = STREAM_IDLE;
+        return;
+    }
+    if (ctx) {
+        configure_rate((uint32_t)(uintptr_t)ctx);   // restart: the rates are known
+        return;
+    }
+    err = uac_read_rates(s_stream.dev->ctrl, s_stream.dev->dev_hdl, &s_stream.info, rates_read, NULL);
+    if (err != ESP_OK) {
+        rates_read(err, NULL);
+    }
+}
+
+static void alt_zero_done(esp_err_t err, const uint8_t *data, size_t len, void *ctx)
+{
+    if (s_stream.state != STREAM_STARTING) {
+        return;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "SET_INTERFACE alt 0 failed (%s); selecting alt %d anyway", esp_err_to_name(err), s_stream.info.alt);
+    }
+    err = ctrl_xfer_set_interface(s_stream.dev->ctrl, s_stream.dev->dev_hdl, s_stream.info.intf, s_stream.info.alt,
+                                  set_interface_done, ctx);
+    if (err != ESP_OK) {
+        set_interface_done(err, NULL, 0, ctx);
+    }
+}
+
+/* Zero-bandwidth alt setting and back: resets the device's streaming
+ * engine, then restarts at `hz` (0: reads the rates, as at attach) */
+static void reset_alt(uint32_t hz)
+{
+    s_stream.state = STREAM_STARTING;
+    const esp_err_t err = ctrl_xfer_set_interface(s_stream.dev->ctrl, s_stream.dev->dev_hdl, s_stream.info.intf, 0,
+                                                  alt_zero_done, (void *)(uintptr_t)hz);
+    if (err != ESP_OK) {
+        alt_zero_done(err, NULL, 0, (void *)(uintptr_t)hz);
+    }
+}
+
+/* All URBs are back after a flush: retune the device and restart, unless detaching */
+static void stream_stopped(void)
+{
+    free_idle_urbs();
+    if (s_stream.state != STREAM_STOPPING || s_stream.next_rate_hz == 0) {
+        s_stream.state = STREAM_IDLE;
+        return;
+    }
+    usb_host_endpoint_clear(s_stream.dev->dev_hdl, s_stream.info.ep_addr);
+    if (s_stream.alt_reset) {
+        s_stream.alt_reset = false;
+        reset_alt(s_stream.next_rate_hz);
+        return;
+    }
+    configure_rate(s_stream.next_rate_hz);
+}
+
+/* Stop streaming to restart at s_stream.next_rate_hz: flushing completes
+ * every URB as canceled and isoc_in_cb frees them. A wedged or departing
+ * endpoint may refuse the halt or the flush; the URBs come back regardless,
+ * so that is logged and the restart goes on. */
+static esp_err_t stream_stop(void)
+{
+    s_attach_us = esp_timer_get_time();
+    s_stream.state = STREAM_STOPPING;
+    esp_err_t err = usb_host_endpoint_halt(s_stream.dev->dev_hdl, s_stream.info.ep_addr);
+    if (err == ESP_OK) {
+        err = usb_host_endpoint_flush(s_stream.dev->dev_hdl, s_stream.info.ep_addr);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "EP 0x%02x halt/flush: %s", s_stream.info.ep_addr, esp_err_to_name(err));
+        metrics_add(s_metrics.stop_fail, 1);
+    }
+    if (s_stream.urbs_live == 0) {
+        stream_stopped();   // none in flight to wait for
+    }
+    return err;
+}
+
+static esp_err_t stream_switch_rate(uint32_t hz)
+{
+    if (s_stream.state != STREAM_RUNNING || hz == s_stream.rate_hz) {
+        return ESP_OK;
+    }
+    ESP_LOGI(TAG, "switching %" PRIu32 " -> %" PRIu32 " Hz", s_stream.rate_hz, hz);
+    s_stream.next_rate_hz = hz;
+    return stream_stop();
+}
+
+/* Watchdog recovery: flush and restart at the same rate, through alt
+ * setting 0 with `alt_reset`. A stream that failed to start is started
+ * again from SET_INTERFACE. */
+static void stream_restart(bool alt_reset)
+{
+    if (s_stream.dev == NULL) {
+        return;
+    }
+    if (s_stream.state == STREAM_IDLE) {
+        ESP_LOGW(TAG, "starting the stream again");
+        s_attach_us = esp_timer_get_time();
+        reset_alt(s_stream.rate_hz);   // 0 never streamed: as at attach
+        return;
+    }
+    if (s_stream.state != STREAM_RUNNING) {
+        return;     // already on its way
+    }
+    ESP_LOGW(TAG, "restarting the stream at %" PRIu32 " Hz%s", s_stream.rate_hz, alt_reset ? " through alt 0" : "");
+    s_stream.next_rate_hz = s_stream.rate_hz;
+    s_stream.alt_reset = alt_reset;
+    stream_stop();
+}
+
+/* ================== URB recovery ================== */
+/* Put the URBs whose submit failed back in flight; true while any is still
+ * out. With none in flight the endpoint is re-armed (halt, flush, clear)
+ * first, and the service intervals that went by unpolled become a gap. */
+static bool heal_urbs(void)
+{
+    if (s_stream.state != STREAM_RUNNING || s_stream.urbs_idle == 0) {
+        return false;
+    }
+    while (s_stream.urbs_idle) {
+        usb_transfer_t *t = s_idle_urbs[s_stream.urbs_idle - 1];
+        const int64_t now = esp_timer_get_time();
+        const esp_err_t err = usb_host_transfer_submit(t);
+        TRACE_INSTANT(TRACE_URB_SUBMIT, err != ESP_OK);
+        if (err != ESP_OK && s_stream.urbs_live == 0 && !s_stream.rearmed) {
+            ESP_LOGW(TAG, "no URB in flight (%s): re-arming EP 0x%02x", esp_err_to_name(err), s_stream.info.ep_addr);
+            usb_host_endpoint_halt(s_stream.dev->dev_hdl, s_stream.info.ep_addr);
+            usb_host_endpoint_flush(s_stream.dev->dev_hdl, s_stream.info.ep_addr);
+            usb_host_endpoint_clear(s_stream.dev->dev_hdl, s_stream.info.ep_addr);
+            s_stream.rearmed = true;
+            continue;
+        }
+        if (err != ESP_OK) {
+            metrics_add(s_metrics.resubmit_fail, 1);
+            return true;
+        }
+        if (s_stream.urbs_live++ == 0) {
+            s_stream_pos += frames_missed_since(s_stream.dry_us, now);
+        }
+        s_stream.urbs_idle--;
+    }
+    ESP_LOGW(TAG, "URB pool recovered after %lld us", (long long)(esp_timer_get_time() - s_stream.heal_since_us));
+    metrics_add(s_metrics.recovered, 1);
+    s_stream.heal_since_us = 0;
+    s_stream.rearmed = false;
+    return false;
+}
+
+/* ================== Bandwidth admission ================== */
+/* Bytes per (micro)frame the alt setting's endpoint can take, to rank alt settings */
+static uint32_t alt_bandwidth(const uac_stream_info_t *s)
+{
+    return ((uint32_t)s->ep_mps << 15) >> (s->ep_interval - 1);
+}
+
+/* Reserve bandwidth for the most demanding alt setting that still fits the
+ * bus, NULL if none does */
+static const uac_stream_info_t *admit(const class_driver_dev_t *dev, const usb_device_info_t *dev_info)
+{
+    const desc_cache_entry_t *d = dev->desc;
+    // Full-speed devices behind a high-speed hub share its transaction translator
+    uint8_t tt_hub = 0;
+    usb_device_info_t hub_info;
+    if (dev_info->speed != USB_SPEED_HIGH && dev_info->parent.dev_hdl != NULL &&
+            usb_host_device_info(dev_info->parent.dev_hdl, &hub_info) == ESP_OK && hub_info.speed == USB_SPEED_HIGH) {
+        tt_hub = hub_info.dev_addr;
+    }
+    usb_bw_ep_t options[1 + DESC_CACHE_STREAM_ALTS];
+    const size_t n = 1 + d->num_stream_alts;
+    for (size_t i = 0; i < n; i++) {
+        const uac_stream_info_t *s = i ? &d->stream_alts[i - 1] : &d->stream;
+        options[i] = (usb_bw_ep_t) {
+            .speed = dev_info->speed,
+            .tt_hub = tt_hub,
+            .bytes = s->ep_mps,
+            .mult = s->ep_mult,
+            .interval = s->ep_interval,
+        };
+    }
+    const usb_bw_request_t req = {
+        .dev_addr = dev->dev_addr,
+        .ep_addr = d->stream.ep_addr,
+        .options = options,
+        .num_options = n,
+    };
+    int choice;
+    usb_bw_plan(dev->bw, &req, 1, &choice);
+    if (choice < 0) {
+        ESP_LOGW(TAG, "interface %d: none of %u alt settings fits the periodic bandwidth left",
+                 d->stream.intf, (unsigned)n);
+        usb_bw_log(dev->bw);
+        return NULL;
+    }
+    const uac_stream_info_t *s = choice ? &d->stream_alts[choice - 1] : &d->stream;
+    if (choice) {
+        ESP_LOGW(TAG, "bus busy: alt %d instead of alt %d", s->alt, d->stream.alt);
+    }
+    usb_bw_log(dev->bw);
+    return s;
+}
+
+/* ================== Class driver hooks ================== */
+/* Formats isoc_in_cb can unpack into s_frames */
+static bool format_supported(const uac_stream_info_t *s)
+{
+    return s->subframe_size >= 2 && s->subframe_size <= 4 && s->channels <= MAX_CHANNELS;
+}
+
+/* Every usable alt setting, the most bandwidth first: attach falls back along
+ * the list when the bus is busy, so an alt it can't stream is never listed */
+static void uac_parse(const usb_config_desc_t *config_desc, const usb_intf_desc_t *intf,
+                      desc_cache_entry_t *entry, void *arg)
+{
+    if (entry->has_stream) {
+        return;
+    }
+    uac_stream_info_t alts[1 + DESC_CACHE_STREAM_ALTS];
+    size_t n = 0;
+    for (uint8_t alt = 1; alt < MAX_ALT_SETTINGS && n < sizeof(alts) / sizeof(alts[0]); alt++) {
+        uac_stream_info_t s;
+        if (uac_parse_stream(config_desc, intf->bInterfaceNumber, alt, &s) != ESP_OK) {
+            continue;
+        }
+        if (!format_supported(&s)) {
+            ESP_LOGW(TAG, "interface %d alt %d: %u ch x %u-byte subframes isn't supported (CONFIG_APP_MAX_CHANNELS %d)",
+                     intf->bInterfaceNumber, alt, s.channels, s.subframe_size, MAX_CHANNELS);
+            continue;
+        }
+        // Insertion sort; equal bandwidth keeps descriptor order
+        size_t i = n++;
+        for (; i > 0 && alt_bandwidth(&alts[i - 1]) < alt_bandwidth(&s); i--) {
+            alts[i] = alts[i - 1];
+        }
+        alts[i] = s;
+    }
+    entry->has_stream = n > 0;
+    if (!entry->has_stream) {
+        ESP_LOGW(TAG, "interface %d: no usable AudioStreaming alt setting", intf->bInterfaceNumber);
+        return;
+    }
+    entry->stream = alts[0];
+    entry->num_stream_alts = (uint8_t)(n - 1);
+    memcpy(entry->stream_alts, alts + 1, (n - 1) * sizeof(alts[0]));
+    for (size_t i = 0; i < n; i++) {
+        const uac_stream_info_t *s = &alts[i];
+        ESP_LOGI(TAG, "interface %d alt %d: UAC %u, EP 0x%02x MPS=%u x%u bInterval %u, %u ch x %u bit, %s rate control",
+                 s->intf, s->alt, s->uac_version, s->ep_addr, s->ep_mps / s->ep_mult, s->ep_mult, s->ep_interval,
+                 s->channels, s->bit_resolution, s->freq_control ? "with" : "no");
+    }
+}
+
+static esp_err_t uac_attach(const class_driver_dev_t *dev, const usb_intf_desc_t *intf, void *arg, void **ret_ctx)
+{
+    if (!dev->desc->has_stream || dev->desc->stream.intf != intf->bInterfaceNumber) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (s_stream.dev != NULL) {
+        ESP_LOGW(TAG, "already streaming from address %d", s_stream.dev->dev_addr);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    usb_device_info_t dev_info;
+    ESP_RETURN_ON_ERROR(usb_host_device_info(dev->dev_hdl, &dev_info), TAG, "device info");
+    const uac_stream_info_t *info = admit(dev, &dev_info);
+    if (info == NULL) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    s_stream.resv_ep = dev->desc->stream.ep_addr;
+    s_attach_us = esp_timer_get_time();
+    s_stream.info = *info;
+    s_stream.info.high_speed = dev_info.speed == USB_SPEED_HIGH;
+    const uint32_t interval_us = uac_interval_us(&s_stream.info);
+    s_stream.pkts_per_urb = interval_us < URB_MS * 1000 ? (int)(URB_MS * 1000 / interval_us) : 1;
+    s_stream.frame_bytes = (size_t)info->channels * info->subframe_size;
+    s_stream.mono_channel = CONFIG_APP_STREAM_CHANNEL < info->channels ? CONFIG_APP_STREAM_CHANNEL : info->channels - 1u;
+    esp_err_t err = usb_host_interface_claim(dev->client, dev->dev_hdl, s_stream.info.intf, s_stream.info.alt);
+    if (err != ESP_OK) {
+        usb_bw_release(dev->bw, dev->dev_addr, s_stream.resv_ep);
+        return err;
+    }
+    s_stream.dev = dev;
+    s_stream.state = STREAM_STARTING;
+    s_stream.rate_hz = 0;
+    s_stream.alt_reset = false;
+    s_cache_hit = dev->cache_hit;
+    s_await_first_sample = true;
+    err = ctrl_xfer_set_interface(dev->ctrl, dev->dev_hdl, s_stream.info.intf, s_stream.info.alt,
+                                  set_interface_done, NULL);
+    if (err != ESP_OK) {
+        usb_host_interface_release(dev->client, dev->dev_hdl, s_stream.info.intf);
+        usb_bw_release(dev->bw, dev->dev_addr, s_stream.resv_ep);
+        s_stream.dev = NULL;
+        s_stream.state = STREAM_IDLE;
+        return err;
+    }
+    atomic_store(&s_active, true);
+    *ret_ctx = NULL;
+    return ESP_OK;
+}
+
+static esp_err_t uac_detach(const class_driver_dev_t *dev, void *ctx)
+{
+    if (s_stream.state == STREAM_RUNNING) {
+        // Errors are expected here when the device is already gone
+        usb_host_endpoint_halt(dev->dev_hdl, s_stream.info.ep_addr);
+        usb_host_endpoint_flush(dev->dev_hdl, s_stream.info.ep_addr);
+        s_stream.state = STREAM_STOPPING;
+    } else if (s_stream.state == STREAM_STARTING) {
+        s_stream.state = STREAM_IDLE;
+    }
+    s_stream.next_rate_hz = 0;
+    s_stream.alt_reset = false;
+    if (s_stream.urbs_live) {
+        return ESP_ERR_NOT_FINISHED;
+    }
+    free_idle_urbs();
+    s_stream.state = STREAM_IDLE;
+    s_stream.rate_hz = 0;
+    s_stream.dev = NULL;
+    usb_host_interface_release(dev->client, dev->dev_hdl, s_stream.info.intf);
+    usb_bw_release(dev->bw, dev->dev_addr, s_stream.resv_ep);
+    atomic_store(&s_active, false);
+    return ESP_OK;
+}
+
+static bool uac_poll(const class_driver_dev_t *dev, void *ctx)
+{
+    const uint32_t hz = atomic_exchange(&s_rate_request, 0);
+    if (hz) {
+        stream_switch_rate(hz);
+    }
+    const int recovery = atomic_exchange(&s_recovery_request, 0);
+    if (recovery) {
+        stream_restart(recovery - 1 == UAC_RECOVER_ALT_RESET);
+    }
+    return heal_urbs();
+}
+
+static const class_driver_ops_t s_ops = {
+    .name = "UAC",
+    .intf_class = USB_CLASS_AUDIO,
+    .intf_subclass = UAC_SUBCLASS_AUDIOSTREAMING,
+    .parse = uac_parse,
+    .attach = uac_attach,
+    .detach = uac_detach,
+    .poll = uac_poll,
+};
+
+esp_err_t uac_driver_register(const uac_driver_config_t *config)
+{
+    if (config == NULL || config->sample_rate_hz == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_config = *config;
+    ESP_RETURN_ON_ERROR(metrics_register(METRICS_COUNTER, "uac.packets", &s_metrics.packets), TAG, "metrics");
+    ESP_RETURN_ON_ERROR(metrics_register(METRICS_COUNTER, "uac.bytes", &s_metrics.bytes), TAG, "metrics");
+    ESP_RETURN_ON_ERROR(metrics_register(METRICS_COUNTER, "uac.lost", &s_metrics.lost), TAG, "metrics");
+    ESP_RETURN_ON_ERROR(metrics_register(METRICS_COUNTER, "uac.short", &s_metrics.short_pkts), TAG, "metrics");
+    ESP_RETURN_ON_ERROR(metrics_register(METRICS_COUNTER, "uac.resubmit_fail", &s_metrics.resubmit_fail), TAG, "metrics");
+    ESP_RETURN_ON_ERROR(metrics_register(METRICS_COUNTER, "uac.recovered", &s_metrics.recovered), TAG, "metrics");
+    ESP_RETURN_ON_ERROR(metrics_register(METRICS_COUNTER, "uac.stop_fail", &s_metrics.stop_fail), TAG, "metrics");
+    ESP_RETURN_ON_ERROR(metrics_register(METRICS_GAUGE, "uac.rate_hz", &s_metrics.rate_hz), TAG, "metrics");
+    ESP_RETURN_ON_ERROR(metrics_register(METRICS_HISTOGRAM, "uac.cb_us", &s_metrics.cb_us), TAG, "metrics");
+    return class_driver_register(&s_ops, NULL);
+}
+
+void uac_driver_request_rate(uint32_t hz)
+{
+    atomic_store(&s_rate_request, hz);
+    class_driver_wake();
+}
+
+void uac_driver_request_recovery(uac_recovery_t how)
+{
+    atomic_store(&s_recovery_request, (int)how + 1);
+    class_driver_wake();
+}
+
+uint32_t uac_driver_frames_received(void)
+{
+    return atomic_load_explicit(&s_frames_received, memory_order_relaxed);
+}
+
+bool uac_driver_active(void)
+{
+    return atomic_load(&s_active);
+}
+
+void uac_driver_take_stats(uac_driver_stats_t *stats)
+{
+    metrics_value_t v;
+    metrics_read(s_metrics.packets, &v);
+    stats->packets = v.count - s_taken.packets;
+    s_taken.packets = v.count;
+    metrics_read(s_metrics.bytes, &v);
+    stats->bytes = v.count - s_taken.bytes;
+    s_taken.bytes = v.count;
+    metrics_read(s_metrics.lost, &v);
+    stats->lost = v.count - s_taken.lost;
+    s_taken.lost = v.count;
+    metrics_read(s_metrics.short_pkts, &v);
+    stats->short_packets = v.count - s_taken.short_pkts;
+    s_taken.short_pkts = v.count;
+    metrics_read(s_metrics.recovered, &v);
+    stats->recoveries = v.count - s_taken.recovered;
+    s_taken.recovered = v.count;
+    stats->rate_hz = audio_stream_sample_rate();
+}
+
+size_t uac_driver_max_block_samples(void)
+{
+    return MAX_URB_FRAMES;
+}
@@ -0,0 +1,85 @@
+// uac_driver.h  (USB Audio Class streaming as a class_driver plugin)
+//
+// Takes the first AudioStreaming interface with a usable PCM alternate
+// setting, selects the most demanding one the bus still has periodic
+// bandwidth for (usb_bw; the device is refused if none fits), negotiates
+// the sampling frequency and keeps NUM_ISO_URBS isochronous URBs in
+// flight, publishing every URB's samples to audio_stream. Any Type I PCM layout with 16-, 24- or 32-bit subframes
+// and up to CONFIG_APP_MAX_CHANNELS channels is unpacked to Q31 frames; the
+// int16 stages get CONFIG_APP_STREAM_CHANNEL. One stream at a time: further
+// audio devices are left to the other drivers.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t sample_rate_hz;    /**< Asked for at attach */
+} uac_driver_config_t;
+
+typedef struct {
+    uint32_t packets;           /**< ISO packets received */
+    uint32_t bytes;
+    uint32_t lost;              /**< Packets that came back without data */
+    uint32_t short_packets;     /**< Packets cut short: what's missing is a gap */
+    uint32_t recoveries;        /**< Failed URB submits all retried into flight */
+    uint32_t rate_hz;           /**< Rate audio_stream runs at */
+} uac_driver_stats_t;
+
+typedef enum {
+    UAC_RECOVER_RESTART = 0,    /**< Flush, confirm the rate and resubmit the URBs */
+    UAC_RECOVER_ALT_RESET,      /**< The same through alt setting 0 */
+} uac_recovery_t;
+
+/**
+ * @brief Register with class_driver; before class_driver_install()
+ */
+esp_err_t uac_driver_register(const uac_driver_config_t *config);
+
+/**
+ * @brief Switch the running stream to `hz`; any task
+ *
+ * Picked up by the client task after its next event pass.
+ */
+void uac_driver_request_rate(uint32_t hz);
+
+/**
+ * @brief Restart the stream at its rate; any task
+ *
+ * Picked up like uac_driver_request_rate(); a stream that failed to start
+ * is started again. The time the restart takes is a gap in the timeline.
+ */
+void uac_driver_request_recovery(uac_recovery_t how);
+
+/**
+ * @brief Frames published since boot, gaps not counted; any task
+ */
+uint32_t uac_driver_frames_received(void);
+
+/**
+ * @brief A device is attached and meant to be streaming; any task
+ */
+bool uac_driver_active(void);
+
+/**
+ * @brief Counters since the previous call; any one task
+ *
+ * The same counts are exported as the uac.* metrics.
+ */
+void uac_driver_take_stats(uac_driver_stats_t *stats);
+
+/**
+ * @brief Largest block published to audio_stream (one URB at CONFIG_APP_MAX_SAMPLE_RATE_HZ)
+ */
+size_t uac_driver_max_block_samples(void);
+
+#ifdef __cplusplus
+}
+#endif
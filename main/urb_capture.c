@@ -0,0 +1,184 @@
+// urb_capture.c  (record every isochronous URB completion for replay on a PC)
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "urb_capture.h"
+
+static uint8_t *s_buf;
+static size_t s_size;
+// Bytes ever recorded and drained; a power-of-two size keeps % right across
+// their wrap
+static _Atomic uint32_t s_head;     // the producer's
+static _Atomic uint32_t s_tail;     // the consumer's
+static _Atomic uint32_t s_dropped;
+
+/* Left out since the last record that fitted; producer only */
+static uint32_t s_gap_urbs;
+static uint32_t s_gap_packets;
+
+static size_t room(uint32_t head)
+{
+    return s_size - (head - atomic_load_explicit(&s_tail, memory_order_acquire));
+}
+
+static void put(uint32_t *pos, const void *data, size_t len)
+{
+    const size_t at = *pos % s_size;
+    const size_t first = len < s_size - at ? len : s_size - at;
+    memcpy(s_buf + at, data, first);
+    memcpy(s_buf, (const uint8_t *)data + first, len - first);
+    *pos += (uint32_t)len;
+}
+
+static void put_le(uint32_t *pos, uint64_t v, size_t n)
+{
+    uint8_t b[8];
+    for (size_t i = 0; i < n; i++) {
+        b[i] = (uint8_t)(v >> (8 * i));
+    }
+    put(pos, b, n);
+}
+
+static void put_header(uint32_t *pos, urb_capture_record_t type, size_t len)
+{
+    put_le(pos, type, 1);
+    put_le(pos, len, 4);
+}
+
+static void commit(uint32_t head)
+{
+    atomic_store_explicit(&s_head, head, memory_order_release);
+}
+
+esp_err_t urb_capture_start(size_t ring_bytes)
+{
+    if (s_buf != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (ring_bytes < 256 || (ring_bytes & (ring_bytes - 1))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_buf = malloc(ring_bytes);
+    if (s_buf == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_size = ring_bytes;
+    s_gap_urbs = 0;
+    s_gap_packets = 0;
+    atomic_store(&s_tail, 0);
+    atomic_store(&s_dropped, 0);
+    uint32_t head = 0;
+    put(&head, URB_CAPTURE_MAGIC, URB_CAPTURE_MAGIC_LEN);
+    commit(head);
+    return ESP_OK;
+}
+
+void urb_capture_stop(void)
+{
+    free(s_buf);
+    s_buf = NULL;
+    atomic_store(&s_head, 0);
+    atomic_store(&s_tail, 0);
+}
+
+esp_err_t urb_capture_device(usb_speed_t speed, uint16_t vid, uint16_t pid, uint8_t ep, uint32_t rate_hz,
+                             const usb_config_desc_t *config_desc)
+{
+    if (s_buf == NULL) {
+        return ESP_OK;
+    }
+    const size_t desc_len = config_desc->wTotalLength;
+    const size_t len = URB_CAPTURE_DEVICE_LEN + desc_len;
+    uint32_t head = atomic_load_explicit(&s_head, memory_order_relaxed);
+    if (room(head) < URB_CAPTURE_RECORD_HEADER_LEN + len) {
+        return ESP_ERR_NO_MEM;
+    }
+    put_header(&head, URB_CAPTURE_DEVICE, len);
+    put_le(&head, speed, 1);
+    put_le(&head, vid, 2);
+    put_le(&head, pid, 2);
+    put_le(&head, ep, 1);
+    put_le(&head, rate_hz, 4);
+    put(&head, config_desc, desc_len);
+    commit(head);
+    return ESP_OK;
+}
+
+void urb_capture_urb(const usb_transfer_t *t, uint64_t t_us)
+{
+    if (s_buf == NULL) {
+        return;
+    }
+    size_t data_len = 0;
+    for (int i = 0; i < t->num_isoc_packets; i++) {
+        const usb_isoc_packet_desc_t *d = &t->isoc_packet_desc[i];
+        data_len += d->status == USB_TRANSFER_STATUS_COMPLETED ? (size_t)d->actual_num_bytes : 0;
+    }
+    const size_t len = 10 + (size_t)t->num_isoc_packets * URB_CAPTURE_PACKET_LEN + data_len;
+    const size_t gap = s_gap_urbs ? URB_CAPTURE_RECORD_HEADER_LEN + 8 : 0;
+    uint32_t head = atomic_load_explicit(&s_head, memory_order_relaxed);
+    if (room(head) < gap + URB_CAPTURE_RECORD_HEADER_LEN + len) {
+        s_gap_urbs++;
+        s_gap_packets += (uint32_t)t->num_isoc_packets;
+        atomic_fetch_add_explicit(&s_dropped, 1, memory_order_relaxed);
+        return;
+    }
+    if (gap) {
+        put_header(&head, URB_CAPTURE_GAP, 8);
+        put_le(&head, s_gap_urbs, 4);
+        put_le(&head, s_gap_packets, 4);
+        s_gap_urbs = 0;
+        s_gap_packets = 0;
+    }
+    put_header(&head, URB_CAPTURE_URB, len);
+    put_le(&head, t_us, 8);
+    put_le(&head, (uint32_t)t->num_isoc_packets, 2);
+    for (int i = 0; i < t->num_isoc_packets; i++) {
+        const usb_isoc_packet_desc_t *d = &t->isoc_packet_desc[i];
+        put_le(&head, (uint32_t)d->status, 1);
+        put_le(&head, d->status == USB_TRANSFER_STATUS_COMPLETED ? (uint32_t)d->actual_num_bytes : 0, 2);
+    }
+    // Packets sit num_bytes apart in the buffer whatever they received
+    size_t off = 0;
+    for (int i = 0; i < t->num_isoc_packets; i++) {
+        const usb_isoc_packet_desc_t *d = &t->isoc_packet_desc[i];
+        if (d->status == USB_TRANSFER_STATUS_COMPLETED) {
+            put(&head, t->data_buffer + off, (size_t)d->actual_num_bytes);
+        }
+        off += (size_t)d->num_bytes;
+    }
+    commit(head);
+}
+
+esp_err_t urb_capture_drain(urb_capture_write_fn_t write, void *ctx, size_t *ret_len)
+{
+    size_t written = 0;
+    esp_err_t err = ESP_OK;
+    if (s_buf != NULL) {
+        const uint32_t head = atomic_load_explicit(&s_head, memory_order_acquire);
+        uint32_t tail = atomic_load_explicit(&s_tail, memory_order_relaxed);
+        // At most two pieces: up to the end of the buffer, then from its start
+        while (tail != head) {
+            const size_t at = tail % s_size;
+            const size_t avail = head - tail;
+            const size_t n = avail < s_size - at ? avail : s_size - at;
+            err = write(s_buf + at, n, ctx);
+            if (err != ESP_OK) {
+                break;
+            }
+            tail += (uint32_t)n;
+            written += n;
+            atomic_store_explicit(&s_tail, tail, memory_order_release);
+        }
+    }
+    if (ret_len) {
+        *ret_len = written;
+    }
+    return err;
+}
+
+uint32_t urb_capture_take_dropped(void)
+{
+    return atomic_exchange_explicit(&s_dropped, 0, memory_order_relaxed);
+}
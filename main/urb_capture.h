@@ -0,0 +1,98 @@
+// urb_capture.h  (record every isochronous URB completion for replay on a PC)
+//
+// The URB callback appends each completion (bus time, packet statuses and
+// lengths, and the bytes of the packets that carried data) to a lock-free
+// byte ring; a low-priority task drains the ring to a file on the SD card.
+// host_test/urb_replay feeds a capture back through the mock USB host into
+// uac_driver and the DSP pipeline, at the original timing or as fast as it
+// goes, so field traffic can be replayed on the bench. One producer (the
+// USB client task) and one consumer.
+//
+// File (little endian): "URC1", then records
+//
+//   type:u8  length:u32  payload
+//   device:  speed:u8  vid:u16  pid:u16  ep:u8  rate_hz:u32  configuration descriptor
+//   urb:     t_us:u64  packets:u16  { status:u8  length:u16 } x packets,
+//            then the data of every packet with status COMPLETED, back to back
+//   gap:     urbs:u32  packets:u32     (left out because the ring was full)
+//
+// A device record comes before the URBs of every stream start (attach, rate
+// switch).
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "usb/usb_host.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define URB_CAPTURE_MAGIC       "URC1"
+#define URB_CAPTURE_MAGIC_LEN   4
+#define URB_CAPTURE_RECORD_HEADER_LEN   5
+#define URB_CAPTURE_DEVICE_LEN  10      /**< Device payload before the descriptor */
+#define URB_CAPTURE_PACKET_LEN  3       /**< Per-packet entry of a URB record */
+
+typedef enum {
+    URB_CAPTURE_DEVICE = 1,
+    URB_CAPTURE_URB,
+    URB_CAPTURE_GAP,
+} urb_capture_record_t;
+
+/**
+ * @brief Sink for urb_capture_drain(); trace_write_file() writes to a FILE *
+ */
+typedef esp_err_t (*urb_capture_write_fn_t)(const void *data, size_t len, void *ctx);
+
+/**
+ * @brief Allocate the ring and start capturing; until then the record calls do nothing
+ *
+ * `ring_bytes` is a power of two, and URBs bigger than the ring are never
+ * recorded: 16 ms of 48 kHz mono 16-bit is about 1.6 KB, of 384 kHz
+ * 8-channel 24-bit about 150 KB.
+ *
+ * @return ESP_ERR_INVALID_ARG for a size that isn't a power of two of at
+ *         least 256, ESP_ERR_INVALID_STATE if already started, ESP_ERR_NO_MEM
+ */
+esp_err_t urb_capture_start(size_t ring_bytes);
+
+/**
+ * @brief Stop and free the ring; only while no URB callback or drain can run
+ */
+void urb_capture_stop(void);
+
+/**
+ * @brief Record the stream about to start; client task
+ *
+ * @return ESP_ERR_NO_MEM if the ring has no room for it (nothing is recorded)
+ */
+esp_err_t urb_capture_device(usb_speed_t speed, uint16_t vid, uint16_t pid, uint8_t ep, uint32_t rate_hz,
+                             const usb_config_desc_t *config_desc);
+
+/**
+ * @brief Record a completed isochronous URB; from its callback
+ *
+ * A URB that doesn't fit is counted and shows up as a gap record.
+ */
+void urb_capture_urb(const usb_transfer_t *t, uint64_t t_us);
+
+/**
+ * @brief Hand everything recorded so far to `write`; one consumer task
+ *
+ * Stops at the first write error, keeping the unwritten bytes for the next call.
+ *
+ * @param ret_len  Bytes written, may be NULL
+ */
+esp_err_t urb_capture_drain(urb_capture_write_fn_t write, void *ctx, size_t *ret_len);
+
+/**
+ * @brief URBs left out on a full ring since the last call
+ */
+uint32_t urb_capture_take_dropped(void);
+
+#ifdef __cplusplus
+}
+#endif
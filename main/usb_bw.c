@@ -0,0 +1,245 @@
+// usb_bw.c  (periodic bandwidth admission for isochronous endpoints)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "usb_bw.h"
+
+static const char *TAG = "USB_BW";
+
+/* USB 2.0 5.11.3: per-transaction protocol overhead in byte times, payload
+ * charged with worst-case bit stuffing (7/6) */
+#define HS_ISO_OVERHEAD     38
+#define FS_ISO_OVERHEAD     9
+#define LS_BIT_TIMES        8       // a low-speed byte takes 8 full-speed byte times
+
+#define DOMAIN_FS_ROOT      0
+#define DOMAIN_HS           0x100   // below it: the TT of hub address n
+
+struct usb_bw {
+    size_t count;
+    usb_bw_resv_t resv[USB_BW_MAX_RESERVATIONS];
+};
+
+static uint16_t domain_of(const usb_bw_ep_t *ep)
+{
+    return ep->speed == USB_SPEED_HIGH ? DOMAIN_HS : ep->tt_hub;
+}
+
+static uint32_t domain_budget(uint16_t domain)
+{
+    return domain == DOMAIN_HS ? USB_BW_HS_BUDGET : domain == DOMAIN_FS_ROOT ? USB_BW_FS_BUDGET : USB_BW_TT_BUDGET;
+}
+
+static uint8_t period_of(const usb_bw_ep_t *ep)
+{
+    return ep->interval > 6 ? USB_BW_SLOTS : (uint8_t)(1u << (ep->interval - 1));
+}
+
+esp_err_t usb_bw_create(usb_bw_t **ret_bw)
+{
+    if (ret_bw == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    usb_bw_t *bw = calloc(1, sizeof(*bw));
+    if (bw == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    *ret_bw = bw;
+    return ESP_OK;
+}
+
+void usb_bw_delete(usb_bw_t *bw)
+{
+    free(bw);
+}
+
+uint16_t usb_bw_cost(const usb_bw_ep_t *ep)
+{
+    const uint32_t payload = ((uint32_t)ep->bytes * 7 + 5) / 6;
+    uint32_t cost;
+    if (ep->speed == USB_SPEED_HIGH) {
+        cost = (uint32_t)(ep->mult ? ep->mult : 1) * HS_ISO_OVERHEAD + payload;
+    } else {
+        cost = FS_ISO_OVERHEAD + payload;
+        cost *= ep->speed == USB_SPEED_LOW ? LS_BIT_TIMES : 1;
+    }
+    return cost > UINT16_MAX ? UINT16_MAX : (uint16_t)cost;
+}
+
+/* Byte times already scheduled in (micro)frame `slot` of `domain` */
+static uint32_t slot_load(const usb_bw_t *bw, uint16_t domain, unsigned slot)
+{
+    uint32_t load = 0;
+    for (size_t i = 0; i < bw->count; i++) {
+        const usb_bw_resv_t *r = &bw->resv[i];
+        if (domain_of(&r->ep) == domain && slot % r->period == r->phase) {
+            load += r->cost;
+        }
+    }
+    return load;
+}
+
+static usb_bw_resv_t *find(usb_bw_t *bw, uint8_t dev_addr, uint8_t ep_addr)
+{
+    for (size_t i = 0; i < bw->count; i++) {
+        if (bw->resv[i].dev_addr == dev_addr && bw->resv[i].ep_addr == ep_addr) {
+            return &bw->resv[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t usb_bw_reserve(usb_bw_t *bw, uint8_t dev_addr, uint8_t ep_addr, const usb_bw_ep_t *ep)
+{
+    if (bw == NULL || ep == NULL || ep->interval < 1 || ep->interval > 16 || ep->mult > 3) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (find(bw, dev_addr, ep_addr)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (bw->count == USB_BW_MAX_RESERVATIONS) {
+        return ESP_ERR_NO_MEM;
+    }
+    const uint16_t domain = domain_of(ep);
+    const uint16_t cost = usb_bw_cost(ep);
+    const uint8_t period = period_of(ep);
+
+    // Lowest resulting peak wins; ties go to the earliest phase
+    uint32_t best_peak = UINT32_MAX;
+    uint8_t best_phase = 0;
+    for (uint8_t phase = 0; phase < period; phase++) {
+        uint32_t peak = 0;
+        for (unsigned slot = phase; slot < USB_BW_SLOTS; slot += period) {
+            const uint32_t load = slot_load(bw, domain, slot) + cost;
+            peak = load > peak ? load : peak;
+        }
+        if (peak < best_peak) {
+            best_peak = peak;
+            best_phase = phase;
+        }
+    }
+    if (best_peak > domain_budget(domain)) {
+        return ESP_ERR_NO_MEM;
+    }
+    bw->resv[bw->count++] = (usb_bw_resv_t) {
+        .dev_addr = dev_addr,
+        .ep_addr = ep_addr,
+        .ep = *ep,
+        .cost = cost,
+        .phase = best_phase,
+        .period = period,
+    };
+    return ESP_OK;
+}
+
+esp_err_t usb_bw_release(usb_bw_t *bw, uint8_t dev_addr, uint8_t ep_addr)
+{
+    usb_bw_resv_t *r = bw ? find(bw, dev_addr, ep_addr) : NULL;
+    if (r == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    // Keep reservation order: it is the order they were admitted in
+    memmove(r, r + 1, (size_t)(&bw->resv[bw->count] - (r + 1)) * sizeof(*r));
+    bw->count--;
+    return ESP_OK;
+}
+
+void usb_bw_release_device(usb_bw_t *bw, uint8_t dev_addr)
+{
+    for (size_t i = bw->count; i-- > 0;) {
+        if (bw->resv[i].dev_addr == dev_addr) {
+            usb_bw_release(bw, dev_addr, bw->resv[i].ep_addr);
+        }
+    }
+}
+
+esp_err_t usb_bw_plan(usb_bw_t *bw, const usb_bw_request_t *reqs, size_t n, int *choice)
+{
+    if (bw == NULL || (n && (reqs == NULL || choice == NULL))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // Admit as many endpoints as possible at their least demanding option...
+    bool refused = false;
+    for (size_t i = 0; i < n; i++) {
+        const usb_bw_request_t *r = &reqs[i];
+        const int last = (int)r->num_options - 1;
+        choice[i] = last >= 0 && usb_bw_reserve(bw, r->dev_addr, r->ep_addr, &r->options[last]) == ESP_OK ? last : -1;
+        refused |= choice[i] < 0;
+    }
+    // ...then spend what is left on the earliest requests first
+    for (size_t i = 0; i < n; i++) {
+        const usb_bw_request_t *r = &reqs[i];
+        for (int o = 0; o < choice[i]; o++) {
+            usb_bw_release(bw, r->dev_addr, r->ep_addr);
+            if (usb_bw_reserve(bw, r->dev_addr, r->ep_addr, &r->options[o]) == ESP_OK) {
+                choice[i] = o;
+                break;
+            }
+            // It fit a moment ago, so it fits again
+            ESP_ERROR_CHECK(usb_bw_reserve(bw, r->dev_addr, r->ep_addr, &r->options[choice[i]]));
+        }
+    }
+    return refused ? ESP_ERR_NO_MEM : ESP_OK;
+}
+
+uint32_t usb_bw_peak(const usb_bw_t *bw, const usb_bw_ep_t *ep, uint32_t *budget)
+{
+    const uint16_t domain = domain_of(ep);
+    uint32_t peak = 0;
+    for (unsigned slot = 0; slot < USB_BW_SLOTS; slot++) {
+        const uint32_t load = slot_load(bw, domain, slot);
+        peak = load > peak ? load : peak;
+    }
+    if (budget) {
+        *budget = domain_budget(domain);
+    }
+    return peak;
+}
+
+size_t usb_bw_reservations(const usb_bw_t *bw, const usb_bw_resv_t **resv)
+{
+    *resv = bw->resv;
+    return bw->count;
+}
+
+static const char *domain_name(uint16_t domain, char *buf, size_t len)
+{
+    if (domain == DOMAIN_HS) {
+        return "high speed";
+    }
+    if (domain == DOMAIN_FS_ROOT) {
+        return "full speed";
+    }
+    snprintf(buf, len, "TT of hub %u", domain);
+    return buf;
+}
+
+void usb_bw_log(const usb_bw_t *bw)
+{
+    char name[24];
+    for (size_t i = 0; i < bw->count; i++) {
+        const usb_bw_resv_t *r = &bw->resv[i];
+        const uint16_t domain = domain_of(&r->ep);
+        ESP_LOGI(TAG, "address %d EP 0x%02x: %s, %u bytes x%u every %u %s, %u byte times at phase %u",
+                 r->dev_addr, r->ep_addr, domain_name(domain, name, sizeof(name)), r->ep.bytes,
+                 r->ep.mult ? r->ep.mult : 1, r->period, domain == DOMAIN_HS ? "microframes" : "frames",
+                 r->cost, r->phase);
+    }
+    // One summary line per domain, at its first reservation
+    for (size_t i = 0; i < bw->count; i++) {
+        const uint16_t domain = domain_of(&bw->resv[i].ep);
+        size_t first = 0;
+        while (domain_of(&bw->resv[first].ep) != domain) {
+            first++;
+        }
+        if (first != i) {
+            continue;
+        }
+        uint32_t budget;
+        const uint32_t peak = usb_bw_peak(bw, &bw->resv[i].ep, &budget);
+        ESP_LOGI(TAG, "%s: peak %u of %u byte times (%u%%)", domain_name(domain, name, sizeof(name)),
+                 (unsigned)peak, (unsigned)budget, (unsigned)(peak * 100 / budget));
+    }
+}
@@ -0,0 +1,123 @@
+// usb_bw.h  (periodic bandwidth admission for isochronous endpoints)
+//
+// The host can only schedule so much periodic traffic per (micro)frame: 80%
+// of a high-speed microframe, 90% of a full-speed frame, and the full-speed
+// budget of a hub's transaction translator for full-speed devices behind a
+// high-speed hub. Without admission, a second or third microphone's stream
+// start fails or loses packets once the sum doesn't fit.
+//
+// Every ISO endpoint reserves what its descriptor allows per service
+// interval (wMaxPacketSize x transactions, plus protocol overhead and worst
+// case bit stuffing) in one budget domain, at the phase within its interval
+// that keeps the busiest (micro)frame lowest. Domains: high-speed
+// microframes, full-speed frames of the root port, and full-speed frames of
+// each hub's TT. Split-transaction overhead on the high-speed side isn't
+// counted.
+//
+// usb_bw_plan() admits a set of endpoints deterministically: in request
+// order, every endpoint first gets its least demanding option, endpoints
+// whose least demanding option no longer fits are refused, then endpoints
+// are upgraded in request order to the most preferred option that fits.
+// The same call admits one device at attach and plans a whole array on the
+// host. Client task only, like desc_cache.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "usb/usb_host.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define USB_BW_SLOTS            32      /**< Schedule period in (micro)frames; longer intervals are charged every 32 */
+#define USB_BW_MAX_RESERVATIONS 16      /**< Periodic endpoints, one host channel each */
+#define USB_BW_HS_BUDGET        6000    /**< Byte times per microframe: 80% of 7500 */
+#define USB_BW_FS_BUDGET        1350    /**< Byte times per frame: 90% of 1500 */
+#define USB_BW_TT_BUDGET        1157    /**< Full-speed payload a TT can schedule per frame */
+
+typedef struct {
+    usb_speed_t speed;          /**< Of the device */
+    uint8_t tt_hub;             /**< Address of the high-speed hub translating for a full-speed device, 0 if none */
+    uint16_t bytes;             /**< Per service interval, all transactions */
+    uint8_t mult;               /**< Transactions per service interval, 1..3 */
+    uint8_t interval;           /**< bInterval: every 2^(interval-1) (micro)frames */
+} usb_bw_ep_t;
+
+typedef struct {
+    uint8_t dev_addr;
+    uint8_t ep_addr;
+    const usb_bw_ep_t *options; /**< Most preferred (usually most demanding) first */
+    size_t num_options;
+} usb_bw_request_t;
+
+typedef struct {
+    uint8_t dev_addr;
+    uint8_t ep_addr;
+    usb_bw_ep_t ep;
+    uint16_t cost;              /**< Byte times per service interval */
+    uint8_t phase;              /**< First (micro)frame of the schedule period it occupies */
+    uint8_t period;             /**< (Micro)frames between its transfers, capped at USB_BW_SLOTS */
+} usb_bw_resv_t;
+
+typedef struct usb_bw usb_bw_t;
+
+esp_err_t usb_bw_create(usb_bw_t **ret_bw);
+void usb_bw_delete(usb_bw_t *bw);
+
+/**
+ * @brief Byte times `ep` costs per service interval in its domain
+ */
+uint16_t usb_bw_cost(const usb_bw_ep_t *ep);
+
+/**
+ * @brief Reserve bandwidth for one endpoint
+ *
+ * @return ESP_ERR_NO_MEM if it doesn't fit its domain or every reservation is in use,
+ *         ESP_ERR_INVALID_STATE if the endpoint already holds one
+ */
+esp_err_t usb_bw_reserve(usb_bw_t *bw, uint8_t dev_addr, uint8_t ep_addr, const usb_bw_ep_t *ep);
+
+/**
+ * @brief Return an endpoint's reservation
+ *
+ * @return ESP_ERR_NOT_FOUND if it holds none
+ */
+esp_err_t usb_bw_release(usb_bw_t *bw, uint8_t dev_addr, uint8_t ep_addr);
+
+/**
+ * @brief Return every reservation of a device, e.g. once it is closed
+ */
+void usb_bw_release_device(usb_bw_t *bw, uint8_t dev_addr);
+
+/**
+ * @brief Admit `reqs` in order (see above); reservations stay in `bw`
+ *
+ * @param[out] choice  Per request: the option reserved, or -1 if refused
+ * @return ESP_OK if every request was admitted, ESP_ERR_NO_MEM if any was refused
+ */
+esp_err_t usb_bw_plan(usb_bw_t *bw, const usb_bw_request_t *reqs, size_t n, int *choice);
+
+/**
+ * @brief Busiest (micro)frame of the domain `ep` belongs to, in byte times
+ *
+ * @param[out] budget  The domain's limit; optional
+ */
+uint32_t usb_bw_peak(const usb_bw_t *bw, const usb_bw_ep_t *ep, uint32_t *budget);
+
+/**
+ * @brief Current reservations; valid until the next reserve or release
+ */
+size_t usb_bw_reservations(const usb_bw_t *bw, const usb_bw_resv_t **resv);
+
+/**
+ * @brief Log every reservation and the peak load of each domain in use
+ */
+void usb_bw_log(const usb_bw_t *bw);
+
+#ifdef __cplusplus
+}
+#endif
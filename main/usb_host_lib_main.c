@@ -1,39 +1,66 @@
-// uac_probe.c  (triple-buffered ISO URBs)
+// uac_probe.c  (class drivers: UAC stream, AudioMoth HID, descriptor logger)
 // Build-tested against ESP-IDF v5.4.x
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/semphr.h"
 #include "esp_log.h"
 #include "esp_check.h"
 #include "esp_timer.h"
+#include "driver/uart.h"
 
 #include "usb/usb_host.h"
-#include "usb/usb_types_stack.h"
-#include "usb/usb_helpers.h"
-#include "usb/usb_types_ch9.h"
+
+#include "dsp_bench.h"
+#include "audio_stream.h"
+#include "stft.h"
+#include "goertzel.h"
+#include "biquad.h"
+#include "level_meter.h"
+#include "class_driver.h"
+#include "uac_driver.h"
+#include "audiomoth_driver.h"
+#include "desc_logger.h"
+#include "metrics.h"
+#include "trace.h"
+#include "dlog.h"
+#include "urb_capture.h"
+#include "stream_watchdog.h"
+#include "app_tasks.h"
+#include "audio_fanout.h"
+#include "dsp_kernels.h"
+#include "dsp_graph_stages.h"
+#include "esp_cpu.h"
+
+#if CONFIG_APP_URB_CAPTURE
+#include <sys/stat.h>
+#include "esp_vfs_fat.h"
+#include "sdmmc_cmd.h"
+#include "driver/sdmmc_host.h"
+#endif
 
 static const char *TAG = "UAC_PROBE";
 
-static usb_host_client_handle_t g_client;
-static usb_device_handle_t      g_dev;
-static SemaphoreHandle_t        ctrl_sem;
+#define STATUS_PERIOD_US     500000
+
+static level_meter_t *s_meter;
 
-/* ---------- ISO config ---------- */
-#define ISO_MPS              96      // from your descriptor
-#define ISO_PKTS_PER_URB     16      // 16 ms per URB (tune)
-#define NUM_ISO_URBS         3       // triple buffering
+#if CONFIG_APP_TRACE_DUMP_ON_LOSS
+#define TRACE_DUMP_HOLDOFF_US   (60 * 1000000)  // a dump takes seconds of console time
 
-/* Keep the URB pointers so they don't get GC'd */
-static usb_transfer_t *s_iso_urbs[NUM_ISO_URBS] = {0};
+static TaskHandle_t s_trace_task;
+#endif
 
-/* Stats (atomic not necessary here; single core handles callback) */
-static uint64_t g_pkt_cnt = 0;
-static uint64_t g_byte_cnt = 0;
-static int64_t  g_last_log_us = 0;
+#if CONFIG_APP_HPF_ENABLE
+static biquad_t *s_hpf;
+#endif
+
+#if CONFIG_APP_DSP_GRAPH_ENABLE
+static dsp_graph_t *s_graph;
+#endif
 
 /* ================== Daemon task ================== */
 static void daemon_task(void *arg)
@@ -47,167 +74,663 @@ static void daemon_task(void *arg)
     }
 }
 
-/* ================== Control xfer completion ================== */
-static void ctrl_cb(usb_transfer_t *xfer)
+/* ================== Status log ================== */
+static void status_cb(void *arg)
 {
-    xSemaphoreGiveFromISR(ctrl_sem, NULL);
+    static int64_t last_us;
+    const int64_t now_us = esp_timer_get_time();
+    uac_driver_stats_t st;
+    uac_driver_take_stats(&st);
+    if (st.packets == 0 && st.lost == 0) {
+        last_us = now_us;
+        return;     // not streaming
+    }
+#if CONFIG_APP_TRACE_DUMP_ON_LOSS
+    static int64_t last_dump_us = -TRACE_DUMP_HOLDOFF_US;
+    if ((st.lost || st.short_packets) && now_us - last_dump_us >= TRACE_DUMP_HOLDOFF_US) {
+        last_dump_us = now_us;
+        xTaskNotifyGive(s_trace_task);
+    }
+#endif
+    const float kbps = (st.bytes * 8.0f) / ((now_us - last_us) / 1000.0f);
+    last_us = now_us;
+    level_summary_t lvl;
+    if (level_meter_get(s_meter, LEVEL_METER_BLOCK, 0, &lvl) == ESP_OK) {
+        ESP_LOGI(TAG, "pkts=%" PRIu32 " lost=%" PRIu32 " short=%" PRIu32 " ~%.1f kbps @%" PRIu32 " Hz rms=%.1f peak=%.1f dBFS clip=%" PRIu32 " dc=%.1f",
+                 st.packets, st.lost, st.short_packets, kbps, st.rate_hz,
+                 lvl.rms_dbfs, lvl.peak_dbfs, lvl.clip_count, lvl.dc);
+    } else {
+        // No block yet, or the writer kept the seqlock busy: a zeroed summary would read as full scale
+        ESP_LOGI(TAG, "pkts=%" PRIu32 " lost=%" PRIu32 " short=%" PRIu32 " ~%.1f kbps @%" PRIu32 " Hz level n/a",
+                 st.packets, st.lost, st.short_packets, kbps, st.rate_hz);
+    }
+#if CONFIG_APP_HPF_ENABLE
+    ESP_LOGI(TAG, "hpf %.1f cycles/sample", biquad_cycles_per_sample(s_hpf));
+#endif
+#if CONFIG_APP_DSP_GRAPH_ENABLE
+    char line[128];
+    int len = 0;
+    for (size_t k = 0; k < dsp_graph_num_nodes(s_graph) && len < (int)sizeof(line); k++) {
+        dsp_graph_node_info_t info;
+        dsp_graph_node_info(s_graph, k, &info);
+        len += snprintf(line + len, sizeof(line) - len, " %s %.1f", info.name,
+                        info.frames ? (double)info.time / (double)info.frames : 0.0);
+    }
+    ESP_LOGI(TAG, "graph cycles/frame:%s", line);
+#endif
 }
 
-static esp_err_t ctrl_set_interface(uint8_t intf, uint8_t alt)
+static esp_err_t status_start(void)
 {
-    usb_transfer_t *xfer;
-    ESP_RETURN_ON_ERROR(usb_host_transfer_alloc(sizeof(usb_setup_packet_t), 0, &xfer),
-                        TAG, "alloc ctrl");
+    static esp_timer_handle_t timer;
+    const esp_timer_create_args_t args = {
+        .callback = status_cb,
+        .name = "status",
+    };
+    ESP_RETURN_ON_ERROR(esp_timer_create(&args, &timer), TAG, "status timer");
+    return esp_timer_start_periodic(timer, STATUS_PERIOD_US);
+}
 
-    usb_setup_packet_t *setup = (usb_setup_packet_t *)xfer->data_buffer;
-    USB_SETUP_PACKET_INIT_SET_INTERFACE(setup, intf, alt);
+/* ================== Metrics export ================== */
+#if CONFIG_APP_METRICS_ENABLE
+#define METRICS_SCHEMA_EVERY    10      // frames; a decoder attached mid-stream waits at most this long
 
-    xfer->device_handle     = g_dev;
-    xfer->bEndpointAddress  = 0; // EP0
-    xfer->num_bytes         = sizeof(*setup);
-    xfer->callback          = ctrl_cb;
-    xfer->context           = NULL;
+static void metrics_task(void *arg)
+{
+    static uint8_t frame[METRICS_FRAME_MAX];
+    TickType_t wake = xTaskGetTickCount();
+    for (uint32_t seq = 0;; seq++) {
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(CONFIG_APP_METRICS_PERIOD_MS));
+        const uint64_t now_us = (uint64_t)esp_timer_get_time();
+        size_t len;
+        if (seq % METRICS_SCHEMA_EVERY == 0 &&
+                metrics_encode(METRICS_FRAME_SCHEMA, seq, now_us, frame, sizeof(frame), &len) == ESP_OK) {
+            uart_write_bytes(CONFIG_APP_METRICS_UART_NUM, frame, len);
+        }
+        if (metrics_encode(METRICS_FRAME_VALUES, seq, now_us, frame, sizeof(frame), &len) == ESP_OK) {
+            uart_write_bytes(CONFIG_APP_METRICS_UART_NUM, frame, len);
+        }
+    }
+}
 
-    while (xSemaphoreTake(ctrl_sem, 0) == pdTRUE) { /* drain */ }
-    ESP_RETURN_ON_ERROR(usb_host_transfer_submit_control(g_client, xfer),
-                        TAG, "submit ctrl");
+static esp_err_t metrics_start(void)
+{
+    const uart_config_t cfg = {
+        .baud_rate = CONFIG_APP_METRICS_UART_BAUD,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .source_clk = UART_SCLK_DEFAULT,
+    };
+    // TX ring big enough that a frame never blocks the task on the FIFO
+    ESP_RETURN_ON_ERROR(uart_driver_install(CONFIG_APP_METRICS_UART_NUM, 256, 2 * METRICS_FRAME_MAX, 0, NULL, 0),
+                        TAG, "metrics uart");
+    ESP_RETURN_ON_ERROR(uart_param_config(CONFIG_APP_METRICS_UART_NUM, &cfg), TAG, "metrics uart config");
+    ESP_RETURN_ON_ERROR(uart_set_pin(CONFIG_APP_METRICS_UART_NUM, CONFIG_APP_METRICS_UART_TX_GPIO, UART_PIN_NO_CHANGE,
+                                     UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE), TAG, "metrics uart pins");
+    return app_task_start(APP_TASK_METRICS, metrics_task, NULL, NULL);
+}
+#endif
 
-    while (xSemaphoreTake(ctrl_sem, 10 / portTICK_PERIOD_MS) != pdTRUE) {
-        usb_host_client_handle_events(g_client, 10 / portTICK_PERIOD_MS);
+/* ================== Trace dump ================== */
+#if CONFIG_APP_TRACE_DUMP_ON_LOSS
+/* Snapshot at once (the rings keep rolling), then print at leisure;
+ * host_test/trace2json converts the console log */
+static void trace_task(void *arg)
+{
+    static trace_snapshot_t snap;
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        trace_snapshot(&snap);
+        ESP_LOGW(TAG, "packets lost: dumping the trace");
+        trace_dump_hex(&snap, stdout);
     }
+}
+
+static esp_err_t trace_start(void)
+{
+    return app_task_start(APP_TASK_TRACE, trace_task, NULL, &s_trace_task);
+}
+#endif
 
-    esp_err_t ret = ESP_OK;
-    if (xfer->status != USB_TRANSFER_STATUS_COMPLETED) {
-        ESP_LOGE(TAG, "SET_INTERFACE failed, status=%d", xfer->status);
-        ret = ESP_FAIL;
+/* ================== URB capture ================== */
+#if CONFIG_APP_URB_CAPTURE
+#define CAPTURE_MOUNT           "/sdcard"
+#define CAPTURE_DRAIN_MS        100
+#define CAPTURE_FLUSH_EVERY     10      // drains; fflush() makes FAT update the directory entry
+
+/* Moves what the URB callback recorded from the ring to the file;
+ * host_test/urb_replay plays the file back */
+static void capture_task(void *arg)
+{
+    FILE *f = arg;
+    for (uint32_t n = 1;; n++) {
+        vTaskDelay(pdMS_TO_TICKS(CAPTURE_DRAIN_MS));
+        if (urb_capture_drain(trace_write_file, f, NULL) != ESP_OK ||
+                (n % CAPTURE_FLUSH_EVERY == 0 && fflush(f) != 0)) {
+            ESP_LOGE(TAG, "capture write failed (card full?), capture stopped");
+            fclose(f);
+            vTaskDelete(NULL);
+        }
+        const uint32_t dropped = urb_capture_take_dropped();
+        if (dropped) {
+            ESP_LOGW(TAG, "%" PRIu32 " URBs left out of the capture (SD card too slow)", dropped);
+        }
     }
-    usb_host_transfer_free(xfer);
-    return ret;
 }
 
-/* ================== ISO callback ================== */
-static void isoc_in_cb(usb_transfer_t *t)
+static esp_err_t capture_start(void)
 {
-    const int mps = (int)(intptr_t)t->context;
-    size_t off = 0;
+    const esp_vfs_fat_sdmmc_mount_config_t mount_cfg = {
+        .format_if_mount_failed = false,
+        .max_files = 2,
+        .allocation_unit_size = 64 * 1024,  // big clusters: fewer FAT updates while streaming
+    };
+    const sdmmc_host_t host = SDMMC_HOST_DEFAULT();
+    const sdmmc_slot_config_t slot = SDMMC_SLOT_CONFIG_DEFAULT();
+    sdmmc_card_t *card;
+    ESP_RETURN_ON_ERROR(esp_vfs_fat_sdmmc_mount(CAPTURE_MOUNT, &host, &slot, &mount_cfg, &card), TAG, "SD card");
+    // A new file every boot: urb0000.bin, urb0001.bin...
+    char path[32];
+    struct stat st;
+    int i = 0;
+    do {
+        snprintf(path, sizeof(path), CAPTURE_MOUNT "/urb%04d.bin", i++);
+    } while (stat(path, &st) == 0 && i < 10000);
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        ESP_LOGE(TAG, "can't create %s", path);
+        return ESP_FAIL;
+    }
+    ESP_RETURN_ON_ERROR(urb_capture_start(CONFIG_APP_URB_CAPTURE_RING_KB * 1024), TAG, "capture ring");
+    ESP_LOGI(TAG, "capturing URBs to %s", path);
+    return app_task_start(APP_TASK_CAPTURE, capture_task, f, NULL);
+}
+#endif
 
-    const int64_t now_us = esp_timer_get_time();
-    static int16_t last_first_sample = 0;
-
-    for (int i = 0; i < t->num_isoc_packets; i++) {
-        const usb_isoc_packet_desc_t *d = &t->isoc_packet_desc[i];
-        if (d->status == USB_TRANSFER_STATUS_COMPLETED && d->actual_num_bytes) {
-            const int16_t *pcm = (const int16_t *)(t->data_buffer + off);
-            last_first_sample = pcm[0];
-            g_pkt_cnt++;
-            g_byte_cnt += d->actual_num_bytes;
+/* ================== Deferred log ================== */
+#define DLOG_POLL_MS            50
+#define DLOG_ANCHOR_EVERY_US    (5 * 1000000)   // a decoder attached mid-stream waits at most this long
+
+/* Formats (or frames) what DLOGx queued on the URB and audio paths */
+static void dlog_task(void *arg)
+{
+#if CONFIG_APP_DLOG_BINARY
+    static uint8_t frame[DLOG_FRAME_MAX];
+    int64_t next_anchor_us = 0;
+#else
+    static char line[160];
+#endif
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(DLOG_POLL_MS));
+        const uint32_t dropped = dlog_take_dropped();
+        if (dropped) {
+            ESP_LOGW(TAG, "%" PRIu32 " deferred log records dropped", dropped);
+        }
+        dlog_record_t r;
+        while (dlog_pop(&r)) {
+#if CONFIG_APP_DLOG_BINARY
+            size_t len;
+            if (esp_timer_get_time() >= next_anchor_us &&
+                    dlog_encode(NULL, frame, sizeof(frame), &len) == ESP_OK) {
+                uart_write_bytes(CONFIG_APP_METRICS_UART_NUM, frame, len);
+                next_anchor_us = esp_timer_get_time() + DLOG_ANCHOR_EVERY_US;
+            }
+            if (dlog_encode(&r, frame, sizeof(frame), &len) == ESP_OK) {
+                uart_write_bytes(CONFIG_APP_METRICS_UART_NUM, frame, len);
+            }
+#else
+            dlog_format(&r, line, sizeof(line));
+            printf("%s\n", line);
+#endif
         }
-        off += mps;
     }
+}
 
-    // Log every 500 ms
-    if (now_us - g_last_log_us > 500000) {
-        float kbps = (g_byte_cnt * 8.0f) / ((now_us - g_last_log_us) / 1000.0f);
-        ESP_LOGI(TAG, "pkts=%llu bytes=%llu ~%.1f kbps first_sample=%d",
-                 (unsigned long long)g_pkt_cnt,
-                 (unsigned long long)g_byte_cnt,
-                 kbps,
-                 last_first_sample);
-        g_pkt_cnt = 0;
-        g_byte_cnt = 0;
-        g_last_log_us = now_us;
-    }
+static esp_err_t dlog_start(void)
+{
+    return app_task_start(APP_TASK_DLOG, dlog_task, NULL, NULL);
+}
 
-    // Re-submit THIS URB immediately
-    esp_err_t err = usb_host_transfer_submit(t);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "ISO resubmit failed: %s", esp_err_to_name(err));
-        usb_host_transfer_free(t);
+/* ================== Level meter ================== */
+static void level_log_cb(level_meter_period_t period, const level_summary_t *s, void *ctx)
+{
+    if (period != LEVEL_METER_MINUTE) {
+        return;
     }
+    // Two records: all six values are more than DLOG_ARG_BYTES
+    DLOGI(TAG, "minute @%llu: rms=%.1f peak=%.1f dBFS clip=%" PRIu32,
+          (unsigned long long)s->t0, s->rms_dbfs, s->peak_dbfs, s->clip_count);
+    DLOGI(TAG, "minute @%llu: dc=%.1f missing=%" PRIu32,
+          (unsigned long long)s->t0, s->dc, (uint32_t)(60u * audio_stream_sample_rate()) - s->samples);
+}
+
+static void level_rate_cb(uint32_t sample_rate_hz, void *ctx)
+{
+    level_meter_set_sample_rate(s_meter, sample_rate_hz);
+}
+
+static esp_err_t level_start(void)
+{
+    const level_meter_config_t cfg = {
+        .sample_rate_hz = CONFIG_APP_SAMPLE_RATE_HZ,
+        .clip_level = 0,    // default: only full-scale samples count as clipped
+    };
+    ESP_RETURN_ON_ERROR(level_meter_create(&cfg, &s_meter), TAG, "level_meter_create");
+    ESP_RETURN_ON_ERROR(level_meter_subscribe(s_meter, level_log_cb, NULL), TAG, "level subscribe");
+    ESP_RETURN_ON_ERROR(audio_stream_on_rate_change(level_rate_cb, NULL), TAG, "level rate");
+    return audio_stream_subscribe(level_meter_stream_cb, s_meter);
 }
 
-/* ================== Start ISO stream (multi-URB) ================== */
-static esp_err_t start_isoc_stream(uint8_t ep_addr, int mps)
+/* ================== DC removal / high-pass ================== */
+#if CONFIG_APP_HPF_ENABLE
+static esp_err_t hpf_design(uint32_t sample_rate_hz, biquad_config_t *cfg)
 {
-    size_t buf_size = mps * ISO_PKTS_PER_URB;
+    // DC blocker first, then Butterworth sections at the wind cutoff
+    cfg->num_sections = 1 + CONFIG_APP_HPF_SECTIONS;
+    ESP_RETURN_ON_ERROR(biquad_design_dc_block(2.0f, sample_rate_hz, &cfg->sections[0]), TAG, "dc block");
+    for (size_t s = 1; s < cfg->num_sections; s++) {
+        ESP_RETURN_ON_ERROR(biquad_design_highpass(CONFIG_APP_HPF_CUTOFF_HZ, 0.7071f, sample_rate_hz,
+                                                   &cfg->sections[s]), TAG, "high-pass");
+    }
+    return ESP_OK;
+}
 
-    for (int u = 0; u < NUM_ISO_URBS; u++) {
-        usb_transfer_t *xfer;
-        ESP_RETURN_ON_ERROR(usb_host_transfer_alloc(buf_size, ISO_PKTS_PER_URB, &xfer),
-                            TAG, "alloc iso");
-        s_iso_urbs[u] = xfer;
+static void hpf_rate_cb(uint32_t sample_rate_hz, void *ctx)
+{
+    biquad_config_t cfg;
+    if (hpf_design(sample_rate_hz, &cfg) == ESP_OK) {
+        biquad_set_sections(s_hpf, cfg.sections, cfg.num_sections);
+    }
+}
 
-        xfer->device_handle    = g_dev;
-        xfer->bEndpointAddress = ep_addr;
-        xfer->callback         = isoc_in_cb;
-        xfer->context          = (void*)(intptr_t)mps;
-        xfer->num_bytes        = buf_size;
+static esp_err_t hpf_start(void)
+{
+    biquad_config_t cfg = {
+        .channels = 1,
+        .max_frames = uac_driver_max_block_samples(),
+    };
+    ESP_RETURN_ON_ERROR(hpf_design(CONFIG_APP_SAMPLE_RATE_HZ, &cfg), TAG, "hpf design");
+    ESP_RETURN_ON_ERROR(biquad_create(&cfg, &s_hpf), TAG, "biquad_create");
+    ESP_RETURN_ON_ERROR(audio_stream_on_rate_change(hpf_rate_cb, NULL), TAG, "hpf rate");
+    return audio_stream_add_filter(biquad_stream_filter, s_hpf);
+}
+#endif
 
-        for (int i = 0; i < ISO_PKTS_PER_URB; i++) {
-            xfer->isoc_packet_desc[i].num_bytes = mps;
+/* ================== Spectrogram ================== */
+#if CONFIG_APP_STFT_ENABLE || CONFIG_APP_DSP_GRAPH_ENABLE
+static void stft_log_cb(const stft_frame_t *f, void *arg)
+{
+    // Once a second: strongest bin, as a sanity check that frames flow
+    static uint64_t next_log_t = 0;
+    if (f->t0 < next_log_t) {
+        return;
+    }
+    const uint32_t fs = audio_stream_sample_rate();
+    next_log_t = f->t0 + fs;
+    size_t pk = 1;
+    for (size_t k = 2; k < f->nbins; k++) {
+        if (f->power[k] > f->power[pk]) {
+            pk = k;
         }
     }
+    DLOGI(TAG, "STFT frame=%" PRIu32 " peak=%u Hz",
+          f->index, (unsigned)(pk * fs / (2u * (f->nbins - 1u))));
+}
+#endif
 
-    // Submit ALL of them so the controller always has work
-    for (int u = 0; u < NUM_ISO_URBS; u++) {
-        esp_err_t err = usb_host_transfer_submit(s_iso_urbs[u]);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "submit iso urb %d failed: %s", u, esp_err_to_name(err));
-            return err;
+#if CONFIG_APP_STFT_ENABLE
+
+static esp_err_t stft_start(void)
+{
+    const stft_config_t cfg = {
+        .fft_size = CONFIG_APP_STFT_FFT_SIZE,
+        .hop = CONFIG_APP_STFT_HOP,
+        .window = STFT_WINDOW_HANN,
+    };
+    stft_t *stft;
+    ESP_RETURN_ON_ERROR(stft_create(&cfg, &stft), TAG, "stft_create");
+    ESP_RETURN_ON_ERROR(stft_subscribe(stft, stft_log_cb, NULL), TAG, "stft_subscribe");
+    return audio_stream_subscribe(stft_stream_cb, stft);
+}
+#endif
+
+/* ================== Band detector ================== */
+#if CONFIG_APP_GOERTZEL_ENABLE || CONFIG_APP_DSP_GRAPH_ENABLE
+static void goertzel_log_cb(const goertzel_result_t *r, void *arg)
+{
+    const uint32_t changed = r->rising_mask | r->falling_mask;
+    for (size_t b = 0; b < r->num_bands; b++) {
+        if (changed & (1u << b)) {
+            DLOGI(TAG, "band %u %s at sample %llu (%.1f dBFS)", (unsigned)b,
+                  (r->rising_mask & (1u << b)) ? "ON" : "OFF",
+                  (unsigned long long)r->t0, r->level_dbfs[b]);
         }
     }
-    return ESP_OK;
 }
+#endif
 
-/* ================== Client event callback ================== */
-static void client_event_cb(const usb_host_client_event_msg_t *event_msg, void *arg)
+#if CONFIG_APP_GOERTZEL_ENABLE
+
+static void goertzel_rate_cb(uint32_t sample_rate_hz, void *ctx)
 {
-    switch (event_msg->event) {
-    case USB_HOST_CLIENT_EVENT_NEW_DEV: {
-        ESP_LOGI(TAG, "NEW_DEV addr=%d", event_msg->new_dev.address);
-        ESP_ERROR_CHECK(usb_host_device_open(g_client, event_msg->new_dev.address, &g_dev));
+    if (goertzel_set_sample_rate((goertzel_t *)ctx, sample_rate_hz) != ESP_OK) {
+        ESP_LOGW(TAG, "Goertzel bands above Nyquist at %" PRIu32 " Hz; detector results are stale", sample_rate_hz);
+    }
+}
 
-        // IF=1 ALT=1, EP 0x82 (ISO IN), MPS=96
-        ESP_ERROR_CHECK(usb_host_interface_claim(g_client, g_dev, 1, 1));
-        ESP_ERROR_CHECK(ctrl_set_interface(1, 1));
+#if CONFIG_APP_FANOUT_ENABLE
+/* The bank in a task of its own, off the ingest core, reading raw frames
+ * from the fan-out instead of running inside the client task. The frames
+ * are from before the stream's high-pass, so the task runs its own copy:
+ * detection doesn't change with the fan-out. */
+typedef struct {
+    goertzel_t *bank;
+    audio_fanout_sub_t *sub;
+    int16_t *pcm;
+#if CONFIG_APP_HPF_ENABLE
+    biquad_t *hpf;
+#endif
+    TaskHandle_t task;
+} detector_t;
+
+static void detector_notify(void *ctx)
+{
+    xTaskNotifyGive(((detector_t *)ctx)->task);
+}
 
-        esp_err_t err = start_isoc_stream(0x82, ISO_MPS);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "start_isoc_stream failed: %s", esp_err_to_name(err));
+static void detector_task(void *arg)
+{
+    detector_t *d = arg;
+    uint32_t rate = 0;
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        const audio_block_t *blk;
+        while ((blk = audio_fanout_next(d->sub)) != NULL) {
+            // The rate travels with the block: no callback racing this task
+            if (blk->sample_rate_hz != rate) {
+                rate = blk->sample_rate_hz;
+                goertzel_rate_cb(rate, d->bank);
+#if CONFIG_APP_HPF_ENABLE
+                biquad_config_t cfg;
+                if (hpf_design(rate, &cfg) == ESP_OK) {
+                    biquad_set_sections(d->hpf, cfg.sections, cfg.num_sections);
+                }
+#endif
+            }
+            const size_t ch = CONFIG_APP_STREAM_CHANNEL < blk->channels ? CONFIG_APP_STREAM_CHANNEL
+                              : blk->channels - 1u;
+            dsp_q31_to_s16(d->pcm, blk->frames + ch, blk->channels, blk->nframes);
+#if CONFIG_APP_HPF_ENABLE
+            biquad_process(d->hpf, d->pcm, blk->nframes);
+#endif
+            goertzel_process(d->bank, d->pcm, blk->nframes, blk->t0);
         }
-        break;
     }
-    case USB_HOST_CLIENT_EVENT_DEV_GONE:
-        ESP_LOGW(TAG, "DEV_GONE");
-        // TODO: stop stream and free URBs if you want to support hot-unplug
+}
+
+static esp_err_t detector_start(goertzel_t *bank)
+{
+    const audio_fanout_config_t fcfg = {
+        .num_blocks = CONFIG_APP_FANOUT_BLOCKS,
+        .block_samples = CONFIG_APP_FANOUT_BLOCK_SAMPLES,
+    };
+    audio_fanout_t *fo;
+    ESP_RETURN_ON_ERROR(audio_fanout_create(&fcfg, &fo), TAG, "audio_fanout_create");
+    static detector_t d;
+    d.bank = bank;
+    // A mono block is the longest run of one channel
+    d.pcm = malloc(CONFIG_APP_FANOUT_BLOCK_SAMPLES * sizeof(int16_t));
+    if (d.pcm == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+#if CONFIG_APP_HPF_ENABLE
+    biquad_config_t hcfg = {
+        .channels = 1,
+        .max_frames = CONFIG_APP_FANOUT_BLOCK_SAMPLES,
+    };
+    ESP_RETURN_ON_ERROR(hpf_design(CONFIG_APP_SAMPLE_RATE_HZ, &hcfg), TAG, "hpf design");
+    ESP_RETURN_ON_ERROR(biquad_create(&hcfg, &d.hpf), TAG, "biquad_create");
+#endif
+    ESP_RETURN_ON_ERROR(app_task_start(APP_TASK_DETECTOR, detector_task, &d, &d.task), TAG, "detector task");
+    const audio_fanout_sub_config_t scfg = {
+        .name = "detect",
+        .depth = CONFIG_APP_FANOUT_DETECTOR_DEPTH,
+        // Late results are worth less than current ones
+        .policy = AUDIO_FANOUT_DROP_OLDEST,
+        .notify = detector_notify,
+        .ctx = &d,
+    };
+    ESP_RETURN_ON_ERROR(audio_fanout_subscribe(fo, &scfg, &d.sub), TAG, "detector subscribe");
+    return audio_stream_subscribe_frames(audio_fanout_publish, fo);
+}
+#endif
+
+static esp_err_t goertzel_start(void)
+{
+    goertzel_config_t cfg = {
+        .sample_rate_hz = CONFIG_APP_SAMPLE_RATE_HZ,
+        .block_len = CONFIG_APP_GOERTZEL_BLOCK_LEN,
+        .hann = true,
+    };
+    ESP_RETURN_ON_ERROR(goertzel_config_add_bands(&cfg, CONFIG_APP_GOERTZEL_BANDS_HZ,
+                                                  (float)CONFIG_APP_GOERTZEL_THRESHOLD_DBFS),
+                        TAG, "bad CONFIG_APP_GOERTZEL_BANDS_HZ");
+    goertzel_t *bank;
+    ESP_RETURN_ON_ERROR(goertzel_create(&cfg, &bank), TAG, "goertzel_create");
+    ESP_RETURN_ON_ERROR(goertzel_subscribe(bank, goertzel_log_cb, NULL), TAG, "goertzel_subscribe");
+#if CONFIG_APP_FANOUT_ENABLE
+    return detector_start(bank);
+#else
+    ESP_RETURN_ON_ERROR(audio_stream_on_rate_change(goertzel_rate_cb, bank), TAG, "goertzel rate");
+    return audio_stream_subscribe(goertzel_stream_cb, bank);
+#endif
+}
+#endif
+
+/* ================== DSP graph ================== */
+#if CONFIG_APP_DSP_GRAPH_ENABLE
+/* The cycle counter widened to 64 bits; a process() call is far shorter than a wrap */
+static uint64_t graph_clock(void)
+{
+    static uint64_t cycles;
+    cycles += (uint32_t)(esp_cpu_get_cycle_count() - (uint32_t)cycles);
+    return cycles;
+}
+
+static void graph_rate_cb(uint32_t sample_rate_hz, void *ctx)
+{
+    if (dsp_graph_set_sample_rate(s_graph, sample_rate_hz) != ESP_OK) {
+        ESP_LOGW(TAG, "DSP graph: a stage can't run at %" PRIu32 " Hz; its results are stale", sample_rate_hz);
+    }
+}
+
+static esp_err_t graph_start(void)
+{
+    const dsp_graph_stages_config_t cfg = {
+        .sample_rate_hz = CONFIG_APP_SAMPLE_RATE_HZ,
+        .max_channels = CONFIG_APP_MAX_CHANNELS,
+        .max_frames = uac_driver_max_block_samples(),
+        .level_cb = level_log_cb,
+        .stft_cb = stft_log_cb,
+        .goertzel_cb = goertzel_log_cb,
+        .clock = graph_clock,
+    };
+    ESP_RETURN_ON_ERROR(dsp_graph_stages_build(CONFIG_APP_DSP_GRAPH, &cfg, &s_graph), TAG,
+                        "bad CONFIG_APP_DSP_GRAPH \"%s\"", CONFIG_APP_DSP_GRAPH);
+    for (size_t k = 0; k < dsp_graph_num_nodes(s_graph); k++) {
+        dsp_graph_node_info_t info;
+        dsp_graph_node_info(s_graph, k, &info);
+        ESP_LOGI(TAG, "DSP graph %u: %s, up to %u frames%s%s%s", (unsigned)k, info.name, (unsigned)info.max_frames,
+                 info.fifo ? ", gathered" : info.split ? ", split" : "", info.in_place ? ", in place" : "",
+                 info.out.type == DSP_GRAPH_NONE ? ", sink" : "");
+    }
+    ESP_RETURN_ON_ERROR(audio_stream_on_rate_change(graph_rate_cb, NULL), TAG, "graph rate");
+    return audio_stream_subscribe_frames(dsp_graph_stream_cb, s_graph);
+}
+#endif
+
+/* ================== Rate schedule ================== */
+#if CONFIG_APP_RATE_SCHEDULE_ENABLE
+static void rate_schedule_cb(void *arg)
+{
+    // Alternate survey and bat mode; each phase re-arms the timer for the next
+    static bool bat;
+    bat = !bat;
+    uac_driver_request_rate(bat ? CONFIG_APP_BAT_RATE_HZ : CONFIG_APP_SURVEY_RATE_HZ);
+    esp_timer_start_once(*(esp_timer_handle_t *)arg,
+                         (uint64_t)(bat ? CONFIG_APP_BAT_SECONDS : CONFIG_APP_SURVEY_SECONDS) * 1000000);
+}
+
+static esp_err_t rate_schedule_start(void)
+{
+    static esp_timer_handle_t timer;
+    const esp_timer_create_args_t args = {
+        .callback = rate_schedule_cb,
+        .arg = &timer,
+        .name = "rate_sched",
+    };
+    ESP_RETURN_ON_ERROR(esp_timer_create(&args, &timer), TAG, "rate timer");
+    return esp_timer_start_once(timer, (uint64_t)CONFIG_APP_SURVEY_SECONDS * 1000000);
+}
+#endif
+
+/* ================== Stream watchdog ================== */
+#if CONFIG_APP_STREAM_WATCHDOG_ENABLE
+#define WATCHDOG_PERIOD_MS      100
+#define ROOT_PORT_OFF_MS        500     // long enough for the device to lose power
+
+static void watchdog_recover(stream_watchdog_stage_t stage, void *ctx)
+{
+    esp_err_t err = ESP_OK;
+    switch (stage) {
+    case STREAM_WATCHDOG_RESUBMIT:
+        uac_driver_request_recovery(UAC_RECOVER_RESTART);
+        break;
+    case STREAM_WATCHDOG_ALT_RESET:
+        uac_driver_request_recovery(UAC_RECOVER_ALT_RESET);
+        break;
+    case STREAM_WATCHDOG_REENUMERATE:
+        // Only a device no client has open is freed: the client task closes its devices first
+        class_driver_request_reenumerate();
+        break;
+    case STREAM_WATCHDOG_POWER_CYCLE:
+        err = usb_host_lib_set_root_port_power(false);
+        vTaskDelay(pdMS_TO_TICKS(ROOT_PORT_OFF_MS));
+        if (err == ESP_OK) {
+            err = usb_host_lib_set_root_port_power(true);
+        }
         break;
     default:
         break;
     }
+    if (err != ESP_OK && err != ESP_ERR_NOT_FINISHED) {
+        ESP_LOGE(TAG, "watchdog %s: %s", stream_watchdog_stage_name(stage), esp_err_to_name(err));
+    }
+}
+
+static void watchdog_task(void *arg)
+{
+    stream_watchdog_t *wd = arg;
+    TickType_t wake = xTaskGetTickCount();
+    while (1) {
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(WATCHDOG_PERIOD_MS));
+        stream_watchdog_sample_t s = {
+            .frames = uac_driver_frames_received(),
+            .active = uac_driver_active(),
+        };
+        audio_stream_progress(&s.stream);
+        stream_watchdog_check(wd, &s, esp_timer_get_time());
+    }
 }
 
-/* ================== Client task ================== */
-static void client_task(void *arg)
+static esp_err_t watchdog_start(void)
 {
-    const usb_host_client_config_t cfg = {
-        .is_synchronous = false,
-        .max_num_event_msg = 16,
-        .async = {
-            .client_event_callback = client_event_cb,
-            .callback_arg = NULL,
+    const stream_watchdog_config_t cfg = {
+        .stall_ms = CONFIG_APP_STREAM_WATCHDOG_STALL_MS,
+        .stage_ms = {
+            [STREAM_WATCHDOG_RESUBMIT] = CONFIG_APP_STREAM_WATCHDOG_STAGE_MS,
+            [STREAM_WATCHDOG_ALT_RESET] = CONFIG_APP_STREAM_WATCHDOG_STAGE_MS,
+            [STREAM_WATCHDOG_REENUMERATE] = CONFIG_APP_STREAM_WATCHDOG_ENUM_MS,
+            [STREAM_WATCHDOG_POWER_CYCLE] = CONFIG_APP_STREAM_WATCHDOG_ENUM_MS,
         },
+        .recover = watchdog_recover,
     };
-    ESP_ERROR_CHECK(usb_host_client_register(&cfg, &g_client));
+    stream_watchdog_t *wd;
+    ESP_RETURN_ON_ERROR(stream_watchdog_create(&cfg, &wd), TAG, "stream watchdog");
+    return app_task_start(APP_TASK_WATCHDOG, watchdog_task, wd, NULL);
+}
+#endif
 
-    while (1) {
-        usb_host_client_handle_events(g_client, portMAX_DELAY);
-    }
+/* ================== Class drivers ================== */
+/* Offered each interface in this order */
+static esp_err_t drivers_register(void)
+{
+    const uac_driver_config_t uac_cfg = {
+        .sample_rate_hz = CONFIG_APP_SAMPLE_RATE_HZ,
+    };
+    ESP_RETURN_ON_ERROR(uac_driver_register(&uac_cfg), TAG, "UAC driver");
+#if CONFIG_APP_AUDIOMOTH_CONFIG
+    const audiomoth_settings_t settings = {
+        .sample_rate_hz = CONFIG_APP_SAMPLE_RATE_HZ,
+        .gain = CONFIG_APP_AUDIOMOTH_GAIN,
+        .filter = CONFIG_APP_AUDIOMOTH_HPF_HZ ? AUDIOMOTH_FILTER_HIGH_PASS : AUDIOMOTH_FILTER_NONE,
+        .lower_filter_hz = CONFIG_APP_AUDIOMOTH_HPF_HZ,
+#if CONFIG_APP_AUDIOMOTH_LED
+        .led = true,
+#endif
+    };
+    ESP_RETURN_ON_ERROR(audiomoth_driver_register(&settings), TAG, "AudioMoth driver");
+#endif
+    return desc_logger_register();
 }
 
 /* ================== app_main ================== */
 void app_main(void)
 {
-    ctrl_sem = xSemaphoreCreateBinary();
+#if CONFIG_APP_DSP_BENCH_AT_BOOT
+    dsp_bench_result_t bench[DSP_BENCH_MAX_RESULTS];
+    int nbench = dsp_bench_run(768, 200, bench);   // 768 = one 16 ms URB at 48 kHz
+    if (nbench > 0) {
+        dsp_bench_print(bench, nbench);
+    }
+#endif
+    app_tasks_log();
+    ESP_LOGI(TAG, "DSP kernels: %s backend", dsp_kernels_backend());
+
+#if CONFIG_APP_HPF_ENABLE
+    ESP_ERROR_CHECK(hpf_start());
+#endif
+    ESP_ERROR_CHECK(level_start());
+#if CONFIG_APP_STFT_ENABLE
+    ESP_ERROR_CHECK(stft_start());
+#endif
+#if CONFIG_APP_GOERTZEL_ENABLE
+    ESP_ERROR_CHECK(goertzel_start());
+#endif
+#if CONFIG_APP_DSP_GRAPH_ENABLE
+    ESP_ERROR_CHECK(graph_start());
+#endif
+
+#if CONFIG_APP_TRACE_DUMP_ON_LOSS
+    ESP_ERROR_CHECK(trace_start());
+#endif
+#if CONFIG_APP_URB_CAPTURE
+    // Before the first device: its stream start has to be in the file
+    ESP_ERROR_CHECK(capture_start());
+#endif
+    ESP_ERROR_CHECK(status_start());
+    ESP_ERROR_CHECK(drivers_register());
+#if CONFIG_APP_STREAM_WATCHDOG_ENABLE
+    ESP_ERROR_CHECK(watchdog_start());
+#endif
+#if CONFIG_APP_METRICS_ENABLE
+    // After the drivers have registered their metrics
+    ESP_ERROR_CHECK(metrics_start());
+#endif
+    // With CONFIG_APP_DLOG_BINARY it writes to the metrics UART
+    ESP_ERROR_CHECK(dlog_start());
 
     const usb_host_config_t host_cfg = {
         .skip_phy_setup = false,
@@ -215,6 +738,12 @@ void app_main(void)
     };
     ESP_ERROR_CHECK(usb_host_install(&host_cfg));
 
-    xTaskCreatePinnedToCore(daemon_task, "usb_daemon", 4096, NULL, 3, NULL, 0);
-    xTaskCreatePinnedToCore(client_task, "usb_client", 8192, NULL, 4, NULL, 1);
+    ESP_ERROR_CHECK(app_task_start(APP_TASK_USB_DAEMON, daemon_task, NULL, NULL));
+    ESP_ERROR_CHECK(app_task_start(APP_TASK_USB_CLIENT, class_driver_task, NULL, NULL));
+#if CONFIG_APP_RATE_SCHEDULE_ENABLE
+    ESP_ERROR_CHECK(rate_schedule_start());
+#endif
+#if CONFIG_APP_TASK_PROFILE
+    ESP_ERROR_CHECK(app_tasks_profile_start());
+#endif
 }